@@ -1,7 +1,38 @@
 dnl * I/O loop function
 AC_DEFUN([DOVECOT_IOLOOP], [
   have_ioloop=no
-  
+
+  dnl * io_uring is used only when explicitly requested
+  AS_IF([test "$ioloop" = "uring"], [
+    AC_CACHE_CHECK([whether we can use io_uring],i_cv_io_uring_works,[
+      AC_RUN_IFELSE([AC_LANG_PROGRAM([[
+        #include <string.h>
+        #include <unistd.h>
+        #include <sys/syscall.h>
+        #include <linux/io_uring.h>
+      ]], [[
+        struct io_uring_params params;
+        int fd;
+
+        memset(&params, 0, sizeof(params));
+        fd = syscall(__NR_io_uring_setup, 4, &params);
+        if (fd < 0)
+          return 1;
+        return (params.features & IORING_FEAT_EXT_ARG) == 0;
+      ]])],[
+        i_cv_io_uring_works=yes
+      ], [
+        i_cv_io_uring_works=no
+      ],[])
+    ])
+    AS_IF([test $i_cv_io_uring_works = yes], [
+      AC_DEFINE(IOLOOP_URING,, [Implement I/O loop with Linux io_uring])
+      have_ioloop=yes
+    ], [
+      AC_MSG_ERROR([uring ioloop requested but io_uring (Linux v5.11+) is not available])
+    ])
+  ])
+
   AS_IF([test "$ioloop" = "best" || test "$ioloop" = "epoll"], [
     AC_CACHE_CHECK([whether we can use epoll],i_cv_epoll_works,[
       AC_RUN_IFELSE([AC_LANG_PROGRAM([[
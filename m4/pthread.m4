@@ -0,0 +1,6 @@
+AC_DEFUN([DOVECOT_PTHREAD], [
+  dnl * used by fs-posix's async mode
+  AC_SEARCH_LIBS([pthread_create], [pthread], [
+    AC_DEFINE(HAVE_PTHREAD,, [Define if you have pthreads])
+  ])
+])
@@ -132,6 +132,7 @@ AC_DEFUN([DOVECOT_SSL], [
   DOVECOT_CHECK_SSL_FUNC([SSL_CTX_set_min_proto_version])
   DOVECOT_CHECK_SSL_FUNC([SSL_CTX_set_tmp_dh_callback])
   DOVECOT_CHECK_SSL_FUNC([SSL_CTX_set_tmp_rsa_callback])
+  DOVECOT_CHECK_SSL_FUNC([SSL_CTX_set_tlsext_ticket_key_evp_cb])
   DOVECOT_CHECK_SSL_FUNC([SSL_get1_peer_certificate])
   DOVECOT_CHECK_SSL_FUNC([SSL_load_error_strings])
 
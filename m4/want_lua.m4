@@ -2,8 +2,14 @@ AC_DEFUN([DOVECOT_WANT_LUA], [
   have_lua=no
 
   AS_IF([test "$want_lua" != "no"], [
-    for LUAPC in lua5.3 lua-5.3 lua53 lua5.1 lua-5.1 lua51 lua; do
-      PKG_CHECK_MODULES([LUA], [$LUAPC >= 5.1 $LUAPC != 5.2], [
+    for LUAPC in lua5.3 lua-5.3 lua53 lua5.1 lua-5.1 lua51 luajit lua; do
+      dnl LuaJIT implements the Lua 5.1 API, but uses its own versioning
+      AS_IF([test "$LUAPC" = "luajit"], [
+        LUAPC_REQ="luajit >= 2.0"
+      ], [
+        LUAPC_REQ="$LUAPC >= 5.1 $LUAPC != 5.2"
+      ])
+      PKG_CHECK_MODULES([LUA], [$LUAPC_REQ], [
         have_lua=yes
         AC_MSG_NOTICE([using library $LUAPC])
         break
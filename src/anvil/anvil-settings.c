@@ -41,6 +41,7 @@ struct service_settings anvil_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -50,6 +51,7 @@ struct service_settings anvil_service_settings = {
 	.service_count = 0,
 	.idle_kill = UINT_MAX,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &anvil_unix_listeners_buf,
 			      sizeof(anvil_unix_listeners[0]) } },
@@ -8,6 +8,7 @@
 #include "str.h"
 #include "str-table.h"
 #include "strescape.h"
+#include "wildcard-match.h"
 #include "ostream.h"
 #include "connect-limit.h"
 
@@ -562,13 +563,40 @@ void connect_limit_disconnect_pid(struct connect_limit *limit, pid_t pid)
 		connect_limit_process_free(limit, process);
 }
 
-void connect_limit_dump(struct connect_limit *limit, struct ostream *output)
+static void
+connect_limit_dump_session(string_t *str, const struct session *session)
+{
+	unsigned int alt_idx;
+
+	str_printfa(str, "%lu\t", (unsigned long)session->process->pid);
+	str_append_tabescaped(str, session->userip->username);
+	str_append_c(str, '\t');
+	str_append_tabescaped(str, session->service);
+	str_append_c(str, '\t');
+	if (session->userip->ip.family != 0)
+		str_append(str, net_ip2addr(&session->userip->ip));
+	str_append_c(str, '\t');
+	str_append_tabescaped(str, guid_128_to_string(session->conn_guid));
+	str_append_c(str, '\t');
+	if (session->dest_ip.family != 0)
+		str_append(str, net_ip2addr(&session->dest_ip));
+	for (alt_idx = 0; alt_idx < session->alt_usernames_count; alt_idx++) {
+		str_append_c(str, '\t');
+		if (session->alt_usernames[alt_idx].alt_username != NULL) {
+			str_append_tabescaped(str,
+				session->alt_usernames[alt_idx].alt_username);
+		}
+	}
+	str_append_c(str, '\n');
+}
+
+void connect_limit_dump(struct connect_limit *limit, struct ostream *output,
+			const char *username_mask)
 {
 	struct hash_iterate_context *iter;
 	struct session *session;
 	const uint8_t *conn_guid;
 	const struct alt_username_field *alt_field;
-	unsigned int alt_idx;
 	string_t *str = str_new(default_pool, 256);
 	ssize_t ret = 0;
 
@@ -581,34 +609,21 @@ void connect_limit_dump(struct connect_limit *limit, struct ostream *output)
 	str_append_c(str, '\n');
 	o_stream_nsend(output, str_data(str), str_len(str));
 
-	/* Send all sessions */
+	/* Send all sessions, or only the ones matching the username mask */
 	iter = hash_table_iterate_init(limit->session_hash);
 	while (ret >= 0 &&
 	       hash_table_iterate(iter, limit->session_hash,
-				  &conn_guid, &session)) T_BEGIN {
-		str_truncate(str, 0);
-		str_printfa(str, "%lu\t", (unsigned long)session->process->pid);
-		str_append_tabescaped(str, session->userip->username);
-		str_append_c(str, '\t');
-		str_append_tabescaped(str, session->service);
-		str_append_c(str, '\t');
-		if (session->userip->ip.family != 0)
-			str_append(str, net_ip2addr(&session->userip->ip));
-		str_append_c(str, '\t');
-		str_append_tabescaped(str, guid_128_to_string(session->conn_guid));
-		str_append_c(str, '\t');
-		if (session->dest_ip.family != 0)
-			str_append(str, net_ip2addr(&session->dest_ip));
-		for (alt_idx = 0; alt_idx < session->alt_usernames_count; alt_idx++) {
-			str_append_c(str, '\t');
-			if (session->alt_usernames[alt_idx].alt_username != NULL) {
-				str_append_tabescaped(str,
-					session->alt_usernames[alt_idx].alt_username);
-			}
-		}
-		str_append_c(str, '\n');
-		ret = o_stream_send(output, str_data(str), str_len(str));
-	} T_END;
+				  &conn_guid, &session)) {
+		if (username_mask != NULL &&
+		    !wildcard_match_icase(session->userip->username,
+					  username_mask))
+			continue;
+		T_BEGIN {
+			str_truncate(str, 0);
+			connect_limit_dump_session(str, session);
+			ret = o_stream_send(output, str_data(str), str_len(str));
+		} T_END;
+	}
 	hash_table_iterate_deinit(&iter);
 	o_stream_nsend(output, "\n", 1);
 	str_free(&str);
@@ -58,7 +58,10 @@ void connect_limit_disconnect(struct connect_limit *limit, pid_t pid,
 			      const struct connect_limit_key *key,
 			      const guid_128_t conn_guid);
 void connect_limit_disconnect_pid(struct connect_limit *limit, pid_t pid);
-void connect_limit_dump(struct connect_limit *limit, struct ostream *output);
+/* Dump all sessions, or if username_mask isn't NULL only the sessions whose
+   username matches the (case-insensitive) wildcard mask. */
+void connect_limit_dump(struct connect_limit *limit, struct ostream *output,
+			const char *username_mask);
 
 /* Iterate through sessions of the username. The connect-limit shouldn't be
    modified while the iterator exists. The results are sorted by pid.
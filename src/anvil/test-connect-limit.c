@@ -21,13 +21,13 @@ static guid_128_t session3_guid = {
 #define SESSION3_HEX "300000000000000000000000000000f3"
 
 static void
-test_session_dump(struct connect_limit *limit, const char *expected_altnames,
-		  const char *expected_dump)
+test_session_dump_mask(struct connect_limit *limit, const char *username_mask,
+		       const char *expected_altnames, const char *expected_dump)
 {
 	string_t *str = str_new(default_pool, 128);
 	struct ostream *output = o_stream_create_buffer(str);
 
-	connect_limit_dump(limit, output);
+	connect_limit_dump(limit, output, username_mask);
 	if (str_len(str) == 1) {
 		test_assert_strcmp("", expected_dump);
 		o_stream_destroy(&output);
@@ -68,6 +68,13 @@ test_session_dump(struct connect_limit *limit, const char *expected_altnames,
 	str_free(&str);
 }
 
+static void
+test_session_dump(struct connect_limit *limit, const char *expected_altnames,
+		  const char *expected_dump)
+{
+	test_session_dump_mask(limit, NULL, expected_altnames, expected_dump);
+}
+
 static void test_connect_limit(void)
 {
 	struct connect_limit *limit;
@@ -135,6 +142,16 @@ static void test_connect_limit(void)
 	test_assert(connect_limit_lookup(limit, &key) == 2);
 	test_assert(connect_limit_lookup(limit, &key3) == 0);
 
+	/* dump only some users */
+	test_session_dump_mask(limit, "USER2",
+			       "altkey1\taltkey2\taltkey3\taltkey4",
+			       TEST_SESSION3_STR);
+	test_session_dump_mask(limit, "user*",
+			       "altkey1\taltkey2\taltkey3\taltkey4",
+			       TEST_SESSION1_STR TEST_SESSION2_STR TEST_SESSION3_STR);
+	test_session_dump_mask(limit, "nobody",
+			       "altkey1\taltkey2\taltkey3\taltkey4", "");
+
 	/* duplicate conn-guid */
 	struct connect_limit_key key4 = {
 		.username = "user3",
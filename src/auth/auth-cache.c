@@ -5,15 +5,36 @@
 #include "hash.h"
 #include "str.h"
 #include "strescape.h"
+#include "strnum.h"
+#include "istream.h"
+#include "ostream.h"
 #include "var-expand.h"
+#include "safe-mkstemp.h"
 #include "auth-request.h"
 #include "auth-cache.h"
 #include "auth-common.h"
 
+#include <stdio.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define AUTH_CACHE_FILE_HEADER "AUTHCACHE\t1"
+
+struct auth_cache_waiter {
+	struct auth_request *request;
+	auth_cache_wait_callback_t *callback;
+};
+
+struct auth_cache_inflight {
+	char *key;
+	ARRAY(struct auth_cache_waiter) waiters;
+};
 
 struct auth_cache {
 	HASH_TABLE(char *, struct auth_cache_node *) hash;
+	/* lookups that are running for keys not found in cache */
+	HASH_TABLE(char *, struct auth_cache_inflight *) inflight;
 	struct auth_cache_node *head, *tail;
 	struct event *event;
 
@@ -233,7 +254,9 @@ struct auth_cache *auth_cache_new(size_t max_size, unsigned int ttl_secs,
 	struct auth_cache *cache;
 
 	cache = i_new(struct auth_cache, 1);
-	hash_table_create(&cache->hash, default_pool, 0, str_hash, strcmp);
+	hash_table_create_flags(&cache->hash, default_pool, 0, str_hash, strcmp,
+				HASH_TABLE_FLAG_OPEN_ADDRESSING);
+	hash_table_create(&cache->inflight, default_pool, 0, str_hash, strcmp);
 	cache->max_size = max_size;
 	cache->size_left = max_size;
 	cache->ttl_secs = ttl_secs;
@@ -247,11 +270,35 @@ struct auth_cache *auth_cache_new(size_t max_size, unsigned int ttl_secs,
 	return cache;
 }
 
+static void auth_cache_inflight_free(struct auth_cache_inflight **_inflight)
+{
+	struct auth_cache_inflight *inflight = *_inflight;
+
+	*_inflight = NULL;
+	array_free(&inflight->waiters);
+	i_free(inflight->key);
+	i_free(inflight);
+}
+
 void auth_cache_free(struct auth_cache **_cache)
 {
 	struct auth_cache *cache = *_cache;
+	struct hash_iterate_context *iter;
+	struct auth_cache_inflight *inflight;
+	struct auth_cache_waiter *waiter;
+	char *key;
 
 	*_cache = NULL;
+	/* the waiting requests are already aborted at this point */
+	iter = hash_table_iterate_init(cache->inflight);
+	while (hash_table_iterate(iter, cache->inflight, &key, &inflight)) {
+		array_foreach_modifiable(&inflight->waiters, waiter)
+			auth_request_unref(&waiter->request);
+		auth_cache_inflight_free(&inflight);
+	}
+	hash_table_iterate_deinit(&iter);
+	hash_table_destroy(&cache->inflight);
+
 	lib_signals_unset_handler(SIGHUP, sig_auth_cache_clear, cache);
 	lib_signals_unset_handler(SIGUSR2, sig_auth_cache_stats, cache);
 
@@ -418,19 +465,15 @@ auth_cache_lookup(struct auth_cache *cache, const struct auth_request *request,
 	return value;
 }
 
-void auth_cache_insert(struct auth_cache *cache, struct auth_request *request,
-		       const char *key, const char *value, bool last_success)
+static void
+auth_cache_insert_expanded(struct auth_cache *cache, const char *key,
+			   const char *value, bool last_success,
+			   time_t created)
 {
         struct auth_cache_node *node;
 	size_t data_size, alloc_size, key_len, value_len = strlen(value);
 	char *hash_key;
 
-	if (*value == '\0' && cache->neg_ttl_secs == 0) {
-		/* we're not caching negative entries */
-		return;
-	}
-
-	key = auth_request_expand_cache_key(request, key, request->fields.translated_username);
 	key_len = strlen(key);
 
 	data_size = key_len + 1 + value_len + 1;
@@ -448,7 +491,7 @@ void auth_cache_insert(struct auth_cache *cache, struct auth_request *request,
 
 	/* @UNSAFE */
 	node = i_malloc(alloc_size);
-	node->created = time(NULL);
+	node->created = created;
 	node->alloc_size = alloc_size;
 	node->last_success = last_success;
 	memcpy(node->data, key, key_len);
@@ -469,6 +512,73 @@ void auth_cache_insert(struct auth_cache *cache, struct auth_request *request,
 	}
 }
 
+void auth_cache_insert(struct auth_cache *cache, struct auth_request *request,
+		       const char *key, const char *value, bool last_success)
+{
+	if (*value == '\0' && cache->neg_ttl_secs == 0) {
+		/* we're not caching negative entries */
+		return;
+	}
+
+	key = auth_request_expand_cache_key(request, key, request->fields.translated_username);
+	auth_cache_insert_expanded(cache, key, value, last_success, time(NULL));
+}
+
+bool auth_cache_lookup_wait(struct auth_cache *cache,
+			    struct auth_request *request, const char *key,
+			    auth_cache_wait_callback_t *callback)
+{
+	struct auth_cache_inflight *inflight;
+	struct auth_cache_waiter *waiter;
+
+	/* previous lookup of this request must be finished before the next
+	   one can be coalesced */
+	auth_cache_lookup_finished(cache, request);
+
+	key = auth_request_expand_cache_key(request, key, request->fields.translated_username);
+	inflight = hash_table_lookup(cache->inflight, key);
+	if (inflight == NULL) {
+		inflight = i_new(struct auth_cache_inflight, 1);
+		inflight->key = i_strdup(key);
+		i_array_init(&inflight->waiters, 4);
+		hash_table_insert(cache->inflight, inflight->key, inflight);
+		request->cache_inflight_key = p_strdup(request->pool, key);
+		return FALSE;
+	}
+
+	waiter = array_append_space(&inflight->waiters);
+	waiter->request = request;
+	waiter->callback = callback;
+	auth_request_ref(request);
+	return TRUE;
+}
+
+void auth_cache_lookup_finished(struct auth_cache *cache,
+				struct auth_request *request)
+{
+	struct auth_cache_inflight *inflight;
+	struct auth_cache_waiter *waiter;
+
+	if (request->cache_inflight_key == NULL)
+		return;
+
+	inflight = hash_table_lookup(cache->inflight,
+				     request->cache_inflight_key);
+	i_assert(inflight != NULL);
+	hash_table_remove(cache->inflight, inflight->key);
+	request->cache_inflight_key = NULL;
+
+	/* The waiters may start new lookups for the same key, which are
+	   tracked separately since this one was already removed. */
+	array_foreach_modifiable(&inflight->waiters, waiter) {
+		struct auth_request *waiting_request = waiter->request;
+
+		waiter->callback(waiting_request);
+		auth_request_unref(&waiting_request);
+	}
+	auth_cache_inflight_free(&inflight);
+}
+
 void auth_cache_remove(struct auth_cache *cache,
 		       const struct auth_request *request, const char *key)
 {
@@ -481,3 +591,134 @@ void auth_cache_remove(struct auth_cache *cache,
 
 	auth_cache_node_destroy(cache, node);
 }
+
+static bool
+auth_cache_node_is_expired(struct auth_cache *cache,
+			   const char *value, time_t created, time_t now)
+{
+	unsigned int ttl_secs;
+
+	ttl_secs = *value == '\0' ? cache->neg_ttl_secs : cache->ttl_secs;
+	return created < now - (time_t)ttl_secs;
+}
+
+int auth_cache_save(struct auth_cache *cache, const char *path,
+		    const char *tag, const char **error_r)
+{
+	struct auth_cache_node *node;
+	struct ostream *output;
+	const char *temp_path, *key, *value;
+	time_t now = time(NULL);
+	string_t *str;
+	int fd;
+
+	str = t_str_new(256);
+	str_append(str, path);
+	str_append_c(str, '.');
+	fd = safe_mkstemp_hostpid(str, 0600, (uid_t)-1, (gid_t)-1);
+	if (fd == -1) {
+		*error_r = t_strdup_printf("safe_mkstemp(%s) failed: %m",
+					   str_c(str));
+		return -1;
+	}
+	temp_path = t_strdup(str_c(str));
+	output = o_stream_create_fd_file_autoclose(&fd, 0);
+	o_stream_cork(output);
+	o_stream_nsend_str(output, t_strdup_printf(
+		AUTH_CACHE_FILE_HEADER"\t%s\n", str_tabescape(tag)));
+
+	/* write the oldest entries first, so that loading them preserves
+	   the LRU order */
+	for (node = cache->tail; node != NULL; node = node->next) {
+		key = node->data;
+		value = key + strlen(key) + 1;
+		if (auth_cache_node_is_expired(cache, value, node->created, now))
+			continue;
+
+		str_truncate(str, 0);
+		str_printfa(str, "%ld\t%c\t", (long)node->created,
+			    node->last_success ? '1' : '0');
+		str_append_tabescaped(str, key);
+		str_append_c(str, '\t');
+		str_append_tabescaped(str, value);
+		str_append_c(str, '\n');
+		o_stream_nsend(output, str_data(str), str_len(str));
+	}
+	if (o_stream_finish(output) < 0) {
+		*error_r = t_strdup_printf("write(%s) failed: %s", temp_path,
+					   o_stream_get_error(output));
+		o_stream_destroy(&output);
+		i_unlink(temp_path);
+		return -1;
+	}
+	o_stream_destroy(&output);
+
+	if (rename(temp_path, path) < 0) {
+		*error_r = t_strdup_printf("rename(%s, %s) failed: %m",
+					   temp_path, path);
+		i_unlink(temp_path);
+		return -1;
+	}
+	return 0;
+}
+
+int auth_cache_load(struct auth_cache *cache, const char *path,
+		    const char *tag, const char **error_r)
+{
+	struct istream *input;
+	const char *line, *const *args;
+	time_t now = time(NULL);
+	long long created;
+	unsigned int linenum = 1;
+	bool corrupted = FALSE;
+	int ret = 0;
+
+	input = i_stream_create_file(path, IO_BLOCK_SIZE);
+	line = i_stream_read_next_line(input);
+	if (line == NULL) {
+		if (input->stream_errno == ENOENT) {
+			/* nothing saved yet */
+		} else if (input->stream_errno != 0) {
+			*error_r = t_strdup_printf("read(%s) failed: %s", path,
+						   i_stream_get_error(input));
+			ret = -1;
+		}
+		i_stream_unref(&input);
+		return ret;
+	}
+	if (strcmp(line, t_strdup_printf(AUTH_CACHE_FILE_HEADER"\t%s",
+					 str_tabescape(tag))) != 0) {
+		/* written with a different configuration or version */
+		i_stream_unref(&input);
+		return 0;
+	}
+
+	while (!corrupted &&
+	       (line = i_stream_read_next_line(input)) != NULL) T_BEGIN {
+		linenum++;
+		args = t_strsplit_tabescaped(line);
+		if (str_array_length(args) != 4 ||
+		    str_to_llong(args[0], &created) < 0 ||
+		    (args[1][0] != '0' && args[1][0] != '1'))
+			corrupted = TRUE;
+		else if (!auth_cache_node_is_expired(cache, args[3],
+						     (time_t)created, now) &&
+			 (args[3][0] != '\0' || cache->neg_ttl_secs > 0)) {
+			auth_cache_insert_expanded(cache, args[2], args[3],
+						   args[1][0] == '1',
+						   (time_t)created);
+			ret++;
+		}
+	} T_END;
+	if (corrupted) {
+		*error_r = t_strdup_printf("%s: Corrupted line %u",
+					   path, linenum);
+		ret = -1;
+	} else if (input->stream_errno != 0) {
+		*error_r = t_strdup_printf("read(%s) failed: %s", path,
+					   i_stream_get_error(input));
+		ret = -1;
+	}
+	i_stream_unref(&input);
+	return ret;
+}
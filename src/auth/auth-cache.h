@@ -16,6 +16,8 @@ struct auth_cache_node {
 struct auth_cache;
 struct auth_request;
 
+typedef void auth_cache_wait_callback_t(struct auth_request *request);
+
 /* Parses all %x variables from query and compresses them into tab-separated
    list, so it can be used as a cache key. */
 char *auth_cache_parse_key(pool_t pool, const char *query);
@@ -45,6 +47,32 @@ auth_cache_lookup(struct auth_cache *cache, const struct auth_request *request,
 void auth_cache_insert(struct auth_cache *cache, struct auth_request *request,
 		       const char *key, const char *value, bool last_success);
 
+/* Write all the non-expired cache entries to path, so they can be loaded
+   with auth_cache_load() after the process has been restarted. tag
+   identifies the configuration the entries were created with. */
+int auth_cache_save(struct auth_cache *cache, const char *path,
+		    const char *tag, const char **error_r);
+/* Load cache entries written by auth_cache_save(). Entries whose TTL has
+   already expired are skipped. If the file was written with a different tag,
+   it's ignored. Returns the number of loaded entries, or -1 on error. */
+int auth_cache_load(struct auth_cache *cache, const char *path,
+		    const char *tag, const char **error_r);
+
+/* Coalesce concurrent identical passdb/userdb lookups. If a lookup for the
+   same expanded key is already running, returns TRUE and calls callback
+   after auth_cache_lookup_finished() is called for it. The callback should
+   then retry the cache lookup. Otherwise returns FALSE and the caller is
+   expected to do the lookup and call auth_cache_lookup_finished() after it
+   has updated the cache. */
+bool auth_cache_lookup_wait(struct auth_cache *cache,
+			    struct auth_request *request, const char *key,
+			    auth_cache_wait_callback_t *callback);
+/* Finish the lookup started after auth_cache_lookup_wait() returned FALSE,
+   and wake up the waiting requests. Does nothing if there's no such lookup
+   for the request. */
+void auth_cache_lookup_finished(struct auth_cache *cache,
+				struct auth_request *request);
+
 /* Remove key from cache */
 void auth_cache_remove(struct auth_cache *cache,
 		       const struct auth_request *request,
@@ -3,13 +3,22 @@
 #include "auth-common.h"
 #include "str.h"
 #include "strescape.h"
+#include "hash.h"
 #include "auth-request.h"
 
+/* Templates come from settings, so there are only a few of them. This is
+   only a safety limit in case something expands dynamically built strings. */
+#define AUTH_REQUEST_VAR_EXPAND_MAX_PROGRAMS 256
+
 struct auth_request_var_expand_ctx {
 	const struct auth_request *auth_request;
 	auth_request_escape_func_t *escape_func;
 };
 
+static pool_t auth_request_var_expand_pool;
+static HASH_TABLE(const char *, struct var_expand_program *)
+	auth_request_var_expand_programs;
+
 /* Update this offset when you add new values */
 #define ALIAS(x) ((x)+36)
 const struct var_expand_table
@@ -282,6 +291,32 @@ int auth_request_var_expand(string_t *dest, const char *str,
 		escape_func, error_r);
 }
 
+static struct var_expand_program *
+auth_request_var_expand_program_get(const char *str)
+{
+	struct var_expand_program *program;
+	const char *key;
+
+	if (!hash_table_is_created(auth_request_var_expand_programs)) {
+		auth_request_var_expand_pool =
+			pool_alloconly_create("auth var expand programs", 4096);
+		hash_table_create(&auth_request_var_expand_programs,
+				  auth_request_var_expand_pool, 0,
+				  str_hash, strcmp);
+	}
+	program = hash_table_lookup(auth_request_var_expand_programs, str);
+	if (program != NULL)
+		return program;
+	if (hash_table_count(auth_request_var_expand_programs) >=
+	    AUTH_REQUEST_VAR_EXPAND_MAX_PROGRAMS)
+		return NULL;
+
+	key = p_strdup(auth_request_var_expand_pool, str);
+	program = var_expand_program_create(auth_request_var_expand_pool, key);
+	hash_table_insert(auth_request_var_expand_programs, key, program);
+	return program;
+}
+
 int auth_request_var_expand_with_table(string_t *dest, const char *str,
 				       const struct auth_request *auth_request,
 				       const struct var_expand_table *table,
@@ -289,10 +324,19 @@ int auth_request_var_expand_with_table(string_t *dest, const char *str,
 				       const char **error_r)
 {
 	struct auth_request_var_expand_ctx ctx;
+	struct var_expand_program *program;
 
 	i_zero(&ctx);
 	ctx.auth_request = auth_request;
 	ctx.escape_func = escape_func == NULL ? escape_none : escape_func;
+
+	/* the same templates are expanded for each request, so parse them
+	   only once */
+	program = auth_request_var_expand_program_get(str);
+	if (program != NULL) {
+		return var_expand_program_execute(dest, program, table,
+			auth_request_var_funcs_table, &ctx, error_r);
+	}
 	return var_expand_with_funcs(dest, str, table,
 				     auth_request_var_funcs_table, &ctx, error_r);
 }
@@ -308,3 +352,10 @@ int t_auth_request_var_expand(const char *str,
 	*value_r = str_c(dest);
 	return ret;
 }
+
+void auth_request_var_expand_deinit(void)
+{
+	if (hash_table_is_created(auth_request_var_expand_programs))
+		hash_table_destroy(&auth_request_var_expand_programs);
+	pool_unref(&auth_request_var_expand_pool);
+}
@@ -41,4 +41,7 @@ int t_auth_request_var_expand(const char *str,
 const char *auth_request_str_escape(const char *string,
 				    const struct auth_request *request);
 
+/* Free the templates that were parsed by auth_request_var_expand*(). */
+void auth_request_var_expand_deinit(void);
+
 #endif
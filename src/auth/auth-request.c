@@ -324,6 +324,8 @@ void auth_request_unref(struct auth_request **_request)
 
 	i_assert(array_count(&request->authdb_event) == 0);
 
+	if (passdb_cache != NULL)
+		auth_cache_lookup_finished(passdb_cache, request);
 	if (request->handler_pending_reply)
 		auth_request_handler_abort(request);
 
@@ -915,7 +917,11 @@ void auth_request_verify_plain_callback(enum passdb_result result,
 
 	if (result != PASSDB_RESULT_INTERNAL_FAILURE)
 		auth_request_save_cache(request, result);
-	else {
+	/* wake up the concurrent requests for the same user. they'll find
+	   the result from cache. */
+	if (passdb_cache != NULL)
+		auth_cache_lookup_finished(passdb_cache, request);
+	if (result == PASSDB_RESULT_INTERNAL_FAILURE) {
 		/* lookup failed. if we're looking here only because the
 		   request was expired in cache, fallback to using cached
 		   expired record. */
@@ -1041,12 +1047,65 @@ void auth_request_verify_plain(struct auth_request *request,
 	}
 }
 
+static bool
+auth_request_cache_lookup_wait(struct auth_request *request,
+			       const char *cache_key,
+			       auth_cache_wait_callback_t *callback)
+{
+	if (cache_key == NULL || !request->set->cache_coalesce_lookups)
+		return FALSE;
+	if (!auth_cache_lookup_wait(passdb_cache, request, cache_key, callback))
+		return FALSE;
+	e_debug(authdb_event(request),
+		"cache: waiting for a concurrent lookup to finish");
+	return TRUE;
+}
+
+static void auth_request_verify_plain_lookup(struct auth_request *request)
+{
+	struct auth_passdb *passdb = request->passdb;
+	enum passdb_result result;
+	const char *cache_key, *error;
+	const char *password = request->mech_password;
+
+	cache_key = passdb_cache == NULL ? NULL : passdb->cache_key;
+	if (passdb_cache_verify_plain(request, cache_key, password,
+				      &result, FALSE)) {
+		return;
+	}
+	if (auth_request_cache_lookup_wait(request, cache_key,
+					   auth_request_verify_plain_lookup))
+		return;
+
+	auth_request_set_state(request, AUTH_REQUEST_STATE_PASSDB);
+	/* In case this request had already done a credentials lookup (is it
+	   even possible?), make sure wanted_credentials_scheme is cleared
+	   so passdbs don't think we're doing a credentials lookup. */
+	request->wanted_credentials_scheme = NULL;
+
+	if (passdb->passdb->iface.verify_plain == NULL) {
+		/* we're deinitializing and just want to get rid of this
+		   request */
+		auth_request_verify_plain_callback(
+			PASSDB_RESULT_INTERNAL_FAILURE, request);
+	} else if (passdb->passdb->blocking) {
+		passdb_blocking_verify_plain(request);
+	} else if (passdb_template_export(passdb->default_fields_tmpl,
+					  request, &error) < 0) {
+		e_error(authdb_event(request),
+			"Failed to expand default_fields: %s", error);
+		auth_request_verify_plain_callback(
+			PASSDB_RESULT_INTERNAL_FAILURE, request);
+	} else {
+		passdb->passdb->iface.verify_plain(request, password,
+					   auth_request_verify_plain_callback);
+	}
+}
+
 void auth_request_default_verify_plain_continue(struct auth_request *request,
 						verify_plain_callback_t *callback)
 {
 	struct auth_passdb *passdb;
-	enum passdb_result result;
-	const char *cache_key, *error;
 	const char *password = request->mech_password;
 
 	i_assert(request->state == AUTH_REQUEST_STATE_MECH_CONTINUE);
@@ -1080,36 +1139,7 @@ void auth_request_default_verify_plain_continue(struct auth_request *request,
 
 	auth_request_passdb_lookup_begin(request);
 	request->private_callback.verify_plain = callback;
-
-	cache_key = passdb_cache == NULL ? NULL : passdb->cache_key;
-	if (passdb_cache_verify_plain(request, cache_key, password,
-				      &result, FALSE)) {
-		return;
-	}
-
-	auth_request_set_state(request, AUTH_REQUEST_STATE_PASSDB);
-	/* In case this request had already done a credentials lookup (is it
-	   even possible?), make sure wanted_credentials_scheme is cleared
-	   so passdbs don't think we're doing a credentials lookup. */
-	request->wanted_credentials_scheme = NULL;
-
-	if (passdb->passdb->iface.verify_plain == NULL) {
-		/* we're deinitializing and just want to get rid of this
-		   request */
-		auth_request_verify_plain_callback(
-			PASSDB_RESULT_INTERNAL_FAILURE, request);
-	} else if (passdb->passdb->blocking) {
-		passdb_blocking_verify_plain(request);
-	} else if (passdb_template_export(passdb->default_fields_tmpl,
-					  request, &error) < 0) {
-		e_error(authdb_event(request),
-			"Failed to expand default_fields: %s", error);
-		auth_request_verify_plain_callback(
-			PASSDB_RESULT_INTERNAL_FAILURE, request);
-	} else {
-		passdb->passdb->iface.verify_plain(request, password,
-					   auth_request_verify_plain_callback);
-	}
+	auth_request_verify_plain_lookup(request);
 }
 
 static void
@@ -1183,7 +1213,9 @@ void auth_request_lookup_credentials_callback(enum passdb_result result,
 
 	if (result != PASSDB_RESULT_INTERNAL_FAILURE)
 		auth_request_save_cache(request, result);
-	else {
+	if (passdb_cache != NULL)
+		auth_cache_lookup_finished(passdb_cache, request);
+	if (result == PASSDB_RESULT_INTERNAL_FAILURE) {
 		/* lookup failed. if we're looking here only because the
 		   request was expired in cache, fallback to using cached
 		   expired record. */
@@ -1230,35 +1262,13 @@ void auth_request_lookup_credentials(struct auth_request *request,
 	}
 }
 
-static
-void auth_request_lookup_credentials_policy_continue(struct auth_request *request,
-						     lookup_credentials_callback_t *callback)
+static void
+auth_request_lookup_credentials_lookup(struct auth_request *request)
 {
-	struct auth_passdb *passdb;
+	struct auth_passdb *passdb = request->passdb;
 	const char *cache_key, *cache_cred, *cache_scheme, *error;
 	enum passdb_result result;
 
-	i_assert(request->state == AUTH_REQUEST_STATE_MECH_CONTINUE);
-	if (auth_request_is_disabled_master_user(request)) {
-		callback(PASSDB_RESULT_USER_UNKNOWN, NULL, 0, request);
-		return;
-	}
-	passdb = request->passdb;
-	while (passdb != NULL && auth_request_want_skip_passdb(request, passdb))
-		passdb = passdb->next;
-	request->passdb = passdb;
-
-	if (passdb == NULL) {
-		auth_request_log_error(request,
-			request->mech != NULL ? AUTH_SUBSYS_MECH : "none",
-			"All password databases were skipped");
-		callback(PASSDB_RESULT_INTERNAL_FAILURE, NULL, 0, request);
-		return;
-	}
-
-	auth_request_passdb_lookup_begin(request);
-	request->private_callback.lookup_credentials = callback;
-
 	cache_key = passdb_cache == NULL ? NULL : passdb->cache_key;
 	if (cache_key != NULL) {
 		if (passdb_cache_lookup_credentials(request, cache_key,
@@ -1274,6 +1284,9 @@ void auth_request_lookup_credentials_policy_continue(struct auth_request *reques
 			request->passdb_cache_result = AUTH_REQUEST_CACHE_MISS;
 		}
 	}
+	if (auth_request_cache_lookup_wait(request, cache_key,
+			auth_request_lookup_credentials_lookup))
+		return;
 
 	auth_request_set_state(request, AUTH_REQUEST_STATE_PASSDB);
 
@@ -1299,6 +1312,35 @@ void auth_request_lookup_credentials_policy_continue(struct auth_request *reques
 	}
 }
 
+static
+void auth_request_lookup_credentials_policy_continue(struct auth_request *request,
+						     lookup_credentials_callback_t *callback)
+{
+	struct auth_passdb *passdb;
+
+	i_assert(request->state == AUTH_REQUEST_STATE_MECH_CONTINUE);
+	if (auth_request_is_disabled_master_user(request)) {
+		callback(PASSDB_RESULT_USER_UNKNOWN, NULL, 0, request);
+		return;
+	}
+	passdb = request->passdb;
+	while (passdb != NULL && auth_request_want_skip_passdb(request, passdb))
+		passdb = passdb->next;
+	request->passdb = passdb;
+
+	if (passdb == NULL) {
+		auth_request_log_error(request,
+			request->mech != NULL ? AUTH_SUBSYS_MECH : "none",
+			"All password databases were skipped");
+		callback(PASSDB_RESULT_INTERNAL_FAILURE, NULL, 0, request);
+		return;
+	}
+
+	auth_request_passdb_lookup_begin(request);
+	request->private_callback.lookup_credentials = callback;
+	auth_request_lookup_credentials_lookup(request);
+}
+
 void auth_request_set_credentials(struct auth_request *request,
 				  const char *scheme, const char *data,
 				  set_credentials_callback_t *callback)
@@ -1454,6 +1496,9 @@ void auth_request_userdb_callback(enum userdb_result result,
 		next_userdb = next_userdb->next;
 
 	if (userdb_continue && next_userdb != NULL) {
+		/* results of non-final userdbs aren't cached */
+		if (passdb_cache != NULL)
+			auth_cache_lookup_finished(passdb_cache, request);
 		/* try next userdb. */
 		if (result == USERDB_RESULT_INTERNAL_FAILURE)
 			request->userdbs_seen_internal_failure = TRUE;
@@ -1533,15 +1578,19 @@ void auth_request_userdb_callback(enum userdb_result result,
 				auth_request_get_log_prefix_db(request));
 		}
 	}
+	if (passdb_cache != NULL)
+		auth_cache_lookup_finished(passdb_cache, request);
 
 	 request->private_callback.userdb(result, request);
 }
 
+static void auth_request_lookup_user_lookup(struct auth_request *request);
+
 void auth_request_lookup_user(struct auth_request *request,
 			      userdb_callback_t *callback)
 {
 	struct auth_userdb *userdb = request->userdb;
-	const char *cache_key, *error;
+	const char *error;
 
 	request->private_callback.userdb = callback;
 	request->user_changed_by_lookup = FALSE;
@@ -1564,6 +1613,13 @@ void auth_request_lookup_user(struct auth_request *request,
 	}
 
 	auth_request_userdb_lookup_begin(request);
+	auth_request_lookup_user_lookup(request);
+}
+
+static void auth_request_lookup_user_lookup(struct auth_request *request)
+{
+	struct auth_userdb *userdb = request->userdb;
+	const char *cache_key;
 
 	/* (for now) auth_cache is shared between passdb and userdb */
 	cache_key = passdb_cache == NULL ? NULL : userdb->cache_key;
@@ -1579,6 +1635,9 @@ void auth_request_lookup_user(struct auth_request *request,
 			request->userdb_cache_result = AUTH_REQUEST_CACHE_MISS;
 		}
 	}
+	if (auth_request_cache_lookup_wait(request, cache_key,
+					   auth_request_lookup_user_lookup))
+		return;
 
 	if (userdb->userdb->iface->lookup == NULL) {
 		/* we are deinitializing */
@@ -167,6 +167,9 @@ struct auth_request {
 
 	enum auth_request_cache_result passdb_cache_result;
 	enum auth_request_cache_result userdb_cache_result;
+	/* Expanded cache key of the passdb/userdb lookup that other requests
+	   may be waiting for (see auth_cache_lookup_wait()) */
+	const char *cache_inflight_key;
 
 	/* this is a lookup on auth socket (not login socket).
 	   skip any proxying stuff if enabled. */
@@ -83,6 +83,7 @@ struct service_settings auth_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -92,6 +93,7 @@ struct service_settings auth_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &auth_unix_listeners_buf,
 			      sizeof(auth_unix_listeners[0]) } },
@@ -128,6 +130,7 @@ struct service_settings auth_worker_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -137,6 +140,7 @@ struct service_settings auth_worker_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &auth_worker_unix_listeners_buf,
 			      sizeof(auth_worker_unix_listeners[0]) } },
@@ -274,6 +278,11 @@ static const struct setting_define auth_setting_defines[] = {
 	DEF(TIME, cache_ttl),
 	DEF(TIME, cache_negative_ttl),
 	DEF(BOOL, cache_verify_password_with_worker),
+	DEF(TIME, cache_verified_ttl),
+	DEF(BOOL, cache_coalesce_lookups),
+	DEF(STR, cache_persistent_path),
+	DEF(UINT, worker_queue_limit),
+	DEF(TIME, worker_idle_timeout),
 	DEF(STR, username_chars),
 	DEF(STR, username_translation),
 	DEF(STR, username_format),
@@ -331,6 +340,11 @@ static const struct auth_settings auth_default_settings = {
 	.cache_ttl = 60*60,
 	.cache_negative_ttl = 60*60,
 	.cache_verify_password_with_worker = FALSE,
+	.cache_verified_ttl = 0,
+	.cache_coalesce_lookups = FALSE,
+	.cache_persistent_path = "",
+	.worker_queue_limit = 0,
+	.worker_idle_timeout = 5*60,
 	.username_chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ01234567890.-_@",
 	.username_translation = "",
 	.username_format = "%Lu",
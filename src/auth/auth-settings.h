@@ -45,6 +45,11 @@ struct auth_settings {
 	unsigned int cache_ttl;
 	unsigned int cache_negative_ttl;
 	bool cache_verify_password_with_worker;
+	unsigned int cache_verified_ttl;
+	bool cache_coalesce_lookups;
+	const char *cache_persistent_path;
+	unsigned int worker_queue_limit;
+	unsigned int worker_idle_timeout;
 	const char *username_chars;
 	const char *username_translation;
 	const char *username_format;
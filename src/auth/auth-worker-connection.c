@@ -12,6 +12,7 @@
 #include "str.h"
 #include "strescape.h"
 #include "eacces-error.h"
+#include "time-util.h"
 #include "auth-request.h"
 #include "auth-worker-server.h"
 #include "auth-worker-connection.h"
@@ -25,7 +26,6 @@
    for the users. And because of buffering this timeout is for handling
    multiple users, not just one. */
 #define AUTH_WORKER_RESUME_TIMEOUT_SECS (30*60)
-#define AUTH_WORKER_MAX_IDLE_SECS (5*60)
 #define AUTH_WORKER_ABORT_SECS 60
 #define AUTH_WORKER_DELAY_WARN_SECS 3
 #define AUTH_WORKER_DELAY_WARN_MIN_INTERVAL_SECS (5*60)
@@ -34,6 +34,8 @@
 struct auth_worker_request {
 	unsigned int id;
 	time_t created;
+	/* set when the request had to be queued */
+	struct timeval queued_time;
 	const char *username;
 	const char *data;
 	auth_worker_callback_t *callback;
@@ -57,7 +59,7 @@ static struct connection_list *connections = NULL;
 static unsigned int idle_count = 0, auth_workers_with_errors = 0;
 static ARRAY(struct auth_worker_request *) worker_request_array;
 static struct aqueue *worker_request_queue;
-static time_t auth_worker_last_warn;
+static time_t auth_worker_last_warn, auth_worker_last_drop_warn;
 static unsigned int auth_workers_throttle_count;
 static unsigned int auth_worker_process_limit = 0;
 
@@ -66,6 +68,17 @@ static const char *worker_socket_path;
 static void auth_worker_deinit(struct auth_worker_connection **worker,
 			       const char *reason, bool restart) ATTR_NULL(2);
 
+static void auth_worker_idle_timeout(struct auth_worker_connection *worker);
+
+static struct timeout *
+auth_worker_idle_timeout_add(struct auth_worker_connection *worker)
+{
+	unsigned int secs = global_auth_settings->worker_idle_timeout;
+
+	return timeout_add(I_MAX(secs, 1) * 1000,
+			   auth_worker_idle_timeout, worker);
+}
+
 static void auth_worker_idle_timeout(struct auth_worker_connection *worker)
 {
 	i_assert(worker->request == NULL);
@@ -137,6 +150,48 @@ static bool auth_worker_request_send(struct auth_worker_connection *worker,
 	return TRUE;
 }
 
+static struct auth_worker_request *auth_worker_request_dequeue(void)
+{
+	struct auth_worker_request *request;
+
+	request = array_idx_elem(&worker_request_array,
+				 aqueue_idx(worker_request_queue, 0));
+	aqueue_delete_tail(worker_request_queue);
+	return request;
+}
+
+static void
+auth_worker_request_dequeued_event(struct auth_worker_request *request,
+				   const char *error)
+{
+	struct event_passthrough *e =
+		event_create_passthrough(auth_event)->
+		set_name("auth_worker_request_dequeued")->
+		add_int("queue_usecs",
+			timeval_diff_usecs(&ioloop_timeval,
+					   &request->queued_time))->
+		add_int("queue_length", aqueue_count(worker_request_queue))->
+		add_int("worker_count", connections->connections_count)->
+		add_int("idle_worker_count", idle_count);
+	if (error == NULL) {
+		e_debug(e->event(), "auth-worker: Request left the queue");
+		return;
+	}
+
+	e->add_str("error", error);
+	if (ioloop_time - auth_worker_last_drop_warn >
+	    AUTH_WORKER_DELAY_WARN_MIN_INTERVAL_SECS) {
+		auth_worker_last_drop_warn = ioloop_time;
+		e_warning(e->event(), "auth-worker: Dropped %s request "
+			  "for %s: %s", t_strcut(request->data, '\t'),
+			  request->username, error);
+	} else {
+		e_debug(e->event(), "auth-worker: Dropped %s request "
+			"for %s: %s", t_strcut(request->data, '\t'),
+			request->username, error);
+	}
+}
+
 static void auth_worker_request_send_next(struct auth_worker_connection *worker)
 {
 	struct auth_worker_request *request;
@@ -145,12 +200,47 @@ static void auth_worker_request_send_next(struct auth_worker_connection *worker)
 		if (aqueue_count(worker_request_queue) == 0)
 			return;
 
-		request = array_idx_elem(&worker_request_array,
-					 aqueue_idx(worker_request_queue, 0));
-		aqueue_delete_tail(worker_request_queue);
+		request = auth_worker_request_dequeue();
+		auth_worker_request_dequeued_event(request, NULL);
 	} while (!auth_worker_request_send(worker, request));
 }
 
+static struct auth_worker_connection *auth_worker_create(void);
+
+static void auth_worker_spawn_for_queue(void)
+{
+	struct auth_worker_connection *worker;
+
+	/* Requests were queued while no more workers could be created. Now
+	   that the limit allows it, start workers for them instead of waiting
+	   for the existing workers to become free. */
+	while (aqueue_count(worker_request_queue) > 0) {
+		worker = auth_worker_create();
+		if (worker == NULL)
+			break;
+		auth_worker_request_send_next(worker);
+	}
+}
+
+static void auth_worker_request_drop_oldest(unsigned int queue_limit)
+{
+	struct auth_worker_request *request;
+	const char *error;
+
+	/* The oldest requests are the most likely ones to have been already
+	   given up by the client, so fail them instead of the new one. */
+	error = t_strdup_printf("Queue limit reached (auth_worker_queue_limit=%u)",
+				queue_limit);
+	const char *const args[] = {
+		"FAIL",
+		t_strdup_printf("%d", PASSDB_RESULT_INTERNAL_FAILURE),
+		NULL,
+	};
+	request = auth_worker_request_dequeue();
+	auth_worker_request_dequeued_event(request, error);
+	request->callback(NULL, args, request->context);
+}
+
 static int auth_worker_handshake_args(struct connection *conn,
 				      const char *const *args)
 {
@@ -247,8 +337,7 @@ static struct auth_worker_connection *auth_worker_create(void)
 
 	event_set_append_log_prefix(worker->conn.event, "auth-worker: ");
 
-	worker->to_lookup = timeout_add(AUTH_WORKER_MAX_IDLE_SECS * 1000,
-					auth_worker_idle_timeout, worker);
+	worker->to_lookup = auth_worker_idle_timeout_add(worker);
 
 	idle_count++;
 	return worker;
@@ -333,8 +422,7 @@ static int auth_worker_request_handle(struct auth_worker_connection *worker,
 		worker->request = NULL;
 		worker->timeout_pending_resume = FALSE;
 		timeout_remove(&worker->to_lookup);
-		worker->to_lookup = timeout_add(AUTH_WORKER_MAX_IDLE_SECS * 1000,
-						auth_worker_idle_timeout, worker);
+		worker->to_lookup = auth_worker_idle_timeout_add(worker);
 		idle_count++;
 	}
 
@@ -387,6 +475,7 @@ static void auth_worker_success(struct auth_worker_connection *worker)
 	} else if (auth_workers_throttle_count < auth_worker_process_limit)
 		auth_workers_throttle_count++;
 	worker->received_error = FALSE;
+	auth_worker_spawn_for_queue();
 }
 
 static int worker_input_args(struct connection *conn, const char *const *args)
@@ -507,6 +596,12 @@ void auth_worker_call(pool_t pool, const char *username, const char *data,
 			i_unreached();
 	} else {
 		/* reached the limit, queue the request */
+		unsigned int queue_limit =
+			global_auth_settings->worker_queue_limit;
+		if (queue_limit > 0 &&
+		    aqueue_count(worker_request_queue) >= queue_limit)
+			auth_worker_request_drop_oldest(queue_limit);
+		request->queued_time = ioloop_timeval;
 		aqueue_append(worker_request_queue, &request);
 	}
 }
@@ -125,6 +125,7 @@ static struct setting_def setting_defs[] = {
 	DEF_STR(iterate_filter),
 	DEF_STR(default_pass_scheme),
 	DEF_BOOL(blocking),
+	DEF_INT(max_pending_requests),
 
 	{ 0, NULL, 0 }
 };
@@ -160,7 +161,8 @@ static struct ldap_settings default_ldap_settings = {
 	.iterate_attrs = "uid=user",
 	.iterate_filter = "(objectClass=posixAccount)",
 	.default_pass_scheme = "crypt",
-	.blocking = FALSE
+	.blocking = FALSE,
+	.max_pending_requests = DB_LDAP_MAX_PENDING_REQUESTS
 };
 
 static struct ldap_connection *ldap_connections = NULL;
@@ -371,7 +373,7 @@ static bool db_ldap_request_queue_next(struct ldap_connection *conn)
 		/* no non-pending requests */
 		return FALSE;
 	}
-	if (conn->pending_count > DB_LDAP_MAX_PENDING_REQUESTS) {
+	if (conn->pending_count >= conn->set.max_pending_requests) {
 		/* wait until server has replied to some requests */
 		return FALSE;
 	}
@@ -2048,6 +2050,8 @@ struct ldap_connection *db_ldap_init(const char *config_path, bool userdb)
 
 	if (conn->set.uris == NULL && conn->set.hosts == NULL)
 		i_fatal("LDAP %s: No uris or hosts set", config_path);
+	if (conn->set.max_pending_requests == 0)
+		i_fatal("LDAP %s: max_pending_requests must not be 0", config_path);
 #ifndef LDAP_HAVE_INITIALIZE
 	if (conn->set.uris != NULL) {
 		i_fatal("LDAP %s: uris set, but Dovecot compiled without support for LDAP uris "
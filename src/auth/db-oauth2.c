@@ -1,8 +1,13 @@
 /* Copyright (c) 2017-2018 Dovecot authors, see the included COPYING file */
 
 #include "auth-common.h"
+#include "ioloop.h"
 #include "array.h"
+#include "hash.h"
 #include "str.h"
+#include "strescape.h"
+#include "strnum.h"
+#include "sha2.h"
 #include "var-expand.h"
 #include "env-util.h"
 #include "var-expand.h"
@@ -79,6 +84,12 @@ struct passdb_oauth2_settings {
 	unsigned int max_pipelined_requests;
 	bool tls_allow_invalid_cert;
 
+	/* Maximum number of cached introspection results, 0 = disabled */
+	unsigned int introspection_cache_size;
+	/* Maximum time to cache introspection results. The token's
+	   expiration time is used instead if it's sooner. */
+	unsigned int introspection_cache_ttl;
+
 	bool debug;
 	/* Should introspection be done even if not necessary */
 	bool force_introspection;
@@ -87,6 +98,17 @@ struct passdb_oauth2_settings {
 	bool use_grant_password;
 };
 
+struct db_oauth2_cache_entry {
+	/* LRU list, the most recently used entry is at head */
+	struct db_oauth2_cache_entry *prev, *next;
+
+	/* SHA256 of the token, so the tokens themselves aren't kept */
+	unsigned char key[SHA256_RESULTLEN];
+	time_t expires;
+	/* The introspection reply fields as tab-escaped name/value pairs */
+	char *fields;
+};
+
 struct db_oauth2 {
 	struct db_oauth2 *prev,*next;
 
@@ -100,6 +122,10 @@ struct db_oauth2 {
 
 	struct db_oauth2_request *head;
 
+	HASH_TABLE(const unsigned char *, struct db_oauth2_cache_entry *)
+		cache_hash;
+	struct db_oauth2_cache_entry *cache_head, *cache_tail;
+
 	unsigned int refcount;
 };
 
@@ -134,6 +160,8 @@ static struct setting_def setting_defs[] = {
 	DEF_INT(max_idle_time_msecs),
 	DEF_INT(max_parallel_connections),
 	DEF_INT(max_pipelined_requests),
+	DEF_INT(introspection_cache_size),
+	DEF_INT(introspection_cache_ttl),
 	DEF_BOOL(send_auth_headers),
 	DEF_BOOL(use_grant_password),
 
@@ -173,6 +201,8 @@ static struct passdb_oauth2_settings default_oauth2_settings = {
 	.max_idle_time_msecs = 60000,
 	.max_parallel_connections = 10,
 	.max_pipelined_requests = 1,
+	.introspection_cache_size = 0,
+	.introspection_cache_ttl = 60,
 	.tls_ca_cert_file = NULL,
 	.tls_ca_cert_dir = NULL,
 	.tls_cert_file = NULL,
@@ -184,6 +214,116 @@ static struct passdb_oauth2_settings default_oauth2_settings = {
 	.debug = FALSE,
 };
 
+static const char *
+db_oauth2_field_find(const ARRAY_TYPE(oauth2_field) *fields, const char *name);
+
+static unsigned int db_oauth2_cache_key_hash(const unsigned char *key)
+{
+	unsigned int hash;
+
+	/* the key is already a cryptographic hash */
+	memcpy(&hash, key, sizeof(hash));
+	return hash;
+}
+
+static int db_oauth2_cache_key_cmp(const unsigned char *key1,
+				   const unsigned char *key2)
+{
+	return memcmp(key1, key2, SHA256_RESULTLEN);
+}
+
+static void
+db_oauth2_cache_entry_free(struct db_oauth2 *db,
+			   struct db_oauth2_cache_entry *entry)
+{
+	const unsigned char *key = entry->key;
+
+	hash_table_remove(db->cache_hash, key);
+	DLLIST2_REMOVE(&db->cache_head, &db->cache_tail, entry);
+	i_free(entry->fields);
+	i_free(entry);
+}
+
+static void db_oauth2_cache_deinit(struct db_oauth2 *db)
+{
+	if (!hash_table_is_created(db->cache_hash))
+		return;
+	while (db->cache_tail != NULL)
+		db_oauth2_cache_entry_free(db, db->cache_tail);
+	hash_table_destroy(&db->cache_hash);
+}
+
+static struct db_oauth2_cache_entry *
+db_oauth2_cache_lookup(struct db_oauth2 *db, const char *token)
+{
+	struct db_oauth2_cache_entry *entry;
+	unsigned char key_buf[SHA256_RESULTLEN];
+	const unsigned char *key = key_buf;
+
+	if (!hash_table_is_created(db->cache_hash))
+		return NULL;
+
+	sha256_get_digest(token, strlen(token), key_buf);
+	entry = hash_table_lookup(db->cache_hash, key);
+	if (entry == NULL)
+		return NULL;
+	if (entry->expires <= ioloop_time) {
+		db_oauth2_cache_entry_free(db, entry);
+		return NULL;
+	}
+	DLLIST2_REMOVE(&db->cache_head, &db->cache_tail, entry);
+	DLLIST2_PREPEND(&db->cache_head, &db->cache_tail, entry);
+	return entry;
+}
+
+static void
+db_oauth2_cache_add(struct db_oauth2 *db, const char *token,
+		    const struct oauth2_request_result *result)
+{
+	struct db_oauth2_cache_entry *entry;
+	const struct oauth2_field *field;
+	const unsigned char *key;
+	const char *exp_str;
+	time_t expires, exp;
+
+	if (!hash_table_is_created(db->cache_hash))
+		return;
+
+	expires = ioloop_time + db->set.introspection_cache_ttl;
+	if (result->expires_at > 0 && result->expires_at < expires)
+		expires = result->expires_at;
+	exp_str = db_oauth2_field_find(result->fields, "exp");
+	if (exp_str != NULL && str_to_time(exp_str, &exp) == 0 &&
+	    exp < expires)
+		expires = exp;
+	if (expires <= ioloop_time)
+		return;
+
+	entry = i_new(struct db_oauth2_cache_entry, 1);
+	sha256_get_digest(token, strlen(token), entry->key);
+	key = entry->key;
+	struct db_oauth2_cache_entry *old_entry =
+		hash_table_lookup(db->cache_hash, key);
+	if (old_entry != NULL)
+		db_oauth2_cache_entry_free(db, old_entry);
+
+	entry->expires = expires;
+	string_t *str = t_str_new(256);
+	array_foreach(result->fields, field) {
+		if (str_len(str) > 0)
+			str_append_c(str, '\t');
+		str_append_tabescaped(str, field->name);
+		str_append_c(str, '\t');
+		str_append_tabescaped(str, field->value);
+	}
+	entry->fields = i_strdup(str_c(str));
+	hash_table_insert(db->cache_hash, key, entry);
+	DLLIST2_PREPEND(&db->cache_head, &db->cache_tail, entry);
+
+	if (hash_table_count(db->cache_hash) > db->set.introspection_cache_size)
+		db_oauth2_cache_entry_free(db, db->cache_tail);
+}
+
 static const char *parse_setting(const char *key, const char *value,
 				 struct db_oauth2 *db)
 {
@@ -318,6 +458,12 @@ struct db_oauth2 *db_oauth2_init(const char *config_path)
 		}
 	}
 
+	if (db->set.introspection_cache_size > 0) {
+		hash_table_create(&db->cache_hash, default_pool, 0,
+				  db_oauth2_cache_key_hash,
+				  db_oauth2_cache_key_cmp);
+	}
+
 	DLLIST_PREPEND(&db_oauth2_head, db);
 
 	return db;
@@ -349,6 +495,7 @@ void db_oauth2_unref(struct db_oauth2 **_db)
 	while (db->head != NULL)
 		oauth2_request_abort(&db->head->req);
 
+	db_oauth2_cache_deinit(db);
 	http_client_deinit(&db->client);
 	if (db->oauth2_set.key_dict != NULL)
 		dict_deinit(&db->oauth2_set.key_dict);
@@ -704,17 +851,49 @@ db_oauth2_introspect_continue(struct oauth2_request_result *result,
 	} else {
 		e_debug(authdb_event(req->auth_request),
 			"Introspection succeeded");
+		db_oauth2_cache_add(req->db, req->token, result);
 		db_oauth2_fields_merge(req, result->fields);
 		db_oauth2_process_fields(req, &passdb_result, &error);
 	}
 	db_oauth2_callback(req, passdb_result, "Introspection failed: ", error);
 }
 
+static void
+db_oauth2_introspect_cached(struct db_oauth2_request *req,
+			    const struct db_oauth2_cache_entry *entry)
+{
+	struct oauth2_request_result result;
+	ARRAY_TYPE(oauth2_field) fields;
+	const char *const *args;
+
+	e_debug(authdb_event(req->auth_request),
+		"Using cached introspection result");
+	t_array_init(&fields, 8);
+	args = t_strsplit_tabescaped(entry->fields);
+	for (; args[0] != NULL && args[1] != NULL; args += 2) {
+		struct oauth2_field *field = array_append_space(&fields);
+		field->name = args[0];
+		field->value = args[1];
+	}
+
+	i_zero(&result);
+	result.fields = &fields;
+	result.valid = TRUE;
+	db_oauth2_introspect_continue(&result, req);
+}
+
 static void db_oauth2_lookup_introspect(struct db_oauth2_request *req)
 {
+	struct db_oauth2_cache_entry *cache_entry;
 	struct oauth2_request_input input;
 	i_zero(&input);
 
+	cache_entry = db_oauth2_cache_lookup(req->db, req->token);
+	if (cache_entry != NULL) {
+		db_oauth2_introspect_cached(req, cache_entry);
+		return;
+	}
+
 	e_debug(authdb_event(req->auth_request),
 		"Making introspection request to %s",
 		req->db->set.introspection_url);
@@ -854,6 +1033,7 @@ void db_oauth2_lookup(struct db_oauth2 *db, struct db_oauth2_request *req,
 		      const char *token, struct auth_request *request,
 		      db_oauth2_lookup_callback_t *callback, void *context)
 {
+	struct db_oauth2_cache_entry *cache_entry;
 	struct oauth2_request_input input;
 	i_zero(&input);
 
@@ -892,6 +1072,12 @@ void db_oauth2_lookup(struct db_oauth2 *db, struct db_oauth2_request *req,
 		req->req = oauth2_passwd_grant_start(&db->oauth2_set, &input,
 						     request->fields.user, request->mech_password,
 						     db_oauth2_lookup_passwd_grant, req);
+	} else if (*db->oauth2_set.tokeninfo_url == '\0' &&
+		   (cache_entry = db_oauth2_cache_lookup(db, token)) != NULL) {
+		/* db_oauth2_callback() expects the request to be in the list */
+		DLLIST_PREPEND(&db->head, req);
+		db_oauth2_introspect_cached(req, cache_entry);
+		return;
 	} else if (*db->oauth2_set.tokeninfo_url == '\0') {
 		e_debug(authdb_event(req->auth_request),
 			"Making introspection request to %s",
@@ -289,6 +289,7 @@ static void main_deinit(void)
 	userdbs_deinit();
 	passdbs_deinit();
 	passdb_cache_deinit();
+	auth_request_var_expand_deinit();
         password_schemes_deinit();
 
 	sql_drivers_deinit();
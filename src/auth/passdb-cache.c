@@ -3,14 +3,135 @@
 #include "auth-common.h"
 #include "str.h"
 #include "strescape.h"
+#include "hex-binary.h"
+#include "hash.h"
+#include "hmac.h"
+#include "md5.h"
+#include "sha2.h"
+#include "randgen.h"
+#include "safe-memset.h"
+#include "ioloop.h"
 #include "restrict-process-size.h"
 #include "auth-worker-connection.h"
 #include "password-scheme.h"
 #include "passdb.h"
 #include "passdb-cache.h"
 #include "passdb-blocking.h"
+#include "userdb.h"
+
+/* Maximum number of remembered successful password verifications */
+#define PASSDB_CACHE_VERIFIED_MAX_COUNT 100000
+
+struct passdb_cache_verified {
+	struct passdb_cache_verified *next;
+	time_t created;
+	unsigned char digest[SHA256_RESULTLEN];
+};
+
+struct passdb_cache_verify_context {
+	struct auth_request *request;
+	unsigned char digest[SHA256_RESULTLEN];
+};
 
 struct auth_cache *passdb_cache = NULL;
+static char *passdb_cache_path = NULL, *passdb_cache_tag = NULL;
+
+/* Successful password verifications in creation order. They all have the
+   same TTL, so the oldest ones are always at the head. */
+static HASH_TABLE(unsigned char *, struct passdb_cache_verified *)
+	passdb_cache_verified_hash;
+static struct passdb_cache_verified *passdb_cache_verified_head;
+static struct passdb_cache_verified *passdb_cache_verified_tail;
+static unsigned int passdb_cache_verified_ttl, passdb_cache_verified_count;
+static unsigned char passdb_cache_verified_secret[SHA256_RESULTLEN];
+
+static unsigned int passdb_cache_verified_hash_cb(const unsigned char *digest)
+{
+	unsigned int value;
+
+	memcpy(&value, digest, sizeof(value));
+	return value;
+}
+
+static int passdb_cache_verified_cmp(const unsigned char *digest1,
+				     const unsigned char *digest2)
+{
+	return memcmp(digest1, digest2, SHA256_RESULTLEN);
+}
+
+static void
+passdb_cache_verified_digest(struct auth_request *request,
+			     const char *cached_pw, const char *password,
+			     unsigned char digest_r[STATIC_ARRAY SHA256_RESULTLEN])
+{
+	struct hmac_context ctx;
+
+	/* The cached password hash is part of the digest, so when the
+	   password is changed in the passdb and the cache entry is
+	   refreshed, the old verifications stop matching. */
+	hmac_init(&ctx, passdb_cache_verified_secret,
+		  sizeof(passdb_cache_verified_secret), &hash_method_sha256);
+	hmac_update(&ctx, &request->passdb->passdb->id,
+		    sizeof(request->passdb->passdb->id));
+	hmac_update(&ctx, request->fields.user,
+		    strlen(request->fields.user) + 1);
+	hmac_update(&ctx, cached_pw, strlen(cached_pw) + 1);
+	hmac_update(&ctx, password, strlen(password));
+	hmac_final(&ctx, digest_r);
+}
+
+static void passdb_cache_verified_remove_head(void)
+{
+	struct passdb_cache_verified *verified = passdb_cache_verified_head;
+	unsigned char *key = verified->digest;
+
+	hash_table_remove(passdb_cache_verified_hash, key);
+	passdb_cache_verified_head = verified->next;
+	if (passdb_cache_verified_head == NULL)
+		passdb_cache_verified_tail = NULL;
+	passdb_cache_verified_count--;
+	i_free(verified);
+}
+
+static void passdb_cache_verified_expunge(void)
+{
+	while (passdb_cache_verified_head != NULL &&
+	       passdb_cache_verified_head->created <
+	       ioloop_time - (time_t)passdb_cache_verified_ttl)
+		passdb_cache_verified_remove_head();
+}
+
+static bool
+passdb_cache_verified_lookup(const unsigned char digest[STATIC_ARRAY SHA256_RESULTLEN])
+{
+	passdb_cache_verified_expunge();
+	return hash_table_lookup(passdb_cache_verified_hash, digest) != NULL;
+}
+
+static void
+passdb_cache_verified_add(const unsigned char digest[STATIC_ARRAY SHA256_RESULTLEN])
+{
+	struct passdb_cache_verified *verified;
+	unsigned char *key;
+
+	passdb_cache_verified_expunge();
+	if (hash_table_lookup(passdb_cache_verified_hash, digest) != NULL)
+		return;
+	if (passdb_cache_verified_count >= PASSDB_CACHE_VERIFIED_MAX_COUNT)
+		passdb_cache_verified_remove_head();
+
+	verified = i_new(struct passdb_cache_verified, 1);
+	verified->created = ioloop_time;
+	memcpy(verified->digest, digest, sizeof(verified->digest));
+	key = verified->digest;
+	hash_table_insert(passdb_cache_verified_hash, key, verified);
+	if (passdb_cache_verified_tail == NULL)
+		passdb_cache_verified_head = verified;
+	else
+		passdb_cache_verified_tail->next = verified;
+	passdb_cache_verified_tail = verified;
+	passdb_cache_verified_count++;
+}
 
 static void
 passdb_cache_log_hit(struct auth_request *request, const char *value)
@@ -57,12 +178,15 @@ passdb_cache_verify_plain_callback(struct auth_worker_connection *conn ATTR_UNUS
 				   const char *const *args,
 				   void *context)
 {
-	struct auth_request *request = context;
+	struct passdb_cache_verify_context *ctx = context;
+	struct auth_request *request = ctx->request;
 	enum passdb_result result;
 
 	result = passdb_blocking_auth_worker_reply_parse(request, args);
 	if (result != PASSDB_RESULT_OK)
 		auth_fields_rollback(request->fields.extra_fields);
+	else if (passdb_cache_verified_ttl > 0)
+		passdb_cache_verified_add(ctx->digest);
 	auth_request_verify_plain_callback_finish(result, request);
 	auth_request_unref(&request);
 	return TRUE;
@@ -74,8 +198,10 @@ bool passdb_cache_verify_plain(struct auth_request *request, const char *key,
 {
 	const char *value, *cached_pw, *scheme, *const *list;
 	struct auth_cache_node *node;
+	struct passdb_cache_verify_context *ctx;
+	unsigned char digest[SHA256_RESULTLEN];
 	enum passdb_result ret;
-	bool neg_expired;
+	bool neg_expired, verified = FALSE;
 
 	if (passdb_cache == NULL || key == NULL)
 		return FALSE;
@@ -95,11 +221,22 @@ bool passdb_cache_verify_plain(struct auth_request *request, const char *key,
 	list = t_strsplit_tabescaped(value);
 
 	cached_pw = list[0];
+	if (*cached_pw != '\0' && passdb_cache_verified_ttl > 0) {
+		passdb_cache_verified_digest(request, cached_pw, password,
+					     digest);
+		verified = passdb_cache_verified_lookup(digest);
+	}
 	if (*cached_pw == '\0') {
 		/* NULL password */
 		e_info(authdb_event(request),
 		       "Cached NULL password access");
 		ret = PASSDB_RESULT_OK;
+	} else if (verified) {
+		/* the same password was successfully verified against
+		   this password hash recently */
+		e_debug(authdb_event(request), "cache: "
+			"password was recently verified");
+		ret = PASSDB_RESULT_OK;
 	} else if (request->set->cache_verify_password_with_worker) {
 		string_t *str;
 
@@ -118,8 +255,12 @@ bool passdb_cache_verify_plain(struct auth_request *request, const char *key,
 		   If verification fails, roll back fields. */
 		auth_request_set_fields(request, list + 1, NULL);
 		auth_fields_snapshot(request->fields.extra_fields);
+		ctx = p_new(request->pool, struct passdb_cache_verify_context, 1);
+		ctx->request = request;
+		if (passdb_cache_verified_ttl > 0)
+			memcpy(ctx->digest, digest, sizeof(ctx->digest));
 		auth_worker_call(request->pool, request->fields.user, str_c(str),
-				 passdb_cache_verify_plain_callback, request);
+				 passdb_cache_verify_plain_callback, ctx);
 		return TRUE;
 	} else {
 		scheme = password_get_scheme(&cached_pw);
@@ -138,6 +279,8 @@ bool passdb_cache_verify_plain(struct auth_request *request, const char *key,
 			node->last_success = FALSE;
 			return FALSE;
 		}
+		if (ret == PASSDB_RESULT_OK && passdb_cache_verified_ttl > 0)
+			passdb_cache_verified_add(digest);
 	}
 	node->last_success = ret == PASSDB_RESULT_OK;
 
@@ -186,6 +329,31 @@ bool passdb_cache_lookup_credentials(struct auth_request *request,
 	return TRUE;
 }
 
+static void passdb_cache_load(const char *path)
+{
+	unsigned char passdb_md5[MD5_RESULTLEN], userdb_md5[MD5_RESULTLEN];
+	const char *error;
+	int ret;
+
+	/* The cache keys contain passdb/userdb IDs, so the saved entries
+	   are usable only if the passdbs and userdbs haven't changed. */
+	passdbs_generate_md5(passdb_md5);
+	userdbs_generate_md5(userdb_md5);
+	passdb_cache_path = i_strdup(path);
+	passdb_cache_tag = i_strconcat(
+		binary_to_hex(passdb_md5, sizeof(passdb_md5)),
+		binary_to_hex(userdb_md5, sizeof(userdb_md5)), NULL);
+
+	ret = auth_cache_load(passdb_cache, passdb_cache_path,
+			      passdb_cache_tag, &error);
+	if (ret < 0)
+		i_error("auth_cache_persistent_path: %s", error);
+	else if (ret > 0) {
+		e_debug(auth_event, "Loaded %d auth cache entries from %s",
+			ret, passdb_cache_path);
+	}
+}
+
 void passdb_cache_init(const struct auth_settings *set)
 {
 	rlim_t limit;
@@ -202,10 +370,39 @@ void passdb_cache_init(const struct auth_settings *set)
 	}
 	passdb_cache = auth_cache_new(set->cache_size, set->cache_ttl,
 				      set->cache_negative_ttl);
+	if (set->cache_verified_ttl > 0) {
+		passdb_cache_verified_ttl = set->cache_verified_ttl;
+		random_fill(passdb_cache_verified_secret,
+			    sizeof(passdb_cache_verified_secret));
+		hash_table_create(&passdb_cache_verified_hash, default_pool, 0,
+				  passdb_cache_verified_hash_cb,
+				  passdb_cache_verified_cmp);
+	}
+	if (set->cache_persistent_path[0] != '\0')
+		passdb_cache_load(set->cache_persistent_path);
 }
 
 void passdb_cache_deinit(void)
 {
-	if (passdb_cache != NULL)
-		auth_cache_free(&passdb_cache);
+	const char *error;
+
+	if (passdb_cache == NULL)
+		return;
+
+	if (passdb_cache_path != NULL) {
+		if (auth_cache_save(passdb_cache, passdb_cache_path,
+				    passdb_cache_tag, &error) < 0)
+			i_error("auth_cache_persistent_path: %s", error);
+		i_free(passdb_cache_path);
+		i_free(passdb_cache_tag);
+	}
+	if (passdb_cache_verified_ttl > 0) {
+		while (passdb_cache_verified_head != NULL)
+			passdb_cache_verified_remove_head();
+		hash_table_destroy(&passdb_cache_verified_hash);
+		safe_memset(passdb_cache_verified_secret, 0,
+			    sizeof(passdb_cache_verified_secret));
+		passdb_cache_verified_ttl = 0;
+	}
+	auth_cache_free(&passdb_cache);
 }
@@ -1,11 +1,17 @@
 /* Copyright (c) 2013-2018 Dovecot authors, see the included COPYING file */
 
+#define AUTH_REQUEST_FIELDS_CONST
+
 #include "lib.h"
 #include "str.h"
+#include "unlink-directory.h"
 #include "auth-request.h"
 #include "auth-cache.h"
 #include "test-common.h"
 
+#include <unistd.h>
+#include <sys/stat.h>
+
 const struct var_expand_table
 auth_request_var_expand_static_tab[AUTH_REQUEST_VAR_TAB_COUNT + 1] = {
 	/* these 3 must be in this order */
@@ -23,20 +29,40 @@ struct event *auth_event;
 
 struct var_expand_table *
 auth_request_get_var_expand_table_full(const struct auth_request *auth_request ATTR_UNUSED,
-				       const char *username ATTR_UNUSED,
+				       const char *username,
 				       auth_request_escape_func_t *escape_func ATTR_UNUSED,
 				       unsigned int *count ATTR_UNUSED)
 {
-	i_unreached();
+	struct var_expand_table *table = t_new(struct var_expand_table, 3);
+
+	table[0].key = 'u';
+	table[0].value = username;
+	table[1].key = '!';
+	table[1].value = "1";
+	return table;
 }
 
 int auth_request_var_expand_with_table(string_t *dest, const char *str,
 				       const struct auth_request *auth_request ATTR_UNUSED,
-				       const struct var_expand_table *table ATTR_UNUSED,
+				       const struct var_expand_table *table,
 				       auth_request_escape_func_t *escape_func ATTR_UNUSED,
-				       const char **error_r ATTR_UNUSED)
+				       const char **error_r)
 {
-	return var_expand(dest, str, auth_request_var_expand_static_tab, error_r);
+	return var_expand(dest, str, table, error_r);
+}
+
+void auth_request_ref(struct auth_request *request)
+{
+	request->refcount++;
+}
+
+void auth_request_unref(struct auth_request **_request)
+{
+	struct auth_request *request = *_request;
+
+	*_request = NULL;
+	i_assert(request->refcount > 0);
+	request->refcount--;
 }
 
 static void test_auth_cache_parse_key(void)
@@ -74,12 +100,131 @@ static void test_auth_cache_parse_key(void)
 	test_end();
 }
 
+static void test_auth_cache_save_load(void)
+{
+	const char *dir = ".test-auth-cache";
+	const char *path = t_strconcat(dir, "/auth-cache", NULL);
+	struct auth_request request;
+	struct auth_cache *cache;
+	struct auth_cache_node *node;
+	const char *value, *error;
+	bool expired, neg_expired;
+
+	test_begin("auth cache save and load");
+	(void)unlink_directory(dir, UNLINK_DIRECTORY_FLAG_RMDIR, &error);
+	if (mkdir(dir, 0700) < 0)
+		i_fatal("mkdir(%s) failed: %m", dir);
+
+	i_zero(&request);
+	cache = auth_cache_new(1024*1024, 60, 60);
+	request.fields.translated_username = "user1";
+	auth_cache_insert(cache, &request, "%u", "pass\t1", TRUE);
+	request.fields.translated_username = "user2";
+	auth_cache_insert(cache, &request, "%u", "", FALSE);
+	/* a symlink with the old predictable temp name isn't followed */
+	const char *link_target = t_strconcat(dir, "/target", NULL);
+	if (symlink("target", t_strconcat(path, ".tmp", NULL)) < 0)
+		i_fatal("symlink(%s.tmp) failed: %m", path);
+	test_assert(auth_cache_save(cache, path, "tag", &error) == 0);
+	test_assert(access(link_target, F_OK) < 0 && errno == ENOENT);
+	auth_cache_free(&cache);
+
+	/* a different tag means the configuration has changed */
+	cache = auth_cache_new(1024*1024, 60, 60);
+	test_assert(auth_cache_load(cache, path, "other", &error) == 0);
+	request.fields.translated_username = "user1";
+	test_assert(auth_cache_lookup(cache, &request, "%u", &node,
+				      &expired, &neg_expired) == NULL);
+	auth_cache_free(&cache);
+
+	/* negative entries are dropped when they're not cached */
+	cache = auth_cache_new(1024*1024, 60, 0);
+	test_assert(auth_cache_load(cache, path, "tag", &error) == 1);
+	auth_cache_free(&cache);
+
+	cache = auth_cache_new(1024*1024, 60, 60);
+	test_assert(auth_cache_load(cache, path, "tag", &error) == 2);
+	request.fields.translated_username = "user1";
+	value = auth_cache_lookup(cache, &request, "%u", &node,
+				  &expired, &neg_expired);
+	test_assert_strcmp(value, "pass\t1");
+	test_assert(node != NULL && node->last_success && !expired);
+	request.fields.translated_username = "user2";
+	value = auth_cache_lookup(cache, &request, "%u", &node,
+				  &expired, &neg_expired);
+	test_assert_strcmp(value, "");
+	test_assert(node != NULL && !node->last_success && !expired);
+	auth_cache_free(&cache);
+
+	/* missing file isn't an error */
+	i_unlink(path);
+	cache = auth_cache_new(1024*1024, 60, 60);
+	test_assert(auth_cache_load(cache, path, "tag", &error) == 0);
+	auth_cache_free(&cache);
+
+	(void)unlink_directory(dir, UNLINK_DIRECTORY_FLAG_RMDIR, &error);
+	test_end();
+}
+
+static unsigned int test_wait_callback_count;
+
+static void test_auth_cache_wait_callback(struct auth_request *request)
+{
+	test_assert_strcmp(request->fields.translated_username, "user1");
+	test_wait_callback_count++;
+}
+
+static void test_auth_cache_lookup_wait(void)
+{
+	struct auth_request request1, request2, request3;
+	struct auth_cache *cache;
+
+	test_begin("auth cache lookup wait");
+	cache = auth_cache_new(1024*1024, 60, 60);
+	i_zero(&request1);
+	i_zero(&request2);
+	i_zero(&request3);
+	request1.pool = request2.pool = request3.pool =
+		pool_datastack_create();
+	request1.refcount = request2.refcount = request3.refcount = 1;
+	request1.fields.translated_username = "user1";
+	request2.fields.translated_username = "user1";
+	request3.fields.translated_username = "user2";
+
+	test_assert(!auth_cache_lookup_wait(cache, &request1, "%u",
+					    test_auth_cache_wait_callback));
+	test_assert(auth_cache_lookup_wait(cache, &request2, "%u",
+					   test_auth_cache_wait_callback));
+	test_assert(request2.refcount == 2);
+	test_assert(!auth_cache_lookup_wait(cache, &request3, "%u",
+					    test_auth_cache_wait_callback));
+
+	auth_cache_lookup_finished(cache, &request3);
+	test_assert(test_wait_callback_count == 0);
+	auth_cache_lookup_finished(cache, &request1);
+	test_assert(test_wait_callback_count == 1);
+	test_assert(request2.refcount == 1);
+	test_assert(request1.cache_inflight_key == NULL);
+	/* finishing again does nothing */
+	auth_cache_lookup_finished(cache, &request1);
+	test_assert(test_wait_callback_count == 1);
+
+	/* the next lookup doesn't wait anymore */
+	test_assert(!auth_cache_lookup_wait(cache, &request2, "%u",
+					    test_auth_cache_wait_callback));
+	auth_cache_lookup_finished(cache, &request2);
+	auth_cache_free(&cache);
+	test_end();
+}
+
 int main(void)
 {
 	lib_init();
 	auth_event = event_create(NULL);
 	static void (*const test_functions[])(void) = {
 		test_auth_cache_parse_key,
+		test_auth_cache_save_load,
+		test_auth_cache_lookup_wait,
 		NULL
 	};
 	int ret = test_run(test_functions);
@@ -34,6 +34,7 @@ struct service_settings config_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -43,6 +44,7 @@ struct service_settings config_service_settings = {
 	.service_count = 0,
 	.idle_kill = UINT_MAX,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &config_unix_listeners_buf,
 			      sizeof(config_unix_listeners[0]) } },
@@ -2,6 +2,8 @@
 
 #include "lib.h"
 #include "array.h"
+#include "ioloop.h"
+#include "hash.h"
 #include "ostream.h"
 #include "str.h"
 #include "strescape.h"
@@ -16,6 +18,9 @@
 #include "main.h"
 
 #define DICT_OUTPUT_OPTIMAL_SIZE 1024
+/* Commit the coalesced transactions immediately after this many of them have
+   been queued, without waiting for dict_write_coalesce_interval. */
+#define DICT_COALESCE_MAX_TRANSACTIONS 1000
 
 struct dict_cmd_func {
 	enum dict_protocol_cmd cmd;
@@ -39,7 +44,26 @@ struct dict_connection_cmd {
 	bool uncork_pending;
 };
 
+/* Transactions containing only increments for the same dict, username and
+   expire_secs, which are committed together as a single backend transaction.
+   Increments to the same key are merged. */
+struct dict_coalesce {
+	pool_t pool;
+	/* <dict pointer>/<username> */
+	char *hash_key;
+	struct dict *dict;
+	const char *username;
+	unsigned int expire_secs;
+
+	/* There are usually only a few different keys per user, so a linear
+	   lookup is fast enough. */
+	ARRAY(struct dict_connection_inc) incs;
+	ARRAY(struct dict_connection_cmd *) cmds;
+	struct timeout *to;
+};
+
 struct dict_command_stats cmd_stats;
+static HASH_TABLE(char *, struct dict_coalesce *) dict_coalesces;
 
 static int cmd_iterate_flush(struct dict_connection_cmd *cmd);
 
@@ -414,9 +438,17 @@ static int cmd_begin(struct dict_connection_cmd *cmd, const char *const *args)
 	trans->id = id;
 	trans->conn = cmd->conn;
 	trans->ctx = dict_transaction_begin(cmd->conn->dict, &set);
+	trans->coalesce = dict_settings->dict_write_coalesce_interval > 0;
 	return 0;
 }
 
+static void
+dict_connection_transaction_no_coalesce(struct dict_connection_transaction *trans)
+{
+	trans->coalesce = FALSE;
+	pool_unref(&trans->inc_pool);
+}
+
 static int
 dict_connection_transaction_lookup_parse(struct dict_connection *conn,
 					 const char *id_str,
@@ -491,6 +523,126 @@ static void cmd_commit_callback(const struct dict_commit_result *result,
 	cmd_commit_finish(cmd, result, FALSE);
 }
 
+static void dict_coalesce_free(struct dict_coalesce *coalesce)
+{
+	array_free(&coalesce->cmds);
+	pool_unref(&coalesce->pool);
+}
+
+static void dict_coalesce_callback(const struct dict_commit_result *result,
+				   struct dict_coalesce *coalesce)
+{
+	struct dict_connection_cmd *cmd;
+
+	array_foreach_elem(&coalesce->cmds, cmd)
+		cmd_commit_finish(cmd, result, FALSE);
+	dict_coalesce_free(coalesce);
+}
+
+static void dict_coalesce_commit(struct dict_coalesce *coalesce)
+{
+	struct dict_transaction_context *ctx;
+	const struct dict_connection_inc *inc;
+	const struct dict_op_settings set = {
+		.username = coalesce->username,
+		.expire_secs = coalesce->expire_secs,
+	};
+
+	hash_table_remove(dict_coalesces, coalesce->hash_key);
+	timeout_remove(&coalesce->to);
+
+	e_debug(array_idx_elem(&coalesce->cmds, 0)->conn->conn.event,
+		"Committing %u coalesced transactions with %u keys",
+		array_count(&coalesce->cmds), array_count(&coalesce->incs));
+	ctx = dict_transaction_begin(coalesce->dict, &set);
+	array_foreach(&coalesce->incs, inc)
+		dict_atomic_inc(ctx, inc->key, inc->diff);
+	dict_transaction_commit_async(&ctx, dict_coalesce_callback, coalesce);
+}
+
+static const char *
+dict_coalesce_get_hash_key(struct dict *dict, const char *username)
+{
+	return t_strdup_printf("%p/%s", dict, username == NULL ? "" : username);
+}
+
+static struct dict_coalesce *
+dict_coalesce_lookup(struct dict *dict, const char *username)
+{
+	if (!hash_table_is_created(dict_coalesces))
+		return NULL;
+	return hash_table_lookup(dict_coalesces,
+				 dict_coalesce_get_hash_key(dict, username));
+}
+
+static struct dict_coalesce *
+dict_coalesce_get(struct dict *dict, const char *username,
+		  unsigned int expire_secs)
+{
+	struct dict_coalesce *coalesce;
+	pool_t pool;
+
+	coalesce = dict_coalesce_lookup(dict, username);
+	if (coalesce != NULL) {
+		if (coalesce->expire_secs == expire_secs)
+			return coalesce;
+		dict_coalesce_commit(coalesce);
+	}
+	if (!hash_table_is_created(dict_coalesces))
+		hash_table_create(&dict_coalesces, default_pool, 0,
+				  str_hash, strcmp);
+
+	pool = pool_alloconly_create("dict coalesce", 512);
+	coalesce = p_new(pool, struct dict_coalesce, 1);
+	coalesce->pool = pool;
+	coalesce->hash_key =
+		p_strdup(pool, dict_coalesce_get_hash_key(dict, username));
+	coalesce->dict = dict;
+	coalesce->username = p_strdup(pool, username);
+	coalesce->expire_secs = expire_secs;
+	p_array_init(&coalesce->incs, pool, 4);
+	i_array_init(&coalesce->cmds, 16);
+	coalesce->to = timeout_add(dict_settings->dict_write_coalesce_interval,
+				   dict_coalesce_commit, coalesce);
+	hash_table_insert(dict_coalesces, coalesce->hash_key, coalesce);
+	return coalesce;
+}
+
+static void
+dict_coalesce_add(struct dict_connection_cmd *cmd,
+		  struct dict_connection_transaction *trans)
+{
+	struct dict_coalesce *coalesce;
+	const struct dict_connection_inc *inc;
+	struct dict_connection_inc *old_incs, *new_inc;
+	unsigned int i, count;
+
+	coalesce = dict_coalesce_get(cmd->conn->dict, trans->ctx->set.username,
+				     trans->ctx->set.expire_secs);
+	array_foreach(&trans->incs, inc) {
+		old_incs = array_get_modifiable(&coalesce->incs, &count);
+		for (i = 0; i < count; i++) {
+			if (strcmp(old_incs[i].key, inc->key) == 0)
+				break;
+		}
+		if (i < count)
+			old_incs[i].diff += inc->diff;
+		else {
+			new_inc = array_append_space(&coalesce->incs);
+			new_inc->key = p_strdup(coalesce->pool, inc->key);
+			new_inc->diff = inc->diff;
+		}
+	}
+	array_push_back(&coalesce->cmds, &cmd);
+
+	/* the increments are committed by the coalesced transaction */
+	dict_transaction_rollback(&trans->ctx);
+	pool_unref(&trans->inc_pool);
+
+	if (array_count(&coalesce->cmds) >= DICT_COALESCE_MAX_TRANSACTIONS)
+		dict_coalesce_commit(coalesce);
+}
+
 static int
 cmd_commit(struct dict_connection_cmd *cmd, const char *const *args)
 {
@@ -502,6 +654,17 @@ cmd_commit(struct dict_connection_cmd *cmd, const char *const *args)
 	event_add_str(cmd->event, "user", trans->ctx->set.username);
 
 	dict_connection_cmd_async(cmd);
+	if (trans->coalesce && array_is_created(&trans->incs)) {
+		dict_coalesce_add(cmd, trans);
+		return 1;
+	}
+	/* Commit the user's earlier coalesced increments first, so they
+	   don't get reordered after this transaction. */
+	struct dict_coalesce *coalesce =
+		dict_coalesce_lookup(cmd->conn->dict, trans->ctx->set.username);
+	if (coalesce != NULL)
+		dict_coalesce_commit(coalesce);
+	pool_unref(&trans->inc_pool);
 	dict_transaction_commit_async(&trans->ctx, cmd_commit_callback, cmd);
 	return 1;
 }
@@ -516,6 +679,7 @@ cmd_rollback(struct dict_connection_cmd *cmd, const char *const *args)
 
 	event_add_str(cmd->event, "user", trans->ctx->set.username);
 	dict_transaction_rollback(&trans->ctx);
+	pool_unref(&trans->inc_pool);
 	dict_connection_transaction_array_remove(cmd->conn, trans->id);
 	return 0;
 }
@@ -533,6 +697,7 @@ static int cmd_set(struct dict_connection_cmd *cmd, const char *const *args)
 	if (dict_connection_transaction_lookup_parse(cmd->conn, args[0], &trans) < 0)
 		return -1;
 	event_add_str(cmd->event, "user", trans->ctx->set.username);
+	dict_connection_transaction_no_coalesce(trans);
         dict_set(trans->ctx, args[1], args[2]);
 	return 0;
 }
@@ -549,6 +714,7 @@ static int cmd_unset(struct dict_connection_cmd *cmd, const char *const *args)
 
 	if (dict_connection_transaction_lookup_parse(cmd->conn, args[0], &trans) < 0)
 		return -1;
+	dict_connection_transaction_no_coalesce(trans);
         dict_unset(trans->ctx, args[1]);
 	return 0;
 }
@@ -569,6 +735,18 @@ cmd_atomic_inc(struct dict_connection_cmd *cmd, const char *const *args)
 	if (dict_connection_transaction_lookup_parse(cmd->conn, args[0], &trans) < 0)
 		return -1;
 
+	if (trans->coalesce) {
+		struct dict_connection_inc *inc;
+
+		if (trans->inc_pool == NULL) {
+			trans->inc_pool =
+				pool_alloconly_create("dict transaction incs", 256);
+			p_array_init(&trans->incs, trans->inc_pool, 4);
+		}
+		inc = array_append_space(&trans->incs);
+		inc->key = p_strdup(trans->inc_pool, args[1]);
+		inc->diff = diff;
+	}
         dict_atomic_inc(trans->ctx, args[1], diff);
 	return 0;
 }
@@ -594,6 +772,7 @@ static int cmd_timestamp(struct dict_connection_cmd *cmd, const char *const *arg
 		.tv_sec = tv_sec,
 		.tv_nsec = tv_nsec
 	};
+	dict_connection_transaction_no_coalesce(trans);
         dict_transaction_set_timestamp(trans->ctx, &ts);
 	return 0;
 }
@@ -615,6 +794,7 @@ cmd_hide_log_values(struct dict_connection_cmd *cmd, const char *const *args)
 	if (dict_connection_transaction_lookup_parse(cmd->conn, args[0], &trans) < 0)
 		return -1;
 
+	dict_connection_transaction_no_coalesce(trans);
 	dict_transaction_set_hide_log_values(trans->ctx, value);
 	return 0;
 }
@@ -709,6 +889,20 @@ void dict_connection_cmds_output_more(struct dict_connection *conn)
 	}
 }
 
+void dict_commands_flush_coalesced(void)
+{
+	struct hash_iterate_context *iter;
+	char *key;
+	struct dict_coalesce *coalesce;
+
+	if (!hash_table_is_created(dict_coalesces))
+		return;
+	iter = hash_table_iterate_init(dict_coalesces);
+	while (hash_table_iterate(iter, dict_coalesces, &key, &coalesce))
+		dict_coalesce_commit(coalesce);
+	hash_table_iterate_deinit(&iter);
+}
+
 void dict_commands_init(void)
 {
 	cmd_stats.lookups = stats_dist_init();
@@ -721,4 +915,8 @@ void dict_commands_deinit(void)
 	stats_dist_deinit(&cmd_stats.lookups);
 	stats_dist_deinit(&cmd_stats.iterations);
 	stats_dist_deinit(&cmd_stats.commits);
+	if (hash_table_is_created(dict_coalesces)) {
+		i_assert(hash_table_count(dict_coalesces) == 0);
+		hash_table_destroy(&dict_coalesces);
+	}
 }
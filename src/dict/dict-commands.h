@@ -15,6 +15,9 @@ int dict_command_input(struct dict_connection *conn, const char *line);
 
 void dict_connection_cmds_output_more(struct dict_connection *conn);
 
+/* Commit all the coalesced transactions immediately. */
+void dict_commands_flush_coalesced(void);
+
 void dict_commands_init(void);
 void dict_commands_deinit(void);
 
@@ -4,10 +4,22 @@
 #include "dict.h"
 #include "connection.h"
 
+struct dict_connection_inc {
+	const char *key;
+	long long diff;
+};
+
 struct dict_connection_transaction {
 	unsigned int id;
 	struct dict_connection *conn;
 	struct dict_transaction_context *ctx;
+
+	/* Increments done by the transaction. These are tracked only while
+	   the transaction can still be coalesced with others, i.e. it has
+	   nothing but increments. */
+	pool_t inc_pool;
+	ARRAY(struct dict_connection_inc) incs;
+	bool coalesce;
 };
 
 struct dict_connection {
@@ -48,6 +48,7 @@ struct service_settings dict_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -57,6 +58,7 @@ struct service_settings dict_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &dict_unix_listeners_buf,
 			      sizeof(dict_unix_listeners[0]) } },
@@ -74,6 +76,7 @@ struct service_settings dict_async_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -83,6 +86,7 @@ struct service_settings dict_async_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &dict_async_unix_listeners_buf,
 			      sizeof(dict_async_unix_listeners[0]) } },
@@ -100,6 +104,7 @@ struct service_settings dict_expire_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -109,6 +114,7 @@ struct service_settings dict_expire_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = ARRAY_INIT,
 	.fifo_listeners = ARRAY_INIT,
@@ -122,6 +128,7 @@ struct service_settings dict_expire_service_settings = {
 static const struct setting_define dict_setting_defines[] = {
 	DEF(STR, base_dir),
 	DEF(BOOL, verbose_proctitle),
+	DEF(TIME_MSECS, dict_write_coalesce_interval),
 	{ .type = SET_STRLIST, .key = "dict",
 	  .offset = offsetof(struct dict_server_settings, dicts) },
 
@@ -131,6 +138,7 @@ static const struct setting_define dict_setting_defines[] = {
 const struct dict_server_settings dict_default_settings = {
 	.base_dir = PKG_RUNDIR,
 	.verbose_proctitle = FALSE,
+	.dict_write_coalesce_interval = 0,
 	.dicts = ARRAY_INIT
 };
 
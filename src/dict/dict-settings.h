@@ -4,6 +4,7 @@
 struct dict_server_settings {
 	const char *base_dir;
 	bool verbose_proctitle;
+	unsigned int dict_write_coalesce_interval;
 	ARRAY(const char *) dicts;
 };
 
@@ -125,6 +125,7 @@ static void main_init(void)
 static void main_deinit(void)
 {
 	/* wait for all dict operations to finish */
+	dict_commands_flush_coalesced();
 	dict_init_cache_wait_all();
 	/* connections should no longer have any extra refcounts */
 	dict_connections_destroy_all();
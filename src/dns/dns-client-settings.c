@@ -41,6 +41,7 @@ struct service_settings dns_client_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -50,6 +51,7 @@ struct service_settings dns_client_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &dns_client_unix_listeners_buf,
 			      sizeof(dns_client_unix_listeners[0]) } },
@@ -7,12 +7,16 @@
 #include "ioloop.h"
 #include "str.h"
 #include "str-sanitize.h"
+#include "read-full.h"
+#include "write-full.h"
+#include "safe-mkstemp.h"
 #include "istream.h"
 #include "ostream.h"
 #include "strescape.h"
 #include "settings-parser.h"
 #include "iostream-ssl.h"
 #include "iostream-temp.h"
+#include "istream-concat.h"
 #include "istream-seekable.h"
 #include "master-service.h"
 #include "master-service-ssl.h"
@@ -31,6 +35,16 @@
 
 #include <unistd.h>
 #include <ctype.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+/* Command results at least this large are already in temporary files (see
+   iostream_temp). Send them directly from there instead of copying them to
+   the response's temporary file. */
+#define DOVEADM_HTTP_PAYLOAD_INSERT_MIN_SIZE (1024*128)
+/* Each inserted command result keeps its temporary file open until the
+   response is sent, so copy the rest of them as usual. */
+#define DOVEADM_HTTP_PAYLOAD_MAX_INSERTS 32
 
 enum client_request_parse_state {
 	CLIENT_REQUEST_PARSE_INIT,
@@ -46,6 +60,25 @@ enum client_request_parse_state {
 	CLIENT_REQUEST_PARSE_DONE
 };
 
+struct client_request_http_insert {
+	/* offset in the request's output */
+	uoff_t offset;
+	struct istream *input;
+};
+
+struct client_request_http_child {
+	pid_t pid;
+	/* unlinked file for the command's result and output */
+	int fd;
+	const char *user;
+	const char *method_id;
+};
+
+struct doveadm_http_child_result {
+	int exit_code;
+	bool success;
+};
+
 struct client_request_http {
 	pool_t pool;
 	struct client_connection_http *conn;
@@ -55,6 +88,10 @@ struct client_request_http {
 	struct io *io;
 	struct istream *input;
 	struct ostream *output;
+	/* command results to be inserted to the output when sending it */
+	ARRAY(struct client_request_http_insert) payload_inserts;
+	/* commands running in child processes, in the request's order */
+	ARRAY(struct client_request_http_child) children;
 
 	struct json_parser *json_parser;
 
@@ -124,9 +161,10 @@ static struct doveadm_http_server_mount doveadm_http_server_mounts[] = {
 }
 };
 
-static void doveadm_http_server_json_error(void *context, const char *error)
+static void
+doveadm_http_server_json_error(struct client_request_http *req,
+			       const char *method_id, const char *error)
 {
-	struct client_request_http *req = context;
 	struct ostream *output = req->output;
 	string_t *escaped;
 
@@ -141,56 +179,102 @@ static void doveadm_http_server_json_error(void *context, const char *error)
 	o_stream_nsend_str(output, str_c(escaped));
 	o_stream_nsend_str(output, "},\"");
 	str_truncate(escaped,0);
-	if (req->method_id != NULL) {
-	        json_append_escaped(escaped, req->method_id);
+	if (method_id != NULL) {
+	        json_append_escaped(escaped, method_id);
 		o_stream_nsend_str(output, str_c(escaped));
 	}
 	o_stream_nsend_str(output, "\"]");
 }
 
-static void doveadm_http_server_json_success(void *context, struct istream *result)
+static void
+doveadm_http_server_output_istream(struct client_request_http *req,
+				   struct istream *input)
+{
+	struct client_request_http_insert *insert;
+	uoff_t size;
+
+	if (i_stream_get_size(input, TRUE, &size) <= 0 ||
+	    size < DOVEADM_HTTP_PAYLOAD_INSERT_MIN_SIZE ||
+	    (array_is_created(&req->payload_inserts) &&
+	     array_count(&req->payload_inserts) >=
+	     DOVEADM_HTTP_PAYLOAD_MAX_INSERTS)) {
+		o_stream_nsend_istream(req->output, input);
+		return;
+	}
+
+	if (!array_is_created(&req->payload_inserts))
+		p_array_init(&req->payload_inserts, req->pool, 4);
+	insert = array_append_space(&req->payload_inserts);
+	insert->offset = req->output->offset;
+	insert->input = input;
+	i_stream_ref(input);
+}
+
+static struct istream *
+doveadm_http_server_payload_concat(struct client_request_http *req,
+				   struct istream *output_input)
+{
+	ARRAY(struct istream *) inputs;
+	struct client_request_http_insert *insert;
+	struct istream *input, **inputp;
+	uoff_t size, offset = 0;
+
+	/* the temp istream's size is always known */
+	if (i_stream_get_size(output_input, TRUE, &size) <= 0)
+		i_unreached();
+
+	t_array_init(&inputs, array_count(&req->payload_inserts) * 2 + 2);
+	array_foreach_modifiable(&req->payload_inserts, insert) {
+		if (insert->offset > offset) {
+			input = i_stream_create_range(output_input, offset,
+						      insert->offset - offset);
+			array_push_back(&inputs, &input);
+		}
+		array_push_back(&inputs, &insert->input);
+		insert->input = NULL;
+		offset = insert->offset;
+	}
+	array_clear(&req->payload_inserts);
+	input = i_stream_create_range(output_input, offset, size - offset);
+	array_push_back(&inputs, &input);
+	array_append_zero(&inputs);
+
+	input = i_stream_create_concat(array_front_modifiable(&inputs));
+	i_stream_set_name(input, i_stream_get_name(output_input));
+	array_foreach_modifiable(&inputs, inputp) {
+		if (*inputp != NULL)
+			i_stream_unref(inputp);
+	}
+	return input;
+}
+
+static void
+doveadm_http_server_json_success(struct client_request_http *req,
+				 const char *method_id, struct istream *result)
 {
-	struct client_request_http *req = context;
 	struct ostream *output = req->output;
 	string_t *escaped;
 
 	escaped = str_new(req->pool, 10);
 
 	o_stream_nsend_str(output, "[\"doveadmResponse\",");
-	o_stream_nsend_istream(output, result);
+	doveadm_http_server_output_istream(req, result);
 	o_stream_nsend_str(output, ",\"");
-	if (req->method_id != NULL) {
-		json_append_escaped(escaped, req->method_id);
+	if (method_id != NULL) {
+		json_append_escaped(escaped, method_id);
 		o_stream_nsend_str(output, str_c(escaped));
 	}
 	o_stream_nsend_str(output, "\"]");
 }
 
-static void
-doveadm_http_server_command_execute(struct client_request_http *req)
+/* Run the command with its output written to doveadm_print_ostream. Returns
+   FALSE if the command requested a referral. */
+static bool doveadm_http_server_command_run(struct client_request_http *req)
 {
 	struct client_connection_http *conn = req->conn;
-	struct istream *is;
 	const char *user;
 	struct ioloop *ioloop, *prev_ioloop;
-
-	/* final preflight check */
-	if (req->method_err == 0 &&
-		!doveadm_client_is_allowed_command(conn->conn.set,
-						   req->cmd->name))
-		req->method_err = 403;
-	if (req->method_err != 0) {
-		if (req->method_err == 404) {
-			doveadm_http_server_json_error(req, "unknownMethod");
-		} else if (req->method_err == 403) {
-			doveadm_http_server_json_error(req, "unAuthorized");
-		} else if (req->method_err == 400) {
-			doveadm_http_server_json_error(req, "invalidRequest");
-		} else {
-			doveadm_http_server_json_error(req, "internalError");
-		}
-		return;
-	}
+	bool ret = TRUE;
 
 	prev_ioloop = current_ioloop;
 
@@ -199,9 +283,6 @@ doveadm_http_server_command_execute(struct client_request_http *req)
 
 	cctx->input = req->input;
 	cctx->output = req->output;
-
-	// create iostream
-	doveadm_print_ostream = iostream_temp_create("/tmp/doveadm.", 0);
 	cctx->cmd = req->cmd;
 
 	if ((cctx->cmd->flags & CMD_FLAG_NO_PRINT) == 0)
@@ -238,32 +319,259 @@ doveadm_http_server_command_execute(struct client_request_http *req)
 		doveadm_print_deinit();
 	if (o_stream_finish(doveadm_print_ostream) < 0) {
 		e_info(cctx->event, "Error writing output in command %s: %s",
-		       req->cmd->name, o_stream_get_error(req->output));
+		       req->cmd->name, o_stream_get_error(doveadm_print_ostream));
 		doveadm_exit_code = EX_TEMPFAIL;
 	}
 
-	is = iostream_temp_finish(&doveadm_print_ostream, 4096);
-
-	if (req->first_row == TRUE)
-		req->first_row = FALSE;
-	else
-		o_stream_nsend_str(req->output,",");
-
 	if (cctx->referral != NULL) {
 		e_error(cctx->event,
 			"Command requested referral: %s", cctx->referral);
-		doveadm_http_server_json_error(req, "internalError");
+		ret = FALSE;
 	} else if (doveadm_exit_code != 0) {
 		if (doveadm_exit_code == 0 || doveadm_exit_code == EX_TEMPFAIL) {
 			e_error(cctx->event,
 				"Command %s failed", req->cmd->name);
 		}
-		doveadm_http_server_json_error(req, "exitCode");
+	}
+	doveadm_cmd_context_unref(&cctx);
+	return ret;
+}
+
+static void doveadm_http_server_json_row_begin(struct client_request_http *req)
+{
+	if (req->first_row == TRUE)
+		req->first_row = FALSE;
+	else
+		o_stream_nsend_str(req->output,",");
+}
+
+static void
+doveadm_http_server_command_result(struct client_request_http *req,
+				   const char *method_id, bool success,
+				   struct istream *result)
+{
+	doveadm_http_server_json_row_begin(req);
+	if (!success)
+		doveadm_http_server_json_error(req, method_id, "internalError");
+	else if (doveadm_exit_code != 0)
+		doveadm_http_server_json_error(req, method_id, "exitCode");
+	else
+		doveadm_http_server_json_success(req, method_id, result);
+}
+
+static void
+doveadm_http_server_child_finish(struct client_request_http *req,
+				 struct client_request_http_child *child)
+{
+	struct doveadm_http_child_result result;
+	struct istream *input, *file_input;
+	uoff_t size;
+	int status;
+	bool success = FALSE;
+
+	doveadm_exit_code = EX_TEMPFAIL;
+	if (waitpid(child->pid, &status, 0) < 0) {
+		e_error(req->conn->conn.event, "waitpid(%s) failed: %m",
+			dec2str(child->pid));
+	} else if (WIFSIGNALED(status)) {
+		e_error(req->conn->conn.event,
+			"Command child process %s died with signal %d",
+			dec2str(child->pid), WTERMSIG(status));
+	} else if (pread_full(child->fd, &result, sizeof(result), 0) <= 0) {
+		e_error(req->conn->conn.event,
+			"Command child process %s exited without result",
+			dec2str(child->pid));
 	} else {
-		doveadm_http_server_json_success(req, is);
+		doveadm_exit_code = result.exit_code;
+		success = result.success;
+	}
+
+	file_input = i_stream_create_fd_autoclose(&child->fd, IO_BLOCK_SIZE);
+	if (!success || i_stream_get_size(file_input, TRUE, &size) <= 0)
+		size = sizeof(result);
+	input = i_stream_create_range(file_input, sizeof(result),
+				      size - sizeof(result));
+	i_stream_unref(&file_input);
+
+	doveadm_http_server_command_result(req, child->method_id, success,
+					   input);
+	i_stream_unref(&input);
+}
+
+static void
+doveadm_http_server_children_wait(struct client_request_http *req,
+				  unsigned int max_count, const char *user)
+{
+	struct client_request_http_child *child;
+	bool user_running;
+
+	if (!array_is_created(&req->children))
+		return;
+	for (;;) {
+		user_running = FALSE;
+		array_foreach_modifiable(&req->children, child) {
+			if (user != NULL && strcmp(child->user, user) == 0)
+				user_running = TRUE;
+		}
+		if (array_count(&req->children) <= max_count && !user_running)
+			break;
+
+		/* Results are returned in the request's order, so wait for
+		   the oldest command. */
+		child = array_front_modifiable(&req->children);
+		doveadm_http_server_child_finish(req, child);
+		array_pop_front(&req->children);
+	}
+}
+
+static void
+doveadm_http_server_children_kill(struct client_request_http *req)
+{
+	struct client_request_http_child *child;
+	int status;
+
+	if (!array_is_created(&req->children))
+		return;
+	array_foreach_modifiable(&req->children, child) {
+		if (kill(child->pid, SIGTERM) < 0 && errno != ESRCH) {
+			e_error(req->conn->conn.event, "kill(%s) failed: %m",
+				dec2str(child->pid));
+		}
+	}
+	array_foreach_modifiable(&req->children, child) {
+		if (waitpid(child->pid, &status, 0) < 0) {
+			e_error(req->conn->conn.event, "waitpid(%s) failed: %m",
+				dec2str(child->pid));
+		}
+		i_close_fd(&child->fd);
+	}
+	array_clear(&req->children);
+}
+
+/* Returns the user the command can be run for in a child process, or NULL if
+   it needs to be run in this process. */
+static const char *
+doveadm_http_server_command_child_user(struct client_request_http *req)
+{
+	const struct doveadm_cmd_param *param;
+	const char *user = NULL;
+
+	if (doveadm_settings->doveadm_http_worker_count <= 1)
+		return NULL;
+	array_foreach(&req->pargv, param) {
+		if (!param->value_set)
+			continue;
+		/* istreams are read from the request input */
+		if (param->type == CMD_PARAM_ISTREAM)
+			return NULL;
+		if (param->type == CMD_PARAM_STR &&
+		    strcmp(param->name, "user") == 0)
+			user = param->value.v_string;
+	}
+	return user;
+}
+
+static int
+doveadm_http_server_command_fork(struct client_request_http *req,
+				 const char *user)
+{
+	struct client_request_http_child *child;
+	struct doveadm_http_child_result result;
+	string_t *path;
+	pid_t pid;
+	int fd;
+
+	path = t_str_new(128);
+	str_append(path, "/tmp/doveadm.");
+	fd = safe_mkstemp_hostpid(path, 0600, (uid_t)-1, (gid_t)-1);
+	if (fd == -1) {
+		e_error(req->conn->conn.event,
+			"safe_mkstemp(%s) failed: %m", str_c(path));
+		return -1;
+	}
+	i_unlink(str_c(path));
+
+	if ((pid = fork()) < 0) {
+		e_error(req->conn->conn.event, "fork() failed: %m");
+		i_close_fd(&fd);
+		return -1;
+	}
+	if (pid == 0) {
+		/* child: the result is written to the beginning of the file
+		   after the command's output */
+		i_zero(&result);
+		if (lseek(fd, sizeof(result), SEEK_SET) < 0)
+			i_fatal("lseek(%s) failed: %m", str_c(path));
+		doveadm_print_ostream = o_stream_create_fd(fd, 0);
+		o_stream_set_name(doveadm_print_ostream, str_c(path));
+		result.success = doveadm_http_server_command_run(req);
+		result.exit_code = doveadm_exit_code;
+		o_stream_destroy(&doveadm_print_ostream);
+		if (pwrite_full(fd, &result, sizeof(result), 0) < 0)
+			i_fatal("pwrite(%s) failed: %m", str_c(path));
+		/* the rest of the process state belongs to the parent */
+		_exit(0);
 	}
+
+	if (!array_is_created(&req->children))
+		p_array_init(&req->children, req->pool, 8);
+	child = array_append_space(&req->children);
+	child->pid = pid;
+	child->fd = fd;
+	child->user = p_strdup(req->pool, user);
+	child->method_id = p_strdup(req->pool, req->method_id);
+	return 0;
+}
+
+static void
+doveadm_http_server_command_execute(struct client_request_http *req)
+{
+	struct client_connection_http *conn = req->conn;
+	struct istream *is;
+	const char *user;
+	bool success;
+
+	/* final preflight check */
+	if (req->method_err == 0 &&
+		!doveadm_client_is_allowed_command(conn->conn.set,
+						   req->cmd->name))
+		req->method_err = 403;
+	if (req->method_err == 0 &&
+	    (user = doveadm_http_server_command_child_user(req)) != NULL) {
+		/* commands for the same user are run serially */
+		doveadm_http_server_children_wait(req,
+			doveadm_settings->doveadm_http_worker_count - 1, user);
+		if (doveadm_http_server_command_fork(req, user) == 0)
+			return;
+	}
+	/* the earlier results must be written first */
+	doveadm_http_server_children_wait(req, 0, NULL);
+
+	if (req->method_err != 0) {
+		doveadm_http_server_json_row_begin(req);
+		if (req->method_err == 404) {
+			doveadm_http_server_json_error(req, req->method_id,
+						       "unknownMethod");
+		} else if (req->method_err == 403) {
+			doveadm_http_server_json_error(req, req->method_id,
+						       "unAuthorized");
+		} else if (req->method_err == 400) {
+			doveadm_http_server_json_error(req, req->method_id,
+						       "invalidRequest");
+		} else {
+			doveadm_http_server_json_error(req, req->method_id,
+						       "internalError");
+		}
+		return;
+	}
+
+	// create iostream
+	doveadm_print_ostream = iostream_temp_create("/tmp/doveadm.", 0);
+	success = doveadm_http_server_command_run(req);
+	is = iostream_temp_finish(&doveadm_print_ostream, 4096);
+
+	doveadm_http_server_command_result(req, req->method_id, success, is);
 	i_stream_unref(&is);
-	doveadm_cmd_context_unref(&cctx);
 }
 
 static int
@@ -768,6 +1076,7 @@ doveadm_http_server_read_request_v1(struct client_request_http *req)
 	}
 
 	i_stream_destroy(&req->input);
+	doveadm_http_server_children_wait(req, 0, NULL);
 	o_stream_nsend_str(req->output,"]");
 
 	doveadm_http_server_send_response(req);
@@ -931,6 +1240,14 @@ static void doveadm_http_server_send_response(struct client_request_http *req)
 
 		payload = iostream_temp_finish(&req->output,
 					       IO_BLOCK_SIZE);
+		if (array_is_created(&req->payload_inserts) &&
+		    array_count(&req->payload_inserts) > 0) {
+			struct istream *output_input = payload;
+
+			payload = doveadm_http_server_payload_concat(
+				req, output_input);
+			i_stream_unref(&output_input);
+		}
 	}
 
 	http_resp = http_server_response_create(http_sreq, 200, "OK");
@@ -985,6 +1302,13 @@ doveadm_http_server_request_destroy(struct client_request_http *req)
 	io_remove(&req->io);
 	o_stream_destroy(&req->output);
 	i_stream_destroy(&req->input);
+	doveadm_http_server_children_kill(req);
+	if (array_is_created(&req->payload_inserts)) {
+		struct client_request_http_insert *insert;
+
+		array_foreach_modifiable(&req->payload_inserts, insert)
+			i_stream_unref(&insert->input);
+	}
 
 	http_server_request_unref(&req->http_request);
 	http_server_switch_ioloop(doveadm_http_server);
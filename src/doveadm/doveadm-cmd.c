@@ -25,6 +25,7 @@ static struct doveadm_cmd_ver2 *doveadm_commands_ver2[] = {
 	&doveadm_cmd_stats_add_ver2,
 	&doveadm_cmd_stats_remove_ver2,
 	&doveadm_cmd_penalty_ver2,
+	&doveadm_cmd_hibernate_memory_ver2,
 	&doveadm_cmd_kick_ver2,
 	&doveadm_cmd_proxy_kick_ver2,
 	&doveadm_cmd_who_ver2,
@@ -45,6 +45,7 @@ extern struct doveadm_cmd_ver2 doveadm_cmd_stats_add_ver2;
 extern struct doveadm_cmd_ver2 doveadm_cmd_stats_remove_ver2;
 extern struct doveadm_cmd_ver2 doveadm_cmd_mailbox_mutf7;
 extern struct doveadm_cmd_ver2 doveadm_cmd_penalty_ver2;
+extern struct doveadm_cmd_ver2 doveadm_cmd_hibernate_memory_ver2;
 extern struct doveadm_cmd_ver2 doveadm_cmd_pw;
 extern struct doveadm_cmd_ver2 doveadm_cmd_kick_ver2;
 extern struct doveadm_cmd_ver2 doveadm_cmd_proxy_kick_ver2;
@@ -7,7 +7,9 @@
 #include "child-wait.h"
 #include "connection.h"
 #include "istream.h"
+#include "istream-multiplex.h"
 #include "ostream.h"
+#include "ostream-multiplex.h"
 #include "iostream-ssl.h"
 #include "iostream-rawlog.h"
 #include "write-full.h"
@@ -53,6 +55,8 @@
 #define DSYNC_LIST_VNAME_ALT_ESCAPE_CHAR '~'
 
 #define DSYNC_DEFAULT_IO_STREAM_TIMEOUT_SECS (60*10)
+/* Maximum number of mailboxes synced in parallel with -j parameter */
+#define DSYNC_MAX_PARALLEL_COUNT 64
 
 enum dsync_run_type {
 	DSYNC_RUN_TYPE_LOCAL,
@@ -75,6 +79,7 @@ struct dsync_cmd_context {
 	time_t sync_until_timestamp;
 	uoff_t sync_max_size;
 	unsigned int io_timeout_secs;
+	unsigned int parallel_count;
 
 	const char *remote_name;
 	const char *local_location;
@@ -94,6 +99,16 @@ struct dsync_cmd_context {
 	struct ssl_iostream_context *ssl_ctx;
 	struct ssl_iostream *ssl_iostream;
 
+	/* With -j parameter the connection is multiplexed into
+	   parallel_count+1 channels. Channel 0 syncs the mailbox tree and
+	   the rest sync the mails in their own mailbox partitions. */
+	struct istream **channel_inputs;
+	struct ostream **channel_outputs;
+	/* Reads the connection after channel 0 is no longer used, so the
+	   other channels keep receiving their data. */
+	struct istream *pump_input;
+	struct io *io_pump;
+
 	enum dsync_run_type run_type;
 	struct doveadm_client *tcp_conn;
 	const char *error;
@@ -611,6 +626,107 @@ parse_ssh_location(const char *location, const char *username, struct event *eve
 	return get_ssh_cmd_args(host, login, username, event);
 }
 
+static void dsync_parallel_init(struct dsync_cmd_context *ctx)
+{
+	unsigned int i;
+
+	ctx->channel_inputs = p_new(ctx->ctx.pool, struct istream *,
+				    ctx->parallel_count + 1);
+	ctx->channel_outputs = p_new(ctx->ctx.pool, struct ostream *,
+				     ctx->parallel_count + 1);
+	ctx->channel_inputs[0] = i_stream_create_multiplex(ctx->input, SIZE_MAX);
+	ctx->channel_outputs[0] =
+		o_stream_create_multiplex(ctx->output, SIZE_MAX);
+	/* Data sent to a channel that doesn't exist yet would be dropped,
+	   so add all of them immediately. */
+	for (i = 1; i <= ctx->parallel_count; i++) {
+		ctx->channel_inputs[i] =
+			i_stream_multiplex_add_channel(ctx->channel_inputs[0], i);
+		ctx->channel_outputs[i] =
+			o_stream_multiplex_add_channel(ctx->channel_outputs[0], i);
+	}
+}
+
+static struct dsync_ibc *
+cmd_dsync_ibc_channel_init(struct dsync_cmd_context *ctx, unsigned int idx,
+			   const char *name, const char *temp_prefix)
+{
+	if (idx > 0)
+		name = t_strdup_printf("%s#%u", name, idx);
+	return dsync_ibc_init_stream(ctx->channel_inputs[idx],
+				     ctx->channel_outputs[idx],
+				     name, temp_prefix, ctx->io_timeout_secs);
+}
+
+static void dsync_parallel_pump_input(struct dsync_cmd_context *ctx)
+{
+	const unsigned char *data;
+	size_t size;
+	unsigned int i;
+	ssize_t ret;
+
+	/* Reading forwards the other channels' data to them. Anything still
+	   sent to channel 0 can be ignored. */
+	while ((ret = i_stream_read_more(ctx->pump_input, &data, &size)) > 0)
+		i_stream_skip(ctx->pump_input, size);
+	if (ret < 0) {
+		/* the EOF/error was propagated to all the channels, but their
+		   ios need to be notified about it */
+		io_remove(&ctx->io_pump);
+		for (i = 1; i <= ctx->parallel_count; i++)
+			i_stream_set_input_pending(ctx->channel_inputs[i], TRUE);
+	}
+}
+
+static void dsync_parallel_pump_start(struct dsync_cmd_context *ctx)
+{
+	/* channel 0's ibc is already deinitialized */
+	i_stream_unref(&ctx->channel_inputs[0]);
+	o_stream_unref(&ctx->channel_outputs[0]);
+
+	/* Only channel 0 has the fd, so add it back for reading. */
+	ctx->pump_input =
+		i_stream_multiplex_add_channel(ctx->channel_inputs[1], 0);
+	ctx->io_pump = io_add_istream(ctx->pump_input,
+				      dsync_parallel_pump_input, ctx);
+	io_set_pending(ctx->io_pump);
+}
+
+static void
+dsync_parallel_wait(struct dsync_cmd_context *ctx,
+		    struct dsync_brain *const *brains, unsigned int count)
+{
+	unsigned int i;
+
+	for (;;) {
+		for (i = 0; i < count; i++) {
+			if (!dsync_brain_is_finished(brains[i]))
+				break;
+		}
+		if (i == count || doveadm_is_killed())
+			break;
+		io_loop_run(current_ioloop);
+		/* io_loop_run() deactivates the context - put it back */
+		mail_storage_service_io_activate_user(ctx->ctx.cur_service_user);
+	}
+}
+
+static void dsync_parallel_deinit(struct dsync_cmd_context *ctx)
+{
+	unsigned int i;
+
+	io_remove(&ctx->io_pump);
+	i_stream_unref(&ctx->pump_input);
+	for (i = 0; i <= ctx->parallel_count; i++) {
+		i_stream_unref(&ctx->channel_inputs[i]);
+		o_stream_unref(&ctx->channel_outputs[i]);
+	}
+	ctx->channel_inputs = NULL;
+	ctx->channel_outputs = NULL;
+	/* send whatever the channels left to the parent stream */
+	(void)o_stream_flush(ctx->output);
+}
+
 static struct dsync_ibc *
 cmd_dsync_ibc_stream_init(struct dsync_cmd_context *ctx,
 			  const char *name, const char *temp_prefix)
@@ -633,6 +749,10 @@ cmd_dsync_ibc_stream_init(struct dsync_cmd_context *ctx,
 		iostream_rawlog_create_path(ctx->rawlog_path,
 					    &ctx->input, &ctx->output);
 	}
+	if (ctx->parallel_count > 0) {
+		dsync_parallel_init(ctx);
+		return cmd_dsync_ibc_channel_init(ctx, 0, name, temp_prefix);
+	}
 	return dsync_ibc_init_stream(ctx->input, ctx->output,
 				     name, temp_prefix, ctx->io_timeout_secs);
 }
@@ -651,6 +771,65 @@ static void dsync_errors_finish(struct dsync_cmd_context *ctx)
 	i_close_fd(&ctx->fd_err);
 }
 
+static void
+dsync_mail_error_merge(enum mail_error *mail_error, enum mail_error mail_error2)
+{
+	/* tempfail is the default error. prefer to use a non-tempfail
+	   if that exists. */
+	if (mail_error2 != 0 &&
+	    (*mail_error == 0 || *mail_error == MAIL_ERROR_TEMP))
+		*mail_error = mail_error2;
+}
+
+static int
+cmd_dsync_run_parallel(struct dsync_cmd_context *ctx, struct mail_user *user,
+		       enum dsync_brain_flags brain_flags,
+		       const struct dsync_brain_settings *set,
+		       const char *temp_prefix,
+		       const char **changes_during_sync_r,
+		       enum mail_error *mail_error)
+{
+	struct dsync_brain_settings part_set = *set;
+	struct dsync_ibc **ibcs;
+	struct dsync_brain **brains;
+	const char *changes_during_sync;
+	enum mail_error mail_error2;
+	bool remote_only_changes;
+	unsigned int i, count = ctx->parallel_count;
+	int ret = 0;
+
+	/* The mailbox tree is already synced via channel 0. Now sync the
+	   mails, each channel handling its own partition of mailboxes. */
+	dsync_parallel_pump_start(ctx);
+	ibcs = t_new(struct dsync_ibc *, count);
+	brains = t_new(struct dsync_brain *, count);
+	part_set.mailbox_partition_count = count;
+	for (i = 0; i < count; i++) {
+		part_set.mailbox_partition_idx = i;
+		ibcs[i] = cmd_dsync_ibc_channel_init(ctx, i + 1,
+						     ctx->remote_name,
+						     temp_prefix);
+		brains[i] = dsync_brain_master_init(user, ibcs[i],
+						    ctx->sync_type,
+						    brain_flags, &part_set);
+	}
+	dsync_parallel_wait(ctx, brains, count);
+
+	for (i = 0; i < count; i++) {
+		changes_during_sync = dsync_brain_get_unexpected_changes_reason(
+			brains[i], &remote_only_changes);
+		if (changes_during_sync != NULL &&
+		    *changes_during_sync_r == NULL)
+			*changes_during_sync_r = t_strdup(changes_during_sync);
+		if (dsync_brain_deinit(&brains[i], &mail_error2) < 0) {
+			dsync_mail_error_merge(mail_error, mail_error2);
+			ret = -1;
+		}
+		dsync_ibc_deinit(&ibcs[i]);
+	}
+	return ret;
+}
+
 static int
 cmd_dsync_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user)
 {
@@ -662,7 +841,7 @@ cmd_dsync_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user)
 	struct dsync_brain *brain;
 	struct dsync_brain_settings set;
 	struct mail_namespace *ns;
-	const char *const *strp;
+	const char *const *strp, *temp_prefix = NULL, *compression;
 	enum dsync_brain_flags brain_flags;
 	enum mail_error mail_error = 0, mail_error2;
 	const char *changes_during_sync, *changes_during_sync2 = NULL;
@@ -699,6 +878,19 @@ cmd_dsync_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user)
 	}
 	set.hashed_headers =
 		t_strsplit_spaces(doveadm_settings->dsync_hashed_headers, " ,");
+	/* compression is negotiated only for a single remote stream */
+	compression = doveadm_settings->dsync_compression;
+	if (*compression != '\0' && ctx->run_type != DSYNC_RUN_TYPE_LOCAL &&
+	    ctx->parallel_count == 0) {
+		if (!dsync_ibc_stream_compression_supported(compression)) {
+			e_error(cctx->event,
+				"dsync_compression: Unsupported mechanism: %s",
+				compression);
+			ctx->ctx.exit_code = EX_USAGE;
+			return -1;
+		}
+		set.compression = compression;
+	}
 	if (array_count(&ctx->exclude_mailboxes) > 0) {
 		/* array is NULL-terminated in init() */
 		set.exclude_mailboxes = array_front(&ctx->exclude_mailboxes);
@@ -719,10 +911,11 @@ cmd_dsync_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user)
 	if (ctx->run_type == DSYNC_RUN_TYPE_LOCAL)
 		dsync_ibc_init_pipe(&ibc, &ibc2);
 	else {
-		string_t *temp_prefix = t_str_new(64);
-		mail_user_set_get_temp_prefix(temp_prefix, user->set);
+		string_t *temp_prefix_str = t_str_new(64);
+		mail_user_set_get_temp_prefix(temp_prefix_str, user->set);
+		temp_prefix = str_c(temp_prefix_str);
 		ibc = cmd_dsync_ibc_stream_init(ctx, ctx->remote_name,
-						str_c(temp_prefix));
+						temp_prefix);
 		if (ctx->err_stream != NULL) {
 			ctx->io_err = io_add_istream(ctx->err_stream,
 						     remote_error_input, ctx);
@@ -754,8 +947,11 @@ cmd_dsync_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user)
 		brain_flags |= DSYNC_BRAIN_FLAG_DEBUG;
 
 	child_wait_init();
+	/* with -j the first brain syncs only the mailbox tree */
 	brain = dsync_brain_master_init(user, ibc, ctx->sync_type,
-					brain_flags, &set);
+					ctx->parallel_count == 0 ? brain_flags :
+					brain_flags | DSYNC_BRAIN_FLAG_NO_MAIL_SYNC,
+					&set);
 
 	switch (ctx->run_type) {
 	case DSYNC_RUN_TYPE_LOCAL:
@@ -781,35 +977,43 @@ cmd_dsync_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user)
 	}
 
 	changes_during_sync = dsync_brain_get_unexpected_changes_reason(brain, &remote_only_changes);
-	if (changes_during_sync != NULL || changes_during_sync2 != NULL) {
+	if (changes_during_sync == NULL ||
+	    (remote_only_changes && changes_during_sync2 != NULL))
+		changes_during_sync = changes_during_sync2;
+	else
+		changes_during_sync = t_strdup(changes_during_sync);
+	if (dsync_brain_deinit(&brain, &mail_error2) < 0)
+		ret = -1;
+	dsync_ibc_deinit(&ibc);
+	if (ibc2 != NULL)
+		dsync_ibc_deinit(&ibc2);
+	if (ret < 0)
+		dsync_mail_error_merge(&mail_error, mail_error2);
+	else if (ctx->parallel_count > 0 && !doveadm_is_killed()) {
+		if (cmd_dsync_run_parallel(ctx, user, brain_flags, &set,
+					   temp_prefix, &changes_during_sync,
+					   &mail_error) < 0)
+			ret = -1;
+	}
+
+	if (changes_during_sync != NULL) {
 		/* don't log a warning when running via doveadm server */
 		const char *msg = t_strdup_printf(
 			"Mailbox changes caused a desync. "
 			"You may want to run dsync again: %s",
-			changes_during_sync == NULL ||
-			(remote_only_changes && changes_during_sync2 != NULL) ?
-			changes_during_sync2 : changes_during_sync);
+			changes_during_sync);
 		if (cctx->conn_type == DOVEADM_CONNECTION_TYPE_CLI)
 			e_warning(cctx->event, "%s", msg);
 		else
 			e_debug(cctx->event, "%s", msg);
 		ctx->ctx.exit_code = DOVEADM_EX_CHANGED;
 	}
-	if (dsync_brain_deinit(&brain, &mail_error2) < 0)
-		ret = -1;
-	if (ret < 0) {
-		/* tempfail is the default error. prefer to use a non-tempfail
-		   if that exists. */
-		if (mail_error2 != 0 &&
-		    (mail_error == 0 || mail_error == MAIL_ERROR_TEMP))
-			mail_error = mail_error2;
+	if (ret < 0)
 		doveadm_mail_failed_error(&ctx->ctx, mail_error);
-	}
-	dsync_ibc_deinit(&ibc);
-	if (ibc2 != NULL)
-		dsync_ibc_deinit(&ibc2);
 	if (ctx->run_type != DSYNC_RUN_TYPE_CMD)
 		dsync_errors_finish(ctx);
+	if (ctx->channel_inputs != NULL)
+		dsync_parallel_deinit(ctx);
 	ssl_iostream_destroy(&ctx->ssl_iostream);
 	if (ctx->ssl_ctx != NULL)
 		ssl_iostream_context_unref(&ctx->ssl_ctx);
@@ -885,6 +1089,8 @@ static void dsync_server_run_command(struct dsync_cmd_context *ctx,
 	str_append_tabescaped(cmd, cctx->username);
 	str_append(cmd, "\tdsync-server\t-u");
 	str_append_tabescaped(cmd, cctx->username);
+	if (ctx->parallel_count > 0)
+		str_printfa(cmd, "\t-j\t%u", ctx->parallel_count);
 	str_append_c(cmd, '\n');
 
 	ctx->tcp_conn = conn;
@@ -1067,6 +1273,21 @@ static int cmd_dsync_prerun(struct doveadm_mail_cmd_context *_ctx,
 	}
 
 	if (remote_cmd_args != NULL) {
+		if (ctx->parallel_count > 0) {
+			/* remote needs to use the same number of channels */
+			ARRAY_TYPE(const_string) cmd_args;
+			const char *arg;
+
+			t_array_init(&cmd_args, 16);
+			array_append(&cmd_args, remote_cmd_args,
+				     str_array_length(remote_cmd_args));
+			arg = "-j";
+			array_push_back(&cmd_args, &arg);
+			arg = dec2str(ctx->parallel_count);
+			array_push_back(&cmd_args, &arg);
+			array_append_zero(&cmd_args);
+			remote_cmd_args = array_front(&cmd_args);
+		}
 		/* do this before mail_storage_service_next() in case it
 		   drops process privileges */
 		run_cmd(ctx, remote_cmd_args);
@@ -1076,6 +1297,9 @@ static int cmd_dsync_prerun(struct doveadm_mail_cmd_context *_ctx,
 	if (ctx->sync_visible_namespaces &&
 	    ctx->run_type == DSYNC_RUN_TYPE_LOCAL)
 		i_fatal("-N parameter requires syncing with remote host");
+	if (ctx->parallel_count > 0 &&
+	    ctx->run_type == DSYNC_RUN_TYPE_LOCAL)
+		i_fatal("-j parameter requires syncing with remote host");
 	return 0;
 }
 
@@ -1178,6 +1402,20 @@ static void cmd_dsync_preinit(struct doveadm_mail_cmd_context *_ctx)
 
 	(void)doveadm_cmd_param_uint32(cctx, "timeout", &ctx->io_timeout_secs);
 
+	if (doveadm_cmd_param_uint32(cctx, "parallel", &ctx->parallel_count) &&
+	    ctx->parallel_count > 0) {
+		if (ctx->parallel_count > DSYNC_MAX_PARALLEL_COUNT) {
+			i_fatal("-j parameter can't be larger than %u",
+				DSYNC_MAX_PARALLEL_COUNT);
+		}
+		/* these would have to be shared by all the channels */
+		if (ctx->state_input != NULL || ctx->lock ||
+		    ctx->purge_remote || ctx->mailbox != NULL ||
+		    ctx->no_mail_sync || !guid_128_is_empty(ctx->mailbox_guid) ||
+		    legacy_dsync)
+			i_fatal("-j parameter can't be used with -s, -l, -P, -m, -g or -E");
+	}
+
 	if (!doveadm_cmd_param_array(cctx, "destination", &ctx->destination))
 		ctx->destination = empty_str_array;
 
@@ -1219,6 +1457,39 @@ static struct doveadm_mail_cmd_context *cmd_dsync_backup_alloc(void)
 	return _ctx;
 }
 
+static void
+cmd_dsync_server_run_parallel(struct dsync_cmd_context *ctx,
+			      struct mail_user *user, const char *name,
+			      const char *temp_prefix,
+			      const char *process_title_prefix)
+{
+	struct dsync_ibc **ibcs;
+	struct dsync_brain **brains;
+	enum mail_error mail_error;
+	unsigned int i, count = ctx->parallel_count;
+
+	/* Create the brains only after the mailbox tree is synced via
+	   channel 0. Until then the remote isn't using the other channels
+	   and their ibcs would just time out. */
+	dsync_parallel_pump_start(ctx);
+	ibcs = t_new(struct dsync_ibc *, count);
+	brains = t_new(struct dsync_brain *, count);
+	for (i = 0; i < count; i++) {
+		ibcs[i] = cmd_dsync_ibc_channel_init(ctx, i + 1, name,
+						     temp_prefix);
+		brains[i] = dsync_brain_slave_init(user, ibcs[i], FALSE,
+			process_title_prefix,
+			doveadm_settings->dsync_alt_char[0]);
+	}
+	dsync_parallel_wait(ctx, brains, count);
+
+	for (i = 0; i < count; i++) {
+		if (dsync_brain_deinit(&brains[i], &mail_error) < 0)
+			doveadm_mail_failed_error(&ctx->ctx, mail_error);
+		dsync_ibc_deinit(&ibcs[i]);
+	}
+}
+
 static int
 cmd_dsync_server_run(struct doveadm_mail_cmd_context *_ctx,
 		     struct mail_user *user)
@@ -1233,6 +1504,7 @@ cmd_dsync_server_run(struct doveadm_mail_cmd_context *_ctx,
 	string_t *temp_prefix;
 	const char *name, *process_title_prefix = "";
 	enum mail_error mail_error;
+	int ret = 0;
 
 	if (!cli) {
 		/* doveadm-server connection. start with a success reply.
@@ -1272,9 +1544,19 @@ cmd_dsync_server_run(struct doveadm_mail_cmd_context *_ctx,
 	/* io_loop_run() deactivates the context - put it back */
 	mail_storage_service_io_activate_user(ctx->ctx.cur_service_user);
 
-	if (dsync_brain_deinit(&brain, &mail_error) < 0)
+	if (dsync_brain_deinit(&brain, &mail_error) < 0) {
 		doveadm_mail_failed_error(_ctx, mail_error);
+		ret = -1;
+	}
 	dsync_ibc_deinit(&ibc);
+	if (ctx->parallel_count > 0) {
+		if (ret == 0 && !doveadm_is_killed()) {
+			cmd_dsync_server_run_parallel(ctx, user, name,
+						      str_c(temp_prefix),
+						      process_title_prefix);
+		}
+		dsync_parallel_deinit(ctx);
+	}
 
 	if (!cli) {
 		/* make sure nothing more is written by the generic doveadm
@@ -1299,6 +1581,11 @@ cmd_dsync_server_init(struct doveadm_mail_cmd_context *_ctx)
 
 	(void)doveadm_cmd_param_str(cctx, "rawlog", &ctx->rawlog_path);
 	(void)doveadm_cmd_param_uint32(cctx, "timeout", &ctx->io_timeout_secs);
+	if (doveadm_cmd_param_uint32(cctx, "parallel", &ctx->parallel_count) &&
+	    ctx->parallel_count > DSYNC_MAX_PARALLEL_COUNT) {
+		i_fatal("-j parameter can't be larger than %u",
+			DSYNC_MAX_PARALLEL_COUNT);
+	}
 }
 
 static struct doveadm_mail_cmd_context *cmd_dsync_server_alloc(void)
@@ -1335,6 +1622,7 @@ DOVEADM_CMD_PARAM('e', "sync-until-time", CMD_PARAM_STR, 0) \
 DOVEADM_CMD_PARAM('O', "sync-flags", CMD_PARAM_STR, 0) \
 DOVEADM_CMD_PARAM('I', "sync-max-size", CMD_PARAM_STR, 0) \
 DOVEADM_CMD_PARAM('T', "timeout", CMD_PARAM_INT64, CMD_PARAM_FLAG_UNSIGNED) \
+DOVEADM_CMD_PARAM('j', "parallel", CMD_PARAM_INT64, CMD_PARAM_FLAG_UNSIGNED) \
 DOVEADM_CMD_PARAM('d', "default-destination", CMD_PARAM_BOOL, 0) \
 DOVEADM_CMD_PARAM('E', "legacy-dsync", CMD_PARAM_BOOL, 0) \
 DOVEADM_CMD_PARAM('\0', "destination", CMD_PARAM_ARRAY, CMD_PARAM_FLAG_POSITIONAL)
@@ -1344,7 +1632,7 @@ DOVEADM_CMD_PARAM('\0', "destination", CMD_PARAM_ARRAY, CMD_PARAM_FLAG_POSITIONA
 	"[-m <mailbox>] [-g <mailbox guid>] [-n <namespace> | -N] " \
 	"[-x <exclude>] [-a <all mailbox>] [-s <state>] [-T <secs>] " \
 	"[-t <start date>] [-e <end date>] [-O <sync flag>] [-I <max size>] " \
-	"-d|<dest>"
+	"[-j <parallel count>] -d|<dest>"
 
 struct doveadm_cmd_ver2 doveadm_cmd_dsync_mirror = {
 	.mail_cmd = cmd_dsync_alloc,
@@ -1368,12 +1656,13 @@ DOVEADM_CMD_PARAMS_END
 struct doveadm_cmd_ver2 doveadm_cmd_dsync_server = {
 	.mail_cmd = cmd_dsync_server_alloc,
 	.name = "dsync-server",
-	.usage = "[-E] [-r <rawlog path>] [-T <timeout secs>] [-U]",
+	.usage = "[-E] [-r <rawlog path>] [-T <timeout secs>] [-j <parallel count>] [-U]",
 DOVEADM_CMD_PARAMS_START
 DOVEADM_CMD_MAIL_COMMON
 DOVEADM_CMD_PARAM('E', "legacy-dsync", CMD_PARAM_BOOL, 0)
 DOVEADM_CMD_PARAM('r', "rawlog", CMD_PARAM_STR, 0)
 DOVEADM_CMD_PARAM('T', "timeout", CMD_PARAM_INT64, CMD_PARAM_FLAG_UNSIGNED)
+DOVEADM_CMD_PARAM('j', "parallel", CMD_PARAM_INT64, CMD_PARAM_FLAG_UNSIGNED)
 /* previously dsync-server could have been added twice to the parameters */
 DOVEADM_CMD_PARAM('\0', "ignore-arg", CMD_PARAM_STR, CMD_PARAM_FLAG_POSITIONAL)
 DOVEADM_CMD_PARAMS_END
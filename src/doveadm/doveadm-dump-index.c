@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "array.h"
+#include "ioloop.h"
 #include "str.h"
 #include "hex-binary.h"
 #include "file-lock.h"
@@ -9,11 +10,13 @@
 #include "message-part-serialize.h"
 #include "mail-cache-private.h"
 #include "mail-index-modseq.h"
+#include "mail-transaction-log-private.h"
 #include "mail-storage-private.h"
 #include "doveadm-dump.h"
 
 #include <stdio.h>
 #include <time.h>
+#include <sys/stat.h>
 
 struct index_vsize_header {
 	uint64_t vsize;
@@ -468,6 +471,7 @@ static void dump_cache_hdr(struct mail_cache *cache)
 	hdr = cache->hdr;
 	printf("major version ........ = %u\n", hdr->major_version);
 	printf("minor version ........ = %u\n", hdr->minor_version);
+	printf("flags ................ = %u\n", hdr->flags);
 	printf("indexid .............. = %u (%s)\n", hdr->indexid, unixdate2str(hdr->indexid));
 	printf("file_seq ............. = %u (%s) (%d purges)\n",
 	       hdr->file_seq, unixdate2str(hdr->file_seq),
@@ -764,6 +768,228 @@ static void dump_record(struct mail_index_view *view, unsigned int seq)
 	}
 }
 
+struct analyze_cache_field {
+	unsigned int mail_count;
+	uoff_t size;
+	uoff_t duplicate_size;
+};
+
+struct analyze_cache_context {
+	struct mail_cache_view *cache_view;
+	/* indexed by mail_cache_field.idx */
+	ARRAY(struct analyze_cache_field) fields;
+	uoff_t records_size;
+	unsigned int uncached_mails, broken_mails;
+};
+
+static uoff_t analyze_file_size(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) < 0) {
+		if (errno != ENOENT)
+			i_error("stat(%s) failed: %m", path);
+		return 0;
+	}
+	return st.st_size;
+}
+
+static unsigned int analyze_percentage(uoff_t value, uoff_t total)
+{
+	return total == 0 ? 0 : value * 100 / total;
+}
+
+static void analyze_index_log(struct mail_index *index)
+{
+	const struct mail_index_header *hdr = &index->map->hdr;
+	const struct mail_index_log_optimization_settings *set =
+		&index->optimization_set.log;
+	struct mail_transaction_log_file *head = index->log->head;
+	const char *log_path = t_strconcat(index->filepath,
+		MAIL_TRANSACTION_LOG_SUFFIX, NULL);
+	uoff_t log_size = analyze_file_size(log_path);
+	uoff_t log2_size = analyze_file_size(t_strconcat(log_path, ".2", NULL));
+	uoff_t unsynced_size;
+
+	printf("index file size ...... = %"PRIuUOFF_T"\n",
+	       analyze_file_size(index->filepath));
+	printf("log file size ........ = %"PRIuUOFF_T"\n", log_size);
+	printf("log.2 file size ...... = %"PRIuUOFF_T"\n", log2_size);
+	if (head == NULL)
+		return;
+
+	printf("log created .......... = %s\n",
+	       unixdate2str(head->hdr.create_stamp));
+	if (log_size >= set->max_size ||
+	    (log_size >= set->min_size &&
+	     head->hdr.create_stamp + set->min_age_secs <= ioloop_time))
+		printf("log rotation ......... = on next write\n");
+	else {
+		printf("log rotation ......... = at %"PRIuUOFF_T" bytes\n",
+		       log_size < set->min_size ? set->min_size : set->max_size);
+	}
+
+	/* The transaction log records after the index's head offset must be
+	   replayed whenever the index is opened, until the index is
+	   rewritten. */
+	if (head->hdr.file_seq == hdr->log_file_seq) {
+		unsynced_size = log_size > hdr->log_file_head_offset ?
+			log_size - hdr->log_file_head_offset : 0;
+		printf("log not in index ..... = %"PRIuUOFF_T" bytes "
+		       "(rewritten at %"PRIuUOFF_T")\n", unsynced_size,
+		       index->optimization_set.index.rewrite_min_log_bytes);
+	} else {
+		printf("log not in index ..... = %u log files behind\n",
+		       head->hdr.file_seq - hdr->log_file_seq);
+	}
+}
+
+static void
+analyze_cache_mail(struct analyze_cache_context *ctx, uint32_t seq)
+{
+	struct mail_cache_lookup_iterate_ctx iter;
+	struct mail_cache_iterate_field iter_field;
+	const struct mail_cache_record *prev_rec = NULL;
+	struct analyze_cache_field *field;
+	ARRAY(bool) seen;
+	bool *seenp;
+	int ret;
+
+	t_array_init(&seen, 64);
+	mail_cache_lookup_iter_init(ctx->cache_view, seq, &iter);
+	while ((ret = mail_cache_lookup_iter_next(&iter, &iter_field)) > 0) {
+		if (iter.rec != prev_rec) {
+			ctx->records_size += iter.rec->size;
+			prev_rec = iter.rec;
+		}
+		field = array_idx_get_space(&ctx->fields, iter_field.field_idx);
+		seenp = array_idx_get_space(&seen, iter_field.field_idx);
+		if (*seenp) {
+			/* the same field was added again in a continued
+			   record - only the newest one is used */
+			field->duplicate_size += iter_field.size;
+		} else {
+			*seenp = TRUE;
+			field->mail_count++;
+			field->size += iter_field.size;
+		}
+	}
+	if (ret < 0)
+		ctx->broken_mails++;
+	else if (prev_rec == NULL)
+		ctx->uncached_mails++;
+}
+
+static void analyze_cache_fields(struct analyze_cache_context *ctx)
+{
+	struct mail_cache *cache = ctx->cache_view->cache;
+	const struct analyze_cache_field *afield;
+	const struct mail_cache_field *field;
+	unsigned int i, count;
+
+	printf("-- Cache fields --\n");
+	printf(
+" #  Name                                 Dec  Last used   Mails      Bytes Avg  Dup bytes\n");
+	afield = array_get(&ctx->fields, &count);
+	for (i = 0; i < cache->file_fields_count; i++) {
+		unsigned int idx = cache->file_field_map[i];
+
+		field = &cache->fields[idx].field;
+		printf("%2u: %-36s %-4s %.10s %6u %10"PRIuUOFF_T" %3"PRIuUOFF_T
+		       " %10"PRIuUOFF_T"\n", i, field->name,
+		       cache_decision2str(field->decision),
+		       unixdate2str(field->last_used),
+		       idx < count ? afield[idx].mail_count : 0,
+		       idx < count ? afield[idx].size : 0,
+		       idx < count && afield[idx].mail_count > 0 ?
+		       afield[idx].size / afield[idx].mail_count : 0,
+		       idx < count ? afield[idx].duplicate_size : 0);
+	}
+}
+
+static void
+analyze_cache(struct mail_index_view *view, struct mail_cache_view *cache_view)
+{
+	struct mail_cache *cache = cache_view->cache;
+	struct analyze_cache_context ctx;
+	uint32_t seq, messages_count = mail_index_view_get_messages_count(view);
+	uoff_t file_size, used_size, wasted_size;
+	const char *reason;
+
+	(void)mail_cache_open_and_verify(cache);
+	if (MAIL_CACHE_IS_UNUSABLE(cache)) {
+		printf("cache is unusable\n");
+		return;
+	}
+
+	i_zero(&ctx);
+	ctx.cache_view = cache_view;
+	t_array_init(&ctx.fields, 32);
+	for (seq = 1; seq <= messages_count; seq++) T_BEGIN {
+		analyze_cache_mail(&ctx, seq);
+	} T_END;
+
+	/* everything except the header, the latest field header and the
+	   records reachable from the index is purged away */
+	file_size = analyze_file_size(cache->filepath);
+	used_size = sizeof(struct mail_cache_header) + ctx.records_size;
+	if (cache->hdr->field_header_offset != 0) {
+		const struct mail_cache_header_fields *field_hdr;
+		const void *data;
+		uint32_t offset =
+			mail_index_offset_to_uint32(cache->hdr->field_header_offset);
+
+		while (mail_cache_map(cache, offset, sizeof(*field_hdr),
+				      &data) > 0) {
+			field_hdr = data;
+			if (field_hdr->next_offset == 0) {
+				used_size += field_hdr->size;
+				break;
+			}
+			offset = mail_index_offset_to_uint32(field_hdr->next_offset);
+		}
+	}
+	wasted_size = file_size > used_size ? file_size - used_size : 0;
+
+	printf("file size ............ = %"PRIuUOFF_T"\n", file_size);
+	printf("used bytes ........... = %"PRIuUOFF_T"\n", used_size);
+	printf("wasted bytes ......... = %"PRIuUOFF_T" (%u%%)\n",
+	       wasted_size, analyze_percentage(wasted_size, file_size));
+	printf("deleted records ...... = %u\n", cache->hdr->deleted_record_count);
+	printf("continued records .... = %u\n",
+	       cache->hdr->continued_record_count);
+	printf("uncached mails ....... = %u/%u (%u%%)\n", ctx.uncached_mails,
+	       messages_count,
+	       analyze_percentage(ctx.uncached_mails, messages_count));
+	if (ctx.broken_mails > 0)
+		printf("broken mails ......... = %u\n", ctx.broken_mails);
+	if (mail_cache_need_purge(cache, &reason))
+		printf("purge needed ......... = yes (%s)\n", reason);
+	else
+		printf("purge needed ......... = no\n");
+	analyze_cache_fields(&ctx);
+
+	printf("-- Estimates --\n");
+	printf("doveadm purge ........ = cache file shrinks by %"PRIuUOFF_T
+	       " bytes (%u%%)\n", wasted_size,
+	       analyze_percentage(wasted_size, file_size));
+	printf("doveadm index ........ = caches %u mails (%u%% of mails are "
+	       "currently read from the mail files)\n", ctx.uncached_mails,
+	       analyze_percentage(ctx.uncached_mails, messages_count));
+}
+
+static void
+cmd_dump_index_analyze(struct mail_index *index, struct mail_index_view *view,
+		       struct mail_cache_view *cache_view)
+{
+	printf("-- INDEX: %s\n", index->filepath);
+	printf("messages count ....... = %u\n", index->map->hdr.messages_count);
+	analyze_index_log(index);
+
+	printf("\n-- CACHE: %s\n", index->cache->filepath);
+	analyze_cache(view, cache_view);
+}
+
 static bool dir_has_index(const char *dir, const char *name)
 {
 	struct stat st;
@@ -803,7 +1029,7 @@ cmd_dump_index(struct doveadm_cmd_context *cctx ATTR_UNUSED,
 	if (index == NULL ||
 	    mail_index_open(index, MAIL_INDEX_OPEN_FLAG_READONLY) <= 0)
 		i_fatal("Couldn't open index %s", path);
-	if (args[0] != NULL) {
+	if (args[0] != NULL && strcmp(args[0], "analyze") != 0) {
 		if (str_to_uint(args[0], &uid) < 0)
 			i_fatal("Invalid uid number %s", args[0]);
 	}
@@ -811,6 +1037,14 @@ cmd_dump_index(struct doveadm_cmd_context *cctx ATTR_UNUSED,
 	view = mail_index_view_open(index);
 	cache_view = mail_cache_view_open(index->cache, view);
 
+	if (args[0] != NULL && uid == 0) {
+		cmd_dump_index_analyze(index, view, cache_view);
+		mail_cache_view_close(&cache_view);
+		mail_index_view_close(&view);
+		mail_index_close(index);
+		mail_index_free(&index);
+		return;
+	}
 	if (uid == 0) {
 		printf("-- INDEX: %s\n", index->filepath);
 		dump_hdr(index);
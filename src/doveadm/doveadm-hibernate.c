@@ -0,0 +1,132 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "strescape.h"
+#include "strnum.h"
+#include "connection.h"
+#include "istream.h"
+#include "ostream.h"
+#include "doveadm.h"
+#include "doveadm-print.h"
+
+#include <unistd.h>
+#include <dirent.h>
+
+#define IMAP_HIBERNATE_ADMIN_DIR "srv.imap-hibernate"
+
+static void
+hibernate_memory_print(struct event *event, const char *pid,
+		       const char *const *args)
+{
+	uintmax_t clients, alloc_size;
+
+	if (str_array_length(args) < 4 ||
+	    str_to_uintmax(args[0], &clients) < 0 ||
+	    str_to_uintmax(args[2], &alloc_size) < 0) {
+		e_error(event, "imap-hibernate %s sent invalid "
+			"MEMORY-USAGE reply", pid);
+		doveadm_exit_code = EX_PROTOCOL;
+		return;
+	}
+
+	doveadm_print(pid);
+	doveadm_print(args[0]);
+	doveadm_print(args[1]);
+	doveadm_print(args[2]);
+	doveadm_print(args[3]);
+	doveadm_print(dec2str(clients == 0 ? 0 : alloc_size / clients));
+}
+
+static void
+hibernate_memory_process(struct event *event, const char *path,
+			 const char *pid)
+{
+	const struct connection_settings set = {
+		.service_name_out = "master-admin-client",
+		.service_name_in = "master-admin-server",
+		.major_version = 1,
+		.minor_version = 0,
+	};
+	struct istream *input;
+	struct ostream *output;
+	const char *line, *error;
+
+	if (doveadm_blocking_connect(path, &set, &input, &output, &error) < 0) {
+		/* the process may have just died */
+		e_error(event, "%s", error);
+		doveadm_exit_code = EX_TEMPFAIL;
+		return;
+	}
+	o_stream_nsend_str(output, "MEMORY-USAGE\n");
+	if (o_stream_flush(output) < 0) {
+		e_error(event, "write(%s) failed: %s", path,
+			o_stream_get_error(output));
+		doveadm_exit_code = EX_TEMPFAIL;
+	} else {
+		alarm(5);
+		line = i_stream_read_next_line(input);
+		alarm(0);
+		if (line == NULL) {
+			e_error(event, "read(%s) failed: %s", path,
+				i_stream_get_error(input));
+			doveadm_exit_code = EX_TEMPFAIL;
+		} else if (line[0] != '+') {
+			e_error(event, "%s: MEMORY-USAGE failed: %s",
+				path, line);
+			doveadm_exit_code = EX_TEMPFAIL;
+		} else {
+			hibernate_memory_print(event, pid,
+				t_strsplit_tabescaped(line + 1));
+		}
+	}
+	o_stream_destroy(&output);
+	i_stream_destroy(&input);
+}
+
+static void cmd_hibernate_memory(struct doveadm_cmd_context *cctx)
+{
+	const char *dir_path;
+	struct dirent *d;
+	DIR *dir;
+
+	dir_path = t_strconcat(doveadm_settings->base_dir, "/",
+			       IMAP_HIBERNATE_ADMIN_DIR, NULL);
+	dir = opendir(dir_path);
+	if (dir == NULL) {
+		if (errno == ENOENT) {
+			/* no imap-hibernate processes running */
+			return;
+		}
+		e_error(cctx->event, "opendir(%s) failed: %m", dir_path);
+		doveadm_exit_code = EX_TEMPFAIL;
+		return;
+	}
+
+	doveadm_print_init(DOVEADM_PRINT_TYPE_TABLE);
+	doveadm_print_header_simple("pid");
+	doveadm_print_header_simple("clients");
+	doveadm_print_header_simple("notify_fds");
+	doveadm_print_header_simple("pool_alloc_bytes");
+	doveadm_print_header_simple("pool_used_bytes");
+	doveadm_print_header_simple("bytes_per_client");
+
+	while ((d = readdir(dir)) != NULL) {
+		if (d->d_name[0] == '.')
+			continue;
+		T_BEGIN {
+			hibernate_memory_process(cctx->event,
+				t_strconcat(dir_path, "/", d->d_name, NULL),
+				d->d_name);
+		} T_END;
+	}
+	if (closedir(dir) < 0)
+		e_error(cctx->event, "closedir(%s) failed: %m", dir_path);
+}
+
+struct doveadm_cmd_ver2 doveadm_cmd_hibernate_memory_ver2 = {
+	.name = "hibernate memory",
+	.cmd = cmd_hibernate_memory,
+	.usage = "",
+DOVEADM_CMD_PARAMS_START
+DOVEADM_CMD_PARAMS_END
+};
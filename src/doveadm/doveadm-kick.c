@@ -48,7 +48,7 @@ static void kick_users_get_via_who(struct kick_context *ctx)
 	/* get a list of all user+sessions matching the filter */
 	p_array_init(&ctx->kicks, ctx->who.pool, 64);
 	struct doveadm_who_iter *iter =
-		doveadm_who_iter_init(ctx->who.anvil_path);
+		doveadm_who_iter_init(ctx->who.anvil_path, &ctx->who.filter);
 	if (!doveadm_who_iter_init_filter(iter, &ctx->who.filter)) {
 		if (doveadm_who_iter_deinit(&iter, &error) < 0)
 			e_error(ctx->event, "%s", error);
@@ -25,13 +25,16 @@ struct index_cmd_context {
 	struct ostream *queue_output;
 	unsigned int max_recent_msgs;
 	bool queue:1;
+	bool bulk:1;
 	bool have_wildcards:1;
 };
 
-static int cmd_index_box_precache(struct doveadm_mail_cmd_context *dctx,
+static int cmd_index_box_precache(struct index_cmd_context *ictx,
 				  struct mailbox *box)
 {
+	struct doveadm_mail_cmd_context *dctx = &ictx->ctx;
 	struct event *event = dctx->cctx->event;
+	enum mailbox_transaction_flags trans_flags;
 	struct mailbox_status status;
 	struct mailbox_transaction_context *trans;
 	struct mail_search_args *search_args;
@@ -69,8 +72,11 @@ static int cmd_index_box_precache(struct doveadm_mail_cmd_context *dctx,
 		       mailbox_get_vname(box), seq, status.messages);
 	}
 
-	trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_NO_CACHE_DEC |
-					  dctx->transaction_flags, __func__);
+	trans_flags = MAILBOX_TRANSACTION_FLAG_NO_CACHE_DEC |
+		dctx->transaction_flags;
+	if (ictx->bulk)
+		trans_flags |= MAILBOX_TRANSACTION_FLAG_BULK_CACHE;
+	trans = mailbox_transaction_begin(box, trans_flags, __func__);
 	search_args = mail_search_build_init();
 	mail_search_build_add_seqset(search_args, seq, status.messages);
 	ctx = mailbox_search_init(trans, search_args, NULL,
@@ -145,7 +151,7 @@ cmd_index_box(struct index_cmd_context *ctx, const struct mailbox_info *info)
 		doveadm_mail_failed_mailbox(&ctx->ctx, box);
 		ret = -1;
 	} else {
-		if (cmd_index_box_precache(&ctx->ctx, box) < 0) {
+		if (cmd_index_box_precache(ctx, box) < 0) {
 			doveadm_mail_failed_mailbox(&ctx->ctx, box);
 			ret = -1;
 		}
@@ -254,6 +260,7 @@ static void cmd_index_init(struct doveadm_mail_cmd_context *_ctx)
 		container_of(_ctx, struct index_cmd_context, ctx);
 
 	ctx->queue = doveadm_cmd_param_flag(cctx, "queue");
+	ctx->bulk = doveadm_cmd_param_flag(cctx, "bulk");
 	(void)doveadm_cmd_param_uint32(cctx, "max-recent", &ctx->max_recent_msgs);
 
 	if (!doveadm_cmd_param_array(cctx, "mailbox-mask", &ctx->mailboxes))
@@ -288,11 +295,12 @@ static struct doveadm_mail_cmd_context *cmd_index_alloc(void)
 
 struct doveadm_cmd_ver2 doveadm_cmd_index_ver2 = {
 	.name = "index",
-	.usage = DOVEADM_CMD_MAIL_USAGE_PREFIX"[-q] [-n <max recent>] <mailbox mask>",
+	.usage = DOVEADM_CMD_MAIL_USAGE_PREFIX"[-q] [-b] [-n <max recent>] <mailbox mask>",
 	.mail_cmd = cmd_index_alloc,
 DOVEADM_CMD_PARAMS_START
 DOVEADM_CMD_MAIL_COMMON
 DOVEADM_CMD_PARAM('q',"queue",CMD_PARAM_BOOL,0)
+DOVEADM_CMD_PARAM('b',"bulk",CMD_PARAM_BOOL,0)
 DOVEADM_CMD_PARAM('n',"max-recent",CMD_PARAM_INT64,CMD_PARAM_FLAG_UNSIGNED)
 DOVEADM_CMD_PARAM('\0',"mailbox-mask",CMD_PARAM_ARRAY,CMD_PARAM_FLAG_POSITIONAL)
 DOVEADM_CMD_PARAMS_END
@@ -0,0 +1,333 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "ioloop.h"
+#include "str.h"
+#include "strnum.h"
+#include "env-util.h"
+#include "execv-const.h"
+#include "fd-util.h"
+#include "write-full.h"
+#include "time-util.h"
+#include "wildcard-match.h"
+#include "master-interface.h"
+#include "doveadm.h"
+#include "doveadm-print.h"
+#include "doveadm-settings.h"
+#include "doveadm-mail.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define DOVEADM_WORKER_FD_ENV "DOVEADM_WORKER_FD"
+/* Number of users queued to each worker at a time. Keeping this small
+   spreads the users evenly between the workers. */
+#define DOVEADM_WORKER_QUEUE_LENGTH 2
+
+struct doveadm_mail_workers;
+
+struct doveadm_mail_worker {
+	struct doveadm_mail_workers *workers;
+	pid_t pid;
+	/* usernames are written to the worker's stdin */
+	int fd_users;
+	/* the worker writes LF for each finished user */
+	int fd_done;
+	struct io *io;
+	unsigned int queued_count;
+};
+
+struct doveadm_mail_workers {
+	struct doveadm_mail_cmd_context *ctx;
+	ARRAY_TYPE(const_string) users;
+	unsigned int next_user_idx, done_count;
+
+	ARRAY(struct doveadm_mail_worker) workers;
+	unsigned int running_count;
+
+	struct timeval start_time;
+	struct timeout *to_progress;
+	bool failed;
+};
+
+static const char *const *global_argv = NULL;
+static unsigned int global_argc = 0;
+static int worker_done_fd = -1;
+
+void doveadm_mail_workers_set_global_args(unsigned int argc,
+					  const char *const *argv)
+{
+	global_argv = argv;
+	global_argc = argc;
+}
+
+bool doveadm_mail_workers_want(struct doveadm_mail_cmd_context *ctx)
+{
+	if (global_argv == NULL || ctx->set->doveadm_local_worker_count == 0)
+		return FALSE;
+	/* Commands sending users to doveadm-server, reading input or printing
+	   output can't be split between multiple processes. Workers also
+	   don't create more workers. */
+	return ctx->set->doveadm_worker_count == 0 &&
+		ctx->cmd_input == NULL && !doveadm_print_is_initialized() &&
+		getenv(DOVEADM_WORKER_FD_ENV) == NULL;
+}
+
+bool doveadm_mail_is_worker(void)
+{
+	const char *value;
+
+	if (worker_done_fd != -1)
+		return TRUE;
+	value = getenv(DOVEADM_WORKER_FD_ENV);
+	if (value == NULL)
+		return FALSE;
+	if (str_to_int(value, &worker_done_fd) < 0 || worker_done_fd < 0)
+		i_fatal("Invalid "DOVEADM_WORKER_FD_ENV": %s", value);
+	return TRUE;
+}
+
+void doveadm_mail_worker_user_done(void)
+{
+	i_assert(worker_done_fd != -1);
+
+	if (write_full(worker_done_fd, "\n", 1) < 0)
+		i_fatal("write(worker fd) failed: %m");
+}
+
+static const char *const *
+doveadm_mail_worker_get_args(struct doveadm_mail_cmd_context *ctx)
+{
+	ARRAY_TYPE(const_string) args;
+	const char *const *argp;
+	const char *value;
+	unsigned int i;
+
+	t_array_init(&args, 32);
+	for (i = 0; i < global_argc; i++)
+		array_push_back(&args, &global_argv[i]);
+	argp = t_strsplit_spaces(ctx->cmd->name, " ");
+	for (; *argp != NULL; argp++)
+		array_push_back(&args, argp);
+	value = "-F";
+	array_push_back(&args, &value);
+	value = "-";
+	array_push_back(&args, &value);
+	argp = doveadm_cmdv2_wrapper_generate_args(ctx);
+	for (; *argp != NULL; argp++)
+		array_push_back(&args, argp);
+	array_append_zero(&args);
+	return array_front(&args);
+}
+
+static void doveadm_mail_worker_input(struct doveadm_mail_worker *worker);
+
+static void
+doveadm_mail_worker_spawn(struct doveadm_mail_workers *workers,
+			  struct doveadm_mail_worker *worker,
+			  const char *const *args)
+{
+	int fd_users[2], fd_done[2];
+
+	if (pipe(fd_users) < 0 || pipe(fd_done) < 0)
+		i_fatal("pipe() failed: %m");
+	/* the other workers must not inherit the pipes, or they won't see
+	   EOF in their input */
+	fd_close_on_exec(fd_users[0], TRUE);
+	fd_close_on_exec(fd_users[1], TRUE);
+	fd_close_on_exec(fd_done[0], TRUE);
+	fd_close_on_exec(fd_done[1], TRUE);
+
+	worker->workers = workers;
+	worker->pid = fork();
+	switch (worker->pid) {
+	case -1:
+		i_fatal("fork() failed: %m");
+	case 0:
+		/* child */
+		if (dup2(fd_users[0], STDIN_FILENO) < 0)
+			i_fatal("dup2() failed: %m");
+		fd_close_on_exec(fd_done[1], FALSE);
+		env_put(DOVEADM_WORKER_FD_ENV, dec2str(fd_done[1]));
+
+		/* use the already parsed configuration */
+		int config_fd = doveadm_settings_get_config_fd();
+		fd_close_on_exec(config_fd, FALSE);
+		env_put(DOVECOT_CONFIG_FD_ENV, dec2str(config_fd));
+		execvp_const(args[0], args);
+	default:
+		break;
+	}
+	i_close_fd(&fd_users[0]);
+	i_close_fd(&fd_done[1]);
+	worker->fd_users = fd_users[1];
+	worker->fd_done = fd_done[0];
+	worker->io = io_add(worker->fd_done, IO_READ,
+			    doveadm_mail_worker_input, worker);
+	workers->running_count++;
+}
+
+static void doveadm_mail_worker_send_next(struct doveadm_mail_worker *worker)
+{
+	struct doveadm_mail_workers *workers = worker->workers;
+	const char *user;
+
+	if (worker->fd_users == -1)
+		return;
+	if (workers->next_user_idx == array_count(&workers->users) ||
+	    doveadm_is_killed()) {
+		/* no more users - the worker stops after the queued ones */
+		i_close_fd(&worker->fd_users);
+		return;
+	}
+
+	user = array_idx_elem(&workers->users, workers->next_user_idx++);
+	if (write_full(worker->fd_users, t_strconcat(user, "\n", NULL),
+		       strlen(user) + 1) < 0) {
+		e_error(workers->ctx->cctx->event,
+			"write(worker %s stdin) failed: %m",
+			dec2str(worker->pid));
+		i_close_fd(&worker->fd_users);
+		workers->failed = TRUE;
+		return;
+	}
+	worker->queued_count++;
+}
+
+static void doveadm_mail_worker_finish(struct doveadm_mail_worker *worker)
+{
+	struct doveadm_mail_workers *workers = worker->workers;
+	struct event *event = workers->ctx->cctx->event;
+	int status;
+
+	io_remove(&worker->io);
+	i_close_fd(&worker->fd_done);
+	i_close_fd(&worker->fd_users);
+
+	if (waitpid(worker->pid, &status, 0) < 0)
+		e_error(event, "waitpid(%s) failed: %m", dec2str(worker->pid));
+	else if (WIFSIGNALED(status)) {
+		e_error(event, "Worker %s died with signal %d",
+			dec2str(worker->pid), WTERMSIG(status));
+		workers->failed = TRUE;
+	} else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		/* the worker already logged the errors */
+		workers->ctx->exit_code = WEXITSTATUS(status);
+	}
+	if (worker->queued_count > 0) {
+		e_error(event, "Worker %s exited with %u unfinished users",
+			dec2str(worker->pid), worker->queued_count);
+		workers->failed = TRUE;
+	}
+
+	i_assert(workers->running_count > 0);
+	if (--workers->running_count == 0)
+		io_loop_stop(current_ioloop);
+}
+
+static void doveadm_mail_worker_input(struct doveadm_mail_worker *worker)
+{
+	unsigned char buf[128];
+	ssize_t i, ret;
+
+	ret = read(worker->fd_done, buf, sizeof(buf));
+	if (ret < 0) {
+		if (errno == EINTR)
+			return;
+		e_error(worker->workers->ctx->cctx->event,
+			"read(worker %s) failed: %m", dec2str(worker->pid));
+	}
+	if (ret <= 0) {
+		/* worker exited */
+		doveadm_mail_worker_finish(worker);
+		return;
+	}
+	for (i = 0; i < ret; i++) {
+		if (buf[i] != '\n' || worker->queued_count == 0)
+			continue;
+		worker->queued_count--;
+		worker->workers->done_count++;
+		doveadm_mail_worker_send_next(worker);
+	}
+}
+
+static void doveadm_mail_workers_progress(struct doveadm_mail_workers *workers)
+{
+	unsigned int total = array_count(&workers->users);
+	unsigned int left = total - workers->done_count;
+	long long msecs;
+	unsigned int eta_secs;
+
+	printf("\r%u/%u", workers->done_count, total);
+	if (workers->done_count > 0 && left > 0) {
+		msecs = timeval_diff_msecs(&ioloop_timeval,
+					   &workers->start_time);
+		eta_secs = msecs * left / workers->done_count / 1000;
+		printf(" (ETA %u:%02u:%02u)", eta_secs / 3600,
+		       eta_secs / 60 % 60, eta_secs % 60);
+	}
+	/* clear the leftovers of a longer previous line */
+	printf("    ");
+	fflush(stdout);
+}
+
+int doveadm_mail_workers_run(struct doveadm_mail_cmd_context *ctx,
+			     const char *wildcard_user)
+{
+	struct doveadm_mail_workers workers;
+	struct doveadm_mail_worker *worker;
+	const char *const *args, *user;
+	unsigned int i, count;
+	int ret;
+
+	i_zero(&workers);
+	workers.ctx = ctx;
+	p_array_init(&workers.users, ctx->pool, 128);
+
+	/* Get all the users first to know how many workers are needed and
+	   to be able to estimate the remaining time. */
+	while ((ret = ctx->v.get_next_user(ctx, &user)) > 0) {
+		if (wildcard_user != NULL &&
+		    !wildcard_match_icase(user, wildcard_user))
+			continue;
+		user = p_strdup(ctx->pool, user);
+		array_push_back(&workers.users, &user);
+		if (doveadm_is_killed())
+			return -1;
+	}
+	if (array_count(&workers.users) == 0)
+		return ret;
+
+	count = I_MIN(ctx->set->doveadm_local_worker_count,
+		      array_count(&workers.users));
+	e_debug(ctx->cctx->event, "Running %u users in %u worker processes",
+		array_count(&workers.users), count);
+	args = doveadm_mail_worker_get_args(ctx);
+
+	/* make sure nothing buffered gets written twice by the children */
+	fflush(stdout);
+	fflush(stderr);
+	i_gettimeofday(&workers.start_time);
+	p_array_init(&workers.workers, ctx->pool, count);
+	for (i = 0; i < count; i++) {
+		worker = array_append_space(&workers.workers);
+		doveadm_mail_worker_spawn(&workers, worker, args);
+	}
+	array_foreach_modifiable(&workers.workers, worker) {
+		for (i = 0; i < DOVEADM_WORKER_QUEUE_LENGTH; i++)
+			doveadm_mail_worker_send_next(worker);
+	}
+	if (doveadm_verbose) {
+		workers.to_progress = timeout_add(1000,
+			doveadm_mail_workers_progress, &workers);
+	}
+	io_loop_run(current_ioloop);
+	timeout_remove(&workers.to_progress);
+	if (doveadm_verbose) {
+		doveadm_mail_workers_progress(&workers);
+		printf("\n");
+	}
+	return ret < 0 || workers.failed ? -1 : 0;
+}
@@ -516,34 +516,16 @@ int doveadm_mail_single_user(struct doveadm_mail_cmd_context *ctx,
 	return doveadm_mail_next_user(ctx, error_r);
 }
 
-static void
-doveadm_mail_all_users(struct doveadm_mail_cmd_context *ctx,
-		       const char *wildcard_user)
+static int
+doveadm_mail_all_users_iter(struct doveadm_mail_cmd_context *ctx,
+			    const char *wildcard_user)
 {
 	struct doveadm_cmd_context *cctx = ctx->cctx;
+	bool worker = doveadm_mail_is_worker();
 	unsigned int user_idx;
-	const char *ip, *user, *error;
+	const char *user, *error;
 	int ret;
 
-	ctx->service_flags |= MAIL_STORAGE_SERVICE_FLAG_USERDB_LOOKUP;
-
-	doveadm_mail_ctx_to_storage_service_input(ctx, &ctx->storage_service_input);
-	ctx->storage_service = mail_storage_service_init(master_service, NULL,
-							 ctx->service_flags);
-
-	T_BEGIN {
-		ctx->v.init(ctx);
-	} T_END;
-	doveadm_print_header_disallow(TRUE);
-
-	if (wildcard_user != NULL) {
-		mail_storage_service_all_init_mask(ctx->storage_service,
-						   wildcard_user);
-	}
-
-	if (hook_doveadm_mail_init != NULL)
-		hook_doveadm_mail_init(ctx);
-
 	user_idx = 0;
 	while ((ret = ctx->v.get_next_user(ctx, &user)) > 0) {
 		if (wildcard_user != NULL) {
@@ -561,7 +543,9 @@ doveadm_mail_all_users(struct doveadm_mail_cmd_context *ctx,
 		} T_END;
 		if (ret == -1)
 			break;
-		if (doveadm_verbose) {
+		if (worker)
+			doveadm_mail_worker_user_done();
+		else if (doveadm_verbose) {
 			if (++user_idx % 100 == 0) {
 				printf("\r%d", user_idx);
 				fflush(stdout);
@@ -572,8 +556,43 @@ doveadm_mail_all_users(struct doveadm_mail_cmd_context *ctx,
 			break;
 		}
 	}
-	if (doveadm_verbose)
+	if (doveadm_verbose && !worker)
 		printf("\n");
+	return ret;
+}
+
+static void
+doveadm_mail_all_users(struct doveadm_mail_cmd_context *ctx,
+		       const char *wildcard_user)
+{
+	struct doveadm_cmd_context *cctx = ctx->cctx;
+	const char *ip;
+	int ret;
+
+	ctx->service_flags |= MAIL_STORAGE_SERVICE_FLAG_USERDB_LOOKUP;
+
+	doveadm_mail_ctx_to_storage_service_input(ctx, &ctx->storage_service_input);
+	ctx->storage_service = mail_storage_service_init(master_service, NULL,
+							 ctx->service_flags);
+
+	T_BEGIN {
+		ctx->v.init(ctx);
+	} T_END;
+	doveadm_print_header_disallow(TRUE);
+
+	if (wildcard_user != NULL) {
+		mail_storage_service_all_init_mask(ctx->storage_service,
+						   wildcard_user);
+	}
+
+	if (hook_doveadm_mail_init != NULL)
+		hook_doveadm_mail_init(ctx);
+
+	if (doveadm_mail_workers_want(ctx))
+		ret = doveadm_mail_workers_run(ctx, wildcard_user);
+	else
+		ret = doveadm_mail_all_users_iter(ctx, wildcard_user);
+
 	ip = net_ip2addr(&cctx->remote_ip);
 	if (ip[0] == '\0')
 		i_set_failure_prefix("doveadm: ");
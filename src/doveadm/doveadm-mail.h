@@ -132,6 +132,22 @@ void doveadm_mail_server_handle(struct doveadm_server *server,
 				const char *username, bool print_username);
 void doveadm_mail_server_flush(struct doveadm_mail_cmd_context *ctx);
 
+/* Set the doveadm command line's global arguments (before the command name)
+   for executing the worker processes. */
+void doveadm_mail_workers_set_global_args(unsigned int argc,
+					  const char *const *argv);
+/* Returns TRUE if the users should be split between
+   doveadm_local_worker_count worker processes. */
+bool doveadm_mail_workers_want(struct doveadm_mail_cmd_context *ctx);
+/* Run the command for all the users in worker processes. Returns 0 if all
+   users were processed, -1 if some weren't. */
+int doveadm_mail_workers_run(struct doveadm_mail_cmd_context *ctx,
+			     const char *wildcard_user);
+/* Returns TRUE if this process is a worker process. */
+bool doveadm_mail_is_worker(void);
+/* Tell the parent process that the worker has finished with a user. */
+void doveadm_mail_worker_user_done(void);
+
 int doveadm_cmd_pass_lookup(struct doveadm_mail_cmd_context *ctx,
 			    const char *const *extra_fields, pool_t pool,
 			    const char *const **fields_r,
@@ -48,6 +48,7 @@ struct service_settings doveadm_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "$default_internal_group",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -57,6 +58,7 @@ struct service_settings doveadm_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &doveadm_unix_listeners_buf,
 			      sizeof(doveadm_unix_listeners[0]) } },
@@ -78,6 +80,8 @@ static const struct setting_define doveadm_setting_defines[] = {
 	DEF(STR, auth_socket_path),
 	DEF(STR, doveadm_socket_path),
 	DEF(UINT, doveadm_worker_count),
+	DEF(UINT, doveadm_local_worker_count),
+	DEF(UINT, doveadm_http_worker_count),
 	DEF(IN_PORT, doveadm_port),
 	{ .type = SET_ALIAS, .key = "doveadm_proxy_port" },
 	DEF(ENUM, doveadm_ssl),
@@ -91,6 +95,7 @@ static const struct setting_define doveadm_setting_defines[] = {
 	DEF(UINT, dsync_commit_msgs_interval),
 	DEF(STR, doveadm_http_rawlog_dir),
 	DEF(STR, dsync_hashed_headers),
+	DEF(STR, dsync_compression),
 
 	{ .type = SET_STRLIST, .key = "plugin",
 	  .offset = offsetof(struct doveadm_settings, plugin_envs) },
@@ -108,6 +113,8 @@ const struct doveadm_settings doveadm_default_settings = {
 	.auth_socket_path = "auth-userdb",
 	.doveadm_socket_path = "doveadm-server",
 	.doveadm_worker_count = 0,
+	.doveadm_local_worker_count = 0,
+	.doveadm_http_worker_count = 0,
 	.doveadm_port = 0,
 	.doveadm_ssl = "no:ssl:starttls",
 	.doveadm_username = "doveadm",
@@ -117,6 +124,7 @@ const struct doveadm_settings doveadm_default_settings = {
 	.dsync_remote_cmd = "ssh -l%{login} %{host} doveadm dsync-server -u%u -U",
 	.dsync_features = "",
 	.dsync_hashed_headers = "Date Message-ID",
+	.dsync_compression = "",
 	.dsync_commit_msgs_interval = 100,
 	.doveadm_api_key = "",
 	.doveadm_http_rawlog_dir = "",
@@ -22,6 +22,8 @@ struct doveadm_settings {
 	const char *auth_socket_path;
 	const char *doveadm_socket_path;
 	unsigned int doveadm_worker_count;
+	unsigned int doveadm_local_worker_count;
+	unsigned int doveadm_http_worker_count;
 	in_port_t doveadm_port;
 	const char *doveadm_ssl;
 	const char *doveadm_username;
@@ -32,6 +34,7 @@ struct doveadm_settings {
 	const char *doveadm_api_key;
 	const char *dsync_features;
 	const char *dsync_hashed_headers;
+	const char *dsync_compression;
 	unsigned int dsync_commit_msgs_interval;
 	const char *doveadm_http_rawlog_dir;
 	enum dsync_features parsed_features;
@@ -206,12 +206,13 @@ int who_parse_args(struct who_context *ctx, const char *alt_username_field,
 	return 0;
 }
 
-struct doveadm_who_iter *doveadm_who_iter_init(const char *anvil_path)
+struct doveadm_who_iter *
+doveadm_who_iter_init(const char *anvil_path, const struct who_filter *filter)
 {
 #define ANVIL_HANDSHAKE "VERSION\tanvil-client\t2\t0\n\n"
-#define ANVIL_CMD ANVIL_HANDSHAKE"CONNECT-DUMP\n"
 	struct doveadm_who_iter *iter;
 	const char *line;
+	string_t *cmd;
 	int fd;
 	pool_t pool;
 
@@ -220,9 +221,21 @@ struct doveadm_who_iter *doveadm_who_iter_init(const char *anvil_path)
 	iter->pool = pool;
 	iter->line_pool = pool_alloconly_create("doveadm who line", 256);
 
+	cmd = t_str_new(128);
+	str_append(cmd, ANVIL_HANDSHAKE"CONNECT-DUMP");
+	if (filter != NULL && filter->username != NULL &&
+	    filter->alt_username_field == NULL) {
+		/* Let anvil filter the users, so it doesn't have to send
+		   all the sessions. The filter is still applied to the
+		   returned lines, in case anvil is an older version. */
+		str_append_c(cmd, '\t');
+		str_append_tabescaped(cmd, filter->username);
+	}
+	str_append_c(cmd, '\n');
+
 	fd = doveadm_connect(anvil_path);
 	net_set_nonblock(fd, FALSE);
-	if (write(fd, ANVIL_CMD, strlen(ANVIL_CMD)) < 0) {
+	if (write(fd, str_data(cmd), str_len(cmd)) < 0) {
 		iter->error = p_strdup_printf(iter->pool,
 					      "write(%s) failed: %m", anvil_path);
 		i_close_fd(&fd);
@@ -471,7 +484,8 @@ static void cmd_who(struct doveadm_cmd_context *cctx)
 	}
 
 	doveadm_print_init(DOVEADM_PRINT_TYPE_TABLE);
-	struct doveadm_who_iter *iter = doveadm_who_iter_init(ctx.anvil_path);
+	struct doveadm_who_iter *iter =
+		doveadm_who_iter_init(ctx.anvil_path, &ctx.filter);
 	struct who_line who_line;
 	if (!separate_connections) {
 		while (doveadm_who_iter_next(iter, &who_line))
@@ -44,7 +44,11 @@ int who_parse_args(struct who_context *ctx, const char *alt_username_field,
 bool who_line_filter_match(const struct who_line *line,
 			   const struct who_filter *filter);
 
-struct doveadm_who_iter *doveadm_who_iter_init(const char *anvil_path);
+/* If filter is given, anvil is asked to send only the sessions whose username
+   matches it. The lines still need to be matched with
+   who_line_filter_match(). */
+struct doveadm_who_iter *
+doveadm_who_iter_init(const char *anvil_path, const struct who_filter *filter);
 /* Returns TRUE if ok, FALSE if filter can never match anything. */
 bool doveadm_who_iter_init_filter(struct doveadm_who_iter *iter,
 				  struct who_filter *filter);
@@ -312,6 +312,7 @@ int main(int argc, char *argv[])
 		}
 	}
 	cmd_name = argv[optind];
+	doveadm_mail_workers_set_global_args(optind, (const char **)argv);
 
 	if (cmd_name != NULL && strcmp(cmd_name, "help") == 0 &&
 	    argv[optind+1] != NULL) {
@@ -0,0 +1,290 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "str.h"
+#include "safe-mkstemp.h"
+#include "istream.h"
+#include "istream-concat.h"
+#include "ostream.h"
+#include "ostream-null.h"
+#include "hash-format.h"
+#include "fs-api.h"
+#include "istream-attachment-extractor.h"
+#include "mail-user.h"
+#include "mail-namespace.h"
+#include "mail-storage-private.h"
+#include "dsync-attachment.h"
+
+struct dsync_attachment_store {
+	pool_t pool;
+	struct fs *fs;
+	const char *dir;
+	const char *hash;
+	uoff_t min_size;
+};
+
+struct dsync_attachment_find_context {
+	pool_t pool;
+	const char *temp_path_prefix;
+	ARRAY_TYPE(mail_attachment_extref) *extrefs;
+};
+
+int dsync_attachment_store_init(struct mail_user *user, struct event *event,
+				struct dsync_attachment_store **store_r,
+				const char **error_r)
+{
+	struct dsync_attachment_store *store;
+	struct mail_namespace *ns;
+	const struct mail_storage_settings *set;
+	const char *name, *args, *dir, *error;
+	struct fs *fs;
+	pool_t pool;
+
+	*store_r = NULL;
+
+	ns = mail_namespace_find_inbox(user->namespaces);
+	set = ns->storage->set;
+	if (*set->mail_attachment_fs == '\0' ||
+	    *set->mail_attachment_dir == '\0')
+		return 0;
+	/* only dbox saves the attachments separately */
+	if (strcmp(ns->storage->name, "sdbox") != 0 &&
+	    strcmp(ns->storage->name, "mdbox") != 0)
+		return 0;
+
+	args = strpbrk(set->mail_attachment_fs, ": ");
+	if (args == NULL) {
+		name = set->mail_attachment_fs;
+		args = "";
+	} else {
+		name = t_strdup_until(set->mail_attachment_fs, args++);
+	}
+	dir = mail_user_home_expand(user, set->mail_attachment_dir);
+	if (mailbox_list_init_fs(ns->list, event, name, args, dir,
+				 &fs, &error) < 0) {
+		*error_r = t_strdup_printf("mail_attachment_fs: %s", error);
+		return -1;
+	}
+
+	pool = pool_alloconly_create("dsync attachment store", 256);
+	store = p_new(pool, struct dsync_attachment_store, 1);
+	store->pool = pool;
+	store->fs = fs;
+	store->dir = p_strdup(pool, dir);
+	store->hash = p_strdup(pool, set->mail_attachment_hash);
+	store->min_size = set->mail_attachment_min_size;
+	*store_r = store;
+	return 1;
+}
+
+void dsync_attachment_store_deinit(struct dsync_attachment_store **_store)
+{
+	struct dsync_attachment_store *store = *_store;
+
+	if (store == NULL)
+		return;
+	*_store = NULL;
+
+	fs_deinit(&store->fs);
+	pool_unref(&store->pool);
+}
+
+const char *
+dsync_attachment_store_get_hash(struct dsync_attachment_store *store)
+{
+	return store->hash;
+}
+
+uoff_t dsync_attachment_store_get_min_size(struct dsync_attachment_store *store)
+{
+	return store->min_size;
+}
+
+int dsync_attachment_store_lookup(struct dsync_attachment_store *store,
+				  const char *hash, const char **path_r,
+				  const char **error_r)
+{
+	struct fs_iter *iter;
+	const char *dir, *prefix, *fname, *subdir, *error;
+	struct fs *fs;
+
+	/* the hash comes from the remote, so make sure it can't point
+	   outside the attachment directory */
+	if (strlen(hash) < 4 || strchr(hash, '/') != NULL ||
+	    hash[0] == '.' || hash[2] == '.')
+		return 0;
+
+	subdir = t_strdup_printf("%c%c/%c%c", hash[0], hash[1],
+				 hash[2], hash[3]);
+	dir = t_strdup_printf("%s/%s", store->dir, subdir);
+	prefix = t_strconcat(hash, "-", NULL);
+
+	/* wrappers like fs-sis don't support iteration, but they don't
+	   change the filenames either, so list the backend directly */
+	fs = store->fs;
+	while (fs_get_parent(fs) != NULL)
+		fs = fs_get_parent(fs);
+
+	*path_r = NULL;
+	iter = fs_iter_init(fs, dir, 0);
+	while ((fname = fs_iter_next(iter)) != NULL) {
+		if (str_begins_with(fname, prefix)) {
+			*path_r = t_strdup_printf("%s/%s", subdir, fname);
+			break;
+		}
+	}
+	if (fs_iter_deinit(&iter, &error) < 0) {
+		*error_r = t_strdup_printf("fs_iter_deinit(%s) failed: %s",
+					   dir, error);
+		return -1;
+	}
+	return *path_r != NULL ? 1 : 0;
+}
+
+int dsync_attachment_store_connect(struct dsync_attachment_store *store,
+				   struct istream **input, uoff_t full_size,
+				   const char *ext_refs, const char **error_r)
+{
+	return index_attachment_stream_get(store->fs, store->dir, "", input,
+					   full_size, ext_refs, error_r);
+}
+
+static bool
+dsync_attachment_want(const struct istream_attachment_header *hdr,
+		      void *context ATTR_UNUSED)
+{
+	/* same as what the storage saves as attachments by default */
+	return hdr->content_type != NULL &&
+		!str_begins_icase_with(hdr->content_type, "text/");
+}
+
+static int dsync_attachment_open_temp_fd(void *context)
+{
+	struct dsync_attachment_find_context *ctx = context;
+	string_t *temp_path;
+	int fd;
+
+	temp_path = t_str_new(256);
+	str_append(temp_path, ctx->temp_path_prefix);
+	fd = safe_mkstemp_hostpid(temp_path, 0600, (uid_t)-1, (gid_t)-1);
+	if (fd == -1) {
+		i_error("safe_mkstemp(%s) failed: %m", str_c(temp_path));
+		return -1;
+	}
+	if (i_unlink(str_c(temp_path)) < 0) {
+		i_close_fd(&fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int
+dsync_attachment_open_ostream(struct istream_attachment_info *info,
+			      struct ostream **output_r,
+			      const char **error_r ATTR_UNUSED, void *context)
+{
+	struct dsync_attachment_find_context *ctx = context;
+	struct mail_attachment_extref *extref;
+
+	extref = array_append_space(ctx->extrefs);
+	extref->path = p_strdup(ctx->pool, info->hash);
+	extref->start_offset = info->start_offset;
+	extref->size = info->encoded_size;
+	extref->base64_blocks_per_line = info->base64_blocks_per_line;
+	extref->base64_have_crlf = info->base64_have_crlf;
+
+	/* only the hash is needed, not the attachment itself */
+	*output_r = o_stream_create_null();
+	return 0;
+}
+
+static int
+dsync_attachment_close_ostream(struct ostream *output, bool success,
+			       const char **error ATTR_UNUSED, void *context)
+{
+	struct dsync_attachment_find_context *ctx = context;
+
+	o_stream_destroy(&output);
+	if (!success)
+		array_pop_back(ctx->extrefs);
+	return success ? 0 : -1;
+}
+
+int dsync_attachment_find(struct istream *input, const char *hash_format,
+			  uoff_t min_size, const char *temp_path_prefix,
+			  pool_t pool,
+			  ARRAY_TYPE(mail_attachment_extref) *extrefs,
+			  const char **error_r)
+{
+	struct dsync_attachment_find_context ctx;
+	struct istream_attachment_settings set;
+	struct istream *attach_input;
+	const char *error;
+	int ret = 0;
+
+	i_zero(&ctx);
+	ctx.pool = pool;
+	ctx.temp_path_prefix = temp_path_prefix;
+	ctx.extrefs = extrefs;
+
+	i_zero(&set);
+	set.min_size = min_size;
+	set.drain_parent_input = TRUE;
+	if (hash_format_init(hash_format, &set.hash_format, &error) < 0) {
+		*error_r = t_strdup_printf("Invalid attachment hash %s: %s",
+					   hash_format, error);
+		return -1;
+	}
+	set.want_attachment = dsync_attachment_want;
+	set.open_temp_fd = dsync_attachment_open_temp_fd;
+	set.open_attachment_ostream = dsync_attachment_open_ostream;
+	set.close_attachment_ostream = dsync_attachment_close_ostream;
+
+	i_stream_seek(input, 0);
+	attach_input = i_stream_create_attachment_extractor(input, &set, &ctx);
+	while (i_stream_read(attach_input) != -1)
+		i_stream_skip(attach_input, i_stream_get_data_size(attach_input));
+	if (attach_input->stream_errno != 0) {
+		*error_r = t_strdup_printf("read(%s) failed: %s",
+					   i_stream_get_name(attach_input),
+					   i_stream_get_error(attach_input));
+		ret = -1;
+	}
+	i_stream_unref(&attach_input);
+	i_stream_seek(input, 0);
+	return ret;
+}
+
+struct istream *
+dsync_attachment_skip(struct istream *input,
+		      const ARRAY_TYPE(mail_attachment_extref) *extrefs)
+{
+	ARRAY(struct istream *) inputs;
+	const struct mail_attachment_extref *extref;
+	struct istream *range_input, **inputp, *ret_input;
+	uoff_t offset = 0;
+
+	t_array_init(&inputs, array_count(extrefs) + 2);
+	array_foreach(extrefs, extref) {
+		i_assert(extref->start_offset >= offset);
+		if (extref->start_offset > offset) {
+			range_input = i_stream_create_range(input, offset,
+				extref->start_offset - offset);
+			array_push_back(&inputs, &range_input);
+		}
+		offset = extref->start_offset + extref->size;
+	}
+	range_input = i_stream_create_range(input, offset, UOFF_T_MAX);
+	array_push_back(&inputs, &range_input);
+	array_append_zero(&inputs);
+
+	ret_input = i_stream_create_concat(array_front_modifiable(&inputs));
+	i_stream_set_name(ret_input, t_strdup_printf(
+		"attachments-skipped(%s)", i_stream_get_name(input)));
+	array_foreach_modifiable(&inputs, inputp) {
+		if (*inputp != NULL)
+			i_stream_unref(inputp);
+	}
+	return ret_input;
+}
@@ -0,0 +1,50 @@
+#ifndef DSYNC_ATTACHMENT_H
+#define DSYNC_ATTACHMENT_H
+
+#include "index-attachment.h"
+
+struct mail_user;
+struct dsync_attachment_store;
+
+/* Open the local user's deduplicated attachment storage
+   (mail_attachment_dir). Returns 1 if opened, 0 if attachments aren't
+   stored separately, -1 on error. */
+int dsync_attachment_store_init(struct mail_user *user, struct event *event,
+				struct dsync_attachment_store **store_r,
+				const char **error_r);
+void dsync_attachment_store_deinit(struct dsync_attachment_store **store);
+
+/* Returns the mail_attachment_hash setting. */
+const char *
+dsync_attachment_store_get_hash(struct dsync_attachment_store *store);
+/* Returns the mail_attachment_min_size setting. */
+uoff_t dsync_attachment_store_get_min_size(struct dsync_attachment_store *store);
+
+/* Find an attachment with the given hash. Returns 1 and the attachment's path
+   relative to mail_attachment_dir if found, 0 if not, -1 on error. */
+int dsync_attachment_store_lookup(struct dsync_attachment_store *store,
+				  const char *hash, const char **path_r,
+				  const char **error_r);
+/* Replace *input with a stream where the attachments in ext_refs have been
+   added back from the store. The stream must become exactly full_size
+   bytes. */
+int dsync_attachment_store_connect(struct dsync_attachment_store *store,
+				   struct istream **input, uoff_t full_size,
+				   const char *ext_refs, const char **error_r);
+
+/* Find the attachments that would be saved separately with the given
+   mail_attachment_hash and mail_attachment_min_size settings. The extrefs'
+   paths are set to the attachments' hashes. Returns 0 on success, -1 if
+   reading the input failed. */
+int dsync_attachment_find(struct istream *input, const char *hash_format,
+			  uoff_t min_size, const char *temp_path_prefix,
+			  pool_t pool,
+			  ARRAY_TYPE(mail_attachment_extref) *extrefs,
+			  const char **error_r);
+/* Returns the input with the given attachments left out. The extrefs must
+   be sorted by start_offset. */
+struct istream *
+dsync_attachment_skip(struct istream *input,
+		      const ARRAY_TYPE(mail_attachment_extref) *extrefs);
+
+#endif
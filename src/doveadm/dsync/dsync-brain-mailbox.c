@@ -237,6 +237,7 @@ dsync_brain_sync_mailbox_init_remote(struct dsync_brain *brain,
 					  brain->import_commit_msgs_interval,
 					  import_flags, brain->hdr_hash_version,
 					  brain->hashed_headers,
+					  brain->attachment_store,
 					  brain->event);
 }
 
@@ -263,6 +264,7 @@ int dsync_brain_sync_mailbox_open(struct dsync_brain *brain,
 					      highest_wanted_uid,
 					      last_common_modseq,
 					      last_common_pvt_modseq,
+					      brain->mailbox_state.last_messages_count,
 					      &pvt_too_old);
 	if (ret < 0) {
 		e_error(brain->event,
@@ -351,6 +353,8 @@ int dsync_brain_sync_mailbox_open(struct dsync_brain *brain,
 					  exporter_flags,
 					  brain->hdr_hash_version,
 					  brain->hashed_headers,
+					  brain->remote_attachment_hash,
+					  brain->remote_attachment_min_size,
 					  brain->event);
 	dsync_brain_sync_mailbox_init_remote(brain, remote_dsync_box);
 	return 1;
@@ -471,6 +475,16 @@ dsync_brain_has_mailbox_state_changed(struct dsync_brain *brain,
 		state->last_messages_count != dsync_box->messages_count;
 }
 
+static bool
+dsync_brain_want_mailbox_partition(struct dsync_brain *brain,
+				   const guid_128_t mailbox_guid)
+{
+	if (brain->mailbox_partition_count <= 1)
+		return TRUE;
+	return guid_128_hash(mailbox_guid) % brain->mailbox_partition_count ==
+		brain->mailbox_partition_idx;
+}
+
 static int
 dsync_brain_try_next_mailbox(struct dsync_brain *brain, struct mailbox **box_r,
 			     struct file_lock **lock_r,
@@ -490,7 +504,9 @@ dsync_brain_try_next_mailbox(struct dsync_brain *brain, struct mailbox **box_r,
 
 	while (dsync_mailbox_tree_iter_next(brain->local_tree_iter, &vname, &node)) {
 		if (node->existence == DSYNC_MAILBOX_NODE_EXISTS &&
-		    !guid_128_is_empty(node->mailbox_guid))
+		    !guid_128_is_empty(node->mailbox_guid) &&
+		    dsync_brain_want_mailbox_partition(brain,
+						       node->mailbox_guid))
 			break;
 		vname = NULL;
 	}
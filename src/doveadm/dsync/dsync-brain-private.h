@@ -11,6 +11,7 @@
 #define DSYNC_MAILBOX_DEFAULT_LOCK_TIMEOUT_SECS 30
 
 struct dsync_mailbox_tree_sync_change;
+struct dsync_attachment_store;
 
 enum dsync_state {
 	DSYNC_STATE_MASTER_RECV_HANDSHAKE,
@@ -58,6 +59,7 @@ struct dsync_brain {
 	const char *sync_box;
 	struct mailbox *virtual_all_box;
 	guid_128_t sync_box_guid;
+	unsigned int mailbox_partition_count, mailbox_partition_idx;
 	const char *const *exclude_mailboxes;
 	enum dsync_brain_sync_type sync_type;
 	time_t sync_since_timestamp;
@@ -109,6 +111,13 @@ struct dsync_brain {
 
 	const char *const *hashed_headers;
 
+	/* Local deduplicated attachments, or NULL if not used */
+	struct dsync_attachment_store *attachment_store;
+	/* Remote's mail_attachment_hash, or NULL if the remote doesn't
+	   store attachments deduplicated */
+	const char *remote_attachment_hash;
+	uoff_t remote_attachment_min_size;
+
 	bool master_brain:1;
 	bool mail_requests:1;
 	bool backup_send:1;
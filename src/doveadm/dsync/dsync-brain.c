@@ -11,6 +11,7 @@
 #include "master-service.h"
 #include "master-service-settings.h"
 #include "mail-namespace.h"
+#include "dsync-attachment.h"
 #include "dsync-mailbox-tree.h"
 #include "dsync-ibc.h"
 #include "dsync-brain-private.h"
@@ -134,6 +135,7 @@ dsync_brain_common_init(struct mail_user *user, struct dsync_ibc *ibc,
 {
 	struct dsync_brain *brain;
 	const struct master_service_settings *service_set;
+	const char *error;
 	pool_t pool;
 
 	service_set = master_service_settings_get(master_service);
@@ -155,9 +157,37 @@ dsync_brain_common_init(struct mail_user *user, struct dsync_ibc *ibc,
 	brain->event = event_create(user->event);
 	event_set_append_log_prefix(brain->event, t_strdup_printf(
 		"brain %c: ", master_brain ? 'M': 'S'));
+
+	if (dsync_attachment_store_init(user, brain->event,
+					&brain->attachment_store,
+					&error) < 0) {
+		e_error(brain->event, "%s - "
+			"sending all attachments from remote", error);
+	}
 	return brain;
 }
 
+static void
+dsync_brain_set_attachment_settings(struct dsync_brain *brain,
+				    struct dsync_ibc_settings *ibc_set)
+{
+	if (brain->attachment_store == NULL)
+		return;
+	ibc_set->attachment_hash =
+		dsync_attachment_store_get_hash(brain->attachment_store);
+	ibc_set->attachment_min_size =
+		dsync_attachment_store_get_min_size(brain->attachment_store);
+}
+
+static void
+dsync_brain_set_remote_attachment_settings(struct dsync_brain *brain,
+					   const struct dsync_ibc_settings *ibc_set)
+{
+	brain->remote_attachment_hash =
+		p_strdup(brain->pool, ibc_set->attachment_hash);
+	brain->remote_attachment_min_size = ibc_set->attachment_min_size;
+}
+
 static void
 dsync_brain_set_flags(struct dsync_brain *brain, enum dsync_brain_flags flags)
 {
@@ -234,6 +264,10 @@ dsync_brain_master_init(struct mail_user *user, struct dsync_ibc *ibc,
 		p_strarray_dup(brain->pool, set->exclude_mailboxes);
 	memcpy(brain->sync_box_guid, set->sync_box_guid,
 	       sizeof(brain->sync_box_guid));
+	brain->mailbox_partition_count = set->mailbox_partition_count;
+	brain->mailbox_partition_idx = set->mailbox_partition_idx;
+	i_assert(brain->mailbox_partition_count <= 1 ||
+		 brain->mailbox_partition_idx < brain->mailbox_partition_count);
 	brain->lock_timeout = set->lock_timeout_secs;
 	if (brain->lock_timeout != 0)
 		brain->mailbox_lock_timeout_secs = brain->lock_timeout;
@@ -282,6 +316,8 @@ dsync_brain_master_init(struct mail_user *user, struct dsync_ibc *ibc,
 	ibc_set.lock_timeout = set->lock_timeout_secs;
 	ibc_set.import_commit_msgs_interval = set->import_commit_msgs_interval;
 	ibc_set.hashed_headers = set->hashed_headers;
+	ibc_set.compression = set->compression;
+	dsync_brain_set_attachment_settings(brain, &ibc_set);
 	/* reverse the backup direction for the slave */
 	ibc_set.brain_flags = flags & ENUM_NEGATE(DSYNC_BRAIN_FLAG_BACKUP_SEND |
 						  DSYNC_BRAIN_FLAG_BACKUP_RECV);
@@ -324,6 +360,7 @@ dsync_brain_slave_init(struct mail_user *user, struct dsync_ibc *ibc,
 	i_zero(&ibc_set);
 	ibc_set.hdr_hash_v2 = TRUE;
 	ibc_set.hostname = my_hostdomain();
+	dsync_brain_set_attachment_settings(brain, &ibc_set);
 	dsync_ibc_send_handshake(ibc, &ibc_set);
 
 	if (brain->verbose_proctitle)
@@ -385,6 +422,7 @@ int dsync_brain_deinit(struct dsync_brain **_brain, enum mail_error *error_r)
 		dsync_mailbox_tree_deinit(&brain->remote_mailbox_tree);
 	hash_table_iterate_deinit(&brain->mailbox_states_iter);
 	hash_table_destroy(&brain->mailbox_states);
+	dsync_attachment_store_deinit(&brain->attachment_store);
 
 	pool_unref(&brain->dsync_box_pool);
 
@@ -497,6 +535,7 @@ static bool dsync_brain_master_recv_handshake(struct dsync_brain *brain)
 		}
 	}
 	dsync_brain_set_hdr_hash_version(brain, ibc_set);
+	dsync_brain_set_remote_attachment_settings(brain, ibc_set);
 
 	brain->state = brain->sync_type == DSYNC_BRAIN_SYNC_TYPE_STATE ?
 		DSYNC_STATE_MASTER_SEND_LAST_COMMON :
@@ -515,6 +554,7 @@ static bool dsync_brain_slave_recv_handshake(struct dsync_brain *brain)
 	if (dsync_ibc_recv_handshake(brain->ibc, &ibc_set) == 0)
 		return FALSE;
 	dsync_brain_set_hdr_hash_version(brain, ibc_set);
+	dsync_brain_set_remote_attachment_settings(brain, ibc_set);
 
 	if (ibc_set->lock_timeout > 0) {
 		brain->lock_timeout = ibc_set->lock_timeout;
@@ -831,6 +871,11 @@ bool dsync_brain_has_failed(struct dsync_brain *brain)
 	return brain->failed;
 }
 
+bool dsync_brain_is_finished(struct dsync_brain *brain)
+{
+	return brain->failed || brain->state == DSYNC_STATE_DONE;
+}
+
 const char *dsync_brain_get_unexpected_changes_reason(struct dsync_brain *brain,
 						      bool *remote_only_r)
 {
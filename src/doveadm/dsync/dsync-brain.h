@@ -83,6 +83,9 @@ struct dsync_brain_settings {
 	const char *sync_flag;
 	/* Headers to hash (defaults to Date, Message-ID) */
 	const char *const *hashed_headers;
+	/* If non-NULL, compress the remote dsync stream with this mechanism
+	   if the remote supports it. */
+	const char *compression;
 
 	/* If non-zero, use dsync lock file for this user */
 	unsigned int lock_timeout_secs;
@@ -91,6 +94,13 @@ struct dsync_brain_settings {
 	unsigned int import_commit_msgs_interval;
 	/* Input state for DSYNC_BRAIN_SYNC_TYPE_STATE */
 	const char *state;
+	/* If mailbox_partition_count > 1, sync mails only in the mailboxes
+	   whose GUID hash modulo mailbox_partition_count equals
+	   mailbox_partition_idx. This allows multiple brains to sync
+	   different mailboxes of the same user concurrently after the
+	   mailbox tree has already been synced. */
+	unsigned int mailbox_partition_count;
+	unsigned int mailbox_partition_idx;
 };
 
 #define DSYNC_LIST_CONTEXT(obj) \
@@ -119,6 +129,8 @@ int dsync_brain_deinit(struct dsync_brain **brain, enum mail_error *error_r);
 bool dsync_brain_run(struct dsync_brain *brain, bool *changed_r);
 /* Returns TRUE if brain has failed, and there's no point in continuing. */
 bool dsync_brain_has_failed(struct dsync_brain *brain);
+/* Returns TRUE if brain has finished syncing (successfully or not). */
+bool dsync_brain_is_finished(struct dsync_brain *brain);
 /* Returns the current sync state string, which can be given as parameter to
    dsync_brain_master_init() to quickly sync only the new changes. */
 void dsync_brain_get_state(struct dsync_brain *brain, string_t *output);
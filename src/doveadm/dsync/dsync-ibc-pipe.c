@@ -181,6 +181,9 @@ dsync_ibc_pipe_send_handshake(struct dsync_ibc *ibc,
 	item->u.set.sync_until_timestamp = set->sync_until_timestamp;
 	item->u.set.sync_max_size = set->sync_max_size;
 	item->u.set.sync_flags = p_strdup(item->pool, set->sync_flags);
+	/* mails are copied directly within the same process, so there's
+	   nothing to gain by leaving out attachments */
+	item->u.set.attachment_hash = NULL;
 }
 
 static enum dsync_ibc_recv_ret
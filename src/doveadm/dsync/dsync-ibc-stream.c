@@ -10,6 +10,7 @@
 #include "ostream.h"
 #include "str.h"
 #include "strescape.h"
+#include "compression.h"
 #include "master-service.h"
 #include "mail-cache.h"
 #include "mail-storage-private.h"
@@ -79,7 +80,8 @@ static const struct {
 	  	"no_mail_sync no_backup_overwrite purge_remote "
 		"no_notify sync_since_timestamp sync_max_size sync_flags sync_until_timestamp "
 		"virtual_all_box empty_hdr_workaround import_commit_msgs_interval "
-		"hashed_headers alt_char"
+		"hashed_headers alt_char attachment_hash attachment_min_size "
+		"compress compress_mechanisms"
 	},
 	{ .name = "mailbox_state",
 	  .chr = 'S',
@@ -116,15 +118,17 @@ static const struct {
 	  .required_keys = "type uid",
 	  .optional_keys = "guid hdr_hash modseq pvt_modseq "
 	  	"add_flags remove_flags final_flags "
-		"keywords_reset keyword_changes received_timestamp virtual_size"
+		"keywords_reset keyword_changes received_timestamp virtual_size "
+		"attachment_hashes"
 	},
 	{ .name = "mail_request",
 	  .chr = 'R',
-	  .optional_keys = "guid uid"
+	  .optional_keys = "guid uid attachment_hashes"
 	},
 	{ .name = "mail",
 	  .chr = 'M',
-	  .optional_keys = "guid uid pop3_uidl pop3_order received_date saved_date stream"
+	  .optional_keys = "guid uid pop3_uidl pop3_order received_date saved_date stream "
+		"attachment_refs attachment_full_size"
 	},
 	{ .name = "finish",
 	  .chr = 'F',
@@ -141,6 +145,10 @@ static const struct {
 };
 static_assert_array_size(items, ITEM_END_OF_LIST+1);
 
+static const char *const compress_mechanisms[] = {
+	"zstd", "deflate", NULL
+};
+
 struct dsync_ibc_stream {
 	struct dsync_ibc ibc;
 
@@ -163,6 +171,8 @@ struct dsync_ibc_stream {
 	struct dsync_mailbox_attribute *cur_attr;
 	char value_output_last;
 
+	const struct compression_handler *compress_handler;
+
 	enum item_type last_recv_item, last_sent_item;
 	bool last_recv_item_eol:1;
 	bool last_sent_item_eol:1;
@@ -312,6 +322,63 @@ static int dsync_ibc_stream_output(struct dsync_ibc_stream *ibc)
 	return ret;
 }
 
+static void dsync_ibc_stream_compress_input(struct dsync_ibc_stream *ibc)
+{
+	struct istream *input = ibc->input;
+
+	/* the already buffered input is read through the new stream */
+	io_remove(&ibc->io);
+	ibc->input = ibc->compress_handler->create_istream(input);
+	i_stream_unref(&input);
+	ibc->io = io_add_istream(ibc->input, dsync_ibc_stream_input, ibc);
+	io_set_pending(ibc->io);
+}
+
+static void dsync_ibc_stream_compress_output(struct dsync_ibc_stream *ibc)
+{
+	struct ostream *output = ibc->output;
+	bool corked = o_stream_is_corked(output);
+
+	/* send the uncompressed data first */
+	if (corked)
+		o_stream_uncork(output);
+	ibc->output = ibc->compress_handler->create_ostream(output,
+		ibc->compress_handler->get_default_level());
+	o_stream_unref(&output);
+	o_stream_set_no_error_handling(ibc->output, TRUE);
+	o_stream_set_flush_callback(ibc->output, dsync_ibc_stream_output, ibc);
+	if (corked)
+		o_stream_cork(ibc->output);
+}
+
+static bool
+dsync_ibc_stream_compress_lookup(const char *mechanism,
+				 const struct compression_handler **handler_r)
+{
+	/* the mechanism must be able to flush the output without ending the
+	   stream */
+	if (!str_array_find(compress_mechanisms, mechanism))
+		return FALSE;
+	return compression_lookup_handler(mechanism, handler_r) > 0;
+}
+
+static const char *dsync_ibc_stream_get_compress_mechanisms(void)
+{
+	const struct compression_handler *handler;
+	string_t *str = t_str_new(32);
+	unsigned int i;
+
+	for (i = 0; compress_mechanisms[i] != NULL; i++) {
+		if (dsync_ibc_stream_compress_lookup(compress_mechanisms[i],
+						     &handler)) {
+			if (str_len(str) > 0)
+				str_append_c(str, ' ');
+			str_append(str, handler->name);
+		}
+	}
+	return str_c(str);
+}
+
 static void dsync_ibc_stream_timeout(struct dsync_ibc_stream *ibc)
 {
 	i_error("dsync(%s): I/O has stalled, no activity for %u seconds (%s)",
@@ -654,6 +721,7 @@ dsync_ibc_stream_send_handshake(struct dsync_ibc *_ibc,
 {
 	struct dsync_ibc_stream *ibc = (struct dsync_ibc_stream *)_ibc;
 	struct dsync_serializer_encoder *encoder;
+	const struct compression_handler *handler;
 	string_t *str = t_str_new(128);
 	char sync_type[2];
 
@@ -760,6 +828,20 @@ dsync_ibc_stream_send_handshake(struct dsync_ibc *_ibc,
 		}
 	}
 	dsync_serializer_encode_add(encoder, "hashed_headers", str_c(str2));
+	if (set->attachment_hash != NULL) {
+		dsync_serializer_encode_add(encoder, "attachment_hash",
+					    set->attachment_hash);
+		dsync_serializer_encode_add(encoder, "attachment_min_size",
+			t_strdup_printf("%"PRIuUOFF_T, set->attachment_min_size));
+	}
+	if (set->compression != NULL &&
+	    dsync_ibc_stream_compress_lookup(set->compression, &handler)) {
+		/* master: compress if the slave supports the mechanism */
+		dsync_serializer_encode_add(encoder, "compress", handler->name);
+		ibc->compress_handler = handler;
+	}
+	dsync_serializer_encode_add(encoder, "compress_mechanisms",
+				    dsync_ibc_stream_get_compress_mechanisms());
 	dsync_serializer_encode_finish(&encoder, str);
 	dsync_ibc_stream_send_string(ibc, str);
 }
@@ -771,6 +853,7 @@ dsync_ibc_stream_recv_handshake(struct dsync_ibc *_ibc,
 	struct dsync_ibc_stream *ibc = (struct dsync_ibc_stream *)_ibc;
 	struct dsync_deserializer_decoder *decoder;
 	struct dsync_ibc_settings *set;
+	const struct compression_handler *handler;
 	const char *value;
 	pool_t pool = ibc->ret_pool;
 	enum dsync_ibc_recv_ret ret;
@@ -895,9 +978,37 @@ dsync_ibc_stream_recv_handshake(struct dsync_ibc *_ibc,
 		set->brain_flags |= DSYNC_BRAIN_FLAG_EMPTY_HDR_WORKAROUND;
 	if (dsync_deserializer_decode_try(decoder, "hashed_headers", &value))
 		set->hashed_headers = (const char*const*)p_strsplit_tabescaped(pool, value);
+	if (dsync_deserializer_decode_try(decoder, "attachment_hash", &value))
+		set->attachment_hash = p_strdup(pool, value);
+	if (dsync_deserializer_decode_try(decoder, "attachment_min_size", &value) &&
+	    str_to_uoff(value, &set->attachment_min_size) < 0) {
+		dsync_ibc_input_error(ibc, decoder,
+			"Invalid attachment_min_size: %s", value);
+		return DSYNC_IBC_RECV_RET_TRYAGAIN;
+	}
 	set->hdr_hash_v2 = ibc->minor_version >= DSYNC_PROTOCOL_MINOR_HAVE_HDR_HASH_V2;
 	set->hdr_hash_v3 = ibc->minor_version >= DSYNC_PROTOCOL_MINOR_HAVE_HDR_HASH_V3;
 
+	if (ibc->compress_handler != NULL) {
+		if (!dsync_deserializer_decode_try(decoder,
+						   "compress_mechanisms",
+						   &value) ||
+		    !str_array_find(t_strsplit_spaces(value, " "),
+				    ibc->compress_handler->name))
+			ibc->compress_handler = NULL;
+	} else if (dsync_deserializer_decode_try(decoder, "compress", &value) &&
+		   dsync_ibc_stream_compress_lookup(value, &handler)) {
+		/* master requested a mechanism that we support */
+		ibc->compress_handler = handler;
+	}
+	if (ibc->compress_handler != NULL) {
+		/* Neither side sends anything after its handshake until it
+		   has received the remote's handshake, so everything after
+		   the handshakes is compressed. */
+		dsync_ibc_stream_compress_input(ibc);
+		dsync_ibc_stream_compress_output(ibc);
+	}
+
 	*set_r = set;
 	return DSYNC_IBC_RECV_RET_OK;
 }
@@ -1631,6 +1742,42 @@ dsync_ibc_stream_recv_mailbox_attribute(struct dsync_ibc *_ibc,
 	return DSYNC_IBC_RECV_RET_OK;
 }
 
+static void
+dsync_ibc_stream_encode_strarray(struct dsync_serializer_encoder *encoder,
+				 const char *key,
+				 const ARRAY_TYPE(const_string) *arr)
+{
+	const char *const *strings;
+	unsigned int i, count;
+	string_t *str;
+
+	if (!array_is_created(arr) || array_count(arr) == 0)
+		return;
+
+	str = t_str_new(128);
+	strings = array_get(arr, &count);
+	str_append_tabescaped(str, strings[0]);
+	for (i = 1; i < count; i++) {
+		str_append_c(str, '\t');
+		str_append_tabescaped(str, strings[i]);
+	}
+	dsync_serializer_encode_add(encoder, key, str_c(str));
+}
+
+static void
+dsync_ibc_stream_decode_strarray(pool_t pool, const char *value,
+				 ARRAY_TYPE(const_string) *arr)
+{
+	const char *const *strings = t_strsplit_tabescaped(value);
+	unsigned int i, count = str_array_length(strings);
+
+	p_array_init(arr, pool, count);
+	for (i = 0; i < count; i++) {
+		value = p_strdup(pool, strings[i]);
+		array_push_back(arr, &value);
+	}
+}
+
 static void
 dsync_ibc_stream_send_change(struct dsync_ibc *_ibc,
 			     const struct dsync_mail_change *change)
@@ -1712,6 +1859,8 @@ dsync_ibc_stream_send_change(struct dsync_ibc *_ibc,
 		dsync_serializer_encode_add(encoder, "virtual_size",
 			t_strdup_printf("%llx", (unsigned long long)change->virtual_size));
 	}
+	dsync_ibc_stream_encode_strarray(encoder, "attachment_hashes",
+					 &change->attachment_hashes);
 
 	dsync_serializer_encode_finish(&encoder, str);
 	dsync_ibc_stream_send_string(ibc, str);
@@ -1829,6 +1978,10 @@ dsync_ibc_stream_recv_change(struct dsync_ibc *_ibc,
 		}
 		change->virtual_size = ullongval;
 	}
+	if (dsync_deserializer_decode_try(decoder, "attachment_hashes", &value)) {
+		dsync_ibc_stream_decode_strarray(pool, value,
+						 &change->attachment_hashes);
+	}
 
 	*change_r = change;
 	return DSYNC_IBC_RECV_RET_OK;
@@ -1850,6 +2003,8 @@ dsync_ibc_stream_send_mail_request(struct dsync_ibc *_ibc,
 		dsync_serializer_encode_add(encoder, "uid",
 					    dec2str(request->uid));
 	}
+	dsync_ibc_stream_encode_strarray(encoder, "attachment_hashes",
+					 &request->attachment_hashes);
 	dsync_serializer_encode_finish(&encoder, str);
 	dsync_ibc_stream_send_string(ibc, str);
 }
@@ -1878,6 +2033,10 @@ dsync_ibc_stream_recv_mail_request(struct dsync_ibc *_ibc,
 		dsync_ibc_input_error(ibc, decoder, "Invalid uid");
 		return DSYNC_IBC_RECV_RET_TRYAGAIN;
 	}
+	if (dsync_deserializer_decode_try(decoder, "attachment_hashes", &value)) {
+		dsync_ibc_stream_decode_strarray(ibc->ret_pool, value,
+						 &request->attachment_hashes);
+	}
 
 	*request_r = request;
 	return DSYNC_IBC_RECV_RET_OK;
@@ -1916,6 +2075,12 @@ dsync_ibc_stream_send_mail(struct dsync_ibc *_ibc,
 		dsync_serializer_encode_add(encoder, "saved_date",
 					    dec2str(mail->saved_date));
 	}
+	if (mail->attachment_refs != NULL) {
+		dsync_serializer_encode_add(encoder, "attachment_refs",
+					    mail->attachment_refs);
+		dsync_serializer_encode_add(encoder, "attachment_full_size",
+			dec2str(mail->attachment_full_size));
+	}
 	if (mail->input != NULL)
 		dsync_serializer_encode_add(encoder, "stream", "");
 
@@ -1982,6 +2147,16 @@ dsync_ibc_stream_recv_mail(struct dsync_ibc *_ibc, struct dsync_mail **mail_r)
 		dsync_ibc_input_error(ibc, decoder, "Invalid saved_date");
 		return DSYNC_IBC_RECV_RET_TRYAGAIN;
 	}
+	if (dsync_deserializer_decode_try(decoder, "attachment_refs", &value)) {
+		mail->attachment_refs = p_strdup(pool, value);
+		if (!dsync_deserializer_decode_try(decoder,
+				"attachment_full_size", &value) ||
+		    str_to_uoff(value, &mail->attachment_full_size) < 0) {
+			dsync_ibc_input_error(ibc, decoder,
+				"Invalid attachment_full_size");
+			return DSYNC_IBC_RECV_RET_TRYAGAIN;
+		}
+	}
 	if (dsync_deserializer_decode_try(decoder, "stream", &value)) {
 		mail->input = dsync_ibc_stream_input_stream(ibc);
 		if (dsync_ibc_stream_read_mail_stream(ibc) <= 0) {
@@ -2119,6 +2294,13 @@ static const struct dsync_ibc_vfuncs dsync_ibc_stream_vfuncs = {
 	dsync_ibc_stream_has_pending_data
 };
 
+bool dsync_ibc_stream_compression_supported(const char *mechanism)
+{
+	const struct compression_handler *handler;
+
+	return dsync_ibc_stream_compress_lookup(mechanism, &handler);
+}
+
 struct dsync_ibc *
 dsync_ibc_init_stream(struct istream *input, struct ostream *output,
 		      const char *name, const char *temp_path_prefix,
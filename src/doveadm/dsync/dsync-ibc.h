@@ -66,6 +66,15 @@ struct dsync_ibc_settings {
 	const char *sync_flags;
 	/* Hashed headers */
 	const char *const *hashed_headers;
+	/* If non-NULL, attachments are stored deduplicated using this
+	   mail_attachment_hash. The remote can then leave out attachments
+	   that we already have. */
+	const char *attachment_hash;
+	/* mail_attachment_min_size for attachment_hash */
+	uoff_t attachment_min_size;
+	/* If non-NULL, ask the remote to compress the stream with this
+	   mechanism. It's used only if the remote also supports it. */
+	const char *compression;
 
 	char alt_char;
 	enum dsync_brain_sync_type sync_type;
@@ -82,6 +91,8 @@ struct dsync_ibc *
 dsync_ibc_init_stream(struct istream *input, struct ostream *output,
 		      const char *name, const char *temp_path_prefix,
 		      unsigned int timeout_secs);
+/* Returns TRUE if the stream can be compressed with the given mechanism. */
+bool dsync_ibc_stream_compression_supported(const char *mechanism);
 void dsync_ibc_deinit(struct dsync_ibc **ibc);
 
 /* I/O callback is called whenever new data is available. It's also called on
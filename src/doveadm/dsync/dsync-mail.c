@@ -153,4 +153,6 @@ void dsync_mail_change_dup(pool_t pool, const struct dsync_mail_change *src,
 			       &dest_r->keyword_changes);
 	dest_r->received_timestamp = src->received_timestamp;
 	dest_r->virtual_size = src->virtual_size;
+	const_string_array_dup(pool, &src->attachment_hashes,
+			       &dest_r->attachment_hashes);
 }
@@ -29,12 +29,20 @@ struct dsync_mail {
 	/* Input stream containing the message text, or NULL if all instances
 	   of the message were already expunged from this mailbox. */
 	struct istream *input;
+	/* If non-NULL, these attachments were left out of the input, because
+	   the remote already has them. This uses the same format as dbox
+	   ext-refs, but with attachment hashes instead of paths. */
+	const char *attachment_refs;
+	/* Size of the message with the attachments added back */
+	uoff_t attachment_full_size;
 };
 
 struct dsync_mail_request {
 	/* either GUID=NULL or uid=0 */
 	const char *guid;
 	uint32_t uid;
+	/* Hashes of the mail's attachments that we already have */
+	ARRAY_TYPE(const_string) attachment_hashes;
 };
 
 enum dsync_mail_change_type {
@@ -86,6 +94,9 @@ struct dsync_mail_change {
 	/* Mail's size for saves if brain.sync_max_size is set,
 	   UOFF_T_MAX otherwise. */
 	uoff_t virtual_size;
+	/* Hashes of the mail's attachments for saves, if the remote stores
+	   attachments deduplicated */
+	ARRAY_TYPE(const_string) attachment_hashes;
 };
 
 struct mailbox_header_lookup_ctx *
@@ -4,10 +4,12 @@
 #include "array.h"
 #include "hash.h"
 #include "istream.h"
+#include "str.h"
 #include "mail-index-modseq.h"
 #include "mail-storage-private.h"
 #include "mail-search-build.h"
 #include "dsync-transaction-log-scan.h"
+#include "dsync-attachment.h"
 #include "dsync-mail.h"
 #include "dsync-mailbox.h"
 #include "dsync-mailbox-export.h"
@@ -18,6 +20,15 @@ struct dsync_mail_guid_instances {
 	bool searched;
 };
 
+struct dsync_mail_attachments {
+	/* physical size of the mail that was used to find the attachments */
+	uoff_t full_size;
+	ARRAY_TYPE(mail_attachment_extref) extrefs;
+	ARRAY_TYPE(const_string) hashes;
+	/* attachments that the remote already has */
+	ARRAY_TYPE(mail_attachment_extref) skip_extrefs;
+};
+
 struct dsync_mailbox_exporter {
 	pool_t pool;
 	struct event *event;
@@ -33,6 +44,16 @@ struct dsync_mailbox_exporter {
 
 	const char *const *hashed_headers;
 
+	/* Remote's mail_attachment_hash and mail_attachment_min_size, or NULL
+	   if the remote doesn't store attachments deduplicated */
+	const char *attachment_hash;
+	uoff_t attachment_min_size;
+	const char *temp_path_prefix;
+	/* GUID => attachments */
+	HASH_TABLE(char *, struct dsync_mail_attachments *) export_attachments;
+	struct istream *attachment_input;
+	string_t *attachment_refs;
+
 	/* GUID => instances */
 	HASH_TABLE(char *, struct dsync_mail_guid_instances *) export_guids;
 	ARRAY_TYPE(seq_range) requested_uids;
@@ -282,9 +303,61 @@ export_add_mail_instance(struct dsync_mailbox_exporter *exporter,
 	seq_range_array_add(&instances->seqs, seq);
 }
 
+static int
+export_find_attachments(struct dsync_mailbox_exporter *exporter,
+			struct mail *mail, const char *guid,
+			struct dsync_mail_attachments **attachments_r)
+{
+	struct dsync_mail_attachments *attachments;
+	const struct mail_attachment_extref *extref;
+	struct istream *input;
+	uoff_t size;
+	const char *error;
+
+	attachments = hash_table_lookup(exporter->export_attachments, guid);
+	if (attachments != NULL) {
+		/* another instance of the same mail */
+		*attachments_r = attachments;
+		return 1;
+	}
+
+	if (mail_get_physical_size(mail, &size) < 0)
+		return dsync_mail_error(exporter, mail, "physical-size");
+	if (size < exporter->attachment_min_size) {
+		/* can't have large enough attachments */
+		*attachments_r = NULL;
+		return 1;
+	}
+	if (mail_get_stream(mail, NULL, NULL, &input) < 0)
+		return dsync_mail_error(exporter, mail, "body");
+
+	attachments = p_new(exporter->pool, struct dsync_mail_attachments, 1);
+	attachments->full_size = size;
+	p_array_init(&attachments->extrefs, exporter->pool, 2);
+	if (dsync_attachment_find(input, exporter->attachment_hash,
+				  exporter->attachment_min_size,
+				  exporter->temp_path_prefix, exporter->pool,
+				  &attachments->extrefs, &error) < 0) {
+		exporter->mail_error = MAIL_ERROR_TEMP;
+		exporter->error = p_strdup_printf(exporter->pool,
+			"Can't find attachments for UID=%u: %s",
+			mail->uid, error);
+		return -1;
+	}
+	p_array_init(&attachments->hashes, exporter->pool,
+		     array_count(&attachments->extrefs));
+	array_foreach(&attachments->extrefs, extref)
+		array_push_back(&attachments->hashes, &extref->path);
+	hash_table_insert(exporter->export_attachments,
+			  p_strdup(exporter->pool, guid), attachments);
+	*attachments_r = attachments;
+	return 1;
+}
+
 static int
 search_add_save(struct dsync_mailbox_exporter *exporter, struct mail *mail)
 {
+	struct dsync_mail_attachments *attachments = NULL;
 	struct dsync_mail_change *change;
 	const char *guid, *hdr_hash;
 	enum mail_fetch_field wanted_fields = MAIL_FETCH_GUID;
@@ -319,6 +392,12 @@ search_add_save(struct dsync_mailbox_exporter *exporter, struct mail *mail)
 			return dsync_mail_error(exporter, mail, "virtual-size");
 		i_assert(virtual_size != UOFF_T_MAX);
 	}
+	if (exporter->attachment_hash != NULL && *guid != '\0') {
+		ret = export_find_attachments(exporter, mail, guid,
+					      &attachments);
+		if (ret <= 0)
+			return ret;
+	}
 
 	change = export_save_change_get(exporter, mail->uid);
 	change->guid = *guid == '\0' ? "" :
@@ -326,6 +405,8 @@ search_add_save(struct dsync_mailbox_exporter *exporter, struct mail *mail)
 	change->hdr_hash = p_strdup(exporter->pool, hdr_hash);
 	change->received_timestamp = received_timestamp;
 	change->virtual_size = virtual_size;
+	if (attachments != NULL)
+		change->attachment_hashes = attachments->hashes;
 	search_update_flag_changes(exporter, mail, change);
 
 	export_add_mail_instance(exporter, change, mail->seq);
@@ -506,6 +587,8 @@ dsync_mailbox_export_init(struct mailbox *box,
 			  enum dsync_mailbox_exporter_flags flags,
 			  unsigned int hdr_hash_version,
 			  const char *const *hashed_headers,
+			  const char *attachment_hash,
+			  uoff_t attachment_min_size,
 			  struct event *parent_event)
 {
 	struct dsync_mailbox_exporter *exporter;
@@ -534,6 +617,21 @@ dsync_mailbox_export_init(struct mailbox *box,
 	exporter->hashed_headers = hashed_headers;
 	exporter->event = event_create(parent_event);
 
+	/* attachments can be left out only from mails requested by GUID */
+	if (attachment_hash != NULL && exporter->mails_have_guids &&
+	    !exporter->auto_export_mails && !exporter->minimal_dmail_fill) {
+		string_t *temp_path = t_str_new(128);
+
+		mail_user_set_get_temp_prefix(temp_path,
+					      box->storage->user->set);
+		exporter->attachment_hash = p_strdup(pool, attachment_hash);
+		exporter->attachment_min_size = attachment_min_size;
+		exporter->temp_path_prefix = p_strdup(pool, str_c(temp_path));
+		exporter->attachment_refs = str_new(pool, 128);
+	}
+	hash_table_create(&exporter->export_attachments, pool, 0,
+			  str_hash, strcmp);
+
 	p_array_init(&exporter->requested_uids, pool, 16);
 	p_array_init(&exporter->search_uids, pool, 16);
 	hash_table_create(&exporter->export_guids, pool, 0, str_hash, strcmp);
@@ -606,7 +704,8 @@ dsync_mailbox_export_iter_next_attr(struct dsync_mailbox_exporter *exporter)
 	bool export_all_attrs;
 
 	export_all_attrs = exporter->return_all_mails ||
-		exporter->last_common_uid == 0;
+		exporter->last_common_uid == 0 ||
+		!dsync_transaction_log_scan_has_attr_changes(exporter->log_scan);
 	attr_changes = dsync_transaction_log_scan_get_attr_hash(exporter->log_scan);
 	lookup_attr.type = exporter->attr_type;
 
@@ -815,11 +914,47 @@ dsync_mailbox_export_body_search_deinit(struct dsync_mailbox_exporter *exporter)
 	}
 }
 
+static int
+dsync_mailbox_export_skip_attachments(struct dsync_mailbox_exporter *exporter,
+				      struct mail *mail)
+{
+	struct dsync_mail *dmail = &exporter->dsync_mail;
+	struct dsync_mail_attachments *attachments;
+	uoff_t size;
+
+	if (dmail->input == NULL || *dmail->guid == '\0')
+		return 1;
+	attachments = hash_table_lookup(exporter->export_attachments,
+					dmail->guid);
+	if (attachments == NULL ||
+	    !array_is_created(&attachments->skip_extrefs))
+		return 1;
+
+	if (mail_get_physical_size(mail, &size) < 0)
+		return dsync_mail_error(exporter, mail, "physical-size");
+	if (size != attachments->full_size) {
+		/* a different instance of the mail, which doesn't look the
+		   same. just send the whole mail. */
+		return 1;
+	}
+
+	exporter->attachment_input =
+		dsync_attachment_skip(dmail->input, &attachments->skip_extrefs);
+	str_truncate(exporter->attachment_refs, 0);
+	index_attachment_append_extrefs(exporter->attachment_refs,
+					&attachments->skip_extrefs);
+	dmail->input = exporter->attachment_input;
+	dmail->attachment_refs = str_c(exporter->attachment_refs);
+	dmail->attachment_full_size = size;
+	return 1;
+}
+
 static int dsync_mailbox_export_mail(struct dsync_mailbox_exporter *exporter,
 				     struct mail *mail)
 {
 	struct dsync_mail_guid_instances *instances;
 	const char *error_field;
+	int ret;
 
 	if (dsync_mail_fill(mail, exporter->minimal_dmail_fill,
 			    &exporter->dsync_mail, &error_field) < 0)
@@ -845,12 +980,43 @@ static int dsync_mailbox_export_mail(struct dsync_mailbox_exporter *exporter,
 	else
 		exporter->dsync_mail.guid = "";
 
+	if (exporter->attachment_hash != NULL &&
+	    (ret = dsync_mailbox_export_skip_attachments(exporter, mail)) <= 0)
+		return ret;
+
 	/* this message was successfully returned, don't try retrying it */
 	if (instances != NULL)
 		array_clear(&instances->seqs);
 	return 1;
 }
 
+static void
+dsync_mailbox_export_want_attachments(struct dsync_mailbox_exporter *exporter,
+				      const struct dsync_mail_request *request)
+{
+	struct dsync_mail_attachments *attachments;
+	const struct mail_attachment_extref *extref;
+
+	if (exporter->attachment_hash == NULL ||
+	    !array_is_created(&request->attachment_hashes))
+		return;
+	attachments = hash_table_lookup(exporter->export_attachments,
+					request->guid);
+	if (attachments == NULL)
+		return;
+
+	array_foreach(&attachments->extrefs, extref) {
+		if (!array_lsearch(&request->attachment_hashes, &extref->path,
+				   i_strcmp_p))
+			continue;
+		if (!array_is_created(&attachments->skip_extrefs)) {
+			p_array_init(&attachments->skip_extrefs,
+				     exporter->pool, 2);
+		}
+		array_push_back(&attachments->skip_extrefs, extref);
+	}
+}
+
 void dsync_mailbox_export_want_mail(struct dsync_mailbox_exporter *exporter,
 				    const struct dsync_mail_request *request)
 {
@@ -872,6 +1038,7 @@ void dsync_mailbox_export_want_mail(struct dsync_mailbox_exporter *exporter,
 		return;
 	}
 	instances->requested = TRUE;
+	dsync_mailbox_export_want_attachments(exporter, request);
 }
 
 int dsync_mailbox_export_next_mail(struct dsync_mailbox_exporter *exporter,
@@ -882,6 +1049,9 @@ int dsync_mailbox_export_next_mail(struct dsync_mailbox_exporter *exporter,
 	unsigned int count;
 	int ret;
 
+	/* the previous mail's stream must be unreferenced before the mail
+	   is closed */
+	i_stream_unref(&exporter->attachment_input);
 	if (exporter->error != NULL)
 		return -1;
 	if (!exporter->body_search_initialized) {
@@ -940,12 +1110,14 @@ int dsync_mailbox_export_deinit(struct dsync_mailbox_exporter **_exporter,
 
 	if (exporter->attr_iter != NULL)
 		(void)mailbox_attribute_iter_deinit(&exporter->attr_iter);
+	i_stream_unref(&exporter->attachment_input);
 	dsync_mailbox_export_body_search_deinit(exporter);
 	(void)mailbox_transaction_commit(&exporter->trans);
 	mailbox_header_lookup_unref(&exporter->wanted_headers);
 
 	i_stream_unref(&exporter->attr.value_stream);
 	hash_table_destroy(&exporter->export_guids);
+	hash_table_destroy(&exporter->export_attachments);
 	hash_table_destroy(&exporter->changes);
 
 	i_assert((exporter->error != NULL) == (exporter->mail_error != 0));
@@ -11,6 +11,7 @@
 #include "mail-storage-private.h"
 #include "mail-search-build.h"
 #include "dsync-transaction-log-scan.h"
+#include "dsync-attachment.h"
 #include "dsync-mail.h"
 #include "dsync-mailbox.h"
 #include "dsync-mailbox-import.h"
@@ -108,6 +109,10 @@ struct dsync_mailbox_importer {
 	ARRAY(struct dsync_mail_request) mail_requests;
 	unsigned int mail_request_idx;
 
+	struct dsync_attachment_store *attachment_store;
+	/* attachment hash => path in attachment_store, or "" if not found */
+	HASH_TABLE(char *, char *) attachment_paths;
+
 	uint32_t prev_uid, next_local_seq, local_uid_next;
 	uint64_t local_initial_highestmodseq, local_initial_highestpvtmodseq;
 	unsigned int import_pos, import_count;
@@ -221,6 +226,7 @@ dsync_mailbox_import_init(struct mailbox *box,
 			  enum dsync_mailbox_import_flags flags,
 			  unsigned int hdr_hash_version,
 			  const char *const *hashed_headers,
+			  struct dsync_attachment_store *attachment_store,
 			  struct event *parent_event)
 {
 	struct dsync_mailbox_importer *importer;
@@ -281,6 +287,11 @@ dsync_mailbox_import_init(struct mailbox *box,
 		i_array_init(&importer->mail_requests, 128);
 		importer->want_mail_requests = TRUE;
 	}
+	if (attachment_store != NULL) {
+		importer->attachment_store = attachment_store;
+		hash_table_create(&importer->attachment_paths, pool, 0,
+				  str_hash, strcmp);
+	}
 	importer->master_brain =
 		(flags & DSYNC_MAILBOX_IMPORT_FLAG_MASTER_BRAIN) != 0;
 	importer->revert_local_changes =
@@ -2156,6 +2167,54 @@ dsync_mailbox_import_try_virtual_all(struct dsync_mailbox_importer *importer,
 	return FALSE;
 }
 
+static bool
+dsync_mailbox_import_have_attachment(struct dsync_mailbox_importer *importer,
+				     const char *hash)
+{
+	const char *path, *error;
+	int ret;
+
+	path = hash_table_lookup(importer->attachment_paths, hash);
+	if (path != NULL)
+		return *path != '\0';
+
+	ret = dsync_attachment_store_lookup(importer->attachment_store, hash,
+					    &path, &error);
+	if (ret < 0) {
+		e_error(importer->event, "Attachment lookup failed: %s", error);
+		return FALSE;
+	}
+	hash_table_insert(importer->attachment_paths,
+			  p_strdup(importer->pool, hash),
+			  p_strdup(importer->pool, ret == 0 ? "" : path));
+	return ret > 0;
+}
+
+static void
+dsync_mailbox_import_request_attachments(struct dsync_mailbox_importer *importer,
+					 struct dsync_mail_request *request,
+					 const struct dsync_mail_change *change)
+{
+	const char *hash;
+
+	if (importer->attachment_store == NULL || request->guid == NULL ||
+	    change == NULL || !array_is_created(&change->attachment_hashes))
+		return;
+
+	/* let the remote know which of the mail's attachments we already
+	   have, so it doesn't need to send them */
+	array_foreach_elem(&change->attachment_hashes, hash) {
+		if (!dsync_mailbox_import_have_attachment(importer, hash))
+			continue;
+		if (!array_is_created(&request->attachment_hashes)) {
+			p_array_init(&request->attachment_hashes,
+				     importer->pool, 4);
+		}
+		hash = p_strdup(importer->pool, hash);
+		array_push_back(&request->attachment_hashes, &hash);
+	}
+}
+
 static bool
 dsync_mailbox_import_handle_mail(struct dsync_mailbox_importer *importer,
 				 struct importer_new_mail *all_newmails)
@@ -2163,6 +2222,7 @@ dsync_mailbox_import_handle_mail(struct dsync_mailbox_importer *importer,
 	ARRAY_TYPE(seq_range) local_uids, wanted_uids;
 	struct dsync_mail_request *request;
 	struct importer_new_mail *mail;
+	const struct dsync_mail_change *request_change = NULL;
 	const char *request_guid = NULL;
 	uint32_t request_uid = 0;
 
@@ -2180,6 +2240,7 @@ dsync_mailbox_import_handle_mail(struct dsync_mailbox_importer *importer,
 			if (*mail->guid != '\0')
 				request_guid = mail->guid;
 			request_uid = mail->remote_uid;
+			request_change = mail->change;
 			i_assert(request_uid != 0);
 		}
 		if (!mail->skip)
@@ -2196,6 +2257,8 @@ dsync_mailbox_import_handle_mail(struct dsync_mailbox_importer *importer,
 			request = array_append_space(&importer->mail_requests);
 			request->guid = request_guid;
 			request->uid = request_uid;
+			dsync_mailbox_import_request_attachments(importer,
+				request, request_change);
 		}
 		return FALSE;
 	}
@@ -2598,10 +2661,64 @@ static bool dsync_mailbox_save_newmails(struct dsync_mailbox_importer *importer,
 	return ret;
 }
 
+static int
+dsync_mailbox_import_attachments(struct dsync_mailbox_importer *importer,
+				 const struct dsync_mail *mail,
+				 struct istream **input_r)
+{
+	ARRAY_TYPE(mail_attachment_extref) extrefs;
+	struct mail_attachment_extref *extref;
+	struct istream *input;
+	const char *path, *error;
+	string_t *str;
+
+	t_array_init(&extrefs, 8);
+	if (importer->attachment_store == NULL ||
+	    !index_attachment_parse_extrefs(mail->attachment_refs,
+					    pool_datastack_create(),
+					    &extrefs)) {
+		e_error(importer->event,
+			"Remote sent invalid attachment refs for GUID=%s: %s",
+			mail->guid, mail->attachment_refs);
+		return -1;
+	}
+	/* the refs contain the attachments' hashes. replace them with the
+	   local paths that were found when requesting the mail. */
+	array_foreach_modifiable(&extrefs, extref) {
+		path = hash_table_lookup(importer->attachment_paths,
+					 extref->path);
+		if (path == NULL || *path == '\0') {
+			e_error(importer->event,
+				"Remote left out unrequested attachment %s "
+				"for GUID=%s", extref->path, mail->guid);
+			return -1;
+		}
+		extref->path = path;
+	}
+	str = t_str_new(128);
+	index_attachment_append_extrefs(str, &extrefs);
+
+	input = mail->input;
+	i_stream_ref(input);
+	if (dsync_attachment_store_connect(importer->attachment_store, &input,
+					   mail->attachment_full_size,
+					   str_c(str), &error) < 0) {
+		e_error(importer->event,
+			"Failed to add attachments for GUID=%s: %s",
+			mail->guid, error);
+		i_stream_unref(&input);
+		return -1;
+	}
+	*input_r = input;
+	return 0;
+}
+
 int dsync_mailbox_import_mail(struct dsync_mailbox_importer *importer,
 			      const struct dsync_mail *mail)
 {
 	struct importer_new_mail *all_newmails;
+	struct dsync_mail attach_mail;
+	struct istream *input = NULL;
 
 	i_assert(mail->input == NULL || mail->input->seekable);
 	i_assert(importer->new_uids_assigned);
@@ -2636,8 +2753,20 @@ int dsync_mailbox_import_mail(struct dsync_mailbox_importer *importer,
 				  POINTER_CAST(mail->uid));
 	}
 	importer->import_pos++;
+	if (mail->attachment_refs != NULL && mail->input != NULL) {
+		if (dsync_mailbox_import_attachments(importer, mail,
+						     &input) < 0) {
+			importer->mail_error = MAIL_ERROR_TEMP;
+			importer->failed = TRUE;
+			return -1;
+		}
+		attach_mail = *mail;
+		attach_mail.input = input;
+		mail = &attach_mail;
+	}
 	if (!dsync_mailbox_save_newmails(importer, mail, all_newmails, TRUE))
 		i_unreached();
+	i_stream_unref(&input);
 	return importer->failed ? -1 : 0;
 }
 
@@ -2963,6 +3092,7 @@ int dsync_mailbox_import_deinit(struct dsync_mailbox_importer **_importer,
 
 	hash_table_destroy(&importer->import_guids);
 	hash_table_destroy(&importer->import_uids);
+	hash_table_destroy(&importer->attachment_paths);
 	array_free(&importer->maybe_expunge_uids);
 	array_free(&importer->maybe_saves);
 	array_free(&importer->wanted_uids);
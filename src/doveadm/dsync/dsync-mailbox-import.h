@@ -19,6 +19,7 @@ struct dsync_mailbox_attribute;
 struct dsync_mail;
 struct dsync_mail_change;
 struct dsync_transaction_log_scan;
+struct dsync_attachment_store;
 
 struct dsync_mailbox_importer *
 dsync_mailbox_import_init(struct mailbox *box,
@@ -39,6 +40,7 @@ dsync_mailbox_import_init(struct mailbox *box,
 			  enum dsync_mailbox_import_flags flags,
 			  unsigned int hdr_hash_version,
 			  const char *const *hashed_headers,
+			  struct dsync_attachment_store *attachment_store,
 			  struct event *event);
 int dsync_mailbox_import_attribute(struct dsync_mailbox_importer *importer,
 				   const struct dsync_mailbox_attribute *attr);
@@ -21,6 +21,7 @@ struct dsync_transaction_log_scan {
 	uoff_t last_log_offset;
 
 	bool returned_all_changes;
+	bool lost_attr_changes;
 };
 
 static bool ATTR_NOWARN_UNUSED_RESULT
@@ -484,6 +485,88 @@ dsync_log_scan(struct dsync_transaction_log_scan *ctx,
 	return ret;
 }
 
+static void
+index_add_flag_state(struct dsync_transaction_log_scan *ctx,
+		     struct mail_index_view *view, uint32_t seq,
+		     ARRAY_TYPE(keyword_indexes) *kw_indexes)
+{
+	const ARRAY_TYPE(keywords) *keywords;
+	const struct mail_index_record *rec;
+	struct dsync_mail_change *change;
+	const char *const *names, *change_str;
+	const unsigned int *idx;
+	unsigned int i, j, names_count, idx_count;
+	bool have;
+
+	rec = mail_index_lookup(view, seq);
+	if (!export_change_get(ctx, rec->uid,
+			       DSYNC_MAIL_CHANGE_TYPE_FLAG_CHANGE, &change))
+		return;
+
+	/* the individual changes aren't known, so the message's current
+	   flags and keywords are all treated as changed to their current
+	   state. */
+	change->add_flags = rec->flags & MAIL_FLAGS_NONRECENT;
+	change->remove_flags = ~rec->flags & MAIL_FLAGS_NONRECENT;
+
+	keywords = mail_index_get_keywords(view->index);
+	names = array_get(keywords, &names_count);
+	if (!array_is_created(&change->keyword_changes)) {
+		p_array_init(&change->keyword_changes, ctx->pool,
+			     I_MAX(names_count, 1));
+	} else {
+		array_clear(&change->keyword_changes);
+	}
+	array_clear(kw_indexes);
+	mail_index_lookup_keywords(view, seq, kw_indexes);
+	idx = array_get(kw_indexes, &idx_count);
+	for (i = 0; i < names_count; i++) {
+		have = FALSE;
+		for (j = 0; j < idx_count && !have; j++)
+			have = idx[j] == i;
+		change_str = p_strdup_printf(ctx->pool, "%c%s",
+			have ? KEYWORD_CHANGE_ADD : KEYWORD_CHANGE_REMOVE,
+			names[i]);
+		array_push_back(&change->keyword_changes, &change_str);
+	}
+}
+
+static int
+dsync_index_modseq_scan(struct dsync_transaction_log_scan *ctx,
+			struct mail_index_view *view, uint64_t modseq,
+			uint32_t last_messages_count)
+{
+	ARRAY_TYPE(keyword_indexes) kw_indexes;
+	uint32_t seq, seq1, seq2;
+
+	if (ctx->highest_wanted_uid == (uint32_t)-1 || last_messages_count == 0)
+		return 0;
+
+	/* Expunges can't be found from the index, but if the number of
+	   messages up to the last common UID is still the same as after the
+	   previous sync, nothing was expunged. */
+	if (!mail_index_lookup_seq_range(view, 1, ctx->highest_wanted_uid,
+					 &seq1, &seq2))
+		seq2 = 0;
+	if (seq2 != last_messages_count)
+		return 0;
+
+	/* the index keeps the messages' modseqs even after the transaction
+	   log has been rotated, so use them to find the changed messages. */
+	t_array_init(&kw_indexes, 32);
+	for (seq = 1; seq <= seq2; seq++) {
+		if (mail_index_modseq_lookup(view, seq) > modseq)
+			index_add_flag_state(ctx, view, seq, &kw_indexes);
+	}
+	e_debug(ctx->event, "%s: Modseq %"PRIu64" is no longer in transaction "
+		"log - found %u changed messages from index",
+		view->index->filepath, modseq, hash_table_count(ctx->changes));
+	/* attribute changes can't be found without the log */
+	ctx->returned_all_changes = FALSE;
+	ctx->lost_attr_changes = TRUE;
+	return 1;
+}
+
 static int
 dsync_mailbox_attribute_cmp(const struct dsync_mailbox_attribute *attr1,
 			    const struct dsync_mailbox_attribute *attr2)
@@ -504,6 +587,7 @@ dsync_mailbox_attribute_hash(const struct dsync_mailbox_attribute *attr)
 int dsync_transaction_log_scan_init(struct dsync_brain *brain,
 				    uint32_t highest_wanted_uid,
 				    uint64_t modseq, uint64_t pvt_modseq,
+				    uint32_t last_messages_count,
 				    bool *pvt_too_old_r)
 {
 	struct mail_index_view *view = brain->box->view;
@@ -530,6 +614,11 @@ int dsync_transaction_log_scan_init(struct dsync_brain *brain,
 
 	if ((ret = dsync_log_scan(ctx, view, modseq, FALSE)) < 0)
 		return -1;
+	if (ret == 0 && pvt_view == NULL) T_BEGIN {
+		/* the transaction log no longer has all the changes */
+		ret = dsync_index_modseq_scan(ctx, view, modseq,
+					      last_messages_count);
+	} T_END;
 	if (pvt_view != NULL) {
 		if ((ret2 = dsync_log_scan(ctx, pvt_view, pvt_modseq, TRUE)) < 0)
 			return -1;
@@ -561,6 +650,12 @@ dsync_transaction_log_scan_has_all_changes(struct dsync_transaction_log_scan *sc
 	return scan->returned_all_changes;
 }
 
+bool
+dsync_transaction_log_scan_has_attr_changes(struct dsync_transaction_log_scan *scan)
+{
+	return !scan->lost_attr_changes;
+}
+
 struct dsync_mail_change *
 dsync_transaction_log_scan_find_new_expunge(struct dsync_transaction_log_scan *scan,
 					    uint32_t uid)
@@ -14,6 +14,7 @@ struct dsync_brain;
 int dsync_transaction_log_scan_init(struct dsync_brain *brain,
 				    uint32_t highest_wanted_uid,
 				    uint64_t modseq, uint64_t pvt_modseq,
+				    uint32_t last_messages_count,
 				    bool *pvt_too_old_r);
 HASH_TABLE_TYPE(dsync_uid_mail_change)
 dsync_transaction_log_scan_get_hash(struct dsync_transaction_log_scan *scan);
@@ -21,6 +22,10 @@ HASH_TABLE_TYPE(dsync_attr_change)
 dsync_transaction_log_scan_get_attr_hash(struct dsync_transaction_log_scan *scan);
 /* Returns TRUE if the entire transaction log was scanned */
 bool dsync_transaction_log_scan_has_all_changes(struct dsync_transaction_log_scan *scan);
+/* Returns FALSE if the changed messages had to be looked up from the index's
+   modseqs, because the transaction log no longer had the wanted modseq. The
+   attribute changes are unknown then. */
+bool dsync_transaction_log_scan_has_attr_changes(struct dsync_transaction_log_scan *scan);
 /* If the given UID has been expunged after the initial log scan, create/update
    a change record for it and return it. */
 struct dsync_mail_change *
@@ -10,6 +10,7 @@
 #include "istream.h"
 #include "ostream.h"
 #include "llist.h"
+#include "hash.h"
 #include "priorityq.h"
 #include "base64.h"
 #include "str.h"
@@ -51,9 +52,23 @@ enum imap_client_input_state {
 	IMAP_CLIENT_INPUT_STATE_DONEIDLE
 };
 
-struct imap_client_notify {
+/* Notify fd shared by all the clients watching the same paths. This way a
+   change in a shared mailbox wakes up all of its clients with a single
+   event, and only one notify fd is kept open for them. */
+struct imap_notify_watch {
+	/* NULL if the fd can't be shared with other clients */
+	char *key;
 	int fd;
 	struct io *io;
+	struct imap_client_notify *notifys;
+};
+
+struct imap_client_notify {
+	struct imap_client_notify *prev, *next;
+	struct imap_client *client;
+	struct imap_notify_watch *watch;
+	/* fd received from the imap process until the watch is attached */
+	int fd;
 };
 
 struct imap_client {
@@ -63,7 +78,7 @@ struct imap_client {
 	pool_t pool;
 	struct event *event;
 	struct imap_client_state state;
-	ARRAY(struct imap_client_notify) notifys;
+	ARRAY(struct imap_client_notify *) notifys;
 
 	time_t move_back_start;
 	struct timeout *to_move_back;
@@ -84,6 +99,8 @@ struct imap_client {
 };
 
 static struct imap_client *imap_clients;
+static HASH_TABLE(char *, struct imap_notify_watch *) notify_watches;
+static unsigned int notify_watches_count;
 static struct priorityq *unhibernate_queue;
 static struct timeout *to_unhibernate;
 static const char imap_still_here_text[] = "* OK Still here\r\n";
@@ -449,11 +466,6 @@ static void imap_client_input_nonidle(struct imap_client *client)
 	}
 }
 
-static void imap_client_input_notify(struct imap_client *client)
-{
-	imap_client_move_back(client);
-}
-
 static void keepalive_timeout(struct imap_client *client)
 {
 	ssize_t ret;
@@ -569,6 +581,106 @@ static void imap_client_io_deactivate_user(struct imap_client *client ATTR_UNUSE
 	i_set_failure_prefix("imap-hibernate: ");
 }
 
+static void imap_notify_watch_free(struct imap_notify_watch **_watch)
+{
+	struct imap_notify_watch *watch = *_watch;
+
+	*_watch = NULL;
+	i_assert(watch->notifys == NULL);
+
+	if (watch->key != NULL)
+		hash_table_remove(notify_watches, watch->key);
+	io_remove(&watch->io);
+	i_close_fd(&watch->fd);
+	i_free(watch->key);
+	i_free(watch);
+	notify_watches_count--;
+}
+
+static void imap_notify_watch_input(struct imap_notify_watch *watch)
+{
+	ARRAY(struct imap_client *) clients;
+	struct imap_client_notify *notify;
+	struct imap_client *client;
+
+	/* The clients stop listening for further notifications when they're
+	   moved back to imap processes, so detach all of them first and
+	   free the watch. */
+	t_array_init(&clients, 16);
+	for (notify = watch->notifys; notify != NULL; notify = notify->next) {
+		notify->watch = NULL;
+		array_push_back(&clients, &notify->client);
+	}
+	watch->notifys = NULL;
+	imap_notify_watch_free(&watch);
+
+	array_foreach_elem(&clients, client) {
+		imap_client_io_activate_user(client);
+		imap_client_move_back(client);
+	}
+	imap_client_io_deactivate_user(NULL);
+}
+
+static void imap_client_notify_attach(struct imap_client_notify *notify)
+{
+	const char *key = notify->client->state.notify_key;
+	struct imap_notify_watch *watch = NULL;
+
+	if (key != NULL)
+		watch = hash_table_lookup(notify_watches, key);
+	if (watch != NULL) {
+		/* another client is already watching the same paths */
+		i_close_fd(&notify->fd);
+	} else {
+		watch = i_new(struct imap_notify_watch, 1);
+		notify_watches_count++;
+		watch->fd = notify->fd;
+		notify->fd = -1;
+		watch->io = io_add(watch->fd, IO_READ,
+				   imap_notify_watch_input, watch);
+		if (key != NULL) {
+			watch->key = i_strdup(key);
+			hash_table_insert(notify_watches, watch->key, watch);
+		}
+	}
+	notify->watch = watch;
+	DLLIST_PREPEND(&watch->notifys, notify);
+}
+
+static void imap_client_notify_detach(struct imap_client_notify *notify)
+{
+	struct imap_notify_watch *watch = notify->watch;
+
+	i_close_fd(&notify->fd);
+	if (watch == NULL)
+		return;
+
+	notify->watch = NULL;
+	DLLIST_REMOVE(&watch->notifys, notify);
+	if (watch->notifys == NULL)
+		imap_notify_watch_free(&watch);
+}
+
+static size_t imap_client_pool_size(const struct imap_client_state *state)
+{
+#define IMAP_CLIENT_STR_SIZE(str) \
+	((str) == NULL ? 0 : MEM_ALIGN(strlen(str) + 1))
+	/* Try to fit all of the client's allocations into the pool's first
+	   memory block. The log prefix isn't expanded yet, but it's usually
+	   about the same size as the template. */
+	return sizeof(struct imap_client) +
+		/* notifys array and a single notify */
+		128 + sizeof(struct imap_client_notify) +
+		IMAP_CLIENT_STR_SIZE(state->username) +
+		IMAP_CLIENT_STR_SIZE(state->mail_log_prefix) * 2 +
+		IMAP_CLIENT_STR_SIZE(state->session_id) +
+		IMAP_CLIENT_STR_SIZE(state->userdb_fields) +
+		IMAP_CLIENT_STR_SIZE(state->stats) +
+		IMAP_CLIENT_STR_SIZE(state->notify_key) +
+		MEM_ALIGN(state->state_size);
+#undef IMAP_CLIENT_STR_SIZE
+}
+
 struct imap_client *
 imap_client_create(int fd, const struct imap_client_state *state)
 {
@@ -577,7 +689,8 @@ imap_client_create(int fd, const struct imap_client_state *state)
 		{ NULL, NULL }
 	};
 	struct imap_client *client;
-	pool_t pool = pool_alloconly_create("imap client", 256);
+	pool_t pool = pool_alloconly_create("imap client",
+					    imap_client_pool_size(state));
 	void *statebuf;
 	const char *error;
 
@@ -597,6 +710,7 @@ imap_client_create(int fd, const struct imap_client_state *state)
 	client->state.session_id = p_strdup(pool, state->session_id);
 	client->state.userdb_fields = p_strdup(pool, state->userdb_fields);
 	client->state.stats = p_strdup(pool, state->stats);
+	client->state.notify_key = p_strdup(pool, state->notify_key);
 
 	client->event = event_create(NULL);
 	event_add_category(client->event, &event_category_imap_hibernate);
@@ -651,10 +765,8 @@ static void imap_client_stop_notify_listening(struct imap_client *client)
 {
 	struct imap_client_notify *notify;
 
-	array_foreach_modifiable(&client->notifys, notify) {
-		io_remove(&notify->io);
-		i_close_fd(&notify->fd);
-	}
+	array_foreach_elem(&client->notifys, notify)
+		imap_client_notify_detach(notify);
 }
 
 static void imap_client_stop(struct imap_client *client)
@@ -724,14 +836,21 @@ void imap_client_add_notify_fd(struct imap_client *client, int fd)
 {
 	struct imap_client_notify *notify;
 
-	notify = array_append_space(&client->notifys);
+	notify = p_new(client->pool, struct imap_client_notify, 1);
+	notify->client = client;
 	notify->fd = fd;
+	array_push_back(&client->notifys, &notify);
 }
 
 void imap_client_create_finish(struct imap_client *client)
 {
 	struct imap_client_notify *notify;
 
+	/* the watches may be shared with other clients, so add them outside
+	   the client's ioloop context */
+	array_foreach_elem(&client->notifys, notify)
+		imap_client_notify_attach(notify);
+
 	client->ioloop_ctx = io_loop_context_new(current_ioloop);
 	io_loop_context_add_callbacks(client->ioloop_ctx,
 				      imap_client_io_activate_user,
@@ -746,11 +865,6 @@ void imap_client_create_finish(struct imap_client *client)
 				    imap_client_input_nonidle, client);
 	}
 	imap_client_add_idle_keepalive_timeout(client);
-
-	array_foreach_modifiable(&client->notifys, notify) {
-		notify->io = io_add(notify->fd, IO_READ,
-				    imap_client_input_notify, client);
-	}
 }
 
 static int client_unhibernate_cmp(const void *p1, const void *p2)
@@ -809,9 +923,25 @@ unsigned int imap_clients_kick(const char *user, const guid_128_t conn_guid)
 	return count;
 }
 
+void imap_clients_append_memory_usage(string_t *dest)
+{
+	struct imap_client *client;
+	unsigned int count = 0;
+	size_t alloc_size = 0, used_size = 0;
+
+	for (client = imap_clients; client != NULL; client = client->next) {
+		count++;
+		alloc_size += pool_alloconly_get_total_alloc_size(client->pool);
+		used_size += pool_alloconly_get_total_used_size(client->pool);
+	}
+	str_printfa(dest, "%u\t%u\t%zu\t%zu", count, notify_watches_count,
+		    alloc_size, used_size);
+}
+
 void imap_clients_init(void)
 {
 	unhibernate_queue = priorityq_init(client_unhibernate_cmp, 64);
+	hash_table_create(&notify_watches, default_pool, 0, str_hash, strcmp);
 }
 
 void imap_clients_deinit(void)
@@ -821,4 +951,5 @@ void imap_clients_deinit(void)
 
 	timeout_remove(&to_unhibernate);
 	priorityq_deinit(&unhibernate_queue);
+	hash_table_destroy(&notify_watches);
 }
@@ -8,6 +8,8 @@ struct imap_client_state {
 	const char *username, *mail_log_prefix;
 	/* optional: */
 	const char *session_id, *mailbox_vname, *userdb_fields, *stats;
+	/* Clients with the same notify_key can share the same notify fd */
+	const char *notify_key;
 	struct ip_addr local_ip, remote_ip;
 	in_port_t local_port, remote_port;
 	time_t session_created;
@@ -36,6 +38,9 @@ void imap_client_create_finish(struct imap_client *client);
 void imap_client_destroy(struct imap_client **_client, const char *reason);
 
 unsigned int imap_clients_kick(const char *user, const guid_128_t conn_guid);
+/* Append "<clients> <notify fds> <pool alloc bytes> <pool used bytes>"
+   tab-separated to dest. */
+void imap_clients_append_memory_usage(string_t *dest);
 
 void imap_clients_init(void);
 void imap_clients_deinit(void);
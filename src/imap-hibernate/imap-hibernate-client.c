@@ -141,6 +141,8 @@ imap_hibernate_client_parse_input(const char *const *args, pool_t pool,
 			state_r->userdb_fields = value;
 		} else if (strcmp(key, "notify_fd") == 0) {
 			state_r->have_notify_fd = TRUE;
+		} else if (strcmp(key, "notify_key") == 0) {
+			state_r->notify_key = value;
 		} else if (strcmp(key, "idle_notify_interval") == 0) {
 			if (str_to_uint(value, &state_r->imap_idle_notify_interval) < 0) {
 				*error_r = t_strdup_printf(
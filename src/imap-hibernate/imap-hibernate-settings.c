@@ -43,6 +43,7 @@ struct service_settings imap_hibernate_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -52,6 +53,7 @@ struct service_settings imap_hibernate_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &imap_hibernate_unix_listeners_buf,
 			      sizeof(imap_hibernate_unix_listeners[0]) } },
@@ -1,6 +1,7 @@
 /* Copyright (c) 2014-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "str.h"
 #include "restrict-access.h"
 #include "master-service.h"
 #include "master-admin-client.h"
@@ -11,7 +12,24 @@
 
 static bool debug = FALSE;
 
+static bool
+imap_hibernate_admin_cmd(struct master_admin_client *client, const char *cmd,
+			 const char *const *args ATTR_UNUSED)
+{
+	string_t *str;
+
+	if (strcmp(cmd, "MEMORY-USAGE") != 0)
+		return FALSE;
+
+	str = t_str_new(64);
+	str_append_c(str, '+');
+	imap_clients_append_memory_usage(str);
+	master_admin_client_send_reply(client, str_c(str));
+	return TRUE;
+}
+
 static const struct master_admin_client_callback admin_callbacks = {
+	.cmd = imap_hibernate_admin_cmd,
 	.cmd_kick_user = imap_clients_kick,
 };
 
@@ -38,6 +38,7 @@ struct service_settings imap_urlauth_login_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "token-login",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -47,6 +48,7 @@ struct service_settings imap_urlauth_login_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &imap_urlauth_login_unix_listeners_buf,
 			      sizeof(imap_urlauth_login_unix_listeners[0]) } },
@@ -36,6 +36,7 @@ struct service_settings imap_urlauth_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -45,6 +46,7 @@ struct service_settings imap_urlauth_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &imap_urlauth_unix_listeners_buf,
 			      sizeof(imap_urlauth_unix_listeners[0]) } },
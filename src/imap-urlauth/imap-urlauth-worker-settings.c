@@ -39,6 +39,7 @@ struct service_settings imap_urlauth_worker_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "$default_internal_group",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -48,6 +49,7 @@ struct service_settings imap_urlauth_worker_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &imap_urlauth_worker_unix_listeners_buf,
 			      sizeof(imap_urlauth_worker_unix_listeners[0]) } },
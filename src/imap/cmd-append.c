@@ -834,6 +834,11 @@ static bool cmd_append_continue_message(struct client_command_context *cmd)
 	}
 
 	if (ctx->save_ctx != NULL) {
+		/* The literal is read directly from the client's input
+		   buffer - the limit istream doesn't copy it. The storage
+		   needs to see the data anyway for parsing the message into
+		   cache and for possible linefeed and attachment conversions,
+		   so splicing it directly into the mail file isn't possible. */
 		while (ctx->litinput->v_offset != ctx->literal_size) {
 			ret = i_stream_read(ctx->litinput);
 			if (mailbox_save_continue(ctx->save_ctx) < 0) {
@@ -65,7 +65,13 @@ bool cmd_compress(struct client_command_context *cmd)
 			t_str_ucase(client->compress_handler->name)));
 		return TRUE;
 	}
-	int ret = compression_lookup_handler(t_str_lcase(mechanism), &handler);
+	int ret;
+	if (!str_array_icase_find(client->set->parsed_compress_mechanisms,
+				  mechanism))
+		ret = 0;
+	else
+		ret = compression_lookup_handler(t_str_lcase(mechanism),
+						 &handler);
 	if (ret <= 0) {
 		const char * tagline =
 			t_strdup_printf("NO %s compression mechanism",
@@ -105,6 +111,19 @@ bool cmd_compress(struct client_command_context *cmd)
 	}
 
 	level = handler->get_default_level();
+	if (client->set->imap_compress_level != 0) {
+		if ((int)client->set->imap_compress_level <
+		    handler->get_min_level() ||
+		    (int)client->set->imap_compress_level >
+		    handler->get_max_level()) {
+			e_error(client->event, "imap_compress_level: "
+				"Level must be between %d..%d for %s",
+				handler->get_min_level(),
+				handler->get_max_level(), handler->name);
+		} else {
+			level = client->set->imap_compress_level;
+		}
+	}
 	old_input = client->input;
 	old_output = client->output;
 	client->input = handler->create_istream(old_input);
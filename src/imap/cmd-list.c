@@ -199,6 +199,10 @@ list_send_status(struct cmd_list_context *ctx, const char *name,
 	/* if we're listing subscriptions and there are subscriptions=no
 	   namespaces, ctx->ns may not point to correct one */
 	ns = mail_namespace_find(ctx->user->namespaces, name);
+	/* The mailbox isn't opened here: with mailbox list indexes the
+	   STATUS items are looked up from the list index as long as it's
+	   up-to-date for the mailbox. Only the changed mailboxes need to be
+	   opened and synced. */
 	if (imap_status_get(ctx->cmd, ns, name,
 			    &ctx->status_items, &result) < 0) {
 		client_send_line(ctx->cmd->client,
@@ -108,8 +108,18 @@ static void imap_hibernate_write_cmd(struct client *client, string_t *cmd,
 	if (client->command_queue != NULL &&
 	    strcasecmp(client->command_queue->name, "IDLE") == 0)
 		str_append(cmd, "\tidle-cmd");
-	if (fd_notify != -1)
+	if (fd_notify != -1) {
 		str_append(cmd, "\tnotify_fd");
+		if (user->set->mail_chroot[0] == '\0') {
+			/* allow imap-hibernate to share the notify fd with
+			   other clients watching the same paths */
+			string_t *paths = t_str_new(128);
+
+			mailbox_watch_append_paths(client->mailbox, paths);
+			str_append(cmd, "\tnotify_key=");
+			str_append_tabescaped(cmd, str_c(paths));
+		}
+	}
 	str_append(cmd, "\tstate=");
 	base64_encode(state->data, state->used, cmd);
 	str_append_c(cmd, '\n');
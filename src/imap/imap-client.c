@@ -13,6 +13,7 @@
 #include "ostream.h"
 #include "time-util.h"
 #include "var-expand.h"
+#include "compression.h"
 #include "master-service.h"
 #include "imap-resp-code.h"
 #include "imap-util.h"
@@ -112,6 +113,36 @@ static bool user_has_special_use_mailboxes(struct mail_user *user)
 	return FALSE;
 }
 
+static void client_add_compress_capabilities(struct client *client)
+{
+	const struct compression_handler *handler;
+	const char *const *mechp, *deflate_cap = " COMPRESS=DEFLATE";
+	bool deflate = FALSE;
+
+	mechp = client->set->parsed_compress_mechanisms;
+	for (; *mechp != NULL; mechp++) {
+		if (strcasecmp(*mechp, "deflate") == 0) {
+			/* it's already in the default capabilities */
+			deflate = TRUE;
+		} else if (compression_lookup_handler(t_str_lcase(*mechp),
+						      &handler) > 0) {
+			client_add_capability(client, t_strconcat(
+				"COMPRESS=", t_str_ucase(*mechp), NULL));
+		}
+	}
+
+	if (!deflate && (client->set->imap_capability[0] == '\0' ||
+			 client->set->imap_capability[0] == '+')) {
+		const char *p = strstr(str_c(client->capability_string),
+				       deflate_cap);
+		if (p != NULL) {
+			str_delete(client->capability_string,
+				   p - str_c(client->capability_string),
+				   strlen(deflate_cap));
+		}
+	}
+}
+
 struct client *client_create(int fd_in, int fd_out, bool unhibernated,
 			     struct event *event, struct mail_user *user,
 			     const struct imap_settings *set,
@@ -202,6 +233,7 @@ struct client *client_create(int fd_in, int fd_out, bool unhibernated,
 		   SPECIAL-USE flags in mailbox configuration. */
 		client_add_capability(client, "SPECIAL-USE");
 	}
+	client_add_compress_capabilities(client);
 
 	struct master_service_anvil_session anvil_session;
 	mail_user_get_anvil_session(client->user, &anvil_session);
@@ -1030,6 +1062,15 @@ void client_command_free(struct client_command_context **_cmd)
 	event_add_int(cmd->event, "lock_wait_usecs", cmd->stats.lock_wait_usecs);
 	event_add_int(cmd->event, "net_in_bytes", cmd->stats.bytes_in);
 	event_add_int(cmd->event, "net_out_bytes", cmd->stats.bytes_out);
+	event_add_int(cmd->event, "cpu_user_usecs", cmd->stats.cpu_user_usecs);
+	event_add_int(cmd->event, "cpu_system_usecs",
+		      cmd->stats.cpu_system_usecs);
+	event_add_int(cmd->event, "storage_read_bytes",
+		      cmd->stats.storage_read_bytes);
+	event_add_int(cmd->event, "cache_lookups", cmd->stats.cache_lookups);
+	event_add_int(cmd->event, "cache_hits", cmd->stats.cache_hits);
+	if (!cmd->internal)
+		command_stats_check_slow(cmd);
 
 	e_debug(cmd->event, "Command finished: %s %s", cmd->name,
 		cmd->human_args != NULL ? cmd->human_args : "");
@@ -1135,6 +1176,23 @@ static bool client_remove_pending_unambiguity(struct client *client)
 	return TRUE;
 }
 
+bool client_command_has_runnable_others(struct client_command_context *cmd)
+{
+	struct client *client = cmd->client;
+	struct client_command_context *other;
+
+	other = client->command_queue;
+	for (; other != NULL; other = other->next) {
+		if (other != cmd &&
+		    (other->state == CLIENT_COMMAND_STATE_WAIT_OUTPUT ||
+		     other->state == CLIENT_COMMAND_STATE_WAIT_EXTERNAL))
+			return TRUE;
+	}
+	/* pipelined commands that haven't been started yet */
+	return (client->input_lock == NULL || client->input_lock == cmd) &&
+		i_stream_get_data_size(client->input) > 0;
+}
+
 void client_continue_pending_input(struct client *client)
 {
 	i_assert(!client->handling_input);
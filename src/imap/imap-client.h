@@ -67,12 +67,22 @@ struct client_command_stats {
 	uint64_t lock_wait_usecs;
 	/* how many bytes of client input/output command has used */
 	uint64_t bytes_in, bytes_out;
+	/* how much user/system CPU time this command has used */
+	uint64_t cpu_user_usecs, cpu_system_usecs;
+	/* how many bytes this command has read from files */
+	uint64_t storage_read_bytes;
+	/* how many cache field lookups this command has done and how many
+	   of them found the field */
+	uint64_t cache_lookups, cache_hits;
 };
 
 struct client_command_stats_start {
 	struct timeval timeval;
 	uint64_t lock_wait_usecs;
 	uint64_t bytes_in, bytes_out;
+	uint64_t cpu_user_usecs, cpu_system_usecs;
+	uint64_t storage_read_bytes;
+	uint64_t cache_lookups, cache_hits;
 };
 
 struct client_command_context {
@@ -350,6 +360,9 @@ void client_command_cancel(struct client_command_context **cmd);
 void client_command_free(struct client_command_context **cmd);
 
 bool client_handle_unfinished_cmd(struct client_command_context *cmd);
+/* Returns TRUE if other commands could make progress if cmd stopped
+   executing for a while. */
+bool client_command_has_runnable_others(struct client_command_context *cmd);
 /* Handle any pending command input. This must be run at the end of all
    I/O callbacks after they've (potentially) finished some commands. */
 void client_continue_pending_input(struct client *client);
@@ -3,10 +3,16 @@
 #include "imap-common.h"
 #include "array.h"
 #include "buffer.h"
+#include "hash.h"
+#include "str.h"
 #include "ioloop.h"
 #include "istream.h"
 #include "ostream.h"
 #include "time-util.h"
+#include "stats-dist.h"
+#include "process-stat.h"
+#include "mail-cache.h"
+#include "sampling-profiler.h"
 #include "imap-commands.h"
 
 
@@ -85,9 +91,15 @@ static const struct command imap_ext_commands[] = {
 };
 #define IMAP_EXT_COMMANDS_COUNT N_ELEMENTS(imap_ext_commands)
 
+/* Don't log slow commands until the command's running time distribution
+   has at least this many samples. */
+#define COMMAND_SLOW_MIN_SAMPLES 100
+
 ARRAY_TYPE(command) imap_commands;
 static bool commands_unsorted;
 static ARRAY(struct command_hook) command_hooks;
+/* command name -> distribution of running_usecs */
+static HASH_TABLE(char *, struct stats_dist *) command_running_stats;
 
 void command_register(const char *name, command_func_t *func,
 		      enum command_flags flags)
@@ -165,10 +177,18 @@ void command_stats_start(struct client_command_context *cmd)
 	cmd->stats_start.lock_wait_usecs = file_lock_wait_get_total_usecs();
 	cmd->stats_start.bytes_in = i_stream_get_absolute_offset(cmd->client->input);
 	cmd->stats_start.bytes_out = cmd->client->output->offset;
+	process_stat_read_cpu(&cmd->stats_start.cpu_user_usecs,
+			      &cmd->stats_start.cpu_system_usecs);
+	cmd->stats_start.storage_read_bytes =
+		i_stream_file_get_total_read_bytes();
+	mail_cache_get_lookup_counts(&cmd->stats_start.cache_lookups,
+				     &cmd->stats_start.cache_hits);
 }
 
 void command_stats_flush(struct client_command_context *cmd)
 {
+	uint64_t utime, stime, cache_lookups, cache_hits;
+
 	io_loop_time_refresh();
 	cmd->stats.running_usecs +=
 		timeval_diff_usecs(&ioloop_timeval, &cmd->stats_start.timeval);
@@ -179,13 +199,96 @@ void command_stats_flush(struct client_command_context *cmd)
 		cmd->stats_start.bytes_in;
 	cmd->stats.bytes_out += cmd->client->prev_output_size +
 		cmd->client->output->offset - cmd->stats_start.bytes_out;
+	process_stat_read_cpu(&utime, &stime);
+	cmd->stats.cpu_user_usecs += utime - cmd->stats_start.cpu_user_usecs;
+	cmd->stats.cpu_system_usecs += stime - cmd->stats_start.cpu_system_usecs;
+	cmd->stats.storage_read_bytes += i_stream_file_get_total_read_bytes() -
+		cmd->stats_start.storage_read_bytes;
+	mail_cache_get_lookup_counts(&cache_lookups, &cache_hits);
+	cmd->stats.cache_lookups += cache_lookups -
+		cmd->stats_start.cache_lookups;
+	cmd->stats.cache_hits += cache_hits - cmd->stats_start.cache_hits;
 	/* allow flushing multiple times */
 	command_stats_start(cmd);
 }
 
+static void
+command_log_slow(struct client_command_context *cmd, unsigned int percentile,
+		 uint64_t threshold_usecs)
+{
+	struct client *client = cmd->client;
+	const struct client_command_stats *stats = &cmd->stats;
+	struct event *event;
+	string_t *str = t_str_new(256);
+
+	event = event_create(cmd->event);
+	event_set_name(event, "imap_command_slow");
+	event_add_int(event, "slow_threshold_usecs", threshold_usecs);
+	if (client->mailbox != NULL) {
+		event_add_str(event, "mailbox",
+			      mailbox_get_vname(client->mailbox));
+		event_add_int(event, "mailbox_messages",
+			      client->messages_count);
+	}
+
+	str_printfa(str, "Slow command: %s", cmd->name);
+	if (cmd->human_args != NULL && cmd->human_args[0] != '\0')
+		str_printfa(str, " %s", cmd->human_args);
+	str_printfa(str, " (running %"PRIu64" ms > p%u %"PRIu64" ms",
+		    stats->running_usecs / 1000, percentile,
+		    threshold_usecs / 1000);
+	if (client->mailbox != NULL) {
+		str_printfa(str, ", mailbox=%s, messages=%u",
+			    mailbox_get_vname(client->mailbox),
+			    client->messages_count);
+	}
+	str_printfa(str, ", cpu user=%"PRIu64" ms system=%"PRIu64" ms"
+		    ", lock wait=%"PRIu64" ms, storage read=%"PRIu64" bytes"
+		    ", cache hits=%"PRIu64"/%"PRIu64")",
+		    stats->cpu_user_usecs / 1000,
+		    stats->cpu_system_usecs / 1000,
+		    stats->lock_wait_usecs / 1000,
+		    stats->storage_read_bytes,
+		    stats->cache_hits, stats->cache_lookups);
+	e_info(event, "%s", str_c(str));
+	event_unref(&event);
+}
+
+void command_stats_check_slow(struct client_command_context *cmd)
+{
+	unsigned int percentile =
+		cmd->client->set->imap_slow_command_percentile;
+	struct stats_dist *dist;
+	uint64_t threshold_usecs;
+
+	if (percentile == 0 || cmd->func == NULL)
+		return;
+
+	if (!hash_table_is_created(command_running_stats)) {
+		hash_table_create(&command_running_stats, default_pool, 0,
+				  strcase_hash, strcasecmp);
+	}
+	dist = hash_table_lookup(command_running_stats, cmd->name);
+	if (dist == NULL) {
+		dist = stats_dist_init_sketch();
+		hash_table_insert(command_running_stats,
+				  i_strdup(cmd->name), dist);
+	}
+
+	if (stats_dist_get_count(dist) >= COMMAND_SLOW_MIN_SAMPLES) {
+		threshold_usecs = stats_dist_get_percentile(dist,
+							    percentile / 100.);
+		if (cmd->stats.running_usecs > threshold_usecs) T_BEGIN {
+			command_log_slow(cmd, percentile, threshold_usecs);
+		} T_END;
+	}
+	stats_dist_add(dist, cmd->stats.running_usecs);
+}
+
 bool command_exec(struct client_command_context *cmd)
 {
 	const struct command_hook *hook;
+	const char *old_label;
 	bool finished;
 
 	i_assert(!cmd->executing);
@@ -194,6 +297,7 @@ bool command_exec(struct client_command_context *cmd)
 	command_stats_start(cmd);
 
 	event_push_global(cmd->global_event);
+	old_label = sampling_profiler_set_label(cmd->name);
 	cmd->executing = TRUE;
 	array_foreach(&command_hooks, hook)
 		hook->pre(cmd);
@@ -201,6 +305,7 @@ bool command_exec(struct client_command_context *cmd)
 	array_foreach(&command_hooks, hook)
 		hook->post(cmd);
 	cmd->executing = FALSE;
+	sampling_profiler_set_label(old_label);
 	event_pop_global(cmd->global_event);
 	if (cmd->state == CLIENT_COMMAND_STATE_DONE)
 		finished = TRUE;
@@ -241,6 +346,20 @@ void commands_init(void)
 
 void commands_deinit(void)
 {
+	struct hash_iterate_context *iter;
+	struct stats_dist *dist;
+	char *name;
+
+	if (hash_table_is_created(command_running_stats)) {
+		iter = hash_table_iterate_init(command_running_stats);
+		while (hash_table_iterate(iter, command_running_stats,
+					  &name, &dist)) {
+			i_free(name);
+			stats_dist_deinit(&dist);
+		}
+		hash_table_iterate_deinit(&iter);
+		hash_table_destroy(&command_running_stats);
+	}
 	array_free(&imap_commands);
 	array_free(&command_hooks);
 }
@@ -66,6 +66,10 @@ void command_stats_start(struct client_command_context *cmd);
    command_exec() returns, but it should be called explicitly if the stats are
    needed during command_exec(). */
 void command_stats_flush(struct client_command_context *cmd);
+/* Add the finished command's running time to the command's distribution.
+   If the command was slower than imap_slow_command_percentile of the
+   previous same commands, log its details. */
+void command_stats_check_slow(struct client_command_context *cmd);
 
 struct command *command_find(const char *name);
 
@@ -6,6 +6,7 @@
 #include "istream.h"
 #include "ostream.h"
 #include "str.h"
+#include "time-util.h"
 #include "message-size.h"
 #include "imap-date.h"
 #include "imap-utf7.h"
@@ -17,6 +18,10 @@
 
 #include <ctype.h>
 
+/* Give other pipelined commands a chance to run after FETCH has been
+   running this long. */
+#define IMAP_FETCH_MAX_SLICE_USECS (10*1000)
+
 #define BODY_NIL_REPLY \
 	"\"text\" \"plain\" NIL NIL NIL \"7bit\" 0 0"
 #define ENVELOPE_NIL_REPLY \
@@ -486,12 +491,28 @@ static bool imap_fetch_cur_failed(struct imap_fetch_context *ctx)
 	return TRUE;
 }
 
-static int imap_fetch_more_int(struct imap_fetch_context *ctx, bool cancel)
+static bool
+imap_fetch_should_yield(struct imap_fetch_context *ctx,
+			struct client_command_context *cmd,
+			uint64_t slice_start_usecs)
+{
+	if (ctx->client->output_cmd_lock != NULL &&
+	    ctx->client->output_cmd_lock != cmd)
+		return FALSE;
+	if (i_microseconds() - slice_start_usecs < IMAP_FETCH_MAX_SLICE_USECS)
+		return FALSE;
+	return client_command_has_runnable_others(cmd);
+}
+
+static int imap_fetch_more_int(struct imap_fetch_context *ctx,
+			       struct client_command_context *cmd)
 {
 	struct imap_fetch_state *state = &ctx->state;
 	struct client *client = ctx->client;
 	const struct imap_fetch_context_handler *handlers;
-	unsigned int count;
+	bool cancel = cmd != NULL && cmd->cancel;
+	uint64_t slice_start_usecs = cmd == NULL ? 0 : i_microseconds();
+	unsigned int count, slice_mails_count = 0;
 	int ret;
 
 	if (state->cont_handler != NULL) {
@@ -532,6 +553,15 @@ static int imap_fetch_more_int(struct imap_fetch_context *ctx, bool cancel)
 		if (state->cur_mail == NULL) {
 			if (cancel)
 				return 1;
+			/* Between mails other commands' replies can be sent.
+			   If there are any, let them run for a while so
+			   their I/O waits can overlap with ours. */
+			if (cmd != NULL && slice_mails_count > 0 &&
+			    imap_fetch_should_yield(ctx, cmd,
+						    slice_start_usecs)) {
+				o_stream_set_flush_pending(client->output, TRUE);
+				return 0;
+			}
 
 			if (!mailbox_search_next(state->search_ctx,
 						 &state->cur_mail))
@@ -540,6 +570,7 @@ static int imap_fetch_more_int(struct imap_fetch_context *ctx, bool cancel)
 			str_printfa(state->cur_str, "* %u FETCH (",
 				    state->cur_mail->seq);
 			ctx->fetched_mails_count++;
+			slice_mails_count++;
 			state->cur_first = TRUE;
 			state->cur_str_prefix_size = str_len(state->cur_str);
 			i_assert(!state->line_partial);
@@ -614,7 +645,7 @@ int imap_fetch_more(struct imap_fetch_context *ctx,
 	i_assert(ctx->client->output_cmd_lock == NULL ||
 		 ctx->client->output_cmd_lock == cmd);
 
-	ret = imap_fetch_more_int(ctx, cmd->cancel);
+	ret = imap_fetch_more_int(ctx, cmd);
 	if (ret < 0)
 		ctx->state.failed = TRUE;
 	if (ctx->state.line_partial) {
@@ -635,7 +666,7 @@ int imap_fetch_more_no_lock_update(struct imap_fetch_context *ctx)
 {
 	int ret;
 
-	ret = imap_fetch_more_int(ctx, FALSE);
+	ret = imap_fetch_more_int(ctx, NULL);
 	if (ret < 0) {
 		ctx->state.failed = TRUE;
 		if (ctx->state.line_partial) {
@@ -699,28 +730,43 @@ void imap_fetch_free(struct imap_fetch_context **_ctx)
 	pool_unref(&ctx->ctx_pool);
 }
 
-static int fetch_body(struct imap_fetch_context *ctx, struct mail *mail,
-		      void *context ATTR_UNUSED)
+/* Send "<name> (<value>)" with a single write. The value is already in
+   IMAP syntax, because that's how it's stored in the mail cache. */
+static int
+fetch_send_list_value(struct imap_fetch_context *ctx, const char *name,
+		      const char *value)
 {
-	const char *body;
-
-	if (mail_get_special(mail, MAIL_FETCH_IMAP_BODY, &body) < 0)
-		return -1;
+	struct const_iovec iov[4];
+	unsigned int i = 0;
 
 	if (ctx->state.cur_first)
 		ctx->state.cur_first = FALSE;
 	else {
-		if (o_stream_send(ctx->client->output, " ", 1) < 0)
-			return -1;
+		iov[i].iov_base = " ";
+		iov[i++].iov_len = 1;
 	}
-
-	if (o_stream_send(ctx->client->output, "BODY (", 6) < 0 ||
-	    o_stream_send_str(ctx->client->output, body) < 0 ||
-	    o_stream_send(ctx->client->output, ")", 1) < 0)
+	iov[i].iov_base = name;
+	iov[i++].iov_len = strlen(name);
+	iov[i].iov_base = value;
+	iov[i++].iov_len = strlen(value);
+	iov[i].iov_base = ")";
+	iov[i++].iov_len = 1;
+
+	if (o_stream_sendv(ctx->client->output, iov, i) < 0)
 		return -1;
 	return 1;
 }
 
+static int fetch_body(struct imap_fetch_context *ctx, struct mail *mail,
+		      void *context ATTR_UNUSED)
+{
+	const char *body;
+
+	if (mail_get_special(mail, MAIL_FETCH_IMAP_BODY, &body) < 0)
+		return -1;
+	return fetch_send_list_value(ctx, "BODY (", body);
+}
+
 static bool fetch_body_init(struct imap_fetch_init_context *ctx)
 {
 	if (ctx->name[4] == '\0') {
@@ -740,20 +786,7 @@ static int fetch_bodystructure(struct imap_fetch_context *ctx,
 	if (mail_get_special(mail, MAIL_FETCH_IMAP_BODYSTRUCTURE,
 			     &bodystructure) < 0)
 		return -1;
-
-	if (ctx->state.cur_first)
-		ctx->state.cur_first = FALSE;
-	else {
-		if (o_stream_send(ctx->client->output, " ", 1) < 0)
-			return -1;
-	}
-
-	if (o_stream_send(ctx->client->output, "BODYSTRUCTURE (", 15) < 0 ||
-	    o_stream_send_str(ctx->client->output, bodystructure) < 0 ||
-	    o_stream_send(ctx->client->output, ")", 1) < 0)
-		return -1;
-
-	return 1;
+	return fetch_send_list_value(ctx, "BODYSTRUCTURE (", bodystructure);
 }
 
 static bool fetch_bodystructure_init(struct imap_fetch_init_context *ctx)
@@ -771,19 +804,7 @@ static int fetch_envelope(struct imap_fetch_context *ctx, struct mail *mail,
 
 	if (mail_get_special(mail, MAIL_FETCH_IMAP_ENVELOPE, &envelope) < 0)
 		return -1;
-
-	if (ctx->state.cur_first)
-		ctx->state.cur_first = FALSE;
-	else {
-		if (o_stream_send(ctx->client->output, " ", 1) < 0)
-			return -1;
-	}
-
-	if (o_stream_send(ctx->client->output, "ENVELOPE (", 10) < 0 ||
-	    o_stream_send_str(ctx->client->output, envelope) < 0 ||
-	    o_stream_send(ctx->client->output, ")", 1) < 0)
-		return -1;
-	return 1;
+	return fetch_send_list_value(ctx, "ENVELOPE (", envelope);
 }
 
 static bool fetch_envelope_init(struct imap_fetch_init_context *ctx)
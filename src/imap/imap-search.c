@@ -536,6 +536,14 @@ bool imap_search_start(struct imap_search_context *ctx,
 	ctx->search_ctx =
 		mailbox_search_init(ctx->trans, sargs, sort_program, 0, NULL);
 	ctx->sorting = sort_program != NULL;
+	if (ctx->sorting &&
+	    HAS_ANY_BITS(ctx->return_options, SEARCH_RETURN_PARTIAL) &&
+	    HAS_NO_BITS(ctx->return_options, SEARCH_RETURN_MIN |
+			SEARCH_RETURN_MAX | SEARCH_RETURN_COUNT |
+			SEARCH_RETURN_SAVE | SEARCH_RETURN_UPDATE)) {
+		/* mails after the PARTIAL range aren't needed for anything */
+		mailbox_search_set_sort_limit(ctx->search_ctx, ctx->partial2);
+	}
 	i_array_init(&ctx->result, 128);
 	if ((ctx->return_options & SEARCH_RETURN_UPDATE) != 0)
 		imap_search_result_save(ctx);
@@ -59,6 +59,7 @@ struct service_settings imap_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "$default_internal_group",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -68,6 +69,7 @@ struct service_settings imap_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &imap_unix_listeners_buf,
 			      sizeof(imap_unix_listeners[0]) } },
@@ -98,6 +100,9 @@ static const struct setting_define imap_setting_defines[] = {
 	DEF(BOOL, imap_metadata),
 	DEF(BOOL, imap_literal_minus),
 	DEF(TIME, imap_hibernate_timeout),
+	DEF(STR, imap_compress_mechanisms),
+	DEF(UINT, imap_compress_level),
+	DEF(UINT, imap_slow_command_percentile),
 
 	DEF(STR, imap_urlauth_host),
 	DEF(IN_PORT, imap_urlauth_port),
@@ -105,6 +110,12 @@ static const struct setting_define imap_setting_defines[] = {
 	SETTING_DEFINE_LIST_END
 };
 
+/* <settings checks> */
+static const char *const imap_default_compress_mechanisms[] = {
+	"deflate", NULL
+};
+/* </settings checks> */
+
 static const struct imap_settings imap_default_settings = {
 	.verbose_proctitle = FALSE,
 	.rawlog_dir = "",
@@ -125,6 +136,11 @@ static const struct imap_settings imap_default_settings = {
 	.imap_metadata = FALSE,
 	.imap_literal_minus = FALSE,
 	.imap_hibernate_timeout = 0,
+	.imap_compress_mechanisms = "deflate",
+	.imap_compress_level = 0,
+	.imap_slow_command_percentile = 0,
+	/* used if the settings aren't checked, e.g. by unit tests */
+	.parsed_compress_mechanisms = imap_default_compress_mechanisms,
 
 	.imap_urlauth_host = "",
 	.imap_urlauth_port = 143
@@ -190,14 +206,43 @@ imap_settings_parse_workarounds(struct imap_settings *set,
 	return 0;
 }
 
+static int
+imap_settings_parse_compress_mechanisms(struct imap_settings *set, pool_t pool,
+					const char **error_r)
+{
+	/* DEFLATE is the only standard one. The others are meant for
+	   connections between Dovecot servers. */
+	static const char *const known_mechanisms[] = {
+		"deflate", "zstd", "lz4", NULL
+	};
+	const char *const *mechanisms;
+
+	mechanisms = (const char *const *)
+		p_strsplit_spaces(pool, set->imap_compress_mechanisms, " ,");
+	for (unsigned int i = 0; mechanisms[i] != NULL; i++) {
+		if (!str_array_icase_find(known_mechanisms, mechanisms[i])) {
+			*error_r = t_strdup_printf("imap_compress_mechanisms: "
+				"Unknown mechanism: %s", mechanisms[i]);
+			return -1;
+		}
+	}
+	set->parsed_compress_mechanisms = mechanisms;
+	return 0;
+}
 
 static bool
-imap_settings_verify(void *_set, pool_t pool ATTR_UNUSED, const char **error_r)
+imap_settings_verify(void *_set, pool_t pool, const char **error_r)
 {
 	struct imap_settings *set = _set;
 
 	if (imap_settings_parse_workarounds(set, error_r) < 0)
 		return FALSE;
+	if (imap_settings_parse_compress_mechanisms(set, pool, error_r) < 0)
+		return FALSE;
+	if (set->imap_slow_command_percentile >= 100) {
+		*error_r = "imap_slow_command_percentile must be less than 100";
+		return FALSE;
+	}
 
 	if (strcmp(set->imap_fetch_failure, "disconnect-immediately") == 0)
 		set->parsed_fetch_failure = IMAP_CLIENT_FETCH_FAILURE_DISCONNECT_IMMEDIATELY;
@@ -34,6 +34,9 @@ struct imap_settings {
 	bool imap_metadata;
 	bool imap_literal_minus;
 	unsigned int imap_hibernate_timeout;
+	const char *imap_compress_mechanisms;
+	unsigned int imap_compress_level;
+	unsigned int imap_slow_command_percentile;
 
 	/* imap urlauth: */
 	const char *imap_urlauth_host;
@@ -41,6 +44,7 @@ struct imap_settings {
 
 	enum imap_client_workarounds parsed_workarounds;
 	enum imap_client_fetch_failure parsed_fetch_failure;
+	const char *const *parsed_compress_mechanisms;
 };
 
 extern const struct setting_parser_info imap_setting_parser_info;
@@ -141,41 +141,25 @@ int imap_state_import_external(struct client *client,
 	return imap_state_import(client, FALSE, data, size, error_r);
 }
 
-static int
-imap_state_export_mailbox_mails(buffer_t *dest, struct mailbox *box,
-				const char **error_r)
+static void
+imap_state_export_mailbox_mails(buffer_t *dest, struct mailbox *box)
 {
-	struct mailbox_transaction_context *trans;
-	struct mail_search_args *search_args;
-	struct mail_search_context *search_ctx;
-	struct mail *mail;
 	ARRAY_TYPE(seq_range) recent_uids;
-	uint32_t crc = 0;
-	int ret = 1;
-
-	search_args = mail_search_build_init();
-	mail_search_build_add_all(search_args);
-
-	trans = mailbox_transaction_begin(box, 0,
-				"unhibernate imap_state_export_mailbox_mails");
-	search_ctx = mailbox_search_init(trans, search_args, NULL, 0, NULL);
-	mail_search_args_unref(&search_args);
+	uint32_t seq, count, uid, crc = 0;
 
+	/* the UIDs are looked up directly from the index, which is much
+	   faster than going through all the mails with a search */
 	t_array_init(&recent_uids, 8);
-	while (mailbox_search_next(search_ctx, &mail)) {
-		crc = crc32_data_more(crc, &mail->uid, sizeof(mail->uid));
-		if ((mail_get_flags(mail) & MAIL_RECENT) != 0)
-			seq_range_array_add(&recent_uids, mail->uid);
-	}
-	if (mailbox_search_deinit(&search_ctx) < 0) {
-		*error_r = mailbox_get_last_internal_error(box, NULL);
-		ret = -1;
+	count = mail_index_view_get_messages_count(box->view);
+	for (seq = 1; seq <= count; seq++) {
+		mail_index_lookup_uid(box->view, seq, &uid);
+		crc = crc32_data_more(crc, &uid, sizeof(uid));
+		if (mailbox_recent_flags_have_uid(box, uid))
+			seq_range_array_add(&recent_uids, uid);
 	}
-	(void)mailbox_transaction_commit(&trans);
 
 	numpack_encode(dest, crc);
 	export_seq_range(dest, &recent_uids);
-	return ret;
 }
 
 static uint32_t
@@ -235,7 +219,8 @@ imap_state_export_mailbox(buffer_t *dest, struct client *client,
 	/* we're now basically done, but just in case there's a bug add a
 	   checksum of the currently existing UIDs and verify it when
 	   importing. this also writes the list of recent UIDs. */
-	return imap_state_export_mailbox_mails(dest, box, error_r);
+	imap_state_export_mailbox_mails(dest, box);
+	return 1;
 }
 
 int imap_state_export_base(struct client *client, bool internal,
@@ -313,18 +298,14 @@ import_send_expunges(struct client *client,
 		     unsigned int *expunge_count_r,
 		     const char **error_r)
 {
-	struct mailbox_transaction_context *trans;
-	struct mail_search_args *search_args;
-	struct mail_search_context *search_ctx;
-	struct mail *mail;
-	uint32_t crc = 0, seq, expunged_uid;
+	struct mail_index_view *view = client->mailbox->view;
+	uint32_t crc = 0, seq, idx_seq, idx_count, uid, expunged_uid;
 	ARRAY_TYPE(seq_range) uids_filter, expunged_uids;
 	ARRAY_TYPE(uint32_t) expunged_seqs;
 	struct seq_range_iter iter;
 	const uint32_t *seqs;
 	unsigned int i, expunge_count, n = 0;
 	string_t *str;
-	int ret = 0;
 
 	*expunge_count_r = 0;
 
@@ -352,19 +333,15 @@ import_send_expunges(struct client *client,
 	}
 	seq_range_array_iter_init(&iter, &expunged_uids);
 
-	search_args = mail_search_build_init();
-	mail_search_build_add_all(search_args);
-
-	trans = mailbox_transaction_begin(client->mailbox, 0,
-					  "unhibernate import_send_expunges");
-	search_ctx = mailbox_search_init(trans, search_args, NULL, 0, NULL);
-	mail_search_args_unref(&search_args);
-
-	/* find sequence numbers for the expunged UIDs */
+	/* find sequence numbers for the expunged UIDs. The UIDs are looked
+	   up directly from the index instead of searching through the mails,
+	   since this is done for every mail in the mailbox. */
 	t_array_init(&expunged_seqs, array_count(&expunged_uids)+1); seq = 0;
-	while (mailbox_search_next(search_ctx, &mail)) {
+	idx_count = mail_index_view_get_messages_count(view);
+	for (idx_seq = 1; idx_seq <= idx_count; idx_seq++) {
+		mail_index_lookup_uid(view, idx_seq, &uid);
 		while (seq_range_array_iter_nth(&iter, n, &expunged_uid) &&
-		       expunged_uid < mail->uid && seq < state->messages) {
+		       expunged_uid < uid && seq < state->messages) {
 			seq++; n++;
 			array_push_back(&expunged_seqs, &seq);
 			crc = crc32_data_more(crc, &expunged_uid,
@@ -372,7 +349,7 @@ import_send_expunges(struct client *client,
 		}
 		if (seq == state->messages)
 			break;
-		crc = crc32_data_more(crc, &mail->uid, sizeof(mail->uid));
+		crc = crc32_data_more(crc, &uid, sizeof(uid));
 		if (++seq == state->messages)
 			break;
 	}
@@ -384,18 +361,12 @@ import_send_expunges(struct client *client,
 				      sizeof(expunged_uid));
 	}
 
-	if (mailbox_search_deinit(&search_ctx) < 0) {
-		*error_r = mailbox_get_last_internal_error(client->mailbox, NULL);
-		ret = -1;
-	} else if (seq != state->messages) {
+	if (seq != state->messages) {
 		*error_r = t_strdup_printf("Message count mismatch after "
 					   "handling expunges (%u != %u)",
 					   seq, state->messages);
-		ret = -1;
-	}
-	(void)mailbox_transaction_commit(&trans);
-	if (ret < 0)
 		return -1;
+	}
 
 	seqs = array_get(&expunged_seqs, &expunge_count);
 	if (client->messages_count + expunge_count < state->messages) {
@@ -106,6 +106,8 @@ indexer_queue_append_request(struct indexer_queue *queue, bool append,
 	if (request != NULL) {
 		if (request->max_recent_msgs > max_recent_msgs)
 			request->max_recent_msgs = max_recent_msgs;
+		if (!append)
+			request->interactive = TRUE;
 		request_add_context(request, context);
 		if (request->working) {
 			/* we're already indexing this mailbox. */
@@ -130,6 +132,7 @@ indexer_queue_append_request(struct indexer_queue *queue, bool append,
 	request->mailbox = i_strdup(mailbox);
 	request->session_id = i_strdup(session_id);
 	request->max_recent_msgs = max_recent_msgs;
+	request->interactive = !append;
 	request_add_context(request, context);
 	hash_table_insert(queue->requests, request, request);
 
@@ -234,6 +237,31 @@ void indexer_queue_request_work(struct indexer_request *request)
 		array_count(&request->contexts);
 }
 
+void indexer_queue_request_requeue(struct indexer_queue *queue,
+				   struct indexer_request **_request)
+{
+	struct indexer_request *request = *_request;
+
+	*_request = NULL;
+
+	i_assert(request->working);
+	if (request->cancelled) {
+		indexer_queue_request_finish(queue, &request,
+					     INDEXER_STATE_FAILED);
+		return;
+	}
+
+	/* keep all the contexts - they're still waiting for the indexing to
+	   finish */
+	request->working = FALSE;
+	if (request->reindex_head)
+		DLLIST2_PREPEND(&queue->head, &queue->tail, request);
+	else
+		DLLIST2_APPEND(&queue->head, &queue->tail, request);
+	request->reindex_head = FALSE;
+	request->reindex_tail = FALSE;
+}
+
 void indexer_queue_request_finish(struct indexer_queue *queue,
 				  struct indexer_request **_request,
 				  enum indexer_state state)
@@ -318,6 +346,7 @@ void indexer_queue_cancel(struct indexer_queue *queue, const char *username,
 			   but we can make sure it won't be added back to the
 			   queue. */
 			request->reindex_head = request->reindex_tail = FALSE;
+			request->cancelled = TRUE;
 		} else {
 			indexer_queue_request_cancel(queue, &request);
 		}
@@ -336,8 +365,10 @@ void indexer_queue_cancel_all(struct indexer_queue *queue)
 	   (or are cancelled) we don't try to retry them (especially during
 	   deinit where it crashes) */
 	iter = hash_table_iterate_init(queue->requests);
-	while (hash_table_iterate(iter, queue->requests, &request, &request))
+	while (hash_table_iterate(iter, queue->requests, &request, &request)) {
 		request->reindex_head = request->reindex_tail = FALSE;
+		request->cancelled = TRUE;
+	}
 	hash_table_iterate_deinit(&iter);
 
 	while ((request = indexer_queue_request_peek(queue)) != NULL)
@@ -26,8 +26,13 @@ struct indexer_request {
 
 	enum indexer_request_type type;
 
+	/* A client is waiting for the indexing to finish (e.g. SEARCH in
+	   fts_indexer_more()), as opposed to indexing in the background. */
+	bool interactive:1;
 	/* currently indexing this mailbox */
 	bool working:1;
+	/* the request was cancelled while it was being worked on */
+	bool cancelled:1;
 	/* after indexing is finished, add this request back to the queue and
 	   reindex it (i.e. a new indexing request came while we were
 	   working.) */
@@ -78,6 +83,10 @@ void indexer_queue_request_status(struct indexer_queue *queue,
 void indexer_queue_move_head_to_tail(struct indexer_queue *queue);
 /* Start working on a request */
 void indexer_queue_request_work(struct indexer_request *request);
+/* The worker stopped before the request was finished, so other requests could
+   run. Add it back to the queue to continue later. */
+void indexer_queue_request_requeue(struct indexer_queue *queue,
+				   struct indexer_request **request);
 /* Finish the request and free its memory. */
 void indexer_queue_request_finish(struct indexer_queue *queue,
 				  struct indexer_request **request,
@@ -42,6 +42,7 @@ struct service_settings indexer_worker_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "$default_internal_group",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -51,6 +52,7 @@ struct service_settings indexer_worker_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &indexer_worker_unix_listeners_buf,
 			      sizeof(indexer_worker_unix_listeners[0]) } },
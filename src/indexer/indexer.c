@@ -50,6 +50,16 @@ static bool worker_send_request(struct indexer_request *request)
 	return TRUE;
 }
 
+static bool queue_background_workers_full(void)
+{
+	unsigned int process_limit = worker_connections_get_process_limit();
+
+	/* Leave one worker for interactive requests, so clients waiting for
+	   indexing don't need to wait for background indexing to finish. */
+	return process_limit > 1 &&
+		worker_connections_get_background_count() + 1 >= process_limit;
+}
+
 static void queue_try_send_more(struct indexer_queue *queue)
 {
 	struct worker_connection *worker;
@@ -57,10 +67,12 @@ static void queue_try_send_more(struct indexer_queue *queue)
 
 	while ((request = indexer_queue_request_peek(queue)) != NULL) {
 		worker = worker_connections_find_user(request->username);
-		if (worker != NULL) {
+		if (worker != NULL ||
+		    (!request->interactive && queue_background_workers_full())) {
 			/* There is already a connection handling a request
-			 * for this user. Move the request to the back of the
-			 * queue and handle requests from other users.
+			 * for this user, or all the workers available for
+			 * background indexing are busy. Move the request to
+			 * the back of the queue and handle other requests.
 			 * Terminate if we went through all requests. */
 			if (request == first_moved_request) {
 				/* all requests are waiting for existing users
@@ -91,6 +103,13 @@ static void worker_status_callback(const struct indexer_status *status,
 		indexer_queue_request_status(queue, request, status);
 		return;
 	}
+	if (status->state == INDEXER_STATE_COMPLETED &&
+	    status->progress < status->total) {
+		/* worker stopped background indexing to let other requests
+		   run. continue it later. */
+		indexer_queue_request_requeue(queue, &request);
+		return;
+	}
 
 	indexer_queue_request_finish(queue, &request, status->state);
 }
@@ -22,6 +22,13 @@
 #define INDEXER_PROTOCOL_MAJOR_VERSION 1
 #define INDEXER_PROTOCOL_MINOR_VERSION 0
 
+/* How many mails to prefetch while indexing, unless mail_prefetch_count
+   is set */
+#define INDEXER_WORKER_PREFETCH_COUNT 16
+/* Stop indexing a mailbox in the background after this many seconds, so the
+   indexer can let other requests run before it continues. */
+#define INDEXER_WORKER_BACKGROUND_MAX_SECS 30
+
 #define INDEXER_MASTER_NAME "indexer-master-worker"
 #define INDEXER_WORKER_NAME "indexer-worker-master"
 
@@ -64,7 +71,8 @@ get_attempt_error(unsigned int counter, uint32_t first_uid, uint32_t last_uid)
 }
 
 static int
-index_mailbox_precache(struct master_connection *conn, struct mailbox *box)
+index_mailbox_precache(struct master_connection *conn, struct mailbox *box,
+		       time_t deadline, struct indexer_status *status_r)
 {
 	struct mail_storage *storage = mailbox_get_storage(box);
 	const char *username = mail_storage_get_user(storage)->username;
@@ -108,6 +116,12 @@ index_mailbox_precache(struct master_connection *conn, struct mailbox *box)
 	ctx = mailbox_search_init(trans, search_args, NULL,
 				  metadata.precache_fields, NULL);
 	mail_search_args_unref(&search_args);
+	if (storage->set->mail_prefetch_count == 0) {
+		/* start reading the next mails while the current one is
+		   being parsed and indexed */
+		mailbox_search_set_prefetch_count(ctx,
+			INDEXER_WORKER_PREFETCH_COUNT);
+	}
 
 	/* otherwise the client doesn't receive the updates timely */
 	o_stream_uncork(conn->conn.output);
@@ -129,7 +143,16 @@ index_mailbox_precache(struct master_connection *conn, struct mailbox *box)
 			ret = -1;
 			break;
 		}
-		unsigned int percentage = (++counter * 100) / goal;
+		counter++;
+		if (deadline != 0 && counter < goal && time(NULL) >= deadline) {
+			/* let the indexer run other requests first */
+			e_debug(index_event, "Stopping background indexing "
+				"after %u/%u messages", counter, goal);
+			status_r->progress = counter;
+			status_r->total = goal;
+			break;
+		}
+		unsigned int percentage = (counter * 100) / goal;
 		if (percentage_sent < percentage) {
 			percentage_sent = percentage;
 			if (percentage < 100) T_BEGIN {
@@ -187,7 +210,7 @@ index_mailbox_precache(struct master_connection *conn, struct mailbox *box)
 static int
 index_mailbox(struct master_connection *conn, struct mail_user *user,
 	      const char *mailbox, unsigned int max_recent_msgs,
-	      const char *what)
+	      const char *what, struct indexer_status *status_r)
 {
 	struct mail_namespace *ns;
 	struct mailbox *box;
@@ -245,7 +268,10 @@ index_mailbox(struct master_connection *conn, struct mail_user *user,
 		}
 		ret = -1;
 	} else if (strchr(what, 'i') != NULL) {
-		if (index_mailbox_precache(conn, box) < 0)
+		time_t deadline = strchr(what, 'b') == NULL ? 0 :
+			time(NULL) + INDEXER_WORKER_BACKGROUND_MAX_SECS;
+
+		if (index_mailbox_precache(conn, box, deadline, status_r) < 0)
 			ret = -1;
 	}
 	mailbox_free(&box);
@@ -256,7 +282,8 @@ static int
 master_connection_cmd_index(struct master_connection *conn,
 			    const char *username, const char *mailbox,
 			    const char *session_id,
-			    unsigned int max_recent_msgs, const char *what)
+			    unsigned int max_recent_msgs, const char *what,
+			    struct indexer_status *status_r)
 {
 	struct mail_storage_service_input input;
 	struct mail_user *user;
@@ -291,7 +318,8 @@ master_connection_cmd_index(struct master_connection *conn,
 	indexer_worker_refresh_proctitle(user->username, mailbox, 0, 0);
 	struct event_reason *reason =
 		event_reason_begin("indexer:index_mailbox");
-	ret = index_mailbox(conn, user, mailbox, max_recent_msgs, what);
+	ret = index_mailbox(conn, user, mailbox, max_recent_msgs, what,
+			    status_r);
 	event_reason_end(&reason);
 	/* refresh proctitle before a potentially long-running
 	   user unref */
@@ -315,7 +343,7 @@ master_connection_input_args(struct connection *_conn, const char *const *args)
 	unsigned int max_recent_msgs;
 	int ret;
 
-	/* <username> <mailbox> <session ID> <max_recent_msgs> [i][o] */
+	/* <username> <mailbox> <session ID> <max_recent_msgs> [i][o][b] */
 	if (str_array_length(args) != 5 ||
 	    str_to_uint(args[3], &max_recent_msgs) < 0 || args[4][0] == '\0') {
 		e_error(conn->conn.event, "Invalid input from master: %s",
@@ -327,11 +355,19 @@ master_connection_input_args(struct connection *_conn, const char *const *args)
 	const char *session_id = args[2];
 	const char *what = args[4];
 
+	struct indexer_status status = { .state = INDEXER_STATE_COMPLETED };
 	ret = master_connection_cmd_index(conn, username, mailbox, session_id,
-					  max_recent_msgs, what);
-
-	const char *str = t_strdup_printf("%d\n",
-		ret < 0 ? INDEXER_STATE_FAILED: INDEXER_STATE_COMPLETED);
+					  max_recent_msgs, what, &status);
+
+	const char *str;
+	if (ret < 0)
+		str = t_strdup_printf("%d\n", INDEXER_STATE_FAILED);
+	else if (status.progress < status.total) {
+		/* stopped before finishing */
+		str = t_strdup_printf("%d\t%u\t%u\n", INDEXER_STATE_COMPLETED,
+				      status.progress, status.total);
+	} else
+		str = t_strdup_printf("%d\n", INDEXER_STATE_COMPLETED);
 	o_stream_nsend_str(conn->conn.output, str);
 	return ret;
 }
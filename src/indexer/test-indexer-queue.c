@@ -1,6 +1,7 @@
 /* Copyright (c) 2022 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "array.h"
 #include "test-common.h"
 #include "indexer-queue.h"
 
@@ -133,6 +134,55 @@ static void test_indexer_queue_reindex(void)
 	test_end();
 }
 
+static void test_indexer_queue_requeue(void)
+{
+	struct indexer_queue *queue;
+	struct indexer_request *request;
+	int ctx1, ctx2;
+
+	test_begin("indexer queue requeue");
+	queue = indexer_queue_init(indexer_queue_status_callback);
+
+	indexer_queue_append(queue, TRUE, "user1", "mailbox1", "session1", 0, &ctx1);
+	indexer_queue_append(queue, TRUE, "user2", "mailbox2", "session2", 0, NULL);
+
+	request = indexer_queue_request_peek(queue);
+	test_assert_strcmp(request->mailbox, "mailbox1");
+	test_assert(!request->interactive);
+
+	/* stop working on the request before it's finished */
+	indexer_queue_request_remove(queue);
+	indexer_queue_request_work(request);
+	indexer_queue_append(queue, TRUE, "user1", "mailbox1", "session1", 0, &ctx2);
+	indexer_queue_request_requeue(queue, &request);
+
+	/* it continues after the other requests, with all its contexts */
+	request = indexer_queue_request_peek(queue);
+	test_assert_strcmp(request->mailbox, "mailbox2");
+	indexer_queue_request_remove(queue);
+	indexer_queue_request_finish(queue, &request, INDEXER_STATE_COMPLETED);
+
+	request = indexer_queue_request_peek(queue);
+	test_assert_strcmp(request->mailbox, "mailbox1");
+	test_assert(!request->working);
+	test_assert(array_count(&request->contexts) == 2);
+
+	/* prepending makes the request interactive */
+	indexer_queue_append(queue, FALSE, "user1", "mailbox1", "session1", 0, NULL);
+	test_assert(request->interactive);
+
+	/* requeueing a cancelled request finishes it */
+	indexer_queue_request_remove(queue);
+	indexer_queue_request_work(request);
+	indexer_queue_cancel(queue, "user1", NULL);
+	indexer_queue_request_requeue(queue, &request);
+	test_assert(indexer_queue_request_peek(queue) == NULL);
+	test_assert(indexer_queue_count(queue) == 0);
+
+	indexer_queue_deinit(&queue);
+	test_end();
+}
+
 static void test_indexer_queue_cancel(void)
 {
 	struct indexer_queue *queue;
@@ -264,6 +314,7 @@ int main(void)
 		test_indexer_queue,
 		test_indexer_queue_repeated_prepend,
 		test_indexer_queue_reindex,
+		test_indexer_queue_requeue,
 		test_indexer_queue_cancel,
 		test_indexer_queue_iter,
 		NULL
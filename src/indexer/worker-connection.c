@@ -155,6 +155,8 @@ worker_connection_send_request(struct worker_connection *worker,
 		switch (request->type) {
 		case INDEXER_REQUEST_TYPE_INDEX:
 			str_append_c(str, 'i');
+			if (!request->interactive)
+				str_append_c(str, 'b');
 			break;
 		case INDEXER_REQUEST_TYPE_OPTIMIZE:
 			str_append_c(str, 'o');
@@ -223,6 +225,26 @@ unsigned int worker_connections_get_count(void)
 	return worker_connections->connections_count;
 }
 
+unsigned int worker_connections_get_background_count(void)
+{
+	struct connection *conn;
+	unsigned int count = 0;
+
+	for (conn = worker_connections->connections; conn != NULL; conn = conn->next) {
+		struct worker_connection *worker =
+			container_of(conn, struct worker_connection, conn);
+
+		if (worker->request != NULL && !worker->request->interactive)
+			count++;
+	}
+	return count;
+}
+
+unsigned int worker_connections_get_process_limit(void)
+{
+	return worker_last_process_limit;
+}
+
 struct worker_connection *worker_connections_find_user(const char *username)
 {
 	struct connection *conn;
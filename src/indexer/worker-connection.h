@@ -18,6 +18,11 @@ int worker_connection_try_create(const char *socket_path,
 				 worker_available_callback_t *avail_callback);
 
 unsigned int worker_connections_get_count(void);
+/* Returns the number of workers indexing non-interactive requests. */
+unsigned int worker_connections_get_background_count(void);
+/* Returns indexer-worker service's process_limit, or 0 if it's not known
+   yet. */
+unsigned int worker_connections_get_process_limit(void);
 struct worker_connection *worker_connections_find_user(const char *username);
 
 void worker_connections_init(void);
@@ -0,0 +1,185 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "buffer.h"
+#include "charset-utf8-private.h"
+
+/* Table-driven conversion for the most commonly seen single-byte charsets.
+   These are common enough in mails that it's worth avoiding iconv() for
+   them. The tables map bytes 0x80..0xff to Unicode code points. 0 means
+   the byte is undefined in the charset. */
+
+struct charset_8bit {
+	const char *const *names;
+	/* NULL = ISO-8859-1, where the code point is the byte value */
+	const uint16_t *high;
+};
+
+static const uint16_t charset_iso_8859_15_high[128] = {
+	0x0080, 0x0081, 0x0082, 0x0083, 0x0084, 0x0085, 0x0086, 0x0087,
+	0x0088, 0x0089, 0x008a, 0x008b, 0x008c, 0x008d, 0x008e, 0x008f,
+	0x0090, 0x0091, 0x0092, 0x0093, 0x0094, 0x0095, 0x0096, 0x0097,
+	0x0098, 0x0099, 0x009a, 0x009b, 0x009c, 0x009d, 0x009e, 0x009f,
+	0x00a0, 0x00a1, 0x00a2, 0x00a3, 0x20ac, 0x00a5, 0x0160, 0x00a7,
+	0x0161, 0x00a9, 0x00aa, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x00af,
+	0x00b0, 0x00b1, 0x00b2, 0x00b3, 0x017d, 0x00b5, 0x00b6, 0x00b7,
+	0x017e, 0x00b9, 0x00ba, 0x00bb, 0x0152, 0x0153, 0x0178, 0x00bf,
+	0x00c0, 0x00c1, 0x00c2, 0x00c3, 0x00c4, 0x00c5, 0x00c6, 0x00c7,
+	0x00c8, 0x00c9, 0x00ca, 0x00cb, 0x00cc, 0x00cd, 0x00ce, 0x00cf,
+	0x00d0, 0x00d1, 0x00d2, 0x00d3, 0x00d4, 0x00d5, 0x00d6, 0x00d7,
+	0x00d8, 0x00d9, 0x00da, 0x00db, 0x00dc, 0x00dd, 0x00de, 0x00df,
+	0x00e0, 0x00e1, 0x00e2, 0x00e3, 0x00e4, 0x00e5, 0x00e6, 0x00e7,
+	0x00e8, 0x00e9, 0x00ea, 0x00eb, 0x00ec, 0x00ed, 0x00ee, 0x00ef,
+	0x00f0, 0x00f1, 0x00f2, 0x00f3, 0x00f4, 0x00f5, 0x00f6, 0x00f7,
+	0x00f8, 0x00f9, 0x00fa, 0x00fb, 0x00fc, 0x00fd, 0x00fe, 0x00ff,
+};
+static const uint16_t charset_windows_1252_high[128] = {
+	0x20ac, 0x0000, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+	0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x0000, 0x017d, 0x0000,
+	0x0000, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+	0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x0000, 0x017e, 0x0178,
+	0x00a0, 0x00a1, 0x00a2, 0x00a3, 0x00a4, 0x00a5, 0x00a6, 0x00a7,
+	0x00a8, 0x00a9, 0x00aa, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x00af,
+	0x00b0, 0x00b1, 0x00b2, 0x00b3, 0x00b4, 0x00b5, 0x00b6, 0x00b7,
+	0x00b8, 0x00b9, 0x00ba, 0x00bb, 0x00bc, 0x00bd, 0x00be, 0x00bf,
+	0x00c0, 0x00c1, 0x00c2, 0x00c3, 0x00c4, 0x00c5, 0x00c6, 0x00c7,
+	0x00c8, 0x00c9, 0x00ca, 0x00cb, 0x00cc, 0x00cd, 0x00ce, 0x00cf,
+	0x00d0, 0x00d1, 0x00d2, 0x00d3, 0x00d4, 0x00d5, 0x00d6, 0x00d7,
+	0x00d8, 0x00d9, 0x00da, 0x00db, 0x00dc, 0x00dd, 0x00de, 0x00df,
+	0x00e0, 0x00e1, 0x00e2, 0x00e3, 0x00e4, 0x00e5, 0x00e6, 0x00e7,
+	0x00e8, 0x00e9, 0x00ea, 0x00eb, 0x00ec, 0x00ed, 0x00ee, 0x00ef,
+	0x00f0, 0x00f1, 0x00f2, 0x00f3, 0x00f4, 0x00f5, 0x00f6, 0x00f7,
+	0x00f8, 0x00f9, 0x00fa, 0x00fb, 0x00fc, 0x00fd, 0x00fe, 0x00ff,
+};
+static const uint16_t charset_koi8_r_high[128] = {
+	0x2500, 0x2502, 0x250c, 0x2510, 0x2514, 0x2518, 0x251c, 0x2524,
+	0x252c, 0x2534, 0x253c, 0x2580, 0x2584, 0x2588, 0x258c, 0x2590,
+	0x2591, 0x2592, 0x2593, 0x2320, 0x25a0, 0x2219, 0x221a, 0x2248,
+	0x2264, 0x2265, 0x00a0, 0x2321, 0x00b0, 0x00b2, 0x00b7, 0x00f7,
+	0x2550, 0x2551, 0x2552, 0x0451, 0x2553, 0x2554, 0x2555, 0x2556,
+	0x2557, 0x2558, 0x2559, 0x255a, 0x255b, 0x255c, 0x255d, 0x255e,
+	0x255f, 0x2560, 0x2561, 0x0401, 0x2562, 0x2563, 0x2564, 0x2565,
+	0x2566, 0x2567, 0x2568, 0x2569, 0x256a, 0x256b, 0x256c, 0x00a9,
+	0x044e, 0x0430, 0x0431, 0x0446, 0x0434, 0x0435, 0x0444, 0x0433,
+	0x0445, 0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e,
+	0x043f, 0x044f, 0x0440, 0x0441, 0x0442, 0x0443, 0x0436, 0x0432,
+	0x044c, 0x044b, 0x0437, 0x0448, 0x044d, 0x0449, 0x0447, 0x044a,
+	0x042e, 0x0410, 0x0411, 0x0426, 0x0414, 0x0415, 0x0424, 0x0413,
+	0x0425, 0x0418, 0x0419, 0x041a, 0x041b, 0x041c, 0x041d, 0x041e,
+	0x041f, 0x042f, 0x0420, 0x0421, 0x0422, 0x0423, 0x0416, 0x0412,
+	0x042c, 0x042b, 0x0417, 0x0428, 0x042d, 0x0429, 0x0427, 0x042a,
+};
+
+static const char *const charset_iso_8859_1_names[] = {
+	"ISO-8859-1", "ISO8859-1", "ISO_8859-1", "latin1", NULL
+};
+static const char *const charset_iso_8859_15_names[] = {
+	"ISO-8859-15", "ISO8859-15", "ISO_8859-15", "latin9", NULL
+};
+static const char *const charset_windows_1252_names[] = {
+	"windows-1252", "cp1252", NULL
+};
+static const char *const charset_koi8_r_names[] = {
+	"KOI8-R", NULL
+};
+
+static const struct charset_8bit charsets_8bit[] = {
+	{ charset_iso_8859_1_names, NULL },
+	{ charset_iso_8859_15_names, charset_iso_8859_15_high },
+	{ charset_windows_1252_names, charset_windows_1252_high },
+	{ charset_koi8_r_names, charset_koi8_r_high },
+};
+
+const struct charset_8bit *charset_8bit_find(const char *charset)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < N_ELEMENTS(charsets_8bit); i++) {
+		for (j = 0; charsets_8bit[i].names[j] != NULL; j++) {
+			if (strcasecmp(charsets_8bit[i].names[j], charset) == 0)
+				return &charsets_8bit[i];
+		}
+	}
+	return NULL;
+}
+
+static size_t ascii_prefix_len(const unsigned char *src, size_t size)
+{
+	size_t i = 0;
+
+	/* check a word at a time for 8bit bytes */
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t word;
+
+		memcpy(&word, src + i, sizeof(word));
+		if ((word & 0x8080808080808080ULL) != 0)
+			break;
+	}
+	for (; i < size; i++) {
+		if (src[i] >= 0x80)
+			break;
+	}
+	return i;
+}
+
+static enum charset_result
+charset_8bit_append(const struct charset_8bit *cs,
+		    const unsigned char *src, size_t size, buffer_t *dest)
+{
+	enum charset_result result = CHARSET_RET_OK;
+	size_t i, prev_invalid_pos = SIZE_MAX;
+	unichar_t chr;
+
+	for (i = 0; i < size; i++) {
+		size_t len = ascii_prefix_len(src + i, size - i);
+
+		buffer_append(dest, src + i, len);
+		i += len;
+		if (i == size)
+			break;
+
+		chr = cs->high == NULL ? src[i] : cs->high[src[i] - 0x80];
+		if (chr != 0)
+			uni_ucs4_to_utf8_c(chr, dest);
+		else {
+			/* same as with iconv: a sequence of invalid bytes
+			   is replaced with a single replacement char */
+			if (prev_invalid_pos != dest->used) {
+				buffer_append(dest, UNICODE_REPLACEMENT_CHAR_UTF8,
+					      strlen(UNICODE_REPLACEMENT_CHAR_UTF8));
+				prev_invalid_pos = dest->used;
+			}
+			result = CHARSET_RET_INVALID_INPUT;
+		}
+	}
+	return result;
+}
+
+enum charset_result
+charset_8bit_to_utf8(const struct charset_8bit *cs,
+		     normalizer_func_t *normalizer,
+		     const unsigned char *src, size_t *src_size,
+		     buffer_t *dest)
+{
+	enum charset_result result = CHARSET_RET_OK;
+	unsigned char tmpbuf[8192];
+	buffer_t tmp;
+	size_t pos, size;
+
+	/* single-byte charsets never have incomplete input, so *src_size
+	   stays as it is */
+	if (normalizer == NULL)
+		return charset_8bit_append(cs, src, *src_size, dest);
+
+	/* each input byte becomes at most 3 bytes of UTF-8 */
+	for (pos = 0; pos < *src_size; pos += size) {
+		size = I_MIN(*src_size - pos, sizeof(tmpbuf) / 3);
+		buffer_create_from_data(&tmp, tmpbuf, sizeof(tmpbuf));
+		if (charset_8bit_append(cs, src + pos, size, &tmp) !=
+		    CHARSET_RET_OK)
+			result = CHARSET_RET_INVALID_INPUT;
+		if (normalizer(tmp.data, tmp.used, dest) < 0)
+			result = CHARSET_RET_INVALID_INPUT;
+	}
+	return result;
+}
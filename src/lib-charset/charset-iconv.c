@@ -11,6 +11,7 @@
 
 struct charset_translation {
 	iconv_t cd;
+	const struct charset_8bit *charset_8bit;
 	normalizer_func_t *normalizer;
 };
 
@@ -19,10 +20,13 @@ iconv_charset_to_utf8_begin(const char *charset, normalizer_func_t *normalizer,
 			    struct charset_translation **t_r)
 {
 	struct charset_translation *t;
+	const struct charset_8bit *charset_8bit = NULL;
 	iconv_t cd;
 
 	if (charset_is_utf8(charset))
 		cd = (iconv_t)-1;
+	else if ((charset_8bit = charset_8bit_find(charset)) != NULL)
+		cd = (iconv_t)-1;
 	else {
 		if (strcmp(charset, "UTF-8//TEST") == 0)
 			charset = "UTF-8";
@@ -33,6 +37,7 @@ iconv_charset_to_utf8_begin(const char *charset, normalizer_func_t *normalizer,
 
 	t = i_new(struct charset_translation, 1);
 	t->cd = cd;
+	t->charset_8bit = charset_8bit;
 	t->normalizer = normalizer;
 	*t_r = t;
 	return 0;
@@ -109,6 +114,11 @@ iconv_charset_to_utf8(struct charset_translation *t,
 	size_t prev_invalid_pos = SIZE_MAX;
 	bool ret;
 
+	if (t->charset_8bit != NULL) {
+		return charset_8bit_to_utf8(t->charset_8bit, t->normalizer,
+					    src, src_size, dest);
+	}
+
 	for (pos = 0;;) {
 		i_assert(pos <= *src_size);
 		size = *src_size - pos;
@@ -18,4 +18,13 @@ struct charset_utf8_vfuncs {
 extern const struct charset_utf8_vfuncs charset_utf8only;
 extern const struct charset_utf8_vfuncs charset_iconv;
 
+/* Returns the built-in conversion table for the single-byte charset, or NULL
+   if it's not one of them. */
+const struct charset_8bit *charset_8bit_find(const char *charset);
+enum charset_result
+charset_8bit_to_utf8(const struct charset_8bit *cs,
+		     normalizer_func_t *normalizer,
+		     const unsigned char *src, size_t *src_size,
+		     buffer_t *dest);
+
 #endif
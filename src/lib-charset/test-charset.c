@@ -60,6 +60,36 @@ static void test_charset_utf8(void)
 	test_end();
 }
 
+static void test_charset_8bit(void)
+{
+	static const struct {
+		const char *charset;
+		const char *input;
+		const char *output;
+		enum charset_result result;
+	} tests[] = {
+		{ "ISO-8859-1", "p\xE4\x80\xFF", "p\xC3\xA4\xC2\x80\xC3\xBF", CHARSET_RET_OK },
+		{ "latin1", "abcdefghijklmnop\xE4q", "abcdefghijklmnop\xC3\xA4q", CHARSET_RET_OK },
+		{ "ISO-8859-15", "\xA4\xBC", "\xE2\x82\xAC\xC5\x92", CHARSET_RET_OK },
+		{ "windows-1252", "\x80 \x93x\x94", "\xE2\x82\xAC \xE2\x80\x9Cx\xE2\x80\x9D", CHARSET_RET_OK },
+		{ "cp1252", "a\x81\x8D""b\x90", "a"UNICODE_REPLACEMENT_CHAR_UTF8"b"UNICODE_REPLACEMENT_CHAR_UTF8, CHARSET_RET_INVALID_INPUT },
+		{ "KOI8-R", "\xF0\xD2\xC9\xD7\xC5\xD4!", "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82!", CHARSET_RET_OK },
+	};
+	string_t *str = t_str_new(128);
+	enum charset_result result;
+	unsigned int i;
+
+	test_begin("charset 8bit");
+	for (i = 0; i < N_ELEMENTS(tests); i++) {
+		str_truncate(str, 0);
+		test_assert_idx(charset_to_utf8_str(tests[i].charset, NULL,
+						    tests[i].input, str, &result) == 0, i);
+		test_assert_idx(strcmp(tests[i].output, str_c(str)) == 0, i);
+		test_assert_idx(result == tests[i].result, i);
+	}
+	test_end();
+}
+
 #ifdef HAVE_ICONV
 static void test_charset_iconv(void)
 {
@@ -215,6 +245,7 @@ int main(int argc, char *argv[])
 	static void (*const test_functions[])(void) = {
 		test_charset_is_utf8,
 		test_charset_utf8,
+		test_charset_8bit,
 #ifdef HAVE_ICONV
 		test_charset_iconv,
 		test_charset_iconv_crashes,
@@ -0,0 +1,203 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "iostream-zstd-dict.h"
+
+#ifdef HAVE_ZSTD
+#  include "zstd.h"
+#  include "zstd_errors.h"
+#  include "iostream-zstd-private.h"
+#endif
+
+#ifdef HAVE_ZSTD_DICT
+
+#include "array.h"
+#include "read-full.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define ZSTD_DICT_MAX_SIZE (16*1024*1024)
+
+struct zstd_dict {
+	unsigned int id;
+	char *path;
+	void *data;
+	size_t size;
+
+	ZSTD_DDict *ddict;
+	/* created lazily on the first compression */
+	ZSTD_CDict *cdict;
+	int cdict_level;
+};
+
+static ARRAY(struct zstd_dict) zstd_dicts = ARRAY_INIT;
+
+static void zstd_dicts_free(void)
+{
+	struct zstd_dict *dict;
+
+	array_foreach_modifiable(&zstd_dicts, dict) {
+		if (dict->cdict != NULL)
+			(void)ZSTD_freeCDict(dict->cdict);
+		(void)ZSTD_freeDDict(dict->ddict);
+		i_free(dict->data);
+		i_free(dict->path);
+	}
+	array_free(&zstd_dicts);
+}
+
+static struct zstd_dict *zstd_dict_lookup(unsigned int id)
+{
+	struct zstd_dict *dict;
+
+	if (!array_is_created(&zstd_dicts))
+		return NULL;
+	array_foreach_modifiable(&zstd_dicts, dict) {
+		if (dict->id == id)
+			return dict;
+	}
+	return NULL;
+}
+
+static int
+zstd_dict_read(const char *path, void **data_r, size_t *size_r,
+	       const char **error_r)
+{
+	struct stat st;
+	void *data;
+	int fd, ret;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		*error_r = t_strdup_printf("open(%s) failed: %m", path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		*error_r = t_strdup_printf("fstat(%s) failed: %m", path);
+		i_close_fd(&fd);
+		return -1;
+	}
+	if (st.st_size == 0 || st.st_size > ZSTD_DICT_MAX_SIZE) {
+		*error_r = t_strdup_printf("%s: Invalid dictionary size %"
+					   PRIuUOFF_T, path,
+					   (uoff_t)st.st_size);
+		i_close_fd(&fd);
+		return -1;
+	}
+	data = i_malloc(st.st_size);
+	ret = read_full(fd, data, st.st_size);
+	if (ret <= 0) {
+		*error_r = ret < 0 ?
+			t_strdup_printf("read(%s) failed: %m", path) :
+			t_strdup_printf("read(%s) failed: File was truncated",
+					path);
+		i_free(data);
+		i_close_fd(&fd);
+		return -1;
+	}
+	i_close_fd(&fd);
+	*data_r = data;
+	*size_r = st.st_size;
+	return 0;
+}
+
+int zstd_dict_load(const char *path, unsigned int *dict_id_r,
+		   const char **error_r)
+{
+	struct zstd_dict *dict, *old_dict;
+	void *data;
+	size_t size;
+	unsigned int id;
+
+	if (array_is_created(&zstd_dicts)) {
+		array_foreach_modifiable(&zstd_dicts, dict) {
+			if (strcmp(dict->path, path) == 0) {
+				*dict_id_r = dict->id;
+				return 0;
+			}
+		}
+	}
+
+	zstd_version_check();
+	if (zstd_dict_read(path, &data, &size, error_r) < 0)
+		return -1;
+	id = ZSTD_getDictID_fromDict(data, size);
+	if (id == 0) {
+		/* raw content dictionaries aren't referenced by the frames,
+		   so they couldn't be found when decompressing */
+		*error_r = t_strdup_printf(
+			"%s: Not a zstd dictionary (missing dictionary ID)",
+			path);
+		i_free(data);
+		return -1;
+	}
+	if ((old_dict = zstd_dict_lookup(id)) != NULL) {
+		*error_r = t_strdup_printf(
+			"%s: Dictionary ID %u is already used by %s",
+			path, id, old_dict->path);
+		i_free(data);
+		return -1;
+	}
+
+	if (!array_is_created(&zstd_dicts)) {
+		i_array_init(&zstd_dicts, 4);
+		lib_atexit(zstd_dicts_free);
+	}
+	dict = array_append_space(&zstd_dicts);
+	dict->id = id;
+	dict->path = i_strdup(path);
+	dict->data = data;
+	dict->size = size;
+	dict->ddict = ZSTD_createDDict(data, size);
+	if (dict->ddict == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "zstd: Out of memory");
+	*dict_id_r = id;
+	return 0;
+}
+
+ZSTD_DDict *zstd_dict_get_ddict(unsigned int dict_id)
+{
+	struct zstd_dict *dict = zstd_dict_lookup(dict_id);
+
+	return dict == NULL ? NULL : dict->ddict;
+}
+
+ZSTD_CDict *zstd_dict_get_cdict(unsigned int dict_id, int level)
+{
+	struct zstd_dict *dict = zstd_dict_lookup(dict_id);
+
+	i_assert(dict != NULL);
+	if (dict->cdict != NULL && dict->cdict_level != level) {
+		(void)ZSTD_freeCDict(dict->cdict);
+		dict->cdict = NULL;
+	}
+	if (dict->cdict == NULL) {
+		dict->cdict = ZSTD_createCDict(dict->data, dict->size, level);
+		if (dict->cdict == NULL)
+			i_fatal_status(FATAL_OUTOFMEM, "zstd: Out of memory");
+		dict->cdict_level = level;
+	}
+	return dict->cdict;
+}
+
+#else
+
+int zstd_dict_load(const char *path ATTR_UNUSED,
+		   unsigned int *dict_id_r ATTR_UNUSED, const char **error_r)
+{
+	*error_r = "zstd dictionary support not compiled in "
+		"(requires zstd v1.4.0 or later)";
+	return -1;
+}
+
+struct ostream *
+o_stream_create_zstd_dict(struct ostream *output ATTR_UNUSED,
+			  int level ATTR_UNUSED,
+			  unsigned int dict_id ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+#endif
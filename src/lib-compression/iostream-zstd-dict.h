@@ -0,0 +1,17 @@
+#ifndef IOSTREAM_ZSTD_DICT_H
+#define IOSTREAM_ZSTD_DICT_H
+
+/* Load a zstd dictionary from the given path (e.g. trained with
+   "zstd --train"). The dictionary stays loaded until the process exits, and
+   zstd istreams automatically use it for frames that reference its
+   dictionary ID. Loading the same path again returns the already loaded
+   dictionary. Returns 0 on success, -1 on error. */
+int zstd_dict_load(const char *path, unsigned int *dict_id_r,
+		   const char **error_r);
+/* Create a zstd ostream that compresses using the dictionary returned by
+   zstd_dict_load(). */
+struct ostream *
+o_stream_create_zstd_dict(struct ostream *output, int level,
+			  unsigned int dict_id);
+
+#endif
@@ -32,4 +32,16 @@ static inline void zstd_version_check(void)
 				  ZSTD_VERSION_NUMBER, ZSTD_versionNumber());
 }
 
+/* ZSTD_DCtx_refDDict() and ZSTD_CCtx_refCDict() became stable in v1.4.0 */
+#if ZSTD_VERSION_NUMBER >= 10400
+#  define HAVE_ZSTD_DICT
+#endif
+
+/* Returns the dictionary loaded by zstd_dict_load(), or NULL if no such
+   dictionary is loaded. */
+ZSTD_DDict *zstd_dict_get_ddict(unsigned int dict_id);
+/* Returns the compression dictionary for the loaded dictionary with the
+   given compression level. */
+ZSTD_CDict *zstd_dict_get_cdict(unsigned int dict_id, int level);
+
 #endif
@@ -41,6 +41,7 @@ struct zstd_istream {
 	buffer_t *data_buffer;
 
 	bool hdr_read:1;
+	bool dict_checked:1;
 	bool marked:1;
 	bool zs_closed:1;
 	/* is there data remaining */
@@ -63,6 +64,7 @@ static void i_stream_zstd_init(struct zstd_istream *zstream)
 	else
 		buffer_set_used_size(zstream->data_buffer, 0);
 	zstream->zs_closed = FALSE;
+	zstream->dict_checked = FALSE;
 }
 
 static void i_stream_zstd_deinit(struct zstd_istream *zstream, bool reuse_buffers)
@@ -115,6 +117,40 @@ static void i_stream_zstd_read_error(struct zstd_istream *zstream, size_t err)
 			    i_stream_get_absolute_offset(&zstream->istream.istream));
 }
 
+#ifdef HAVE_ZSTD_DICT
+static int i_stream_zstd_init_dict(struct zstd_istream *zstream)
+{
+	ZSTD_DDict *ddict;
+	unsigned int dict_id;
+	size_t ret;
+
+	/* The frame header is at most 18 bytes, which is practically always
+	   available in the first read. If it isn't, the dictionary ID can't
+	   be found and ZSTD_decompressStream() fails with
+	   "Dictionary mismatch". */
+	zstream->dict_checked = TRUE;
+	dict_id = ZSTD_getDictID_fromFrame(zstream->input.src,
+					   zstream->input.size);
+	if (dict_id == 0)
+		return 0;
+
+	ddict = zstd_dict_get_ddict(dict_id);
+	if (ddict == NULL) {
+		zstream->istream.istream.stream_errno = EINVAL;
+		io_stream_set_error(&zstream->istream.iostream,
+			"zstd.read(%s): Dictionary ID %u isn't loaded",
+			i_stream_get_name(&zstream->istream.istream), dict_id);
+		return -1;
+	}
+	ret = ZSTD_DCtx_refDDict(zstream->dstream, ddict);
+	if (ZSTD_isError(ret) != 0) {
+		i_stream_zstd_read_error(zstream, ret);
+		return -1;
+	}
+	return 0;
+}
+#endif
+
 static ssize_t i_stream_zstd_read(struct istream_private *stream)
 {
 	struct zstd_istream *zstream =
@@ -170,6 +206,10 @@ static ssize_t i_stream_zstd_read(struct istream_private *stream)
 
 		i_assert(zstream->input.size > 0);
 		i_assert(zstream->data_buffer->used == 0);
+#ifdef HAVE_ZSTD_DICT
+		if (!zstream->dict_checked && i_stream_zstd_init_dict(zstream) < 0)
+			return -1;
+#endif
 		zstream->output.dst = buffer_append_space_unsafe(zstream->data_buffer,
 								 ZSTD_DStreamOutSize());
 		zstream->output.pos = 0;
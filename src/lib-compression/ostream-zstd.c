@@ -7,6 +7,7 @@
 #include "ostream.h"
 #include "ostream-private.h"
 #include "ostream-zlib.h"
+#include "iostream-zstd-dict.h"
 
 #include "zstd.h"
 #include "zstd_errors.h"
@@ -210,8 +211,9 @@ static void o_stream_zstd_close(struct iostream_private *stream,
 		o_stream_close(zstream->ostream.parent);
 }
 
-struct ostream *
-o_stream_create_zstd(struct ostream *output, int level)
+static struct ostream *
+o_stream_create_zstd_full(struct ostream *output, int level,
+			  unsigned int dict_id)
 {
 	struct zstd_ostream *zstream;
 	size_t ret;
@@ -229,6 +231,14 @@ o_stream_create_zstd(struct ostream *output, int level)
 	if (zstream->cstream == NULL)
 		i_fatal_status(FATAL_OUTOFMEM, "zstd: Out of memory");
 	ret = ZSTD_initCStream(zstream->cstream, level);
+#ifdef HAVE_ZSTD_DICT
+	if (dict_id != 0 && ZSTD_isError(ret) == 0) {
+		ret = ZSTD_CCtx_refCDict(zstream->cstream,
+					 zstd_dict_get_cdict(dict_id, level));
+	}
+#else
+	i_assert(dict_id == 0);
+#endif
 	if (ZSTD_isError(ret) != 0)
 		o_stream_zstd_write_error(zstream, ret);
 	else {
@@ -240,4 +250,20 @@ o_stream_create_zstd(struct ostream *output, int level)
 			       o_stream_get_fd(output));
 }
 
+struct ostream *
+o_stream_create_zstd(struct ostream *output, int level)
+{
+	return o_stream_create_zstd_full(output, level, 0);
+}
+
+#ifdef HAVE_ZSTD_DICT
+struct ostream *
+o_stream_create_zstd_dict(struct ostream *output, int level,
+			  unsigned int dict_id)
+{
+	i_assert(dict_id != 0);
+	return o_stream_create_zstd_full(output, level, dict_id);
+}
+#endif
+
 #endif
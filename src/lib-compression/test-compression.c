@@ -10,6 +10,7 @@
 #include "test-common.h"
 #include "compression.h"
 #include "iostream-lz4.h"
+#include "iostream-zstd-dict.h"
 
 #include "hex-binary.h"
 
@@ -1097,6 +1098,28 @@ static void test_compression_ext(void)
 	test_end();
 }
 
+static void test_zstd_dict_load_errors(void)
+{
+	const char *path = ".test-compression-dict";
+	unsigned int dict_id;
+	const char *error;
+	int fd;
+
+	test_begin("zstd dictionary load errors");
+	test_assert(zstd_dict_load(path, &dict_id, &error) < 0);
+
+	/* raw content without a dictionary header isn't accepted */
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		i_fatal("creat(%s) failed: %m", path);
+	if (write(fd, "raw content dictionary", 22) != 22)
+		i_fatal("write(%s) failed: %m", path);
+	i_close_fd(&fd);
+	test_assert(zstd_dict_load(path, &dict_id, &error) < 0);
+	i_unlink(path);
+	test_end();
+}
+
 int main(int argc, char *argv[])
 {
 	static void (*const test_functions[])(void) = {
@@ -1108,6 +1131,7 @@ int main(int argc, char *argv[])
 		test_gz_large_header,
 		test_lz4_small_header,
 		test_compression_ext,
+		test_zstd_dict_load_errors,
 		NULL
 	};
 	if (argc == 2) {
@@ -5,6 +5,8 @@ static const unsigned char IOSTREAM_CRYPT_MAGIC[] =
 	{'C','R','Y','P','T','E','D','\x03','\x07'};
 #define IOSTREAM_CRYPT_VERSION 2
 #define IOSTREAM_TAG_SIZE 16
+/* number of dcrypt_iterated_hash() rounds for the v2 key data hash */
+#define IOSTREAM_KEY_HASH_ROUNDS 2048
 
 enum io_stream_encrypt_flags {
 	IO_STREAM_ENC_INTEGRITY_HMAC = 0x1,
@@ -946,6 +946,46 @@ dcrypt_openssl_pbkdf2(const unsigned char *password, size_t password_len,
 	return TRUE;
 }
 
+static bool
+dcrypt_openssl_iterated_hash(const char *algorithm,
+			     const unsigned char *data, size_t data_len,
+			     unsigned int rounds, buffer_t *result,
+			     const char **error_r)
+{
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int i, digest_len;
+	uint32_t i_msb;
+	bool ret = TRUE;
+
+	const EVP_MD *md = EVP_get_digestbyname(algorithm);
+	if (md == NULL) {
+		*error_r = t_strdup_printf("Invalid digest %s", algorithm);
+		return FALSE;
+	}
+	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+	if (ctx == NULL)
+		return dcrypt_openssl_error(error_r);
+
+	if (EVP_DigestInit_ex(ctx, md, NULL) != 1 ||
+	    EVP_DigestUpdate(ctx, data, data_len) != 1 ||
+	    EVP_DigestFinal_ex(ctx, digest, &digest_len) != 1)
+		ret = FALSE;
+	for (i = 1; i <= rounds && ret; i++) {
+		i_msb = cpu32_to_be(i);
+		if (EVP_DigestInit_ex(ctx, md, NULL) != 1 ||
+		    EVP_DigestUpdate(ctx, digest, digest_len) != 1 ||
+		    EVP_DigestUpdate(ctx, &i_msb, sizeof(i_msb)) != 1 ||
+		    EVP_DigestFinal_ex(ctx, digest, &digest_len) != 1)
+			ret = FALSE;
+	}
+	EVP_MD_CTX_free(ctx);
+	if (!ret)
+		return dcrypt_openssl_error(error_r);
+	buffer_append(result, digest, digest_len);
+	safe_memset(digest, 0, sizeof(digest));
+	return TRUE;
+}
+
 static bool
 dcrypt_openssl_generate_keypair(struct dcrypt_keypair *pair_r,
 				enum dcrypt_key_type kind, unsigned int bits,
@@ -3812,6 +3852,7 @@ static struct dcrypt_vfs dcrypt_openssl_vfs = {
 	.ecdh_derive_secret_local = dcrypt_openssl_ecdh_derive_secret_local,
 	.ecdh_derive_secret_peer = dcrypt_openssl_ecdh_derive_secret_peer,
 	.pbkdf2 = dcrypt_openssl_pbkdf2,
+	.iterated_hash = dcrypt_openssl_iterated_hash,
 	.generate_keypair = dcrypt_openssl_generate_keypair,
 	.load_private_key = dcrypt_openssl_load_private_key,
 	.load_public_key = dcrypt_openssl_load_public_key,
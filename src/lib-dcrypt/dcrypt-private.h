@@ -196,6 +196,10 @@ struct dcrypt_vfs {
 	bool (*ecdh_derive_secret)(struct dcrypt_private_key *priv_key,
 				   struct dcrypt_public_key *pub_key,
 				   buffer_t *shared_secret, const char **error_r);
+	bool (*iterated_hash)(const char *algorithm,
+			      const unsigned char *data, size_t data_len,
+			      unsigned int rounds, buffer_t *result,
+			      const char **error_r);
 };
 
 void dcrypt_set_vfs(struct dcrypt_vfs *vfs);
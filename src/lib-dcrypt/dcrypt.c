@@ -1,6 +1,8 @@
 /* Copyright (c) 2016-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "buffer.h"
+#include "hash-method.h"
 #include "module-dir.h"
 #include "dcrypt.h"
 #include "istream.h"
@@ -286,6 +288,52 @@ bool dcrypt_pbkdf2(const unsigned char *password, size_t password_len,
 				  hash, rounds, result, result_len, error_r);
 }
 
+static bool
+dcrypt_iterated_hash_fallback(const char *algorithm,
+			      const unsigned char *data, size_t data_len,
+			      unsigned int rounds, buffer_t *result,
+			      const char **error_r)
+{
+	const struct hash_method *hash =
+		hash_method_lookup(t_str_lcase(algorithm));
+	unsigned int i;
+
+	if (hash == NULL) {
+		*error_r = t_strdup_printf("Invalid digest %s", algorithm);
+		return FALSE;
+	}
+	unsigned char hctx[hash->context_size];
+	unsigned char hres[hash->digest_size];
+	hash->init(hctx);
+	hash->loop(hctx, data, data_len);
+	hash->result(hctx, hres);
+
+	for (i = 1; i <= rounds; i++) {
+		uint32_t i_msb = cpu32_to_be(i);
+
+		hash->init(hctx);
+		hash->loop(hctx, hres, sizeof(hres));
+		hash->loop(hctx, &i_msb, sizeof(i_msb));
+		hash->result(hctx, hres);
+	}
+	buffer_append(result, hres, sizeof(hres));
+	return TRUE;
+}
+
+bool dcrypt_iterated_hash(const char *algorithm,
+			  const unsigned char *data, size_t data_len,
+			  unsigned int rounds, buffer_t *result,
+			  const char **error_r)
+{
+	i_assert(dcrypt_vfs != NULL);
+	if (dcrypt_vfs->iterated_hash == NULL) {
+		return dcrypt_iterated_hash_fallback(algorithm, data, data_len,
+						     rounds, result, error_r);
+	}
+	return dcrypt_vfs->iterated_hash(algorithm, data, data_len, rounds,
+					 result, error_r);
+}
+
 bool dcrypt_keypair_generate(struct dcrypt_keypair *pair_r,
 			     enum dcrypt_key_type kind, unsigned int bits,
 			     const char *curve, const char **error_r)
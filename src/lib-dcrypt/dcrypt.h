@@ -265,6 +265,16 @@ bool dcrypt_pbkdf2(const unsigned char *password, size_t password_len,
 		   buffer_t *result, unsigned int result_len,
 		   const char **error_r);
 
+/**
+ * Calculate hash(data), and then rounds times
+ * hash(previous result || 32bit big endian round number). This is used for
+ * verifying the per-stream keys of encrypted streams.
+ */
+bool dcrypt_iterated_hash(const char *algorithm,
+			  const unsigned char *data, size_t data_len,
+			  unsigned int rounds, buffer_t *result,
+			  const char **error_r);
+
 bool dcrypt_keypair_generate(struct dcrypt_keypair *pair_r,
 			     enum dcrypt_key_type kind, unsigned int bits,
 			     const char *curve, const char **error_r);
@@ -528,31 +528,17 @@ i_stream_decrypt_key(struct decrypt_istream *stream, const char *malg,
 	}
 
 	/* make sure we were able to decrypt the encrypted key correctly */
-	const struct hash_method *hash = hash_method_lookup(t_str_lcase(malg));
-	if (hash == NULL) {
+	buffer_t *hres = t_buffer_create(64);
+	if (!dcrypt_iterated_hash(malg, key->data, key->used,
+				  IOSTREAM_KEY_HASH_ROUNDS, hres, &error)) {
 		safe_memset(buffer_get_modifiable_data(key, 0), 0, key->used);
 		io_stream_set_error(&stream->istream.iostream,
-				    "Decryption error: "
-				     "unsupported hash algorithm: %s", malg);
+				    "Decryption error: %s", error);
 		return -1;
 	}
-	unsigned char hctx[hash->context_size];
-	unsigned char hres[hash->digest_size];
-	hash->init(hctx);
-	hash->loop(hctx, key->data, key->used);
-	hash->result(hctx, hres);
-
-	for(int i = 1; i < 2049; i++) {
-		uint32_t i_msb = cpu32_to_be(i);
-
-		hash->init(hctx);
-		hash->loop(hctx, hres, sizeof(hres));
-		hash->loop(hctx, &i_msb, sizeof(i_msb));
-		hash->result(hctx, hres);
-	}
 
 	/* do the comparison */
-	if (memcmp(ekhash, hres, I_MIN(ekhash_len, sizeof(hres))) != 0) {
+	if (memcmp(ekhash, hres->data, I_MIN(ekhash_len, hres->used)) != 0) {
 		safe_memset(buffer_get_modifiable_data(key, 0), 0, key->used);
 		io_stream_set_error(&stream->istream.iostream,
 				    "Decryption error: "
@@ -30,6 +30,9 @@
 
 #define IO_STREAM_ENCRYPT_SEED_SIZE 32
 #define IO_STREAM_ENCRYPT_ROUNDS 2048
+/* Encrypt this much data with a single cipher update. AES-GCM is fast enough
+   that the per-call overhead matters with small chunks. */
+#define IO_STREAM_ENCRYPT_CHUNK_SIZE (64*1024)
 
 struct encrypt_ostream {
 	struct ostream_private ostream;
@@ -46,6 +49,8 @@ struct encrypt_ostream {
 	buffer_t *cipher_oid;
 	buffer_t *mac_oid;
 	size_t block_size;
+	/* buffer for encrypted data */
+	buffer_t *ciphertext;
 
 	bool finalized;
 	bool failed;
@@ -425,25 +430,21 @@ o_stream_encrypt_keydata_create_v2(struct encrypt_ostream *stream,
 	}
 
 	/* create hash of the key data */
-	unsigned char hctx[hash->context_size];
-	unsigned char hres[hash->digest_size];
-	hash->init(hctx);
-	hash->loop(hctx, ptr, kl);
-	hash->result(hctx, hres);
-
-	for(int i = 1; i < 2049; i++) {
-		uint32_t i_msb = cpu32_to_be(i);
-
-		hash->init(hctx);
-		hash->loop(hctx, hres, sizeof(hres));
-		hash->loop(hctx, &i_msb, sizeof(i_msb));
-		hash->result(hctx, hres);
+	buffer_t *hres = t_buffer_create(64);
+	if (!dcrypt_iterated_hash(malg, ptr, kl, IOSTREAM_KEY_HASH_ROUNDS,
+				  hres, &error)) {
+		safe_memset(buffer_get_modifiable_data(keydata, 0), 0,
+			    keydata->used);
+		buffer_free(&res);
+		io_stream_set_error(&stream->ostream.iostream,
+				    "Encryption init error: %s", error);
+		return -1;
 	}
 
 	/* store key data hash */
-	val = cpu32_to_be(sizeof(hres));
+	val = cpu32_to_be(hres->used);
 	buffer_append(res, &val, 4);
-	buffer_append(res, hres, sizeof(hres));
+	buffer_append_buf(res, hres, 0, SIZE_MAX);
 
 	/* pick up key data that goes into stream */
 	stream->key_data_len = res->used;
@@ -502,23 +503,22 @@ o_stream_encrypt_sendv(struct ostream_private *stream,
 		}
 	}
 
-	/* buffer for encrypted data */
-	unsigned char ciphertext[IO_BLOCK_SIZE];
-	buffer_t buf;
-	buffer_create_from_data(&buf, ciphertext, sizeof(ciphertext));
+	if (estream->ciphertext == NULL) {
+		estream->ciphertext = buffer_create_dynamic(default_pool,
+			IO_STREAM_ENCRYPT_CHUNK_SIZE + estream->block_size);
+	}
+	buffer_t *buf = estream->ciphertext;
 
-	/* encrypt & send all blocks of data at max ciphertext buffer's
-	   length */
+	/* encrypt & send all data in chunks */
 	for(unsigned int i = 0; i < iov_count; i++) {
 		size_t bl, off = 0, len = iov[i].iov_len;
 		const unsigned char *ptr = iov[i].iov_base;
 		while(len > 0) {
-			buffer_set_used_size(&buf, 0);
-			/* update can emite twice the size of input */
-			bl = I_MIN(sizeof(ciphertext)/2, len);
+			buffer_set_used_size(buf, 0);
+			bl = I_MIN(IO_STREAM_ENCRYPT_CHUNK_SIZE, len);
 
 			if (!dcrypt_ctx_sym_update(estream->ctx_sym, ptr + off,
-						   bl, &buf, &error)) {
+						   bl, buf, &error)) {
 				io_stream_set_error(&stream->iostream,
 						    "Encryption failure: %s",
 						    error);
@@ -528,7 +528,7 @@ o_stream_encrypt_sendv(struct ostream_private *stream,
 				IO_STREAM_ENC_INTEGRITY_HMAC) {
 				/* update mac */
 				if (!dcrypt_ctx_hmac_update(estream->ctx_mac,
-					buf.data, buf.used, &error)) {
+					buf->data, buf->used, &error)) {
 					io_stream_set_error(&stream->iostream,
 						"MAC failure: %s", error);
 					return -1;
@@ -536,7 +536,7 @@ o_stream_encrypt_sendv(struct ostream_private *stream,
 			}
 
 			/* hopefully upstream can accommodate */
-			if (o_stream_encrypt_send(estream, buf.data, buf.used) < 0) {
+			if (o_stream_encrypt_send(estream, buf->data, buf->used) < 0) {
 				return -1;
 			}
 
@@ -654,6 +654,7 @@ o_stream_encrypt_destroy(struct iostream_private *stream)
 		buffer_free(&estream->cipher_oid);
 	if (estream->mac_oid != NULL)
 		buffer_free(&estream->mac_oid);
+	buffer_free(&estream->ciphertext);
 	if (estream->pub != NULL)
 		dcrypt_key_unref_public(&estream->pub);
 	o_stream_unref(&estream->ostream.parent);
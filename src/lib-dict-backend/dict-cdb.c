@@ -4,21 +4,31 @@
 #include "buffer.h"
 
 #ifdef BUILD_CDB
+#include "ioloop.h"
 #include "dict-private.h"
 
 #include <string.h>
 #include <cdb.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #define CDB_WITH_NULL 1
 #define CDB_WITHOUT_NULL 2
 
 struct cdb_dict {
 	struct dict dict;
+	/* The cdb file is mmap()ed, so all the processes share the same
+	   read-only pages. */
 	struct cdb cdb;
 	char *path;
 	int fd, flag;
+
+	/* Identifies the currently opened file. The file is reopened when
+	   it gets replaced with a new one. */
+	ino_t ino;
+	dev_t dev;
+	time_t last_refresh_check;
 };
 
 struct cdb_dict_iterate_context {
@@ -34,42 +44,107 @@ struct cdb_dict_iterate_context {
 
 static void cdb_dict_deinit(struct dict *_dict);
 
+static int
+cdb_dict_open(const char *path, int *fd_r, struct cdb *cdb_r,
+	      struct stat *st_r, const char **error_r)
+{
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		*error_r = t_strdup_printf("open(%s) failed: %m", path);
+		return -1;
+	}
+	if (fstat(fd, st_r) < 0) {
+		*error_r = t_strdup_printf("fstat(%s) failed: %m", path);
+		i_close_fd(&fd);
+		return -1;
+	}
+
+#ifdef TINYCDB_VERSION
+	if (cdb_init(cdb_r, fd) < 0) {
+		*error_r = t_strdup_printf("cdb_init(%s) failed: %m", path);
+		i_close_fd(&fd);
+		return -1;
+	}
+#else
+	cdb_init(cdb_r, fd);
+#endif
+	*fd_r = fd;
+	return 0;
+}
+
 static int
 cdb_dict_init(struct dict *driver, const char *uri,
 	      const struct dict_settings *set ATTR_UNUSED,
 	      struct dict **dict_r, const char **error_r)
 {
 	struct cdb_dict *dict;
+	struct stat st;
 
 	dict = i_new(struct cdb_dict, 1);
 	dict->dict = *driver;
 	dict->path = i_strdup(uri);
 	dict->flag = CDB_WITH_NULL | CDB_WITHOUT_NULL;
+	dict->fd = -1;
 
 	/* initialize cdb to 0 (unallocated) */
 	i_zero(&dict->cdb);
 
-	dict->fd = open(dict->path, O_RDONLY);
-	if (dict->fd == -1) {
-		*error_r = t_strdup_printf("open(%s) failed: %m", dict->path);
+	if (cdb_dict_open(dict->path, &dict->fd, &dict->cdb, &st,
+			  error_r) < 0) {
 		cdb_dict_deinit(&dict->dict);
 		return -1;
 	}
-
-#ifdef TINYCDB_VERSION
-	if (cdb_init(&dict->cdb, dict->fd) < 0) {
-		*error_r = t_strdup_printf("cdb_init(%s) failed: %m", dict->path);
-		cdb_dict_deinit(&dict->dict);
-		return -1;
-	}
-#else
-	cdb_init(&dict->cdb, dict->fd);
-#endif
+	dict->ino = st.st_ino;
+	dict->dev = st.st_dev;
+	dict->last_refresh_check = ioloop_time;
 
 	*dict_r = &dict->dict;
 	return 0;
 }
 
+static void cdb_dict_refresh(struct cdb_dict *dict)
+{
+	struct cdb cdb;
+	struct stat st;
+	const char *error;
+	int fd;
+
+	if (dict->dict.iter_count > 0) {
+		/* iterators are still using the old file */
+		return;
+	}
+	/* check for changes at most once per second */
+	if (dict->last_refresh_check == ioloop_time)
+		return;
+	dict->last_refresh_check = ioloop_time;
+
+	if (stat(dict->path, &st) < 0) {
+		/* keep using the old file if it's being replaced */
+		if (errno != ENOENT)
+			e_error(dict->dict.event, "stat(%s) failed: %m", dict->path);
+		return;
+	}
+	if (st.st_ino == dict->ino && CMP_DEV_T(st.st_dev, dict->dev))
+		return;
+
+	i_zero(&cdb);
+	if (cdb_dict_open(dict->path, &fd, &cdb, &st, &error) < 0) {
+		e_error(dict->dict.event, "%s - keeping the old file", error);
+		return;
+	}
+	cdb_free(&dict->cdb);
+	i_close_fd_path(&dict->fd, dict->path);
+	dict->cdb = cdb;
+	dict->fd = fd;
+	dict->ino = st.st_ino;
+	dict->dev = st.st_dev;
+	/* the new file may have been written differently */
+	dict->flag = CDB_WITH_NULL | CDB_WITHOUT_NULL;
+	e_debug(dict->dict.event, "Reopened changed cdb file %s", dict->path);
+}
+
 static void cdb_dict_deinit(struct dict *_dict)
 {
 	struct cdb_dict *dict = (struct cdb_dict *)_dict;
@@ -95,6 +170,8 @@ cdb_dict_lookup(struct dict *_dict,
 	int ret = 0;
 	char *data;
 
+	cdb_dict_refresh(dict);
+
 	/* keys and values may be null terminated... */
 	if ((dict->flag & CDB_WITH_NULL) != 0) {
 		ret = cdb_find(&dict->cdb, key, (unsigned int)strlen(key)+1);
@@ -145,6 +222,7 @@ cdb_dict_iterate_init(struct dict *_dict,
 	ctx->flags = flags;
 	ctx->buffer = buffer_create_dynamic(default_pool, 256);
 
+	cdb_dict_refresh(dict);
 	cdb_seqinit(&ctx->cptr, &dict->cdb);
 
 	return &ctx->ctx;
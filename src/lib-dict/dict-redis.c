@@ -19,6 +19,8 @@ enum redis_input_state {
 	REDIS_INPUT_STATE_SELECT,
 	/* expecting $-1 / $<size> followed by GET reply */
 	REDIS_INPUT_STATE_GET,
+	/* same as GET, but for the first of the pending async lookups */
+	REDIS_INPUT_STATE_GET_ASYNC,
 	/* expecting +QUEUED */
 	REDIS_INPUT_STATE_MULTI,
 	/* expecting +OK reply for DISCARD */
@@ -45,6 +47,11 @@ struct redis_dict_reply {
 	void *context;
 };
 
+struct redis_dict_lookup {
+	dict_lookup_callback_t *callback;
+	void *context;
+};
+
 struct redis_dict {
 	struct dict dict;
 	char *password, *key_prefix, *expire_value;
@@ -55,6 +62,8 @@ struct redis_dict {
 
 	ARRAY(enum redis_input_state) input_states;
 	ARRAY(struct redis_dict_reply) replies;
+	/* async lookups waiting for their GET reply, in the sending order */
+	ARRAY(struct redis_dict_lookup) lookups;
 	char *last_error;
 
 	bool connected;
@@ -95,6 +104,23 @@ static void redis_reply_callback(struct redis_connection *conn,
 		io_loop_set_current(conn->dict->dict.ioloop);
 }
 
+static void redis_lookup_callback(struct redis_connection *conn,
+				  const struct redis_dict_lookup *lookup,
+				  const struct dict_lookup_result *result)
+{
+	if (conn->dict->dict.prev_ioloop != NULL)
+		io_loop_set_current(conn->dict->dict.prev_ioloop);
+	lookup->callback(result, lookup->context);
+	if (conn->dict->dict.prev_ioloop != NULL)
+		io_loop_set_current(conn->dict->dict.ioloop);
+}
+
+static bool redis_dict_have_async_requests(struct redis_dict *dict)
+{
+	return array_count(&dict->replies) > 0 ||
+		array_count(&dict->lookups) > 0;
+}
+
 static void
 redis_disconnected(struct redis_connection *conn, const char *reason)
 {
@@ -104,18 +130,27 @@ redis_disconnected(struct redis_connection *conn, const char *reason)
 		   freed by connection_disconnect() */
 		t_strdup(reason)
 	};
+	const struct dict_lookup_result lookup_result = {
+		.ret = -1,
+		.error = result.error,
+	};
 	const struct redis_dict_reply *reply;
+	const struct redis_dict_lookup *lookup;
 
 	if (conn->dict->last_error == NULL)
 		conn->dict->last_error = i_strdup(reason);
 
 	conn->dict->db_id_set = FALSE;
 	conn->dict->connected = FALSE;
+	conn->value_received = FALSE;
 	connection_disconnect(&conn->conn);
 
 	array_foreach(&conn->dict->replies, reply)
 		redis_reply_callback(conn, reply, &result);
 	array_clear(&conn->dict->replies);
+	array_foreach(&conn->dict->lookups, lookup)
+		redis_lookup_callback(conn, lookup, &lookup_result);
+	array_clear(&conn->dict->lookups);
 	array_clear(&conn->dict->input_states);
 	timeout_remove(&conn->dict->to);
 
@@ -168,7 +203,38 @@ static const char *redis_wait(struct redis_dict *dict)
 	return error;
 }
 
-static int redis_input_get(struct redis_connection *conn, const char **error_r)
+static void redis_input_get_finished(struct redis_connection *conn, bool async)
+{
+	struct redis_dict *dict = conn->dict;
+	struct redis_dict_lookup lookup;
+	struct dict_lookup_result result;
+	const char *values[2] = { NULL, NULL };
+
+	conn->value_received = TRUE;
+	redis_input_state_remove(dict);
+	if (async) {
+		lookup = *array_front(&dict->lookups);
+		array_pop_front(&dict->lookups);
+		if (!redis_dict_have_async_requests(dict))
+			timeout_remove(&dict->to);
+
+		i_zero(&result);
+		if (conn->value_not_found)
+			result.ret = 0;
+		else {
+			result.ret = 1;
+			values[0] = str_c(conn->last_reply);
+			result.value = values[0];
+			result.values = values;
+		}
+		redis_lookup_callback(conn, &lookup, &result);
+	}
+	if (dict->dict.ioloop != NULL)
+		io_loop_stop(dict->dict.ioloop);
+}
+
+static int redis_input_get(struct redis_connection *conn, bool async,
+			   const char **error_r)
 {
 	const unsigned char *data;
 	size_t size;
@@ -179,12 +245,14 @@ static int redis_input_get(struct redis_connection *conn, const char **error_r)
 		line = i_stream_next_line(conn->conn.input);
 		if (line == NULL)
 			return 0;
+		/* there may be multiple pipelined GET replies */
+		str_truncate(conn->last_reply, 0);
+		conn->value_not_found = FALSE;
+		if (conn->dict->to != NULL)
+			timeout_reset(conn->dict->to);
 		if (strcmp(line, "$-1") == 0) {
-			conn->value_received = TRUE;
 			conn->value_not_found = TRUE;
-			if (conn->dict->dict.ioloop != NULL)
-				io_loop_stop(conn->dict->dict.ioloop);
-			redis_input_state_remove(conn->dict);
+			redis_input_get_finished(conn, async);
 			return 1;
 		}
 		if (line[0] != '$' || str_to_uint(line+1, &conn->bytes_left) < 0) {
@@ -207,12 +275,8 @@ static int redis_input_get(struct redis_connection *conn, const char **error_r)
 		return 0;
 
 	/* reply fully read - drop trailing CRLF */
-	conn->value_received = TRUE;
 	str_truncate(conn->last_reply, str_len(conn->last_reply)-2);
-
-	if (conn->dict->dict.ioloop != NULL)
-		io_loop_stop(conn->dict->dict.ioloop);
-	redis_input_state_remove(conn->dict);
+	redis_input_get_finished(conn, async);
 	return 1;
 }
 
@@ -237,7 +301,9 @@ redis_conn_input_more(struct redis_connection *conn, const char **error_r)
 	}
 	state = states[0];
 	if (state == REDIS_INPUT_STATE_GET)
-		return redis_input_get(conn, error_r);
+		return redis_input_get(conn, FALSE, error_r);
+	if (state == REDIS_INPUT_STATE_GET_ASYNC)
+		return redis_input_get(conn, TRUE, error_r);
 
 	line = i_stream_next_line(conn->conn.input);
 	if (line == NULL)
@@ -249,6 +315,7 @@ redis_conn_input_more(struct redis_connection *conn, const char **error_r)
 	redis_input_state_remove(dict);
 	switch (state) {
 	case REDIS_INPUT_STATE_GET:
+	case REDIS_INPUT_STATE_GET_ASYNC:
 		i_unreached();
 	case REDIS_INPUT_STATE_AUTH:
 	case REDIS_INPUT_STATE_SELECT:
@@ -284,7 +351,7 @@ redis_conn_input_more(struct redis_connection *conn, const char **error_r)
 			array_pop_front(&dict->replies);
 			/* if we're running in a dict-ioloop, we're handling a
 			   synchronous commit and need to stop now */
-			if (array_count(&dict->replies) == 0) {
+			if (!redis_dict_have_async_requests(dict)) {
 				timeout_remove(&dict->to);
 				if (conn->dict->dict.ioloop != NULL)
 					io_loop_stop(conn->dict->dict.ioloop);
@@ -462,6 +529,7 @@ redis_dict_init(struct dict *driver, const char *uri,
 
 	i_array_init(&dict->input_states, 4);
 	i_array_init(&dict->replies, 4);
+	i_array_init(&dict->lookups, 4);
 
 	*dict_r = &dict->dict;
 	return 0;
@@ -480,6 +548,7 @@ static void redis_dict_deinit(struct dict *_dict)
 	connection_deinit(&dict->conn.conn);
 	str_free(&dict->conn.last_reply);
 	array_free(&dict->replies);
+	array_free(&dict->lookups);
 	array_free(&dict->input_states);
 	i_free(dict->last_error);
 	i_free(dict->expire_value);
@@ -602,6 +671,8 @@ static int redis_dict_lookup(struct dict *_dict,
 
 			str_truncate(dict->conn.last_reply, 0);
 			redis_input_state_add(dict, REDIS_INPUT_STATE_GET);
+			/* the reply comes after the already pipelined
+			   async requests' replies */
 			do {
 				io_loop_run(dict->dict.ioloop);
 			} while (array_count(&dict->input_states) > 0);
@@ -632,6 +703,54 @@ static int redis_dict_lookup(struct dict *_dict,
 	return 1;
 }
 
+static void
+redis_dict_lookup_async(struct dict *_dict, const struct dict_op_settings *set,
+			const char *key, dict_lookup_callback_t *callback,
+			void *context)
+{
+	struct redis_dict *dict = (struct redis_dict *)_dict;
+	struct redis_dict_lookup *lookup;
+	struct dict_lookup_result result;
+	const char *cmd, *error = NULL;
+
+	i_assert(dict->dict.ioloop == NULL);
+
+	if (dict->conn.conn.fd_in == -1 &&
+	    connection_client_connect(&dict->conn.conn) < 0) {
+		error = t_strdup_printf("connect() failed: %m");
+		e_error(dict->conn.conn.event, "%s", error);
+	} else if (!dict->connected) {
+		/* wait for connection */
+		error = redis_wait(dict);
+		if (dict->connected)
+			redis_dict_auth(dict);
+	}
+	if (!dict->connected) {
+		i_zero(&result);
+		result.ret = -1;
+		result.error = error != NULL ? error :
+			"redis: Couldn't connect";
+		callback(&result, context);
+		return;
+	}
+	redis_dict_select_db(dict);
+
+	/* Send the GET immediately without waiting for the earlier replies.
+	   A burst of lookups then waits for only a single round trip. */
+	key = redis_dict_get_full_key(dict, set->username, key);
+	cmd = t_strdup_printf("*2\r\n$3\r\nGET\r\n$%zu\r\n%s\r\n",
+			      strlen(key), key);
+	o_stream_nsend_str(dict->conn.conn.output, cmd);
+	redis_input_state_add(dict, REDIS_INPUT_STATE_GET_ASYNC);
+	lookup = array_append_space(&dict->lookups);
+	lookup->callback = callback;
+	lookup->context = context;
+	if (dict->to == NULL) {
+		dict->to = timeout_add(dict->timeout_msecs,
+				       redis_dict_wait_timeout, dict);
+	}
+}
+
 static struct dict_transaction_context *
 redis_transaction_init(struct dict *_dict)
 {
@@ -855,6 +974,7 @@ struct dict dict_driver_redis = {
 		.deinit = redis_dict_deinit,
 		.wait = redis_dict_wait,
 		.lookup = redis_dict_lookup,
+		.lookup_async = redis_dict_lookup_async,
 		.transaction_init = redis_transaction_init,
 		.transaction_commit = redis_transaction_commit,
 		.transaction_rollback = redis_transaction_rollback,
@@ -223,6 +223,11 @@ int dict_expire_scan(struct dict *dict, const char **error_r)
 	return ret;
 }
 
+bool dict_supports_expire_secs(struct dict *dict)
+{
+	return (dict->flags & DICT_DRIVER_FLAG_SUPPORT_EXPIRE_SECS) != 0;
+}
+
 static bool dict_key_prefix_is_valid(const char *key, const char *username)
 {
 	if (str_begins_with(key, DICT_PATH_SHARED))
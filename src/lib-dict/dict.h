@@ -117,6 +117,8 @@ bool dict_switch_ioloop(struct dict *dict) ATTR_NOWARN_UNUSED_RESULT;
    again), 1 if expire scanning was run successfully, -1 if expire scanning
    failed. */
 int dict_expire_scan(struct dict *dict, const char **error_r);
+/* Returns TRUE if the dict driver supports dict_op_settings.expire_secs. */
+bool dict_supports_expire_secs(struct dict *dict);
 
 /* Lookup the first value for the key. Set it to NULL if it's not found.
    Returns 1 if found, 0 if not found and -1 if lookup failed. */
@@ -84,6 +84,7 @@ static void fs_classes_deinit(void)
 static void fs_classes_init(void)
 {
 	i_array_init(&fs_classes, 8);
+	fs_class_register(&fs_class_cache);
 	fs_class_register(&fs_class_dict);
 	fs_class_register(&fs_class_posix);
 	fs_class_register(&fs_class_randomfail);
@@ -0,0 +1,568 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "ioloop.h"
+#include "str.h"
+#include "sha1.h"
+#include "hex-binary.h"
+#include "str-parse.h"
+#include "mkdir-parents.h"
+#include "write-full.h"
+#include "istream-private.h"
+#include "fs-api-private.h"
+#include "fs-wrapper.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+/* Prefix for the files that are being filled. They're renamed to the
+   hash name once the whole file has been read from the parent fs. */
+#define FS_CACHE_FILL_PREFIX ".fill."
+/* A fill file this old was left behind by a crashed process */
+#define FS_CACHE_FILL_STALE_SECS (60*5)
+/* Update the cache file's mtime on hits only this often. The mtime is used
+   for the LRU eviction. */
+#define FS_CACHE_TOUCH_INTERVAL_SECS 60
+/* Scan the cache directory for eviction after 1/n of the byte budget has
+   been filled by this process. */
+#define FS_CACHE_EVICT_SCAN_DIVISOR 10
+/* Evict until the cache is this percentage of the byte budget */
+#define FS_CACHE_EVICT_TARGET_PERCENTAGE 90
+
+struct cache_fs {
+	struct fs fs;
+	char *dir;
+	uoff_t max_size;
+
+	uoff_t filled_since_scan;
+	bool scanned;
+};
+
+struct cache_fs_file {
+	struct fs_file file;
+	struct cache_fs *fs;
+	char *cache_path;
+};
+
+struct cache_fill_istream {
+	struct istream_private istream;
+	struct cache_fs *fs;
+	struct event *event;
+
+	int fd;
+	char *fill_path, *cache_path;
+	uoff_t fill_offset;
+	bool failed;
+};
+
+struct fs_cache_entry {
+	const char *path;
+	time_t mtime;
+	uoff_t size;
+};
+ARRAY_DEFINE_TYPE(fs_cache_entry, struct fs_cache_entry);
+
+#define CACHE_FS(ptr)	container_of((ptr), struct cache_fs, fs)
+#define CACHE_FILE(ptr)	container_of((ptr), struct cache_fs_file, file)
+
+static struct fs *fs_cache_alloc(void)
+{
+	struct cache_fs *fs;
+
+	fs = i_new(struct cache_fs, 1);
+	fs->fs = fs_class_cache;
+	return &fs->fs;
+}
+
+static int fs_cache_parse_params(struct cache_fs *fs, const char *params,
+				 const char **error_r)
+{
+	const char *const *tmp, *error;
+
+	for (tmp = t_strsplit_spaces(params, ","); *tmp != NULL; tmp++) {
+		const char *key = *tmp;
+		const char *value = strchr(key, '=');
+
+		if (value == NULL) {
+			*error_r = "Missing '='";
+			return -1;
+		}
+		key = t_strdup_until(key, value++);
+		if (strcmp(key, "dir") == 0) {
+			i_free(fs->dir);
+			fs->dir = i_strdup(value);
+		} else if (strcmp(key, "size") == 0) {
+			if (str_parse_get_size(value, &fs->max_size,
+					       &error) < 0) {
+				*error_r = t_strdup_printf(
+					"Invalid size: %s", error);
+				return -1;
+			}
+		} else {
+			*error_r = t_strdup_printf("Unknown key '%s'", key);
+			return -1;
+		}
+	}
+	if (fs->dir == NULL || fs->dir[0] == '\0') {
+		*error_r = "dir not given";
+		return -1;
+	}
+	if (fs->max_size == 0) {
+		*error_r = "size not given";
+		return -1;
+	}
+	return 0;
+}
+
+static int
+fs_cache_init(struct fs *_fs, const char *args, const struct fs_settings *set,
+	      const char **error_r)
+{
+	struct cache_fs *fs = CACHE_FS(_fs);
+	const char *p, *parent_name, *parent_args, *error;
+
+	p = strchr(args, ':');
+	if (p == NULL) {
+		*error_r = "Cache parameters missing";
+		return -1;
+	}
+	if (fs_cache_parse_params(fs, t_strdup_until(args, p++), &error) < 0) {
+		*error_r = t_strdup_printf(
+			"Invalid cache parameters: %s", error);
+		return -1;
+	}
+	args = p;
+
+	if (*args == '\0') {
+		*error_r = "Parent filesystem not given as parameter";
+		return -1;
+	}
+
+	parent_args = strchr(args, ':');
+	if (parent_args == NULL) {
+		parent_name = args;
+		parent_args = "";
+	} else {
+		parent_name = t_strdup_until(args, parent_args);
+		parent_args++;
+	}
+	if (fs_init(parent_name, parent_args, set, &_fs->parent, error_r) < 0)
+		return -1;
+	return 0;
+}
+
+static void fs_cache_free(struct fs *_fs)
+{
+	struct cache_fs *fs = CACHE_FS(_fs);
+
+	i_free(fs->dir);
+	i_free(fs);
+}
+
+static struct fs_file *fs_cache_file_alloc(void)
+{
+	struct cache_fs_file *file = i_new(struct cache_fs_file, 1);
+	return &file->file;
+}
+
+static char *fs_cache_get_path(struct cache_fs *fs, const char *path)
+{
+	unsigned char digest[SHA1_RESULTLEN];
+
+	sha1_get_digest(path, strlen(path), digest);
+	return i_strdup_printf("%s/%s", fs->dir,
+			       binary_to_hex(digest, sizeof(digest)));
+}
+
+static void
+fs_cache_file_init(struct fs_file *_file, const char *path,
+		   enum fs_open_mode mode, enum fs_open_flags flags)
+{
+	struct cache_fs_file *file = CACHE_FILE(_file);
+
+	file->fs = CACHE_FS(_file->fs);
+	file->file.path = i_strdup(path);
+	file->cache_path = fs_cache_get_path(file->fs, path);
+	file->file.parent = fs_file_init_parent(_file, path, mode, flags);
+}
+
+static void fs_cache_file_deinit(struct fs_file *_file)
+{
+	struct cache_fs_file *file = CACHE_FILE(_file);
+
+	fs_file_free(_file);
+	i_free(file->cache_path);
+	i_free(file->file.path);
+	i_free(file);
+}
+
+static void fs_cache_invalidate(struct cache_fs_file *file)
+{
+	i_unlink_if_exists(file->cache_path);
+}
+
+static void
+fs_cache_send_event(struct fs_file *file, const char *name, uoff_t size)
+{
+	struct event_passthrough *e =
+		event_create_passthrough(file->event)->
+		set_name(name)->
+		add_str("path", file->path);
+
+	if (size != UOFF_T_MAX)
+		e->add_int("size", size);
+	e_debug(e->event(), "%s", name);
+}
+
+static int fs_cache_entry_cmp(const struct fs_cache_entry *e1,
+			      const struct fs_cache_entry *e2)
+{
+	if (e1->mtime < e2->mtime)
+		return -1;
+	if (e1->mtime > e2->mtime)
+		return 1;
+	return 0;
+}
+
+static void fs_cache_evict_scan(struct cache_fs *fs)
+{
+	ARRAY_TYPE(fs_cache_entry) entries;
+	struct fs_cache_entry *entry;
+	struct dirent *d;
+	struct stat st;
+	const char *path;
+	uoff_t total_size = 0, target_size;
+	DIR *dir;
+
+	fs->scanned = TRUE;
+	fs->filled_since_scan = 0;
+
+	dir = opendir(fs->dir);
+	if (dir == NULL) {
+		if (errno != ENOENT)
+			e_error(fs->fs.event, "opendir(%s) failed: %m", fs->dir);
+		return;
+	}
+	t_array_init(&entries, 128);
+	for (;;) {
+		errno = 0;
+		if ((d = readdir(dir)) == NULL)
+			break;
+		if (d->d_name[0] == '.' &&
+		    !str_begins_with(d->d_name, FS_CACHE_FILL_PREFIX))
+			continue;
+		path = t_strconcat(fs->dir, "/", d->d_name, NULL);
+		if (stat(path, &st) < 0) {
+			if (errno != ENOENT)
+				e_error(fs->fs.event, "stat(%s) failed: %m", path);
+			continue;
+		}
+		if (d->d_name[0] == '.') {
+			if (st.st_mtime + FS_CACHE_FILL_STALE_SECS < ioloop_time)
+				i_unlink_if_exists(path);
+			continue;
+		}
+		entry = array_append_space(&entries);
+		entry->path = path;
+		entry->mtime = st.st_mtime;
+		entry->size = st.st_size;
+		total_size += st.st_size;
+	}
+	if (errno != 0)
+		e_error(fs->fs.event, "readdir(%s) failed: %m", fs->dir);
+	if (closedir(dir) < 0)
+		e_error(fs->fs.event, "closedir(%s) failed: %m", fs->dir);
+
+	if (total_size <= fs->max_size)
+		return;
+
+	/* remove the least recently used files */
+	target_size = fs->max_size / 100 * FS_CACHE_EVICT_TARGET_PERCENTAGE;
+	array_sort(&entries, fs_cache_entry_cmp);
+	array_foreach_modifiable(&entries, entry) {
+		if (total_size <= target_size)
+			break;
+		if (i_unlink_if_exists(entry->path) >= 0)
+			total_size -= entry->size;
+	}
+	e_debug(fs->fs.event, "Evicted cache files from %s down to %"PRIuUOFF_T
+		" bytes", fs->dir, total_size);
+}
+
+static void fs_cache_filled(struct cache_fs *fs, uoff_t size)
+{
+	fs->filled_since_scan += size;
+	if (!fs->scanned ||
+	    fs->filled_since_scan >= fs->max_size / FS_CACHE_EVICT_SCAN_DIVISOR) T_BEGIN {
+		fs_cache_evict_scan(fs);
+	} T_END;
+}
+
+static void i_stream_cache_fill_finish(struct cache_fill_istream *cstream)
+{
+	if (cstream->fd == -1)
+		return;
+
+	if (close(cstream->fd) < 0) {
+		e_error(cstream->event, "close(%s) failed: %m",
+			cstream->fill_path);
+		cstream->failed = TRUE;
+	}
+	cstream->fd = -1;
+	if (cstream->failed) {
+		i_unlink_if_exists(cstream->fill_path);
+		return;
+	}
+	if (rename(cstream->fill_path, cstream->cache_path) < 0) {
+		e_error(cstream->event, "rename(%s, %s) failed: %m",
+			cstream->fill_path, cstream->cache_path);
+		i_unlink_if_exists(cstream->fill_path);
+		return;
+	}
+	fs_cache_filled(cstream->fs, cstream->fill_offset);
+}
+
+static void
+i_stream_cache_fill_write(struct cache_fill_istream *cstream)
+{
+	struct istream_private *stream = &cstream->istream;
+	uoff_t end_offset = stream->istream.v_offset +
+		(stream->pos - stream->skip);
+	size_t skip;
+
+	if (cstream->failed || end_offset <= cstream->fill_offset)
+		return;
+	if (stream->istream.v_offset > cstream->fill_offset) {
+		/* the caller seeked forward - the cache file can't be
+		   filled */
+		cstream->failed = TRUE;
+		return;
+	}
+	skip = stream->skip + (cstream->fill_offset - stream->istream.v_offset);
+	if (write_full(cstream->fd, stream->buffer + skip,
+		       stream->pos - skip) < 0) {
+		e_error(cstream->event, "write(%s) failed: %m",
+			cstream->fill_path);
+		cstream->failed = TRUE;
+		return;
+	}
+	cstream->fill_offset = end_offset;
+}
+
+static ssize_t i_stream_cache_fill_read(struct istream_private *stream)
+{
+	struct cache_fill_istream *cstream =
+		container_of(stream, struct cache_fill_istream, istream);
+	ssize_t ret;
+
+	i_stream_seek(stream->parent, stream->parent_start_offset +
+		      stream->istream.v_offset);
+
+	ret = i_stream_read_copy_from_parent(&stream->istream);
+	if (cstream->fd == -1)
+		return ret;
+	if (ret > 0)
+		i_stream_cache_fill_write(cstream);
+	else if (ret == -1) {
+		if (stream->istream.stream_errno != 0)
+			cstream->failed = TRUE;
+		i_stream_cache_fill_finish(cstream);
+	}
+	return ret;
+}
+
+static void i_stream_cache_fill_destroy(struct iostream_private *stream)
+{
+	struct cache_fill_istream *cstream =
+		container_of(stream, struct cache_fill_istream,
+			     istream.iostream);
+
+	if (cstream->fd != -1) {
+		/* not read until EOF */
+		cstream->failed = TRUE;
+		i_stream_cache_fill_finish(cstream);
+	}
+	event_unref(&cstream->event);
+	i_free(cstream->fill_path);
+	i_free(cstream->cache_path);
+	i_stream_unref(&cstream->istream.parent);
+}
+
+/* Copy the data read from the input to the cache file. The cache file is
+   made visible only if the whole input is read. */
+static struct istream *
+i_stream_create_cache_fill(struct istream *input, struct cache_fs_file *file,
+			   int fd, const char *fill_path)
+{
+	struct cache_fill_istream *cstream;
+
+	cstream = i_new(struct cache_fill_istream, 1);
+	cstream->fs = file->fs;
+	cstream->event = file->file.event;
+	event_ref(cstream->event);
+	cstream->fd = fd;
+	cstream->fill_path = i_strdup(fill_path);
+	cstream->cache_path = i_strdup(file->cache_path);
+	cstream->istream.max_buffer_size = input->real_stream->max_buffer_size;
+	cstream->istream.stream_size_passthrough = TRUE;
+	cstream->istream.read = i_stream_cache_fill_read;
+	cstream->istream.iostream.destroy = i_stream_cache_fill_destroy;
+	cstream->istream.istream.blocking = input->blocking;
+	cstream->istream.istream.seekable = input->seekable;
+	return i_stream_create(&cstream->istream, input,
+			       i_stream_get_fd(input), 0);
+}
+
+static int fs_cache_fill_open(struct cache_fs_file *file, const char **path_r)
+{
+	const char *fname = strrchr(file->cache_path, '/') + 1;
+	const char *path;
+	int fd;
+
+	path = t_strdup_printf("%s/"FS_CACHE_FILL_PREFIX"%s",
+			       file->fs->dir, fname);
+	/* O_EXCL makes sure only one process fills it at a time. The others
+	   read the parent directly meanwhile. */
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	if (fd == -1 && errno == ENOENT) {
+		if (mkdir_parents(file->fs->dir, 0700) < 0 && errno != EEXIST) {
+			e_error(file->file.event, "mkdir_parents(%s) failed: %m",
+				file->fs->dir);
+			return -1;
+		}
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	}
+	if (fd == -1) {
+		if (errno != EEXIST)
+			e_error(file->file.event, "open(%s) failed: %m", path);
+		return -1;
+	}
+	*path_r = path;
+	return fd;
+}
+
+static struct istream *
+fs_cache_read_stream(struct fs_file *_file, size_t max_buffer_size)
+{
+	struct cache_fs_file *file = CACHE_FILE(_file);
+	struct istream *input, *input2;
+	struct stat st;
+	const char *fill_path;
+	int fd;
+
+	fd = open(file->cache_path, O_RDONLY);
+	if (fd != -1) {
+		if (fstat(fd, &st) < 0) {
+			e_error(_file->event, "fstat(%s) failed: %m",
+				file->cache_path);
+			i_close_fd(&fd);
+		} else {
+			if (st.st_mtime + FS_CACHE_TOUCH_INTERVAL_SECS <
+			    ioloop_time &&
+			    utime(file->cache_path, NULL) < 0 &&
+			    errno != ENOENT) {
+				e_error(_file->event, "utime(%s) failed: %m",
+					file->cache_path);
+			}
+			fs_cache_send_event(_file, "fs_cache_hit", st.st_size);
+			input = i_stream_create_fd_autoclose(&fd,
+							     max_buffer_size);
+			i_stream_set_name(input, file->cache_path);
+			return input;
+		}
+	} else if (errno != ENOENT) {
+		e_error(_file->event, "open(%s) failed: %m", file->cache_path);
+	}
+
+	fs_cache_send_event(_file, "fs_cache_miss", UOFF_T_MAX);
+	input = fs_read_stream(_file->parent, max_buffer_size);
+	if (input->stream_errno != 0)
+		return input;
+	if ((fd = fs_cache_fill_open(file, &fill_path)) == -1)
+		return input;
+	input2 = i_stream_create_cache_fill(input, file, fd, fill_path);
+	i_stream_unref(&input);
+	return input2;
+}
+
+static int fs_cache_write(struct fs_file *_file, const void *data, size_t size)
+{
+	fs_cache_invalidate(CACHE_FILE(_file));
+	return fs_wrapper_write(_file, data, size);
+}
+
+static void fs_cache_write_stream(struct fs_file *_file)
+{
+	fs_cache_invalidate(CACHE_FILE(_file));
+	fs_wrapper_write_stream(_file);
+}
+
+static int fs_cache_write_stream_finish(struct fs_file *_file, bool success)
+{
+	/* a concurrent read may have cached the old content */
+	fs_cache_invalidate(CACHE_FILE(_file));
+	return fs_wrapper_write_stream_finish(_file, success);
+}
+
+static int fs_cache_copy(struct fs_file *src, struct fs_file *dest)
+{
+	fs_cache_invalidate(CACHE_FILE(dest));
+	return fs_wrapper_copy(src, dest);
+}
+
+static int fs_cache_rename(struct fs_file *src, struct fs_file *dest)
+{
+	fs_cache_invalidate(CACHE_FILE(src));
+	fs_cache_invalidate(CACHE_FILE(dest));
+	return fs_wrapper_rename(src, dest);
+}
+
+static int fs_cache_delete(struct fs_file *_file)
+{
+	fs_cache_invalidate(CACHE_FILE(_file));
+	return fs_wrapper_delete(_file);
+}
+
+const struct fs fs_class_cache = {
+	.name = "cache",
+	.v = {
+		.alloc = fs_cache_alloc,
+		.init = fs_cache_init,
+		.deinit = NULL,
+		.free = fs_cache_free,
+		.get_properties = fs_wrapper_get_properties,
+		.file_alloc = fs_cache_file_alloc,
+		.file_init = fs_cache_file_init,
+		.file_deinit = fs_cache_file_deinit,
+		.file_close = fs_wrapper_file_close,
+		.get_path = fs_wrapper_file_get_path,
+		.set_async_callback = fs_wrapper_set_async_callback,
+		.wait_async = fs_wrapper_wait_async,
+		.set_metadata = fs_wrapper_set_metadata,
+		.get_metadata = fs_wrapper_get_metadata,
+		.prefetch = fs_wrapper_prefetch,
+		.read = NULL,
+		.read_stream = fs_cache_read_stream,
+		.write = fs_cache_write,
+		.write_stream = fs_cache_write_stream,
+		.write_stream_finish = fs_cache_write_stream_finish,
+		.lock = fs_wrapper_lock,
+		.unlock = fs_wrapper_unlock,
+		.exists = fs_wrapper_exists,
+		.stat = fs_wrapper_stat,
+		.copy = fs_cache_copy,
+		.rename = fs_cache_rename,
+		.delete_file = fs_cache_delete,
+		.iter_alloc = fs_wrapper_iter_alloc,
+		.iter_init = fs_wrapper_iter_init,
+		.iter_next = fs_wrapper_iter_next,
+		.iter_deinit = fs_wrapper_iter_deinit,
+		.switch_ioloop = NULL,
+		.get_nlinks = fs_wrapper_get_nlinks,
+	}
+};
@@ -0,0 +1,314 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "fd-util.h"
+#include "fs-posix-async.h"
+
+#ifdef HAVE_PTHREAD
+
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+
+struct fs_posix_async {
+	unsigned int thread_count, started_count;
+	pthread_t *threads;
+
+	/* protects everything below until pending_count */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct fs_posix_async_job *queue_head, **queue_tail;
+	struct fs_posix_async_job *done_head;
+	bool stopping;
+
+	/* accessed only by the main thread */
+	unsigned int pending_count;
+	/* the threads write a byte here after each finished job */
+	int fd_notify[2];
+	struct io *io;
+};
+
+static void fs_posix_async_run(struct fs_posix_async_job *job)
+{
+	if (job->fd != -1 && fdatasync(job->fd) < 0) {
+		job->error = errno;
+		job->failed_func = "fdatasync";
+		return;
+	}
+	switch (job->op) {
+	case FS_POSIX_ASYNC_OP_NONE:
+		break;
+	case FS_POSIX_ASYNC_OP_LINK:
+		if (link(job->temp_path, job->dest_path) < 0) {
+			job->error = errno;
+			job->failed_func = "link";
+			if (job->error == ENOENT)
+				return;
+		}
+		if (unlink(job->temp_path) < 0 && job->error == 0) {
+			job->error = errno;
+			job->failed_func = "unlink";
+		}
+		break;
+	}
+}
+
+static void *fs_posix_async_thread(void *context)
+{
+	struct fs_posix_async *async = context;
+	struct fs_posix_async_job *job;
+	const unsigned char notify = '\0';
+
+	pthread_mutex_lock(&async->mutex);
+	for (;;) {
+		while (async->queue_head == NULL && !async->stopping)
+			pthread_cond_wait(&async->cond, &async->mutex);
+		if ((job = async->queue_head) == NULL)
+			break;
+		async->queue_head = job->next;
+		if (async->queue_head == NULL)
+			async->queue_tail = &async->queue_head;
+		pthread_mutex_unlock(&async->mutex);
+
+		fs_posix_async_run(job);
+
+		pthread_mutex_lock(&async->mutex);
+		job->next = async->done_head;
+		async->done_head = job;
+		/* if the pipe is full, the main thread is going to read it
+		   anyway */
+		if (write(async->fd_notify[1], &notify, 1) < 0) {
+			/* ignore - can't log here */
+		}
+	}
+	pthread_mutex_unlock(&async->mutex);
+	return NULL;
+}
+
+static void fs_posix_async_start_thread(struct fs_posix_async *async)
+{
+	sigset_t sigs, old_sigs;
+	int ret;
+
+	/* signals must be handled by the main thread */
+	sigfillset(&sigs);
+	pthread_sigmask(SIG_SETMASK, &sigs, &old_sigs);
+	ret = pthread_create(&async->threads[async->started_count], NULL,
+			     fs_posix_async_thread, async);
+	pthread_sigmask(SIG_SETMASK, &old_sigs, NULL);
+	if (ret != 0) {
+		errno = ret;
+		i_fatal("pthread_create() failed: %m");
+	}
+	async->started_count++;
+}
+
+/* Returns the number of the finished jobs. */
+static unsigned int fs_posix_async_handle_done(struct fs_posix_async *async)
+{
+	struct fs_posix_async_job *job, *next;
+	unsigned char buf[128];
+	unsigned int count = 0;
+
+	while (read(async->fd_notify[0], buf, sizeof(buf)) > 0) ;
+
+	pthread_mutex_lock(&async->mutex);
+	job = async->done_head;
+	async->done_head = NULL;
+	pthread_mutex_unlock(&async->mutex);
+
+	for (; job != NULL; job = next) {
+		/* the callback may free the job */
+		next = job->next;
+		i_assert(async->pending_count > 0);
+		async->pending_count--;
+		job->done = TRUE;
+		count++;
+		if (job->callback != NULL)
+			job->callback(job->context);
+	}
+	return count;
+}
+
+static void fs_posix_async_input(struct fs_posix_async *async)
+{
+	(void)fs_posix_async_handle_done(async);
+}
+
+struct fs_posix_async *
+fs_posix_async_init(unsigned int thread_count,
+		    const char **error_r ATTR_UNUSED)
+{
+	struct fs_posix_async *async;
+
+	i_assert(thread_count > 0);
+
+	async = i_new(struct fs_posix_async, 1);
+	async->thread_count = thread_count;
+	async->threads = i_new(pthread_t, thread_count);
+	pthread_mutex_init(&async->mutex, NULL);
+	pthread_cond_init(&async->cond, NULL);
+	async->queue_tail = &async->queue_head;
+
+	if (pipe(async->fd_notify) < 0)
+		i_fatal("pipe() failed: %m");
+	fd_set_nonblock(async->fd_notify[0], TRUE);
+	fd_set_nonblock(async->fd_notify[1], TRUE);
+	fd_close_on_exec(async->fd_notify[0], TRUE);
+	fd_close_on_exec(async->fd_notify[1], TRUE);
+	return async;
+}
+
+void fs_posix_async_deinit(struct fs_posix_async **_async)
+{
+	struct fs_posix_async *async = *_async;
+	unsigned int i;
+
+	*_async = NULL;
+	i_assert(async->pending_count == 0);
+
+	pthread_mutex_lock(&async->mutex);
+	async->stopping = TRUE;
+	pthread_cond_broadcast(&async->cond);
+	pthread_mutex_unlock(&async->mutex);
+	for (i = 0; i < async->started_count; i++)
+		(void)pthread_join(async->threads[i], NULL);
+
+	pthread_cond_destroy(&async->cond);
+	pthread_mutex_destroy(&async->mutex);
+	io_remove(&async->io);
+	i_close_fd(&async->fd_notify[0]);
+	i_close_fd(&async->fd_notify[1]);
+	i_free(async->threads);
+	i_free(async);
+}
+
+void fs_posix_async_submit(struct fs_posix_async *async,
+			   struct fs_posix_async_job *job)
+{
+	job->done = FALSE;
+	job->error = 0;
+	job->failed_func = NULL;
+	job->next = NULL;
+
+	if (async->io == NULL && current_ioloop != NULL) {
+		async->io = io_add(async->fd_notify[0], IO_READ,
+				   fs_posix_async_input, async);
+	}
+	/* start the threads only when they're needed */
+	async->pending_count++;
+	if (async->started_count < async->thread_count &&
+	    async->started_count < async->pending_count)
+		fs_posix_async_start_thread(async);
+
+	pthread_mutex_lock(&async->mutex);
+	*async->queue_tail = job;
+	async->queue_tail = &job->next;
+	pthread_cond_signal(&async->cond);
+	pthread_mutex_unlock(&async->mutex);
+}
+
+void fs_posix_async_wait(struct fs_posix_async *async)
+{
+	struct pollfd pfd = {
+		.fd = async->fd_notify[0],
+		.events = POLLIN,
+	};
+
+	while (async->pending_count > 0 &&
+	       fs_posix_async_handle_done(async) == 0) {
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			i_fatal("poll() failed: %m");
+	}
+}
+
+bool fs_posix_async_cancel(struct fs_posix_async *async,
+			   struct fs_posix_async_job *job)
+{
+	struct fs_posix_async_job **jobp;
+	bool found = FALSE;
+
+	pthread_mutex_lock(&async->mutex);
+	for (jobp = &async->queue_head; *jobp != NULL; jobp = &(*jobp)->next) {
+		if (*jobp == job) {
+			*jobp = job->next;
+			if (async->queue_tail == &job->next)
+				async->queue_tail = jobp;
+			found = TRUE;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&async->mutex);
+
+	if (found) {
+		i_assert(async->pending_count > 0);
+		async->pending_count--;
+	}
+	return found;
+}
+
+void fs_posix_async_wait_job(struct fs_posix_async *async,
+			     struct fs_posix_async_job *job)
+{
+	while (!job->done)
+		fs_posix_async_wait(async);
+}
+
+bool fs_posix_async_switch_ioloop(struct fs_posix_async *async)
+{
+	if (async->io != NULL)
+		async->io = io_loop_move_io(&async->io);
+	else if (current_ioloop != NULL) {
+		async->io = io_add(async->fd_notify[0], IO_READ,
+				   fs_posix_async_input, async);
+	}
+	return async->pending_count > 0;
+}
+
+#else
+
+struct fs_posix_async *
+fs_posix_async_init(unsigned int thread_count ATTR_UNUSED,
+		    const char **error_r)
+{
+	*error_r = "Not supported without pthreads";
+	return NULL;
+}
+
+void fs_posix_async_deinit(struct fs_posix_async **async ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+void fs_posix_async_submit(struct fs_posix_async *async ATTR_UNUSED,
+			   struct fs_posix_async_job *job ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+void fs_posix_async_wait(struct fs_posix_async *async ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+bool fs_posix_async_cancel(struct fs_posix_async *async ATTR_UNUSED,
+			   struct fs_posix_async_job *job ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+void fs_posix_async_wait_job(struct fs_posix_async *async ATTR_UNUSED,
+			     struct fs_posix_async_job *job ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+bool fs_posix_async_switch_ioloop(struct fs_posix_async *async ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef FS_POSIX_ASYNC_H
+#define FS_POSIX_ASYNC_H
+
+/* Thread pool for running the blocking syscalls of finishing fs-posix
+   writes. The threads run only the syscalls - everything else, including
+   logging, is done by the caller in the main thread. */
+
+enum fs_posix_async_op {
+	/* only fdatasync() */
+	FS_POSIX_ASYNC_OP_NONE,
+	/* link(temp_path, dest_path) and unlink(temp_path). rename() isn't
+	   done in threads, because it can't be undone if the write is
+	   aborted. */
+	FS_POSIX_ASYNC_OP_LINK,
+};
+
+typedef void fs_posix_async_callback_t(void *context);
+
+struct fs_posix_async_job {
+	/* fd to fdatasync(), or -1 */
+	int fd;
+	enum fs_posix_async_op op;
+	/* The paths must stay valid until the job is done. */
+	const char *temp_path, *dest_path;
+
+	/* Set when the job is done. If error is non-zero, failed_func is the
+	   syscall that failed. If link() or rename() failed with ENOENT, the
+	   temp file is left as it was, so the caller can create the parent
+	   directories and retry. */
+	bool done;
+	int error;
+	const char *failed_func;
+
+	fs_posix_async_callback_t *callback;
+	void *context;
+
+	struct fs_posix_async_job *next;
+};
+
+/* Returns NULL and sets error_r if threads aren't supported. */
+struct fs_posix_async *
+fs_posix_async_init(unsigned int thread_count, const char **error_r);
+/* All the jobs must be done. */
+void fs_posix_async_deinit(struct fs_posix_async **async);
+
+void fs_posix_async_submit(struct fs_posix_async *async,
+			   struct fs_posix_async_job *job);
+/* Wait until at least one pending job is done and call the callbacks of
+   the finished jobs. Returns immediately if no jobs are pending. */
+void fs_posix_async_wait(struct fs_posix_async *async);
+/* Remove the job from the queue if no thread has started it yet. Returns
+   TRUE if it was removed. Its callback isn't called then. */
+bool fs_posix_async_cancel(struct fs_posix_async *async,
+			   struct fs_posix_async_job *job);
+/* Wait until the job is done. */
+void fs_posix_async_wait_job(struct fs_posix_async *async,
+			     struct fs_posix_async_job *job);
+/* Returns TRUE if there are pending jobs. */
+bool fs_posix_async_switch_ioloop(struct fs_posix_async *async);
+
+#endif
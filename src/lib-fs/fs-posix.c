@@ -13,6 +13,7 @@
 #include "file-dotlock.h"
 #include "time-util.h"
 #include "fs-api-private.h"
+#include "fs-posix-async.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -39,6 +40,9 @@ struct posix_fs {
 	bool have_dirs;
 	bool disable_fsync;
 	bool accurate_mtime;
+
+	/* finishes FS_OPEN_FLAG_ASYNC writes in threads */
+	struct fs_posix_async *async;
 };
 
 struct posix_fs_file {
@@ -50,7 +54,12 @@ struct posix_fs_file {
 
 	buffer_t *write_buf;
 
+	struct fs_posix_async_job async_job;
+	fs_file_async_callback_t *async_callback;
+	void *async_context;
+
 	bool seek_to_beginning;
+	bool async_pending;
 };
 
 struct posix_fs_lock {
@@ -111,6 +120,23 @@ fs_posix_init(struct fs *_fs, const char *args, const struct fs_settings *set,
 			fs->disable_fsync = TRUE;
 		} else if (strcmp(arg, "accurate-mtime") == 0) {
 			fs->accurate_mtime = TRUE;
+		} else if (str_begins(arg, "async=", &value)) {
+			unsigned int thread_count;
+			const char *error;
+
+			if (str_to_uint(value, &thread_count) < 0 ||
+			    thread_count == 0) {
+				*error_r = t_strdup_printf(
+					"Invalid async value: %s", value);
+				return -1;
+			}
+			if (fs->async != NULL)
+				fs_posix_async_deinit(&fs->async);
+			fs->async = fs_posix_async_init(thread_count, &error);
+			if (fs->async == NULL) {
+				*error_r = t_strdup_printf("async: %s", error);
+				return -1;
+			}
 		} else if (str_begins(arg, "mode=", &value)) {
 			unsigned int mode;
 			if (str_to_uint_oct(value, &mode) < 0) {
@@ -134,6 +160,8 @@ static void fs_posix_free(struct fs *_fs)
 {
 	struct posix_fs *fs = container_of(_fs, struct posix_fs, fs);
 
+	if (fs->async != NULL)
+		fs_posix_async_deinit(&fs->async);
 	i_free(fs->temp_file_prefix);
 	i_free(fs->root_path);
 	i_free(fs->path_prefix);
@@ -357,11 +385,21 @@ fs_posix_file_init(struct fs_file *_file, const char *path,
 	file->fd = -1;
 }
 
+static void fs_posix_async_wait_file(struct posix_fs_file *file)
+{
+	struct posix_fs *fs = container_of(file->file.fs, struct posix_fs, fs);
+
+	if (file->async_pending)
+		fs_posix_async_wait_job(fs->async, &file->async_job);
+}
+
 static void fs_posix_file_close(struct fs_file *_file)
 {
 	struct posix_fs_file *file =
 		container_of(_file, struct posix_fs_file, file);
 
+	/* the thread may still be using the fd */
+	fs_posix_async_wait_file(file);
 	if (file->fd != -1 && file->file.output == NULL) {
 		if (close(file->fd) < 0) {
 			e_error(_file->event, "close(%s) failed: %m",
@@ -377,6 +415,7 @@ static void fs_posix_file_deinit(struct fs_file *_file)
 		container_of(_file, struct posix_fs_file, file);
 
 	i_assert(_file->output == NULL);
+	fs_posix_async_wait_file(file);
 
 	switch (file->open_mode) {
 	case FS_OPEN_MODE_READONLY:
@@ -519,21 +558,18 @@ static int fs_posix_write_finish_link(struct posix_fs_file *file)
 	return ret;
 }
 
-static int fs_posix_write_finish(struct posix_fs_file *file)
+static bool fs_posix_want_fsync(struct posix_fs_file *file)
+{
+	struct posix_fs *fs = container_of(file->file.fs, struct posix_fs, fs);
+
+	return (file->open_flags & FS_OPEN_FLAG_FSYNC) != 0 &&
+		!fs->disable_fsync;
+}
+
+static int fs_posix_write_finish_mtime(struct posix_fs_file *file)
 {
 	struct posix_fs *fs = container_of(file->file.fs, struct posix_fs, fs);
-	unsigned int try_count = 0;
-	int ret, old_errno;
 
-	if ((file->open_flags & FS_OPEN_FLAG_FSYNC) != 0 &&
-	    !fs->disable_fsync) {
-		if (fdatasync(file->fd) < 0) {
-			fs_set_error_errno(file->file.event,
-					   "fdatasync(%s) failed: %m",
-					   file->full_path);
-			return -1;
-		}
-	}
 	if (fs->accurate_mtime) {
 		/* Linux updates the mtime timestamp only on timer interrupts.
 		   This isn't anywhere close to being microsecond precision.
@@ -549,8 +585,23 @@ static int fs_posix_write_finish(struct posix_fs_file *file)
 			return -1;
 		}
 	}
+	return 0;
+}
+
+static void fs_posix_write_finished(struct posix_fs_file *file)
+{
+	i_free_and_null(file->temp_path);
+	file->seek_to_beginning = TRUE;
+	/* allow opening the file after writing to it */
+	file->open_mode = FS_OPEN_MODE_READONLY;
+}
+
+/* Move the written temp file to its final path. */
+static int fs_posix_write_finish_commit(struct posix_fs_file *file)
+{
+	unsigned int try_count = 0;
+	int ret, old_errno;
 
-	fs_posix_write_rename_if_needed(file);
 	switch (file->open_mode) {
 	case FS_OPEN_MODE_CREATE_UNIQUE_128:
 	case FS_OPEN_MODE_CREATE:
@@ -587,10 +638,148 @@ static int fs_posix_write_finish(struct posix_fs_file *file)
 	default:
 		i_unreached();
 	}
+	fs_posix_write_finished(file);
+	return 0;
+}
+
+static int fs_posix_write_finish(struct posix_fs_file *file)
+{
+	if (fs_posix_want_fsync(file)) {
+		if (fdatasync(file->fd) < 0) {
+			fs_set_error_errno(file->file.event,
+					   "fdatasync(%s) failed: %m",
+					   file->full_path);
+			return -1;
+		}
+	}
+	if (fs_posix_write_finish_mtime(file) < 0)
+		return -1;
+	fs_posix_write_rename_if_needed(file);
+	return fs_posix_write_finish_commit(file);
+}
+
+static void fs_posix_write_async_done(void *context)
+{
+	struct posix_fs_file *file = context;
+
+	file->async_pending = FALSE;
+	if (file->async_callback != NULL)
+		file->async_callback(file->async_context);
+}
+
+/* Run the fdatasync() and link()/rename() in a thread. */
+static void fs_posix_write_finish_async_start(struct posix_fs_file *file)
+{
+	struct posix_fs *fs = container_of(file->file.fs, struct posix_fs, fs);
+	struct fs_posix_async_job *job = &file->async_job;
+
+	i_zero(job);
+	job->fd = fs_posix_want_fsync(file) ? file->fd : -1;
+	/* rename() is done only in fs_posix_write_finish_async_end() */
+	job->op = file->open_mode == FS_OPEN_MODE_REPLACE ?
+		FS_POSIX_ASYNC_OP_NONE : FS_POSIX_ASYNC_OP_LINK;
+	job->temp_path = file->temp_path;
+	job->dest_path = file->full_path;
+	job->callback = fs_posix_write_async_done;
+	job->context = file;
+	file->async_pending = TRUE;
+	fs_posix_async_submit(fs->async, job);
+}
+
+static int fs_posix_write_finish_async_end(struct posix_fs_file *file)
+{
+	struct fs_posix_async_job *job = &file->async_job;
+
+	i_assert(job->done);
+
+	if (job->error == 0) {
+		if (job->op == FS_POSIX_ASYNC_OP_NONE)
+			return fs_posix_write_finish_commit(file);
+		fs_posix_write_finished(file);
+		return 0;
+	}
+	errno = job->error;
+	if (strcmp(job->failed_func, "fdatasync") == 0) {
+		fs_set_error_errno(file->file.event,
+				   "fdatasync(%s) failed: %m", file->full_path);
+		return -1;
+	}
+	if (strcmp(job->failed_func, "unlink") == 0) {
+		/* the file was already linked to its destination */
+		fs_set_error_errno(file->file.event, "unlink(%s) failed: %m",
+				   file->temp_path);
+		fs_posix_write_finished(file);
+		return 0;
+	}
+	if (job->error == ENOENT) {
+		/* the parent directory is missing - the temp file still
+		   exists, so do the retrying here */
+		return fs_posix_write_finish_commit(file);
+	}
+	fs_set_error_errno(file->file.event, "%s(%s, %s) failed: %m",
+			   job->failed_func, file->temp_path, file->full_path);
+	/* the temp file was already unlinked */
+	fs_posix_file_close(&file->file);
 	i_free_and_null(file->temp_path);
-	file->seek_to_beginning = TRUE;
-	/* allow opening the file after writing to it */
-	file->open_mode = FS_OPEN_MODE_READONLY;
+	return -1;
+}
+
+/* The write was aborted after its job was submitted. Make sure the temp
+   file doesn't become visible under the final name. */
+static void fs_posix_write_finish_async_abort(struct posix_fs_file *file)
+{
+	struct posix_fs *fs = container_of(file->file.fs, struct posix_fs, fs);
+	struct fs_posix_async_job *job = &file->async_job;
+	bool linked, temp_unlinked;
+
+	file->async_callback = NULL;
+	if (file->async_pending) {
+		if (fs_posix_async_cancel(fs->async, job)) {
+			/* the temp file is unlinked by deinit */
+			file->async_pending = FALSE;
+			return;
+		}
+		fs_posix_async_wait_job(fs->async, job);
+	}
+	i_assert(job->done);
+	job->done = FALSE;
+	if (job->op != FS_POSIX_ASYNC_OP_LINK)
+		return;
+
+	linked = job->error == 0 || strcmp(job->failed_func, "unlink") == 0;
+	temp_unlinked = job->error == 0 ||
+		(strcmp(job->failed_func, "link") == 0 && job->error != ENOENT);
+	if (linked && unlink(file->full_path) < 0 && errno != ENOENT) {
+		e_error(file->file.event, "unlink(%s) failed: %m",
+			file->full_path);
+	}
+	if (temp_unlinked)
+		i_free_and_null(file->temp_path);
+}
+
+/* Returns 1 if finished, 0 if it continues asynchronously, -1 on error. */
+static int fs_posix_write_finish_maybe_async(struct posix_fs_file *file)
+{
+	struct posix_fs *fs = container_of(file->file.fs, struct posix_fs, fs);
+	int ret;
+
+	if (file->async_job.done) {
+		ret = fs_posix_write_finish_async_end(file);
+		file->async_job.done = FALSE;
+		return ret < 0 ? -1 : 1;
+	}
+	if (file->async_pending) {
+		fs_file_set_error_async(&file->file);
+		return 0;
+	}
+	if (fs->async == NULL || (file->open_flags & FS_OPEN_FLAG_ASYNC) == 0)
+		return fs_posix_write_finish(file) < 0 ? -1 : 1;
+
+	if (fs_posix_write_finish_mtime(file) < 0)
+		return -1;
+	fs_posix_write_rename_if_needed(file);
+	fs_posix_write_finish_async_start(file);
+	fs_file_set_error_async(&file->file);
 	return 0;
 }
 
@@ -659,6 +848,8 @@ static int fs_posix_write_stream_finish(struct fs_file *_file, bool success)
 	int ret = success ? 0 : -1;
 
 	o_stream_destroy(&_file->output);
+	if (!success && (file->async_pending || file->async_job.done))
+		fs_posix_write_finish_async_abort(file);
 
 	switch (file->open_mode) {
 	case FS_OPEN_MODE_APPEND:
@@ -672,7 +863,7 @@ static int fs_posix_write_stream_finish(struct fs_file *_file, bool success)
 	case FS_OPEN_MODE_CREATE_UNIQUE_128:
 	case FS_OPEN_MODE_REPLACE:
 		if (ret == 0)
-			ret = fs_posix_write_finish(file);
+			return fs_posix_write_finish_maybe_async(file);
 		break;
 	case FS_OPEN_MODE_READONLY:
 		i_unreached();
@@ -990,6 +1181,36 @@ static int fs_posix_iter_deinit(struct fs_iter *_iter)
 	return ret;
 }
 
+static void
+fs_posix_set_async_callback(struct fs_file *_file,
+			    fs_file_async_callback_t *callback, void *context)
+{
+	struct posix_fs_file *file =
+		container_of(_file, struct posix_fs_file, file);
+
+	if (!file->async_pending) {
+		callback(context);
+		return;
+	}
+	file->async_callback = callback;
+	file->async_context = context;
+}
+
+static void fs_posix_wait_async(struct fs *_fs)
+{
+	struct posix_fs *fs = container_of(_fs, struct posix_fs, fs);
+
+	if (fs->async != NULL)
+		fs_posix_async_wait(fs->async);
+}
+
+static bool fs_posix_switch_ioloop(struct fs *_fs)
+{
+	struct posix_fs *fs = container_of(_fs, struct posix_fs, fs);
+
+	return fs->async != NULL && fs_posix_async_switch_ioloop(fs->async);
+}
+
 const struct fs fs_class_posix = {
 	.name = "posix",
 	.v = {
@@ -1003,8 +1224,8 @@ const struct fs fs_class_posix = {
 		.file_deinit = fs_posix_file_deinit,
 		.file_close = fs_posix_file_close,
 		.get_path = NULL,
-		.set_async_callback = NULL,
-		.wait_async = NULL,
+		.set_async_callback = fs_posix_set_async_callback,
+		.wait_async = fs_posix_wait_async,
 		.set_metadata = fs_default_set_metadata,
 		.get_metadata = NULL,
 		.prefetch = fs_posix_prefetch,
@@ -1024,7 +1245,7 @@ const struct fs fs_class_posix = {
 		.iter_init = fs_posix_iter_init,
 		.iter_next = fs_posix_iter_next,
 		.iter_deinit = fs_posix_iter_deinit,
-		.switch_ioloop = NULL,
+		.switch_ioloop = fs_posix_switch_ioloop,
 		.get_nlinks = NULL,
 	}
 };
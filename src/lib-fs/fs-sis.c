@@ -179,6 +179,22 @@ static bool fs_sis_try_link(struct sis_fs_file *file)
 	return TRUE;
 }
 
+static void fs_sis_link_hash_file(struct sis_fs_file *file)
+{
+	if (file->hash_input != NULL) {
+		/* hashes/ file exists already, but with different content.
+		   leave it alone. */
+		return;
+	}
+	/* make the new file available for deduplicating the following
+	   writes with the same hash */
+	if (fs_copy(file->file.parent, file->hash_file) < 0 &&
+	    errno != EEXIST) {
+		e_error(file->file.event, "%s",
+			fs_file_last_error(file->file.parent));
+	}
+}
+
 static struct istream *
 fs_sis_read_stream(struct fs_file *_file, size_t max_buffer_size)
 {
@@ -218,22 +234,44 @@ static int fs_sis_write(struct fs_file *_file, const void *data, size_t size)
 
 	if (fs_write(_file->parent, data, size) < 0)
 		return -1;
+	fs_sis_link_hash_file(file);
 	return 0;
 }
 
 static void fs_sis_write_stream(struct fs_file *_file)
 {
+	struct sis_fs_file *file = SIS_FILE(_file);
+
 	if (_file->parent == NULL) {
 		_file->output = o_stream_create_error_str(EINVAL, "%s",
 						fs_file_last_error(_file));
-	} else {
+	} else if (file->hash_input == NULL) {
 		_file->output = fs_write_stream(_file->parent);
+	} else {
+		/* compare the written data to the existing hashes/ file
+		   while writing, so the write can be replaced with a link
+		   at the end. */
+		file->fs_output = fs_write_stream(_file->parent);
+		_file->output = o_stream_create_cmp(file->fs_output,
+						    file->hash_input);
 	}
 	o_stream_set_name(_file->output, _file->path);
 }
 
 static int fs_sis_write_stream_finish(struct fs_file *_file, bool success)
 {
+	struct sis_fs_file *file = SIS_FILE(_file);
+	bool equals = FALSE;
+	int ret;
+
+	if (file->fs_output != NULL) {
+		/* o_stream_create_cmp() wrapper */
+		equals = success && o_stream_cmp_equals(_file->output) &&
+			i_stream_read_eof(file->hash_input);
+		o_stream_unref(&_file->output);
+		_file->output = file->fs_output;
+		file->fs_output = NULL;
+	}
 
 	if (!success) {
 		if (_file->parent != NULL)
@@ -241,8 +279,15 @@ static int fs_sis_write_stream_finish(struct fs_file *_file, bool success)
 		return -1;
 	}
 
-
-	return fs_write_stream_finish(_file->parent, &_file->output);
+	if (equals && fs_sis_try_link(file)) {
+		/* the existing file is used, drop the written copy */
+		fs_write_stream_abort_error(_file->parent, &_file->output,
+			"File was deduplicated with %s", file->hash_path);
+		return 1;
+	}
+	if ((ret = fs_write_stream_finish(_file->parent, &_file->output)) > 0)
+		fs_sis_link_hash_file(file);
+	return ret;
 }
 
 static int fs_sis_delete(struct fs_file *_file)
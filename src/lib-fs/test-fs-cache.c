@@ -0,0 +1,236 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "str.h"
+#include "istream.h"
+#include "ostream.h"
+#include "write-full.h"
+#include "fs-api.h"
+#include "safe-mkdir.h"
+#include "test-common.h"
+#include "unlink-directory.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define TEST_DIR ".test-fs-cache"
+#define TEST_CACHE_DIR TEST_DIR"/cache"
+#define TEST_DATA_DIR TEST_DIR"/data"
+
+static void test_fs_cache_dirs_reset(void)
+{
+	const char *error;
+
+	if (unlink_directory(TEST_DIR, UNLINK_DIRECTORY_FLAG_RMDIR,
+			     &error) < 0)
+		i_fatal("unlink_directory(%s) failed: %s", TEST_DIR, error);
+	if (safe_mkdir(TEST_DIR, 0700, (uid_t)-1, (gid_t)-1) != 1 ||
+	    safe_mkdir(TEST_DATA_DIR, 0700, (uid_t)-1, (gid_t)-1) != 1)
+		i_fatal("safe_mkdir(%s) failed", TEST_DIR);
+}
+
+static struct fs *test_fs_cache_init(const char *size)
+{
+	struct fs_settings fs_set;
+	struct fs *fs;
+	const char *error;
+
+	i_zero(&fs_set);
+	if (fs_init("cache", t_strdup_printf("dir="TEST_CACHE_DIR",size=%s:"
+			"posix:prefix="TEST_DATA_DIR"/", size),
+		    &fs_set, &fs, &error) < 0)
+		i_fatal("fs_init() failed: %s", error);
+	return fs;
+}
+
+static void test_fs_cache_write(struct fs *fs, const char *path,
+				const char *data)
+{
+	struct fs_file *file;
+	struct ostream *output;
+
+	file = fs_file_init(fs, path, FS_OPEN_MODE_REPLACE);
+	output = fs_write_stream(file);
+	o_stream_nsend_str(output, data);
+	test_assert(fs_write_stream_finish(file, &output) == 1);
+	fs_file_deinit(&file);
+}
+
+static void test_fs_cache_write_parent(const char *path, const char *data)
+{
+	const char *fpath = t_strconcat(TEST_DATA_DIR"/", path, NULL);
+	int fd;
+
+	fd = open(fpath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		i_fatal("open(%s) failed: %m", fpath);
+	if (write_full(fd, data, strlen(data)) < 0)
+		i_fatal("write(%s) failed: %m", fpath);
+	i_close_fd(&fd);
+}
+
+static const char *test_fs_cache_read(struct fs *fs, const char *path)
+{
+	struct fs_file *file;
+	struct istream *input;
+	const unsigned char *data;
+	size_t size;
+	string_t *str = t_str_new(128);
+
+	file = fs_file_init(fs, path, FS_OPEN_MODE_READONLY);
+	input = fs_read_stream(file, 1024);
+	while (i_stream_read_more(input, &data, &size) > 0) {
+		str_append_data(str, data, size);
+		i_stream_skip(input, size);
+	}
+	test_assert(input->stream_errno == 0);
+	i_stream_unref(&input);
+	fs_file_deinit(&file);
+	return str_c(str);
+}
+
+static unsigned int test_fs_cache_file_count(void)
+{
+	struct dirent *d;
+	unsigned int count = 0;
+	DIR *dir;
+
+	dir = opendir(TEST_CACHE_DIR);
+	if (dir == NULL)
+		return 0;
+	while ((d = readdir(dir)) != NULL) {
+		if (d->d_name[0] != '.')
+			count++;
+	}
+	(void)closedir(dir);
+	return count;
+}
+
+static void test_fs_cache_read_through(void)
+{
+	struct fs *fs;
+	const char *error;
+
+	test_begin("fs-cache read through");
+	test_fs_cache_dirs_reset();
+	fs = test_fs_cache_init("1M");
+
+	test_fs_cache_write(fs, "file1", "hello world");
+	test_assert(test_fs_cache_file_count() == 0);
+	test_assert_strcmp(test_fs_cache_read(fs, "file1"), "hello world");
+	test_assert(test_fs_cache_file_count() == 1);
+
+	/* the following reads come from the cache */
+	test_fs_cache_write_parent("file1", "changed behind the cache");
+	test_assert_strcmp(test_fs_cache_read(fs, "file1"), "hello world");
+
+	/* writing via the cache fs invalidates the cached file */
+	test_fs_cache_write(fs, "file1", "new data");
+	test_assert(test_fs_cache_file_count() == 0);
+	test_assert_strcmp(test_fs_cache_read(fs, "file1"), "new data");
+	test_assert_strcmp(test_fs_cache_read(fs, "file1"), "new data");
+
+	/* so does deleting */
+	struct fs_file *file = fs_file_init(fs, "file1", FS_OPEN_MODE_READONLY);
+	test_assert(fs_delete(file) == 0);
+	fs_file_deinit(&file);
+	test_assert(test_fs_cache_file_count() == 0);
+
+	fs_deinit(&fs);
+	if (unlink_directory(TEST_DIR, UNLINK_DIRECTORY_FLAG_RMDIR,
+			     &error) < 0)
+		i_error("unlink_directory(%s) failed: %s", TEST_DIR, error);
+	test_end();
+}
+
+static void test_fs_cache_partial_read(void)
+{
+	struct fs *fs;
+	struct fs_file *file;
+	struct istream *input;
+	const unsigned char *data;
+	size_t size;
+	const char *error;
+
+	test_begin("fs-cache partial read");
+	test_fs_cache_dirs_reset();
+	fs = test_fs_cache_init("1M");
+	test_fs_cache_write(fs, "file1", "hello world");
+
+	/* the cache file isn't created unless the whole file is read */
+	file = fs_file_init(fs, "file1", FS_OPEN_MODE_READONLY);
+	input = fs_read_stream(file, 1024);
+	test_assert(i_stream_read_more(input, &data, &size) > 0);
+	i_stream_unref(&input);
+	fs_file_deinit(&file);
+	test_assert(test_fs_cache_file_count() == 0);
+
+	fs_deinit(&fs);
+	if (unlink_directory(TEST_DIR, UNLINK_DIRECTORY_FLAG_RMDIR,
+			     &error) < 0)
+		i_error("unlink_directory(%s) failed: %s", TEST_DIR, error);
+	test_end();
+}
+
+static void test_fs_cache_evict(void)
+{
+	struct fs *fs;
+	char data[1001];
+	const char *error, *path;
+	unsigned int i;
+
+	test_begin("fs-cache evict");
+	test_fs_cache_dirs_reset();
+	/* 10 files of 1000 bytes fit, the rest get evicted */
+	fs = test_fs_cache_init("10000B");
+	memset(data, 'x', sizeof(data) - 1);
+	data[sizeof(data) - 1] = '\0';
+	for (i = 0; i < 30; i++) {
+		path = t_strdup_printf("file%u", i);
+		test_fs_cache_write(fs, path, data);
+		test_assert_idx(strcmp(test_fs_cache_read(fs, path), data) == 0, i);
+	}
+	test_assert(test_fs_cache_file_count() <= 10);
+	test_assert(test_fs_cache_file_count() > 0);
+
+	fs_deinit(&fs);
+	if (unlink_directory(TEST_DIR, UNLINK_DIRECTORY_FLAG_RMDIR,
+			     &error) < 0)
+		i_error("unlink_directory(%s) failed: %s", TEST_DIR, error);
+	test_end();
+}
+
+static void test_fs_cache_init_errors(void)
+{
+	static const char *const invalid_args[] = {
+		"", "posix", "dir=foo:posix", "size=1M:posix",
+		"dir=foo,size=1M", "dir=foo,size=1M,foo=bar:posix",
+		"dir=foo,size=x:posix",
+	};
+	struct fs_settings fs_set;
+	struct fs *fs;
+	const char *error;
+	unsigned int i;
+
+	test_begin("fs-cache init errors");
+	i_zero(&fs_set);
+	for (i = 0; i < N_ELEMENTS(invalid_args); i++) {
+		test_assert_idx(fs_init("cache", invalid_args[i], &fs_set,
+					&fs, &error) < 0, i);
+	}
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_fs_cache_read_through,
+		test_fs_cache_partial_read,
+		test_fs_cache_evict,
+		test_fs_cache_init_errors,
+		NULL
+	};
+	return test_run(test_functions);
+}
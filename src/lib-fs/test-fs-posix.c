@@ -134,10 +134,85 @@ error_no_testdir:
 	return;
 }
 
+#ifdef HAVE_PTHREAD
+static void test_fs_posix_async(void)
+{
+	static const char *const paths[] = {
+		"async1", "async2", "newdir/async3", "async4"
+	};
+	const char testdir[] = ".test-fs-posix-async";
+	struct fs_settings fs_set;
+	struct fs *fs;
+	struct fs_file *files[N_ELEMENTS(paths)];
+	struct ostream *output;
+	struct stat st;
+	const char *error;
+	unsigned int i, pending;
+	int ret;
+
+	test_begin("test-fs-posix async write");
+	if (unlink_directory(testdir, UNLINK_DIRECTORY_FLAG_RMDIR, &error) < 0)
+		i_fatal("unlink_directory(%s) failed: %s", testdir, error);
+	if (safe_mkdir(testdir, 0700, (uid_t)-1, (gid_t)-1) != 1)
+		i_fatal("safe_mkdir(%s) failed", testdir);
+
+	i_zero(&fs_set);
+	if (fs_init("posix", t_strdup_printf("prefix=%s/:async=2", testdir),
+		    &fs_set, &fs, &error) < 0)
+		i_fatal("fs_init() failed: %s", error);
+
+	/* the writes are finished in parallel */
+	for (i = 0; i < N_ELEMENTS(paths); i++) {
+		/* async4 is linked in the thread, the others are renamed
+		   after the thread has done the fsync */
+		files[i] = fs_file_init(fs, paths[i], i == 0 ?
+					FS_OPEN_MODE_CREATE :
+					(i == 3 ? FS_OPEN_MODE_CREATE :
+					 FS_OPEN_MODE_REPLACE) |
+					FS_OPEN_FLAG_FSYNC | FS_OPEN_FLAG_ASYNC);
+		output = fs_write_stream(files[i]);
+		o_stream_nsend_str(output, paths[i]);
+		ret = fs_write_stream_finish(files[i], &output);
+		test_assert_idx(ret == (i == 0 ? 1 : 0), i);
+	}
+	do {
+		pending = 0;
+		for (i = 1; i < N_ELEMENTS(paths); i++) {
+			if (files[i] == NULL)
+				continue;
+			ret = fs_write_stream_finish_async(files[i]);
+			if (ret == 0) {
+				pending++;
+				continue;
+			}
+			test_assert_idx(ret == 1, i);
+			fs_file_deinit(&files[i]);
+		}
+		if (pending > 0)
+			fs_wait_async(fs);
+	} while (pending > 0);
+	fs_file_deinit(&files[0]);
+
+	for (i = 0; i < N_ELEMENTS(paths); i++) {
+		const char *path = t_strdup_printf("%s/%s", testdir, paths[i]);
+		test_assert_idx(stat(path, &st) == 0 &&
+				st.st_size == (off_t)strlen(paths[i]), i);
+	}
+
+	fs_deinit(&fs);
+	if (unlink_directory(testdir, UNLINK_DIRECTORY_FLAG_RMDIR, &error) < 0)
+		i_error("unlink_directory(%s) failed: %s", testdir, error);
+	test_end();
+}
+#endif
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_fs_posix,
+#ifdef HAVE_PTHREAD
+		test_fs_posix_async,
+#endif
 		NULL
 	};
 	return test_run(test_functions);
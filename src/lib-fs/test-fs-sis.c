@@ -0,0 +1,88 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ostream.h"
+#include "fs-api.h"
+#include "safe-mkdir.h"
+#include "test-common.h"
+#include "unlink-directory.h"
+
+#include <sys/stat.h>
+
+#define TEST_DIR ".test-fs-sis"
+
+static void test_fs_sis_write(struct fs *fs, const char *path,
+			      const char *data)
+{
+	struct fs_file *file;
+	struct ostream *output;
+
+	file = fs_file_init(fs, path, FS_OPEN_MODE_REPLACE);
+	output = fs_write_stream(file);
+	o_stream_nsend_str(output, data);
+	test_assert(fs_write_stream_finish(file, &output) == 1);
+	fs_file_deinit(&file);
+}
+
+static ino_t test_fs_sis_ino(const char *path)
+{
+	struct stat st;
+
+	if (stat(t_strconcat(TEST_DIR"/", path, NULL), &st) < 0) {
+		test_failed(t_strdup_printf("stat(%s) failed: %m", path));
+		return 0;
+	}
+	return st.st_ino;
+}
+
+static void test_fs_sis_dedup(void)
+{
+	struct fs_settings fs_set;
+	struct fs *fs;
+	const char *error;
+	ino_t ino;
+
+	test_begin("fs-sis dedup stream writes");
+	if (unlink_directory(TEST_DIR, UNLINK_DIRECTORY_FLAG_RMDIR,
+			     &error) < 0)
+		i_fatal("unlink_directory(%s) failed: %s", TEST_DIR, error);
+	if (safe_mkdir(TEST_DIR, 0700, (uid_t)-1, (gid_t)-1) != 1)
+		i_fatal("safe_mkdir(%s) failed", TEST_DIR);
+
+	i_zero(&fs_set);
+	if (fs_init("sis", "posix:prefix="TEST_DIR"/", &fs_set,
+		    &fs, &error) < 0)
+		i_fatal("fs_init() failed: %s", error);
+
+	test_fs_sis_write(fs, "ab/1234-first", "attachment data");
+	ino = test_fs_sis_ino("ab/1234-first");
+	test_assert(test_fs_sis_ino("ab/hashes/1234") == ino);
+
+	/* the same content is linked to the existing file */
+	test_fs_sis_write(fs, "ab/1234-second", "attachment data");
+	test_assert(test_fs_sis_ino("ab/1234-second") == ino);
+
+	/* different content with the same hash is written separately */
+	test_fs_sis_write(fs, "ab/1234-third", "attachment DATA");
+	test_assert(test_fs_sis_ino("ab/1234-third") != ino);
+	test_assert(test_fs_sis_ino("ab/hashes/1234") == ino);
+
+	/* prefix of the existing content isn't a match either */
+	test_fs_sis_write(fs, "ab/1234-fourth", "attachment");
+	test_assert(test_fs_sis_ino("ab/1234-fourth") != ino);
+
+	fs_deinit(&fs);
+	if (unlink_directory(TEST_DIR, UNLINK_DIRECTORY_FLAG_RMDIR,
+			     &error) < 0)
+		i_error("unlink_directory(%s) failed: %s", TEST_DIR, error);
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_fs_sis_dedup,
+		NULL
+	};
+	return test_run(test_functions);
+}
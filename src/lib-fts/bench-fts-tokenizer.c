@@ -0,0 +1,143 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "strnum.h"
+#include "time-util.h"
+#include "fts-tokenizer.h"
+
+#include <stdio.h>
+
+/**
+ * Measures the generic tokenizer throughput with both of its algorithms for
+ * plain ASCII text, text with some non-ASCII words and text that is mostly
+ * non-ASCII. The data is sent in blocks, like when indexing mail bodies.
+ */
+
+#define BENCH_DATA_SIZE (4*1024*1024)
+#define BENCH_BLOCK_SIZE 8192
+
+static const char *const bench_words_ascii[] = {
+	"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+	"Hello", "world", "you're", "meeting", "tomorrow", "3.14", "2026",
+};
+static const char *const bench_words_mixed[] = {
+	"the", "quick", "brown", "fox", "na\xC3\xAFve", "caf\xC3\xA9",
+	"jumps", "over", "lazy", "dog", "\xC3\xBC" "ber", "r\xC3\xA9sum\xC3\xA9",
+};
+static const char *const bench_words_nonascii[] = {
+	"\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82",
+	"\xD0\xBC\xD0\xB8\xD1\x80",
+	"\xCE\xBA\xCF\x8C\xCF\x83\xCE\xBC\xCE\xB5",
+	"\xE3\x81\x93\xE3\x82\x93\xE3\x81\xAB\xE3\x81\xA1\xE3\x81\xAF",
+};
+static const char *const bench_separators[] = {
+	" ", " ", " ", " ", ", ", ". ", "\r\n", "\t", " (", ") ",
+};
+
+static size_t
+bench_data_fill(unsigned char *data, size_t size,
+		const char *const *words, unsigned int words_count)
+{
+	const char *word;
+	size_t pos = 0, len;
+
+	for (;;) {
+		word = words[i_rand_limit(words_count)];
+		len = strlen(word);
+		if (pos + len + 2 > size)
+			break;
+		memcpy(data + pos, word, len);
+		pos += len;
+
+		word = bench_separators[i_rand_limit(N_ELEMENTS(bench_separators))];
+		len = strlen(word);
+		memcpy(data + pos, word, len);
+		pos += len;
+	}
+	return pos;
+}
+
+static void
+bench_tokenizer(const char *algorithm, const char *name,
+		const unsigned char *data, size_t size, unsigned int rounds)
+{
+	const char *const settings[] = { "algorithm", algorithm, NULL };
+	struct fts_tokenizer *tok;
+	const char *token, *error;
+	unsigned int round, tokens = 0;
+	uint64_t ts_0, ts_1;
+	size_t pos, block_size;
+
+	if (fts_tokenizer_create(fts_tokenizer_generic, NULL, settings,
+				 &tok, &error) < 0)
+		i_fatal("fts_tokenizer_create() failed: %s", error);
+
+	ts_0 = i_nanoseconds();
+	for (round = 0; round < rounds; round++) {
+		for (pos = 0; pos < size; pos += block_size) {
+			block_size = I_MIN(size - pos, BENCH_BLOCK_SIZE);
+			/* tokenizer input must not split UTF-8 characters */
+			while (pos + block_size < size &&
+			       (data[pos + block_size] & 0xc0) == 0x80)
+				block_size++;
+			while (fts_tokenizer_next(tok, data + pos, block_size,
+						  &token, &error) > 0)
+				tokens++;
+		}
+		while (fts_tokenizer_final(tok, &token, &error) > 0)
+			tokens++;
+	}
+	ts_1 = i_nanoseconds();
+	fts_tokenizer_unref(&tok);
+
+	printf("\t%-6s %-9s %8.02lf MB/s %10u tokens\n", algorithm, name,
+	       (double)size * rounds * 1000 / (double)(ts_1 - ts_0),
+	       tokens / rounds);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [rounds]\n", prog);
+	fprintf(stderr, "Runs 10 rounds if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	static const struct {
+		const char *name;
+		const char *const *words;
+		unsigned int count;
+	} inputs[] = {
+		{ "ascii", bench_words_ascii, N_ELEMENTS(bench_words_ascii) },
+		{ "mixed", bench_words_mixed, N_ELEMENTS(bench_words_mixed) },
+		{ "nonascii", bench_words_nonascii,
+		  N_ELEMENTS(bench_words_nonascii) },
+	};
+	unsigned int i, rounds = 10;
+	unsigned char *data;
+	size_t size;
+
+	lib_init();
+
+	if (argc > 2)
+		print_usage(argv[0]);
+	if (argc == 2 && (str_to_uint(argv[1], &rounds) < 0 || rounds == 0))
+		print_usage(argv[0]);
+
+	fts_tokenizers_init();
+	data = i_malloc(BENCH_DATA_SIZE);
+	printf("%d bytes in %d byte blocks, %u rounds\n",
+	       BENCH_DATA_SIZE, BENCH_BLOCK_SIZE, rounds);
+	for (i = 0; i < N_ELEMENTS(inputs); i++) {
+		size = bench_data_fill(data, BENCH_DATA_SIZE,
+				       inputs[i].words, inputs[i].count);
+		bench_tokenizer("simple", inputs[i].name, data, size, rounds);
+		bench_tokenizer("tr29", inputs[i].name, data, size, rounds);
+	}
+	i_free(data);
+	fts_tokenizers_deinit();
+
+	lib_deinit();
+	return 0;
+}
@@ -18,3 +18,14 @@ void fts_filter_truncate_token(string_t *token, size_t max_length)
 	str_truncate(token, len);
 	i_assert(len <= max_length);
 }
+
+bool fts_filter_token_is_ascii(const char *token)
+{
+	const unsigned char *p = (const unsigned char *)token;
+
+	for (; *p != '\0'; p++) {
+		if (*p >= 0x80)
+			return FALSE;
+	}
+	return TRUE;
+}
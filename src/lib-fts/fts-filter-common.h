@@ -2,5 +2,7 @@
 #define FTS_FILTER_COMMON_H
 
 void fts_filter_truncate_token(string_t *token, size_t max_length);
+/* Returns TRUE if the token contains only 7bit ASCII characters. */
+bool fts_filter_token_is_ascii(const char *token);
 
 #endif
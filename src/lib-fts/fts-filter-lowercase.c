@@ -50,7 +50,13 @@ fts_filter_lowercase_filter(struct fts_filter *filter ATTR_UNUSED,
 {
 #ifdef HAVE_LIBICU
 	str_truncate(filter->token, 0);
-	fts_icu_lcase(filter->token, *token);
+	if (fts_filter_token_is_ascii(*token)) {
+		/* most tokens are plain ASCII - no need for ICU with them */
+		str_append(filter->token, *token);
+		str_lcase(str_c_modifiable(filter->token));
+	} else {
+		fts_icu_lcase(filter->token, *token);
+	}
 	fts_filter_truncate_token(filter->token, filter->max_length);
 	*token = str_c(filter->token);
 #else
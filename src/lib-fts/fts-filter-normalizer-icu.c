@@ -8,13 +8,21 @@
 #include "fts-filter-private.h"
 #include "fts-language.h"
 
+#include <ctype.h>
+
 #ifdef HAVE_LIBICU
 #include "fts-icu.h"
 
+#define FTS_FILTER_NORMALIZER_ICU_DEFAULT_ID \
+	"Any-Lower; NFKD; [: Nonspacing Mark :] Remove; NFC; [\\x20] Remove"
+
 struct fts_filter_normalizer_icu {
 	struct fts_filter filter;
 	pool_t pool;
 	const char *transliterator_id;
+	/* Using the default transliterator, which for ASCII input only
+	   lowercases and removes spaces. */
+	bool default_id;
 
 	UTransliterator *transliterator;
 	ARRAY_TYPE(icu_utf16) utf16_token, trans_token;
@@ -40,7 +48,7 @@ fts_filter_normalizer_icu_create(const struct fts_language *lang ATTR_UNUSED,
 	struct fts_filter_normalizer_icu *np;
 	pool_t pp;
 	unsigned int i, max_length = 250;
-	const char *id = "Any-Lower; NFKD; [: Nonspacing Mark :] Remove; NFC; [\\x20] Remove";
+	const char *id = FTS_FILTER_NORMALIZER_ICU_DEFAULT_ID;
 
 	for (i = 0; settings[i] != NULL; i += 2) {
 		const char *key = settings[i], *value = settings[i+1];
@@ -65,6 +73,7 @@ fts_filter_normalizer_icu_create(const struct fts_language *lang ATTR_UNUSED,
 	np->pool = pp;
 	np->filter = *fts_filter_normalizer_icu;
 	np->transliterator_id = p_strdup(pp, id);
+	np->default_id = strcmp(id, FTS_FILTER_NORMALIZER_ICU_DEFAULT_ID) == 0;
 	p_array_init(&np->utf16_token, pp, 64);
 	p_array_init(&np->trans_token, pp, 64);
 	np->utf8_token = buffer_create_dynamic(pp, 128);
@@ -73,6 +82,26 @@ fts_filter_normalizer_icu_create(const struct fts_language *lang ATTR_UNUSED,
 	return 0;
 }
 
+static int
+fts_filter_normalizer_icu_filter_ascii(struct fts_filter_normalizer_icu *np,
+				       const char **token)
+{
+	const char *p;
+
+	/* Same as what the default transliterator does for ASCII input,
+	   but without the conversions to UTF-16 and back. */
+	str_truncate(np->utf8_token, 0);
+	for (p = *token; *p != '\0'; p++) {
+		if (*p != ' ')
+			str_append_c(np->utf8_token, i_tolower(*p));
+	}
+	if (str_len(np->utf8_token) == 0)
+		return 0;
+	fts_filter_truncate_token(np->utf8_token, np->filter.max_length);
+	*token = str_c(np->utf8_token);
+	return 1;
+}
+
 static int
 fts_filter_normalizer_icu_filter(struct fts_filter *filter, const char **token,
 				 const char **error_r)
@@ -80,6 +109,9 @@ fts_filter_normalizer_icu_filter(struct fts_filter *filter, const char **token,
 	struct fts_filter_normalizer_icu *np =
 		(struct fts_filter_normalizer_icu *)filter;
 
+	if (np->default_id && fts_filter_token_is_ascii(*token))
+		return fts_filter_normalizer_icu_filter_ascii(np, token);
+
 	if (np->transliterator == NULL)
 		if (fts_icu_transliterator_create(np->transliterator_id,
 		                                  &np->transliterator,
@@ -30,6 +30,9 @@ struct fts_filter {
 	string_t *token;
 	size_t max_length;
 	int refcount;
+
+	/* Cache of already filtered tokens, see fts_filter_cache_init() */
+	struct fts_filter_cache *cache;
 };
 
 #endif
@@ -3,6 +3,8 @@
 #include "lib.h"
 #include "array.h"
 #include "str.h"
+#include "hash.h"
+#include "llist.h"
 #include "fts-language.h"
 #include "fts-filter-private.h"
 
@@ -10,6 +12,21 @@
 #  include "fts-icu.h"
 #endif
 
+struct fts_filter_cache_entry {
+	struct fts_filter_cache_entry *prev, *next;
+
+	char *token;
+	/* NULL if the token was filtered out */
+	char *result;
+};
+
+struct fts_filter_cache {
+	HASH_TABLE(char *, struct fts_filter_cache_entry *) entries;
+	/* head is the most recently used entry */
+	struct fts_filter_cache_entry *head, *tail;
+	unsigned int count, max_count;
+};
+
 static ARRAY(const struct fts_filter *) fts_filter_classes;
 
 void fts_filters_init(void)
@@ -94,6 +111,28 @@ void fts_filter_ref(struct fts_filter *fp)
 	fp->refcount++;
 }
 
+static void fts_filter_cache_entry_free(struct fts_filter_cache_entry *entry)
+{
+	i_free(entry->token);
+	i_free(entry->result);
+}
+
+static void fts_filter_cache_deinit(struct fts_filter_cache **_cache)
+{
+	struct fts_filter_cache *cache = *_cache;
+	struct fts_filter_cache_entry *entry;
+
+	*_cache = NULL;
+	while (cache->head != NULL) {
+		entry = cache->head;
+		DLLIST2_REMOVE(&cache->head, &cache->tail, entry);
+		fts_filter_cache_entry_free(entry);
+		i_free(entry);
+	}
+	hash_table_destroy(&cache->entries);
+	i_free(cache);
+}
+
 void fts_filter_unref(struct fts_filter **_fpp)
 {
 	struct fts_filter *fp = *_fpp;
@@ -104,6 +143,8 @@ void fts_filter_unref(struct fts_filter **_fpp)
 	if (--fp->refcount > 0)
 		return;
 
+	if (fp->cache != NULL)
+		fts_filter_cache_deinit(&fp->cache);
 	if (fp->parent != NULL)
 		fts_filter_unref(&fp->parent);
 	if (fp->v.destroy != NULL)
@@ -115,12 +156,23 @@ void fts_filter_unref(struct fts_filter **_fpp)
 	}
 }
 
-int fts_filter_filter(struct fts_filter *filter, const char **token,
-		      const char **error_r)
+void fts_filter_cache_init(struct fts_filter *filter, unsigned int max_count)
 {
-	int ret = 0;
+	struct fts_filter_cache *cache;
 
-	i_assert((*token)[0] != '\0');
+	i_assert(filter->cache == NULL);
+	i_assert(max_count > 0);
+
+	cache = i_new(struct fts_filter_cache, 1);
+	cache->max_count = max_count;
+	hash_table_create(&cache->entries, default_pool, 0, str_hash, strcmp);
+	filter->cache = cache;
+}
+
+static int fts_filter_filter_chain(struct fts_filter *filter,
+				   const char **token, const char **error_r)
+{
+	int ret = 0;
 
 	/* Recurse to parent. */
 	if (filter->parent != NULL)
@@ -129,6 +181,59 @@ int fts_filter_filter(struct fts_filter *filter, const char **token,
 	/* Parent returned token or no parent. */
 	if (ret > 0 || filter->parent == NULL)
 		ret = filter->v.filter(filter, token, error_r);
+	return ret;
+}
+
+static int fts_filter_filter_cached(struct fts_filter *filter,
+				    const char **token, const char **error_r)
+{
+	struct fts_filter_cache *cache = filter->cache;
+	struct fts_filter_cache_entry *entry;
+	const char *orig_token = *token;
+	int ret;
+
+	entry = hash_table_lookup(cache->entries, orig_token);
+	if (entry != NULL) {
+		if (entry != cache->head) {
+			DLLIST2_REMOVE(&cache->head, &cache->tail, entry);
+			DLLIST2_PREPEND(&cache->head, &cache->tail, entry);
+		}
+		*token = entry->result;
+		return entry->result == NULL ? 0 : 1;
+	}
+
+	ret = fts_filter_filter_chain(filter, token, error_r);
+	if (ret < 0)
+		return -1;
+
+	if (cache->count < cache->max_count) {
+		entry = i_new(struct fts_filter_cache_entry, 1);
+		cache->count++;
+	} else {
+		/* reuse the least recently used entry */
+		entry = cache->tail;
+		hash_table_remove(cache->entries, entry->token);
+		DLLIST2_REMOVE(&cache->head, &cache->tail, entry);
+		fts_filter_cache_entry_free(entry);
+	}
+	entry->token = i_strdup(orig_token);
+	entry->result = ret == 0 ? NULL : i_strdup(*token);
+	hash_table_insert(cache->entries, entry->token, entry);
+	DLLIST2_PREPEND(&cache->head, &cache->tail, entry);
+	return ret;
+}
+
+int fts_filter_filter(struct fts_filter *filter, const char **token,
+		      const char **error_r)
+{
+	int ret;
+
+	i_assert((*token)[0] != '\0');
+
+	if (filter->cache != NULL)
+		ret = fts_filter_filter_cached(filter, token, error_r);
+	else
+		ret = fts_filter_filter_chain(filter, token, error_r);
 
 	if (ret <= 0)
 		*token = NULL;
@@ -68,4 +68,11 @@ void fts_filter_unref(struct fts_filter **filter);
 int fts_filter_filter(struct fts_filter *filter, const char **token,
 		      const char **error_r);
 
+/* Remember the results of filtering up to max_count most recently used
+   tokens through the filter and all of its parents, so the same words don't
+   need to be filtered again and again. Tokens that were filtered out are
+   remembered as well, but errors are not. All the filters in the chain must
+   return the same output for the same input token. */
+void fts_filter_cache_init(struct fts_filter *filter, unsigned int max_count);
+
 #endif
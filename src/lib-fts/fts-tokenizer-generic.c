@@ -32,6 +32,13 @@ static unsigned char fts_ascii_word_breaks[128] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0  /* 112-127: {|}~ */
 };
 
+/* TR29 letter types of ASCII characters, filled from the Unicode tables by
+   fts_ascii_letter_types_init() */
+static enum letter_type fts_ascii_letter_types[128];
+static bool fts_ascii_letter_types_initialized = FALSE;
+
+static void fts_ascii_letter_types_init(void);
+
 static int
 fts_tokenizer_generic_create(const char *const *settings,
 			     struct fts_tokenizer **tokenizer_r,
@@ -92,9 +99,10 @@ fts_tokenizer_generic_create(const char *const *settings,
 	}
 
 	tok = i_new(struct generic_fts_tokenizer, 1);
-	if (algo == BOUNDARY_ALGORITHM_TR29)
+	if (algo == BOUNDARY_ALGORITHM_TR29) {
+		fts_ascii_letter_types_init();
 		tok->tokenizer.v = &generic_tokenizer_vfuncs_tr29;
-	else
+	} else
 		tok->tokenizer.v = &generic_tokenizer_vfuncs_simple;
 	tok->max_length = max_length;
 	tok->algorithm = algo;
@@ -230,6 +238,36 @@ fts_simple_is_word_break(const struct generic_fts_tokenizer *tok,
 		   ? FTS_FROM_WORD : FTS_FROM_STOP);
 }
 
+/* Returns the number of characters at the beginning of data that are ASCII
+   letters (or anything else that is part of a word), but not apostrophes.
+   These don't need the full word break logic when they continue a word. */
+static inline size_t
+fts_ascii_word_run(const unsigned char *data, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		if (data[i] >= 0x80 || fts_ascii_word_breaks[data[i]] != 0 ||
+		    data[i] == '\'')
+			break;
+	}
+	return i;
+}
+
+/* Returns the number of ASCII word breaking characters at the beginning of
+   data. */
+static inline size_t
+fts_ascii_break_run(const unsigned char *data, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		if (data[i] >= 0x80 || fts_ascii_word_breaks[data[i]] == 0)
+			break;
+	}
+	return i;
+}
+
 static void fts_tokenizer_generic_reset(struct fts_tokenizer *_tok)
 {
 	struct generic_fts_tokenizer *tok =
@@ -347,7 +385,7 @@ fts_tokenizer_generic_simple_next(struct fts_tokenizer *_tok,
 {
 	struct generic_fts_tokenizer *tok =
 		container_of(_tok, struct generic_fts_tokenizer, tokenizer);
-	size_t i, start;
+	size_t i, start, run;
 	int char_size;
 	unichar_t c;
 	bool apostrophe;
@@ -355,6 +393,27 @@ fts_tokenizer_generic_simple_next(struct fts_tokenizer *_tok,
 
 	start = tok->token->used > 0 ? 0 : skip_base64(data, size);
 	for (i = start; i < size; i += char_size) {
+		/* Fast path for ASCII text: a run of letters continuing a
+		   word, or a run of separators between words, doesn't change
+		   anything except the current position. */
+		if (tok->prev_type == LETTER_TYPE_ALETTER) {
+			run = fts_ascii_word_run(data + i, size - i);
+			if (run > 0) {
+				shift_prev_type(tok, LETTER_TYPE_ALETTER);
+				char_size = run;
+				continue;
+			}
+		} else if (tok->prev_type == LETTER_TYPE_NONE &&
+			   tok->token->used == 0 && start == i) {
+			run = fts_ascii_break_run(data + i, size - i);
+			if (run > 0) {
+				shift_prev_type(tok, LETTER_TYPE_NONE);
+				start = i + run;
+				char_size = run;
+				continue;
+			}
+		}
+
 		char_size = uni_utf8_get_char_n(data + i, size - i, &c);
 		i_assert(char_size > 0);
 
@@ -415,7 +474,7 @@ fts_tokenizer_generic_simple_next(struct fts_tokenizer *_tok,
    HYPHEN.
    TODO
 */
-static enum letter_type letter_type(unichar_t c)
+static enum letter_type letter_type_uni(unichar_t c)
 {
 	unsigned int idx;
 
@@ -458,6 +517,25 @@ static enum letter_type letter_type(unichar_t c)
 	return LETTER_TYPE_OTHER;
 }
 
+static void fts_ascii_letter_types_init(void)
+{
+	unichar_t c;
+
+	if (fts_ascii_letter_types_initialized)
+		return;
+	for (c = 0; c < N_ELEMENTS(fts_ascii_letter_types); c++)
+		fts_ascii_letter_types[c] = letter_type_uni(c);
+	fts_ascii_letter_types_initialized = TRUE;
+}
+
+static inline enum letter_type letter_type(unichar_t c)
+{
+	/* Avoid the binary searches for plain ASCII text */
+	if (c < N_ELEMENTS(fts_ascii_letter_types))
+		return fts_ascii_letter_types[c];
+	return letter_type_uni(c);
+}
+
 static bool letter_panic(struct generic_fts_tokenizer *tok ATTR_UNUSED)
 {
 	i_panic("Letter type should not be used.");
@@ -812,8 +890,13 @@ fts_tokenizer_generic_tr29_next(struct fts_tokenizer *_tok,
 	start_pos = tok->token->used > 0 ? 0 : skip_base64(data, size);
 	for (i = start_pos; i < size; ) {
 		char_start_i = i;
-		char_size = uni_utf8_get_char_n(data + i, size - i, &c);
-		i_assert(char_size > 0);
+		if (data[i] < 0x80) {
+			c = data[i];
+			char_size = 1;
+		} else {
+			char_size = uni_utf8_get_char_n(data + i, size - i, &c);
+			i_assert(char_size > 0);
+		}
 		i += char_size;
 		lt = letter_type(c);
 
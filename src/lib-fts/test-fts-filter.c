@@ -576,6 +576,38 @@ static void test_fts_filter_normalizer_swedish_short_default_id(void)
 	test_end();
 }
 
+static void test_fts_filter_normalizer_ascii(void)
+{
+	/* same as the default ID, so the ASCII fast path isn't used */
+	const char *const settings[] = {
+		"id", "Any-Lower;NFKD;[: Nonspacing Mark :] Remove;NFC;[\\x20] Remove",
+		NULL
+	};
+	const char *input[] = {
+		"abc", "ABC", "Hello World", "3.14", "it's", "a-b_c!",
+		"  ", " x ", "\tTab\r\n", "~`@#$%^&*()[]{}|\\/<>,.;:\"'",
+	};
+	struct fts_filter *norm_default, *norm_icu;
+	const char *token, *token_icu, *error;
+	unsigned int i;
+	int ret, ret_icu;
+
+	test_begin("fts filter normalizer ASCII fast path");
+	test_assert(fts_filter_create(fts_filter_normalizer_icu, NULL, NULL, NULL, &norm_default, &error) == 0);
+	test_assert(fts_filter_create(fts_filter_normalizer_icu, NULL, NULL, settings, &norm_icu, &error) == 0);
+	for (i = 0; i < N_ELEMENTS(input); i++) {
+		token = input[i];
+		ret = fts_filter_filter(norm_default, &token, &error);
+		token_icu = input[i];
+		ret_icu = fts_filter_filter(norm_icu, &token_icu, &error);
+		test_assert_idx(ret == ret_icu, i);
+		test_assert_idx(null_strcmp(token, token_icu) == 0, i);
+	}
+	fts_filter_unref(&norm_default);
+	fts_filter_unref(&norm_icu);
+	test_end();
+}
+
 /* UDHRDIR comes from Automake AM_CPPFLAGS */
 #define UDHR_FRA_NAME "/udhr_fra.txt"
 static void test_fts_filter_normalizer_french(void)
@@ -973,6 +1005,44 @@ static void test_fts_filter_english_possessive(void)
 	test_end();
 }
 
+static void test_fts_filter_cache(void)
+{
+	const char *input[] = {
+		"An", "elephant", "AND", "a", "Bear", "an", "elephant", "and",
+		"the", "bear", "ELEPHANT", "reason", "an", "Bear", "no",
+		"reason", "elephant",
+	};
+	struct fts_filter *lcase, *filter, *lcase_cached, *filter_cached;
+	const char *token, *token_cached, *error;
+	unsigned int i, round;
+	int ret, ret_cached;
+
+	test_begin("fts filter cache");
+	test_assert(fts_filter_create(fts_filter_lowercase, NULL, &english_language, NULL, &lcase, &error) == 0);
+	test_assert(fts_filter_create(fts_filter_stopwords, lcase, &english_language, stopword_settings, &filter, &error) == 0);
+	test_assert(fts_filter_create(fts_filter_lowercase, NULL, &english_language, NULL, &lcase_cached, &error) == 0);
+	test_assert(fts_filter_create(fts_filter_stopwords, lcase_cached, &english_language, stopword_settings, &filter_cached, &error) == 0);
+	/* small enough that entries get evicted */
+	fts_filter_cache_init(filter_cached, 3);
+
+	for (round = 0; round < 2; round++) {
+		for (i = 0; i < N_ELEMENTS(input); i++) {
+			token = input[i];
+			ret = fts_filter_filter(filter, &token, &error);
+			token_cached = input[i];
+			ret_cached = fts_filter_filter(filter_cached,
+						       &token_cached, &error);
+			test_assert_idx(ret >= 0 && ret == ret_cached, i);
+			test_assert_idx(null_strcmp(token, token_cached) == 0, i);
+		}
+	}
+	fts_filter_unref(&filter);
+	fts_filter_unref(&lcase);
+	fts_filter_unref(&filter_cached);
+	fts_filter_unref(&lcase_cached);
+	test_end();
+}
+
 /* TODO: Functions to test 1. ref-unref pairs 2. multiple registers +
   an unregister + find */
 
@@ -1007,6 +1077,7 @@ int main(void)
 		test_fts_filter_normalizer_invalid_id,
 		test_fts_filter_normalizer_oversized,
 		test_fts_filter_normalizer_truncation,
+		test_fts_filter_normalizer_ascii,
 #ifdef HAVE_FTS_STEMMER
 		test_fts_filter_normalizer_stopwords_stemmer_eng,
 		test_fts_filter_stopwords_normalizer_stemmer_no,
@@ -1014,6 +1085,7 @@ int main(void)
 #endif
 #endif
 		test_fts_filter_english_possessive,
+		test_fts_filter_cache,
 		NULL
 	};
 	int ret;
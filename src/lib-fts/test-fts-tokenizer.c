@@ -524,6 +524,71 @@ static void test_fts_tokenizer_random(void)
 	test_end();
 }
 
+static void
+test_tokenizer_get_tokens(struct fts_tokenizer *tok, const unsigned char *data,
+			  size_t size, size_t chunk_size, string_t *tokens)
+{
+	const char *token, *error;
+	size_t pos, len;
+
+	for (pos = 0; pos < size; pos += len) {
+		len = I_MIN(chunk_size, size - pos);
+		/* don't split UTF-8 characters */
+		while (pos + len < size && (data[pos + len] & 0xc0) == 0x80)
+			len++;
+		while (fts_tokenizer_next(tok, data + pos, len,
+					  &token, &error) > 0)
+			str_printfa(tokens, "%s\n", token);
+	}
+	while (fts_tokenizer_final(tok, &token, &error) > 0)
+		str_printfa(tokens, "%s\n", token);
+}
+
+static void test_fts_tokenizer_ascii_runs(void)
+{
+	/* The ASCII fast paths skip over runs of letters and separators.
+	   Make sure the result doesn't depend on where the input is split. */
+	static const char *const test_words[] = {
+		"a", "word", "longerword", " ", "  ",
+		", ", ".", "'", "''", "*", "\r\n", "\xC3\xA4", "\xE2\x80\x99",
+		"\xEF\xBC\x8E", "123", "3.14"
+	};
+	/* Truncating long tokens and skipping base64-looking data depend on
+	   the input splitting, so keep the words short. */
+	const char *const settings[][5] = {
+		{ "algorithm", "simple", "maxlen", "1000", NULL },
+		{ "algorithm", "tr29", "maxlen", "1000", NULL },
+	};
+	struct fts_tokenizer *tok;
+	string_t *input = t_str_new(256);
+	string_t *tokens1 = t_str_new(256), *tokens2 = t_str_new(256);
+	const char *error;
+	unsigned int i, j, n;
+
+	test_begin("fts tokenizer ascii runs");
+	for (n = 0; n < N_ELEMENTS(settings); n++) {
+		test_assert(fts_tokenizer_create(fts_tokenizer_generic, NULL,
+						 settings[n], &tok, &error) == 0);
+		for (i = 0; i < 1000; i++) {
+			str_truncate(input, 0);
+			for (j = i_rand_minmax(1, 20); j > 0; j--) {
+				str_append(input, test_words[
+					i_rand_limit(N_ELEMENTS(test_words))]);
+			}
+			str_truncate(tokens1, 0);
+			str_truncate(tokens2, 0);
+			test_tokenizer_get_tokens(tok, str_data(input),
+						  str_len(input), SIZE_MAX,
+						  tokens1);
+			test_tokenizer_get_tokens(tok, str_data(input),
+						  str_len(input),
+						  i_rand_minmax(1, 8), tokens2);
+			test_assert_strcmp_idx(str_c(tokens1), str_c(tokens2), i);
+		}
+		fts_tokenizer_unref(&tok);
+	}
+	test_end();
+}
 
 static void
 test_fts_tokenizer_explicit_prefix(void)
@@ -677,6 +742,7 @@ int main(void)
 		test_fts_tokenizer_address_search,
 		test_fts_tokenizer_delete_trailing_partial_char,
 		test_fts_tokenizer_random,
+		test_fts_tokenizer_ascii_runs,
 		test_fts_tokenizer_explicit_prefix,
 		NULL
 	};
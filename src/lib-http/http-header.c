@@ -27,16 +27,19 @@ http_header_field_add(struct http_header *header,
 {
 	struct http_header_field *hfield;
 	pool_t pool = array_get_pool(&header->fields);
-	void *value;
+	size_t name_size = strlen(name) + 1;
+	char *buf;
+
+	/* allocate the name and the value with a single allocation */
+	buf = p_malloc(pool, name_size + size + 1);
+	memcpy(buf, name, name_size);
+	memcpy(buf + name_size, data, size);
 
 	hfield = array_append_space(&header->fields);
-	hfield->name = p_strdup(pool, name);
+	hfield->name = buf;
+	hfield->value = buf + name_size;
 	hfield->size = size;
 
-	value = p_malloc(pool, size+1);
-	memcpy(value, data, size);
-	hfield->value = (const char *)value;
-
 	return hfield;
 }
 
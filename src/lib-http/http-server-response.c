@@ -57,7 +57,7 @@ http_server_response_create(struct http_server_request *req,
 	resp->request = req;
 	resp->status = status;
 	resp->reason = p_strdup(req->pool, reason);
-	resp->headers = str_new(default_pool, 256);
+	resp->headers = str_new(req->pool, 256);
 	resp->date = (time_t)-1;
 	resp->event = event_create(req->event);
 	http_server_response_update_event(resp);
@@ -587,6 +587,22 @@ int http_server_response_send_more(struct http_server_response *resp)
 	i_unreached();
 }
 
+static const char *http_server_response_get_date(time_t date)
+{
+	/* All the responses sent within the same second have the same Date
+	   header, so avoid formatting it for each one of them. */
+	static time_t cached_date;
+	static char cached_date_str[64] = "";
+
+	if (date != cached_date || cached_date_str[0] == '\0') {
+		if (i_strocpy(cached_date_str, http_date_create(date),
+			      sizeof(cached_date_str)) < 0)
+			i_unreached();
+		cached_date = date;
+	}
+	return cached_date_str;
+}
+
 static int http_server_response_send_real(struct http_server_response *resp)
 {
 	struct http_server_request *req = resp->request;
@@ -705,7 +721,7 @@ static int http_server_response_send_real(struct http_server_response *resp)
 	   http_server_response_add_header() */
 	if (!resp->have_hdr_date) {
 		str_append(rtext, "\r\nDate: ");
-		str_append(rtext, http_date_create(resp->date));
+		str_append(rtext, http_server_response_get_date(resp->date));
 		str_append(rtext, "\r\n");
 	}
 	if (array_is_created(&resp->auth_challenges)) {
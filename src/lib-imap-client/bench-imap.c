@@ -0,0 +1,362 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "bits.h"
+#include "ioloop.h"
+#include "istream.h"
+#include "strnum.h"
+#include "time-util.h"
+#include "imapc-client.h"
+
+#include <stdio.h>
+
+/**
+ * Replays an IMAP workload against a running server and reports the latency
+ * histogram of each command and the throughput. The time spent waiting while
+ * IDLEing isn't included in the throughput. It's meant to be run against a
+ * test instance and account, since it APPENDs messages to the mailbox.
+ *
+ * Each round consists of "login" sessions. Each session SELECTs the mailbox
+ * "select" times, and after each SELECT it runs the "append", "fetch",
+ * "search" and "idle" commands the given number of times. The counts can be
+ * changed with the <mix> parameter, e.g. "login=1,select=2,fetch=10".
+ *
+ *  - login: connect, wait for the banner, CAPABILITY and LOGIN
+ *  - fetch: a range of BENCH_FETCH_RANGE messages with envelope-like fields
+ *  - search: rotating through a few typical client searches
+ *  - append: a small message
+ *  - idle: enter IDLE, wait until the server confirms it and measure the
+ *    time to leave it (DONE + tagged reply + NOOP)
+ */
+
+#define BENCH_FETCH_RANGE 50
+#define BENCH_IDLE_WAIT_MSECS 200
+#define BENCH_HIST_BUCKETS 32
+
+enum bench_cmd {
+	BENCH_CMD_LOGIN,
+	BENCH_CMD_SELECT,
+	BENCH_CMD_APPEND,
+	BENCH_CMD_FETCH,
+	BENCH_CMD_SEARCH,
+	BENCH_CMD_IDLE,
+
+	BENCH_CMD_COUNT
+};
+
+static const char *const bench_cmd_names[BENCH_CMD_COUNT] = {
+	"login", "select", "append", "fetch", "search", "idle"
+};
+
+static unsigned int bench_mix[BENCH_CMD_COUNT] = {
+	[BENCH_CMD_LOGIN] = 1,
+	[BENCH_CMD_SELECT] = 1,
+	[BENCH_CMD_APPEND] = 1,
+	[BENCH_CMD_FETCH] = 4,
+	[BENCH_CMD_SEARCH] = 2,
+	[BENCH_CMD_IDLE] = 1,
+};
+
+static const char *const bench_searches[] = {
+	"UID SEARCH UNSEEN",
+	"UID SEARCH SINCE 1-Jan-2020",
+	"UID SEARCH FROM \"sender\"",
+	"UID SEARCH SUBJECT \"benchmark\"",
+};
+
+static const char bench_message[] =
+	"From: Benchmark Sender <sender@example.com>\r\n"
+	"To: Benchmark Recipient <recipient@example.com>\r\n"
+	"Subject: benchmark message\r\n"
+	"Date: Wed, 14 Oct 2026 12:00:00 +0000\r\n"
+	"Message-ID: <bench-imap@example.com>\r\n"
+	"MIME-Version: 1.0\r\n"
+	"Content-Type: text/plain; charset=us-ascii\r\n"
+	"\r\n"
+	"This message was appended by bench-imap.\r\n";
+
+struct bench_stats {
+	unsigned int count;
+	uint64_t total_nsecs, max_nsecs;
+	/* bucket n has the commands that took [2^(n-1), 2^n) usecs */
+	unsigned int buckets[BENCH_HIST_BUCKETS];
+};
+
+struct bench_session {
+	struct imapc_client *client;
+	struct imapc_client_mailbox *box;
+	const char *mailbox;
+
+	enum bench_cmd cmd;
+	uint64_t cmd_start;
+	uint32_t exists;
+	unsigned int search_idx;
+};
+
+static struct ioloop *ioloop;
+static struct bench_stats bench_stats[BENCH_CMD_COUNT];
+
+static void bench_stats_add(struct bench_stats *stats, uint64_t nsecs)
+{
+	unsigned int bucket = bits_required64(nsecs / 1000);
+
+	stats->count++;
+	stats->total_nsecs += nsecs;
+	if (stats->max_nsecs < nsecs)
+		stats->max_nsecs = nsecs;
+	if (bucket >= BENCH_HIST_BUCKETS)
+		bucket = BENCH_HIST_BUCKETS - 1;
+	stats->buckets[bucket]++;
+}
+
+/* Returns the upper bound of the bucket containing the given percentile. */
+static uint64_t
+bench_stats_percentile_usecs(const struct bench_stats *stats,
+			     unsigned int percentile)
+{
+	unsigned int i, sum = 0;
+
+	for (i = 0; i < BENCH_HIST_BUCKETS; i++) {
+		sum += stats->buckets[i];
+		if ((uint64_t)sum * 100 >= (uint64_t)stats->count * percentile)
+			break;
+	}
+	return (uint64_t)1 << i;
+}
+
+static void bench_stats_print(const char *name,
+			      const struct bench_stats *stats)
+{
+	unsigned int i;
+
+	if (stats->count == 0)
+		return;
+	printf("%s: %u commands, avg %.0lf us, p50 < %"PRIu64" us, "
+	       "p99 < %"PRIu64" us, max %"PRIu64" us\n", name, stats->count,
+	       (double)stats->total_nsecs / 1000 / stats->count,
+	       bench_stats_percentile_usecs(stats, 50),
+	       bench_stats_percentile_usecs(stats, 99),
+	       stats->max_nsecs / 1000);
+	for (i = 0; i < BENCH_HIST_BUCKETS; i++) {
+		if (stats->buckets[i] == 0)
+			continue;
+		printf("\t< %10"PRIu64" us %8u %5.1lf%%\n", (uint64_t)1 << i,
+		       stats->buckets[i],
+		       stats->buckets[i] * 100.0 / stats->count);
+	}
+}
+
+static void
+bench_cmd_callback(const struct imapc_command_reply *reply, void *context)
+{
+	struct bench_session *session = context;
+
+	if (reply->state != IMAPC_COMMAND_STATE_OK) {
+		i_fatal("%s failed: %s: %s", bench_cmd_names[session->cmd],
+			imapc_command_state_names[reply->state],
+			reply->text_full);
+	}
+	imapc_client_stop(session->client);
+}
+
+static void
+bench_untagged_callback(const struct imapc_untagged_reply *reply,
+			void *context)
+{
+	struct bench_session *session = context;
+
+	if (strcasecmp(reply->name, "EXISTS") == 0)
+		session->exists = reply->num;
+}
+
+static struct imapc_command *
+bench_cmd_begin(struct bench_session *session, enum bench_cmd cmd)
+{
+	session->cmd = cmd;
+	session->cmd_start = i_nanoseconds();
+	return imapc_client_mailbox_cmd(session->box, bench_cmd_callback,
+					session);
+}
+
+static void bench_cmd_finish(struct bench_session *session)
+{
+	imapc_client_run(session->client);
+	bench_stats_add(&bench_stats[session->cmd],
+			i_nanoseconds() - session->cmd_start);
+}
+
+static void bench_select(struct bench_session *session)
+{
+	struct imapc_command *cmd;
+
+	cmd = bench_cmd_begin(session, BENCH_CMD_SELECT);
+	imapc_command_set_flags(cmd, IMAPC_COMMAND_FLAG_SELECT);
+	imapc_command_sendf(cmd, "SELECT %s", session->mailbox);
+	bench_cmd_finish(session);
+}
+
+static void bench_append(struct bench_session *session)
+{
+	struct imapc_command *cmd;
+	struct istream *input;
+
+	input = i_stream_create_from_data(bench_message,
+					  sizeof(bench_message) - 1);
+	cmd = bench_cmd_begin(session, BENCH_CMD_APPEND);
+	imapc_command_sendf(cmd, "APPEND %s %p", session->mailbox, input);
+	i_stream_unref(&input);
+	bench_cmd_finish(session);
+}
+
+static void bench_fetch(struct bench_session *session)
+{
+	struct imapc_command *cmd;
+	uint32_t seq1, seq2;
+
+	if (session->exists == 0)
+		return;
+	seq1 = i_rand_minmax(1, session->exists);
+	seq2 = I_MIN(seq1 + BENCH_FETCH_RANGE - 1, session->exists);
+
+	cmd = bench_cmd_begin(session, BENCH_CMD_FETCH);
+	imapc_command_sendf(cmd, "FETCH %u:%u (UID FLAGS INTERNALDATE "
+		"RFC822.SIZE BODY.PEEK[HEADER.FIELDS "
+		"(From To Cc Subject Date Message-ID)])", seq1, seq2);
+	bench_cmd_finish(session);
+}
+
+static void bench_search(struct bench_session *session)
+{
+	struct imapc_command *cmd;
+
+	cmd = bench_cmd_begin(session, BENCH_CMD_SEARCH);
+	imapc_command_send(cmd, bench_searches[session->search_idx++ %
+					       N_ELEMENTS(bench_searches)]);
+	bench_cmd_finish(session);
+}
+
+static void bench_idle(struct bench_session *session)
+{
+	struct imapc_command *cmd;
+	struct timeout *to;
+
+	/* imapc sends the IDLE after a small delay in the caller's ioloop */
+	imapc_client_mailbox_idle(session->box);
+	to = timeout_add_short(BENCH_IDLE_WAIT_MSECS, io_loop_stop, ioloop);
+	io_loop_run(ioloop);
+	timeout_remove(&to);
+
+	/* sending the next command makes imapc send DONE first */
+	cmd = bench_cmd_begin(session, BENCH_CMD_IDLE);
+	imapc_command_send(cmd, "NOOP");
+	bench_cmd_finish(session);
+}
+
+static void
+bench_session(const struct imapc_client_settings *set, const char *mailbox)
+{
+	struct bench_session session;
+	unsigned int i, j;
+
+	i_zero(&session);
+	session.mailbox = mailbox;
+	session.client = imapc_client_init(set, NULL);
+	imapc_client_register_untagged(session.client,
+				       bench_untagged_callback, &session);
+	imapc_client_set_login_callback(session.client,
+					bench_cmd_callback, &session);
+
+	session.cmd = BENCH_CMD_LOGIN;
+	session.cmd_start = i_nanoseconds();
+	imapc_client_login(session.client);
+	bench_cmd_finish(&session);
+
+	session.box = imapc_client_mailbox_open(session.client, NULL);
+	for (i = 0; i < bench_mix[BENCH_CMD_SELECT]; i++) {
+		bench_select(&session);
+		for (j = 0; j < bench_mix[BENCH_CMD_APPEND]; j++)
+			bench_append(&session);
+		for (j = 0; j < bench_mix[BENCH_CMD_FETCH]; j++)
+			bench_fetch(&session);
+		for (j = 0; j < bench_mix[BENCH_CMD_SEARCH]; j++)
+			bench_search(&session);
+		for (j = 0; j < bench_mix[BENCH_CMD_IDLE]; j++)
+			bench_idle(&session);
+	}
+	imapc_client_mailbox_close(&session.box);
+	imapc_client_logout(session.client);
+	imapc_client_deinit(&session.client);
+}
+
+static int bench_mix_parse(const char *str)
+{
+	const char *const *args = t_strsplit(str, ",");
+	const char *value;
+	unsigned int i;
+
+	for (; *args != NULL; args++) {
+		value = strchr(*args, '=');
+		if (value == NULL)
+			return -1;
+		for (i = 0; i < BENCH_CMD_COUNT; i++) {
+			if (strncmp(*args, bench_cmd_names[i],
+				    value - *args) == 0 &&
+			    bench_cmd_names[i][value - *args] == '\0')
+				break;
+		}
+		if (i == BENCH_CMD_COUNT ||
+		    str_to_uint(value + 1, &bench_mix[i]) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct imapc_client_settings set;
+	const char *mailbox = "INBOX";
+	unsigned int i, round, rounds = 10, commands = 0;
+	uint64_t total_nsecs = 0;
+	in_port_t port;
+
+	lib_init();
+	if (argc < 5 || net_str2port(argv[2], &port) < 0 ||
+	    (argc > 5 && str_to_uint(argv[5], &rounds) < 0) ||
+	    (argc > 6 && bench_mix_parse(argv[6]) < 0)) {
+		i_fatal("Usage: %s <host> <port> <user> <password> "
+			"[<rounds> [<mix> [<mailbox>]]]", argv[0]);
+	}
+	if (argc > 7)
+		mailbox = argv[7];
+
+	i_zero(&set);
+	set.host = argv[1];
+	set.port = port;
+	set.username = argv[3];
+	set.password = argv[4];
+	set.dns_client_socket_path = "";
+	set.temp_path_prefix = "/tmp/bench-imap-";
+	set.rawlog_dir = "";
+	set.max_idle_time = IMAPC_DEFAULT_MAX_IDLE_TIME;
+
+	ioloop = io_loop_create();
+	printf("IMAP workload against %s:%u, %u rounds:\n",
+	       set.host, set.port, rounds);
+	for (round = 0; round < rounds; round++) {
+		for (i = 0; i < bench_mix[BENCH_CMD_LOGIN]; i++)
+			bench_session(&set, mailbox);
+	}
+	io_loop_destroy(&ioloop);
+
+	for (i = 0; i < BENCH_CMD_COUNT; i++) {
+		bench_stats_print(bench_cmd_names[i], &bench_stats[i]);
+		commands += bench_stats[i].count;
+		total_nsecs += bench_stats[i].total_nsecs;
+	}
+	/* the waits while IDLEing aren't included */
+	printf("total: %u commands, %.0lf per second\n", commands,
+	       (double)commands * 1000000000 / (double)total_nsecs);
+
+	lib_deinit();
+	return 0;
+}
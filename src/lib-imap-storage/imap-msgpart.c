@@ -667,6 +667,24 @@ imap_msgpart_open_normal(struct mail *mail, struct imap_msgpart *msgpart,
 	return 0;
 }
 
+static void imap_msgpart_lookup_cached_nul_state(struct mail *mail)
+{
+	enum mail_lookup_abort orig_lookup_abort = mail->lookup_abort;
+	struct message_part *parts;
+
+	if (mail->has_nuls || mail->has_no_nuls)
+		return;
+
+	/* The NUL state is also known if the message parts are cached. If it
+	   turns out that there are no NULs, the stream doesn't need to be
+	   wrapped with a NUL filter, which allows the ostream to sendfile()
+	   CRLF-linefeed mails directly from the mail file. Don't parse the
+	   mail for this though, since filtering the NULs is cheaper. */
+	mail->lookup_abort = MAIL_LOOKUP_ABORT_NOT_IN_CACHE;
+	(void)mail_get_parts(mail, &parts);
+	mail->lookup_abort = orig_lookup_abort;
+}
+
 int imap_msgpart_open(struct mail *mail, struct imap_msgpart *msgpart,
 		      struct imap_msgpart_open_result *result_r)
 {
@@ -702,6 +720,7 @@ int imap_msgpart_open(struct mail *mail, struct imap_msgpart *msgpart,
 		have_crlfs = TRUE;
 		use_partial_cache = FALSE;
 	} else {
+		imap_msgpart_lookup_cached_nul_state(mail);
 		if (imap_msgpart_open_normal(mail, msgpart, part, &virtual_size,
 					     &have_crlfs, result_r) < 0)
 			return -1;
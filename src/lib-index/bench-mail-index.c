@@ -0,0 +1,578 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "buffer.h"
+#include "str.h"
+#include "strnum.h"
+#include "time-util.h"
+#include "unlink-directory.h"
+#include "mail-index-private.h"
+#include "mail-cache-private.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+/**
+ * Generates a synthetic index and cache with the wanted number of messages
+ * and measures the common index and cache operations on it. The flags,
+ * keywords and cache fields are distributed roughly like in a typical
+ * INBOX that has been accessed by IMAP clients:
+ *
+ *  - \Seen in all but the newest 5% and 1% of the older messages,
+ *    \Answered 8%, \Flagged 2%, \Deleted 0.3%
+ *  - $NotJunk 15%, $Forwarded 3%, $Junk 2%, $MDNSent 1%, Work 1%
+ *  - date.received and size.virtual in all messages, imap.envelope in 90%,
+ *    imap.bodystructure in 40% and body.snippet in 20%
+ *
+ * The benchmarks are:
+ *
+ *  - generate: appending the messages with their flags, keywords and cache
+ *    fields in transactions of BENCH_GENERATE_BATCH messages
+ *  - map open: opening the index when dovecot.index is up to date
+ *  - sync replay: opening the index after BENCH_REPLAY_TRANSACTIONS flag
+ *    and keyword updates were committed to the .log only
+ *  - cache lookup: looking up all the cache fields of all messages
+ *  - write/rotate: a flag update followed by a sync that rotates the .log
+ *    and rewrites dovecot.index
+ *  - cache purge: rewriting dovecot.index.cache
+ *  - field scan: looking up date.received and size.virtual of all messages
+ *    after a purge without and with the columnar section for the fixed size
+ *    fields
+ *
+ * The number of messages defaults to 100k, and it can be given as a plain
+ * number or with k/M suffix (e.g. 2M). The index is created under
+ * BENCH_DIR in the current directory and deleted afterwards.
+ */
+
+#define BENCH_DIR ".bench-mail-index"
+#define BENCH_PREFIX "dovecot.index"
+#define BENCH_DEFAULT_MESSAGES 100000
+#define BENCH_GENERATE_BATCH 10000
+#define BENCH_REPLAY_TRANSACTIONS 10000
+#define BENCH_OPEN_ROUNDS 10
+#define BENCH_WRITE_ROUNDS 10
+
+struct bench_keyword {
+	const char *name;
+	/* per mille */
+	unsigned int probability;
+};
+
+static const struct bench_keyword bench_keywords[] = {
+	{ "$NotJunk", 150 },
+	{ "$Forwarded", 30 },
+	{ "$Junk", 20 },
+	{ "$MDNSent", 10 },
+	{ "Work", 10 },
+};
+
+enum bench_cache_field {
+	BENCH_CACHE_FIELD_DATE_RECEIVED,
+	BENCH_CACHE_FIELD_SIZE_VIRTUAL,
+	BENCH_CACHE_FIELD_ENVELOPE,
+	BENCH_CACHE_FIELD_BODYSTRUCTURE,
+	BENCH_CACHE_FIELD_SNIPPET,
+
+	BENCH_CACHE_FIELD_COUNT
+};
+
+static struct mail_cache_field bench_cache_fields[BENCH_CACHE_FIELD_COUNT] = {
+	{ .name = "date.received", .type = MAIL_CACHE_FIELD_FIXED_SIZE,
+	  .field_size = sizeof(uint32_t), .decision = MAIL_CACHE_DECISION_YES },
+	{ .name = "size.virtual", .type = MAIL_CACHE_FIELD_FIXED_SIZE,
+	  .field_size = sizeof(uoff_t), .decision = MAIL_CACHE_DECISION_YES },
+	{ .name = "imap.envelope", .type = MAIL_CACHE_FIELD_STRING,
+	  .decision = MAIL_CACHE_DECISION_YES },
+	{ .name = "imap.bodystructure", .type = MAIL_CACHE_FIELD_STRING,
+	  .decision = MAIL_CACHE_DECISION_YES },
+	{ .name = "body.snippet", .type = MAIL_CACHE_FIELD_VARIABLE_SIZE,
+	  .decision = MAIL_CACHE_DECISION_YES },
+};
+
+/* per mille */
+static const unsigned int bench_cache_field_probability[] = {
+	1000, 1000, 900, 400, 200
+};
+
+struct bench_ctx {
+	unsigned int messages;
+	struct mail_index *index;
+	struct mail_keywords *keywords[N_ELEMENTS(bench_keywords)];
+};
+
+static uint32_t bench_rand_state = 1;
+
+static uint32_t bench_rand(void)
+{
+	/* deterministic, so that the results are comparable between runs */
+	bench_rand_state = bench_rand_state * 1103515245 + 12345;
+	return (bench_rand_state >> 16) & 0x7fff;
+}
+
+static uint32_t bench_rand_seq(unsigned int messages)
+{
+	return ((bench_rand() << 15) | bench_rand()) % messages + 1;
+}
+
+static void
+bench_print(const char *name, uint64_t nsecs, unsigned int count,
+	    const char *unit)
+{
+	printf("\t%-20s %12.02lf us/%-6s %12.0lf %ss/s\n", name,
+	       (double)nsecs / 1000 / count, unit,
+	       (double)count * 1000000000 / (double)nsecs, unit);
+}
+
+static void bench_print_size(const char *name)
+{
+	const char *path = t_strconcat(BENCH_DIR"/"BENCH_PREFIX, name, NULL);
+	struct stat st;
+
+	if (stat(path, &st) < 0) {
+		if (errno != ENOENT)
+			i_fatal("stat(%s) failed: %m", path);
+		return;
+	}
+	printf("\t%-20s %12.02lf MB\n", t_strconcat(BENCH_PREFIX, name, NULL),
+	       (double)st.st_size / (1024*1024));
+}
+
+static void bench_index_fail(struct mail_index *index, const char *func)
+{
+	i_fatal("%s() failed: %s", func, mail_index_get_error_message(index));
+}
+
+static struct mail_index *
+bench_index_open(const struct mail_index_optimization_settings *set)
+{
+	struct mail_index *index;
+
+	index = mail_index_alloc(NULL, BENCH_DIR, BENCH_PREFIX);
+	if (set != NULL)
+		mail_index_set_optimization_settings(index, set);
+	if (mail_index_open_or_create(index, MAIL_INDEX_OPEN_FLAG_CREATE) < 0)
+		bench_index_fail(index, "mail_index_open_or_create");
+	mail_cache_register_fields(index->cache, bench_cache_fields,
+				   N_ELEMENTS(bench_cache_fields),
+				   MAIL_CACHE_TRUNCATE_NAME_FAIL);
+	return index;
+}
+
+static void bench_index_close(struct mail_index **index)
+{
+	mail_index_close(*index);
+	mail_index_free(index);
+}
+
+static void bench_index_sync(struct mail_index *index)
+{
+	struct mail_index_sync_ctx *sync_ctx;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	struct mail_index_sync_rec sync_rec;
+
+	if (mail_index_sync_begin(index, &sync_ctx, &view, &trans, 0) < 0)
+		bench_index_fail(index, "mail_index_sync_begin");
+	while (mail_index_sync_next(sync_ctx, &sync_rec)) ;
+	if (mail_index_sync_commit(&sync_ctx) < 0)
+		bench_index_fail(index, "mail_index_sync_commit");
+}
+
+static enum mail_flags bench_message_flags(struct bench_ctx *ctx, uint32_t seq)
+{
+	enum mail_flags flags = 0;
+	unsigned int r = bench_rand() % 1000;
+
+	if (seq <= ctx->messages / 100 * 95 && r >= 10)
+		flags |= MAIL_SEEN;
+	r = bench_rand() % 1000;
+	if (r < 80)
+		flags |= MAIL_ANSWERED;
+	else if (r < 100)
+		flags |= MAIL_FLAGGED;
+	else if (r < 103)
+		flags |= MAIL_DELETED;
+	return flags;
+}
+
+static void
+bench_cache_field_build(string_t *str, enum bench_cache_field field,
+			uint32_t seq)
+{
+	uint32_t date = 1700000000 + seq * 60;
+	uoff_t size = 2000 + bench_rand() * 4;
+	unsigned int i, words;
+
+	str_truncate(str, 0);
+	switch (field) {
+	case BENCH_CACHE_FIELD_DATE_RECEIVED:
+		str_append_data(str, &date, sizeof(date));
+		break;
+	case BENCH_CACHE_FIELD_SIZE_VIRTUAL:
+		str_append_data(str, &size, sizeof(size));
+		break;
+	case BENCH_CACHE_FIELD_ENVELOPE:
+		str_printfa(str, "\"Tue, 14 Nov 2023 22:13:20 +0000\" "
+			    "\"Re: benchmark message %u\" "
+			    "((\"Sender %u\" NIL \"sender%u\" \"example.com\")) "
+			    "((\"Sender %u\" NIL \"sender%u\" \"example.com\")) "
+			    "((\"Sender %u\" NIL \"sender%u\" \"example.com\")) "
+			    "((NIL NIL \"recipient\" \"example.com\")) NIL NIL "
+			    "\"<parent-%u@example.com>\" "
+			    "\"<bench-%u@example.com>\"", seq,
+			    seq % 97, seq % 97, seq % 97, seq % 97,
+			    seq % 97, seq % 97, seq - 1, seq);
+		break;
+	case BENCH_CACHE_FIELD_BODYSTRUCTURE:
+		str_printfa(str, "(\"text\" \"plain\" (\"charset\" \"utf-8\") "
+			    "NIL NIL \"quoted-printable\" %u %u NIL NIL NIL "
+			    "NIL)(\"text\" \"html\" (\"charset\" \"utf-8\") "
+			    "NIL NIL \"quoted-printable\" %u %u NIL NIL NIL "
+			    "NIL) \"alternative\" (\"boundary\" \"b%u\") NIL "
+			    "NIL NIL", (unsigned int)size / 3,
+			    (unsigned int)size / 200, (unsigned int)size / 2,
+			    (unsigned int)size / 150, seq);
+		break;
+	case BENCH_CACHE_FIELD_SNIPPET:
+		str_append_c(str, '1');
+		words = 5 + bench_rand() % 15;
+		for (i = 0; i < words; i++)
+			str_printfa(str, "word%u ", bench_rand() % 1000);
+		break;
+	case BENCH_CACHE_FIELD_COUNT:
+		i_unreached();
+	}
+}
+
+static void
+bench_generate_batch(struct bench_ctx *ctx, uint32_t first_seq,
+		     unsigned int count)
+{
+	struct mail_index_view *view, *updated_view;
+	struct mail_index_transaction *trans;
+	struct mail_cache_view *cache_view;
+	struct mail_cache_transaction_ctx *cache_trans;
+	const struct mail_index_header *hdr;
+	string_t *str = t_str_new(512);
+	uint32_t seq, uid_validity = 12345;
+	unsigned int i, j;
+
+	view = mail_index_view_open(ctx->index);
+	hdr = mail_index_get_header(view);
+	trans = mail_index_transaction_begin(view, 0);
+	updated_view = mail_index_transaction_open_updated_view(trans);
+	cache_view = mail_cache_view_open(ctx->index->cache, updated_view);
+	cache_trans = mail_cache_get_transaction(cache_view, trans);
+
+	if (hdr->uid_validity == 0) {
+		mail_index_update_header(trans,
+			offsetof(struct mail_index_header, uid_validity),
+			&uid_validity, sizeof(uid_validity), TRUE);
+	}
+
+	for (i = 0; i < count; i++) {
+		mail_index_append(trans, hdr->next_uid + i, &seq);
+		i_assert(seq == first_seq + i);
+		mail_index_update_flags(trans, seq, MODIFY_REPLACE,
+					bench_message_flags(ctx, seq));
+		for (j = 0; j < N_ELEMENTS(bench_keywords); j++) {
+			if (bench_rand() % 1000 < bench_keywords[j].probability) {
+				mail_index_update_keywords(trans, seq,
+					MODIFY_ADD, ctx->keywords[j]);
+			}
+		}
+		for (j = 0; j < BENCH_CACHE_FIELD_COUNT; j++) {
+			if (bench_rand() % 1000 >=
+			    bench_cache_field_probability[j])
+				continue;
+			bench_cache_field_build(str, j, seq);
+			mail_cache_add(cache_trans, seq,
+				       bench_cache_fields[j].idx,
+				       str_data(str), str_len(str));
+		}
+	}
+	if (mail_index_transaction_commit(&trans) < 0)
+		bench_index_fail(ctx->index, "mail_index_transaction_commit");
+	mail_cache_view_close(&cache_view);
+	mail_index_view_close(&updated_view);
+	mail_index_view_close(&view);
+	bench_index_sync(ctx->index);
+}
+
+static void bench_generate(struct bench_ctx *ctx)
+{
+	struct mail_index_optimization_settings set;
+	struct mail_index *index;
+	const char *names[2] = { NULL, NULL };
+	unsigned int i, count;
+	uint64_t ts_0, ts_1;
+
+	ctx->index = bench_index_open(NULL);
+	for (i = 0; i < N_ELEMENTS(bench_keywords); i++) {
+		names[0] = bench_keywords[i].name;
+		ctx->keywords[i] =
+			mail_index_keywords_create(ctx->index, names);
+	}
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < ctx->messages; i += count) T_BEGIN {
+		count = I_MIN(BENCH_GENERATE_BATCH, ctx->messages - i);
+		bench_generate_batch(ctx, i + 1, count);
+	} T_END;
+	ts_1 = i_nanoseconds();
+	bench_print("generate", ts_1 - ts_0, ctx->messages, "msg");
+
+	/* make sure dovecot.index is up to date, so "map open" doesn't
+	   depend on whether the last batch happened to rewrite it */
+	set = ctx->index->optimization_set;
+	set.index.rewrite_max_log_bytes = 1;
+	index = bench_index_open(&set);
+	bench_index_sync(index);
+	bench_index_close(&index);
+}
+
+static void bench_open(const char *name, unsigned int rounds)
+{
+	struct mail_index *index;
+	uint64_t ts_0, ts_1;
+	unsigned int i;
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < rounds; i++) {
+		index = bench_index_open(NULL);
+		bench_index_close(&index);
+	}
+	ts_1 = i_nanoseconds();
+	bench_print(name, ts_1 - ts_0, rounds, "open");
+}
+
+static void bench_replay_prepare(struct bench_ctx *ctx)
+{
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	uint32_t seq;
+	unsigned int i;
+
+	view = mail_index_view_open(ctx->index);
+	for (i = 0; i < BENCH_REPLAY_TRANSACTIONS; i++) {
+		/* similar to an IMAP STORE without syncing afterwards */
+		trans = mail_index_transaction_begin(view, 0);
+		seq = bench_rand_seq(ctx->messages);
+		if (i % 4 == 0) {
+			mail_index_update_keywords(trans, seq, MODIFY_ADD,
+				ctx->keywords[bench_rand() %
+					      N_ELEMENTS(ctx->keywords)]);
+		} else {
+			mail_index_update_flags(trans, seq,
+				i % 2 == 0 ? MODIFY_ADD : MODIFY_REMOVE,
+				MAIL_SEEN);
+		}
+		if (mail_index_transaction_commit(&trans) < 0) {
+			bench_index_fail(ctx->index,
+					 "mail_index_transaction_commit");
+		}
+	}
+	mail_index_view_close(&view);
+}
+
+static void bench_cache_lookup(struct bench_ctx *ctx)
+{
+	struct mail_index *index;
+	struct mail_index_view *view;
+	struct mail_cache_view *cache_view;
+	buffer_t *buf = buffer_create_dynamic(default_pool, 512);
+	unsigned int i, lookups = 0, hits = 0;
+	uint64_t ts_0, ts_1;
+	uint32_t seq;
+	int ret;
+
+	index = bench_index_open(NULL);
+	view = mail_index_view_open(index);
+	cache_view = mail_cache_view_open(index->cache, view);
+
+	ts_0 = i_nanoseconds();
+	for (seq = 1; seq <= ctx->messages; seq++) {
+		for (i = 0; i < BENCH_CACHE_FIELD_COUNT; i++) {
+			buffer_set_used_size(buf, 0);
+			ret = mail_cache_lookup_field(cache_view, buf, seq,
+						      bench_cache_fields[i].idx);
+			if (ret < 0)
+				bench_index_fail(index, "mail_cache_lookup_field");
+			lookups++;
+			if (ret > 0)
+				hits++;
+		}
+	}
+	ts_1 = i_nanoseconds();
+	bench_print("cache lookup", ts_1 - ts_0, lookups, "lookup");
+	printf("\t%-20s %12.02lf %%\n", "cache hits", hits * 100.0 / lookups);
+
+	mail_cache_view_close(&cache_view);
+	mail_index_view_close(&view);
+	bench_index_close(&index);
+	buffer_free(&buf);
+}
+
+static void bench_write_rotate(struct bench_ctx *ctx)
+{
+	struct mail_index_optimization_settings set;
+	struct mail_index *index;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	uint64_t ts_0, ts_1;
+	unsigned int i;
+
+	/* rotate the .log (which also rewrites dovecot.index) on each sync */
+	set = ctx->index->optimization_set;
+	set.log.max_size = 1;
+	index = bench_index_open(&set);
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < BENCH_WRITE_ROUNDS; i++) {
+		view = mail_index_view_open(index);
+		trans = mail_index_transaction_begin(view, 0);
+		mail_index_update_flags(trans, bench_rand_seq(ctx->messages),
+					MODIFY_ADD, MAIL_FLAGGED);
+		if (mail_index_transaction_commit(&trans) < 0)
+			bench_index_fail(index, "mail_index_transaction_commit");
+		mail_index_view_close(&view);
+		bench_index_sync(index);
+	}
+	ts_1 = i_nanoseconds();
+	bench_print("write/rotate", ts_1 - ts_0, BENCH_WRITE_ROUNDS, "sync");
+
+	ts_0 = i_nanoseconds();
+	if (mail_cache_purge(index->cache, (uint32_t)-1, "benchmark") < 0)
+		bench_index_fail(index, "mail_cache_purge");
+	ts_1 = i_nanoseconds();
+	bench_print("cache purge", ts_1 - ts_0, 1, "purge");
+	bench_index_close(&index);
+}
+
+static void
+bench_field_scan(struct bench_ctx *ctx, const char *name,
+		 unsigned int columns_min_messages)
+{
+	const struct mail_index_optimization_settings set = {
+		.cache = {
+			.columns_min_messages = columns_min_messages,
+		},
+	};
+	const unsigned int fields[] = {
+		BENCH_CACHE_FIELD_DATE_RECEIVED,
+		BENCH_CACHE_FIELD_SIZE_VIRTUAL,
+	};
+	struct mail_index *index;
+	struct mail_index_view *view;
+	struct mail_cache_view *cache_view;
+	buffer_t *buf = buffer_create_dynamic(default_pool, 64);
+	unsigned int i, lookups = 0;
+	uint64_t ts_0, ts_1;
+	uint32_t seq;
+
+	index = bench_index_open(&set);
+	if (mail_cache_purge(index->cache, (uint32_t)-1, "benchmark") < 0)
+		bench_index_fail(index, "mail_cache_purge");
+	bench_index_close(&index);
+
+	index = bench_index_open(&set);
+	view = mail_index_view_open(index);
+	cache_view = mail_cache_view_open(index->cache, view);
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < N_ELEMENTS(fields); i++) {
+		for (seq = 1; seq <= ctx->messages; seq++) {
+			buffer_set_used_size(buf, 0);
+			if (mail_cache_lookup_field(cache_view, buf, seq,
+					bench_cache_fields[fields[i]].idx) < 0)
+				bench_index_fail(index, "mail_cache_lookup_field");
+			lookups++;
+		}
+	}
+	ts_1 = i_nanoseconds();
+	bench_print(name, ts_1 - ts_0, lookups, "lookup");
+
+	mail_cache_view_close(&cache_view);
+	mail_index_view_close(&view);
+	bench_index_close(&index);
+	buffer_free(&buf);
+}
+
+static void bench_mail_index(unsigned int messages)
+{
+	struct bench_ctx ctx;
+	const char *error;
+	unsigned int i;
+
+	i_zero(&ctx);
+	ctx.messages = messages;
+
+	if (unlink_directory(BENCH_DIR, UNLINK_DIRECTORY_FLAG_RMDIR,
+			     &error) < 0 && errno != ENOENT)
+		i_fatal("unlink_directory(%s) failed: %s", BENCH_DIR, error);
+	if (mkdir(BENCH_DIR, 0700) < 0)
+		i_fatal("mkdir(%s) failed: %m", BENCH_DIR);
+
+	bench_generate(&ctx);
+	bench_print_size("");
+	bench_print_size(".log");
+	bench_print_size(".cache");
+
+	bench_open("map open", BENCH_OPEN_ROUNDS);
+	bench_replay_prepare(&ctx);
+	bench_open("sync replay", BENCH_OPEN_ROUNDS);
+	bench_cache_lookup(&ctx);
+	bench_write_rotate(&ctx);
+	bench_field_scan(&ctx, "field scan", 0);
+	bench_field_scan(&ctx, "field scan columns", 1);
+	bench_print_size(".cache");
+
+	for (i = 0; i < N_ELEMENTS(ctx.keywords); i++)
+		mail_index_keywords_unref(&ctx.keywords[i]);
+	bench_index_close(&ctx.index);
+	if (unlink_directory(BENCH_DIR, UNLINK_DIRECTORY_FLAG_RMDIR,
+			     &error) < 0)
+		i_error("unlink_directory(%s) failed: %s", BENCH_DIR, error);
+}
+
+static int bench_parse_count(const char *str, unsigned int *count_r)
+{
+	const char *suffix;
+	unsigned int multiplier = 1;
+
+	if (str_parse_uint(str, count_r, &suffix) < 0)
+		return -1;
+	if (strcmp(suffix, "k") == 0)
+		multiplier = 1000;
+	else if (strcmp(suffix, "M") == 0)
+		multiplier = 1000000;
+	else if (*suffix != '\0')
+		return -1;
+	if (*count_r == 0 || *count_r > UINT_MAX / multiplier)
+		return -1;
+	*count_r *= multiplier;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ioloop *ioloop;
+	unsigned int i, messages = BENCH_DEFAULT_MESSAGES;
+
+	lib_init();
+	if (argc > 1 && bench_parse_count(argv[1], &messages) < 0)
+		i_fatal("Usage: %s [<messages>]", argv[0]);
+
+	ioloop = io_loop_create();
+	/* don't let the cache drop the fields as unaccessed */
+	for (i = 0; i < N_ELEMENTS(bench_cache_fields); i++)
+		bench_cache_fields[i].last_used = ioloop_time;
+
+	printf("mail index and cache with %u messages:\n", messages);
+	bench_mail_index(messages);
+
+	io_loop_destroy(&ioloop);
+	lib_deinit();
+	return 0;
+}
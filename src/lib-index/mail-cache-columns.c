@@ -0,0 +1,419 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "buffer.h"
+#include "ostream.h"
+#include "bsearch-insert-pos.h"
+#include "sort.h"
+#include "mail-cache-private.h"
+
+struct mail_cache_columns_write_column {
+	unsigned int field_idx;
+	uint32_t file_field;
+	uint32_t field_size;
+	/* Position of the field's data in the current record buffer,
+	   0 if the current message doesn't have it. */
+	size_t cur_rec_pos;
+
+	buffer_t *bitmap;
+	buffer_t *values;
+};
+
+struct mail_cache_columns_write_ctx {
+	struct mail_cache *cache;
+
+	ARRAY_TYPE(uint32_t) uids;
+	ARRAY(struct mail_cache_columns_write_column) columns;
+	/* mail_cache_field.idx -> columns index + 1, or 0 if not a column */
+	unsigned int *field_column_map;
+};
+
+static bool
+mail_cache_column_field_want(const struct mail_cache_field_private *priv)
+{
+	enum mail_cache_decision_type dec =
+		priv->field.decision & ENUM_NEGATE(MAIL_CACHE_DECISION_FORCED);
+
+	/* Only fields that are kept for all messages are worth writing.
+	   Bitmask fields may be merged from multiple records, so they need
+	   to be looked up via the records. */
+	return priv->used && dec == MAIL_CACHE_DECISION_YES &&
+		priv->field.type == MAIL_CACHE_FIELD_FIXED_SIZE &&
+		priv->field.field_size > 0 &&
+		priv->field.field_size <= MAIL_CACHE_COLUMN_MAX_FIELD_SIZE;
+}
+
+struct mail_cache_columns_write_ctx *
+mail_cache_columns_write_init(struct mail_cache *cache,
+			      const uint32_t *field_file_map,
+			      uint32_t messages_count)
+{
+	struct mail_cache_columns_write_ctx *ctx;
+	struct mail_cache_columns_write_column *column;
+	unsigned int min_messages =
+		cache->index->optimization_set.cache.columns_min_messages;
+	unsigned int i;
+
+	if (min_messages == 0 || messages_count < min_messages)
+		return NULL;
+
+	ctx = i_new(struct mail_cache_columns_write_ctx, 1);
+	ctx->cache = cache;
+	ctx->field_column_map = i_new(unsigned int, cache->fields_count);
+	i_array_init(&ctx->uids, messages_count);
+	i_array_init(&ctx->columns, 8);
+	for (i = 0; i < cache->fields_count; i++) {
+		if (field_file_map[i] == (uint32_t)-1 ||
+		    !mail_cache_column_field_want(&cache->fields[i]))
+			continue;
+
+		column = array_append_space(&ctx->columns);
+		column->field_idx = i;
+		column->file_field = field_file_map[i];
+		column->field_size = cache->fields[i].field.field_size;
+		column->bitmap = buffer_create_dynamic(default_pool,
+						       messages_count / 8 + 4);
+		column->values = buffer_create_dynamic(default_pool,
+			messages_count * column->field_size);
+		ctx->field_column_map[i] = array_count(&ctx->columns);
+	}
+	if (array_count(&ctx->columns) == 0)
+		mail_cache_columns_write_abort(&ctx);
+	return ctx;
+}
+
+void mail_cache_columns_write_field(struct mail_cache_columns_write_ctx *ctx,
+				    unsigned int field_idx, size_t rec_pos)
+{
+	struct mail_cache_columns_write_column *column;
+
+	i_assert(rec_pos > 0);
+
+	if (field_idx >= ctx->cache->fields_count ||
+	    ctx->field_column_map[field_idx] == 0)
+		return;
+	column = array_idx_modifiable(&ctx->columns,
+				      ctx->field_column_map[field_idx] - 1);
+	column->cur_rec_pos = rec_pos;
+}
+
+void mail_cache_columns_write_message(struct mail_cache_columns_write_ctx *ctx,
+				      uint32_t uid, const buffer_t *rec_buf)
+{
+	struct mail_cache_columns_write_column *column;
+	unsigned int idx = array_count(&ctx->uids);
+	uint8_t *bits;
+
+	i_assert(idx == 0 || uid > *array_idx(&ctx->uids, idx-1));
+	array_push_back(&ctx->uids, &uid);
+
+	array_foreach_modifiable(&ctx->columns, column) {
+		/* make sure the bitmap grows even if no bits get set */
+		bits = buffer_get_space_unsafe(column->bitmap, idx / 8, 1);
+		if (column->cur_rec_pos == 0) {
+			buffer_append_zero(column->values, column->field_size);
+			continue;
+		}
+		i_assert(column->cur_rec_pos + column->field_size <=
+			 rec_buf->used);
+		*bits |= 1 << (idx % 8);
+		buffer_append(column->values,
+			      CONST_PTR_OFFSET(rec_buf->data,
+					       column->cur_rec_pos),
+			      column->field_size);
+		column->cur_rec_pos = 0;
+	}
+}
+
+void mail_cache_columns_write_skip(struct mail_cache_columns_write_ctx *ctx)
+{
+	struct mail_cache_columns_write_column *column;
+
+	array_foreach_modifiable(&ctx->columns, column)
+		column->cur_rec_pos = 0;
+}
+
+static size_t mail_cache_columns_bitmap_size(uint32_t uid_count)
+{
+	return (uid_count + 31) / 32 * sizeof(uint32_t);
+}
+
+static size_t mail_cache_column_values_size(uint32_t uid_count,
+					    uint32_t field_size)
+{
+	return ((size_t)uid_count * field_size + sizeof(uint32_t)-1) &
+		~(sizeof(uint32_t)-1);
+}
+
+void mail_cache_columns_write_finish(struct mail_cache_columns_write_ctx **_ctx,
+				     struct ostream *output)
+{
+	struct mail_cache_columns_write_ctx *ctx = *_ctx;
+	struct mail_cache_columns_write_column *column;
+	struct mail_cache_columns_header hdr;
+	struct mail_cache_column_header col_hdr;
+	struct mail_cache_columns_trailer trailer;
+	uint32_t bitmap_size, offset;
+
+	if (ctx == NULL)
+		return;
+
+	i_zero(&hdr);
+	hdr.uid_count = array_count(&ctx->uids);
+	hdr.columns_count = array_count(&ctx->columns);
+	if (hdr.uid_count == 0) {
+		mail_cache_columns_write_abort(_ctx);
+		return;
+	}
+	bitmap_size = mail_cache_columns_bitmap_size(hdr.uid_count);
+
+	i_assert(output->offset % sizeof(uint32_t) == 0);
+	o_stream_nsend(output, &hdr, sizeof(hdr));
+	o_stream_nsend(output, array_front(&ctx->uids),
+		       hdr.uid_count * sizeof(uint32_t));
+
+	offset = sizeof(hdr) + hdr.uid_count * sizeof(uint32_t) +
+		hdr.columns_count * sizeof(col_hdr);
+	array_foreach_modifiable(&ctx->columns, column) {
+		i_zero(&col_hdr);
+		col_hdr.file_field = column->file_field;
+		col_hdr.field_size = column->field_size;
+		col_hdr.data_offset = offset;
+		o_stream_nsend(output, &col_hdr, sizeof(col_hdr));
+		offset += bitmap_size +
+			mail_cache_column_values_size(hdr.uid_count,
+						      column->field_size);
+	}
+	array_foreach_modifiable(&ctx->columns, column) {
+		buffer_write_zero(column->bitmap, column->bitmap->used,
+				  bitmap_size - column->bitmap->used);
+		o_stream_nsend(output, column->bitmap->data, bitmap_size);
+		buffer_write_zero(column->values, column->values->used,
+			mail_cache_column_values_size(hdr.uid_count,
+				column->field_size) - column->values->used);
+		o_stream_nsend(output, column->values->data,
+			       column->values->used);
+	}
+
+	i_zero(&trailer);
+	trailer.size = offset + sizeof(trailer);
+	trailer.magic = MAIL_CACHE_COLUMNS_MAGIC;
+	o_stream_nsend(output, &trailer, sizeof(trailer));
+
+	e_debug(ctx->cache->event, "Purge wrote %u columns for %u mails",
+		hdr.columns_count, hdr.uid_count);
+	mail_cache_columns_write_abort(_ctx);
+}
+
+void mail_cache_columns_write_abort(struct mail_cache_columns_write_ctx **_ctx)
+{
+	struct mail_cache_columns_write_ctx *ctx = *_ctx;
+	struct mail_cache_columns_write_column *column;
+
+	if (ctx == NULL)
+		return;
+	*_ctx = NULL;
+
+	array_foreach_modifiable(&ctx->columns, column) {
+		buffer_free(&column->bitmap);
+		buffer_free(&column->values);
+	}
+	array_free(&ctx->columns);
+	array_free(&ctx->uids);
+	i_free(ctx->field_column_map);
+	i_free(ctx);
+}
+
+static int mail_cache_columns_read(struct mail_cache *cache)
+{
+	const struct mail_cache_columns_trailer *trailer;
+	const struct mail_cache_columns_header *hdr;
+	const struct mail_cache_column_header *col_hdrs;
+	struct mail_cache_column *column;
+	const void *data;
+	uint32_t field_hdr_offset, offset, size, uid_count, columns_count;
+	uint32_t bitmap_size, values_size, meta_size, i;
+	int ret;
+
+	if (cache->columns_file_seq == cache->hdr->file_seq)
+		return 0;
+	cache->columns_file_seq = cache->hdr->file_seq;
+	cache->columns_offset = 0;
+	cache->columns_uid_count = 0;
+	cache->columns_last_uid_idx = 0;
+	if (array_is_created(&cache->columns))
+		array_clear(&cache->columns);
+	else
+		i_array_init(&cache->columns, 8);
+
+	/* with map_with_read the columns would have to be read() for each
+	   lookup, so there's no benefit in using them */
+	if (cache->hdr->minor_version < 2 || cache->map_with_read)
+		return 0;
+
+	field_hdr_offset =
+		mail_index_offset_to_uint32(cache->hdr->field_header_offset);
+	if (field_hdr_offset < sizeof(struct mail_cache_header) +
+	    sizeof(*hdr) + sizeof(*trailer))
+		return 0;
+
+	offset = field_hdr_offset - sizeof(*trailer);
+	if ((ret = mail_cache_map(cache, offset, sizeof(*trailer), &data)) <= 0)
+		return ret;
+	trailer = data;
+	if (trailer->magic != MAIL_CACHE_COLUMNS_MAGIC)
+		return 0;
+	size = trailer->size;
+	if (size > field_hdr_offset - sizeof(struct mail_cache_header) ||
+	    size < sizeof(*hdr) + sizeof(*trailer) ||
+	    size % sizeof(uint32_t) != 0) {
+		mail_cache_set_corrupted(cache, "columns: invalid size");
+		return -1;
+	}
+	offset = field_hdr_offset - size;
+
+	if ((ret = mail_cache_map(cache, offset, sizeof(*hdr), &data)) <= 0)
+		return ret;
+	hdr = data;
+	uid_count = hdr->uid_count;
+	columns_count = hdr->columns_count;
+	if (uid_count > size / sizeof(uint32_t) ||
+	    columns_count > size / sizeof(*col_hdrs)) {
+		mail_cache_set_corrupted(cache, "columns: invalid header");
+		return -1;
+	}
+	meta_size = sizeof(*hdr) + uid_count * sizeof(uint32_t) +
+		columns_count * sizeof(*col_hdrs);
+	if (meta_size + sizeof(*trailer) > size) {
+		mail_cache_set_corrupted(cache, "columns: invalid header");
+		return -1;
+	}
+
+	if ((ret = mail_cache_map(cache, offset, meta_size, &data)) <= 0)
+		return ret;
+	col_hdrs = CONST_PTR_OFFSET(data, meta_size -
+				    columns_count * sizeof(*col_hdrs));
+	bitmap_size = mail_cache_columns_bitmap_size(uid_count);
+	for (i = 0; i < columns_count; i++) {
+		if (col_hdrs[i].field_size == 0 ||
+		    col_hdrs[i].field_size > MAIL_CACHE_COLUMN_MAX_FIELD_SIZE) {
+			mail_cache_set_corrupted(cache,
+				"columns: invalid field size");
+			return -1;
+		}
+		values_size = mail_cache_column_values_size(uid_count,
+						col_hdrs[i].field_size);
+		if (col_hdrs[i].data_offset < meta_size ||
+		    col_hdrs[i].data_offset > size - sizeof(*trailer) ||
+		    bitmap_size + values_size > size - sizeof(*trailer) -
+		    col_hdrs[i].data_offset) {
+			mail_cache_set_corrupted(cache,
+				"columns: data points outside section");
+			return -1;
+		}
+		column = array_append_space(&cache->columns);
+		column->file_field = col_hdrs[i].file_field;
+		column->field_size = col_hdrs[i].field_size;
+		column->bitmap_offset = offset + col_hdrs[i].data_offset;
+		column->values_offset = column->bitmap_offset + bitmap_size;
+	}
+	cache->columns_offset = offset;
+	cache->columns_uid_count = uid_count;
+	return 0;
+}
+
+static int
+mail_cache_columns_find_uid(struct mail_cache *cache, uint32_t uid,
+			    unsigned int *idx_r)
+{
+	const uint32_t *uids;
+	const void *data;
+	unsigned int idx;
+	int ret;
+
+	if ((ret = mail_cache_map(cache, cache->columns_offset +
+				  sizeof(struct mail_cache_columns_header),
+				  cache->columns_uid_count * sizeof(uint32_t),
+				  &data)) <= 0)
+		return ret;
+	uids = data;
+
+	/* fast path for ascending lookups */
+	idx = cache->columns_last_uid_idx;
+	if (idx < cache->columns_uid_count && uids[idx] == uid) {
+		*idx_r = idx;
+		return 1;
+	}
+	if (idx + 1 < cache->columns_uid_count && uids[idx+1] == uid) {
+		*idx_r = cache->columns_last_uid_idx = idx + 1;
+		return 1;
+	}
+	if (!bsearch_insert_pos(&uid, uids, cache->columns_uid_count,
+				sizeof(uint32_t), uint32_cmp, &idx))
+		return 0;
+	*idx_r = cache->columns_last_uid_idx = idx;
+	return 1;
+}
+
+int mail_cache_lookup_column(struct mail_cache_view *view, buffer_t *dest_buf,
+			     uint32_t seq, unsigned int field_idx)
+{
+	struct mail_cache *cache = view->cache;
+	const struct mail_cache_column *columns, *column = NULL;
+	const uint8_t *bits;
+	const void *data;
+	uint32_t offset, uid, file_field;
+	unsigned int i, idx, count;
+	int ret;
+
+	if (!cache->opened)
+		(void)mail_cache_open_and_verify(cache);
+	if (MAIL_CACHE_IS_UNUSABLE(cache) ||
+	    cache->fields[field_idx].field.type != MAIL_CACHE_FIELD_FIXED_SIZE)
+		return 0;
+	if (view->trans_seq1 <= seq && view->trans_seq2 >= seq) {
+		/* the message may have uncommitted changes */
+		return 0;
+	}
+
+	/* this also makes sure that the message's cache offset points to
+	   the current cache file */
+	if (mail_cache_lookup_offset(cache, view->view, seq, &offset) <= 0)
+		return 0;
+	if (mail_cache_columns_read(cache) < 0)
+		return -1;
+	if (cache->columns_offset == 0)
+		return 0;
+
+	file_field = cache->field_file_map[field_idx];
+	if (file_field == (uint32_t)-1)
+		return 0;
+	columns = array_get(&cache->columns, &count);
+	for (i = 0; i < count; i++) {
+		if (columns[i].file_field == file_field) {
+			column = &columns[i];
+			break;
+		}
+	}
+	if (column == NULL)
+		return 0;
+
+	mail_index_lookup_uid(view->view, seq, &uid);
+	if ((ret = mail_cache_columns_find_uid(cache, uid, &idx)) <= 0)
+		return ret;
+
+	if ((ret = mail_cache_map(cache, column->bitmap_offset + idx / 8,
+				  1, &data)) <= 0)
+		return ret;
+	bits = data;
+	if ((*bits & (1 << (idx % 8))) == 0)
+		return 0;
+
+	if ((ret = mail_cache_map(cache, column->values_offset +
+				  idx * column->field_size,
+				  column->field_size, &data)) <= 0)
+		return ret;
+	buffer_append(dest_buf, data, column->field_size);
+	return 1;
+}
@@ -0,0 +1,304 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "buffer.h"
+#include "ostream.h"
+#include "mail-cache-private.h"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+
+/* Stop collecting samples after this many bytes */
+#define MAIL_CACHE_DICT_MAX_SAMPLES_SIZE (1024*1024*2)
+/* Don't bother training a dictionary with fewer samples */
+#define MAIL_CACHE_DICT_MIN_SAMPLES 100
+#define MAIL_CACHE_DICT_COMPRESSION_LEVEL 3
+
+struct mail_cache_dict_write_ctx {
+	struct mail_cache *cache;
+
+	buffer_t *samples;
+	ARRAY(size_t) sample_sizes;
+
+	ZSTD_CDict *cdict;
+	ZSTD_CCtx *cctx;
+};
+
+struct mail_cache_dict {
+	ZSTD_DDict *ddict;
+	ZSTD_DCtx *dctx;
+};
+
+struct mail_cache_dict_write_ctx *
+mail_cache_dict_write_init(struct mail_cache *cache, uint32_t messages_count)
+{
+	struct mail_cache_dict_write_ctx *ctx;
+	unsigned int min_messages =
+		cache->index->optimization_set.cache.dict_min_messages;
+
+	if (min_messages == 0 || messages_count < min_messages)
+		return NULL;
+
+	ctx = i_new(struct mail_cache_dict_write_ctx, 1);
+	ctx->cache = cache;
+	ctx->samples = buffer_create_dynamic(default_pool, 1024*64);
+	i_array_init(&ctx->sample_sizes, 1024);
+	return ctx;
+}
+
+bool mail_cache_dict_write_sample(struct mail_cache_dict_write_ctx *ctx,
+				  const void *data, size_t size)
+{
+	if (size < MAIL_CACHE_DICT_MIN_VALUE_SIZE ||
+	    size > MAIL_CACHE_DICT_MAX_VALUE_SIZE)
+		return TRUE;
+	if (ctx->samples->used + size > MAIL_CACHE_DICT_MAX_SAMPLES_SIZE)
+		return FALSE;
+
+	buffer_append(ctx->samples, data, size);
+	array_push_back(&ctx->sample_sizes, &size);
+	return TRUE;
+}
+
+bool mail_cache_dict_write_train(struct mail_cache_dict_write_ctx **_ctx,
+				 struct ostream *output)
+{
+	struct mail_cache_dict_write_ctx *ctx = *_ctx;
+	struct mail_cache_dict_header hdr;
+	unsigned int samples_count = array_count(&ctx->sample_sizes);
+	void *dict;
+	size_t dict_size;
+
+	if (samples_count < MAIL_CACHE_DICT_MIN_SAMPLES) {
+		mail_cache_dict_write_deinit(_ctx);
+		return FALSE;
+	}
+
+	dict = i_malloc(MAIL_CACHE_DICT_MAX_SIZE);
+	dict_size = ZDICT_trainFromBuffer(dict, MAIL_CACHE_DICT_MAX_SIZE,
+					  ctx->samples->data,
+					  array_front(&ctx->sample_sizes),
+					  samples_count);
+	buffer_free(&ctx->samples);
+	array_free(&ctx->sample_sizes);
+	if (ZDICT_isError(dict_size) != 0) {
+		e_debug(ctx->cache->event,
+			"Purge couldn't train compression dictionary: %s",
+			ZDICT_getErrorName(dict_size));
+		i_free(dict);
+		mail_cache_dict_write_deinit(_ctx);
+		return FALSE;
+	}
+
+	ctx->cdict = ZSTD_createCDict(dict, dict_size,
+				      MAIL_CACHE_DICT_COMPRESSION_LEVEL);
+	ctx->cctx = ZSTD_createCCtx();
+	if (ctx->cdict == NULL || ctx->cctx == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "zstd: Out of memory");
+
+	i_assert(output->offset == sizeof(struct mail_cache_header));
+	i_zero(&hdr);
+	hdr.dict_size = dict_size;
+	hdr.size = (sizeof(hdr) + dict_size + sizeof(uint32_t)-1) &
+		~(sizeof(uint32_t)-1);
+	o_stream_nsend(output, &hdr, sizeof(hdr));
+	o_stream_nsend(output, dict, dict_size);
+	if (hdr.size != sizeof(hdr) + dict_size) {
+		o_stream_nsend(output, "\0\0\0",
+			       hdr.size - (sizeof(hdr) + dict_size));
+	}
+	i_free(dict);
+
+	e_debug(ctx->cache->event,
+		"Purge trained %zu byte compression dictionary from %u samples",
+		dict_size, samples_count);
+	return TRUE;
+}
+
+bool mail_cache_dict_compress(struct mail_cache_dict_write_ctx *ctx,
+			      const void *data, size_t size, buffer_t *dest)
+{
+	size_t max_size, ret;
+	void *output;
+
+	i_assert(ctx->cdict != NULL);
+
+	if (size < MAIL_CACHE_DICT_MIN_VALUE_SIZE ||
+	    size > MAIL_CACHE_DICT_MAX_VALUE_SIZE)
+		return FALSE;
+
+	max_size = ZSTD_compressBound(size);
+	output = buffer_append_space_unsafe(dest, max_size);
+	ret = ZSTD_compress_usingCDict(ctx->cctx, output, max_size,
+				       data, size, ctx->cdict);
+	if (ZSTD_isError(ret) != 0 || ret >= size) {
+		/* failed or not worth it */
+		buffer_set_used_size(dest, dest->used - max_size);
+		return FALSE;
+	}
+	buffer_set_used_size(dest, dest->used - max_size + ret);
+	return TRUE;
+}
+
+void mail_cache_dict_write_deinit(struct mail_cache_dict_write_ctx **_ctx)
+{
+	struct mail_cache_dict_write_ctx *ctx = *_ctx;
+
+	if (ctx == NULL)
+		return;
+	*_ctx = NULL;
+
+	buffer_free(&ctx->samples);
+	if (array_is_created(&ctx->sample_sizes))
+		array_free(&ctx->sample_sizes);
+	ZSTD_freeCDict(ctx->cdict);
+	ZSTD_freeCCtx(ctx->cctx);
+	i_free(ctx);
+}
+
+int mail_cache_dict_read(struct mail_cache *cache)
+{
+	const struct mail_cache_dict_header *hdr;
+	const void *data;
+	uint32_t field_hdr_offset, size, dict_size;
+	int ret;
+
+	if (cache->dict_file_seq == cache->hdr->file_seq)
+		return cache->dict != NULL ? 1 : 0;
+	mail_cache_dict_free(cache);
+	cache->dict_file_seq = cache->hdr->file_seq;
+
+	if ((cache->hdr->flags & MAIL_CACHE_HDR_FLAG_DICT) == 0)
+		return 0;
+
+	field_hdr_offset =
+		mail_index_offset_to_uint32(cache->hdr->field_header_offset);
+	ret = mail_cache_map(cache, sizeof(struct mail_cache_header),
+			     sizeof(*hdr), &data);
+	if (ret <= 0)
+		return ret;
+	hdr = data;
+	size = hdr->size;
+	dict_size = hdr->dict_size;
+	if (field_hdr_offset < sizeof(struct mail_cache_header) ||
+	    dict_size == 0 || dict_size > MAIL_CACHE_DICT_MAX_SIZE ||
+	    size < sizeof(*hdr) + dict_size || size % sizeof(uint32_t) != 0 ||
+	    size > field_hdr_offset - sizeof(struct mail_cache_header)) {
+		mail_cache_set_corrupted(cache,
+			"compression dictionary has invalid size");
+		return -1;
+	}
+	ret = mail_cache_map(cache, sizeof(struct mail_cache_header) +
+			     sizeof(*hdr), dict_size, &data);
+	if (ret <= 0)
+		return ret;
+
+	cache->dict = i_new(struct mail_cache_dict, 1);
+	cache->dict->ddict = ZSTD_createDDict(data, dict_size);
+	cache->dict->dctx = ZSTD_createDCtx();
+	if (cache->dict->ddict == NULL || cache->dict->dctx == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "zstd: Out of memory");
+	return 1;
+}
+
+int mail_cache_dict_decompress(struct mail_cache *cache,
+			       const void *data, size_t size, buffer_t *dest)
+{
+	unsigned long long content_size;
+	size_t ret;
+	void *output;
+
+	i_assert(cache->dict != NULL);
+
+	content_size = ZSTD_getFrameContentSize(data, size);
+	if (content_size == ZSTD_CONTENTSIZE_UNKNOWN ||
+	    content_size == ZSTD_CONTENTSIZE_ERROR ||
+	    content_size > MAIL_CACHE_DICT_MAX_VALUE_SIZE) {
+		mail_cache_set_corrupted(cache,
+			"compressed field has invalid size");
+		return -1;
+	}
+
+	output = buffer_append_space_unsafe(dest, content_size);
+	ret = ZSTD_decompress_usingDDict(cache->dict->dctx,
+					 output, content_size, data, size,
+					 cache->dict->ddict);
+	if (ZSTD_isError(ret) != 0 || ret != content_size) {
+		buffer_set_used_size(dest, dest->used - content_size);
+		mail_cache_set_corrupted(cache,
+			"compressed field is broken: %s",
+			ZSTD_isError(ret) != 0 ? ZSTD_getErrorName(ret) :
+			"size mismatch");
+		return -1;
+	}
+	return 0;
+}
+
+void mail_cache_dict_free(struct mail_cache *cache)
+{
+	cache->dict_file_seq = 0;
+	if (cache->dict == NULL)
+		return;
+
+	ZSTD_freeDDict(cache->dict->ddict);
+	ZSTD_freeDCtx(cache->dict->dctx);
+	i_free(cache->dict);
+}
+#else
+struct mail_cache_dict_write_ctx *
+mail_cache_dict_write_init(struct mail_cache *cache ATTR_UNUSED,
+			   uint32_t messages_count ATTR_UNUSED)
+{
+	return NULL;
+}
+
+bool mail_cache_dict_write_sample(struct mail_cache_dict_write_ctx *ctx ATTR_UNUSED,
+				  const void *data ATTR_UNUSED,
+				  size_t size ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+bool mail_cache_dict_write_train(struct mail_cache_dict_write_ctx **ctx ATTR_UNUSED,
+				 struct ostream *output ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+bool mail_cache_dict_compress(struct mail_cache_dict_write_ctx *ctx ATTR_UNUSED,
+			      const void *data ATTR_UNUSED,
+			      size_t size ATTR_UNUSED,
+			      buffer_t *dest ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+void mail_cache_dict_write_deinit(struct mail_cache_dict_write_ctx **ctx)
+{
+	i_assert(*ctx == NULL);
+}
+
+int mail_cache_dict_read(struct mail_cache *cache)
+{
+	if ((cache->hdr->flags & MAIL_CACHE_HDR_FLAG_DICT) == 0)
+		return 0;
+	mail_cache_set_corrupted(cache,
+		"compression dictionary found, but zstd support not built in");
+	return -1;
+}
+
+int mail_cache_dict_decompress(struct mail_cache *cache ATTR_UNUSED,
+			       const void *data ATTR_UNUSED,
+			       size_t size ATTR_UNUSED,
+			       buffer_t *dest ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+void mail_cache_dict_free(struct mail_cache *cache)
+{
+	cache->dict_file_seq = 0;
+}
+#endif
@@ -180,6 +180,8 @@ void mail_cache_register_fields(struct mail_cache *cache,
 		cache->fields[idx].field.name = name;
 		cache->fields[idx].field.last_used = fields[i].last_used;
 		cache->field_file_map[idx] = (uint32_t)-1;
+		cache->fields[idx].bloom_bit =
+			1U << (strcase_hash(name) % MAIL_CACHE_FIELD_BLOOM_BITS);
 
 		if (!field_has_fixed_size(cache->fields[idx].field.type))
 			cache->fields[idx].field.field_size = UINT_MAX;
@@ -4,8 +4,12 @@
 #include "array.h"
 #include "buffer.h"
 #include "str.h"
+#include "sort.h"
 #include "mail-cache-private.h"
 
+static uint64_t mail_cache_total_lookups = 0;
+static uint64_t mail_cache_total_hits = 0;
+
 
 #define CACHE_PREFETCH IO_BLOCK_SIZE
 
@@ -76,9 +80,9 @@ uint32_t mail_cache_lookup_cur_offset(struct mail_index_view *view,
 	return offset;
 }
 
-static int
-mail_cache_lookup_offset(struct mail_cache *cache, struct mail_index_view *view,
-			 uint32_t seq, uint32_t *offset_r)
+int mail_cache_lookup_offset(struct mail_cache *cache,
+			     struct mail_index_view *view,
+			     uint32_t seq, uint32_t *offset_r)
 {
 	uint32_t offset, reset_id, reset_id2;
 	int ret;
@@ -273,12 +277,36 @@ mail_cache_lookup_rec_get_field(struct mail_cache_lookup_iterate_ctx *ctx,
 	return 0;
 }
 
+static int
+mail_cache_lookup_iter_dict_read(struct mail_cache_lookup_iterate_ctx *ctx)
+{
+	struct mail_cache *cache = ctx->view->cache;
+	int ret;
+
+	if ((ret = mail_cache_dict_read(cache)) <= 0) {
+		if (ret == 0) {
+			mail_cache_set_corrupted(cache,
+				"compressed field without compression dictionary");
+		}
+		return -1;
+	}
+	/* reading the dictionary might have re-mmaped the file and
+	   caused rec pointer to break. need to get it again. */
+	if (ctx->remap_counter != cache->remap_counter) {
+		if (mail_cache_get_record(cache, ctx->offset, &ctx->rec) < 0)
+			return -1;
+		ctx->remap_counter = cache->remap_counter;
+	}
+	return 0;
+}
+
 int mail_cache_lookup_iter_next(struct mail_cache_lookup_iterate_ctx *ctx,
 				struct mail_cache_iterate_field *field_r)
 {
 	struct mail_cache *cache = ctx->view->cache;
 	unsigned int field_idx;
 	unsigned int data_size;
+	bool compressed = FALSE;
 	int ret;
 
 	i_assert(ctx->remap_counter == cache->remap_counter);
@@ -306,6 +334,13 @@ int mail_cache_lookup_iter_next(struct mail_cache_lookup_iterate_ctx *ctx,
 		data_size = *((const uint32_t *)
 			      CONST_PTR_OFFSET(ctx->rec, ctx->pos));
 		ctx->pos += sizeof(uint32_t);
+		if ((data_size & MAIL_CACHE_FIELD_SIZE_COMPRESSED) != 0 &&
+		    !ctx->inmemory_field_idx) {
+			data_size &= ~MAIL_CACHE_FIELD_SIZE_COMPRESSED;
+			compressed = TRUE;
+			if (mail_cache_lookup_iter_dict_read(ctx) < 0)
+				return -1;
+		}
 	}
 
 	if (ctx->rec->size - ctx->pos < data_size) {
@@ -318,6 +353,21 @@ int mail_cache_lookup_iter_next(struct mail_cache_lookup_iterate_ctx *ctx,
 	field_r->data = CONST_PTR_OFFSET(ctx->rec, ctx->pos);
 	field_r->size = data_size;
 	field_r->offset = ctx->offset + ctx->pos;
+	if (compressed) {
+		struct mail_cache_view *view = ctx->view;
+
+		if (view->decompress_buf == NULL) {
+			view->decompress_buf =
+				buffer_create_dynamic(default_pool, 1024);
+		}
+		buffer_set_used_size(view->decompress_buf, 0);
+		if (mail_cache_dict_decompress(cache, field_r->data,
+					       data_size,
+					       view->decompress_buf) < 0)
+			return -1;
+		field_r->data = view->decompress_buf->data;
+		field_r->size = view->decompress_buf->used;
+	}
 
 	/* each record begins from 32bit aligned position */
 	ctx->pos += (data_size + sizeof(uint32_t)-1) & ~(sizeof(uint32_t)-1);
@@ -346,6 +396,27 @@ static int mail_cache_seq(struct mail_cache_view *view, uint32_t seq)
 	return ret;
 }
 
+static bool
+mail_cache_field_bloom_missing(struct mail_cache_view *view, uint32_t seq,
+			       unsigned int field)
+{
+	const void *data;
+	uint32_t bloom;
+	bool expunged;
+
+	if (view->trans_seq1 <= seq && view->trans_seq2 >= seq) {
+		/* the transaction may have added the field */
+		return FALSE;
+	}
+	mail_index_lookup_ext(view->view, seq, view->cache->bloom_ext_id,
+			      &data, &expunged);
+	if (data == NULL)
+		return FALSE;
+	memcpy(&bloom, data, sizeof(bloom));
+	return (bloom & MAIL_CACHE_FIELD_BLOOM_VALID) != 0 &&
+		(bloom & view->cache->fields[field].bloom_bit) == 0;
+}
+
 int mail_cache_field_exists(struct mail_cache_view *view, uint32_t seq,
 			    unsigned int field)
 {
@@ -359,6 +430,11 @@ int mail_cache_field_exists(struct mail_cache_view *view, uint32_t seq,
 
 	/* FIXME: we should discard the cache if view has been synced */
 	if (view->cached_exists_seq != seq) {
+		/* the bloom filter is updated in the same index transaction
+		   as the cache offset, so it matches the records that the
+		   view sees */
+		if (mail_cache_field_bloom_missing(view, seq, field))
+			return 0;
 		if (mail_cache_seq(view, seq) < 0)
 			return -1;
 	}
@@ -419,6 +495,17 @@ int mail_cache_lookup_field(struct mail_cache_view *view, buffer_t *dest_buf,
 	struct mail_cache_iterate_field field;
 	int ret;
 
+	mail_cache_total_lookups++;
+	/* fixed size fields may be found from the columnar section without
+	   reading the message's cache record */
+	ret = mail_cache_lookup_column(view, dest_buf, seq, field_idx);
+	if (ret != 0) {
+		mail_cache_decision_state_update(view, seq, field_idx);
+		if (ret > 0)
+			mail_cache_total_hits++;
+		return ret;
+	}
+
 	ret = mail_cache_field_exists(view, seq, field_idx);
 	mail_cache_decision_state_update(view, seq, field_idx);
 	if (ret <= 0)
@@ -440,11 +527,191 @@ int mail_cache_lookup_field(struct mail_cache_view *view, buffer_t *dest_buf,
 			}
 		}
 	}
+	if (ret > 0)
+		mail_cache_total_hits++;
 	/* NOTE: view->cache->fields may have been reallocated by
 	   mail_cache_lookup_*(). */
 	return ret;
 }
 
+void mail_cache_get_lookup_counts(uint64_t *lookups_r, uint64_t *hits_r)
+{
+	*lookups_r = mail_cache_total_lookups;
+	*hits_r = mail_cache_total_hits;
+}
+
+struct mail_cache_multi_offset {
+	uint32_t offset;
+	uint32_t seq;
+	/* cache file_seq that the offset points to */
+	uint32_t file_seq;
+};
+ARRAY_DEFINE_TYPE(mail_cache_multi_offset, struct mail_cache_multi_offset);
+
+static int
+mail_cache_multi_offset_cmp(const struct mail_cache_multi_offset *o1,
+			    const struct mail_cache_multi_offset *o2)
+{
+	if (o1->offset < o2->offset)
+		return -1;
+	if (o1->offset > o2->offset)
+		return 1;
+	return 0;
+}
+
+static int
+mail_cache_lookup_result_cmp(const struct mail_cache_lookup_result *r1,
+			     const struct mail_cache_lookup_result *r2)
+{
+	return uint32_cmp(&r1->seq, &r2->seq);
+}
+
+static int
+mail_cache_lookup_field_from(struct mail_cache_view *view, buffer_t *dest_buf,
+			     uint32_t seq, uint32_t offset,
+			     unsigned int field_idx)
+{
+	struct mail_cache_lookup_iterate_ctx iter;
+	struct mail_cache_iterate_field field;
+	int ret;
+
+	/* like mail_cache_lookup_iter_init(), but the offset was already
+	   looked up. */
+	i_zero(&iter);
+	iter.view = view;
+	iter.seq = seq;
+	iter.offset = offset;
+	iter.remap_counter = view->cache->remap_counter;
+	i_zero(&view->loop_track);
+
+	if (view->cache->fields[field_idx].field.type == MAIL_CACHE_FIELD_BITMASK) {
+		return mail_cache_lookup_bitmask(&iter, field_idx,
+			view->cache->fields[field_idx].field.field_size,
+			dest_buf);
+	}
+	while ((ret = mail_cache_lookup_iter_next(&iter, &field)) > 0) {
+		if (field.field_idx == field_idx) {
+			buffer_append(dest_buf, field.data, field.size);
+			return 1;
+		}
+	}
+	return ret;
+}
+
+static void
+mail_cache_lookup_result_add(ARRAY_TYPE(mail_cache_lookup_result) *results,
+			     uint32_t seq, const buffer_t *dest_buf,
+			     size_t prev_used)
+{
+	struct mail_cache_lookup_result *result;
+
+	result = array_append_space(results);
+	result->seq = seq;
+	result->data_offset = prev_used;
+	result->data_size = dest_buf->used - prev_used;
+}
+
+static int
+mail_cache_lookup_multi_seq(struct mail_cache_view *view, uint32_t seq,
+			    unsigned int field_idx, buffer_t *dest_buf,
+			    ARRAY_TYPE(mail_cache_lookup_result) *results,
+			    ARRAY_TYPE(mail_cache_multi_offset) *offsets)
+{
+	struct mail_cache *cache = view->cache;
+	struct mail_cache_multi_offset *moffset;
+	size_t prev_used = dest_buf->used;
+	uint32_t offset;
+	int ret;
+
+	mail_cache_decision_state_update(view, seq, field_idx);
+	if (MAIL_CACHE_IS_UNUSABLE(cache))
+		return 0;
+
+	if (view->trans_seq1 <= seq && view->trans_seq2 >= seq) {
+		/* uncommitted changes need to be looked up the slow way */
+		ret = mail_cache_lookup_field(view, dest_buf, seq, field_idx);
+	} else {
+		ret = mail_cache_lookup_column(view, dest_buf, seq, field_idx);
+	}
+	if (ret > 0) {
+		mail_cache_lookup_result_add(results, seq, dest_buf, prev_used);
+		return 0;
+	}
+	if (ret < 0)
+		return -1;
+	if (view->trans_seq1 <= seq && view->trans_seq2 >= seq)
+		return 0;
+
+	if ((ret = mail_cache_lookup_offset(cache, view->view,
+					    seq, &offset)) <= 0)
+		return ret;
+	moffset = array_append_space(offsets);
+	moffset->offset = offset;
+	moffset->seq = seq;
+	moffset->file_seq = cache->hdr->file_seq;
+	return 0;
+}
+
+int mail_cache_lookup_field_multi(struct mail_cache_view *view,
+				  const ARRAY_TYPE(seq_range) *seqs,
+				  unsigned int field_idx, buffer_t *dest_buf,
+				  ARRAY_TYPE(mail_cache_lookup_result) *results)
+{
+	struct mail_cache *cache = view->cache;
+	ARRAY_TYPE(mail_cache_multi_offset) offsets;
+	const struct mail_cache_multi_offset *moffset;
+	const struct seq_range *range;
+	unsigned int first_result = array_count(results);
+	size_t prev_used;
+	uint32_t seq;
+	int ret = 0;
+
+	if (!cache->opened)
+		(void)mail_cache_open_and_verify(cache);
+
+	/* first look up the records' offsets */
+	i_array_init(&offsets, I_MIN(seq_range_count(seqs), 1024));
+	array_foreach(seqs, range) {
+		for (seq = range->seq1; seq <= range->seq2 && ret == 0; seq++) {
+			ret = mail_cache_lookup_multi_seq(view, seq, field_idx,
+							  dest_buf, results,
+							  &offsets);
+		}
+	}
+
+	/* then read the records in the order they are in the file */
+	array_sort(&offsets, mail_cache_multi_offset_cmp);
+	array_foreach(&offsets, moffset) {
+		if (ret < 0 || MAIL_CACHE_IS_UNUSABLE(cache))
+			break;
+		prev_used = dest_buf->used;
+		if (cache->hdr->file_seq != moffset->file_seq) {
+			/* cache file was reopened while looking up the
+			   offsets */
+			ret = mail_cache_lookup_field(view, dest_buf,
+						      moffset->seq, field_idx);
+		} else {
+			ret = mail_cache_lookup_field_from(view, dest_buf,
+				moffset->seq, moffset->offset, field_idx);
+		}
+		if (ret > 0) {
+			mail_cache_lookup_result_add(results, moffset->seq,
+						     dest_buf, prev_used);
+		}
+	}
+	array_free(&offsets);
+	if (ret < 0)
+		return -1;
+
+	if (array_count(results) > first_result) {
+		struct mail_cache_lookup_result *new_results =
+			array_idx_modifiable(results, first_result);
+		i_qsort(new_results, array_count(results) - first_result,
+			sizeof(*new_results), mail_cache_lookup_result_cmp);
+	}
+	return 0;
+}
+
 struct header_lookup_data {
 	uint32_t data_size;
 	const unsigned char *data;
@@ -6,16 +6,46 @@
 #include "mail-cache.h"
 
 #define MAIL_CACHE_MAJOR_VERSION 1
-#define MAIL_CACHE_MINOR_VERSION 1
+#define MAIL_CACHE_MINOR_VERSION 3
 
 #define MAIL_CACHE_LOCK_TIMEOUT 10
 #define MAIL_CACHE_LOCK_CHANGE_TIMEOUT 300
 
 #define MAIL_CACHE_MAX_WRITE_BUFFER (1024*256)
 
+/* Magic value in mail_cache_columns_trailer */
+#define MAIL_CACHE_COLUMNS_MAGIC 0x434f4c31 /* "COL1" */
+/* Only fixed size fields up to this size are written to columns */
+#define MAIL_CACHE_COLUMN_MAX_FIELD_SIZE 32
+
+/* Set in a variable size field's size when the value is compressed with the
+   cache file's dictionary. The rest of the bits contain the compressed
+   size. */
+#define MAIL_CACHE_FIELD_SIZE_COMPRESSED 0x80000000U
+/* Maximum size for the compression dictionary */
+#define MAIL_CACHE_DICT_MAX_SIZE (1024*32)
+/* Only values with size between these are compressed */
+#define MAIL_CACHE_DICT_MIN_VALUE_SIZE 32
+#define MAIL_CACHE_DICT_MAX_VALUE_SIZE (1024*1024)
+
+/* The "cache-fields" index extension contains for each message a bloom
+   filter of the fields in its cache records. Each field sets one of the
+   lowest MAIL_CACHE_FIELD_BLOOM_BITS bits based on its name. If the VALID bit
+   isn't set, the filter isn't known to contain all the fields and it can't
+   be used for lookups. */
+#define MAIL_CACHE_FIELD_BLOOM_EXT_NAME "cache-fields"
+#define MAIL_CACHE_FIELD_BLOOM_BITS 31
+#define MAIL_CACHE_FIELD_BLOOM_VALID 0x80000000U
+
 #define MAIL_CACHE_IS_UNUSABLE(cache) \
 	((cache)->hdr == NULL)
 
+enum mail_cache_header_flags {
+	/* mail_cache_dict_header follows directly after mail_cache_header.
+	   Variable size fields may be compressed with the dictionary. */
+	MAIL_CACHE_HDR_FLAG_DICT	= 0x01,
+};
+
 struct mail_cache_header {
 	/* Major version is increased only when you can't have backwards
 	   compatibility. If the field doesn't match MAIL_CACHE_MAJOR_VERSION,
@@ -27,7 +57,9 @@ struct mail_cache_header {
 	/* Minor version is increased when the file format changes in a
 	   backwards compatible way. */
 	uint8_t minor_version;
-	uint8_t unused;
+	/* enum mail_cache_header_flags. This was unused before minor
+	   version 3. */
+	uint8_t flags;
 
 	/* Unique index file ID, which must match the main index's indexid.
 	   See mail_index_header.indexid. */
@@ -98,6 +130,62 @@ struct mail_cache_header_fields {
 #define MAIL_CACHE_FIELD_NAMES(count) \
 	(MAIL_CACHE_FIELD_DECISION(count) + sizeof(uint8_t) * (count))
 
+/* Columnar section. Purging may write the fixed size fields of all the
+   messages as contiguous arrays directly before the first
+   mail_cache_header_fields. This allows looking up these fields for a large
+   number of messages without reading each message's cache record. The
+   section exists only when minor_version >= 2 and the trailer's magic
+   matches. */
+struct mail_cache_columns_header {
+	/* Number of UIDs and values in each column */
+	uint32_t uid_count;
+	/* Number of columns */
+	uint32_t columns_count;
+
+#if 0
+	/* Message UIDs in ascending order */
+	uint32_t uid[uid_count];
+	struct mail_cache_column_header columns[columns_count];
+	/* for each column at mail_cache_column_header.data_offset: */
+	/* Bit (1 << (n % 8)) in byte n / 8 is set if uid[n] has this
+	   field cached. Padded to 32bit alignment. */
+	uint8_t present_bitmap[(uid_count + 31) / 32 * 4];
+	/* Values, padded to 32bit alignment */
+	unsigned char value[uid_count][field_size];
+#endif
+};
+
+struct mail_cache_column_header {
+	/* File-specific field index */
+	uint32_t file_field;
+	/* Same as the field's size in mail_cache_header_fields */
+	uint32_t field_size;
+	/* Offset to the column's presence bitmap, relative to the beginning
+	   of mail_cache_columns_header */
+	uint32_t data_offset;
+};
+
+struct mail_cache_columns_trailer {
+	/* Size of the whole columnar section, including this trailer */
+	uint32_t size;
+	/* MAIL_CACHE_COLUMNS_MAGIC */
+	uint32_t magic;
+};
+
+/* Compression dictionary, which exists if MAIL_CACHE_HDR_FLAG_DICT is set.
+   It's trained while purging, so the values written afterwards to the same
+   file are never compressed. */
+struct mail_cache_dict_header {
+	/* Size of the whole dictionary section, including this header.
+	   Padded to 32bit alignment. */
+	uint32_t size;
+	/* Size of the dictionary */
+	uint32_t dict_size;
+#if 0
+	unsigned char dict[dict_size];
+#endif
+};
+
 struct mail_cache_record {
 	uint32_t prev_offset;
 	uint32_t size; /* full record size, including this header */
@@ -106,6 +194,8 @@ struct mail_cache_record {
 
 struct mail_cache_field_private {
 	struct mail_cache_field field;
+	/* Bit for this field in the "cache-fields" bloom filter */
+	uint32_t bloom_bit;
 
 	/* Highest message UID whose cache field of this type have been
 	   accessed within this session. This is used to track whether messages
@@ -121,11 +211,22 @@ struct mail_cache_field_private {
 	bool decision_dirty:1;
 };
 
+struct mail_cache_column {
+	/* File-specific field index */
+	uint32_t file_field;
+	uint32_t field_size;
+	/* Cache file offsets to the presence bitmap and the values */
+	uint32_t bitmap_offset;
+	uint32_t values_offset;
+};
+
 struct mail_cache {
 	struct mail_index *index;
 	struct event *event;
 	/* Registered "cache" extension ID */
 	uint32_t ext_id;
+	/* Registered "cache-fields" extension ID */
+	uint32_t bloom_ext_id;
 
 	char *filepath;
 	int fd;
@@ -169,6 +270,23 @@ struct mail_cache {
 	   pointers. */
 	uint32_t last_field_header_offset;
 
+	/* The columnar section has been looked up for the cache file with
+	   this file_seq. 0 if not yet looked up. */
+	uint32_t columns_file_seq;
+	/* Cache file offset to mail_cache_columns_header, 0 if none */
+	uint32_t columns_offset;
+	uint32_t columns_uid_count;
+	ARRAY(struct mail_cache_column) columns;
+	/* Index of the last UID found from the columns. Used to avoid binary
+	   searching when messages are looked up in ascending order. */
+	unsigned int columns_last_uid_idx;
+
+	/* The compression dictionary has been read for the cache file with
+	   this file_seq. 0 if not yet read. */
+	uint32_t dict_file_seq;
+	/* Decompression state, NULL if the file has no dictionary */
+	struct mail_cache_dict *dict;
+
 	/* Memory pool used for permanent field allocations. Currently this
 	   means mail_cache_field.name and field_name_hash. */
 	pool_t field_pool;
@@ -266,6 +384,10 @@ struct mail_cache_view {
 	uint8_t cached_exists_value;
 	uint32_t cached_exists_seq;
 
+	/* Decompressed field values returned by mail_cache_lookup_iter_next()
+	   point to this buffer. */
+	buffer_t *decompress_buf;
+
 	/* mail_cache_view_update_cache_decisions() has been used to disable
 	   updating cache decisions. */
 	bool no_decision_updates:1;
@@ -351,6 +473,11 @@ void mail_cache_expunge_count(struct mail_cache *cache, unsigned int count);
 
 uint32_t mail_cache_lookup_cur_offset(struct mail_index_view *view,
 				      uint32_t seq, uint32_t *reset_id_r);
+/* Look up the message's cache offset, making sure it points to the current
+   cache file. Returns 1 if found, 0 if not, -1 if error. */
+int mail_cache_lookup_offset(struct mail_cache *cache,
+			     struct mail_index_view *view,
+			     uint32_t seq, uint32_t *offset_r);
 int mail_cache_get_record(struct mail_cache *cache, uint32_t offset,
 			  const struct mail_cache_record **rec_r);
 uint32_t mail_cache_get_first_new_seq(struct mail_index_view *view);
@@ -399,6 +526,68 @@ mail_cache_decision_changed_event(struct mail_cache *cache, struct event *event,
 
 bool mail_cache_headers_check_capped(struct mail_cache *cache);
 
+/* Returns TRUE if the "cache-fields" bloom filter should be updated when
+   writing cache records. Once the extension exists in the index it's kept
+   updated even if it's not enabled by the settings. */
+bool mail_cache_want_field_bloom(struct mail_cache *cache,
+				 struct mail_index_view *view);
+
+/* Look up field from the columnar section. Returns 1 if found, 0 if the
+   columns can't be used for this lookup (the caller needs to fall back to
+   looking up the cache record) or -1 if error. */
+int mail_cache_lookup_column(struct mail_cache_view *view, buffer_t *dest_buf,
+			     uint32_t seq, unsigned int field_idx);
+
+struct mail_cache_columns_write_ctx;
+/* Start collecting columns for purging. Returns NULL if no columns should be
+   written. field_file_map is the new file's field mapping. */
+struct mail_cache_columns_write_ctx *
+mail_cache_columns_write_init(struct mail_cache *cache,
+			      const uint32_t *field_file_map,
+			      uint32_t messages_count);
+/* Field was written to the record buffer at the given position. */
+void mail_cache_columns_write_field(struct mail_cache_columns_write_ctx *ctx,
+				    unsigned int field_idx, size_t rec_pos);
+/* The current message's record was written to the cache file. rec_buf
+   contains the record. */
+void mail_cache_columns_write_message(struct mail_cache_columns_write_ctx *ctx,
+				      uint32_t uid, const buffer_t *rec_buf);
+/* The current message's record was dropped. */
+void mail_cache_columns_write_skip(struct mail_cache_columns_write_ctx *ctx);
+/* Write the columnar section to output and free the context. */
+void mail_cache_columns_write_finish(struct mail_cache_columns_write_ctx **ctx,
+				     struct ostream *output);
+void mail_cache_columns_write_abort(struct mail_cache_columns_write_ctx **ctx);
+
+struct mail_cache_dict_write_ctx;
+/* Start collecting samples for training a compression dictionary while
+   purging. Returns NULL if no dictionary should be written. */
+struct mail_cache_dict_write_ctx *
+mail_cache_dict_write_init(struct mail_cache *cache, uint32_t messages_count);
+/* Returns TRUE if more samples are still wanted. */
+bool mail_cache_dict_write_sample(struct mail_cache_dict_write_ctx *ctx,
+				  const void *data, size_t size);
+/* Train the dictionary from the samples and write it to output, which must
+   be directly after mail_cache_header. Returns TRUE if the dictionary was
+   written. If FALSE is returned, ctx is freed. */
+bool mail_cache_dict_write_train(struct mail_cache_dict_write_ctx **ctx,
+				 struct ostream *output);
+/* Append the value compressed with the trained dictionary to dest. Returns
+   FALSE if the value shouldn't be compressed, and nothing is appended. */
+bool mail_cache_dict_compress(struct mail_cache_dict_write_ctx *ctx,
+			      const void *data, size_t size, buffer_t *dest);
+void mail_cache_dict_write_deinit(struct mail_cache_dict_write_ctx **ctx);
+
+/* Read the cache file's compression dictionary if it's not already read.
+   Returns 1 if the dictionary exists, 0 if not, -1 on error. */
+int mail_cache_dict_read(struct mail_cache *cache);
+/* Decompress a value compressed with the cache file's dictionary into dest.
+   mail_cache_dict_read() must have returned 1. Returns 0 on success, -1 if
+   the cache file is corrupted. */
+int mail_cache_dict_decompress(struct mail_cache *cache,
+			       const void *data, size_t size, buffer_t *dest);
+void mail_cache_dict_free(struct mail_cache *cache);
+
 struct mail_cache_purge_drop_ctx {
 	struct mail_cache *cache;
 	time_t max_yes_downgrade_time;
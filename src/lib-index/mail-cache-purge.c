@@ -13,6 +13,13 @@
 #include <stdio.h>
 #include <sys/stat.h>
 
+struct mail_cache_purge_ext_rec {
+	uint32_t offset;
+	/* Bloom filter for the "cache-fields" extension */
+	uint32_t field_bloom;
+};
+ARRAY_DEFINE_TYPE(mail_cache_purge_ext_rec, struct mail_cache_purge_ext_rec);
+
 struct mail_cache_copy_context {
 	struct mail_cache *cache;
 	struct event *event;
@@ -21,7 +28,10 @@ struct mail_cache_copy_context {
 	buffer_t *buffer, *field_seen;
 	ARRAY(unsigned int) bitmask_pos;
 	uint32_t *field_file_map;
+	struct mail_cache_columns_write_ctx *columns;
+	struct mail_cache_dict_write_ctx *dict;
 
+	uint32_t field_bloom;
 	uint8_t field_seen_value;
 	bool new_msg;
 };
@@ -79,10 +89,25 @@ mail_cache_purge_field(struct mail_cache_copy_context *ctx,
 	}
 
 	buffer_append(ctx->buffer, &file_field_idx, sizeof(file_field_idx));
+	ctx->field_bloom |= ctx->cache->fields[field->field_idx].bloom_bit;
 
 	if (cache_field->field_size == UINT_MAX) {
+		size_t size_pos = ctx->buffer->used;
+
 		size32 = (uint32_t)field->size;
 		buffer_append(ctx->buffer, &size32, sizeof(size32));
+		if (ctx->dict != NULL &&
+		    mail_cache_dict_compress(ctx->dict, field->data,
+					     field->size, ctx->buffer)) {
+			size32 = (ctx->buffer->used - size_pos - sizeof(size32)) |
+				MAIL_CACHE_FIELD_SIZE_COMPRESSED;
+			buffer_write(ctx->buffer, size_pos,
+				     &size32, sizeof(size32));
+			if ((ctx->buffer->used & 3) != 0)
+				buffer_append_zero(ctx->buffer,
+						   4 - (ctx->buffer->used & 3));
+			return;
+		}
 	}
 
 	if (cache_field->type == MAIL_CACHE_FIELD_BITMASK) {
@@ -91,11 +116,41 @@ mail_cache_purge_field(struct mail_cache_copy_context *ctx,
 
 		array_idx_set(&ctx->bitmask_pos, field->field_idx, &pos);
 	}
+	if (ctx->columns != NULL) {
+		mail_cache_columns_write_field(ctx->columns, field->field_idx,
+					       ctx->buffer->used);
+	}
 	buffer_append(ctx->buffer, field->data, field->size);
 	if ((field->size & 3) != 0)
 		buffer_append_zero(ctx->buffer, 4 - (field->size & 3));
 }
 
+static void
+mail_cache_purge_dict_samples(struct mail_cache_copy_context *ctx,
+			      struct mail_cache_view *cache_view,
+			      struct mail_index_transaction *trans,
+			      uint32_t seq, uint32_t message_count)
+{
+	struct mail_cache_lookup_iterate_ctx iter;
+	struct mail_cache_iterate_field field;
+	bool want_more = TRUE;
+
+	for (; seq <= message_count && want_more; seq++) {
+		if (mail_index_transaction_is_expunged(trans, seq))
+			continue;
+
+		mail_cache_lookup_iter_init(cache_view, seq, &iter);
+		while (want_more &&
+		       mail_cache_lookup_iter_next(&iter, &field) > 0) {
+			if (ctx->field_file_map[field.field_idx] == (uint32_t)-1 ||
+			    ctx->cache->fields[field.field_idx].field.field_size != UINT_MAX)
+				continue;
+			want_more = mail_cache_dict_write_sample(ctx->dict,
+						field.data, field.size);
+		}
+	}
+}
+
 static uint32_t get_next_file_seq(struct mail_cache *cache)
 {
 	const struct mail_index_ext *ext;
@@ -198,11 +253,119 @@ mail_cache_purge_check_field(struct mail_cache_copy_context *ctx,
 	return priv->used;
 }
 
+struct mail_cache_purge_field_size {
+	unsigned int field_idx;
+	time_t last_used;
+	uint64_t size;
+};
+
+static int
+mail_cache_purge_field_size_cmp(const struct mail_cache_purge_field_size *f1,
+				const struct mail_cache_purge_field_size *f2)
+{
+	/* least recently used first, and for equally old fields the ones that
+	   save the most space */
+	if (f1->last_used != f2->last_used)
+		return f1->last_used < f2->last_used ? -1 : 1;
+	if (f1->size != f2->size)
+		return f1->size > f2->size ? -1 : 1;
+	return 0;
+}
+
+static unsigned int
+mail_cache_purge_fields_budget(struct mail_cache_copy_context *ctx,
+			       struct mail_cache_view *cache_view,
+			       struct mail_index_transaction *trans,
+			       unsigned int used_fields_count)
+{
+	struct mail_cache *cache = ctx->cache;
+	uoff_t max_size = cache->index->optimization_set.cache.fields_max_size;
+	struct mail_cache_lookup_iterate_ctx iter;
+	struct mail_cache_iterate_field field;
+	ARRAY(struct mail_cache_purge_field_size) fields;
+	struct mail_cache_purge_field_size *fsize;
+	uint64_t *sizes, total_size = 0;
+	uint32_t seq, message_count;
+	unsigned int i;
+
+	/* Find out how much space each field uses. The record headers are
+	   ignored, since they can't be dropped anyway. */
+	sizes = t_new(uint64_t, cache->fields_count);
+	message_count = mail_index_view_get_messages_count(cache_view->view);
+	for (seq = 1; seq <= message_count; seq++) {
+		if (mail_index_transaction_is_expunged(trans, seq))
+			continue;
+
+		mail_cache_lookup_iter_init(cache_view, seq, &iter);
+		while (mail_cache_lookup_iter_next(&iter, &field) > 0) {
+			if (ctx->field_file_map[field.field_idx] == (uint32_t)-1)
+				continue;
+			sizes[field.field_idx] += sizeof(uint32_t) +
+				((field.size + 3) & ~3U);
+			if (cache->fields[field.field_idx].field.field_size == UINT_MAX)
+				sizes[field.field_idx] += sizeof(uint32_t);
+		}
+	}
+
+	t_array_init(&fields, used_fields_count);
+	for (i = 0; i < cache->fields_count; i++) {
+		if (ctx->field_file_map[i] == (uint32_t)-1)
+			continue;
+		total_size += sizes[i];
+		if ((cache->fields[i].field.decision &
+		     MAIL_CACHE_DECISION_FORCED) != 0 || sizes[i] == 0)
+			continue;
+		fsize = array_append_space(&fields);
+		fsize->field_idx = i;
+		fsize->last_used = cache->fields[i].field.last_used;
+		fsize->size = sizes[i];
+	}
+	if (total_size <= max_size)
+		return used_fields_count;
+
+	/* drop fields until the rest fit within the limit */
+	array_sort(&fields, mail_cache_purge_field_size_cmp);
+	array_foreach_modifiable(&fields, fsize) {
+		struct mail_cache_field_private *priv =
+			&cache->fields[fsize->field_idx];
+		const char *dec_str =
+			mail_cache_decision_to_string(priv->field.decision);
+		struct event_passthrough *e =
+			event_create_passthrough(ctx->event)->
+			set_name("mail_cache_purge_drop_field")->
+			add_str("field", priv->field.name)->
+			add_str("decision", dec_str)->
+			add_int("last_used", priv->field.last_used)->
+			add_int("size", fsize->size);
+		e_debug(e->event(), "Purge dropped field %s to fit "
+			"mail_cache_fields_max_size (decision=%s, "
+			"last_used=%"PRIdTIME_T", size=%"PRIu64")",
+			priv->field.name, dec_str, priv->field.last_used,
+			fsize->size);
+		priv->field.decision = MAIL_CACHE_DECISION_NO;
+		priv->used = FALSE;
+		priv->field.last_used = 0;
+		ctx->field_file_map[fsize->field_idx] = (uint32_t)-1;
+
+		total_size -= fsize->size;
+		if (total_size <= max_size)
+			break;
+	}
+
+	/* renumber the remaining fields */
+	for (i = used_fields_count = 0; i < cache->fields_count; i++) {
+		if (ctx->field_file_map[i] != (uint32_t)-1)
+			ctx->field_file_map[i] = used_fields_count++;
+	}
+	return used_fields_count;
+}
+
 static int
 mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 		struct event *event, int fd, const char *reason,
 		uint32_t *file_seq_r, uoff_t *file_size_r, uint32_t *max_uid_r,
-		uint32_t *ext_first_seq_r, ARRAY_TYPE(uint32_t) *ext_offsets)
+		uint32_t *ext_first_seq_r,
+		ARRAY_TYPE(mail_cache_purge_ext_rec) *ext_recs)
 {
         struct mail_cache_copy_context ctx;
 	struct mail_cache_lookup_iterate_ctx iter;
@@ -213,7 +376,8 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 	struct mail_cache_header hdr;
 	struct mail_cache_record cache_rec;
 	struct ostream *output;
-	uint32_t message_count, seq, first_new_seq, ext_offset;
+	struct mail_cache_purge_ext_rec *ext_rec;
+	uint32_t message_count, seq, first_new_seq;
 	unsigned int i, used_fields_count, orig_fields_count, record_count;
 
 	i_assert(reason != NULL);
@@ -269,6 +433,11 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 			else
 				ctx.field_file_map[i] = used_fields_count++;
 		}
+		if (cache->index->optimization_set.cache.fields_max_size != 0) {
+			used_fields_count =
+				mail_cache_purge_fields_budget(&ctx, cache_view,
+					trans, used_fields_count);
+		}
 	}
 
 	/* get sequence of first message which doesn't need its temp fields
@@ -283,14 +452,26 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 	}
 
 	*ext_first_seq_r = seq;
-	i_array_init(ext_offsets, message_count); record_count = 0;
+	ctx.dict = mail_cache_dict_write_init(cache, message_count - seq + 1);
+	if (ctx.dict != NULL) {
+		/* the dictionary is written directly after the header, so it
+		   needs to be trained before any records are written */
+		mail_cache_purge_dict_samples(&ctx, cache_view, trans,
+					      seq, message_count);
+		if (mail_cache_dict_write_train(&ctx.dict, output))
+			hdr.flags |= MAIL_CACHE_HDR_FLAG_DICT;
+	}
+	ctx.columns = mail_cache_columns_write_init(cache, ctx.field_file_map,
+						    message_count - seq + 1);
+	i_array_init(ext_recs, message_count); record_count = 0;
 	for (; seq <= message_count; seq++) {
 		if (mail_index_transaction_is_expunged(trans, seq)) {
-			array_append_zero(ext_offsets);
+			array_append_zero(ext_recs);
 			continue;
 		}
 
 		ctx.new_msg = seq >= first_new_seq;
+		ctx.field_bloom = 0;
 		buffer_set_used_size(ctx.buffer, 0);
 
 		ctx.field_seen_value = (ctx.field_seen_value + 1) & UINT8_MAX;
@@ -311,24 +492,34 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 		if (ctx.buffer->used == sizeof(cache_rec) ||
 		    ctx.buffer->used > cache->index->optimization_set.cache.record_max_size) {
 			/* nothing cached */
-			ext_offset = 0;
+			ext_rec = array_append_space(ext_recs);
+			if (ctx.columns != NULL)
+				mail_cache_columns_write_skip(ctx.columns);
 		} else {
 			mail_index_lookup_uid(view, seq, max_uid_r);
+			if (ctx.columns != NULL) {
+				mail_cache_columns_write_message(ctx.columns,
+					*max_uid_r, ctx.buffer);
+			}
 			cache_rec.size = ctx.buffer->used;
-			ext_offset = output->offset;
+			ext_rec = array_append_space(ext_recs);
+			ext_rec->offset = output->offset;
+			ext_rec->field_bloom =
+				ctx.field_bloom | MAIL_CACHE_FIELD_BLOOM_VALID;
 			buffer_write(ctx.buffer, 0, &cache_rec,
 				     sizeof(cache_rec));
 			o_stream_nsend(output, ctx.buffer->data, cache_rec.size);
 			record_count++;
 		}
-
-		array_push_back(ext_offsets, &ext_offset);
 	}
 	i_assert(orig_fields_count == cache->fields_count);
 
 	bool file_too_large =
 		output->offset > cache->index->optimization_set.cache.max_size;
 	if (!file_too_large) {
+		/* the columns must be written directly before the first
+		   field header */
+		mail_cache_columns_write_finish(&ctx.columns, output);
 		hdr.record_count = record_count;
 		hdr.field_header_offset = mail_index_uint32_to_offset(output->offset);
 		mail_cache_purge_get_fields(&ctx, used_fields_count);
@@ -336,6 +527,8 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 	}
 
 	hdr.backwards_compat_used_file_size = output->offset;
+	mail_cache_columns_write_abort(&ctx.columns);
+	mail_cache_dict_write_deinit(&ctx.dict);
 	buffer_free(&ctx.buffer);
 	buffer_free(&ctx.field_seen);
 
@@ -358,7 +551,7 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 			i_unlink(cache->filepath);
 		}
 		o_stream_destroy(&output);
-		array_free(ext_offsets);
+		array_free(ext_recs);
 		return -1;
 	}
 	o_stream_destroy(&output);
@@ -366,7 +559,7 @@ mail_cache_copy(struct mail_cache *cache, struct mail_index_transaction *trans,
 	if (cache->index->set.fsync_mode == FSYNC_MODE_ALWAYS) {
 		if (fdatasync(fd) < 0) {
 			mail_cache_set_syscall_error(cache, "fdatasync()");
-			array_free(ext_offsets);
+			array_free(ext_recs);
 			return -1;
 		}
 	}
@@ -384,8 +577,8 @@ mail_cache_purge_write(struct mail_cache *cache,
 	struct event *event;
 	struct stat st;
 	uint32_t prev_file_seq, file_seq, old_offset, max_uid, ext_first_seq;
-	ARRAY_TYPE(uint32_t) ext_offsets;
-	const uint32_t *offsets;
+	ARRAY_TYPE(mail_cache_purge_ext_rec) ext_recs;
+	const struct mail_cache_purge_ext_rec *recs;
 	uoff_t prev_file_size, file_size;
 	unsigned int i, count, prev_deleted_records;
 
@@ -405,20 +598,20 @@ mail_cache_purge_write(struct mail_cache *cache,
 
 	if (mail_cache_copy(cache, trans, event, fd, reason,
 			    &file_seq, &file_size, &max_uid,
-			    &ext_first_seq, &ext_offsets) < 0) {
+			    &ext_first_seq, &ext_recs) < 0) {
 		event_unref(&event);
 		return -1;
 	}
 
 	if (fstat(fd, &st) < 0) {
 		mail_cache_set_syscall_error(cache, "fstat()");
-		array_free(&ext_offsets);
+		array_free(&ext_recs);
 		event_unref(&event);
 		return -1;
 	}
 	if (rename(temp_path, cache->filepath) < 0) {
 		mail_cache_set_syscall_error(cache, "rename()");
-		array_free(&ext_offsets);
+		array_free(&ext_recs);
 		event_unref(&event);
 		return -1;
 	}
@@ -434,15 +627,21 @@ mail_cache_purge_write(struct mail_cache *cache,
 	/* once we're sure that the purging was successful,
 	   update the offsets */
 	mail_index_ext_reset(trans, cache->ext_id, file_seq, TRUE);
-	offsets = array_get(&ext_offsets, &count);
+	bool update_field_bloom =
+		mail_cache_want_field_bloom(cache, trans->view);
+	recs = array_get(&ext_recs, &count);
 	for (i = 0; i < count; i++) {
-		if (offsets[i] != 0) {
+		if (recs[i].offset == 0)
+			continue;
+		mail_index_update_ext(trans, ext_first_seq + i, cache->ext_id,
+				      &recs[i].offset, &old_offset);
+		if (update_field_bloom) {
 			mail_index_update_ext(trans, ext_first_seq + i,
-					      cache->ext_id,
-					      &offsets[i], &old_offset);
+					      cache->bloom_ext_id,
+					      &recs[i].field_bloom, NULL);
 		}
 	}
-	array_free(&ext_offsets);
+	array_free(&ext_recs);
 
 	if (*unlock) {
 		mail_cache_unlock(cache);
@@ -25,6 +25,8 @@
 struct mail_cache_transaction_rec {
 	uint32_t seq;
 	uint32_t cache_data_pos;
+	/* "cache-fields" bloom filter after this record is linked */
+	uint32_t field_bloom;
 };
 
 struct mail_cache_transaction_ctx {
@@ -44,6 +46,7 @@ struct mail_cache_transaction_ctx {
 	ARRAY_TYPE(seq_range) cache_data_wanted_seqs;
 	uint32_t prev_seq, min_seq;
 	size_t last_rec_pos;
+	size_t max_buffer_size;
 
 	unsigned int records_written;
 
@@ -51,6 +54,7 @@ struct mail_cache_transaction_ctx {
 	bool decisions_refreshed:1;
 	bool have_noncommited_mails:1;
 	bool changes:1;
+	bool update_field_bloom:1;
 };
 
 static MODULE_CONTEXT_DEFINE_INIT(cache_mail_index_transaction_module,
@@ -110,6 +114,7 @@ mail_cache_get_transaction(struct mail_cache_view *view,
 	ctx->cache = view->cache;
 	ctx->view = view;
 	ctx->trans = t;
+	ctx->max_buffer_size = MAIL_CACHE_MAX_WRITE_BUFFER;
 
 	i_assert(view->transaction == NULL);
 	view->transaction = ctx;
@@ -144,6 +149,12 @@ mail_cache_transaction_forget_flushed(struct mail_cache_transaction_ctx *ctx,
 				    ctx->cache_file_seq);
 }
 
+void mail_cache_transaction_set_max_buffer_size(
+	struct mail_cache_transaction_ctx *ctx, size_t size)
+{
+	ctx->max_buffer_size = I_MAX(size, MAIL_CACHE_MAX_WRITE_BUFFER);
+}
+
 void mail_cache_transaction_reset(struct mail_cache_transaction_ctx *ctx)
 {
 	mail_cache_transaction_forget_flushed(ctx, FALSE);
@@ -328,6 +339,11 @@ mail_cache_transaction_update_index(struct mail_cache_transaction_ctx *ctx,
 	for (i = 0; i < seq_count; i++) {
 		mail_index_update_ext(trans, recs[i].seq, cache->ext_id,
 				      &write_offset, NULL);
+		if (ctx->update_field_bloom) {
+			mail_index_update_ext(trans, recs[i].seq,
+					      cache->bloom_ext_id,
+					      &recs[i].field_bloom, NULL);
+		}
 
 		write_offset += rec->size;
 		rec = CONST_PTR_OFFSET(rec, rec->size);
@@ -343,29 +359,83 @@ mail_cache_transaction_update_index(struct mail_cache_transaction_ctx *ctx,
 	}
 }
 
+static uint32_t
+mail_cache_record_get_field_bloom(struct mail_cache *cache,
+				  const struct mail_cache_record *rec)
+{
+	const unsigned char *p = CONST_PTR_OFFSET(rec, sizeof(*rec));
+	const unsigned char *end = CONST_PTR_OFFSET(rec, rec->size);
+	uint32_t file_field, field_idx, data_size, bloom = 0;
+
+	/* the record already uses the file-specific field indexes */
+	while (p < end) {
+		memcpy(&file_field, p, sizeof(file_field));
+		p += sizeof(file_field);
+		i_assert(file_field < cache->file_fields_count);
+		field_idx = cache->file_field_map[file_field];
+		bloom |= cache->fields[field_idx].bloom_bit;
+
+		data_size = cache->fields[field_idx].field.field_size;
+		if (data_size == UINT_MAX) {
+			memcpy(&data_size, p, sizeof(data_size));
+			p += sizeof(data_size);
+		}
+		/* data & 32bit padding */
+		p += (data_size + sizeof(uint32_t)-1) & ~(sizeof(uint32_t)-1);
+	}
+	return bloom;
+}
+
+static uint32_t
+mail_cache_lookup_prev_field_bloom(struct mail_cache_transaction_ctx *ctx,
+				   uint32_t seq, uint32_t prev_offset)
+{
+	const void *data;
+	uint32_t bloom;
+	bool expunged;
+
+	if (prev_offset == 0) {
+		/* this is the first record */
+		return MAIL_CACHE_FIELD_BLOOM_VALID;
+	}
+	mail_index_lookup_ext(ctx->view->trans_view, seq,
+			      ctx->cache->bloom_ext_id, &data, &expunged);
+	if (data == NULL)
+		return 0;
+	memcpy(&bloom, data, sizeof(bloom));
+	return bloom;
+}
+
 static int
 mail_cache_link_records(struct mail_cache_transaction_ctx *ctx,
 			uint32_t write_offset)
 {
 	struct mail_index_map *map;
 	struct mail_cache_record *rec;
-	const struct mail_cache_transaction_rec *recs;
+	struct mail_cache_transaction_rec *recs;
 	const uint32_t *prev_offsetp;
-	ARRAY_TYPE(uint32_t) seq_offsets;
-	uint32_t i, seq_count, reset_id, prev_offset, *offsetp;
+	ARRAY_TYPE(uint32_t) seq_offsets, seq_blooms;
+	uint32_t i, seq_count, reset_id, prev_offset, prev_bloom;
+	uint32_t *offsetp, *bloomp;
 	const void *data;
 
 	i_assert(ctx->min_seq != 0);
 
+	ctx->update_field_bloom =
+		mail_cache_want_field_bloom(ctx->cache, ctx->view->trans_view);
 	i_array_init(&seq_offsets, 64);
-	recs = array_get(&ctx->cache_data_seq, &seq_count);
+	i_array_init(&seq_blooms, 64);
+	recs = array_get_modifiable(&ctx->cache_data_seq, &seq_count);
 	rec = buffer_get_modifiable_data(ctx->cache_data, NULL);
 	for (i = 0; i < seq_count; i++) {
 		offsetp = array_idx_get_space(&seq_offsets,
 					       recs[i].seq - ctx->min_seq);
-		if (*offsetp != 0)
+		bloomp = array_idx_get_space(&seq_blooms,
+					     recs[i].seq - ctx->min_seq);
+		if (*offsetp != 0) {
 			prev_offset = *offsetp;
-		else {
+			prev_bloom = *bloomp;
+		} else {
 			mail_index_lookup_ext_full(ctx->view->trans_view, recs[i].seq,
 						   ctx->cache->ext_id, &map,
 						   &data, NULL);
@@ -384,8 +454,12 @@ mail_cache_link_records(struct mail_cache_transaction_ctx *ctx,
 				mail_cache_set_corrupted(ctx->cache,
 					"Cache record offset points outside existing file");
 				array_free(&seq_offsets);
+				array_free(&seq_blooms);
 				return -1;
 			}
+			prev_bloom = !ctx->update_field_bloom ? 0 :
+				mail_cache_lookup_prev_field_bloom(ctx,
+					recs[i].seq, prev_offset);
 		}
 
 		if (prev_offset != 0) {
@@ -397,10 +471,21 @@ mail_cache_link_records(struct mail_cache_transaction_ctx *ctx,
 		}
 		*offsetp = write_offset;
 
+		if ((prev_bloom & MAIL_CACHE_FIELD_BLOOM_VALID) == 0) {
+			/* the previous records may have been written without
+			   updating the bloom filter */
+			*bloomp = 0;
+		} else {
+			*bloomp = prev_bloom |
+				mail_cache_record_get_field_bloom(ctx->cache, rec);
+		}
+		recs[i].field_bloom = *bloomp;
+
 		write_offset += rec->size;
 		rec = PTR_OFFSET(rec, rec->size);
 	}
 	array_free(&seq_offsets);
+	array_free(&seq_blooms);
 	ctx->cache->hdr_modified = TRUE;
 	return 0;
 }
@@ -843,13 +928,13 @@ void mail_cache_add(struct mail_cache_transaction_ctx *ctx, uint32_t seq,
 	buffer_write(ctx->view->cached_exists_buf, field_idx,
 		     &ctx->view->cached_exists_value, 1);
 
-	if (ctx->cache_data->used + full_size > MAIL_CACHE_MAX_WRITE_BUFFER &&
+	if (ctx->cache_data->used + full_size > ctx->max_buffer_size &&
 	    ctx->last_rec_pos > 0) {
 		/* time to flush our buffer. */
 		if (MAIL_INDEX_IS_IN_MEMORY(ctx->cache->index)) {
 			/* just drop the old data to free up memory */
 			size_t space_needed = ctx->cache_data->used +
-				full_size - MAIL_CACHE_MAX_WRITE_BUFFER;
+				full_size - ctx->max_buffer_size;
 			mail_cache_transaction_drop_unwanted(ctx, space_needed);
 		} else {
 			if (mail_cache_transaction_flush(ctx, FALSE) < 0) {
@@ -99,6 +99,9 @@ void mail_cache_file_close(struct mail_cache *cache)
 	cache->hdr = NULL;
 	cache->mmap_length = 0;
 	cache->last_field_header_offset = 0;
+	cache->columns_file_seq = 0;
+	cache->columns_offset = 0;
+	mail_cache_dict_free(cache);
 
 	file_lock_free(&cache->file_lock);
 	cache->locked = FALSE;
@@ -597,9 +600,20 @@ mail_cache_open_or_create_path(struct mail_index *index, const char *path)
 					sizeof(uint32_t), sizeof(uint32_t));
 	mail_index_register_expunge_handler(index, cache->ext_id,
 					    mail_cache_expunge_handler);
+	cache->bloom_ext_id =
+		mail_index_ext_register(index, MAIL_CACHE_FIELD_BLOOM_EXT_NAME,
+					0, sizeof(uint32_t), sizeof(uint32_t));
 	return cache;
 }
 
+bool mail_cache_want_field_bloom(struct mail_cache *cache,
+				 struct mail_index_view *view)
+{
+	if (cache->index->optimization_set.cache.field_bloom)
+		return TRUE;
+	return mail_index_view_get_ext(view, cache->bloom_ext_id) != NULL;
+}
+
 struct mail_cache *mail_cache_open_or_create(struct mail_index *index)
 {
 	const char *path = t_strconcat(index->filepath,
@@ -622,6 +636,8 @@ void mail_cache_free(struct mail_cache **_cache)
 	mail_cache_file_close(cache);
 
 	buffer_free(&cache->read_buf);
+	if (array_is_created(&cache->columns))
+		array_free(&cache->columns);
 	hash_table_destroy(&cache->field_name_hash);
 	pool_unref(&cache->field_pool);
 	event_unref(&cache->event);
@@ -977,6 +993,7 @@ void mail_cache_view_close(struct mail_cache_view **_view)
 
 	DLLIST_REMOVE(&view->cache->views, view);
 	buffer_free(&view->cached_exists_buf);
+	buffer_free(&view->decompress_buf);
 	i_free(view);
 }
 
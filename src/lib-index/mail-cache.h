@@ -2,6 +2,7 @@
 #define MAIL_CACHE_H
 
 #include "mail-index.h"
+#include "seq-range-array.h"
 
 #define MAIL_CACHE_FILE_SUFFIX ".cache"
 
@@ -135,6 +136,11 @@ struct mail_cache_transaction_ctx *
 mail_cache_get_transaction(struct mail_cache_view *view,
 			   struct mail_index_transaction *t);
 
+/* Set how much cache data is buffered in memory before it's written to the
+   cache file. The default is MAIL_CACHE_MAX_WRITE_BUFFER. A larger buffer
+   reduces the number of cache file writes when caching many mails. */
+void mail_cache_transaction_set_max_buffer_size(
+	struct mail_cache_transaction_ctx *ctx, size_t size);
 void mail_cache_transaction_reset(struct mail_cache_transaction_ctx *ctx);
 int mail_cache_transaction_commit(struct mail_cache_transaction_ctx **ctx);
 void mail_cache_transaction_rollback(struct mail_cache_transaction_ctx **ctx);
@@ -177,6 +183,27 @@ void mail_cache_decision_add(struct mail_cache_view *view, uint32_t seq,
    Returns 1 if field was found, 0 if not, -1 if error. */
 int mail_cache_lookup_field(struct mail_cache_view *view, buffer_t *dest_buf,
 			    uint32_t seq, unsigned int field_idx);
+/* Returns the number of mail_cache_lookup_field() calls done by this process
+   and how many of them found the field. */
+void mail_cache_get_lookup_counts(uint64_t *lookups_r, uint64_t *hits_r);
+
+struct mail_cache_lookup_result {
+	uint32_t seq;
+	/* The field's data is in dest_buf at data_offset..+data_size */
+	uint32_t data_offset;
+	uint32_t data_size;
+};
+ARRAY_DEFINE_TYPE(mail_cache_lookup_result, struct mail_cache_lookup_result);
+
+/* Look up the field for all the messages in seqs. The cache records are
+   read in their file offset order to avoid random access. The found fields
+   are appended to dest_buf and a result is added to results for each of
+   them, sorted by seq. Messages that don't have the field cached are
+   skipped. Returns 0 if ok, -1 if error. */
+int mail_cache_lookup_field_multi(struct mail_cache_view *view,
+				  const ARRAY_TYPE(seq_range) *seqs,
+				  unsigned int field_idx, buffer_t *dest_buf,
+				  ARRAY_TYPE(mail_cache_lookup_result) *results);
 
 /* Return specified cached headers. Returns 1 if all fields were found,
    0 if not, -1 if error. dest is updated only if all fields were found. */
@@ -11,9 +11,9 @@
 	MODULE_CONTEXT(obj, mail_index_alloc_cache_index_module)
 
 /* How many seconds to keep index opened for reuse after it's been closed */
-#define INDEX_CACHE_TIMEOUT 10
+#define INDEX_CACHE_DEFAULT_TIMEOUT 10
 /* How many closed indexes to keep */
-#define INDEX_CACHE_MAX 3
+#define INDEX_CACHE_DEFAULT_MAX 3
 
 struct mail_index_alloc_cache_list {
 	union mail_index_module_context module_ctx;
@@ -35,6 +35,8 @@ static MODULE_CONTEXT_DEFINE_INIT(mail_index_alloc_cache_index_module,
 static struct mail_index_alloc_cache_list *indexes = NULL;
 static unsigned int indexes_cache_references_count = 0;
 static struct timeout *to_index = NULL;
+static unsigned int index_cache_max = INDEX_CACHE_DEFAULT_MAX;
+static unsigned int index_cache_timeout = INDEX_CACHE_DEFAULT_TIMEOUT;
 
 static struct mail_index_alloc_cache_list *
 mail_index_alloc_cache_add(struct mail_index *index,
@@ -120,7 +122,7 @@ mail_index_alloc_cache_find_and_expire(const char *mailbox_path,
 
 		if (rec->refcount == 0 && rec != match) {
 			if (rec->destroy_time <= ioloop_time ||
-			    destroy_count >= INDEX_CACHE_MAX) {
+			    destroy_count >= index_cache_max) {
 				*indexp = rec->next;
 				mail_index_alloc_cache_list_free(rec);
 				continue;
@@ -229,12 +231,40 @@ static bool destroy_unrefed(unsigned int min_destroy_count)
 	return destroyed;
 }
 
+static bool destroy_lru_unrefed(void)
+{
+	struct mail_index_alloc_cache_list **list, **lru = NULL, *rec;
+
+	/* the list is sorted by the last unref time, so the last unrefed
+	   index is the least recently used one */
+	for (list = &indexes; *list != NULL; list = &(*list)->next) {
+		if ((*list)->refcount == 0)
+			lru = list;
+	}
+	if (lru == NULL)
+		return FALSE;
+
+	rec = *lru;
+	*lru = rec->next;
+	mail_index_alloc_cache_list_free(rec);
+	return TRUE;
+}
+
 static void ATTR_NULL(1)
 index_removal_timeout(void *context ATTR_UNUSED)
 {
 	destroy_unrefed(0);
 }
 
+static void index_removal_timeout_add(void)
+{
+	/* Add to root ioloop in case we got here from an inner
+	   ioloop which gets destroyed too early. */
+	to_index = timeout_add_to(io_loop_get_root(),
+				  index_cache_timeout*1000/2,
+				  index_removal_timeout, NULL);
+}
+
 void mail_index_alloc_cache_unref(struct mail_index **_index)
 {
 	struct mail_index *index = *_index;
@@ -253,19 +283,21 @@ void mail_index_alloc_cache_unref(struct mail_index **_index)
 	i_assert(list->refcount > 0);
 
 	list->refcount--;
-	list->destroy_time = ioloop_time + INDEX_CACHE_TIMEOUT;
+	list->destroy_time = ioloop_time + index_cache_timeout;
 
+	*listp = list->next;
 	if (list->refcount == 0 && index->open_count == 0) {
 		/* index was already closed. don't even try to cache it. */
-		*listp = list->next;
 		mail_index_alloc_cache_list_free(list);
-	} else if (to_index == NULL) {
-		/* Add to root ioloop in case we got here from an inner
-		   ioloop which gets destroyed too early. */
-		to_index = timeout_add_to(io_loop_get_root(),
-					  INDEX_CACHE_TIMEOUT*1000/2,
-					  index_removal_timeout, NULL);
+		return;
 	}
+
+	/* move to the head of the list, so the indexes are expired in
+	   LRU order */
+	list->next = indexes;
+	indexes = list;
+	if (to_index == NULL)
+		index_removal_timeout_add();
 }
 
 void mail_index_alloc_cache_destroy_unrefed(void)
@@ -273,6 +305,26 @@ void mail_index_alloc_cache_destroy_unrefed(void)
 	destroy_unrefed(UINT_MAX);
 }
 
+void mail_index_alloc_cache_set_limits(unsigned int max_count,
+				       unsigned int timeout_secs)
+{
+	if (timeout_secs == 0)
+		max_count = 0;
+	if (index_cache_max == max_count && index_cache_timeout == timeout_secs)
+		return;
+
+	index_cache_max = max_count;
+	index_cache_timeout = timeout_secs;
+	if (to_index != NULL) {
+		timeout_remove(&to_index);
+		index_removal_timeout_add();
+	}
+	while (indexes_cache_references_count > index_cache_max) {
+		if (!destroy_lru_unrefed() && !destroy_unrefed(1))
+			break;
+	}
+}
+
 void mail_index_alloc_cache_index_opened(struct mail_index *index)
 {
 	struct mail_index_alloc_cache_list *list =
@@ -302,8 +354,10 @@ void mail_index_alloc_cache_index_closing(struct mail_index *index)
 		/* we're closing our referenced index */
 		return;
 	}
-	while (indexes_cache_references_count > INDEX_CACHE_MAX) {
-		if (!destroy_unrefed(1)) {
+	if (index_cache_max == 0)
+		return;
+	while (indexes_cache_references_count >= index_cache_max) {
+		if (!destroy_lru_unrefed() && !destroy_unrefed(1)) {
 			/* our cache is full already, don't keep more */
 			return;
 		}
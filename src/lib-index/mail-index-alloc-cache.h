@@ -12,6 +12,11 @@ struct mail_index *
 mail_index_alloc_cache_find(const char *index_dir);
 
 void mail_index_alloc_cache_destroy_unrefed(void);
+/* Set how many closed indexes are kept open for reuse and for how long.
+   The least recently used indexes are closed first. timeout_secs=0 or
+   max_count=0 disables keeping closed indexes open. */
+void mail_index_alloc_cache_set_limits(unsigned int max_count,
+				       unsigned int timeout_secs);
 
 /* internal: */
 void mail_index_alloc_cache_index_opened(struct mail_index *index);
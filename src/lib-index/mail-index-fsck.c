@@ -327,10 +327,9 @@ static void
 mail_index_fsck_records(struct mail_index *index, struct mail_index_map *map,
 			struct mail_index_header *hdr)
 {
-	struct mail_index_record *rec, *next_rec;
-	uint32_t i, last_uid;
+	struct mail_index_record *rec, *dest_rec;
+	uint32_t i, records_count, last_uid;
 	bool logged_unordered_uids = FALSE, logged_zero_uids = FALSE;
-	bool records_dropped = FALSE;
 
 	hdr->messages_count = 0;
 	hdr->seen_messages_count = 0;
@@ -339,9 +338,12 @@ mail_index_fsck_records(struct mail_index *index, struct mail_index_map *map,
 	hdr->first_unseen_uid_lowwater = 0;
 	hdr->first_deleted_uid_lowwater = 0;
 
-	rec = map->rec_map->records; last_uid = 0;
-	for (i = 0; i < map->rec_map->records_count; ) {
-		next_rec = PTR_OFFSET(rec, hdr->record_size);
+	/* Dropped records are compacted away while going through the records,
+	   so this stays linear even if most of the records are broken. */
+	rec = dest_rec = map->rec_map->records; last_uid = 0;
+	records_count = map->rec_map->records_count;
+	for (i = 0; i < records_count; i++,
+	     rec = PTR_OFFSET(rec, hdr->record_size)) {
 		if (rec->uid <= last_uid) {
 			/* log an error once, and skip this record */
 			if (rec->uid == 0) {
@@ -357,15 +359,11 @@ mail_index_fsck_records(struct mail_index *index, struct mail_index_map *map,
 					logged_unordered_uids = TRUE;
 				}
 			}
-			/* not the fastest way when we're skipping lots of
-			   records, but this should happen rarely so don't
-			   bother optimizing. */
-			memmove(rec, next_rec, hdr->record_size *
-				(map->rec_map->records_count - i - 1));
-			map->rec_map->records_count--;
-			records_dropped = TRUE;
+			/* skip this record */
 			continue;
 		}
+		if (dest_rec != rec)
+			memcpy(dest_rec, rec, hdr->record_size);
 
 		hdr->messages_count++;
 		if ((rec->flags & MAIL_SEEN) != 0)
@@ -381,12 +379,12 @@ mail_index_fsck_records(struct mail_index *index, struct mail_index_map *map,
 			hdr->first_deleted_uid_lowwater = rec->uid;
 
 		last_uid = rec->uid;
-		rec = next_rec;
-		i++;
+		dest_rec = PTR_OFFSET(dest_rec, hdr->record_size);
 	}
 
-	if (records_dropped) {
+	if (hdr->messages_count != records_count) {
 		/* all existing views are broken now */
+		map->rec_map->records_count = hdr->messages_count;
 		index->inconsistency_id++;
 	}
 
@@ -464,6 +464,40 @@ mail_index_map_latest_sync(struct mail_index *index,
 	return ret;
 }
 
+static bool mail_index_map_file_is_newer(struct mail_index *index)
+{
+	struct mail_index_map *map = index->map;
+	struct mail_index_header hdr;
+	const char *reason;
+	bool reopened;
+	int ret;
+
+	if ((map->hdr.flags & MAIL_INDEX_HDR_FLAG_CORRUPTED) != 0)
+		return TRUE;
+
+	/* errors are handled by mail_index_map_latest_file() */
+	if (mail_index_reopen_if_changed(index, &reopened, &reason) <= 0)
+		return TRUE;
+	if (!reopened) {
+		/* Index files are never modified after they have been
+		   rename()d into place. The file is still the same one that
+		   the current map was read from, so it can't have anything
+		   newer. */
+		return FALSE;
+	}
+
+	/* A new index file was written. Reading it is useful only if it's
+	   ahead of the current map. Otherwise the same changes would have
+	   to be synced from the transaction log anyway. */
+	ret = pread_full(index->fd, &hdr, sizeof(hdr), 0);
+	if (ret <= 0 || hdr.major_version != MAIL_INDEX_MAJOR_VERSION ||
+	    hdr.indexid != map->hdr.indexid)
+		return TRUE;
+	if (hdr.log_file_seq != map->hdr.log_file_seq)
+		return hdr.log_file_seq > map->hdr.log_file_seq;
+	return hdr.log_file_head_offset > map->hdr.log_file_head_offset;
+}
+
 static int
 mail_index_map_real(struct mail_index *index,
 		    enum mail_index_sync_handler_type type)
@@ -482,7 +516,8 @@ mail_index_map_real(struct mail_index *index,
 	if (!index->initial_mapped || index->reopen_main_index) {
 		/* index is being created/opened for the first time */
 		ret = 0;
-	} else if (mail_index_sync_map_want_index_reopen(index->map, type)) {
+	} else if (mail_index_sync_map_want_index_reopen(index->map, type) &&
+		   mail_index_map_file_is_newer(index)) {
 		/* it's likely more efficient to reopen the index file than
 		   sync from the transaction log. */
 		ret = 0;
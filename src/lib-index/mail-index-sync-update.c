@@ -928,6 +928,14 @@ bool mail_index_sync_map_want_index_reopen(struct mail_index_map *map,
 		if (log_size > start_offset &&
 		    log_size - start_offset > index_size)
 			return TRUE;
+		if (index->readonly && log_size > start_offset) {
+			/* We can't write the changes back to the index, so
+			   syncing from the log would make us keep a private
+			   copy of all the records. Prefer mapping the shared
+			   index file if some other process has rewritten it
+			   since we read it. */
+			return TRUE;
+		}
 	}
 	return FALSE;
 }
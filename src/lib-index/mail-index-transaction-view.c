@@ -259,6 +259,54 @@ static void tview_lookup_first(struct mail_index_view *view,
 	}
 }
 
+static void
+tview_lookup_seqs_by_flags(struct mail_index_view *view,
+			   uint32_t seq1, uint32_t seq2,
+			   const struct mail_index_flags_filter *filter,
+			   ARRAY_TYPE(seq_range) *seqs)
+{
+	struct mail_index_view_transaction *tview =
+		(struct mail_index_view_transaction *)view;
+	struct mail_index_transaction *t = tview->t;
+	uint32_t old_seq2, update_seq1, update_seq2;
+
+	if (t->reset) {
+		mail_index_view_lookup_seqs_by_flags_slow(view, seq1, seq2,
+							  filter, seqs);
+		return;
+	}
+
+	old_seq2 = I_MIN(seq2, t->first_new_seq - 1);
+	if (seq1 > old_seq2) {
+		/* only appended messages */
+	} else if (t->min_flagupdate_seq == 0 ||
+		   t->min_flagupdate_seq > old_seq2 ||
+		   t->max_flagupdate_seq < seq1) {
+		tview->super->lookup_seqs_by_flags(view, seq1, old_seq2,
+						   filter, seqs);
+	} else {
+		/* the messages with flag or keyword updates in this
+		   transaction are looked up one by one */
+		update_seq1 = I_MAX(seq1, t->min_flagupdate_seq);
+		update_seq2 = I_MIN(old_seq2, t->max_flagupdate_seq);
+		if (seq1 < update_seq1) {
+			tview->super->lookup_seqs_by_flags(view, seq1,
+				update_seq1 - 1, filter, seqs);
+		}
+		mail_index_view_lookup_seqs_by_flags_slow(view, update_seq1,
+			update_seq2, filter, seqs);
+		if (update_seq2 < old_seq2) {
+			tview->super->lookup_seqs_by_flags(view,
+				update_seq2 + 1, old_seq2, filter, seqs);
+		}
+	}
+
+	if (seq2 >= t->first_new_seq) {
+		mail_index_view_lookup_seqs_by_flags_slow(view,
+			I_MAX(seq1, t->first_new_seq), seq2, filter, seqs);
+	}
+}
+
 static void keyword_index_add(ARRAY_TYPE(keyword_indexes) *keywords,
 			      unsigned int idx)
 {
@@ -504,6 +552,7 @@ static struct mail_index_view_vfuncs trans_view_vfuncs = {
 	tview_lookup_uid,
 	tview_lookup_seq_range,
 	tview_lookup_first,
+	tview_lookup_seqs_by_flags,
 	tview_lookup_keywords,
 	tview_lookup_ext_full,
 	tview_get_header_ext,
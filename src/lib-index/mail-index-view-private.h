@@ -26,6 +26,10 @@ struct mail_index_view_vfuncs {
 	void (*lookup_first)(struct mail_index_view *view,
 			     enum mail_flags flags, uint8_t flags_mask,
 			     uint32_t *seq_r);
+	void (*lookup_seqs_by_flags)(struct mail_index_view *view,
+				     uint32_t seq1, uint32_t seq2,
+				     const struct mail_index_flags_filter *filter,
+				     ARRAY_TYPE(seq_range) *seqs);
 	void (*lookup_keywords)(struct mail_index_view *view, uint32_t seq,
 				ARRAY_TYPE(keyword_indexes) *keyword_idx);
 	void (*lookup_ext_full)(struct mail_index_view *view, uint32_t seq,
@@ -114,6 +118,11 @@ void mail_index_view_add_hidden_transaction(struct mail_index_view *view,
 					    uint32_t log_file_seq,
 					    uoff_t log_file_offset,
 					    unsigned int length);
+/* Look up the matching messages one by one using the view's vfuncs. */
+void mail_index_view_lookup_seqs_by_flags_slow(struct mail_index_view *view,
+				uint32_t seq1, uint32_t seq2,
+				const struct mail_index_flags_filter *filter,
+				ARRAY_TYPE(seq_range) *seqs);
 
 struct mail_index_view *mail_index_dummy_view_open(struct mail_index *index);
 
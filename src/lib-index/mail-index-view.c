@@ -4,7 +4,9 @@
 #include "array.h"
 #include "buffer.h"
 #include "llist.h"
+#include "seq-range-array.h"
 #include "mail-index-view-private.h"
+#include "mail-index-modseq.h"
 #include "mail-transaction-log.h"
 
 #undef mail_index_view_clone
@@ -283,6 +285,227 @@ static void view_lookup_first(struct mail_index_view *view,
 	}
 }
 
+static bool
+mail_index_flags_filter_has_keywords(const ARRAY_TYPE(keyword_indexes) *keywords)
+{
+	return array_is_created(keywords) && array_count(keywords) > 0;
+}
+
+static bool
+mail_index_keywords_have(const ARRAY_TYPE(keyword_indexes) *keywords,
+			 unsigned int keyword_idx)
+{
+	unsigned int idx;
+
+	array_foreach_elem(keywords, idx) {
+		if (idx == keyword_idx)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static bool
+mail_index_flags_filter_keywords_match(const struct mail_index_flags_filter *filter,
+				       const ARRAY_TYPE(keyword_indexes) *keywords)
+{
+	unsigned int idx;
+
+	if (array_is_created(&filter->keywords_set)) {
+		array_foreach_elem(&filter->keywords_set, idx) {
+			if (!mail_index_keywords_have(keywords, idx))
+				return FALSE;
+		}
+	}
+	if (array_is_created(&filter->keywords_unset)) {
+		array_foreach_elem(&filter->keywords_unset, idx) {
+			if (mail_index_keywords_have(keywords, idx))
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+void mail_index_view_lookup_seqs_by_flags_slow(struct mail_index_view *view,
+				uint32_t seq1, uint32_t seq2,
+				const struct mail_index_flags_filter *filter,
+				ARRAY_TYPE(seq_range) *seqs)
+{
+	ARRAY_TYPE(keyword_indexes) keywords;
+	const struct mail_index_record *rec;
+	bool check_keywords;
+	uint32_t seq;
+
+	check_keywords =
+		mail_index_flags_filter_has_keywords(&filter->keywords_set) ||
+		mail_index_flags_filter_has_keywords(&filter->keywords_unset);
+
+	T_BEGIN {
+		t_array_init(&keywords, 32);
+		for (seq = seq1; seq <= seq2; seq++) {
+			rec = mail_index_lookup(view, seq);
+			if ((rec->flags & filter->flags_mask) !=
+			    (uint8_t)filter->flags)
+				continue;
+			if (check_keywords) {
+				mail_index_lookup_keywords(view, seq, &keywords);
+				if (!mail_index_flags_filter_keywords_match(filter,
+								&keywords))
+					continue;
+			}
+			if (filter->min_modseq != 0 &&
+			    mail_index_modseq_lookup(view, seq) <
+			    filter->min_modseq)
+				continue;
+			seq_range_array_add(seqs, seq);
+		}
+	} T_END;
+}
+
+/* Set the bits of the keywords to the mask, which has the same layout as the
+   keywords in the records. Returns FALSE if some of the keywords don't exist
+   in the map. */
+static bool
+view_keywords_get_mask(struct mail_index_map *map,
+		       const ARRAY_TYPE(keyword_indexes) *keywords,
+		       unsigned char *mask, unsigned int mask_size)
+{
+	const unsigned int *keyword_idx_map;
+	unsigned int idx, i, count;
+	bool all_found = TRUE;
+
+	if (!array_is_created(&map->keyword_idx_map))
+		return FALSE;
+
+	/* keyword_idx_map[] contains file => index keyword mapping */
+	keyword_idx_map = array_get(&map->keyword_idx_map, &count);
+	array_foreach_elem(keywords, idx) {
+		for (i = 0; i < count; i++) {
+			if (keyword_idx_map[i] == idx)
+				break;
+		}
+		if (i == count || i / CHAR_BIT >= mask_size)
+			all_found = FALSE;
+		else
+			mask[i / CHAR_BIT] |= 1 << (i % CHAR_BIT);
+	}
+	return all_found;
+}
+
+static void
+view_lookup_seqs_by_flags_map(struct mail_index_view *view,
+			      uint32_t seq1, uint32_t seq2,
+			      const struct mail_index_flags_filter *filter,
+			      ARRAY_TYPE(seq_range) *seqs)
+{
+	struct mail_index_map *map = view->map;
+	const struct mail_index_ext *ext;
+	const struct mail_index_record *rec;
+	const unsigned char *data;
+	unsigned char *set_mask = NULL, *unset_mask = NULL;
+	unsigned int i, kw_offset = 0, kw_size = 0, modseq_offset = 0;
+	uint64_t modseq, highest_modseq = 0;
+	uint32_t seq, idx, range_seq1 = 0;
+	bool match;
+
+	if (filter->min_modseq != 0) {
+		if (!mail_index_map_get_ext_idx(map, view->index->modseq_ext_id,
+						&idx))
+			i_unreached();
+		ext = array_idx(&map->extensions, idx);
+		modseq_offset = ext->record_offset;
+		highest_modseq = mail_index_map_modseq_get_highest(map);
+	}
+
+	if (mail_index_map_get_ext_idx(map, view->index->keywords_ext_id,
+				       &idx)) {
+		ext = array_idx(&map->extensions, idx);
+		if (ext->record_offset != 0) {
+			kw_offset = ext->record_offset;
+			kw_size = ext->record_size;
+		}
+	}
+	if (mail_index_flags_filter_has_keywords(&filter->keywords_set)) {
+		if (kw_size == 0)
+			return;
+		set_mask = t_malloc0(kw_size);
+		if (!view_keywords_get_mask(map, &filter->keywords_set,
+					    set_mask, kw_size)) {
+			/* keyword isn't set for any mail */
+			return;
+		}
+	}
+	if (mail_index_flags_filter_has_keywords(&filter->keywords_unset) &&
+	    kw_size > 0) {
+		/* keywords that don't exist are never set, so they can be
+		   ignored */
+		unset_mask = t_malloc0(kw_size);
+		(void)view_keywords_get_mask(map, &filter->keywords_unset,
+					     unset_mask, kw_size);
+	}
+
+	i_assert(seq2 <= map->hdr.messages_count);
+	for (seq = seq1; seq <= seq2; seq++) {
+		rec = MAIL_INDEX_REC_AT_SEQ(map, seq);
+		match = (rec->flags & filter->flags_mask) ==
+			(uint8_t)filter->flags;
+		if (match && (set_mask != NULL || unset_mask != NULL)) {
+			data = CONST_PTR_OFFSET(rec, kw_offset);
+			for (i = 0; i < kw_size; i++) {
+				if ((set_mask != NULL &&
+				     (data[i] & set_mask[i]) != set_mask[i]) ||
+				    (unset_mask != NULL &&
+				     (data[i] & unset_mask[i]) != 0)) {
+					match = FALSE;
+					break;
+				}
+			}
+		}
+		if (match && modseq_offset != 0) {
+			/* zero means the modseq hasn't been set yet, see
+			   mail_index_modseq_lookup() */
+			modseq = *(const uint64_t *)
+				CONST_PTR_OFFSET(rec, modseq_offset);
+			if (modseq == 0)
+				modseq = highest_modseq;
+			match = modseq >= filter->min_modseq;
+		}
+		/* add the matches as ranges, they're often consecutive */
+		if (match) {
+			if (range_seq1 == 0)
+				range_seq1 = seq;
+		} else if (range_seq1 != 0) {
+			seq_range_array_add_range(seqs, range_seq1, seq - 1);
+			range_seq1 = 0;
+		}
+	}
+	if (range_seq1 != 0)
+		seq_range_array_add_range(seqs, range_seq1, seq2);
+}
+
+static void
+view_lookup_seqs_by_flags(struct mail_index_view *view,
+			  uint32_t seq1, uint32_t seq2,
+			  const struct mail_index_flags_filter *filter,
+			  ARRAY_TYPE(seq_range) *seqs)
+{
+	uint32_t ext_map_idx;
+
+	if (view->map != view->index->map ||
+	    (filter->min_modseq != 0 &&
+	     !mail_index_map_get_ext_idx(view->map, view->index->modseq_ext_id,
+					 &ext_map_idx))) {
+		/* the latest flags need to be looked up from the head
+		   mapping. mail_index_modseq_lookup() also handles modseqs
+		   that aren't being tracked yet. */
+		mail_index_view_lookup_seqs_by_flags_slow(view, seq1, seq2,
+							  filter, seqs);
+		return;
+	}
+	T_BEGIN {
+		view_lookup_seqs_by_flags_map(view, seq1, seq2, filter, seqs);
+	} T_END;
+}
+
 static void
 mail_index_data_lookup_keywords(struct mail_index_map *map,
 				const unsigned char *data,
@@ -524,6 +747,17 @@ void mail_index_lookup_first(struct mail_index_view *view,
 	view->v.lookup_first(view, flags, flags_mask, seq_r);
 }
 
+void mail_index_lookup_seqs_by_flags(struct mail_index_view *view,
+				     uint32_t seq1, uint32_t seq2,
+				     const struct mail_index_flags_filter *filter,
+				     ARRAY_TYPE(seq_range) *seqs)
+{
+	i_assert(seq1 > 0);
+
+	if (seq1 <= seq2)
+		view->v.lookup_seqs_by_flags(view, seq1, seq2, filter, seqs);
+}
+
 void mail_index_lookup_ext(struct mail_index_view *view, uint32_t seq,
 			   uint32_t ext_id, const void **data_r,
 			   bool *expunged_r)
@@ -591,6 +825,7 @@ static struct mail_index_view_vfuncs view_vfuncs = {
 	view_lookup_uid,
 	view_lookup_seq_range,
 	view_lookup_first,
+	view_lookup_seqs_by_flags,
 	view_lookup_keywords,
 	view_lookup_ext_full,
 	view_get_header_ext,
@@ -1,6 +1,8 @@
 /* Copyright (c) 2003-2018 Dovecot authors, see the included COPYING file */
 
+#define _GNU_SOURCE /* for copy_file_range() */
 #include "lib.h"
+#include "buffer.h"
 #include "nfs-workarounds.h"
 #include "read-full.h"
 #include "write-full.h"
@@ -9,6 +11,11 @@
 #include "mail-transaction-log-private.h"
 
 #include <stdio.h>
+#include <sys/stat.h>
+
+/* Compare the old and new records in blocks of this size, and write only the
+   blocks that differ. */
+#define MAIL_INDEX_INCREMENTAL_BLOCK_SIZE 4096
 
 static int mail_index_create_backup(struct mail_index *index)
 {
@@ -54,13 +61,175 @@ static int mail_index_create_backup(struct mail_index *index)
 	return 0;
 }
 
+static int mail_index_copy_file(int old_fd, int fd, uoff_t size)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+	loff_t in_offset = 0, out_offset = 0;
+	ssize_t ret;
+
+	/* Filesystems that support reflinks can share the data blocks
+	   instead of copying them. */
+	while (size > 0) {
+		ret = copy_file_range(old_fd, &in_offset, fd, &out_offset,
+				      size, 0);
+		if (ret < 0)
+			return -1;
+		if (ret == 0) {
+			/* file was unexpectedly truncated */
+			errno = EINVAL;
+			return -1;
+		}
+		size -= ret;
+	}
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static int
+mail_index_write_incremental_records(struct mail_index *index, int fd,
+				     const char *path,
+				     uoff_t header_size, uoff_t old_size)
+{
+	struct mail_index_map *map = index->map;
+	const unsigned char *records = map->rec_map->records;
+	unsigned char *old_block;
+	uoff_t offset, records_size, changed_size = 0;
+	size_t size;
+	ssize_t ret;
+
+	/* patch the blocks that differ from the old file */
+	old_block = t_malloc_no0(MAIL_INDEX_INCREMENTAL_BLOCK_SIZE);
+	for (offset = 0; offset < old_size; offset += size) {
+		size = I_MIN(old_size - offset,
+			     MAIL_INDEX_INCREMENTAL_BLOCK_SIZE);
+		ret = pread_full(index->fd, old_block, size,
+				 header_size + offset);
+		if (ret <= 0) {
+			if (ret == 0)
+				errno = EINVAL;
+			mail_index_set_syscall_error(index, "pread_full()");
+			return -1;
+		}
+		if (memcmp(old_block, records + offset, size) == 0)
+			continue;
+		if (pwrite_full(fd, records + offset, size,
+				header_size + offset) < 0) {
+			mail_index_file_set_syscall_error(index, path,
+							  "pwrite_full()");
+			return -1;
+		}
+		changed_size += size;
+	}
+
+	/* write the appended records */
+	records_size = (uoff_t)map->rec_map->records_count *
+		map->hdr.record_size;
+	if (records_size > old_size) {
+		if (pwrite_full(fd, records + old_size, records_size - old_size,
+				header_size + old_size) < 0) {
+			mail_index_file_set_syscall_error(index, path,
+							  "pwrite_full()");
+			return -1;
+		}
+	}
+	e_debug(index->event, "Incrementally rewriting %s: "
+		"%"PRIuUOFF_T" of %"PRIuUOFF_T" existing record bytes changed, "
+		"%"PRIuUOFF_T" bytes appended", index->filepath,
+		changed_size, old_size, records_size - old_size);
+	return 0;
+}
+
+/* Write the records by copying the old index file and then patching the
+   changed parts. Returns 1 if the records were written, 0 if they need to be
+   fully written instead, -1 on error. */
+static int
+mail_index_write_incremental(struct mail_index *index, int fd,
+			     const char *path)
+{
+	struct mail_index_map *map = index->map;
+	struct mail_index_header old_hdr;
+	struct mail_index_record old_rec;
+	struct stat st;
+	uoff_t old_size, records_size;
+	int ret;
+
+	if (index->optimization_set.index.rewrite_incremental_min_size == 0 ||
+	    index->fd == -1)
+		return 0;
+	records_size = (uoff_t)map->rec_map->records_count *
+		map->hdr.record_size;
+	if (map->hdr.header_size + records_size <
+	    index->optimization_set.index.rewrite_incremental_min_size)
+		return 0;
+
+	if (fstat(index->fd, &st) < 0) {
+		if (!ESTALE_FSTAT(errno))
+			mail_index_set_syscall_error(index, "fstat()");
+		return 0;
+	}
+	ret = pread_full(index->fd, &old_hdr, sizeof(old_hdr), 0);
+	if (ret <= 0) {
+		if (ret < 0)
+			mail_index_set_syscall_error(index, "pread_full()");
+		return 0;
+	}
+	/* the records must be at the same offsets as in the old file */
+	if (old_hdr.indexid != map->hdr.indexid ||
+	    old_hdr.header_size != map->hdr.header_size ||
+	    old_hdr.record_size != map->hdr.record_size ||
+	    old_hdr.messages_count > map->rec_map->records_count ||
+	    (uoff_t)st.st_size != old_hdr.header_size +
+	    (uoff_t)old_hdr.messages_count * old_hdr.record_size)
+		return 0;
+	old_size = (uoff_t)old_hdr.messages_count * old_hdr.record_size;
+
+	if (old_hdr.messages_count > 0) {
+		/* UIDs only grow, so if the last old record still has the
+		   same UID nothing was expunged. Expunges move all the
+		   following records, so there's nothing to gain. */
+		ret = pread_full(index->fd, &old_rec, sizeof(old_rec),
+				 old_hdr.header_size + old_size -
+				 old_hdr.record_size);
+		if (ret <= 0) {
+			if (ret < 0)
+				mail_index_set_syscall_error(index, "pread_full()");
+			return 0;
+		}
+		if (old_rec.uid != MAIL_INDEX_REC_AT_SEQ(map,
+				old_hdr.messages_count)->uid)
+			return 0;
+	}
+
+	if (mail_index_copy_file(index->fd, fd,
+				 old_hdr.header_size + old_size) < 0) {
+		if (errno != ENOSYS && errno != EXDEV &&
+		    errno != EOPNOTSUPP && errno != EINVAL)
+			mail_index_file_set_syscall_error(index, path,
+							  "copy_file_range()");
+		return ftruncate(fd, 0) < 0 ? -1 : 0;
+	}
+
+	T_BEGIN {
+		ret = mail_index_write_incremental_records(index, fd, path,
+							   old_hdr.header_size,
+							   old_size);
+	} T_END;
+	if (ret < 0)
+		return ftruncate(fd, 0) < 0 ? -1 : 0;
+	return 1;
+}
+
 static int mail_index_recreate(struct mail_index *index)
 {
 	struct mail_index_map *map = index->map;
 	struct ostream *output;
 	unsigned int base_size;
 	const char *path;
-	int ret = 0, fd;
+	bool incremental;
+	int ret, fd;
 
 	i_assert(!MAIL_INDEX_IS_IN_MEMORY(index));
 	i_assert(map->hdr.indexid == index->indexid);
@@ -71,6 +240,16 @@ static int mail_index_recreate(struct mail_index *index)
 	if (fd == -1)
 		return -1;
 
+	ret = mail_index_write_incremental(index, fd, path);
+	if (ret < 0) {
+		mail_index_file_set_syscall_error(index, path, "ftruncate()");
+		i_close_fd(&fd);
+		i_unlink(path);
+		return -1;
+	}
+	incremental = ret > 0;
+	ret = 0;
+
 	output = o_stream_create_fd_file(fd, 0, FALSE);
 	o_stream_cork(output);
 
@@ -84,8 +263,10 @@ static int mail_index_recreate(struct mail_index *index)
 	o_stream_nsend(output, &hdr, base_size);
 	o_stream_nsend(output, MAIL_INDEX_MAP_HDR_OFFSET(map, base_size),
 		       hdr.header_size - base_size);
-	o_stream_nsend(output, map->rec_map->records,
-		       map->rec_map->records_count * hdr.record_size);
+	if (!incremental) {
+		o_stream_nsend(output, map->rec_map->records,
+			       map->rec_map->records_count * hdr.record_size);
+	}
 	if (o_stream_finish(output) < 0) {
 		mail_index_file_set_syscall_error(index, path, "write()");
 		ret = -1;
@@ -196,6 +196,8 @@ void mail_index_set_optimization_settings(struct mail_index *index,
 		dest->index.rewrite_min_log_bytes = set->index.rewrite_min_log_bytes;
 	if (set->index.rewrite_max_log_bytes != 0)
 		dest->index.rewrite_max_log_bytes = set->index.rewrite_max_log_bytes;
+	dest->index.rewrite_incremental_min_size =
+		set->index.rewrite_incremental_min_size;
 
 	/* log */
 	if (set->log.min_size != 0)
@@ -229,6 +231,10 @@ void mail_index_set_optimization_settings(struct mail_index *index,
 
 	dest->cache.max_header_name_length = set->cache.max_header_name_length;
 	dest->cache.max_headers_count = set->cache.max_headers_count;
+	dest->cache.columns_min_messages = set->cache.columns_min_messages;
+	dest->cache.dict_min_messages = set->cache.dict_min_messages;
+	dest->cache.fields_max_size = set->cache.fields_max_size;
+	dest->cache.field_bloom = set->cache.field_bloom;
 }
 
 void mail_index_set_ext_init_data(struct mail_index *index, uint32_t ext_id,
@@ -185,6 +185,19 @@ struct mail_keywords {
 	unsigned int idx[FLEXIBLE_ARRAY_MEMBER];
 };
 
+/* Matches messages with (flags & flags_mask) == flags, which have all of the
+   keywords_set and none of the keywords_unset. The keyword arrays may be
+   left uncreated. If min_modseq is non-zero, the message's modseq must also
+   be at least min_modseq. */
+struct mail_index_flags_filter {
+	enum mail_flags flags;
+	uint8_t flags_mask;
+
+	ARRAY_TYPE(keyword_indexes) keywords_set;
+	ARRAY_TYPE(keyword_indexes) keywords_unset;
+	uint64_t min_modseq;
+};
+
 enum mail_index_transaction_flags {
 	/* If transaction is marked as hidden, the changes are marked with
 	   hidden=TRUE when the view is synchronized. */
@@ -311,6 +324,10 @@ struct mail_index_base_optimization_settings {
 	   from the .log on refresh is between these min/max values. */
 	uoff_t rewrite_min_log_bytes;
 	uoff_t rewrite_max_log_bytes;
+	/* When rewriting an index file at least this large, copy the old
+	   file and write only the parts that changed. Expunges still cause
+	   the whole file to be written. 0 disables. */
+	uoff_t rewrite_incremental_min_size;
 };
 
 struct mail_index_log_optimization_settings {
@@ -349,6 +366,22 @@ struct mail_index_cache_optimization_settings {
 	/* Purge the file when we need to follow more than n next_offsets to
 	   find the latest cache header. */
 	unsigned int purge_header_continue_count;
+	/* Write the fixed size fields also into a columnar section when
+	   purging a cache file with at least this many messages. 0 disables
+	   writing the columns. */
+	unsigned int columns_min_messages;
+	/* Train a compression dictionary for the variable size fields when
+	   purging a cache file with at least this many messages. 0 disables
+	   the compression. Requires zstd support. */
+	unsigned int dict_min_messages;
+	/* When purging, drop the least recently used fields until the rest of
+	   the cached fields take at most this many bytes. FORCED fields are
+	   never dropped. 0 disables the limit. */
+	uoff_t fields_max_size;
+	/* Keep a bloom filter of the cached fields for each message as an
+	   index extension, so lookups for fields that aren't cached don't need
+	   to read the cache records. */
+	bool field_bloom;
 };
 
 struct mail_index_optimization_settings {
@@ -623,6 +656,12 @@ bool mail_index_lookup_seq(struct mail_index_view *view,
 void mail_index_lookup_first(struct mail_index_view *view,
 			     enum mail_flags flags, uint8_t flags_mask,
 			     uint32_t *seq_r);
+/* Add all messages between seq1..seq2 matching the filter to seqs. This scans
+   the records directly, so it's much faster than looking up each message. */
+void mail_index_lookup_seqs_by_flags(struct mail_index_view *view,
+				     uint32_t seq1, uint32_t seq2,
+				     const struct mail_index_flags_filter *filter,
+				     ARRAY_TYPE(seq_range) *seqs);
 
 /* Append a new record to index. */
 void mail_index_append(struct mail_index_transaction *t, uint32_t uid,
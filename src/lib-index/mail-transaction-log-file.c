@@ -1645,6 +1645,29 @@ int mail_transaction_log_file_map(struct mail_transaction_log_file *file,
 					  reason_r) ? 1 : 0;
 }
 
+void mail_transaction_log_file_willneed(struct mail_transaction_log_file *file,
+					uoff_t start_offset, uoff_t end_offset)
+{
+	size_t page_size = mmap_get_page_size();
+	uoff_t page_offset;
+
+	if (file->mmap_base == NULL)
+		return;
+	i_assert(file->buffer_offset == 0);
+
+	end_offset = I_MIN(end_offset, file->mmap_size);
+	if (start_offset >= end_offset ||
+	    end_offset - start_offset <= page_size) {
+		/* reading it is as fast as the madvise() */
+		return;
+	}
+	page_offset = start_offset - start_offset % page_size;
+	errno = posix_madvise(PTR_OFFSET(file->mmap_base, page_offset),
+			      end_offset - page_offset, POSIX_MADV_WILLNEED);
+	if (errno != 0)
+		log_file_set_syscall_error(file, "posix_madvise()");
+}
+
 int mail_transaction_log_file_move_to_memory(struct mail_transaction_log_file *file)
 {
 	const char *error;
@@ -171,6 +171,10 @@ int mail_transaction_log_find_file(struct mail_transaction_log *log,
 int mail_transaction_log_file_map(struct mail_transaction_log_file *file,
 				  uoff_t start_offset, uoff_t end_offset,
 				  const char **reason_r);
+/* Tell the kernel that the given range of mmap()ed log file is going to be
+   read soon. Does nothing if the file isn't mmap()ed. */
+void mail_transaction_log_file_willneed(struct mail_transaction_log_file *file,
+					uoff_t start_offset, uoff_t end_offset);
 int mail_transaction_log_file_move_to_memory(struct mail_transaction_log_file *file);
 
 void mail_transaction_logs_clean(struct mail_transaction_log *log);
@@ -322,6 +322,11 @@ int mail_transaction_log_view_set(struct mail_transaction_log_view *view,
 				file->hdr.file_seq, start_offset, end_offset, ret, *reason_r);
 			return ret;
 		}
+		/* view_next() returns pointers directly to the mmap()ed
+		   file. Start reading the pages in already, so syncing a
+		   view that is far behind doesn't wait on each page fault. */
+		mail_transaction_log_file_willneed(file, start_offset,
+						   end_offset);
 
 		if (file->hdr.prev_file_seq == 0) {
 			/* this file resets the index.
@@ -1,6 +1,7 @@
 /* Copyright (c) 2020 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "ioloop.h"
 #include "str.h"
 #include "array.h"
 #include "test-common.h"
@@ -920,6 +921,196 @@ static void test_mail_cache_purge_bitmask(void)
 	test_end();
 }
 
+static void test_mail_cache_purge_columns(void)
+{
+	struct mail_index_optimization_settings optimization_set = {
+		.cache = {
+			.columns_min_messages = 2,
+		},
+	};
+	struct mail_cache_field fixed_field = {
+		.name = "fixed",
+		.type = MAIL_CACHE_FIELD_FIXED_SIZE,
+		.field_size = 4,
+		.decision = MAIL_CACHE_DECISION_YES,
+	};
+	struct test_mail_cache_ctx ctx;
+	struct mail_cache_view *cache_view;
+	char value[5];
+	uint32_t seq;
+
+	test_begin("mail cache purge columns");
+	test_mail_cache_init(test_mail_index_init(), &ctx);
+	mail_index_set_optimization_settings(ctx.index, &optimization_set);
+	mail_cache_register_fields(ctx.cache, &fixed_field, 1,
+				   unsafe_data_stack_pool);
+	for (seq = 1; seq <= 10; seq++) {
+		i_snprintf(value, sizeof(value), "v%03u", seq);
+		test_mail_cache_add_mail(&ctx, seq == 5 ? ctx.cache_field.idx :
+					 fixed_field.idx,
+					 seq == 5 ? "foo5" : value);
+	}
+	test_assert(mail_cache_purge(ctx.cache, (uint32_t)-1, "test") == 0);
+	test_mail_cache_view_sync(&ctx);
+
+	/* add fields after purge - these are found only from records */
+	test_mail_cache_add_mail(&ctx, fixed_field.idx, "v011");
+	test_mail_cache_add_field(&ctx, 5, fixed_field.idx, "v005");
+
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	for (seq = 1; seq <= 11; seq++) {
+		i_snprintf(value, sizeof(value), "v%03u", seq);
+		test_assert_idx(cache_equals(cache_view, seq,
+					     fixed_field.idx, value), seq);
+	}
+	test_assert(cache_equals(cache_view, 5, ctx.cache_field.idx, "foo5"));
+	/* columns were found and used */
+	test_assert(ctx.cache->columns_offset != 0);
+	test_assert(ctx.cache->columns_uid_count == 10);
+	test_assert(array_count(&ctx.cache->columns) == 1);
+	mail_cache_view_close(&cache_view);
+
+	/* expunging keeps the remaining columns usable */
+	struct mail_index_transaction *trans =
+		mail_index_transaction_begin(ctx.view, 0);
+	mail_index_expunge(trans, 2);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	test_mail_cache_index_sync(&ctx);
+	test_mail_cache_view_sync(&ctx);
+
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	test_assert(cache_equals(cache_view, 1, fixed_field.idx, "v001"));
+	test_assert(cache_equals(cache_view, 2, fixed_field.idx, "v003"));
+	test_assert(cache_equals(cache_view, 10, fixed_field.idx, "v011"));
+	mail_cache_view_close(&cache_view);
+
+	test_mail_cache_deinit(&ctx);
+	test_mail_index_delete();
+	test_end();
+}
+
+static const char *test_mail_cache_dict_value(uint32_t seq)
+{
+	return t_strdup_printf("from mail%u.example.com (mail%u.example.com "
+			       "[192.0.2.%u]) by mx.example.org with ESMTPS "
+			       "id %08x for <user%u@example.org>",
+			       seq % 7, seq % 7, seq % 250, seq * 2654435761U,
+			       seq % 13);
+}
+
+static void test_mail_cache_purge_dict(void)
+{
+	struct mail_index_optimization_settings optimization_set = {
+		.cache = {
+			.dict_min_messages = 2,
+		},
+	};
+	struct test_mail_cache_ctx ctx;
+	struct mail_cache_view *cache_view;
+	unsigned int i;
+	uint32_t seq;
+
+	test_begin("mail cache purge dict");
+	test_mail_cache_init(test_mail_index_init(), &ctx);
+	mail_index_set_optimization_settings(ctx.index, &optimization_set);
+	for (seq = 1; seq <= 500; seq++) {
+		test_mail_cache_add_mail(&ctx, ctx.cache_field.idx,
+					 test_mail_cache_dict_value(seq));
+	}
+	/* short values aren't compressed */
+	test_mail_cache_add_field(&ctx, 1, ctx.cache_field2.idx, "short");
+
+	/* the 2nd purge recompresses the already compressed values */
+	for (i = 0; i < 2; i++) {
+		test_assert(mail_cache_purge(ctx.cache, (uint32_t)-1, "test") == 0);
+		test_mail_cache_view_sync(&ctx);
+#ifdef HAVE_ZSTD
+		test_assert_idx((ctx.cache->hdr->flags &
+				 MAIL_CACHE_HDR_FLAG_DICT) != 0, i);
+#else
+		test_assert_idx((ctx.cache->hdr->flags &
+				 MAIL_CACHE_HDR_FLAG_DICT) == 0, i);
+#endif
+	}
+
+	/* fields added after purge are never compressed */
+	test_mail_cache_add_mail(&ctx, ctx.cache_field.idx,
+				 test_mail_cache_dict_value(501));
+
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	for (seq = 1; seq <= 501; seq++) {
+		test_assert_idx(cache_equals(cache_view, seq,
+			ctx.cache_field.idx,
+			test_mail_cache_dict_value(seq)), seq);
+	}
+	test_assert(cache_equals(cache_view, 1, ctx.cache_field2.idx, "short"));
+	mail_cache_view_close(&cache_view);
+
+	test_mail_cache_deinit(&ctx);
+	test_mail_index_delete();
+	test_end();
+}
+
+static void test_mail_cache_purge_fields_max_size(void)
+{
+	struct mail_index_optimization_settings optimization_set = {
+		.cache = {
+			/* fits "bar" and "baz" fields for 10 mails, but not
+			   "foo" */
+			.fields_max_size = 250,
+		},
+	};
+	struct test_mail_cache_ctx ctx;
+	struct mail_cache_view *cache_view;
+	string_t *str = t_str_new(16);
+	uint32_t seq;
+
+	test_begin("mail cache purge fields max size");
+	test_mail_cache_init(test_mail_index_init(), &ctx);
+	for (seq = 1; seq <= 10; seq++) {
+		test_mail_cache_add_mail(&ctx, ctx.cache_field.idx,
+					 "1234567890");
+		test_mail_cache_add_field(&ctx, seq, ctx.cache_field2.idx, "ab");
+		test_mail_cache_add_field(&ctx, seq, ctx.cache_field3.idx, "cd");
+	}
+	/* merge the records */
+	test_assert(mail_cache_purge(ctx.cache, (uint32_t)-1, "test") == 0);
+	test_mail_cache_view_sync(&ctx);
+
+	/* "foo" is the least recently used field */
+	ctx.cache->fields[ctx.cache_field2.idx].field.last_used =
+		ioloop_time + 100;
+	ctx.cache->fields[ctx.cache_field3.idx].field.last_used =
+		ioloop_time + 100;
+	mail_index_set_optimization_settings(ctx.index, &optimization_set);
+	test_assert(mail_cache_purge(ctx.cache, (uint32_t)-1, "test") == 0);
+	test_mail_cache_view_sync(&ctx);
+	test_assert(ctx.cache->fields[ctx.cache_field.idx].field.decision ==
+		    MAIL_CACHE_DECISION_NO);
+
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	for (seq = 1; seq <= 10; seq++) {
+		test_assert_idx(mail_cache_lookup_field(cache_view, str, seq,
+				ctx.cache_field.idx) == 0, seq);
+		test_assert_idx(cache_equals(cache_view, seq,
+			ctx.cache_field2.idx, "ab"), seq);
+		test_assert_idx(cache_equals(cache_view, seq,
+			ctx.cache_field3.idx, "cd"), seq);
+	}
+	mail_cache_view_close(&cache_view);
+
+	/* the remaining fields fit */
+	test_assert(mail_cache_purge(ctx.cache, (uint32_t)-1, "test") == 0);
+	test_mail_cache_view_sync(&ctx);
+	test_assert(ctx.cache->fields[ctx.cache_field2.idx].field.decision ==
+		    MAIL_CACHE_DECISION_YES);
+	test_assert(ctx.cache->fields[ctx.cache_field3.idx].field.decision ==
+		    MAIL_CACHE_DECISION_YES);
+
+	test_mail_cache_deinit(&ctx);
+	test_mail_index_delete();
+	test_end();
+}
 
 static void
 test_mail_cache_update_need_purge_continued_records_int(bool big_min_size)
@@ -1104,6 +1295,9 @@ int main(void)
 		test_mail_cache_purge_field_changes4,
 		test_mail_cache_purge_already_done,
 		test_mail_cache_purge_bitmask,
+		test_mail_cache_purge_columns,
+		test_mail_cache_purge_dict,
+		test_mail_cache_purge_fields_max_size,
 		test_mail_cache_update_need_purge_continued_records,
 		test_mail_cache_update_need_purge_continued_records2,
 		test_mail_cache_update_need_purge_deleted_records,
@@ -1,6 +1,7 @@
 /* Copyright (c) 2020 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "array.h"
 #include "str.h"
 #include "write-full.h"
 #include "test-common.h"
@@ -212,9 +213,13 @@ static void test_mail_cache_fields(void)
 	}
 
 	/* verify that bitmask is still as expected */
+	uint64_t lookups, hits, lookups2, hits2;
+	mail_cache_get_lookup_counts(&lookups, &hits);
 	str_truncate(str, 0);
 	test_assert(mail_cache_lookup_field(cache_view, str, 1,
 		cache_fields[TEST_FIELD_BITMASK].idx) == 1);
+	mail_cache_get_lookup_counts(&lookups2, &hits2);
+	test_assert(lookups2 == lookups + 1 && hits2 == hits + 1);
 	test_assert(str_len(str) == sizeof(bitmask_data) &&
 		    memcmp(str_data(str), bitmask_data, str_len(str)) == 0);
 
@@ -717,6 +722,62 @@ static void test_mail_cache_in_memory(void)
 	test_end();
 }
 
+static void test_mail_cache_in_memory_max_buffer_size(void)
+{
+	const struct mail_index_optimization_settings optimization_set = {
+		.cache = {
+			.record_max_size = MAIL_CACHE_MAX_WRITE_BUFFER*2,
+		},
+	};
+	struct test_mail_cache_ctx ctx;
+	struct mail_index *index;
+	struct mail_index_transaction *trans;
+	struct mail_cache_view *cache_view;
+	struct mail_cache_transaction_ctx *cache_trans;
+
+	test_begin("mail cache add in-memory with larger buffer");
+
+	index = mail_index_alloc(NULL, NULL, "(in-memory)");
+	test_assert(mail_index_open_or_create(index, MAIL_INDEX_OPEN_FLAG_CREATE) == 0);
+	test_mail_cache_init(index, &ctx);
+	mail_index_set_optimization_settings(ctx.index, &optimization_set);
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+
+	test_mail_cache_add_mail(&ctx, UINT_MAX, NULL);
+	test_mail_cache_add_mail(&ctx, UINT_MAX, NULL);
+
+	trans = mail_index_transaction_begin(ctx.view, 0);
+	cache_trans = mail_cache_get_transaction(cache_view, trans);
+	mail_cache_transaction_set_max_buffer_size(cache_trans,
+		MAIL_CACHE_MAX_WRITE_BUFFER*4);
+
+	size_t blob_size = 1024*130;
+	char *blob = i_malloc(blob_size);
+	memset(blob, 'x', blob_size);
+	mail_cache_add(cache_trans, 1, ctx.cache_field.idx, blob, blob_size);
+	mail_cache_add(cache_trans, 2, ctx.cache_field.idx, blob, blob_size);
+
+	/* the larger buffer keeps both blobs available */
+	string_t *str = str_new(default_pool, blob_size + 1024);
+	test_assert(mail_cache_lookup_field(cache_view, str, 1,
+					    ctx.cache_field.idx) == 1);
+	test_assert(str_len(str) == blob_size);
+	str_truncate(str, 0);
+	test_assert(mail_cache_lookup_field(cache_view, str, 2,
+					    ctx.cache_field.idx) == 1);
+	test_assert(str_len(str) == blob_size);
+
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+
+	str_free(&str);
+	i_free(blob);
+
+	mail_cache_view_close(&cache_view);
+	test_mail_cache_deinit(&ctx);
+	test_mail_index_delete();
+	test_end();
+}
+
 static void test_mail_cache_size_corruption(void)
 {
 	struct test_mail_cache_ctx ctx;
@@ -806,6 +867,154 @@ static void test_mail_cache_duplicate_fields(void)
 	test_end();
 }
 
+static void test_mail_cache_lookup_field_multi(void)
+{
+	struct test_mail_cache_ctx ctx;
+	struct mail_cache_view *cache_view;
+	ARRAY_TYPE(seq_range) seqs;
+	ARRAY_TYPE(mail_cache_lookup_result) results;
+	const struct mail_cache_lookup_result *result;
+	buffer_t *buf = t_buffer_create(64);
+	char value[16];
+	uint32_t seq;
+
+	test_begin("mail cache lookup field multi");
+	test_mail_cache_init(test_mail_index_init(), &ctx);
+	for (seq = 1; seq <= 5; seq++) {
+		i_snprintf(value, sizeof(value), "foo%u", seq);
+		test_mail_cache_add_mail(&ctx, seq == 3 ? ctx.cache_field2.idx :
+					 ctx.cache_field.idx, value);
+	}
+	/* records for seq 4 and 2 end up later in the file than seq 5 */
+	test_mail_cache_add_field(&ctx, 4, ctx.cache_field2.idx, "bar4");
+	test_mail_cache_add_field(&ctx, 2, ctx.cache_field2.idx, "bar2");
+
+	t_array_init(&seqs, 2);
+	seq_range_array_add_range(&seqs, 1, 5);
+	t_array_init(&results, 8);
+
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	test_assert(mail_cache_lookup_field_multi(cache_view, &seqs,
+			ctx.cache_field.idx, buf, &results) == 0);
+	test_assert(array_count(&results) == 4);
+	seq = 1;
+	array_foreach(&results, result) {
+		if (seq == 3)
+			seq++;
+		i_snprintf(value, sizeof(value), "foo%u", seq);
+		test_assert_idx(result->seq == seq, seq);
+		test_assert_idx(result->data_size == strlen(value) &&
+				memcmp(CONST_PTR_OFFSET(buf->data,
+							result->data_offset),
+				       value, result->data_size) == 0, seq);
+		seq++;
+	}
+
+	array_clear(&results);
+	buffer_set_used_size(buf, 0);
+	test_assert(mail_cache_lookup_field_multi(cache_view, &seqs,
+			ctx.cache_field2.idx, buf, &results) == 0);
+	test_assert(array_count(&results) == 3);
+	result = array_idx(&results, 0);
+	test_assert(result[0].seq == 2 && result[1].seq == 3 &&
+		    result[2].seq == 4);
+	test_assert(memcmp(CONST_PTR_OFFSET(buf->data, result[2].data_offset),
+			   "bar4", 4) == 0);
+	mail_cache_view_close(&cache_view);
+
+	test_mail_cache_deinit(&ctx);
+	test_mail_index_delete();
+	test_end();
+}
+
+static uint32_t
+test_mail_cache_get_field_bloom(struct test_mail_cache_ctx *ctx, uint32_t seq)
+{
+	const void *data;
+	uint32_t bloom;
+	bool expunged;
+
+	mail_index_lookup_ext(ctx->view, seq, ctx->cache->bloom_ext_id,
+			      &data, &expunged);
+	if (data == NULL)
+		return 0;
+	memcpy(&bloom, data, sizeof(bloom));
+	return bloom;
+}
+
+static void test_mail_cache_field_bloom(void)
+{
+	const struct mail_index_optimization_settings optimization_set = {
+		.cache = {
+			.field_bloom = TRUE,
+		},
+	};
+	struct test_mail_cache_ctx ctx;
+	struct mail_index_transaction *trans;
+	struct mail_cache_view *cache_view;
+	uint32_t bit1, bit2, bloom;
+
+	test_begin("mail cache field bloom");
+	test_mail_cache_init(test_mail_index_init(), &ctx);
+	mail_index_set_optimization_settings(ctx.index, &optimization_set);
+	bit1 = ctx.cache->fields[ctx.cache_field.idx].bloom_bit;
+	bit2 = ctx.cache->fields[ctx.cache_field2.idx].bloom_bit;
+	test_assert(bit1 != bit2);
+
+	test_mail_cache_add_mail(&ctx, ctx.cache_field.idx, "foo1");
+	test_mail_cache_add_mail(&ctx, ctx.cache_field2.idx, "bar2");
+	test_mail_cache_add_field(&ctx, 1, ctx.cache_field2.idx, "bar1");
+	test_mail_cache_view_sync(&ctx);
+
+	test_assert(test_mail_cache_get_field_bloom(&ctx, 1) ==
+		    (MAIL_CACHE_FIELD_BLOOM_VALID | bit1 | bit2));
+	test_assert(test_mail_cache_get_field_bloom(&ctx, 2) ==
+		    (MAIL_CACHE_FIELD_BLOOM_VALID | bit2));
+
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	test_assert(mail_cache_field_exists(cache_view, 1, ctx.cache_field.idx) == 1);
+	test_assert(mail_cache_field_exists(cache_view, 1, ctx.cache_field2.idx) == 1);
+	test_assert(mail_cache_field_exists(cache_view, 2, ctx.cache_field.idx) == 0);
+	test_assert(mail_cache_field_exists(cache_view, 2, ctx.cache_field2.idx) == 1);
+	mail_cache_view_close(&cache_view);
+
+	/* the bloom filter is trusted without reading the cache records */
+	trans = mail_index_transaction_begin(ctx.view, 0);
+	bloom = MAIL_CACHE_FIELD_BLOOM_VALID | bit2;
+	mail_index_update_ext(trans, 1, ctx.cache->bloom_ext_id, &bloom, NULL);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	test_mail_cache_view_sync(&ctx);
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	test_assert(mail_cache_field_exists(cache_view, 1, ctx.cache_field.idx) == 0);
+	mail_cache_view_close(&cache_view);
+
+	/* without the VALID bit the records are read */
+	trans = mail_index_transaction_begin(ctx.view, 0);
+	bloom = bit2;
+	mail_index_update_ext(trans, 1, ctx.cache->bloom_ext_id, &bloom, NULL);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	test_mail_cache_view_sync(&ctx);
+	cache_view = mail_cache_view_open(ctx.cache, ctx.view);
+	test_assert(mail_cache_field_exists(cache_view, 1, ctx.cache_field.idx) == 1);
+	mail_cache_view_close(&cache_view);
+
+	/* adding more fields doesn't make it valid again, but purging does */
+	test_mail_cache_add_field(&ctx, 1, ctx.cache_field3.idx, "baz1");
+	test_mail_cache_view_sync(&ctx);
+	test_assert(test_mail_cache_get_field_bloom(&ctx, 1) == 0);
+	test_assert(mail_cache_purge(ctx.cache, (uint32_t)-1, "test") == 0);
+	test_mail_cache_view_sync(&ctx);
+	test_assert(test_mail_cache_get_field_bloom(&ctx, 1) ==
+		    (MAIL_CACHE_FIELD_BLOOM_VALID | bit1 | bit2 |
+		     ctx.cache->fields[ctx.cache_field3.idx].bloom_bit));
+	test_assert(test_mail_cache_get_field_bloom(&ctx, 2) ==
+		    (MAIL_CACHE_FIELD_BLOOM_VALID | bit2));
+
+	test_mail_cache_deinit(&ctx);
+	test_mail_index_delete();
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
@@ -818,8 +1027,11 @@ int main(void)
 		test_mail_cache_lookup_decisions,
 		test_mail_cache_lookup_decisions2,
 		test_mail_cache_in_memory,
+		test_mail_cache_in_memory_max_buffer_size,
 		test_mail_cache_size_corruption,
 		test_mail_cache_duplicate_fields,
+		test_mail_cache_lookup_field_multi,
+		test_mail_cache_field_bloom,
 		NULL
 	};
 	return test_run(test_functions);
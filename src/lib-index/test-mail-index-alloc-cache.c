@@ -0,0 +1,97 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "test-common.h"
+#include "mail-index-private.h"
+#include "mail-index-alloc-cache.h"
+
+static struct mail_index *test_index_get(const char *name)
+{
+	/* in-memory indexes are looked up by the mailbox path */
+	return mail_index_alloc_cache_get(NULL, name, NULL, "test");
+}
+
+static void test_index_open_close(const char *name)
+{
+	struct mail_index *index = test_index_get(name);
+
+	test_assert(mail_index_open_or_create(index,
+					      MAIL_INDEX_OPEN_FLAG_CREATE) == 0);
+	mail_index_close(index);
+	mail_index_alloc_cache_unref(&index);
+}
+
+static bool test_index_is_cached(const char *name)
+{
+	struct mail_index *index = test_index_get(name);
+	bool cached = index->open_count > 0;
+
+	mail_index_alloc_cache_unref(&index);
+	return cached;
+}
+
+static void test_mail_index_alloc_cache_lru(void)
+{
+	test_begin("mail index alloc cache LRU");
+	mail_index_alloc_cache_set_limits(2, 10);
+
+	test_index_open_close("box1");
+	test_index_open_close("box2");
+	test_index_open_close("box3");
+	/* box1 was the least recently used */
+	test_assert(!test_index_is_cached("box1"));
+	test_assert(test_index_is_cached("box2"));
+	test_assert(test_index_is_cached("box3"));
+
+	/* reopening box2 makes it the most recently used */
+	test_index_open_close("box2");
+	test_index_open_close("box4");
+	test_assert(test_index_is_cached("box2"));
+	test_assert(!test_index_is_cached("box3"));
+	test_assert(test_index_is_cached("box4"));
+
+	mail_index_alloc_cache_destroy_unrefed();
+	test_end();
+}
+
+static void test_mail_index_alloc_cache_set_limits(void)
+{
+	test_begin("mail index alloc cache set limits");
+	mail_index_alloc_cache_set_limits(3, 10);
+	test_index_open_close("box1");
+	test_index_open_close("box2");
+	test_index_open_close("box3");
+	test_assert(test_index_is_cached("box1"));
+
+	/* lowering the limit closes the least recently used indexes */
+	mail_index_alloc_cache_set_limits(1, 10);
+	test_assert(!test_index_is_cached("box2"));
+	test_assert(!test_index_is_cached("box3"));
+	test_assert(test_index_is_cached("box1"));
+
+	/* 0 disables keeping the indexes open */
+	mail_index_alloc_cache_set_limits(0, 10);
+	test_index_open_close("box5");
+	test_assert(!test_index_is_cached("box1"));
+	test_assert(!test_index_is_cached("box5"));
+
+	mail_index_alloc_cache_destroy_unrefed();
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_mail_index_alloc_cache_lru,
+		test_mail_index_alloc_cache_set_limits,
+		NULL
+	};
+	struct ioloop *ioloop;
+	int ret;
+
+	ioloop = io_loop_create();
+	ret = test_run(test_functions);
+	io_loop_destroy(&ioloop);
+	return ret;
+}
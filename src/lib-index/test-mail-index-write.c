@@ -2,9 +2,12 @@
 
 #include "lib.h"
 #include "test-common.h"
+#include "write-full.h"
 #include "mail-index-private.h"
 #include "mail-transaction-log-private.h"
 
+#include <sys/stat.h>
+
 #define TEST_INDEX_FNAME ".test.index.write"
 #define TEST_INDEXID 123456
 #define LOG_FILE1_HEAD_OFFSET 200
@@ -141,10 +144,148 @@ static void test_mail_index_write(void)
 	test_end();
 }
 
+static void
+test_mail_index_write_records(struct mail_index *index,
+			      struct mail_index_map *map, unsigned int count)
+{
+	struct mail_index_record_map *rec_map = map->rec_map;
+	struct stat st;
+	buffer_t *buf;
+	int fd;
+
+	map->hdr.messages_count = rec_map->records_count = count;
+	map->hdr.next_uid = rec_map->last_appended_uid + 1;
+
+	buf = t_buffer_create(sizeof(map->hdr) +
+			      count * sizeof(struct mail_index_record));
+	buffer_append(buf, &map->hdr, sizeof(map->hdr));
+	buffer_append(buf, rec_map->records,
+		      count * sizeof(struct mail_index_record));
+
+	fd = open(TEST_INDEX_FNAME, O_RDWR|O_CREAT|O_TRUNC, 0600);
+	if (fd == -1)
+		i_fatal("open(%s) failed: %m", TEST_INDEX_FNAME);
+	if (write_full(fd, buf->data, buf->used) < 0)
+		i_fatal("write(%s) failed: %m", TEST_INDEX_FNAME);
+	if (fstat(fd, &st) < 0)
+		i_fatal("fstat(%s) failed: %m", TEST_INDEX_FNAME);
+	test_assert(st.st_size == (off_t)buf->used);
+	index->fd = fd;
+}
+
+static void
+test_mail_index_write_verify(struct mail_index_map *map)
+{
+	struct mail_index_record_map *rec_map = map->rec_map;
+	struct mail_index_header hdr;
+	buffer_t *buf;
+	size_t records_size =
+		rec_map->records_count * sizeof(struct mail_index_record);
+	int fd;
+
+	buf = t_buffer_create(sizeof(hdr) + records_size + 1);
+	fd = open(TEST_INDEX_FNAME, O_RDONLY);
+	if (fd == -1)
+		i_fatal("open(%s) failed: %m", TEST_INDEX_FNAME);
+	test_assert(read(fd, buffer_append_space_unsafe(buf,
+			sizeof(hdr) + records_size + 1),
+			sizeof(hdr) + records_size + 1) ==
+		    (ssize_t)(sizeof(hdr) + records_size));
+	i_close_fd(&fd);
+
+	memcpy(&hdr, buf->data, sizeof(hdr));
+	test_assert(hdr.messages_count == map->hdr.messages_count);
+	test_assert(hdr.log_file_tail_offset == map->hdr.log_file_head_offset);
+	test_assert(memcmp(CONST_PTR_OFFSET(buf->data, sizeof(hdr)),
+			   rec_map->records, records_size) == 0);
+}
+
+static void test_mail_index_write_incremental(void)
+{
+#define TEST_INCREMENTAL_OLD_COUNT 2000
+#define TEST_INCREMENTAL_NEW_COUNT (TEST_INCREMENTAL_OLD_COUNT + 10)
+	struct mail_transaction_log log = {
+		.head = &log_file,
+		.files = &log_file,
+	};
+	struct mail_index_record records[TEST_INCREMENTAL_NEW_COUNT];
+	struct mail_index_record_map rec_map = {
+		.records = records,
+	};
+	buffer_t hdr_copy;
+	struct mail_index_map map = {
+		.hdr = {
+			.indexid = TEST_INDEXID,
+			.base_header_size = sizeof(struct mail_index_header),
+			.header_size = sizeof(struct mail_index_header),
+			.record_size = sizeof(struct mail_index_record),
+			.log_file_seq = 1,
+			.log_file_tail_offset = 100,
+			.log_file_head_offset = LOG_FILE1_HEAD_OFFSET,
+		},
+		.hdr_copy_buf = &hdr_copy,
+		.rec_map = &rec_map,
+	};
+	buffer_create_from_const_data(&hdr_copy, &map.hdr, sizeof(map.hdr));
+	struct mail_index index = {
+		.event = event_create(NULL),
+		.log = &log,
+		.map = &map,
+		.dir = ".",
+		.fd = -1,
+		.indexid = TEST_INDEXID,
+		.filepath = TEST_INDEX_FNAME,
+		.log_sync_locked = TRUE,
+		.optimization_set = {
+			.index = {
+				.rewrite_incremental_min_size = 1,
+			},
+		},
+	};
+	unsigned int i;
+
+	test_begin("test_mail_index_write() incremental");
+	rotate_fail = FALSE;
+	expect_index_rewrite = TRUE;
+
+	for (i = 0; i < N_ELEMENTS(records); i++) {
+		records[i].uid = i + 1;
+		records[i].flags = 0;
+	}
+	rec_map.last_appended_uid = TEST_INCREMENTAL_OLD_COUNT;
+	test_mail_index_write_records(&index, &map, TEST_INCREMENTAL_OLD_COUNT);
+
+	/* change flags and append new records */
+	records[0].flags = MAIL_SEEN;
+	records[1000].flags = MAIL_FLAGGED;
+	map.hdr.messages_count = rec_map.records_count =
+		TEST_INCREMENTAL_NEW_COUNT;
+	map.hdr.log_file_head_offset = LOG_FILE1_HEAD_OFFSET + 100;
+	mail_index_write(&index, FALSE, "testing");
+	test_mail_index_write_verify(&map);
+	i_close_fd(&index.fd);
+
+	/* expunges fall back to writing the whole file */
+	rec_map.last_appended_uid = TEST_INCREMENTAL_OLD_COUNT;
+	test_mail_index_write_records(&index, &map, TEST_INCREMENTAL_OLD_COUNT);
+	memmove(records, records + 1,
+		sizeof(records[0]) * (TEST_INCREMENTAL_NEW_COUNT - 1));
+	map.hdr.messages_count = rec_map.records_count =
+		TEST_INCREMENTAL_NEW_COUNT - 1;
+	mail_index_write(&index, FALSE, "testing");
+	test_mail_index_write_verify(&map);
+	i_close_fd(&index.fd);
+
+	event_unref(&index.event);
+	i_unlink(TEST_INDEX_FNAME);
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_mail_index_write,
+		test_mail_index_write_incremental,
 		NULL
 	};
 	return test_run(test_functions);
@@ -2,10 +2,16 @@
 
 #include "lib.h"
 #include "array.h"
+#include "seq-range-array.h"
 #include "test-common.h"
 #include "test-mail-index.h"
+#include "mail-index-modseq.h"
+#include "mail-index-sync-private.h"
+#include "mail-index-view-private.h"
 #include "mail-transaction-log-private.h"
 
+#include <sys/stat.h>
+
 static void test_mail_index_rotate(void)
 {
 	struct mail_index *index, *index2;
@@ -158,11 +164,356 @@ static void test_mail_index_new_extension(void)
 	test_end();
 }
 
+static void test_mail_index_append_mails(struct mail_index *index,
+					 unsigned int count)
+{
+	const struct mail_index_header *hdr;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	unsigned int i;
+	uint32_t seq, uid_validity = 12345;
+
+	for (i = 0; i < count; i++) {
+		view = mail_index_view_open(index);
+		hdr = mail_index_get_header(view);
+		trans = mail_index_transaction_begin(view, 0);
+		if (hdr->uid_validity == 0) {
+			mail_index_update_header(trans,
+				offsetof(struct mail_index_header, uid_validity),
+				&uid_validity, sizeof(uid_validity), TRUE);
+		}
+		mail_index_append(trans, hdr->next_uid, &seq);
+		test_assert(mail_index_transaction_commit(&trans) == 0);
+		mail_index_view_close(&view);
+	}
+}
+
+static void test_mail_index_map_unchanged_file(void)
+{
+	struct mail_index *index, *index2;
+	struct mail_index_map *map;
+	struct stat st;
+	uint32_t file_seq;
+	uoff_t file_offset;
+
+	test_begin("mail index map unchanged file");
+	index = test_mail_index_init();
+	test_mail_index_append_mails(index, 1);
+	test_assert(mail_transaction_log_sync_lock(index->log, "test",
+						   &file_seq, &file_offset) == 0);
+	mail_index_write(index, TRUE, "test");
+	mail_transaction_log_sync_unlock(index->log, "test");
+
+	index2 = test_mail_index_open();
+	map = index2->map;
+	test_assert(map->hdr.messages_count == 1);
+
+	/* The log grows larger than the index, but the index file isn't
+	   rewritten. The map is synced from the log instead of re-reading
+	   the same index file again. */
+	test_mail_index_append_mails(index, 100);
+	/* make sure index2 knows the latest log size */
+	test_assert(fstat(index2->log->head->fd, &st) == 0);
+	index2->log->head->last_size = st.st_size;
+	test_assert(mail_index_sync_map_want_index_reopen(index2->map,
+		MAIL_INDEX_SYNC_HANDLER_HEAD));
+	test_assert(mail_index_refresh(index2) == 0);
+	test_assert(index2->map == map);
+	test_assert(index2->map->hdr.messages_count == 101);
+
+	/* After the index file is rewritten it's read again */
+	test_assert(mail_transaction_log_sync_lock(index->log, "test",
+						   &file_seq, &file_offset) == 0);
+	mail_index_write(index, TRUE, "test");
+	mail_transaction_log_sync_unlock(index->log, "test");
+	test_mail_index_append_mails(index, 100);
+	test_assert(mail_index_refresh(index2) == 0);
+	test_assert(index2->map->hdr.messages_count == 201);
+
+	test_mail_index_close(&index2);
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
+static void test_mail_index_readonly_reopen(void)
+{
+	struct mail_index *index, *index2;
+	struct mail_index_map *map;
+	struct stat st;
+	uint32_t file_seq;
+	uoff_t file_offset;
+
+	test_begin("mail index readonly reopen");
+	index = test_mail_index_init();
+	test_mail_index_append_mails(index, 10);
+	test_assert(mail_transaction_log_sync_lock(index->log, "test",
+						   &file_seq, &file_offset) == 0);
+	mail_index_write(index, FALSE, "test");
+	mail_transaction_log_sync_unlock(index->log, "test");
+
+	index2 = mail_index_alloc(NULL, TESTDIR_NAME, "test.dovecot.index");
+	test_assert(mail_index_open(index2, MAIL_INDEX_OPEN_FLAG_READONLY) == 1);
+	test_assert(index2->readonly);
+	map = index2->map;
+
+	/* the index file hasn't changed, so the changes are synced from the
+	   log */
+	test_mail_index_append_mails(index, 1);
+	test_assert(fstat(index2->log->head->fd, &st) == 0);
+	index2->log->head->last_size = st.st_size;
+	test_assert(mail_index_refresh(index2) == 0);
+	test_assert(index2->map == map);
+	test_assert(index2->map->hdr.messages_count == 11);
+
+	/* after the index is rewritten, the readonly index reads it again
+	   even though syncing the log would be cheap */
+	test_mail_index_append_mails(index, 1);
+	test_assert(mail_transaction_log_sync_lock(index->log, "test",
+						   &file_seq, &file_offset) == 0);
+	mail_index_write(index, TRUE, "test");
+	mail_transaction_log_sync_unlock(index->log, "test");
+	test_assert(fstat(index2->log->head->fd, &st) == 0);
+	index2->log->head->last_size = st.st_size;
+	test_assert(mail_index_refresh(index2) == 0);
+	test_assert(index2->map != map);
+	test_assert(index2->map->hdr.messages_count == 12);
+
+	test_mail_index_close(&index2);
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
+static void test_mail_index_fsck_records(void)
+{
+	struct mail_index *index;
+	struct mail_index_map *map;
+	unsigned int i;
+
+	test_begin("mail index fsck records");
+	index = test_mail_index_init();
+	test_mail_index_append_mails(index, 10);
+	test_assert(mail_index_refresh(index) == 0);
+
+	map = mail_index_map_clone(index->map);
+	mail_index_unmap(&index->map);
+	index->map = map;
+	test_assert(map->rec_map->records_count == 10);
+
+	/* break UIDs 3, 4, 6 and 10 */
+	MAIL_INDEX_REC_AT_SEQ(map, 3)->uid = 0;
+	MAIL_INDEX_REC_AT_SEQ(map, 4)->uid = 2;
+	MAIL_INDEX_REC_AT_SEQ(map, 6)->uid = 1;
+	MAIL_INDEX_REC_AT_SEQ(map, 10)->uid = 9;
+
+	/* fsck warning, zero UIDs, unordered UIDs, messages_count */
+	test_expect_errors(4);
+	test_assert(mail_index_fsck(index) == 0);
+	test_expect_no_more_errors();
+
+	map = index->map;
+	test_assert(map->rec_map->records_count == 6);
+	test_assert(map->hdr.messages_count == 6);
+	static const uint32_t expected_uids[] = { 1, 2, 5, 7, 8, 9 };
+	for (i = 0; i < N_ELEMENTS(expected_uids); i++) {
+		test_assert_idx(MAIL_INDEX_REC_AT_SEQ(map, i + 1)->uid ==
+				expected_uids[i], i);
+	}
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
+static bool test_seq_ranges_equal(const ARRAY_TYPE(seq_range) *seqs1,
+				  const ARRAY_TYPE(seq_range) *seqs2)
+{
+	unsigned int count = array_count(seqs1);
+
+	return count == array_count(seqs2) &&
+		(count == 0 || memcmp(array_front(seqs1), array_front(seqs2),
+				      sizeof(struct seq_range) * count) == 0);
+}
+
+static void
+test_mail_index_lookup_seqs_by_flags_cmp(struct mail_index_view *view,
+					 const struct mail_index_flags_filter *filter,
+					 unsigned int expected_count)
+{
+	ARRAY_TYPE(seq_range) seqs, slow_seqs;
+	uint32_t count = mail_index_view_get_messages_count(view);
+
+	i_array_init(&seqs, 8);
+	i_array_init(&slow_seqs, 8);
+	mail_index_lookup_seqs_by_flags(view, 1, count, filter, &seqs);
+	mail_index_view_lookup_seqs_by_flags_slow(view, 1, count, filter,
+						  &slow_seqs);
+	test_assert(test_seq_ranges_equal(&seqs, &slow_seqs));
+	test_assert(seq_range_count(&seqs) == expected_count);
+
+	/* partial range */
+	array_clear(&seqs);
+	mail_index_lookup_seqs_by_flags(view, 10, 20, filter, &seqs);
+	seq_range_array_remove_range(&slow_seqs, 1, 9);
+	seq_range_array_remove_range(&slow_seqs, 21, count);
+	test_assert(test_seq_ranges_equal(&seqs, &slow_seqs));
+	array_free(&seqs);
+	array_free(&slow_seqs);
+}
+
+static void test_mail_index_lookup_seqs_by_flags(void)
+{
+	static const char *const kw_foo_names[] = { "foo", NULL };
+	static const char *const kw_bar_names[] = { "bar", NULL };
+	struct mail_index *index;
+	struct mail_index_view *view, *tview;
+	struct mail_index_transaction *trans;
+	struct mail_index_flags_filter filter;
+	struct mail_keywords *kw_foo, *kw_bar;
+	unsigned int foo_idx, bar_idx, missing_idx = 100;
+	uint32_t seq;
+
+	test_begin("mail index lookup seqs by flags");
+	index = test_mail_index_init();
+	test_mail_index_append_mails(index, 100);
+	test_assert(mail_index_refresh(index) == 0);
+
+	view = mail_index_view_open(index);
+	trans = mail_index_transaction_begin(view, 0);
+	kw_foo = mail_index_keywords_create(index, kw_foo_names);
+	kw_bar = mail_index_keywords_create(index, kw_bar_names);
+	for (seq = 1; seq <= 100; seq++) {
+		if (seq % 3 == 0) {
+			mail_index_update_flags(trans, seq, MODIFY_ADD,
+						MAIL_SEEN);
+		}
+		if (seq % 5 == 0) {
+			mail_index_update_flags(trans, seq, MODIFY_ADD,
+						MAIL_FLAGGED);
+		}
+		if (seq % 7 == 0) {
+			mail_index_update_keywords(trans, seq, MODIFY_ADD,
+						   kw_foo);
+		}
+		if (seq % 2 == 0) {
+			mail_index_update_keywords(trans, seq, MODIFY_ADD,
+						   kw_bar);
+		}
+	}
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+	test_assert(mail_index_refresh(index) == 0);
+	test_assert(mail_index_keyword_lookup(index, "foo", &foo_idx));
+	test_assert(mail_index_keyword_lookup(index, "bar", &bar_idx));
+
+	view = mail_index_view_open(index);
+	i_zero(&filter);
+	t_array_init(&filter.keywords_set, 4);
+	t_array_init(&filter.keywords_unset, 4);
+
+	/* flags only */
+	filter.flags_mask = MAIL_SEEN;
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 100 - 33);
+	filter.flags = MAIL_SEEN;
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 33);
+	filter.flags_mask = MAIL_SEEN | MAIL_FLAGGED;
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 33 - 6);
+
+	/* keywords */
+	filter.flags = 0;
+	filter.flags_mask = 0;
+	array_push_back(&filter.keywords_set, &foo_idx);
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 14);
+	array_push_back(&filter.keywords_unset, &bar_idx);
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 7);
+	filter.flags = filter.flags_mask = MAIL_SEEN;
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 2);
+
+	/* nonexistent keywords */
+	array_clear(&filter.keywords_set);
+	array_push_back(&filter.keywords_unset, &missing_idx);
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 33 - 16);
+	array_push_back(&filter.keywords_set, &missing_idx);
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 0);
+
+	/* uncommitted changes and appends in a transaction */
+	trans = mail_index_transaction_begin(view, 0);
+	tview = mail_index_transaction_open_updated_view(trans);
+	mail_index_update_flags(trans, 33, MODIFY_REMOVE, MAIL_SEEN);
+	mail_index_update_flags(trans, 35, MODIFY_ADD, MAIL_SEEN);
+	mail_index_update_keywords(trans, 51, MODIFY_ADD, kw_bar);
+	mail_index_update_keywords(trans, 54, MODIFY_REMOVE, kw_bar);
+	mail_index_append(trans, 0, &seq);
+	mail_index_update_flags(trans, seq, MODIFY_ADD, MAIL_SEEN);
+	mail_index_append(trans, 0, &seq);
+
+	array_clear(&filter.keywords_set);
+	array_clear(&filter.keywords_unset);
+	array_push_back(&filter.keywords_unset, &bar_idx);
+	filter.flags = filter.flags_mask = MAIL_SEEN;
+	test_mail_index_lookup_seqs_by_flags_cmp(tview, &filter, 17 + 1);
+	filter.flags = 0;
+	test_mail_index_lookup_seqs_by_flags_cmp(tview, &filter, 33 + 1);
+	mail_index_view_close(&tview);
+	mail_index_transaction_rollback(&trans);
+
+	mail_index_keywords_unref(&kw_foo);
+	mail_index_keywords_unref(&kw_bar);
+	mail_index_view_close(&view);
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
+static void test_mail_index_lookup_seqs_by_modseq(void)
+{
+	struct mail_index *index;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	struct mail_index_flags_filter filter;
+	uint64_t modseq;
+	uint32_t seq;
+
+	test_begin("mail index lookup seqs by modseq");
+	index = test_mail_index_init();
+	mail_index_modseq_enable(index);
+	test_mail_index_append_mails(index, 100);
+	test_assert(mail_index_refresh(index) == 0);
+
+	view = mail_index_view_open(index);
+	modseq = mail_index_modseq_get_highest(view);
+	trans = mail_index_transaction_begin(view, 0);
+	for (seq = 10; seq <= 100; seq += 10)
+		mail_index_update_flags(trans, seq, MODIFY_ADD, MAIL_SEEN);
+	mail_index_update_flags(trans, 11, MODIFY_ADD, MAIL_FLAGGED);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+	test_assert(mail_index_refresh(index) == 0);
+
+	view = mail_index_view_open(index);
+	i_zero(&filter);
+	filter.min_modseq = modseq + 1;
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 11);
+	filter.flags = filter.flags_mask = MAIL_SEEN;
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 10);
+	filter.flags = 0;
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 1);
+	filter.flags_mask = 0;
+	filter.min_modseq = mail_index_modseq_get_highest(view) + 1;
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 0);
+	filter.min_modseq = 1;
+	test_mail_index_lookup_seqs_by_flags_cmp(view, &filter, 100);
+	mail_index_view_close(&view);
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_mail_index_rotate,
 		test_mail_index_new_extension,
+		test_mail_index_map_unchanged_file,
+		test_mail_index_fsck_records,
+		test_mail_index_readonly_reopen,
+		test_mail_index_lookup_seqs_by_flags,
+		test_mail_index_lookup_seqs_by_modseq,
 		NULL
 	};
 	return test_run(test_functions);
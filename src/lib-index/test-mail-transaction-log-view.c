@@ -85,6 +85,12 @@ int mail_transaction_log_file_map(struct mail_transaction_log_file *file ATTR_UN
 	return 1;
 }
 
+void mail_transaction_log_file_willneed(struct mail_transaction_log_file *file ATTR_UNUSED,
+					uoff_t start_offset ATTR_UNUSED,
+					uoff_t end_offset ATTR_UNUSED)
+{
+}
+
 int mail_transaction_log_file_get_highest_modseq_at(
 		struct mail_transaction_log_file *file ATTR_UNUSED,
 		uoff_t offset ATTR_UNUSED, uint64_t *highest_modseq_r,
@@ -382,6 +382,7 @@ int mail_deliver_save(struct mail_deliver_context *ctx, const char *mailbox,
 	enum mail_error error;
 	const char *mailbox_name, *errstr, *guid;
 	struct mail_transaction_commit_changes changes;
+	uint64_t start_usecs, end_usecs;
 	bool default_save;
 	int ret = 0;
 
@@ -397,8 +398,12 @@ int mail_deliver_save(struct mail_deliver_context *ctx, const char *mailbox,
 	open_ctx.lda_mailbox_autosubscribe = ctx->set->lda_mailbox_autosubscribe;
 
 	mailbox_name = str_sanitize(mailbox, 80);
-	if (mail_deliver_save_open(&open_ctx, mailbox, &box,
-				   &error, &errstr) < 0) {
+	start_usecs = i_microseconds();
+	ret = mail_deliver_save_open(&open_ctx, mailbox, &box,
+				     &error, &errstr);
+	end_usecs = i_microseconds();
+	ctx->mailbox_open_usecs += end_usecs - start_usecs;
+	if (ret < 0) {
 		if (box != NULL) {
 			*storage_r = mailbox_get_storage(box);
 			mailbox_free(&box);
@@ -429,15 +434,21 @@ int mail_deliver_save(struct mail_deliver_context *ctx, const char *mailbox,
 	mailbox_header_lookup_unref(&headers_ctx);
 	mail_deliver_deduplicate_guid_if_needed(ctx->session, save_ctx);
 
+	start_usecs = end_usecs;
 	if (mailbox_save_using_mail(&save_ctx, ctx->src_mail) < 0)
 		ret = -1;
 	if (kw != NULL)
 		mailbox_keywords_unref(&kw);
+	end_usecs = i_microseconds();
+	ctx->save_usecs += end_usecs - start_usecs;
 
 	if (ret < 0)
 		mailbox_transaction_rollback(&t);
-	else
+	else {
+		/* includes the fsyncs and index updates */
 		ret = mailbox_transaction_commit_get_changes(&t, &changes);
+		ctx->commit_usecs += i_microseconds() - end_usecs;
+	}
 
 	if (ret == 0) {
 		ctx->saved_mail = TRUE;
@@ -579,6 +590,7 @@ int mail_deliver(struct mail_deliver_context *ctx,
 	struct mail_storage *storage = NULL;
 	enum mail_deliver_error error_code = MAIL_DELIVER_ERROR_NONE;
 	const char *error = NULL;
+	uint64_t start_usecs, deliver_usecs;
 	int ret;
 
 	i_assert(muser->deliver_ctx == NULL);
@@ -595,7 +607,9 @@ int mail_deliver(struct mail_deliver_context *ctx,
 		set_name("mail_delivery_started");
 	e_debug(e->event(), "Local delivery started");
 
+	start_usecs = i_microseconds();
 	ret = mail_do_deliver(ctx, &storage);
+	deliver_usecs = i_microseconds() - start_usecs;
 
 	if (ret >= 0)
 		i_assert(ret == 0); /* ret > 0 has no defined meaning */
@@ -619,7 +633,11 @@ int mail_deliver(struct mail_deliver_context *ctx,
 	}
 
 	e = event_create_passthrough(ctx->event)->
-		set_name("mail_delivery_finished");
+		set_name("mail_delivery_finished")->
+		add_int("deliver_usecs", deliver_usecs)->
+		add_int("mailbox_open_usecs", ctx->mailbox_open_usecs)->
+		add_int("save_usecs", ctx->save_usecs)->
+		add_int("commit_usecs", ctx->commit_usecs);
 	if (ret == 0) {
 		e_debug(e->event(), "Local delivery finished successfully");
 	} else {
@@ -89,6 +89,10 @@ struct mail_deliver_context {
 
 	struct mail_duplicate_db *dup_db;
 
+	/* Time spent in mail_deliver_save() phases. Added to the
+	   mail_delivery_finished event. */
+	uint64_t mailbox_open_usecs, save_usecs, commit_usecs;
+
 	/* Session ID, used as log line prefix if non-NULL. */
 	const char *session_id;
 	/* Mail to save */
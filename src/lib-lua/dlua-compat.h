@@ -15,6 +15,7 @@
 	((luaL_newmetatable(L, tn) != 0) ? \
 	 (lua_pushstring((L), (tn)), lua_setfield((L), -2, "__name"), 1) : \
 	 0)
+#  define lua_dump(L, writer, data, strip) lua_dump(L, writer, data)
 #endif
 
 /* functionality missing from <= 5.1 */
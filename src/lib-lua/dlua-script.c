@@ -2,6 +2,8 @@
 
 #include "lib.h"
 #include "llist.h"
+#include "buffer.h"
+#include "hash.h"
 #include "istream.h"
 #include "sha1.h"
 #include "str.h"
@@ -12,6 +14,7 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 /* the registry entry with a pointer to struct dlua_script */
 #define LUA_SCRIPT_REGISTRY_KEY	"DLUA_SCRIPT"
@@ -23,7 +26,20 @@ struct event_category event_category_lua = {
 	.name = "lua",
 };
 
+/* The compiled chunk of a script file. Every user (or auth request) may
+   create its own lua_State for the same file, so the file is parsed only
+   once per process and version of the file. */
+struct dlua_script_chunk {
+	char *path;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	unsigned long mtime_nsec;
+	buffer_t *bytecode;
+};
+
 static struct dlua_script *dlua_scripts = NULL;
+static HASH_TABLE(char *, struct dlua_script_chunk *) dlua_script_chunks;
 
 static int
 dlua_script_create_finish(struct dlua_script *script, const char **error_r);
@@ -278,10 +294,98 @@ int dlua_script_create_string(const char *str, struct dlua_script **script_r,
 	return -1;
 }
 
+static void dlua_script_chunk_free(struct dlua_script_chunk *chunk)
+{
+	buffer_free(&chunk->bytecode);
+	i_free(chunk->path);
+	i_free(chunk);
+}
+
+static void dlua_script_chunks_deinit(void)
+{
+	struct hash_iterate_context *iter;
+	struct dlua_script_chunk *chunk;
+	char *path;
+
+	iter = hash_table_iterate_init(dlua_script_chunks);
+	while (hash_table_iterate(iter, dlua_script_chunks, &path, &chunk))
+		dlua_script_chunk_free(chunk);
+	hash_table_iterate_deinit(&iter);
+	hash_table_destroy(&dlua_script_chunks);
+}
+
+static int dlua_script_chunk_writer(lua_State *L ATTR_UNUSED,
+				    const void *data, size_t size, void *context)
+{
+	buffer_t *buf = context;
+
+	buffer_append(buf, data, size);
+	return 0;
+}
+
+static bool
+dlua_script_chunk_load(struct dlua_script *script, const char *file,
+		       const struct stat *st)
+{
+	struct dlua_script_chunk *chunk;
+
+	if (!hash_table_is_created(dlua_script_chunks))
+		return FALSE;
+	chunk = hash_table_lookup(dlua_script_chunks, file);
+	if (chunk == NULL || chunk->ino != st->st_ino ||
+	    chunk->size != st->st_size || chunk->mtime != st->st_mtime ||
+	    !ST_NTIMES_EQUAL(chunk->mtime_nsec, ST_MTIME_NSEC(*st)))
+		return FALSE;
+
+	if (luaL_loadbuffer(script->L, chunk->bytecode->data,
+			    chunk->bytecode->used,
+			    t_strconcat("@", file, NULL)) != LUA_OK) {
+		/* shouldn't happen - just compile the file again */
+		lua_pop(script->L, 1);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void
+dlua_script_chunk_save(struct dlua_script *script, const char *file,
+		       const struct stat *st)
+{
+	struct dlua_script_chunk *chunk;
+	char *path;
+
+	if (!hash_table_is_created(dlua_script_chunks)) {
+		hash_table_create(&dlua_script_chunks, default_pool, 0,
+				  str_hash, strcmp);
+		lib_atexit(dlua_script_chunks_deinit);
+	}
+	if (hash_table_lookup_full(dlua_script_chunks, file, &path, &chunk)) {
+		hash_table_remove(dlua_script_chunks, path);
+		dlua_script_chunk_free(chunk);
+	}
+
+	chunk = i_new(struct dlua_script_chunk, 1);
+	chunk->path = i_strdup(file);
+	chunk->ino = st->st_ino;
+	chunk->size = st->st_size;
+	chunk->mtime = st->st_mtime;
+	chunk->mtime_nsec = ST_MTIME_NSEC(*st);
+	chunk->bytecode = buffer_create_dynamic(default_pool, st->st_size + 64);
+	/* the compiled function is at the top of the stack */
+	if (lua_dump(script->L, dlua_script_chunk_writer,
+		     chunk->bytecode, 0) != 0) {
+		dlua_script_chunk_free(chunk);
+		return;
+	}
+	hash_table_insert(dlua_script_chunks, chunk->path, chunk);
+}
+
 int dlua_script_create_file(const char *file, struct dlua_script **script_r,
 			    struct event *event_parent, const char **error_r)
 {
 	struct dlua_script *script;
+	struct stat st;
+	bool have_stat;
 
 	/* lua reports file access errors poorly */
 	if (access(file, O_RDONLY) < 0) {
@@ -294,12 +398,19 @@ int dlua_script_create_file(const char *file, struct dlua_script **script_r,
 	}
 
 	script = dlua_create_script(file, event_parent);
+	have_stat = stat(file, &st) == 0;
+	if (have_stat && dlua_script_chunk_load(script, file, &st)) {
+		*script_r = script;
+		return 0;
+	}
 	if (luaL_loadfile(script->L, file) != LUA_OK) {
 		*error_r = t_strdup_printf("lua_load(%s) failed: %s",
 					   file, lua_tostring(script->L, -1));
 		dlua_script_unref(&script);
 		return -1;
 	}
+	if (have_stat)
+		dlua_script_chunk_save(script, file, &st);
 
 	*script_r = script;
 	return 0;
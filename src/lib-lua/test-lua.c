@@ -1,9 +1,12 @@
 /* Copyright (c) 2018 Dovecot authors, see the included COPYING file */
 
 #include "test-lib.h"
+#include "write-full.h"
 #include "dlua-script-private.h"
 
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 static int dlua_test_assert(lua_State *L)
 {
@@ -513,11 +516,62 @@ static void test_compat_tointegerx_and_isinteger(void)
 	test_end();
 }
 
+#define TEST_LUA_SCRIPT_FILE ".test-lua-script.lua"
+
+static void test_script_file_write(const char *data)
+{
+	int fd;
+
+	fd = open(TEST_LUA_SCRIPT_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		i_fatal("open(%s) failed: %m", TEST_LUA_SCRIPT_FILE);
+	if (write_full(fd, data, strlen(data)) < 0)
+		i_fatal("write(%s) failed: %m", TEST_LUA_SCRIPT_FILE);
+	i_close_fd(&fd);
+}
+
+static lua_Integer test_script_file_run(void)
+{
+	struct dlua_script *script;
+	const char *error;
+	lua_Integer value = -1;
+
+	if (dlua_script_create_file(TEST_LUA_SCRIPT_FILE, &script, NULL,
+				    &error) < 0)
+		i_fatal("dlua_script_create_file() failed: %s", error);
+	test_assert(dlua_script_init(script, &error) == 0);
+	lua_getglobal(script->L, "value");
+	if (lua_isnumber(script->L, -1))
+		value = lua_tointegerx(script->L, -1, NULL);
+	lua_pop(script->L, 1);
+	dlua_script_unref(&script);
+	return value;
+}
+
+static void test_script_file_cache(void)
+{
+	test_begin("lua script file cache");
+
+	test_script_file_write("value = 1\n");
+	test_assert(test_script_file_run() == 1);
+	/* the second load uses the compiled chunk */
+	test_assert(test_script_file_run() == 1);
+
+	/* a changed file is compiled again */
+	test_script_file_write("value = 1234\n");
+	test_assert(test_script_file_run() == 1234);
+	test_assert(test_script_file_run() == 1234);
+
+	i_unlink(TEST_LUA_SCRIPT_FILE);
+	test_end();
+}
+
 int main(void) {
 	void (*tests[])(void) = {
 		test_lua,
 		test_tls,
 		test_compat_tointegerx_and_isinteger,
+		test_script_file_cache,
 		NULL
 	};
 
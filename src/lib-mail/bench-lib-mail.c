@@ -0,0 +1,496 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "buffer.h"
+#include "str.h"
+#include "istream.h"
+#include "time-util.h"
+#include "strnum.h"
+#include "message-parser.h"
+#include "message-header-parser.h"
+#include "message-header-decode.h"
+#include "message-decoder.h"
+#include "message-part-data.h"
+#include "message-snippet.h"
+#include "mail-html2text.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/**
+ * Replays a mail corpus through the lib-mail parsers that run for every
+ * mail when it's indexed, searched or fetched: MIME parsing, header
+ * decoding, body decoding, BODYSTRUCTURE header parsing, snippet
+ * generation and HTML to text conversion. The corpus can be any number of
+ * mbox files, maildirs (the cur/ and new/ directories are read) or
+ * directories and files containing one mail each.
+ *
+ * For each parser the throughput is reported, along with how many times
+ * and how many bytes per mail were allocated from the memory pool given
+ * to it. Allocations done internally from default_pool or the data stack
+ * aren't counted.
+ */
+
+#define BENCH_BLOCK_SIZE 8192
+#define BENCH_SNIPPET_MAX_CHARS 200
+
+struct bench_mail {
+	buffer_t *data;
+	/* Decoded text/html parts of the mail */
+	buffer_t *html;
+};
+ARRAY_DEFINE_TYPE(bench_mail, struct bench_mail);
+
+/* Pool that counts the allocations done through it */
+struct bench_pool {
+	struct pool pool;
+	pool_t parent;
+	int refcount;
+
+	unsigned int alloc_count;
+	size_t alloc_bytes;
+};
+
+struct bench {
+	const char *name;
+	/* Returns the number of bytes processed */
+	size_t (*run)(const struct bench_mail *mail, pool_t pool);
+};
+
+static ARRAY_TYPE(bench_mail) bench_mails;
+
+static const char *bench_pool_get_name(pool_t pool ATTR_UNUSED)
+{
+	return "bench pool";
+}
+
+static void bench_pool_ref(pool_t pool)
+{
+	struct bench_pool *bpool = container_of(pool, struct bench_pool, pool);
+
+	bpool->refcount++;
+}
+
+static void bench_pool_unref(pool_t *pool)
+{
+	struct bench_pool *bpool = container_of(*pool, struct bench_pool, pool);
+
+	/* the pool is freed by the benchmark itself */
+	i_assert(bpool->refcount > 1);
+	bpool->refcount--;
+	*pool = NULL;
+}
+
+static void *bench_pool_malloc(pool_t pool, size_t size)
+{
+	struct bench_pool *bpool = container_of(pool, struct bench_pool, pool);
+
+	bpool->alloc_count++;
+	bpool->alloc_bytes += size;
+	return p_malloc(bpool->parent, size);
+}
+
+static void bench_pool_free(pool_t pool, void *mem)
+{
+	struct bench_pool *bpool = container_of(pool, struct bench_pool, pool);
+
+	p_free(bpool->parent, mem);
+}
+
+static void *bench_pool_realloc(pool_t pool, void *mem,
+				size_t old_size, size_t new_size)
+{
+	struct bench_pool *bpool = container_of(pool, struct bench_pool, pool);
+
+	bpool->alloc_count++;
+	bpool->alloc_bytes += new_size - old_size;
+	return p_realloc(bpool->parent, mem, old_size, new_size);
+}
+
+static void bench_pool_clear(pool_t pool)
+{
+	struct bench_pool *bpool = container_of(pool, struct bench_pool, pool);
+
+	p_clear(bpool->parent);
+}
+
+static size_t bench_pool_get_max_easy_alloc_size(pool_t pool)
+{
+	struct bench_pool *bpool = container_of(pool, struct bench_pool, pool);
+
+	return p_get_max_easy_alloc_size(bpool->parent);
+}
+
+static const struct pool_vfuncs bench_pool_vfuncs = {
+	bench_pool_get_name,
+	bench_pool_ref,
+	bench_pool_unref,
+	bench_pool_malloc,
+	bench_pool_free,
+	bench_pool_realloc,
+	bench_pool_clear,
+	bench_pool_get_max_easy_alloc_size,
+};
+
+static void bench_pool_init(struct bench_pool *bpool)
+{
+	i_zero(bpool);
+	bpool->pool.v = &bench_pool_vfuncs;
+	bpool->pool.alloconly_pool = TRUE;
+	bpool->parent = pool_alloconly_create("bench mail", 1024);
+	bpool->refcount = 1;
+}
+
+static void bench_pool_deinit(struct bench_pool *bpool)
+{
+	i_assert(bpool->refcount == 1);
+	pool_unref(&bpool->parent);
+}
+
+static void
+bench_mail_get_html(struct bench_mail *mail)
+{
+	struct message_parser_settings parser_set = { .flags = 0 };
+	struct message_decoder_context *decoder;
+	struct message_parser_ctx *parser;
+	struct message_block block, decoded;
+	struct message_part *parts;
+	struct istream *input;
+	const char *content_type;
+	pool_t pool;
+
+	mail->html = buffer_create_dynamic(default_pool, 128);
+	pool = pool_alloconly_create("bench html", 1024);
+	input = i_stream_create_from_buffer(mail->data);
+	parser = message_parser_init(pool, input, &parser_set);
+	decoder = message_decoder_init(NULL, 0);
+	while (message_parser_parse_next_block(parser, &block) > 0) {
+		if (!message_decoder_decode_next_block(decoder, &block,
+						       &decoded) ||
+		    decoded.hdr != NULL || decoded.size == 0)
+			continue;
+		content_type = message_decoder_current_content_type(decoder);
+		if (content_type != NULL &&
+		    mail_html2text_content_type_match(content_type))
+			buffer_append(mail->html, decoded.data, decoded.size);
+	}
+	message_decoder_deinit(&decoder);
+	message_parser_deinit(&parser, &parts);
+	i_stream_unref(&input);
+	pool_unref(&pool);
+}
+
+static void bench_mail_add(const unsigned char *data, size_t size)
+{
+	struct bench_mail *mail;
+
+	mail = array_append_space(&bench_mails);
+	mail->data = buffer_create_dynamic(default_pool, size);
+	buffer_append(mail->data, data, size);
+	bench_mail_get_html(mail);
+}
+
+static void bench_load_mbox(const buffer_t *buf)
+{
+	const unsigned char *data = buf->data, *end = data + buf->used;
+	const unsigned char *p, *next;
+
+	while (data < end) {
+		/* skip over the From_ line */
+		p = memchr(data, '\n', end - data);
+		if (p == NULL)
+			break;
+		data = p + 1;
+
+		for (next = data; next < end; next = p + 1) {
+			p = memchr(next, '\n', end - next);
+			if (p == NULL) {
+				next = end;
+				break;
+			}
+			if ((size_t)(end - (p + 1)) >= 5 &&
+			    memcmp(p + 1, "From ", 5) == 0) {
+				next = p + 1;
+				break;
+			}
+		}
+		bench_mail_add(data, next - data);
+		data = next;
+	}
+}
+
+static void bench_load_file(const char *path)
+{
+	buffer_t *buf;
+	const char *error;
+
+	buf = buffer_create_dynamic(default_pool, 4096);
+	if (buffer_append_full_file(buf, path, SIZE_MAX, &error) !=
+	    BUFFER_APPEND_OK)
+		i_fatal("%s", error);
+	if (buf->used >= 5 && memcmp(buf->data, "From ", 5) == 0)
+		bench_load_mbox(buf);
+	else
+		bench_mail_add(buf->data, buf->used);
+	buffer_free(&buf);
+}
+
+static void bench_load_dir(const char *path)
+{
+	struct dirent *d;
+	struct stat st;
+	const char *subpath;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (dir == NULL)
+		i_fatal("opendir(%s) failed: %m", path);
+	while ((d = readdir(dir)) != NULL) {
+		if (d->d_name[0] == '.')
+			continue;
+		T_BEGIN {
+			subpath = t_strconcat(path, "/", d->d_name, NULL);
+			if (stat(subpath, &st) < 0)
+				i_fatal("stat(%s) failed: %m", subpath);
+			if (S_ISREG(st.st_mode))
+				bench_load_file(subpath);
+			else if (S_ISDIR(st.st_mode) &&
+				 (strcmp(d->d_name, "cur") == 0 ||
+				  strcmp(d->d_name, "new") == 0))
+				bench_load_dir(subpath);
+		} T_END;
+	}
+	if (closedir(dir) < 0)
+		i_fatal("closedir(%s) failed: %m", path);
+}
+
+static void bench_load(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) < 0)
+		i_fatal("stat(%s) failed: %m", path);
+	if (S_ISDIR(st.st_mode))
+		bench_load_dir(path);
+	else
+		bench_load_file(path);
+}
+
+static size_t bench_message_parser(const struct bench_mail *mail, pool_t pool)
+{
+	struct message_parser_settings parser_set = { .flags = 0 };
+	struct message_parser_ctx *parser;
+	struct message_block block;
+	struct message_part *parts;
+	struct istream *input;
+
+	input = i_stream_create_from_buffer(mail->data);
+	i_stream_set_max_buffer_size(input, BENCH_BLOCK_SIZE);
+	parser = message_parser_init(pool, input, &parser_set);
+	while (message_parser_parse_next_block(parser, &block) > 0) ;
+	message_parser_deinit(&parser, &parts);
+	i_stream_unref(&input);
+	return mail->data->used;
+}
+
+static size_t bench_header_decode(const struct bench_mail *mail, pool_t pool)
+{
+	struct message_header_parser_ctx *hdr_ctx;
+	struct message_header_line *hdr;
+	struct message_size hdr_size;
+	struct istream *input;
+	string_t *str;
+
+	str = str_new(pool, 256);
+	input = i_stream_create_from_buffer(mail->data);
+	hdr_ctx = message_parse_header_init(input, &hdr_size, 0);
+	while (message_parse_header_next(hdr_ctx, &hdr) > 0) {
+		if (hdr->eoh)
+			continue;
+		if (hdr->continues) {
+			hdr->use_full_value = TRUE;
+			continue;
+		}
+		str_truncate(str, 0);
+		message_header_decode_utf8(hdr->full_value, hdr->full_value_len,
+					   str, NULL);
+	}
+	message_parse_header_deinit(&hdr_ctx);
+	i_stream_unref(&input);
+	return hdr_size.physical_size;
+}
+
+static size_t bench_decoder(const struct bench_mail *mail, pool_t pool)
+{
+	struct message_parser_settings parser_set = { .flags = 0 };
+	struct message_decoder_context *decoder;
+	struct message_parser_ctx *parser;
+	struct message_block block, decoded;
+	struct message_part *parts;
+	struct istream *input;
+
+	input = i_stream_create_from_buffer(mail->data);
+	i_stream_set_max_buffer_size(input, BENCH_BLOCK_SIZE);
+	parser = message_parser_init(pool, input, &parser_set);
+	decoder = message_decoder_init(NULL, 0);
+	while (message_parser_parse_next_block(parser, &block) > 0)
+		(void)message_decoder_decode_next_block(decoder, &block,
+							&decoded);
+	message_decoder_deinit(&decoder);
+	message_parser_deinit(&parser, &parts);
+	i_stream_unref(&input);
+	return mail->data->used;
+}
+
+static size_t bench_bodystructure(const struct bench_mail *mail, pool_t pool)
+{
+	struct message_parser_settings parser_set = {
+		.hdr_flags = MESSAGE_HEADER_PARSER_FLAG_SKIP_INITIAL_LWSP |
+			MESSAGE_HEADER_PARSER_FLAG_DROP_CR,
+		.flags = MESSAGE_PARSER_FLAG_SKIP_BODY_BLOCK,
+	};
+	struct message_parser_ctx *parser;
+	struct message_block block;
+	struct message_part *parts;
+	struct istream *input;
+
+	input = i_stream_create_from_buffer(mail->data);
+	i_stream_set_max_buffer_size(input, BENCH_BLOCK_SIZE);
+	parser = message_parser_init(pool, input, &parser_set);
+	while (message_parser_parse_next_block(parser, &block) > 0)
+		message_part_data_parse_from_header(pool, block.part, block.hdr);
+	message_parser_deinit(&parser, &parts);
+	i_stream_unref(&input);
+	return mail->data->used;
+}
+
+static size_t bench_snippet(const struct bench_mail *mail, pool_t pool)
+{
+	struct istream *input;
+	string_t *snippet;
+
+	snippet = str_new(pool, 256);
+	input = i_stream_create_from_buffer(mail->data);
+	i_stream_set_max_buffer_size(input, BENCH_BLOCK_SIZE);
+	if (message_snippet_generate(input, BENCH_SNIPPET_MAX_CHARS,
+				     snippet) < 0)
+		i_unreached();
+	i_stream_unref(&input);
+	return mail->data->used;
+}
+
+static size_t bench_html2text(const struct bench_mail *mail, pool_t pool)
+{
+	struct mail_html2text *ht;
+	buffer_t *output;
+	size_t pos, size;
+
+	if (mail->html->used == 0)
+		return 0;
+
+	output = buffer_create_dynamic(pool, BENCH_BLOCK_SIZE);
+	ht = mail_html2text_init(0);
+	for (pos = 0; pos < mail->html->used; pos += size) {
+		size = I_MIN(mail->html->used - pos, BENCH_BLOCK_SIZE);
+		mail_html2text_more(ht, CONST_PTR_OFFSET(mail->html->data, pos),
+				    size, output);
+		buffer_set_used_size(output, 0);
+	}
+	mail_html2text_deinit(&ht);
+	return mail->html->used;
+}
+
+static const struct bench benches[] = {
+	{ "message-parser", bench_message_parser },
+	{ "header-decode", bench_header_decode },
+	{ "decoder", bench_decoder },
+	{ "bodystructure", bench_bodystructure },
+	{ "snippet", bench_snippet },
+	{ "html2text", bench_html2text },
+};
+
+static void bench_run(const struct bench *bench, unsigned int rounds)
+{
+	const struct bench_mail *mail;
+	struct bench_pool bpool;
+	uint64_t ts_0, nsecs = 0, alloc_count = 0, alloc_bytes = 0;
+	uint64_t total_size = 0;
+	unsigned int round, mail_count = 0;
+
+	for (round = 0; round < rounds; round++) {
+		array_foreach(&bench_mails, mail) {
+			bench_pool_init(&bpool);
+			T_BEGIN {
+				ts_0 = i_nanoseconds();
+				total_size += bench->run(mail, &bpool.pool);
+				nsecs += i_nanoseconds() - ts_0;
+			} T_END;
+			alloc_count += bpool.alloc_count;
+			alloc_bytes += bpool.alloc_bytes;
+			mail_count++;
+			bench_pool_deinit(&bpool);
+		}
+	}
+	printf("\t%-16s %8.02lf MB/s %8.01lf allocs/mail %8.01lf kB/mail\n",
+	       bench->name,
+	       nsecs == 0 ? 0 : (double)total_size * 1000 / (double)nsecs,
+	       (double)alloc_count / mail_count,
+	       (double)alloc_bytes / 1024 / mail_count);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-r rounds] <mbox file|maildir|file>...\n",
+		prog);
+	lib_exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_mail *mail;
+	uint64_t total_size = 0, html_size = 0;
+	unsigned int i, rounds = 5;
+	int c;
+
+	lib_init();
+
+	while ((c = getopt(argc, argv, "r:")) > 0) {
+		switch (c) {
+		case 'r':
+			if (str_to_uint(optarg, &rounds) < 0 || rounds == 0)
+				print_usage(argv[0]);
+			break;
+		default:
+			print_usage(argv[0]);
+		}
+	}
+	if (optind == argc)
+		print_usage(argv[0]);
+
+	i_array_init(&bench_mails, 1024);
+	for (; optind < argc; optind++)
+		bench_load(argv[optind]);
+	if (array_count(&bench_mails) == 0)
+		i_fatal("No mails found");
+
+	array_foreach_modifiable(&bench_mails, mail) {
+		total_size += mail->data->used;
+		html_size += mail->html->used;
+	}
+	printf("%u mails, %"PRIu64" kB of data (%"PRIu64" kB HTML), "
+	       "%u rounds\n", array_count(&bench_mails), total_size / 1024,
+	       html_size / 1024, rounds);
+	for (i = 0; i < N_ELEMENTS(benches); i++)
+		bench_run(&benches[i], rounds);
+
+	array_foreach_modifiable(&bench_mails, mail) {
+		buffer_free(&mail->data);
+		buffer_free(&mail->html);
+	}
+	array_free(&bench_mails);
+	lib_deinit();
+	return 0;
+}
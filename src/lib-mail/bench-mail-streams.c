@@ -0,0 +1,175 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "buffer.h"
+#include "str.h"
+#include "istream.h"
+#include "istream-crlf.h"
+#include "istream-nonuls.h"
+#include "istream-dot.h"
+#include "ostream.h"
+#include "ostream-dot.h"
+#include "time-util.h"
+#include "strnum.h"
+
+#include <stdio.h>
+
+/**
+ * Measures the throughput of the streams that process every byte of mails
+ * as they're delivered or fetched: CRLF/LF conversion, NUL filtering and
+ * SMTP/LMTP dot-stuffing in both directions. The input is generated to look
+ * like a mail body with lines of varying length, some of them beginning
+ * with a dot.
+ */
+
+#define BENCH_BLOCK_SIZE 8192
+
+static void
+bench_print(const char *name, uint64_t nsecs, size_t size)
+{
+	printf("\t%-12s %8.02lf MB/s\n", name,
+	       (double)size * 1000 / (double)nsecs);
+}
+
+static void bench_generate(string_t *str, size_t size, bool crlf)
+{
+	unsigned int i, line_len;
+
+	while (str_len(str) < size) {
+		line_len = i_rand_limit(100);
+		if (i_rand_limit(20) == 0)
+			str_append_c(str, '.');
+		for (i = 0; i < line_len; i++)
+			str_append_c(str, 'a' + i_rand_limit(26));
+		if (crlf)
+			str_append_c(str, '\r');
+		str_append_c(str, '\n');
+	}
+}
+
+static uint64_t
+bench_istream_read(struct istream *input, size_t expected_min_size)
+{
+	const unsigned char *data;
+	size_t size, total_size = 0;
+	uint64_t ts_0;
+
+	ts_0 = i_nanoseconds();
+	while (i_stream_read_more(input, &data, &size) > 0) {
+		total_size += size;
+		i_stream_skip(input, size);
+	}
+	i_assert(input->stream_errno == 0);
+	i_assert(total_size >= expected_min_size);
+	return i_nanoseconds() - ts_0;
+}
+
+static void
+bench_istream(const char *name, const string_t *str, unsigned int rounds,
+	      struct istream *(*create)(struct istream *input))
+{
+	struct istream *data_input, *input;
+	uint64_t nsecs = 0;
+	unsigned int round;
+
+	for (round = 0; round < rounds; round++) {
+		data_input = i_stream_create_from_data(str_data(str),
+						       str_len(str));
+		i_stream_set_max_buffer_size(data_input, BENCH_BLOCK_SIZE);
+		input = create(data_input);
+		i_stream_unref(&data_input);
+		nsecs += bench_istream_read(input, str_len(str) / 2);
+		i_stream_unref(&input);
+	}
+	bench_print(name, nsecs, str_len(str) * rounds);
+}
+
+static struct istream *bench_create_nonuls(struct istream *input)
+{
+	return i_stream_create_nonuls(input, '?');
+}
+
+static struct istream *bench_create_dot(struct istream *input)
+{
+	return i_stream_create_dot(input, TRUE);
+}
+
+static void
+bench_ostream_dot(const string_t *str, unsigned int rounds)
+{
+	struct ostream *buf_output, *output;
+	buffer_t *buf;
+	uint64_t ts_0, nsecs = 0;
+	unsigned int round;
+	size_t pos, size;
+
+	buf = buffer_create_dynamic(default_pool, str_len(str) * 2);
+	for (round = 0; round < rounds; round++) {
+		buffer_set_used_size(buf, 0);
+		buf_output = o_stream_create_buffer(buf);
+		output = o_stream_create_dot(buf_output, FALSE);
+
+		ts_0 = i_nanoseconds();
+		for (pos = 0; pos < str_len(str); pos += size) {
+			size = I_MIN(str_len(str) - pos, BENCH_BLOCK_SIZE);
+			o_stream_nsend(output, str_data(str) + pos, size);
+		}
+		i_assert(o_stream_finish(output) > 0);
+		nsecs += i_nanoseconds() - ts_0;
+
+		o_stream_unref(&output);
+		o_stream_unref(&buf_output);
+	}
+	bench_print("ostream-dot", nsecs, str_len(str) * rounds);
+	buffer_free(&buf);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [size_mb [rounds]]\n", prog);
+	fprintf(stderr, "Runs 5 rounds with 16 MB of data if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	unsigned int size_mb = 16, rounds = 5;
+	string_t *lf_str, *crlf_str, *dot_str;
+
+	lib_init();
+
+	if (argc > 3)
+		print_usage(argv[0]);
+	if (argc >= 2 && (str_to_uint(argv[1], &size_mb) < 0 || size_mb == 0))
+		print_usage(argv[0]);
+	if (argc >= 3 && (str_to_uint(argv[2], &rounds) < 0 || rounds == 0))
+		print_usage(argv[0]);
+
+	lf_str = str_new(default_pool, size_mb * 1024 * 1024 + 128);
+	bench_generate(lf_str, size_mb * 1024 * 1024, FALSE);
+	crlf_str = str_new(default_pool, size_mb * 1024 * 1024 + 128);
+	bench_generate(crlf_str, size_mb * 1024 * 1024, TRUE);
+
+	/* dot-stuffed input for istream-dot */
+	dot_str = str_new(default_pool, str_len(crlf_str) * 2);
+	struct ostream *output = o_stream_create_buffer(dot_str);
+	struct ostream *dot_output = o_stream_create_dot(output, FALSE);
+	o_stream_nsend(dot_output, str_data(crlf_str), str_len(crlf_str));
+	i_assert(o_stream_finish(dot_output) > 0);
+	o_stream_unref(&dot_output);
+	o_stream_unref(&output);
+
+	printf("%u MB of data in %u byte blocks, %u rounds\n",
+	       size_mb, BENCH_BLOCK_SIZE, rounds);
+	bench_istream("istream-crlf", lf_str, rounds, i_stream_create_crlf);
+	bench_istream("istream-lf", crlf_str, rounds, i_stream_create_lf);
+	bench_istream("nonuls", crlf_str, rounds, bench_create_nonuls);
+	bench_istream("istream-dot", dot_str, rounds, bench_create_dot);
+	bench_ostream_dot(crlf_str, rounds);
+
+	str_free(&lf_str);
+	str_free(&crlf_str);
+	str_free(&dot_str);
+	lib_deinit();
+	return 0;
+}
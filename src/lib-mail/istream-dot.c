@@ -112,7 +112,7 @@ static ssize_t i_stream_dot_read(struct istream_private *stream)
 	/* @UNSAFE */
 	struct dot_istream *dstream = (struct dot_istream *)stream;
 	const unsigned char *data;
-	size_t i, dest, size, avail;
+	size_t i, dest, size, avail, copy_len;
 	ssize_t ret, ret1;
 
 	if (dstream->pending[0] != '\0') {
@@ -202,7 +202,15 @@ static ssize_t i_stream_dot_read(struct istream_private *stream)
 				dstream->state = 2;
 				dstream->state_no_cr = TRUE;
 			} else {
-				stream->w_buffer[dest++] = data[i];
+				/* copy everything until the next CR or LF */
+				copy_len = i_memcspn(data + i,
+					I_MIN(size - i, stream->buffer_size - dest),
+					"\r\n", 2);
+				i_assert(copy_len > 0);
+				memcpy(stream->w_buffer + dest, data + i,
+				       copy_len);
+				dest += copy_len;
+				i += copy_len - 1;
 			}
 		}
 	}
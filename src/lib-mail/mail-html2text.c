@@ -176,12 +176,39 @@ static void mail_html2text_add_space(buffer_t *output)
 		buffer_append_c(output, ' ');
 }
 
+/* Returns the length of data until the first c1 or c2 character, or size if
+   neither is found. */
+static size_t
+html_span_until(const unsigned char *data, size_t size,
+		unsigned char c1, unsigned char c2)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		if (data[i] == c1 || data[i] == c2)
+			break;
+	}
+	return i;
+}
+
+static size_t html_span_until_c(const unsigned char *data, size_t size,
+				unsigned char c)
+{
+	const unsigned char *p = memchr(data, c, size);
+
+	return p == NULL ? size : (size_t)(p - data);
+}
+
 static size_t
 parse_data(struct mail_html2text *ht,
 	   const unsigned char *data, size_t size, buffer_t *output)
 {
-	size_t i, ret;
+	size_t i, ret, len;
 
+	/* The text between the interesting characters of each state is
+	   copied or skipped in one go, rather than going through the state
+	   machine character by character. In the loop "i += len - 1" moves
+	   i to the last character of the span. */
 	for (i = 0; i < size; i++) {
 		unsigned char c = data[i];
 
@@ -194,14 +221,17 @@ parse_data(struct mail_html2text *ht,
 				i += ret - 1;
 			} else if (ht->quote_level > 0 &&
 				   (ht->flags & MAIL_HTML2TEXT_FLAG_SKIP_QUOTED) != 0) {
-					break;
+				len = html_span_until_c(data+i, size-i, '<');
+				i += len - 1;
 			} else if (c == '&') {
 				ret = parse_entity(data+i+1, size-i-1, output);
 				if (ret == 0)
 					return i;
 				i += ret - 1;
 			} else {
-				buffer_append_c(output, c);
+				len = html_span_until(data+i, size-i, '<', '&');
+				buffer_append(output, data+i, len);
+				i += len - 1;
 			}
 			break;
 		case HTML_STATE_TAG:
@@ -219,6 +249,14 @@ parse_data(struct mail_html2text *ht,
 				}
 				ht->add_newline = FALSE;
 				mail_html2text_add_space(output);
+			} else {
+				for (len = 1; i + len < size; len++) {
+					if (data[i+len] == '"' ||
+					    data[i+len] == '\'' ||
+					    data[i+len] == '>')
+						break;
+				}
+				i += len - 1;
 			}
 			break;
 		case HTML_STATE_TAG_DQUOTED:
@@ -226,6 +264,10 @@ parse_data(struct mail_html2text *ht,
 				ht->state = HTML_STATE_TAG;
 			else if (c == '\\')
 				ht->state = HTML_STATE_TAG_DQUOTED_ESCAPE;
+			else {
+				len = html_span_until(data+i, size-i, '"', '\\');
+				i += len - 1;
+			}
 			break;
 		case HTML_STATE_TAG_DQUOTED_ESCAPE:
 			ht->state = HTML_STATE_TAG_DQUOTED;
@@ -235,6 +277,10 @@ parse_data(struct mail_html2text *ht,
 				ht->state = HTML_STATE_TAG;
 			else if (c == '\\')
 				ht->state = HTML_STATE_TAG_SQUOTED_ESCAPE;
+			else {
+				len = html_span_until(data+i, size-i, '\'', '\\');
+				i += len - 1;
+			}
 			break;
 		case HTML_STATE_TAG_SQUOTED_ESCAPE:
 			ht->state = HTML_STATE_TAG_SQUOTED;
@@ -247,6 +293,9 @@ parse_data(struct mail_html2text *ht,
 					ht->state = HTML_STATE_COMMENT_END;
 					i++;
 				}
+			} else {
+				len = html_span_until_c(data+i, size-i, '-');
+				i += len - 1;
 			}
 			break;
 		case HTML_STATE_COMMENT_END:
@@ -266,6 +315,9 @@ parse_data(struct mail_html2text *ht,
 					ht->state = HTML_STATE_TEXT;
 					i += 8;
 				}
+			} else {
+				len = html_span_until_c(data+i, size-i, '<');
+				i += len - 1;
 			}
 			break;
 		case HTML_STATE_STYLE:
@@ -279,6 +331,9 @@ parse_data(struct mail_html2text *ht,
 					ht->state = HTML_STATE_TEXT;
 					i += 7;
 				}
+			} else {
+				len = html_span_until_c(data+i, size-i, '<');
+				i += len - 1;
 			}
 			break;
 		case HTML_STATE_CDATA:
@@ -293,9 +348,13 @@ parse_data(struct mail_html2text *ht,
 					break;
 				}
 			}
+			/* ']' that didn't end the CDATA is copied alone */
+			len = c == ']' ? 1 :
+				html_span_until_c(data+i, size-i, ']');
 			if (ht->quote_level == 0 ||
 			    (ht->flags & MAIL_HTML2TEXT_FLAG_SKIP_QUOTED) == 0)
-				buffer_append_c(output, c);
+				buffer_append(output, data+i, len);
+			i += len - 1;
 			break;
 		}
 	}
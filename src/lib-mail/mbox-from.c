@@ -51,6 +51,47 @@ static int mbox_parse_year(const unsigned char *msg, struct tm *tm)
 	return 0;
 }
 
+static time_t mbox_from_mktime_local(struct tm *tm, int *tz_offset_r)
+{
+	static bool last_offset_set = FALSE;
+	static int last_offset;
+	struct tm ltm;
+	time_t t;
+
+	/* mktime() calls tzset(), which with glibc stat()s /etc/localtime
+	   every time when TZ isn't set. That's a syscall for every message
+	   in mbox parsing. Most mails have the same UTC offset as the
+	   previous one, so first try whether it gives the wanted local time.
+	   localtime_r() isn't required to call tzset(). */
+	if (last_offset_set) {
+		t = utc_mktime(tm);
+		if (t != (time_t)-1) {
+			t -= last_offset*60;
+			if (localtime_r(&t, &ltm) != NULL &&
+			    ltm.tm_sec == tm->tm_sec &&
+			    ltm.tm_min == tm->tm_min &&
+			    ltm.tm_hour == tm->tm_hour &&
+			    ltm.tm_mday == tm->tm_mday &&
+			    ltm.tm_mon == tm->tm_mon &&
+			    ltm.tm_year == tm->tm_year &&
+			    utc_offset(&ltm, t) == last_offset) {
+				*tz_offset_r = last_offset;
+				return t;
+			}
+		}
+	}
+
+	t = mktime(tm);
+	if (localtime_r(&t, &ltm) == NULL)
+		*tz_offset_r = 0;
+	else {
+		*tz_offset_r = utc_offset(&ltm, t);
+		last_offset = *tz_offset_r;
+		last_offset_set = TRUE;
+	}
+	return t;
+}
+
 int mbox_from_parse(const unsigned char *msg, size_t size,
 		    time_t *time_r, int *tz_offset_r, char **sender_r)
 {
@@ -238,8 +279,7 @@ int mbox_from_parse(const unsigned char *msg, size_t size,
 		*tz_offset_r = timezone_secs/60;
 	} else {
 		/* assume local timezone */
-		*time_r = mktime(&tm);
-		*tz_offset_r = utc_offset(localtime(time_r), *time_r);
+		*time_r = mbox_from_mktime_local(&tm, tz_offset_r);
 	}
 
 	*sender_r = i_strdup_until(msg_start, sender_end);
@@ -191,14 +191,18 @@ int message_parse_header_next(struct message_header_parser_ctx *ctx,
 			i = startpos;
 		}
 
-		/* find '\n' */
-		for (; i < parse_size; i++) {
-			if (msg[i] <= '\n') {
-				if (msg[i] == '\n')
-					break;
-				if (msg[i] == '\0')
-					ctx->has_nuls = TRUE;
-			}
+		/* find '\n' - memchr() is usually vectorized, so it's much
+		   faster than checking each byte with long header values. */
+		if (i < parse_size) {
+			const unsigned char *p =
+				memchr(msg + i, '\n', parse_size - i);
+			size_t end = p == NULL ? parse_size :
+				(size_t)(p - msg);
+
+			if (!ctx->has_nuls &&
+			    memchr(msg + i, '\0', end - i) != NULL)
+				ctx->has_nuls = TRUE;
+			i = end;
 		}
 
 		if (i < parse_size && i+1 == size && ret == -2) {
@@ -28,10 +28,18 @@
 
 */
 
+/* The smallest possible serialized non-root part: flags, physical_pos and
+   the four sizes. The root part doesn't have physical_pos. */
+#define MESSAGE_PART_SERIALIZED_MIN_SIZE \
+	(sizeof(enum message_part_flags) + sizeof(uoff_t) * 5)
+
 struct deserialize_context {
-	pool_t pool;
 	const unsigned char *data, *end;
 
+	/* all parts are allocated with a single allocation */
+	struct message_part *parts;
+	unsigned int parts_count, parts_used;
+
 	uoff_t pos;
 	const char *error;
 };
@@ -120,8 +128,8 @@ message_part_deserialize_part(struct deserialize_context *ctx,
 			      unsigned int siblings,
 			      struct message_part **part_r)
 {
-	struct message_part *p, *part, *first_part, **next_part;
-	unsigned int children_count;
+	struct message_part *part, *first_part, **next_part;
+	unsigned int children_count, first_child_idx;
 	uoff_t pos;
 	bool root = parent == NULL;
 
@@ -130,10 +138,13 @@ message_part_deserialize_part(struct deserialize_context *ctx,
 	while (siblings > 0) {
 		siblings--;
 
-		part = p_new(ctx->pool, struct message_part, 1);
+		if (ctx->parts_used == ctx->parts_count) {
+			/* can't happen unless the size calculation is wrong */
+			ctx->error = "Too many parts";
+			return FALSE;
+		}
+		part = &ctx->parts[ctx->parts_used++];
 		part->parent = parent;
-		for (p = parent; p != NULL; p = p->parent)
-			p->children_count++;
 
 		if (!read_next(ctx, &part->flags, sizeof(part->flags)))
 			return FALSE;
@@ -216,10 +227,13 @@ message_part_deserialize_part(struct deserialize_context *ctx,
 				part->header_size.physical_size;
 			pos = ctx->pos + part->body_size.physical_size;
 
+			first_child_idx = ctx->parts_used;
 			if (!message_part_deserialize_part(ctx, part,
 							   children_count,
 							   &part->children))
 				return FALSE;
+			/* children_count includes all the descendants */
+			part->children_count = ctx->parts_used - first_child_idx;
 
 			if (ctx->pos > pos) {
 				ctx->error =
@@ -248,9 +262,12 @@ message_part_deserialize(pool_t pool, const void *data, size_t size,
         struct message_part *part;
 
 	i_zero(&ctx);
-	ctx.pool = pool;
 	ctx.data = data;
 	ctx.end = ctx.data + size;
+	/* upper bound for the number of parts. +1 is for the root part, which
+	   is smaller than the minimum size. */
+	ctx.parts_count = size / MESSAGE_PART_SERIALIZED_MIN_SIZE + 1;
+	ctx.parts = p_new(pool, struct message_part, ctx.parts_count);
 
 	if (!message_part_deserialize_part(&ctx, NULL, 1, &part)) {
 		*error_r = ctx.error;
@@ -108,6 +108,16 @@ o_stream_dot_sendv(struct ostream_private *stream,
 		for (; p < pend && (size_t)(p-data)+2 < max_bytes; p++) {
 			char add = 0;
 
+			if (dstream->state == STREAM_STATE_NONE &&
+			    *p != '\r' && *p != '\n') {
+				/* skip to the next CR or LF, but no further
+				   than the loop would go */
+				p += i_memcspn(p, I_MIN((size_t)(pend - p),
+					max_bytes - 2 - (size_t)(p - data)),
+					"\r\n", 2) - 1;
+				continue;
+			}
+
 			switch (dstream->state) {
 			/* none */
 			case STREAM_STATE_NONE:
@@ -48,6 +48,18 @@ void qp_decoder_deinit(struct qp_decoder **_qp)
 	i_free(qp);
 }
 
+static int qp_hex_value(unsigned char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	/* lowercase hex isn't strictly valid, but allow */
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
 static size_t
 qp_decoder_more_text(struct qp_decoder *qp, const unsigned char *src,
 		     size_t src_size)
@@ -61,6 +73,22 @@ qp_decoder_more_text(struct qp_decoder *qp, const unsigned char *src,
 		}
 		switch (src[i]) {
 		case '=':
+			if (i + 2 < src_size) {
+				int hi = qp_hex_value(src[i+1]);
+				int lo = qp_hex_value(src[i+2]);
+
+				if (hi >= 0 && lo >= 0) {
+					/* decode =XX directly without going
+					   through the state machine */
+					buffer_append(qp->dest, src+start,
+						      i-start);
+					buffer_append_c(qp->dest,
+							(hi << 4) | lo);
+					i += 2;
+					start = i+1;
+					continue;
+				}
+			}
 			qp->state = STATE_EQUALS;
 			break;
 		case '\r':
@@ -1,6 +1,7 @@
 /* Copyright (c) 2009-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "env-util.h"
 #include "utc-offset.h"
 #include "mbox-from.h"
 #include "test-common.h"
@@ -81,6 +82,63 @@ static void test_mbox_from_parse(void)
 	}
 }
 
+static void test_mbox_from_parse_local_dst(void)
+{
+	static const struct {
+		const char *from;
+		int mon, mday, hour, min, sec;
+	} tests[] = {
+		/* around DST start (03:00 -> 04:00) */
+		{ "user Sun Mar 29 01:30:00 2009", 2, 29, 1, 30, 0 },
+		{ "user Sun Mar 29 02:59:59 2009", 2, 29, 2, 59, 59 },
+		{ "user Sun Mar 29 03:30:00 2009", 2, 29, 3, 30, 0 },
+		{ "user Sun Mar 29 04:00:00 2009", 2, 29, 4, 0, 0 },
+		{ "user Sun Mar 29 05:30:00 2009", 2, 29, 5, 30, 0 },
+		/* around DST end (04:00 -> 03:00) */
+		{ "user Sun Oct 25 02:59:59 2009", 9, 25, 2, 59, 59 },
+		{ "user Sun Oct 25 04:00:00 2009", 9, 25, 4, 0, 0 },
+		{ "user Sun Oct 25 05:00:00 2009", 9, 25, 5, 0, 0 },
+		{ "user Tue Dec  1 12:00:00 2009", 11, 1, 12, 0, 0 },
+		{ "user Mon Jun  1 12:00:00 2009", 5, 1, 12, 0, 0 },
+		{ "user Tue Dec  1 12:00:00 2009", 11, 1, 12, 0, 0 },
+	};
+	char *old_tz = i_strdup(getenv("TZ"));
+	unsigned int i;
+	struct tm tm;
+	char *sender;
+	time_t t, t2;
+	int tz;
+
+	test_begin("mbox_from_parse() local time across DST");
+	env_put("TZ", "EET-2EEST,M3.5.0/3,M10.5.0/4");
+	tzset();
+	for (i = 0; i < N_ELEMENTS(tests); i++) {
+		test_assert_idx(mbox_from_parse(
+			(const unsigned char *)tests[i].from,
+			strlen(tests[i].from), &t, &tz, &sender) == 0, i);
+		i_free(sender);
+
+		i_zero(&tm);
+		tm.tm_year = 2009 - 1900;
+		tm.tm_mon = tests[i].mon;
+		tm.tm_mday = tests[i].mday;
+		tm.tm_hour = tests[i].hour;
+		tm.tm_min = tests[i].min;
+		tm.tm_sec = tests[i].sec;
+		tm.tm_isdst = -1;
+		t2 = mktime(&tm);
+		test_assert_idx(t == t2, i);
+		test_assert_idx(tz == utc_offset(localtime(&t2), t2), i);
+	}
+	if (old_tz == NULL)
+		env_remove("TZ");
+	else
+		env_put("TZ", old_tz);
+	tzset();
+	i_free(old_tz);
+	test_end();
+}
+
 static void test_mbox_from_create(void)
 {
 	time_t t = 1234567890;
@@ -97,6 +155,7 @@ int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_mbox_from_parse,
+		test_mbox_from_parse_local_dst,
 		test_mbox_from_create,
 		NULL
 	};
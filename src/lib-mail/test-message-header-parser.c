@@ -412,7 +412,7 @@ static void test_message_header_parser_no_eoh(void)
 
 static void test_message_header_parser_nul(void)
 {
-	static const unsigned char str[] = "a :\0\0b\n";
+	static const unsigned char str[] = "x: y\na :\0\0b\n";
 	struct message_header_parser_ctx *parser;
 	struct message_header_line *hdr;
 	struct istream *input;
@@ -421,8 +421,12 @@ static void test_message_header_parser_nul(void)
 
 	input = test_istream_create_data(str, sizeof(str)-1);
 	parser = message_parse_header_init(input, NULL, 0);
+	test_assert(message_parse_header_next(parser, &hdr) > 0 &&
+		    strcmp(hdr->name, "x") == 0);
+	test_assert(!message_parse_header_has_nuls(parser));
 	test_assert(message_parse_header_next(parser, &hdr) > 0 &&
 		    strcmp(hdr->name, "a") == 0);
+	test_assert(message_parse_header_has_nuls(parser));
 	test_assert(hdr->value_len >= 3 && memcmp("\0\0b", hdr->value, 3) == 0);
 	test_assert_strcmp(message_header_strdup(pool_datastack_create(),
 						 hdr->value, hdr->value_len),
@@ -2,10 +2,12 @@
 
 #include "lib.h"
 #include "buffer.h"
+#include "ioloop.h"
 #include "str.h"
 #include "istream.h"
 #include "ostream.h"
 #include "ostream-dot.h"
+#include "istream-dot.h"
 #include "test-common.h"
 
 struct dot_test {
@@ -92,11 +94,106 @@ static void test_ostream_dot_parent_almost_full(void)
 	test_end();
 }
 
+static void
+test_ostream_dot_random_generate(string_t *input, string_t *expected)
+{
+	static const char chars[] = "ab.";
+	unsigned int i, j, line_count, line_len;
+	char c;
+
+	line_count = i_rand_minmax(1, 50);
+	for (i = 0; i < line_count; i++) {
+		if (i_rand_limit(3) == 0) {
+			str_append_c(input, '.');
+			str_append_c(expected, '.');
+		}
+		line_len = i_rand_limit(100);
+		for (j = 0; j < line_len; j++) {
+			c = chars[i_rand_limit(sizeof(chars) - 1)];
+			str_append_c(input, c);
+			str_append_c(expected, c);
+		}
+		if (i_rand_limit(2) == 0)
+			str_append(input, "\r\n");
+		else
+			str_append_c(input, '\n');
+		str_append(expected, "\r\n");
+	}
+}
+
+static void test_ostream_dot_random(void)
+{
+	struct ostream *test_output, *output;
+	struct istream *input, *dot_input;
+	struct ioloop *ioloop;
+	buffer_t *output_data;
+	string_t *input_str, *expected, *result;
+	const unsigned char *data;
+	size_t pos, size, max_size;
+	unsigned int n;
+	ssize_t ret;
+
+	test_begin("dot ostream random");
+	/* test ostream adds a timeout when it's flushed partially */
+	ioloop = io_loop_create();
+	for (n = 0; n < 500; n++) T_BEGIN {
+		input_str = t_str_new(1024);
+		expected = t_str_new(1024);
+		test_ostream_dot_random_generate(input_str, expected);
+
+		output_data = t_buffer_create(1024);
+		test_output = test_ostream_create_nonblocking(output_data,
+			i_rand_minmax(3, 64));
+		max_size = 0;
+		test_ostream_set_max_output_size(test_output, max_size);
+		output = o_stream_create_dot(test_output, FALSE);
+		for (pos = 0; pos < str_len(input_str); ) {
+			size = i_rand_minmax(1, 200);
+			size = I_MIN(str_len(input_str) - pos, size);
+			ret = o_stream_send(output, str_data(input_str) + pos,
+					    size);
+			test_assert(ret >= 0);
+			if (ret < 0)
+				break;
+			pos += ret;
+			if (ret == 0) {
+				max_size += i_rand_minmax(1, 100);
+				test_ostream_set_max_output_size(test_output,
+								 max_size);
+				test_assert(o_stream_flush(output) >= 0);
+			}
+		}
+		test_ostream_set_max_output_size(test_output, SIZE_MAX);
+		test_assert(o_stream_finish(output) > 0);
+		test_assert(output->offset == str_len(input_str));
+		o_stream_unref(&output);
+		o_stream_unref(&test_output);
+
+		/* read it back with a small buffer */
+		result = t_str_new(1024);
+		input = i_stream_create_from_data(output_data->data,
+						  output_data->used);
+		dot_input = i_stream_create_dot(input, TRUE);
+		i_stream_set_max_buffer_size(dot_input, i_rand_minmax(1, 64));
+		while (i_stream_read_more(dot_input, &data, &size) > 0) {
+			str_append_data(result, data, size);
+			i_stream_skip(dot_input, size);
+		}
+		test_assert(dot_input->stream_errno == 0);
+		test_assert_idx(str_equals(result, expected), n);
+		i_stream_unref(&dot_input);
+		i_stream_unref(&input);
+	} T_END;
+	io_loop_destroy(&ioloop);
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_ostream_dot,
 		test_ostream_dot_parent_almost_full,
+		test_ostream_dot_random,
 		NULL
 	};
 	return test_run(test_functions);
@@ -63,6 +63,11 @@ enum master_login_state {
    in seconds. */
 #define MASTER_SERVICE_IDLE_KILL_ENV "IDLE_KILL"
 
+/* getenv(MASTER_SERVICE_RESTART_RSS_LIMIT_ENV) specifies the RSS in bytes
+   after which the process stops accepting new connections and exits once its
+   current connections have finished. */
+#define MASTER_SERVICE_RESTART_RSS_LIMIT_ENV "RESTART_RSS_LIMIT"
+
 /* getenv(MASTER_CONFIG_FILE_ENV) provides path to configuration file/socket */
 #define MASTER_CONFIG_FILE_ENV "CONFIG_FILE"
 
@@ -87,7 +92,8 @@ enum master_login_state {
 #define DOVECOT_LOG_DEBUG_ENV "LOG_DEBUG"
 
 /* getenv(DOVECOT_CONFIG_FD_ENV) returns the configuration fd provided by
-   doveconf. */
+   doveconf, or MASTER_CONFIG_FD if master passed its already read
+   configuration to the process. */
 #define DOVECOT_CONFIG_FD_ENV "DOVECOT_CONFIG_FD"
 
 /* getenv(DOVECOT_STATS_WRITER_SOCKET_PATH) returns path to the stats-writer
@@ -13,6 +13,7 @@
 #define PP2_TYPE_AUTHORITY      0x02
 #define PP2_TYPE_CRC32C         0x03
 #define PP2_TYPE_NOOP           0x04
+#define PP2_TYPE_UNIQUE_ID      0x05
 #define PP2_TYPE_SSL            0x20
 #define PP2_SUBTYPE_SSL_VERSION 0x21
 #define PP2_SUBTYPE_SSL_CN      0x22
@@ -110,7 +111,7 @@ struct master_service_haproxy_conn {
 };
 
 static void
-master_service_haproxy_conn_free(struct master_service_haproxy_conn *hpconn)
+master_service_haproxy_conn_detach(struct master_service_haproxy_conn *hpconn)
 {
 	struct master_service *service = hpconn->service;
 
@@ -118,6 +119,12 @@ master_service_haproxy_conn_free(struct master_service_haproxy_conn *hpconn)
 
 	io_remove(&hpconn->io);
 	timeout_remove(&hpconn->to);
+}
+
+static void
+master_service_haproxy_conn_free(struct master_service_haproxy_conn *hpconn)
+{
+	master_service_haproxy_conn_detach(hpconn);
 	event_unref(&hpconn->event);
 	pool_unref(&hpconn->pool);
 }
@@ -137,9 +144,14 @@ master_service_haproxy_conn_success(struct master_service_haproxy_conn *hpconn)
 {
 	struct master_service *service = hpconn->service;
 	struct master_service_connection conn = hpconn->conn;
+	pool_t pool = hpconn->pool;
 
-	master_service_haproxy_conn_free(hpconn);
+	/* the haproxy strings are allocated from the pool, so keep it until
+	   the callback has copied them */
+	master_service_haproxy_conn_detach(hpconn);
+	event_unref(&hpconn->event);
 	master_service_client_connection_callback(service, &conn);
+	pool_unref(&pool);
 }
 
 static void
@@ -221,8 +233,15 @@ master_service_haproxy_parse_ssl_tlv(struct master_service_haproxy_conn *hpconn,
 		}
 		i += SIZEOF_PP2_TLV + kv.len;
 		switch(kv.type) {
-		/* we don't care about these */
+		case PP2_SUBTYPE_SSL_VERSION:
+			hpconn->conn.haproxy.ssl_version =
+				p_strndup(hpconn->pool, kv.data, kv.len);
+			break;
 		case PP2_SUBTYPE_SSL_CIPHER:
+			hpconn->conn.haproxy.ssl_cipher =
+				p_strndup(hpconn->pool, kv.data, kv.len);
+			break;
+		/* we don't care about these */
 		case PP2_SUBTYPE_SSL_SIG_ALG:
 		case PP2_SUBTYPE_SSL_KEY_ALG:
 			break;
@@ -262,6 +281,10 @@ master_service_haproxy_parse_tlv(struct master_service_haproxy_conn *hpconn,
                         hpconn->conn.haproxy.hostname =
 				p_strndup(hpconn->pool, kv.data, kv.len);
                         break;
+		case PP2_TYPE_UNIQUE_ID:
+			hpconn->conn.haproxy.unique_id =
+				p_strndup(hpconn->pool, kv.data, kv.len);
+			break;
                 case PP2_TYPE_SSL:
 			if (get_ssl_tlv(kv.data, kv.len, &ssl_kv) < 0) {
 				*error_r = t_strdup_printf("get_ssl_tlv(%zu) failed: "
@@ -689,6 +712,18 @@ void master_service_haproxy_new(struct master_service *service,
 	hpconn->event = event;
 	DLLIST_PREPEND(&service->haproxy_conns, hpconn);
 
+	/* The header is usually already waiting to be read, so try reading
+	   it immediately instead of waiting for the next ioloop run. */
+	int ret = master_service_haproxy_read(hpconn);
+	if (ret < 0) {
+		master_service_haproxy_conn_failure(hpconn);
+		return;
+	}
+	if (ret > 0) {
+		master_service_haproxy_conn_success(hpconn);
+		return;
+	}
+
 	hpconn->io = io_add(conn->fd, IO_READ,
 			    master_service_haproxy_input, hpconn);
 	hpconn->to = timeout_add(service->set->haproxy_timeout*1000,
@@ -16,9 +16,13 @@ struct master_service_listener {
 	/* settings */
 	bool ssl;
 	bool haproxy;
+	/* listen() backlog for a SO_REUSEPORT listener, 0 if it's not one */
+	unsigned int reuse_port_backlog;
 
 	/* state */
 	bool closed;
+	/* SO_REUSEPORT listener has left the kernel's load balancing group */
+	bool reuse_port_detached;
 	int fd;
 	struct io *io;
 };
@@ -41,6 +45,10 @@ struct master_service {
 	ARRAY_TYPE(const_string) config_overrides;
 	void *config_mmap_base;
 	size_t config_mmap_size;
+	/* Parsed config_mmap_base filters in the order they appear there,
+	   so they don't need to be parsed again for each settings lookup.
+	   NULL = not parsed yet. */
+	ARRAY(struct event_filter *) config_filters;
 	int syslog_facility;
 	data_stack_frame_t datastack_frame_id;
 
@@ -53,12 +61,17 @@ struct master_service {
 	unsigned int process_limit;
 	unsigned int process_min_avail;
 	unsigned int idle_kill_secs;
+	uoff_t restart_rss_limit;
 
 	struct master_status master_status;
 	unsigned int last_sent_status_avail_count;
 	time_t last_sent_status_time;
 	struct timeout *to_status;
 
+	/* CONNECT/DISCONNECT commands waiting to be written to anvil */
+	string_t *anvil_pending_cmds;
+	struct timeout *to_anvil_flush;
+
 	bool (*idle_die_callback)(void);
 	void (*die_callback)(void);
 	struct timeout *to_die;
@@ -100,6 +113,7 @@ struct master_service {
 	bool want_ssl_server:1;
 	bool ssl_ctx_initialized:1;
 	bool config_path_from_master:1;
+	bool config_fd_from_master:1;
 	bool log_initialized:1;
 	bool init_finished:1;
 	bool killed_signal_logged:1;
@@ -130,4 +144,6 @@ void master_service_haproxy_abort(struct master_service *service);
 
 void master_admin_clients_deinit(void);
 
+void master_service_settings_filters_free(struct master_service *service);
+
 #endif
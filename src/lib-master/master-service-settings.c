@@ -50,6 +50,8 @@ static const struct setting_define master_service_setting_defines[] = {
 	DEF(STR, syslog_facility),
 	DEF(STR, import_environment),
 	DEF(STR, stats_writer_socket_path),
+	DEF(TIME_MSECS, stats_profiler_interval),
+	DEF(TIME_MSECS, stats_profiler_report_interval),
 	DEF(SIZE, config_cache_size),
 	DEF(BOOL, version_ignore),
 	DEF(BOOL, shutdown_clients),
@@ -88,6 +90,8 @@ static const struct master_service_settings master_service_default_settings = {
 	.syslog_facility = "mail",
 	.import_environment = "TZ CORE_OUTOFMEM CORE_ERROR" ENV_SYSTEMD ENV_GDB,
 	.stats_writer_socket_path = "stats-writer",
+	.stats_profiler_interval = 0,
+	.stats_profiler_report_interval = 10*1000,
 	.config_cache_size = 1024*1024,
 	.version_ignore = FALSE,
 	.shutdown_clients = TRUE,
@@ -168,6 +172,11 @@ master_service_settings_check(void *_set, pool_t pool ATTR_UNUSED,
 				  master_service_set_process_shutdown_filter_wrapper,
 				  error_r))
 		return FALSE;
+	if (set->stats_profiler_interval > 0 &&
+	    set->stats_profiler_report_interval == 0) {
+		*error_r = "stats_profiler_report_interval must not be 0";
+		return FALSE;
+	}
 	return TRUE;
 }
 /* </settings checks> */
@@ -210,6 +219,9 @@ master_service_exec_config(struct master_service *service,
 
 	if (input->service != NULL)
 		env_put("DOVECONF_SERVICE", input->service);
+	/* doveconf gets the path with -c. Don't let the executed process
+	   think that its DOVECOT_CONFIG_FD came from master. */
+	env_remove(MASTER_CONFIG_FILE_ENV);
 
 	t_array_init(&conf_argv, 11 + (service->argc + 1) + 1);
 	strarr_push(&conf_argv, DOVECOT_CONFIG_BIN_PATH);
@@ -407,14 +419,50 @@ filter_string_parse_protocol(const char *filter_string,
 	array_push_back(protocols, &protocol);
 }
 
+void master_service_settings_filters_free(struct master_service *service)
+{
+	struct event_filter *filter;
+
+	if (!array_is_created(&service->config_filters))
+		return;
+	array_foreach_elem(&service->config_filters, filter)
+		event_filter_unref(&filter);
+	array_free(&service->config_filters);
+}
+
+static struct event_filter *
+master_service_settings_get_filter(struct master_service *service,
+				   unsigned int filter_idx,
+				   const char *filter_string,
+				   const char **error_r)
+{
+	struct event_filter **filterp;
+
+	if (!array_is_created(&service->config_filters))
+		i_array_init(&service->config_filters, 16);
+	filterp = array_idx_get_space(&service->config_filters, filter_idx);
+	if (*filterp != NULL)
+		return *filterp;
+
+	struct event_filter *filter = event_filter_create();
+	if (event_filter_parse(filter_string, filter, error_r) < 0) {
+		event_filter_unref(&filter);
+		return NULL;
+	}
+	*filterp = filter;
+	return filter;
+}
+
 static int
-master_service_settings_read_mmap(struct setting_parser_context *parser,
+master_service_settings_read_mmap(struct master_service *service,
+				  struct setting_parser_context *parser,
 				  struct event *event,
-				  const unsigned char *mmap_base,
-				  size_t mmap_size,
 				  struct master_service_settings_output *output_r,
 				  const char **error_r)
 {
+	const unsigned char *mmap_base = service->config_mmap_base;
+	size_t mmap_size = service->config_mmap_size;
+	unsigned int filter_idx = 0;
 	/*
 	   DOVECOT-CONFIG <TAB> 1.0 <LF>
 
@@ -491,20 +539,20 @@ master_service_settings_read_mmap(struct setting_parser_context *parser,
 				return -1;
 			}
 
-			struct event_filter *filter = event_filter_create();
+			struct event_filter *filter;
 			const char *error;
 			filter_string_parse_protocol(filter_string, &protocols);
-			if (event_filter_parse(filter_string, filter, &error) < 0) {
+			filter = master_service_settings_get_filter(service,
+				filter_idx++, filter_string, &error);
+			if (filter == NULL) {
 				*error_r = t_strdup_printf(
 					"Received invalid filter '%s': %s",
 					filter_string, error);
-				event_filter_unref(&filter);
 				return -1;
 			}
 			bool match = filter_string[0] == '\0' ||
 				event_filter_match(filter, event,
 						   &failure_ctx);
-			event_filter_unref(&filter);
 			if (!match) {
 				/* Filter didn't match. Jump to the next one. */
 				offset = end_offset;
@@ -558,6 +606,20 @@ int master_service_settings_read(struct master_service *service,
 	i_zero(output_r);
 	output_r->config_fd = -1;
 
+	if (service->config_fd_from_master) {
+		/* master passed its config fd. It's only valid for the first
+		   read, and only if we would have read the same config from
+		   the config socket. */
+		service->config_fd_from_master = FALSE;
+		if (service->config_path_changed_with_param ||
+		    input->config_path != NULL || input->always_exec ||
+		    input->disable_check_settings) {
+			fd = MASTER_CONFIG_FD;
+			env_remove(DOVECOT_CONFIG_FD_ENV);
+			i_close_fd(&fd);
+		}
+	}
+
 	if (service->config_mmap_base != NULL && !input->reload_config) {
 		/* config was already read once */
 	} else if ((value = getenv(DOVECOT_CONFIG_FD_ENV)) != NULL) {
@@ -582,6 +644,7 @@ int master_service_settings_read(struct master_service *service,
 			if (munmap(service->config_mmap_base,
 				   service->config_mmap_size) < 0)
 				i_error("munmap(<config>) failed: %m");
+			master_service_settings_filters_free(service);
 		}
 
 		service->config_mmap_base =
@@ -636,9 +699,8 @@ int master_service_settings_read(struct master_service *service,
 	/* config_mmap_base is NULL only if
 	   MASTER_SERVICE_FLAG_NO_CONFIG_SETTINGS is used */
 	if (service->config_mmap_base != NULL) {
-		ret = master_service_settings_read_mmap(parser, event,
-			service->config_mmap_base, service->config_mmap_size,
-			output_r, error_r);
+		ret = master_service_settings_read_mmap(service, parser, event,
+							output_r, error_r);
 
 		if (ret < 0) {
 			if (getenv(DOVECOT_CONFIG_FD_ENV) != NULL) {
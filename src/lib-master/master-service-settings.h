@@ -23,6 +23,8 @@ struct master_service_settings {
 	const char *syslog_facility;
 	const char *import_environment;
 	const char *stats_writer_socket_path;
+	unsigned int stats_profiler_interval;
+	unsigned int stats_profiler_report_interval;
 	uoff_t config_cache_size;
 	bool version_ignore;
 	bool shutdown_clients;
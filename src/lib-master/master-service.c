@@ -15,6 +15,8 @@
 #include "mmap-util.h"
 #include "home-expand.h"
 #include "process-title.h"
+#include "process-stat.h"
+#include "sampling-profiler.h"
 #include "time-util.h"
 #include "restrict-access.h"
 #include "settings-parser.h"
@@ -28,8 +30,10 @@
 #include "iostream-ssl.h"
 
 #include <getopt.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
 #include <syslog.h>
 
 #define DEFAULT_CONFIG_FILE_PATH SYSCONFDIR"/dovecot.conf"
@@ -372,11 +376,29 @@ static void master_service_verify_version_string(struct master_service *service)
 	}
 }
 
+static bool master_service_tcp_migrate_req_enabled(void)
+{
+#ifdef __linux__
+	char buf[2];
+	ssize_t ret;
+	int fd;
+
+	fd = open("/proc/sys/net/ipv4/tcp_migrate_req", O_RDONLY);
+	if (fd == -1)
+		return FALSE;
+	ret = read(fd, buf, sizeof(buf));
+	i_close_fd(&fd);
+	return ret > 0 && buf[0] == '1';
+#else
+	return FALSE;
+#endif
+}
+
 static void master_service_init_socket_listeners(struct master_service *service)
 {
 	unsigned int i;
 	const char *value;
-	bool have_ssl_sockets = FALSE;
+	bool have_ssl_sockets = FALSE, have_reuse_port = FALSE;
 
 	if (service->socket_count == 0)
 		return;
@@ -417,6 +439,13 @@ static void master_service_init_socket_listeners(struct master_service *service)
 					have_ssl_sockets = TRUE;
 				} else if (strcmp(sname, "haproxy") == 0) {
 					l->haproxy = TRUE;
+				} else if (strcmp(sname, "reuse_port") == 0) {
+					if (str_to_uint(svalue,
+							&l->reuse_port_backlog) < 0) {
+						i_fatal("Invalid reuse_port "
+							"value: %s", svalue);
+					}
+					have_reuse_port = TRUE;
 				} else if (strcmp(sname, "type") == 0) {
 					i_free(l->type);
 					l->type = i_strdup_empty(svalue);
@@ -425,6 +454,14 @@ static void master_service_init_socket_listeners(struct master_service *service)
 			}
 		}
 	}
+	if (have_reuse_port && !master_service_tcp_migrate_req_enabled()) {
+		/* Without tcp_migrate_req the kernel resets the connections
+		   that are still queued on a listener when it's shut down.
+		   Keep the listeners in the SO_REUSEPORT group then and just
+		   stop accepting when the process is full. */
+		for (i = 0; i < service->socket_count; i++)
+			service->listeners[i].reuse_port_backlog = 0;
+	}
 	service->want_ssl_server = have_ssl_sockets ||
 		(service->flags & MASTER_SERVICE_FLAG_HAVE_STARTTLS) != 0;
 }
@@ -530,6 +567,14 @@ master_service_init(const char *name, enum master_service_flags flags,
 		service->config_path = i_strdup(DEFAULT_CONFIG_FILE_PATH);
 	else
 		service->config_path_from_master = TRUE;
+	if (service->config_path_from_master &&
+	    null_strcmp(getenv(DOVECOT_CONFIG_FD_ENV),
+			dec2str(MASTER_CONFIG_FD)) == 0) {
+		/* master passed its config fd. Don't leak it to any executed
+		   programs. */
+		service->config_fd_from_master = TRUE;
+		fd_close_on_exec(MASTER_CONFIG_FD, TRUE);
+	}
 
 	if ((flags & MASTER_SERVICE_FLAG_STANDALONE) == 0) {
 		service->version_string = getenv(MASTER_DOVECOT_VERSION_ENV);
@@ -615,6 +660,12 @@ master_service_init(const char *name, enum master_service_flags flags,
 		value = getenv(MASTER_SERVICE_IDLE_KILL_ENV);
 		if (value != NULL && str_to_uint(value, &count) == 0)
 			service->idle_kill_secs = count;
+
+		/* set the RSS limit for restarting the process */
+		value = getenv(MASTER_SERVICE_RESTART_RSS_LIMIT_ENV);
+		if (value != NULL &&
+		    str_to_uoff(value, &service->restart_rss_limit) < 0)
+			service->restart_rss_limit = 0;
 	} else {
 		master_service_set_client_limit(service, 1);
 		master_service_set_service_count(service, 1);
@@ -967,7 +1018,20 @@ void master_service_init_finish(struct master_service *service)
 						  master_status_error, service);
 		lib_signals_set_handler(SIGQUIT, 0, sig_close_listeners, service);
 	}
+	if ((service->flags & MASTER_SERVICE_FLAG_NO_CONFIG_SETTINGS) != 0 &&
+	    service->config_fd_from_master) {
+		/* the config passed by master isn't going to be read */
+		int fd = MASTER_CONFIG_FD;
+
+		service->config_fd_from_master = FALSE;
+		env_remove(DOVECOT_CONFIG_FD_ENV);
+		i_close_fd(&fd);
+	}
 	master_service_io_listeners_add(service);
+	if (service->set != NULL && service->set->stats_profiler_interval > 0) {
+		sampling_profiler_init(service->set->stats_profiler_interval,
+			service->set->stats_profiler_report_interval);
+	}
 	if (service->want_ssl_server &&
 	    (service->flags & MASTER_SERVICE_FLAG_NO_SSL_INIT) == 0)
 		master_service_ssl_ctx_init(service);
@@ -1286,6 +1350,49 @@ master_service_anvil_send(struct master_service *service, const char *cmd)
 	}
 }
 
+static void master_service_anvil_flush(struct master_service *service)
+{
+	timeout_remove(&service->to_anvil_flush);
+	if (service->anvil_pending_cmds == NULL ||
+	    str_len(service->anvil_pending_cmds) == 0)
+		return;
+	(void)master_service_anvil_send(service,
+					str_c(service->anvil_pending_cmds));
+	str_truncate(service->anvil_pending_cmds, 0);
+}
+
+static bool
+master_service_anvil_send_batched(struct master_service *service,
+				  const char *cmd)
+{
+	size_t cmd_len = strlen(cmd);
+
+	if ((service->flags & MASTER_SERVICE_FLAG_STANDALONE) != 0)
+		return FALSE;
+	if (current_ioloop == NULL || current_ioloop != service->ioloop ||
+	    cmd_len > PIPE_BUF) {
+		/* Not running in the main ioloop, so the flush timeout might
+		   never be called. Keep the original ordering regardless. */
+		master_service_anvil_flush(service);
+		return master_service_anvil_send(service, cmd);
+	}
+
+	/* Collect all the commands created within the same ioloop run to a
+	   single write(). Writes to the anvil fifo are shared by all the
+	   processes, so they must not exceed PIPE_BUF to stay atomic. */
+	if (service->anvil_pending_cmds == NULL)
+		service->anvil_pending_cmds = str_new(default_pool, PIPE_BUF);
+	else if (str_len(service->anvil_pending_cmds) + cmd_len > PIPE_BUF)
+		master_service_anvil_flush(service);
+	str_append_data(service->anvil_pending_cmds, cmd, cmd_len);
+	if (service->to_anvil_flush == NULL) {
+		service->to_anvil_flush =
+			timeout_add_short(0, master_service_anvil_flush,
+					  service);
+	}
+	return TRUE;
+}
+
 static void
 master_service_anvil_session_to_cmd(string_t *cmd,
 	const struct master_service_anvil_session *session)
@@ -1334,7 +1441,7 @@ bool master_service_anvil_connect(struct master_service *service,
 		str_append_tabescaped(cmd, str_c(alt_usernames));
 	}
 	str_append_c(cmd, '\n');
-	return master_service_anvil_send(service, str_c(cmd));
+	return master_service_anvil_send_batched(service, str_c(cmd));
 }
 
 void master_service_anvil_disconnect(struct master_service *service,
@@ -1347,13 +1454,72 @@ void master_service_anvil_disconnect(struct master_service *service,
 	str_append_c(cmd, '\t');
 	master_service_anvil_session_to_cmd(cmd, session);
 	str_append_c(cmd, '\n');
-	(void)master_service_anvil_send(service, str_c(cmd));
+	(void)master_service_anvil_send_batched(service, str_c(cmd));
+}
+
+static void
+master_service_reuse_port_listeners_detach(struct master_service *service)
+{
+	unsigned int i;
+
+	for (i = 0; i < service->socket_count; i++) {
+		struct master_service_listener *l = &service->listeners[i];
+
+		if (l->reuse_port_backlog == 0 || l->fd == -1 ||
+		    l->reuse_port_detached)
+			continue;
+
+		/* The kernel keeps distributing the new connections evenly
+		   to all the sockets in the SO_REUSEPORT group, even if this
+		   process can't handle them. Shutting down the listener
+		   removes it from the group, while keeping it bound so it
+		   can start listening again. This is done only with Linux
+		   net.ipv4.tcp_migrate_req=1, which moves the connections
+		   already queued for this socket to the other sockets. */
+		if (shutdown(l->fd, SHUT_RD) < 0) {
+			if (errno != ENOTCONN) {
+				e_error(service->event,
+					"shutdown(listener %d) failed: %m",
+					l->fd);
+			}
+			/* not supported by the OS - don't try again */
+			l->reuse_port_backlog = 0;
+			continue;
+		}
+		io_remove(&l->io);
+		l->reuse_port_detached = TRUE;
+	}
+}
+
+static void
+master_service_reuse_port_listeners_attach(struct master_service *service)
+{
+	unsigned int i;
+
+	for (i = 0; i < service->socket_count; i++) {
+		struct master_service_listener *l = &service->listeners[i];
+
+		if (!l->reuse_port_detached || l->fd == -1)
+			continue;
+		if (listen(l->fd, (int)l->reuse_port_backlog) < 0) {
+			e_error(service->event,
+				"listen(listener %d) failed: %m", l->fd);
+			continue;
+		}
+		l->reuse_port_detached = FALSE;
+	}
 }
 
 void master_service_client_connection_created(struct master_service *service)
 {
 	i_assert(service->master_status.available_count > 0);
 	service->master_status.available_count--;
+	if (service->master_status.available_count == 0 &&
+	    !service->call_avail_overflow) {
+		/* Let the other processes handle the new connections.
+		   Overflow handling still needs them to be accepted here. */
+		master_service_reuse_port_listeners_detach(service);
+	}
 	master_status_update(service);
 }
 
@@ -1424,6 +1590,24 @@ void master_service_client_connection_accept(struct master_service_connection *c
 	conn->accepted = TRUE;
 }
 
+static bool
+master_service_restart_rss_limit_reached(struct master_service *service)
+{
+	uint64_t rss;
+
+	if (service->restart_rss_limit == 0 || service->stopping)
+		return FALSE;
+	if (process_stat_read_rss(&rss, service->event) < 0 ||
+	    rss <= service->restart_rss_limit)
+		return FALSE;
+
+	e_info(service->event, "Process RSS %"PRIu64" MB exceeds "
+	       "restart_rss_limit=%"PRIuUOFF_T" MB - "
+	       "exiting after the current connections have finished",
+	       rss / 1024 / 1024, service->restart_rss_limit / 1024 / 1024);
+	return TRUE;
+}
+
 void master_service_client_connection_destroyed(struct master_service *service)
 {
 	/* we can listen again */
@@ -1456,6 +1640,11 @@ void master_service_client_connection_destroyed(struct master_service *service)
 		   a) master has closed the connection
 		   b) there are no listeners (std-client?) */
 		master_service_stop(service);
+	} else if (master_service_restart_rss_limit_reached(service)) {
+		/* memory usage has grown too large, probably due to
+		   fragmentation. let a new process handle the new
+		   connections. */
+		master_service_stop_new_connections(service);
 	} else {
 		master_status_update(service);
 	}
@@ -1560,12 +1749,16 @@ static void master_service_deinit_real(struct master_service **_service)
 		io_remove(&service->listeners[i].io);
 	master_service_ssl_ctx_deinit(service);
 
+	/* send the remaining samples before disconnecting from stats */
+	sampling_profiler_deinit();
 	if (service->stats_client != NULL)
 		stats_client_deinit(&service->stats_client);
 	timeout_remove(&service->to_overflow_call);
 	timeout_remove(&service->to_die);
 	timeout_remove(&service->to_overflow_state);
 	timeout_remove(&service->to_status);
+	master_service_anvil_flush(service);
+	str_free(&service->anvil_pending_cmds);
 	io_remove(&service->io_status_error);
 	io_remove(&service->io_status_write);
 	if (array_is_created(&service->config_overrides))
@@ -1580,6 +1773,7 @@ static void master_service_deinit_real(struct master_service **_service)
 			   service->config_mmap_size) < 0)
 			i_error("munmap(<config>) failed: %m");
 	}
+	master_service_settings_filters_free(service);
 	i_free(master_service_category_name);
 	master_service_category.name = NULL;
 	event_unregister_callback(master_service_event_callback);
@@ -1624,6 +1818,9 @@ void master_service_deinit_forked(struct master_service **_service)
 {
 	struct master_service *service = *_service;
 
+	/* the pending anvil commands belong to the parent process */
+	if (service->anvil_pending_cmds != NULL)
+		str_truncate(service->anvil_pending_cmds, 0);
 	master_service_deinit_real(_service);
 	io_loop_destroy(&service->ioloop);
 
@@ -1835,10 +2032,12 @@ void master_service_io_listeners_add(struct master_service *service)
 	if (service->stopping)
 		return;
 
+	master_service_reuse_port_listeners_attach(service);
 	for (i = 0; i < service->socket_count; i++) {
 		struct master_service_listener *l = &service->listeners[i];
 
-		if (l->io == NULL && l->fd != -1 && !l->closed) {
+		if (l->io == NULL && l->fd != -1 && !l->closed &&
+		    !l->reuse_port_detached) {
 			l->io = io_add(MASTER_LISTEN_FD_FIRST + i, IO_READ,
 				       master_service_listen, l);
 		}
@@ -45,6 +45,14 @@ struct master_service_connection_haproxy {
 	const char *cert_common_name;
 	const unsigned char *alpn;
 	unsigned int alpn_size;
+	/* TLS protocol version and cipher used by the client, if sent
+	   by the proxy */
+	const char *ssl_version;
+	const char *ssl_cipher;
+	/* Unique ID the proxy assigned to the connection, or NULL */
+	const char *unique_id;
+
+	/* The strings are valid only during the connection callback. */
 
 	bool ssl:1;
 	bool ssl_client_cert:1;
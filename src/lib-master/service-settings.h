@@ -54,6 +54,7 @@ struct service_settings {
 	const char *privileged_group;
 	const char *extra_groups;
 	const char *chroot;
+	const char *cpu_affinity;
 
 	bool drop_priv_before_exec;
 
@@ -63,6 +64,7 @@ struct service_settings {
 	unsigned int service_count;
 	unsigned int idle_kill;
 	uoff_t vsz_limit;
+	uoff_t restart_rss_limit;
 
 	ARRAY_TYPE(file_listener_settings) unix_listeners;
 	ARRAY_TYPE(file_listener_settings) fifo_listeners;
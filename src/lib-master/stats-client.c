@@ -1,24 +1,48 @@
 /* Copyright (c) 2017-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "array.h"
+#include "ioloop.h"
 #include "str.h"
 #include "strescape.h"
 #include "ostream.h"
+#include "strnum.h"
 #include "time-util.h"
 #include "lib-event-private.h"
 #include "event-filter.h"
 #include "connection.h"
+#include "stats-sketch.h"
 #include "stats-client.h"
 
 #define STATS_CLIENT_TIMEOUT_MSECS (5*1000)
 #define STATS_CLIENT_RECONNECT_INTERVAL_MSECS (10*1000)
 
+/* Metric that the stats server wants this process to count by itself */
+struct stats_client_aggregate {
+	char *name;
+	struct event_filter *filter;
+	unsigned int interval_msecs;
+
+	struct stats_sketch *duration;
+	unsigned int fields_count;
+	char **field_keys;
+	struct stats_sketch **fields;
+};
+ARRAY_DEFINE_TYPE(stats_client_aggregate, struct stats_client_aggregate *);
+
 struct stats_client {
 	struct connection conn;
 	struct event_filter *filter;
 	struct ioloop *ioloop;
 	struct timeout *to_reconnect;
 	struct timeval wait_started;
+
+	/* AGGREGATE lines are collected into aggregates_pending until the
+	   following FILTER line replaces the aggregates with them. */
+	ARRAY_TYPE(stats_client_aggregate) aggregates;
+	ARRAY_TYPE(stats_client_aggregate) aggregates_pending;
+	struct timeout *to_aggregates_flush;
+
 	bool handshaked;
 	bool handshake_received_at_least_once;
 	bool silent_notfound_errors;
@@ -28,6 +52,202 @@ static struct connection_list *stats_clients;
 
 static void stats_client_connect(struct stats_client *client);
 
+static void stats_client_aggregate_free(struct stats_client_aggregate *aggr)
+{
+	unsigned int i;
+
+	for (i = 0; i < aggr->fields_count; i++) {
+		stats_sketch_deinit(&aggr->fields[i]);
+		i_free(aggr->field_keys[i]);
+	}
+	i_free(aggr->fields);
+	i_free(aggr->field_keys);
+	stats_sketch_deinit(&aggr->duration);
+	event_filter_unref(&aggr->filter);
+	i_free(aggr->name);
+	i_free(aggr);
+}
+
+static void
+stats_client_aggregates_free(ARRAY_TYPE(stats_client_aggregate) *aggregates)
+{
+	struct stats_client_aggregate *aggr;
+
+	array_foreach_elem(aggregates, aggr)
+		stats_client_aggregate_free(aggr);
+	array_clear(aggregates);
+}
+
+static void stats_client_aggregates_flush(struct stats_client *client)
+{
+	struct stats_client_aggregate *aggr;
+	unsigned int i;
+
+	timeout_remove(&client->to_aggregates_flush);
+	if (!client->handshaked) {
+		/* send them after reconnecting */
+		return;
+	}
+
+	string_t *str = t_str_new(256);
+	array_foreach_elem(&client->aggregates, aggr) {
+		if (stats_sketch_get_count(aggr->duration) == 0)
+			continue;
+
+		str_append(str, "METRIC\t");
+		str_append_tabescaped(str, aggr->name);
+		str_append_c(str, '\t');
+		stats_sketch_export(aggr->duration, str);
+		stats_sketch_reset(aggr->duration);
+		for (i = 0; i < aggr->fields_count; i++) {
+			str_append_c(str, '\t');
+			stats_sketch_export(aggr->fields[i], str);
+			stats_sketch_reset(aggr->fields[i]);
+		}
+		str_append_c(str, '\n');
+	}
+	o_stream_nsend(client->conn.output, str_data(str), str_len(str));
+}
+
+static void
+stats_client_aggregate_field(struct event *event, const char *key,
+			     struct stats_sketch *sketch)
+{
+	const struct event_field *field =
+		event_find_field_recursive(event, key);
+	intmax_t num = 0;
+
+	/* this must count the same way as the stats process */
+	if (field == NULL)
+		return;
+
+	switch (field->value_type) {
+	case EVENT_FIELD_VALUE_TYPE_STR:
+	case EVENT_FIELD_VALUE_TYPE_STRLIST:
+	case EVENT_FIELD_VALUE_TYPE_IP:
+		break;
+	case EVENT_FIELD_VALUE_TYPE_INTMAX:
+		num = field->value.intmax;
+		break;
+	case EVENT_FIELD_VALUE_TYPE_TIMEVAL:
+		num = field->value.timeval.tv_sec * 1000000ULL +
+			field->value.timeval.tv_usec;
+		break;
+	}
+	stats_sketch_add(sketch, num);
+}
+
+static void
+stats_client_aggregate_event(struct stats_client *client, struct event *event,
+			     const struct failure_context *ctx)
+{
+	struct stats_client_aggregate *aggr;
+	uintmax_t duration;
+	unsigned int i;
+
+	array_foreach_elem(&client->aggregates, aggr) {
+		if (!event_filter_match(aggr->filter, event, ctx))
+			continue;
+
+		event_get_last_duration(event, &duration);
+		stats_sketch_add(aggr->duration, duration);
+		for (i = 0; i < aggr->fields_count; i++) {
+			stats_client_aggregate_field(event, aggr->field_keys[i],
+						     aggr->fields[i]);
+		}
+		if (client->to_aggregates_flush == NULL) {
+			client->to_aggregates_flush =
+				timeout_add_to(io_loop_get_root(),
+					       aggr->interval_msecs,
+					       stats_client_aggregates_flush,
+					       client);
+		}
+	}
+}
+
+static int
+stats_client_input_aggregate(struct stats_client *client,
+			     const char *const *args)
+{
+	struct stats_client_aggregate *aggr;
+	unsigned int i, interval_msecs;
+	const char *error;
+
+	/* <interval msecs> <metric name> <filter> [<field key> ...] */
+	if (str_array_length(args) < 3 ||
+	    str_to_uint(args[0], &interval_msecs) < 0) {
+		e_error(client->conn.event,
+			"stats: Received invalid AGGREGATE: %s",
+			t_strarray_join(args, "\t"));
+		return -1;
+	}
+
+	aggr = i_new(struct stats_client_aggregate, 1);
+	aggr->filter = event_filter_create();
+	if (!event_filter_import(aggr->filter, args[2], &error)) {
+		e_error(client->conn.event,
+			"stats: Received invalid AGGREGATE filter: %s "
+			"(input: %s)", error, t_strarray_join(args, "\t"));
+		stats_client_aggregate_free(aggr);
+		return -1;
+	}
+	aggr->name = i_strdup(args[1]);
+	aggr->interval_msecs = interval_msecs;
+	aggr->duration = stats_sketch_init();
+	aggr->fields_count = str_array_length(args + 3);
+	aggr->field_keys = i_new(char *, aggr->fields_count);
+	aggr->fields = i_new(struct stats_sketch *, aggr->fields_count);
+	for (i = 0; i < aggr->fields_count; i++) {
+		aggr->field_keys[i] = i_strdup(args[3 + i]);
+		aggr->fields[i] = stats_sketch_init();
+	}
+
+	if (!array_is_created(&client->aggregates_pending))
+		i_array_init(&client->aggregates_pending, 4);
+	array_push_back(&client->aggregates_pending, &aggr);
+	return 1;
+}
+
+static void
+stats_client_aggregates_replace(struct stats_client *client)
+{
+	if (!array_is_created(&client->aggregates)) {
+		if (!array_is_created(&client->aggregates_pending))
+			return;
+		i_array_init(&client->aggregates, 4);
+	}
+
+	/* send what was counted with the previous configuration */
+	stats_client_aggregates_flush(client);
+	stats_client_aggregates_free(&client->aggregates);
+	if (array_is_created(&client->aggregates_pending)) {
+		array_append_array(&client->aggregates,
+				   &client->aggregates_pending);
+		array_clear(&client->aggregates_pending);
+	}
+}
+
+static void
+stats_client_set_debug_send_filter(struct stats_client *client)
+{
+	struct stats_client_aggregate *aggr;
+	struct event_filter *filter;
+
+	if (!array_is_created(&client->aggregates) ||
+	    array_count(&client->aggregates) == 0) {
+		event_set_global_debug_send_filter(client->filter);
+		return;
+	}
+
+	/* debug events need to be sent for the aggregates as well */
+	filter = event_filter_create();
+	event_filter_merge(filter, client->filter);
+	array_foreach_elem(&client->aggregates, aggr)
+		event_filter_merge(filter, aggr->filter);
+	event_set_global_debug_send_filter(filter);
+	event_filter_unref(&filter);
+}
+
 static int
 client_handshake_filter(const char *const *args, struct event_filter **filter_r,
 			const char **error_r)
@@ -71,7 +291,8 @@ stats_client_handshake(struct stats_client *client, const char *const *args)
 
 	event_filter_unref(&client->filter);
 	client->filter = filter;
-	event_set_global_debug_send_filter(client->filter);
+	stats_client_aggregates_replace(client);
+	stats_client_set_debug_send_filter(client);
 	return 1;
 }
 
@@ -80,6 +301,8 @@ stats_client_input_args(struct connection *conn, const char *const *args)
 {
 	struct stats_client *client = (struct stats_client *)conn;
 
+	if (args[0] != NULL && strcmp(args[0], "AGGREGATE") == 0)
+		return stats_client_input_aggregate(client, args + 1);
 	return stats_client_handshake(client, args);
 
 }
@@ -101,6 +324,8 @@ static void stats_client_destroy(struct connection *conn)
 		event->sent_to_stats_id = 0;
 
 	client->handshaked = FALSE;
+	if (array_is_created(&client->aggregates_pending))
+		stats_client_aggregates_free(&client->aggregates_pending);
 	connection_disconnect(conn);
 	if (client->ioloop != NULL) {
 		/* waiting for stats handshake to finish */
@@ -130,7 +355,7 @@ static const struct connection_settings stats_client_set = {
 	.service_name_in = "stats-server",
 	.service_name_out = "stats-client",
 	.major_version = 4,
-	.minor_version = 0,
+	.minor_version = 1,
 
 	.input_max_size = SIZE_MAX,
 	.output_max_size = SIZE_MAX,
@@ -198,6 +423,8 @@ stats_client_send_event(struct stats_client *client, struct event *event,
 	if (!client->handshaked)
 		return;
 
+	if (array_is_created(&client->aggregates))
+		stats_client_aggregate_event(client, event, ctx);
 	if (!event_filter_match(client->filter, event, ctx))
 		return;
 
@@ -388,6 +615,10 @@ void stats_client_deinit(struct stats_client **_client)
 
 	*_client = NULL;
 
+	if (array_is_created(&client->aggregates)) T_BEGIN {
+		stats_client_aggregates_flush(client);
+	} T_END;
+
 	if (client->conn.output != NULL && !client->conn.output->closed &&
 	    o_stream_get_buffer_used_size(client->conn.output) > 0) {
 		o_stream_set_flush_callback(client->conn.output,
@@ -397,6 +628,15 @@ void stats_client_deinit(struct stats_client **_client)
 		stats_client_wait(client);
 	}
 
+	if (array_is_created(&client->aggregates)) {
+		stats_client_aggregates_free(&client->aggregates);
+		array_free(&client->aggregates);
+	}
+	if (array_is_created(&client->aggregates_pending)) {
+		stats_client_aggregates_free(&client->aggregates_pending);
+		array_free(&client->aggregates_pending);
+	}
+	timeout_remove(&client->to_aggregates_flush);
 	event_filter_unref(&client->filter);
 	connection_deinit(&client->conn);
 	timeout_remove(&client->to_reconnect);
@@ -0,0 +1,158 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "str.h"
+#include "strnum.h"
+#include "istream.h"
+#include "time-util.h"
+#include "smtp-command-parser.h"
+#include "smtp-reply-parser.h"
+
+#include <stdio.h>
+
+/**
+ * Measures how many commands per second the SMTP command parser handles and
+ * how many replies per second the SMTP reply parser handles. The input
+ * resembles pipelined LMTP transactions.
+ */
+
+#define BENCH_TRANSACTIONS 10000
+
+static const char *const bench_commands[] = {
+	"MAIL FROM:<sender@example.com> SIZE=12345 BODY=8BITMIME",
+	"RCPT TO:<user1@example.com> NOTIFY=SUCCESS,FAILURE",
+	"RCPT TO:<user2@example.com>",
+	"RCPT TO:<user3+detail@example.com> ORCPT=rfc822;user3@example.com",
+	"NOOP",
+	"RSET",
+};
+
+static const char *const bench_replies[] = {
+	"250 2.1.0 OK",
+	"250 2.1.5 OK",
+	"250-mx.example.com\r\n"
+	"250-8BITMIME\r\n"
+	"250-ENHANCEDSTATUSCODES\r\n"
+	"250 PIPELINING",
+	"452 4.2.2 <user3@example.com> Mailbox is full",
+	"250 2.0.0 <user1@example.com> Saved",
+};
+
+static void
+bench_data_fill(string_t *data, const char *const *lines,
+		unsigned int lines_count, unsigned int *count_r)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < BENCH_TRANSACTIONS; i++) {
+		for (j = 0; j < lines_count; j++) {
+			str_append(data, lines[j]);
+			str_append(data, "\r\n");
+		}
+	}
+	*count_r = BENCH_TRANSACTIONS * lines_count;
+}
+
+static void
+bench_print(const char *name, unsigned int count, unsigned int rounds,
+	    uint64_t ts_0, uint64_t ts_1)
+{
+	printf("\t%-8s %10.0lf per second\n", name,
+	       (double)count * rounds * 1000000000 / (double)(ts_1 - ts_0));
+}
+
+static void bench_command_parser(unsigned int rounds)
+{
+	struct smtp_command_parser *parser;
+	enum smtp_command_parse_error error_code;
+	const char *cmd_name, *cmd_params, *error;
+	struct istream *input;
+	unsigned int round, count, parsed;
+	string_t *data;
+	uint64_t ts_0, ts_1;
+	int ret;
+
+	data = str_new(default_pool, 1024*1024);
+	bench_data_fill(data, bench_commands, N_ELEMENTS(bench_commands),
+			&count);
+
+	ts_0 = i_nanoseconds();
+	for (round = 0; round < rounds; round++) {
+		input = i_stream_create_from_data(data->data, data->used);
+		parser = smtp_command_parser_init(input, NULL);
+		parsed = 0;
+		while ((ret = smtp_command_parse_next(parser, &cmd_name,
+						      &cmd_params, &error_code,
+						      &error)) > 0)
+			parsed++;
+		if (ret != -2 || parsed != count)
+			i_fatal("Command parsing failed: %s", error);
+		smtp_command_parser_deinit(&parser);
+		i_stream_unref(&input);
+	}
+	ts_1 = i_nanoseconds();
+	str_free(&data);
+
+	bench_print("commands", count, rounds, ts_0, ts_1);
+}
+
+static void bench_reply_parser(unsigned int rounds)
+{
+	struct smtp_reply_parser *parser;
+	struct smtp_reply *reply;
+	const char *error;
+	struct istream *input;
+	unsigned int round, count, parsed;
+	string_t *data;
+	uint64_t ts_0, ts_1;
+	int ret;
+
+	data = str_new(default_pool, 1024*1024);
+	bench_data_fill(data, bench_replies, N_ELEMENTS(bench_replies),
+			&count);
+
+	ts_0 = i_nanoseconds();
+	for (round = 0; round < rounds; round++) {
+		input = i_stream_create_from_data(data->data, data->used);
+		parser = smtp_reply_parser_init(input, SIZE_MAX);
+		parsed = 0;
+		while ((ret = smtp_reply_parse_next(parser, TRUE, &reply,
+						    &error)) > 0)
+			parsed++;
+		/* returns 0 at the end of input */
+		if (ret < 0 || parsed != count)
+			i_fatal("Reply parsing failed: %s", error);
+		smtp_reply_parser_deinit(&parser);
+		i_stream_unref(&input);
+	}
+	ts_1 = i_nanoseconds();
+	str_free(&data);
+
+	bench_print("replies", count, rounds, ts_0, ts_1);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [rounds]\n", prog);
+	fprintf(stderr, "Runs 10 rounds if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	unsigned int rounds = 10;
+
+	lib_init();
+
+	if (argc > 2)
+		print_usage(argv[0]);
+	if (argc == 2 && (str_to_uint(argv[1], &rounds) < 0 || rounds == 0))
+		print_usage(argv[0]);
+
+	printf("%d transactions, %u rounds\n", BENCH_TRANSACTIONS, rounds);
+	bench_command_parser(rounds);
+	bench_reply_parser(rounds);
+
+	lib_deinit();
+	return 0;
+}
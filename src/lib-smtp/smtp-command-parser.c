@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "buffer.h"
+#include "str.h"
 #include "unichar.h"
 #include "istream.h"
 #include "istream-failure-at.h"
@@ -14,6 +15,9 @@
 #include <ctype.h>
 
 #define SMTP_COMMAND_PARSER_MAX_COMMAND_LENGTH 32
+/* The parameters buffer is reused for the next command unless it has grown
+   larger than this (e.g. by a long AUTH response) */
+#define SMTP_COMMAND_PARSER_MAX_REUSED_PARAMS_SIZE 4096
 
 enum smtp_command_parser_state {
 	SMTP_COMMAND_PARSE_STATE_INIT = 0,
@@ -29,8 +33,9 @@ enum smtp_command_parser_state {
 struct smtp_command_parser_state_data {
 	enum smtp_command_parser_state state;
 
-	char *cmd_name;
-	char *cmd_params;
+	/* These point to the parser's name_buf and params_buf */
+	const char *cmd_name;
+	const char *cmd_params;
 
 	size_t poff;
 };
@@ -44,6 +49,9 @@ struct smtp_command_parser {
 	buffer_t *line_buffer;
 	struct istream *data;
 
+	/* Reused for each command to avoid allocating memory for them */
+	string_t *name_buf, *params_buf;
+
 	struct smtp_command_parser_state_data state;
 
 	enum smtp_command_parse_error error_code;
@@ -78,6 +86,9 @@ smtp_command_parser_init(struct istream *input,
 	parser = i_new(struct smtp_command_parser, 1);
 	parser->input = input;
 	i_stream_ref(input);
+	parser->name_buf = str_new(default_pool,
+				   SMTP_COMMAND_PARSER_MAX_COMMAND_LENGTH + 1);
+	parser->params_buf = str_new(default_pool, 128);
 
 	if (limits != NULL)
 		parser->limits = *limits;
@@ -103,8 +114,8 @@ void smtp_command_parser_deinit(struct smtp_command_parser **_parser)
 
 	i_stream_unref(&parser->data);
 	buffer_free(&parser->line_buffer);
-	i_free(parser->state.cmd_name);
-	i_free(parser->state.cmd_params);
+	str_free(&parser->name_buf);
+	str_free(&parser->params_buf);
 	i_free(parser->error);
 	i_stream_unref(&parser->input);
 	i_free(parser);
@@ -114,8 +125,14 @@ void smtp_command_parser_deinit(struct smtp_command_parser **_parser)
 static void smtp_command_parser_restart(struct smtp_command_parser *parser)
 {
 	buffer_free(&parser->line_buffer);
-	i_free(parser->state.cmd_name);
-	i_free(parser->state.cmd_params);
+	str_truncate(parser->name_buf, 0);
+	if (buffer_get_size(parser->params_buf) >
+	    SMTP_COMMAND_PARSER_MAX_REUSED_PARAMS_SIZE) {
+		str_free(&parser->params_buf);
+		parser->params_buf = str_new(default_pool, 128);
+	} else {
+		str_truncate(parser->params_buf, 0);
+	}
 
 	i_zero(&parser->state);
 }
@@ -160,7 +177,8 @@ static int smtp_command_parse_identifier(struct smtp_command_parser *parser)
 	parser->state.poff = p - parser->cur;
 	if (p == parser->end)
 		return 0;
-	parser->state.cmd_name = i_strdup_until(parser->cur, p);
+	str_append_data(parser->name_buf, parser->cur, p - parser->cur);
+	parser->state.cmd_name = str_c(parser->name_buf);
 	parser->cur = p;
 	parser->state.poff = 0;
 	return 1;
@@ -267,16 +285,14 @@ static int smtp_command_parse_parameters(struct smtp_command_parser *parser)
 		return -1;
 	}
 
-	if (parser->line_buffer == NULL) {
-		/* Buffered only in input stream */
-		parser->state.cmd_params = i_strdup_until(parser->cur, mp);
-	} else {
+	if (parser->line_buffer != NULL) {
 		/* Buffered also in the parser */
-		buffer_append(parser->line_buffer, parser->cur,
-			      (mp - parser->cur));
-		parser->state.cmd_params =
-			buffer_free_without_data(&parser->line_buffer);
+		str_append_data(parser->params_buf, parser->line_buffer->data,
+				parser->line_buffer->used);
+		buffer_free(&parser->line_buffer);
 	}
+	str_append_data(parser->params_buf, parser->cur, mp - parser->cur);
+	parser->state.cmd_params = str_c(parser->params_buf);
 	parser->cur = p;
 	parser->state.poff = 0;
 	return 1;
@@ -29,7 +29,8 @@ void smtp_command_parser_set_stream(struct smtp_command_parser *parser,
 
 /* Returns 1 if a command was returned, 0 if more data is needed, -1 on error,
    -2 if disconnected in SMTP_COMMAND_PARSE_STATE_INIT state. -2 is mainly for
-   unit tests - it can normally be treated the same as -1. */
+   unit tests - it can normally be treated the same as -1. The returned command
+   name and parameters are valid only until the next parse call. */
 int smtp_command_parse_next(struct smtp_command_parser *parser,
 			    const char **cmd_name_r, const char **cmd_params_r,
 			    enum smtp_command_parse_error *error_code_r,
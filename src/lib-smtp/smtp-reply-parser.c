@@ -196,10 +196,14 @@ static void
 smtp_reply_parser_restart(struct smtp_reply_parser *parser)
 {
 	str_truncate(parser->strbuf, 0);
-	pool_unref(&parser->reply_pool);
 	i_zero(&parser->state);
 
-	parser->reply_pool = pool_alloconly_create("smtp_reply", 1024);
+	/* The previous reply is valid only until the next one is parsed, so
+	   its memory can be reused. */
+	if (parser->reply_pool != NULL)
+		p_clear(parser->reply_pool);
+	else
+		parser->reply_pool = pool_alloconly_create("smtp_reply", 1024);
 	parser->state.reply = p_new(parser->reply_pool, struct smtp_reply, 1);
 	p_array_init(&parser->state.reply_lines, parser->reply_pool, 8);
 
@@ -16,6 +16,7 @@ void smtp_reply_parser_deinit(struct smtp_reply_parser **_parser);
 void smtp_reply_parser_set_stream(struct smtp_reply_parser *parser,
 				  struct istream *input);
 
+/* The returned reply is valid only until the next parse call. */
 int smtp_reply_parse_next(struct smtp_reply_parser *parser,
 			  bool enhanced_codes, struct smtp_reply **reply_r,
 			  const char **error_r);
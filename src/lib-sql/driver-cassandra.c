@@ -140,6 +140,8 @@ struct cassandra_db {
 struct cassandra_result {
 	struct sql_result api;
 	CassStatement *statement;
+	/* Set instead of statement for committing multiple changes */
+	CassBatch *batch;
 	const CassResult *result;
 	CassIterator *iterator;
 	char *log_query;
@@ -163,6 +165,14 @@ struct cassandra_result {
 	bool paging_continues:1;
 };
 
+struct cassandra_batch_change {
+	CassStatement *cass_stmt;
+	/* prepared statement, which is still waiting for the prepare to
+	   finish. cass_stmt is NULL until then. */
+	struct cassandra_sql_statement *stmt;
+	char *log_query;
+};
+
 struct cassandra_transaction_context {
 	struct sql_transaction_context ctx;
 	int refcount;
@@ -176,6 +186,14 @@ struct cassandra_transaction_context {
 	cass_int64_t query_timestamp;
 	char *error;
 
+	/* Transactions with multiple changes are committed as a single
+	   LOGGED BATCH. The first change is moved here from the fields
+	   above once the second change is added. */
+	ARRAY(struct cassandra_batch_change) batch_changes;
+	struct cassandra_result *batch_result;
+	unsigned int batch_pending_prepares;
+	bool batch_all_deletes;
+
 	bool begin_succeeded:1;
 	bool begin_failed:1;
 	bool failed:1;
@@ -211,6 +229,10 @@ struct cassandra_sql_statement {
 	cass_int64_t timestamp;
 
 	struct cassandra_result *result;
+	/* The statement is part of a batch in this transaction. */
+	struct cassandra_transaction_context *batch_ctx;
+	/* The transaction was freed before the prepare finished. */
+	bool batch_aborted;
 };
 
 struct cassandra_sql_prepared_statement {
@@ -273,6 +295,10 @@ prepare_finish_pending_statements(struct cassandra_sql_prepared_statement *prep_
 static void driver_cassandra_result_send_query(struct cassandra_result *result);
 static void driver_cassandra_send_queries(struct cassandra_db *db);
 static void result_finish(struct cassandra_result *result);
+static void
+driver_cassandra_transaction_batch_prepared(struct cassandra_transaction_context *ctx,
+					    struct cassandra_sql_statement *stmt,
+					    const char *error);
 
 static void log_one_line(const CassLogMessage *message,
 			 enum log_type log_type, const char *log_level_str,
@@ -1240,6 +1266,8 @@ static void driver_cassandra_result_free(struct sql_result *_result)
 		cass_iterator_free(result->iterator);
 	if (result->statement != NULL)
 		cass_statement_free(result->statement);
+	if (result->batch != NULL)
+		cass_batch_free(result->batch);
 	pool_unref(&result->row_pool);
 	event_unref(&result->api.event);
 	i_free(result->log_query);
@@ -1447,9 +1475,15 @@ static void driver_cassandra_result_send_query(struct cassandra_result *result)
 	struct cassandra_db *db = container_of(result->api.db, struct cassandra_db, api);
 	CassFuture *future;
 
-	i_assert(result->statement != NULL);
-
 	db->counters[CASSANDRA_COUNTER_TYPE_QUERY_SENT]++;
+	if (result->batch != NULL) {
+		cass_batch_set_consistency(result->batch, result->consistency);
+		future = cass_session_execute_batch(db->session, result->batch);
+		driver_cassandra_set_callback(future, db, query_callback, result);
+		return;
+	}
+
+	i_assert(result->statement != NULL);
 	if (result->query_type != CASSANDRA_QUERY_TYPE_READ_MORE)
 		driver_cassandra_init_statement(result);
 
@@ -1549,7 +1583,9 @@ static void driver_cassandra_send_queries(struct cassandra_db *db)
 
 	results = array_get(&db->results, &count);
 	for (i = 0; i < count; i++) {
-		if (!results[i]->query_sent && results[i]->statement != NULL) {
+		if (!results[i]->query_sent &&
+		    (results[i]->statement != NULL ||
+		     results[i]->batch != NULL)) {
 			if (driver_cassandra_send_query(results[i]) <= 0)
 				break;
 		}
@@ -1971,12 +2007,26 @@ static void
 driver_cassandra_transaction_unref(struct cassandra_transaction_context **_ctx)
 {
 	struct cassandra_transaction_context *ctx = *_ctx;
+	struct cassandra_batch_change *change;
 
 	*_ctx = NULL;
 	i_assert(ctx->refcount > 0);
 	if (--ctx->refcount > 0)
 		return;
 
+	if (array_is_created(&ctx->batch_changes)) {
+		array_foreach_modifiable(&ctx->batch_changes, change) {
+			if (change->cass_stmt != NULL)
+				cass_statement_free(change->cass_stmt);
+			if (change->stmt != NULL) {
+				/* free it once the prepare finishes */
+				change->stmt->batch_ctx = NULL;
+				change->stmt->batch_aborted = TRUE;
+			}
+			i_free(change->log_query);
+		}
+		array_free(&ctx->batch_changes);
+	}
 	event_unref(&ctx->ctx.event);
 	i_free(ctx->log_query);
 	i_free(ctx->query);
@@ -2018,6 +2068,138 @@ transaction_commit_callback(struct sql_result *result, void *context)
 	driver_cassandra_transaction_unref(&ctx);
 }
 
+static void
+driver_cassandra_transaction_batch_add(struct cassandra_transaction_context *ctx,
+				       struct cassandra_sql_statement *stmt,
+				       const char *query, const char *log_query,
+				       cass_int64_t timestamp)
+{
+	struct cassandra_batch_change *change;
+
+	change = array_append_space(&ctx->batch_changes);
+	change->log_query = i_strdup(log_query);
+	if (stmt != NULL) {
+		/* prepared statement */
+		query = stmt->stmt.query_template;
+		if (stmt->cass_stmt != NULL) {
+			change->cass_stmt = stmt->cass_stmt;
+			pool_unref(&stmt->stmt.pool);
+		} else {
+			/* wait for prepare to finish */
+			change->stmt = stmt;
+			stmt->batch_ctx = ctx;
+			ctx->batch_pending_prepares++;
+		}
+	} else {
+		change->cass_stmt = cass_statement_new(query, 0);
+		if (timestamp != 0)
+			cass_statement_set_timestamp(change->cass_stmt, timestamp);
+	}
+	if (!str_begins_icase_with(query, "DELETE "))
+		ctx->batch_all_deletes = FALSE;
+}
+
+static void
+driver_cassandra_transaction_init_batch(struct cassandra_transaction_context *ctx)
+{
+	struct cassandra_sql_statement *stmt;
+
+	if (array_is_created(&ctx->batch_changes))
+		return;
+
+	/* move the first change to the batch */
+	i_array_init(&ctx->batch_changes, 4);
+	ctx->batch_all_deletes = TRUE;
+	if (ctx->query != NULL) {
+		driver_cassandra_transaction_batch_add(ctx, NULL, ctx->query,
+			ctx->log_query, ctx->query_timestamp);
+		i_free_and_null(ctx->query);
+		i_free_and_null(ctx->log_query);
+	} else {
+		stmt = ctx->stmt;
+		ctx->stmt = NULL;
+		driver_cassandra_transaction_batch_add(ctx, stmt, NULL,
+			sql_statement_get_log_query(&stmt->stmt), 0);
+	}
+}
+
+static void
+driver_cassandra_transaction_batch_send(struct cassandra_transaction_context *ctx)
+{
+	struct cassandra_result *result = ctx->batch_result;
+	struct cassandra_batch_change *change;
+
+	i_assert(ctx->batch_pending_prepares == 0);
+
+	if (ctx->failed) {
+		/* some prepare failed */
+		result->error = i_strdup(ctx->error);
+		result_finish(result);
+		return;
+	}
+
+	result->batch = cass_batch_new(CASS_BATCH_TYPE_LOGGED);
+	array_foreach_modifiable(&ctx->batch_changes, change) {
+		/* the batch keeps its own reference to the statement */
+		cass_batch_add_statement(result->batch, change->cass_stmt);
+		cass_statement_free(change->cass_stmt);
+		change->cass_stmt = NULL;
+	}
+	(void)driver_cassandra_send_query(result);
+}
+
+static void
+driver_cassandra_transaction_batch_prepared(struct cassandra_transaction_context *ctx,
+					    struct cassandra_sql_statement *stmt,
+					    const char *error)
+{
+	struct cassandra_batch_change *change;
+	bool found = FALSE;
+
+	array_foreach_modifiable(&ctx->batch_changes, change) {
+		if (change->stmt == stmt) {
+			found = TRUE;
+			break;
+		}
+	}
+	i_assert(found);
+
+	change->stmt = NULL;
+	stmt->batch_ctx = NULL;
+	if (error != NULL)
+		transaction_set_failed(ctx, error);
+	else
+		change->cass_stmt = stmt->cass_stmt;
+	pool_unref(&stmt->stmt.pool);
+
+	i_assert(ctx->batch_pending_prepares > 0);
+	if (--ctx->batch_pending_prepares == 0 && ctx->batch_result != NULL)
+		driver_cassandra_transaction_batch_send(ctx);
+}
+
+static void
+driver_cassandra_transaction_commit_batch(struct cassandra_transaction_context *ctx)
+{
+	struct cassandra_db *db =
+		container_of(ctx->ctx.db, struct cassandra_db, api);
+	const struct cassandra_batch_change *change;
+	string_t *log_query = t_str_new(256);
+
+	str_append(log_query, "BATCH: ");
+	array_foreach(&ctx->batch_changes, change) {
+		if (str_len(log_query) > 7)
+			str_append(log_query, "; ");
+		str_append(log_query, change->log_query);
+	}
+	ctx->batch_result = driver_cassandra_query_init(db, str_c(log_query),
+		ctx->batch_all_deletes ? CASSANDRA_QUERY_TYPE_DELETE :
+		CASSANDRA_QUERY_TYPE_WRITE, FALSE,
+		transaction_commit_callback, ctx);
+	if (ctx->batch_pending_prepares == 0)
+		driver_cassandra_transaction_batch_send(ctx);
+	/* else wait for prepares to finish */
+}
+
 static void
 driver_cassandra_transaction_commit(struct sql_transaction_context *_ctx,
 				    sql_commit_callback_t *callback, void *context)
@@ -2032,7 +2214,8 @@ driver_cassandra_transaction_commit(struct sql_transaction_context *_ctx,
 	ctx->callback = callback;
 	ctx->context = context;
 
-	if (ctx->failed || (ctx->query == NULL && ctx->stmt == NULL)) {
+	if (ctx->failed || (ctx->query == NULL && ctx->stmt == NULL &&
+			    !array_is_created(&ctx->batch_changes))) {
 		if (ctx->failed)
 			result.error = ctx->error;
 
@@ -2043,6 +2226,10 @@ driver_cassandra_transaction_commit(struct sql_transaction_context *_ctx,
 		driver_cassandra_transaction_unref(&ctx);
 		return;
 	}
+	if (array_is_created(&ctx->batch_changes)) {
+		driver_cassandra_transaction_commit_batch(ctx);
+		return;
+	}
 
 	/* just a single query, send it */
 	const char *query = ctx->query != NULL ?
@@ -2114,6 +2301,10 @@ driver_cassandra_transaction_commit_s(struct sql_transaction_context *_ctx,
 		/* nothing should be using this - don't bother implementing */
 		i_panic("cassandra: sql_transaction_commit_s() not supported for prepared statements");
 	}
+	if (array_is_created(&ctx->batch_changes) && !ctx->failed) {
+		transaction_set_failed(ctx,
+			"Multiple changes not supported in synchronous transactions");
+	}
 
 	if (ctx->query != NULL && !ctx->failed)
 		driver_cassandra_try_commit_s(ctx);
@@ -2144,8 +2335,11 @@ driver_cassandra_update(struct sql_transaction_context *_ctx, const char *query,
 
 	i_assert(affected_rows == NULL);
 
-	if (ctx->query != NULL || ctx->stmt != NULL) {
-		transaction_set_failed(ctx, "Multiple changes in transaction not supported");
+	if (ctx->query != NULL || ctx->stmt != NULL ||
+	    array_is_created(&ctx->batch_changes)) {
+		driver_cassandra_transaction_init_batch(ctx);
+		driver_cassandra_transaction_batch_add(ctx, NULL, query,
+						       query, 0);
 		return;
 	}
 	ctx->query = i_strdup(query);
@@ -2254,6 +2448,11 @@ static void prepare_finish_statement(struct cassandra_sql_statement *stmt)
 		if (stmt->result != NULL) {
 			stmt->result->error = i_strdup(stmt->prep->error);
 			result_finish(stmt->result);
+		} else if (stmt->batch_ctx != NULL) {
+			/* frees the statement */
+			driver_cassandra_transaction_batch_prepared(
+				stmt->batch_ctx, stmt, stmt->prep->error);
+			return;
 		}
 		pool_unref(&stmt->stmt.pool);
 		return;
@@ -2272,6 +2471,12 @@ static void prepare_finish_statement(struct cassandra_sql_statement *stmt)
 		stmt->result->timestamp = stmt->timestamp;
 		(void)driver_cassandra_send_query(stmt->result);
 		pool_unref(&stmt->stmt.pool);
+	} else if (stmt->batch_ctx != NULL) {
+		driver_cassandra_transaction_batch_prepared(stmt->batch_ctx,
+							    stmt, NULL);
+	} else if (stmt->batch_aborted) {
+		cass_statement_free(stmt->cass_stmt);
+		pool_unref(&stmt->stmt.pool);
 	}
 }
 
@@ -2593,9 +2798,19 @@ driver_cassandra_update_stmt(struct sql_transaction_context *_ctx,
 
 	i_assert(affected_rows == NULL);
 
-	if (ctx->query != NULL || ctx->stmt != NULL) {
-		transaction_set_failed(ctx,
-			"Multiple changes in transaction not supported");
+	if (ctx->query != NULL || ctx->stmt != NULL ||
+	    array_is_created(&ctx->batch_changes)) {
+		driver_cassandra_transaction_init_batch(ctx);
+		if (stmt->prep != NULL) {
+			driver_cassandra_transaction_batch_add(ctx, stmt, NULL,
+				sql_statement_get_log_query(_stmt), 0);
+		} else {
+			driver_cassandra_transaction_batch_add(ctx, NULL,
+				sql_statement_get_query(_stmt),
+				sql_statement_get_log_query(_stmt),
+				stmt->timestamp);
+			pool_unref(&_stmt->pool);
+		}
 		return;
 	}
 	if (stmt->prep != NULL)
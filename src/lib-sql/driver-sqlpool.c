@@ -25,6 +25,8 @@ struct sqlpool_host {
 struct sqlpool_connection {
 	struct sql_db *db;
 	unsigned int host_idx;
+	/* when the connection last became idle */
+	time_t last_idle;
 };
 
 struct sqlpool_db {
@@ -33,6 +35,10 @@ struct sqlpool_db {
 	pool_t pool;
 	const struct sql_db *driver;
 	unsigned int connection_limit;
+	/* close connections that have been idle this long, except for the
+	   last one for each host. 0 = never. */
+	unsigned int idle_timeout_secs;
+	struct timeout *to_idle;
 
 	ARRAY(struct sqlpool_host) hosts;
 	/* all connections from all hosts */
@@ -251,6 +257,52 @@ sqlpool_handle_connect_failed(struct sqlpool_db *db, struct sql_db *conndb)
 	}
 }
 
+static void sqlpool_close_idle_connections(struct sqlpool_db *db)
+{
+	struct sqlpool_connection *conns;
+	struct sqlpool_host *host;
+	struct sql_db *conndb;
+	unsigned int i, count;
+
+	conns = array_get_modifiable(&db->all_connections, &count);
+	for (i = count; i > 0; i--) {
+		if (conns[i-1].db->state != SQL_DB_STATE_IDLE ||
+		    conns[i-1].last_idle + (time_t)db->idle_timeout_secs >
+		    ioloop_time)
+			continue;
+		host = array_idx_modifiable(&db->hosts, conns[i-1].host_idx);
+		if (host->connection_count <= 1)
+			continue;
+
+		e_debug(db->api.event, "Closing idle connection");
+		conndb = conns[i-1].db;
+		array_delete(&db->all_connections, i-1, 1);
+		conns = array_get_modifiable(&db->all_connections, &count);
+		host->connection_count--;
+		sql_unref(&conndb);
+	}
+	if (array_count(&db->all_connections) <= array_count(&db->hosts))
+		timeout_remove(&db->to_idle);
+}
+
+static void sqlpool_connection_set_idle(struct sqlpool_db *db,
+					struct sql_db *conndb)
+{
+	struct sqlpool_connection *conn;
+
+	array_foreach_modifiable(&db->all_connections, conn) {
+		if (conn->db == conndb) {
+			conn->last_idle = ioloop_time;
+			break;
+		}
+	}
+	if (db->to_idle == NULL &&
+	    array_count(&db->all_connections) > array_count(&db->hosts)) {
+		db->to_idle = timeout_add(db->idle_timeout_secs * 1000,
+					  sqlpool_close_idle_connections, db);
+	}
+}
+
 static void
 sqlpool_state_changed(struct sql_db *conndb, enum sql_db_state prev_state,
 		      void *context)
@@ -258,6 +310,8 @@ sqlpool_state_changed(struct sql_db *conndb, enum sql_db_state prev_state,
 	struct sqlpool_db *db = context;
 
 	if (conndb->state == SQL_DB_STATE_IDLE) {
+		if (db->idle_timeout_secs > 0)
+			sqlpool_connection_set_idle(db, conndb);
 		conndb->connect_failure_count = 0;
 		conndb->connect_delay = SQL_CONNECT_MIN_DELAY;
 		sqlpool_request_send_next(db, conndb);
@@ -303,6 +357,7 @@ sqlpool_add_connection(struct sqlpool_db *db, struct sqlpool_host *host,
 	conn = array_append_space(&db->all_connections);
 	conn->host_idx = host_idx;
 	conn->db = conndb;
+	conn->last_idle = ioloop_time;
 	return conn;
 }
 
@@ -479,6 +534,12 @@ driver_sqlpool_parse_hosts(struct sqlpool_db *db, const char *connect_string,
 					value);
 				return -1;
 			}
+		} else if (strcmp(key, "idle_timeout") == 0) {
+			if (str_to_uint(value, &db->idle_timeout_secs) < 0) {
+				*error_r = t_strdup_printf("Invalid value for idle_timeout: %s",
+					value);
+				return -1;
+			}
 		} else if (strcmp(key, "host") == 0) {
 			array_push_back(&hostnames, &value);
 		} else {
@@ -573,6 +634,7 @@ static void driver_sqlpool_deinit(struct sql_db *_db)
 	struct sqlpool_host *host;
 	struct sqlpool_connection *conn;
 
+	timeout_remove(&db->to_idle);
 	array_foreach_modifiable(&db->all_connections, conn)
 		sql_unref(&conn->db);
 	array_clear(&db->all_connections);
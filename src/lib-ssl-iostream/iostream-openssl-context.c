@@ -1,6 +1,8 @@
 /* Copyright (c) 2009-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "array.h"
+#include "buffer.h"
 #include "str.h"
 #include "hex-binary.h"
 #include "safe-memset.h"
@@ -15,12 +17,27 @@
 #include <openssl/pem.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/rand.h>
+#ifdef HAVE_SSL_CTX_set_tlsext_ticket_key_evp_cb
+#  include <openssl/core_names.h>
+#else
+#  include <openssl/hmac.h>
+#endif
 #include <arpa/inet.h>
 
 #ifndef HAVE_EVP_PKEY_get0_DH
 #  define EVP_PKEY_get0_DH(x) ((x)->pkey.dh)
 #endif
 
+#define OPENSSL_TICKET_KEY_NAME_LEN 16
+#define OPENSSL_TICKET_KEY_SECRET_LEN 32
+
+struct openssl_iostream_ticket_key {
+	unsigned char name[OPENSSL_TICKET_KEY_NAME_LEN];
+	unsigned char hmac_secret[OPENSSL_TICKET_KEY_SECRET_LEN];
+	unsigned char aes_key[OPENSSL_TICKET_KEY_SECRET_LEN];
+};
+
 struct ssl_iostream_password_context {
 	const char *password;
 	const char *error;
@@ -572,6 +589,183 @@ ssl_iostream_context_load_ca(struct ssl_iostream_context *ctx,
 	return 0;
 }
 
+#ifdef HAVE_SSL_CTX_set_tlsext_ticket_key_evp_cb
+static int
+ssl_ticket_key_mac_init(EVP_MAC_CTX *mac_ctx,
+			const struct openssl_iostream_ticket_key *key)
+{
+	OSSL_PARAM params[] = {
+		OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+			(void *)key->hmac_secret, sizeof(key->hmac_secret)),
+		OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+						 "sha256", 0),
+		OSSL_PARAM_construct_end()
+	};
+	return EVP_MAC_CTX_set_params(mac_ctx, params) == 1 ? 0 : -1;
+}
+#else
+#  define EVP_MAC_CTX HMAC_CTX
+
+static int
+ssl_ticket_key_mac_init(EVP_MAC_CTX *mac_ctx,
+			const struct openssl_iostream_ticket_key *key)
+{
+	return HMAC_Init_ex(mac_ctx, key->hmac_secret,
+			    sizeof(key->hmac_secret), EVP_sha256(),
+			    NULL) == 1 ? 0 : -1;
+}
+#endif
+
+static int
+ssl_ticket_key_callback(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+			EVP_CIPHER_CTX *cipher_ctx, EVP_MAC_CTX *mac_ctx,
+			int enc)
+{
+	struct ssl_iostream *ssl_io =
+		SSL_get_ex_data(ssl, dovecot_ssl_extdata_index);
+	const struct openssl_iostream_ticket_key *keys, *key;
+	unsigned int i, count;
+
+	/* SNI may have switched to a context without the keys */
+	if (!array_is_created(&ssl_io->ctx->ticket_keys))
+		return 0;
+	keys = array_get(&ssl_io->ctx->ticket_keys, &count);
+
+	if (enc == 1) {
+		key = &keys[0];
+		if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) <= 0)
+			return -1;
+		memcpy(key_name, key->name, sizeof(key->name));
+		if (EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL,
+				       key->aes_key, iv) != 1)
+			return -1;
+		return ssl_ticket_key_mac_init(mac_ctx, key) < 0 ? -1 : 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (memcmp(key_name, keys[i].name, sizeof(keys[i].name)) == 0)
+			break;
+	}
+	if (i == count) {
+		/* unknown or already removed key - do a full handshake */
+		return 0;
+	}
+	key = &keys[i];
+	if (EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL,
+			       key->aes_key, iv) != 1 ||
+	    ssl_ticket_key_mac_init(mac_ctx, key) < 0)
+		return -1;
+	/* ask the client to replace tickets encrypted with an older key */
+	return i == 0 ? 1 : 2;
+}
+
+static int
+ssl_iostream_ctx_set_ticket_keys(struct ssl_iostream_context *ctx,
+				 const char *ticket_keys,
+				 const char **error_r)
+{
+	const char *const *hex_keys = t_strsplit_spaces(ticket_keys, " \t\r\n");
+	struct openssl_iostream_ticket_key *key;
+	unsigned int count = str_array_length(hex_keys);
+	buffer_t *buf;
+	int ret = 0;
+
+	if (count == 0)
+		return 0;
+
+	buf = t_buffer_create(sizeof(*key));
+	p_array_init(&ctx->ticket_keys, ctx->pool, count);
+	for (; *hex_keys != NULL; hex_keys++) {
+		buffer_set_used_size(buf, 0);
+		if (hex_to_binary(*hex_keys, buf) < 0 ||
+		    buf->used != sizeof(*key)) {
+			*error_r = t_strdup_printf(
+				"Invalid ssl_ticket_keys: "
+				"Each key must be %zu hex characters",
+				sizeof(*key) * 2);
+			ret = -1;
+			break;
+		}
+		key = array_append_space(&ctx->ticket_keys);
+		memcpy(key, buf->data, sizeof(*key));
+	}
+	safe_memset(buffer_get_modifiable_data(buf, NULL), 0, buf->used);
+	if (ret < 0)
+		return -1;
+
+#ifdef HAVE_SSL_CTX_set_tlsext_ticket_key_evp_cb
+	if (SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx->ssl_ctx,
+						 ssl_ticket_key_callback) != 1) {
+#else
+	if (SSL_CTX_set_tlsext_ticket_key_cb(ctx->ssl_ctx,
+					     ssl_ticket_key_callback) != 1) {
+#endif
+		*error_r = t_strdup_printf(
+			"Can't set session ticket key callback: %s",
+			openssl_iostream_error());
+		return -1;
+	}
+	return 0;
+}
+
+static int
+ssl_alpn_select_callback(SSL *ssl ATTR_UNUSED, const unsigned char **out_r,
+			 unsigned char *outlen_r, const unsigned char *in,
+			 unsigned int inlen, void *context)
+{
+	struct ssl_iostream_context *ctx = context;
+	unsigned char *selected;
+
+	/* use the server's preference order */
+	if (SSL_select_next_proto(&selected, outlen_r,
+				  ctx->alpn_protocols->data,
+				  ctx->alpn_protocols->used,
+				  in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+		/* continue without ALPN */
+		return SSL_TLSEXT_ERR_NOACK;
+	}
+	*out_r = selected;
+	return SSL_TLSEXT_ERR_OK;
+}
+
+static int
+ssl_iostream_ctx_set_alpn_protocols(struct ssl_iostream_context *ctx,
+				    const char *alpn_protocols,
+				    const char **error_r)
+{
+	const char *const *names = t_strsplit_spaces(alpn_protocols, " ");
+	buffer_t *buf;
+	size_t len;
+
+	if (names[0] == NULL)
+		return 0;
+
+	buf = buffer_create_dynamic(ctx->pool, 32);
+	for (; *names != NULL; names++) {
+		len = strlen(*names);
+		if (len > UINT8_MAX) {
+			*error_r = t_strdup_printf(
+				"Invalid ALPN protocol name: %s", *names);
+			return -1;
+		}
+		buffer_append_c(buf, len);
+		buffer_append(buf, *names, len);
+	}
+
+	if (!ctx->client_ctx) {
+		ctx->alpn_protocols = buf;
+		SSL_CTX_set_alpn_select_cb(ctx->ssl_ctx,
+					   ssl_alpn_select_callback, ctx);
+	} else if (SSL_CTX_set_alpn_protos(ctx->ssl_ctx, buf->data,
+					   buf->used) != 0) {
+		/* unlike most OpenSSL functions, this returns 0 on success */
+		*error_r = t_strdup_printf("Can't set ALPN protocols: %s",
+					   openssl_iostream_error());
+		return -1;
+	}
+	return 0;
+}
+
 static int
 ssl_iostream_context_set(struct ssl_iostream_context *ctx,
 			 const struct ssl_iostream_settings *set,
@@ -674,7 +868,15 @@ ssl_iostream_context_set(struct ssl_iostream_context *ctx,
 #ifdef HAVE_SSL_client_hello_get0_ciphers
 		SSL_CTX_set_client_hello_cb(ctx->ssl_ctx, ssl_clienthello_callback, ctx);
 #endif
+		if (set->tickets && set->ticket_keys != NULL &&
+		    ssl_iostream_ctx_set_ticket_keys(ctx, set->ticket_keys,
+						     error_r) < 0)
+			return -1;
 	}
+	if (set->alpn_protocols != NULL &&
+	    ssl_iostream_ctx_set_alpn_protocols(ctx, set->alpn_protocols,
+						error_r) < 0)
+		return -1;
 	return 0;
 }
 
@@ -813,6 +1015,13 @@ void openssl_iostream_context_unref(struct ssl_iostream_context *ctx)
 		return;
 
 	SSL_CTX_free(ctx->ssl_ctx);
+	if (array_is_created(&ctx->ticket_keys)) {
+		struct openssl_iostream_ticket_key *keys;
+		unsigned int count;
+
+		keys = array_get_modifiable(&ctx->ticket_keys, &count);
+		safe_memset(keys, 0, sizeof(*keys) * count);
+	}
 	pool_unref(&ctx->pool);
 	i_free(ctx);
 }
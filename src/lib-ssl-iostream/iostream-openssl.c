@@ -413,7 +413,7 @@ static int openssl_iostream_bio_output_real(struct ssl_iostream *ssl_io)
 {
 	size_t bytes, max_bytes = 0;
 	ssize_t sent;
-	unsigned char buffer[IO_BLOCK_SIZE];
+	char *data;
 	int result = 0;
 	int ret;
 
@@ -429,23 +429,27 @@ static int openssl_iostream_bio_output_real(struct ssl_iostream *ssl_io)
 			}
 			bytes = max_bytes;
 		}
-		if (bytes > sizeof(buffer))
-			bytes = sizeof(buffer);
 
-		/* BIO_read() is guaranteed to return all the bytes that
-		   BIO_ctrl_pending() returned */
-		ret = BIO_read(ssl_io->bio_ext, buffer, bytes);
-		i_assert(ret == (int)bytes);
+		/* Send directly from the BIO pair's buffer instead of
+		   BIO_read()ing the data into a temporary buffer first. The
+		   buffer is a ring, so the pending bytes may be split into
+		   two parts. */
+		ret = BIO_nread0(ssl_io->bio_ext, &data);
+		i_assert(ret > 0);
+		if (bytes > (size_t)ret)
+			bytes = ret;
 
-		/* we limited number of read bytes to plain_output's
+		/* we limited number of sent bytes to plain_output's
 		   available size. this send() is guaranteed to either
 		   fully succeed or completely fail due to some error. */
-		sent = o_stream_send(ssl_io->plain_output, buffer, bytes);
+		sent = o_stream_send(ssl_io->plain_output, data, bytes);
 		if (sent < 0) {
 			o_stream_uncork(ssl_io->plain_output);
 			return -1;
 		}
 		i_assert(sent == (ssize_t)bytes);
+		ret = BIO_nread(ssl_io->bio_ext, &data, bytes);
+		i_assert(ret == (int)bytes);
 		result = 1;
 	}
 
@@ -931,6 +935,20 @@ openssl_iostream_get_ja3(struct ssl_iostream *ssl_io)
 	return ssl_io->ja3_str;
 }
 
+static const char *
+openssl_iostream_get_alpn_protocol(struct ssl_iostream *ssl_io)
+{
+	const unsigned char *data;
+	unsigned int len;
+
+	if (!ssl_io->handshaked)
+		return NULL;
+	SSL_get0_alpn_selected(ssl_io->ssl, &data, &len);
+	if (len == 0)
+		return NULL;
+	return t_strndup(data, len);
+}
+
 static const struct iostream_ssl_vfuncs ssl_vfuncs = {
 	.global_init = openssl_iostream_global_init,
 	.context_init_client = openssl_iostream_context_init_client,
@@ -962,6 +980,7 @@ static const struct iostream_ssl_vfuncs ssl_vfuncs = {
 	.get_pfs = openssl_iostream_get_pfs,
 	.get_protocol_name = openssl_iostream_get_protocol_name,
 	.get_ja3 = openssl_iostream_get_ja3,
+	.get_alpn_protocol = openssl_iostream_get_alpn_protocol,
 };
 
 void ssl_iostream_openssl_init(void)
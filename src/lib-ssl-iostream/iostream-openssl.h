@@ -24,6 +24,10 @@ struct ssl_iostream_context {
 	struct ssl_iostream_settings set;
 
 	int username_nid;
+	/* ssl_ticket_keys: the first key encrypts new tickets */
+	ARRAY(struct openssl_iostream_ticket_key) ticket_keys;
+	/* server: ssl_alpn_protocols in the wire format */
+	buffer_t *alpn_protocols;
 
 	bool client_ctx:1;
 };
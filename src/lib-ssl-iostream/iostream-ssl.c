@@ -22,6 +22,8 @@ static const size_t ssl_iostream_settings_string_offsets[] = {
 	OFFSET(dh),
 	OFFSET(cert_username_field),
 	OFFSET(crypto_device),
+	OFFSET(ticket_keys),
+	OFFSET(alpn_protocols),
 };
 
 static bool ssl_module_loaded = FALSE;
@@ -347,3 +349,8 @@ const char *ssl_iostream_get_ja3(struct ssl_iostream *ssl_io)
 {
 	return ssl_vfuncs->get_ja3(ssl_io);
 }
+
+const char *ssl_iostream_get_alpn_protocol(struct ssl_iostream *ssl_io)
+{
+	return ssl_vfuncs->get_alpn_protocol(ssl_io);
+}
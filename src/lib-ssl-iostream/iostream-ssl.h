@@ -26,6 +26,15 @@ struct ssl_iostream_settings {
 	const char *dh; /* context-only */
 	const char *cert_username_field; /* both */
 	const char *crypto_device; /* context-only */
+	/* Whitespace separated hex encoded session ticket keys shared by all
+	   processes, so tickets can be resumed by any of them. NULL uses a
+	   random per-process key. */
+	const char *ticket_keys; /* context-only */
+	/* Space separated list of ALPN protocol names (e.g. "h2 http/1.1")
+	   in the order of preference. Clients offer them to the server, which
+	   selects the first one in its own list that the client offered.
+	   NULL disables ALPN. */
+	const char *alpn_protocols; /* context-only */
 
 	bool verbose, verbose_invalid_cert; /* stream-only */
 	bool skip_crl_check; /* context-only */
@@ -159,6 +168,9 @@ const char *ssl_iostream_get_pfs(struct ssl_iostream *ssl_io);
    This returns values like SSLv3, TLSv1, TLSv1.1, TLSv1.2
 */
 const char *ssl_iostream_get_protocol_name(struct ssl_iostream *ssl_io);
+/* Returns the ALPN protocol negotiated during the handshake. Returns NULL
+   if the handshake has not yet been made or no protocol was agreed on. */
+const char *ssl_iostream_get_alpn_protocol(struct ssl_iostream *ssl_io);
 
 const char *ssl_iostream_get_last_error(struct ssl_iostream *ssl_io);
 
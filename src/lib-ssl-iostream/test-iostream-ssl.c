@@ -33,6 +33,18 @@ struct test_endpoint {
 	bool finished:1;
 };
 
+/* two 80 byte keys: 16 byte name, 32 byte HMAC secret, 32 byte AES key */
+static const char *test_ticket_keys =
+	"00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+	"00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+	"00112233445566778899aabbccddeeff\n"
+	"ffeeddccbbaa99887766554433221100ffeeddccbbaa99887766554433221100"
+	"ffeeddccbbaa99887766554433221100ffeeddccbbaa99887766554433221100"
+	"ffeeddccbbaa99887766554433221100";
+
+/* ALPN protocol negotiated by the last handshake */
+static char *test_alpn_protocol = NULL;
+
 static void send_output(struct test_endpoint *ep)
 {
 	ssize_t amt = i_rand_limit(10)+1;
@@ -240,6 +252,12 @@ static int test_iostream_ssl_handshake_real(struct ssl_iostream_settings *server
 	if (client->failed || server->failed)
 		ret = -1;
 
+	i_free(test_alpn_protocol);
+	test_alpn_protocol =
+		i_strdup(ssl_iostream_get_alpn_protocol(client->iostream));
+	test_assert(null_strcmp(test_alpn_protocol,
+		ssl_iostream_get_alpn_protocol(server->iostream)) == 0);
+
 	if (ssl_iostream_has_handshake_failed(client->iostream)) {
 		i_error("client: %s", ssl_iostream_get_last_error(client->iostream));
 		ret = -1;
@@ -353,6 +371,48 @@ static void test_iostream_ssl_handshake(void)
 							 "failhost") != 0, idx);
 	idx++;
 
+	/* shared session ticket keys */
+	ssl_iostream_test_settings_server(&server_set);
+	ssl_iostream_test_settings_client(&client_set);
+	client_set.allow_invalid_cert = TRUE;
+	server_set.tickets = TRUE;
+	server_set.ticket_keys = test_ticket_keys;
+	test_assert_idx(test_iostream_ssl_handshake_real(&server_set, &client_set,
+							 "localhost") == 0, idx);
+	idx++;
+	ssl_iostream_test_settings_server(&server_set);
+	ssl_iostream_test_settings_client(&client_set);
+	server_set.tickets = TRUE;
+	server_set.ticket_keys = "0123456789abcdef";
+	test_expect_error_string("server: Invalid ssl_ticket_keys");
+	test_assert_idx(test_iostream_ssl_handshake_real(&server_set, &client_set,
+							 "localhost") != 0, idx);
+	idx++;
+
+	/* ALPN: the server's preference wins */
+	ssl_iostream_test_settings_server(&server_set);
+	ssl_iostream_test_settings_client(&client_set);
+	client_set.allow_invalid_cert = TRUE;
+	server_set.alpn_protocols = "h2 http/1.1";
+	client_set.alpn_protocols = "http/1.1 h2";
+	test_assert_idx(test_iostream_ssl_handshake_real(&server_set, &client_set,
+							 "localhost") == 0, idx);
+	test_assert_strcmp_idx(test_alpn_protocol, "h2", idx);
+	idx++;
+	/* ALPN: no common protocol isn't an error */
+	server_set.alpn_protocols = "h2";
+	client_set.alpn_protocols = "http/1.1";
+	test_assert_idx(test_iostream_ssl_handshake_real(&server_set, &client_set,
+							 "localhost") == 0, idx);
+	test_assert_idx(test_alpn_protocol == NULL, idx);
+	idx++;
+	server_set.alpn_protocols = NULL;
+	client_set.alpn_protocols = "h2 http/1.1";
+	test_assert_idx(test_iostream_ssl_handshake_real(&server_set, &client_set,
+							 "localhost") == 0, idx);
+	test_assert_idx(test_alpn_protocol == NULL, idx);
+	idx++;
+
 	/* invalid client credentials: missing credentials */
 	ssl_iostream_test_settings_server(&server_set);
 	ssl_iostream_test_settings_client(&client_set);
@@ -376,6 +436,7 @@ static void test_iostream_ssl_handshake(void)
 							 "127.0.0.1") != 0, idx);
 	idx++;
 
+	i_free(test_alpn_protocol);
 	io_loop_destroy(&ioloop);
 
 	test_end();
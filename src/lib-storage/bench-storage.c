@@ -0,0 +1,322 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "istream.h"
+#include "str.h"
+#include "strnum.h"
+#include "time-util.h"
+#include "process-stat.h"
+#include "master-service.h"
+#include "mail-namespace.h"
+#include "test-mail-storage-common.h"
+
+#include <stdio.h>
+
+/**
+ * Runs the basic storage operations against each mail storage backend and
+ * reports the operations per second, the read/write syscalls per operation
+ * and the bytes written per operation. The syscall and byte counts come
+ * from /proc/self/io, so they're shown as 0 where it isn't available.
+ *
+ * The workloads are run in the following order against a fresh user under
+ * .test-home/ in the current directory:
+ *
+ *  - save: each message is saved in its own transaction, like LMTP does
+ *  - copy: all messages are copied to another mailbox in one transaction
+ *  - fetch-body: the full body of each message is read
+ *  - flags: \Flagged is added to all messages in one transaction
+ *  - expunge: all messages are expunged in one transaction
+ *
+ * The number of messages defaults to 1000, and it can be given as a plain
+ * number or with k/M suffix (e.g. 100k).
+ */
+
+#define BENCH_DEFAULT_MESSAGES 1000
+
+static const char *const bench_drivers[] = {
+	"maildir", "sdbox", "mdbox", "mbox", NULL
+};
+
+struct bench_op {
+	const char *name;
+	uint64_t start_nsecs;
+	struct process_stat stat;
+};
+
+static struct event *bench_event;
+static uint32_t bench_rand_state = 1;
+
+static uint32_t bench_rand(void)
+{
+	/* deterministic, so that the results are comparable between runs */
+	bench_rand_state = bench_rand_state * 1103515245 + 12345;
+	return (bench_rand_state >> 16) & 0x7fff;
+}
+
+static void bench_op_begin(struct bench_op *op, const char *name)
+{
+	op->name = name;
+	process_stat_read_start(&op->stat, bench_event);
+	op->start_nsecs = i_nanoseconds();
+}
+
+static void bench_op_end(struct bench_op *op, unsigned int count)
+{
+	uint64_t nsecs = i_nanoseconds() - op->start_nsecs;
+
+	process_stat_read_finish(&op->stat, bench_event);
+	printf("\t%-10s %10.0lf ops/s %8.2lf syscalls/op %10.0lf bytes/op\n",
+	       op->name, (double)count * 1000000000 / (double)nsecs,
+	       (double)(op->stat.syscr + op->stat.syscw) / count,
+	       (double)op->stat.wchar / count);
+}
+
+static void bench_fail(struct mailbox *box, const char *func)
+{
+	i_fatal("%s(%s) failed: %s", func, mailbox_get_vname(box),
+		mailbox_get_last_internal_error(box, NULL));
+}
+
+static void bench_sync(struct mailbox *box)
+{
+	if (mailbox_sync(box, 0) < 0)
+		bench_fail(box, "mailbox_sync");
+}
+
+static void bench_message_build(string_t *str, unsigned int idx)
+{
+	unsigned int i, lines = 20 + bench_rand() % 100;
+
+	str_truncate(str, 0);
+	str_printfa(str,
+		"From: Sender %u <sender%u@example.com>\n"
+		"To: Recipient <recipient@example.com>\n"
+		"Subject: benchmark message %u\n"
+		"Date: Wed, 14 Oct 2026 12:00:00 +0000\n"
+		"Message-ID: <bench-%u@example.com>\n"
+		"MIME-Version: 1.0\n"
+		"Content-Type: text/plain; charset=us-ascii\n"
+		"\n", idx % 100, idx % 100, idx, idx);
+	for (i = 0; i < lines; i++) {
+		str_printfa(str, "Line %u of the body of message %u with some "
+			    "filler text to make it look like a mail.\n",
+			    i, idx);
+	}
+}
+
+static void bench_save(struct mailbox *box, unsigned int count)
+{
+	struct mailbox_transaction_context *trans;
+	struct mail_save_context *save_ctx;
+	struct istream *input;
+	struct bench_op op;
+	string_t *str = str_new(default_pool, 8192);
+	unsigned int i;
+	int ret;
+
+	bench_op_begin(&op, "save");
+	for (i = 0; i < count; i++) {
+		bench_message_build(str, i);
+		input = i_stream_create_from_data(str_data(str), str_len(str));
+		trans = mailbox_transaction_begin(box,
+			MAILBOX_TRANSACTION_FLAG_EXTERNAL, __func__);
+		save_ctx = mailbox_save_alloc(trans);
+		if (mailbox_save_begin(&save_ctx, input) < 0)
+			bench_fail(box, "mailbox_save_begin");
+		do {
+			if (mailbox_save_continue(save_ctx) < 0)
+				bench_fail(box, "mailbox_save_continue");
+		} while ((ret = i_stream_read(input)) > 0);
+		i_assert(ret == -1 && input->stream_errno == 0);
+		if (mailbox_save_finish(&save_ctx) < 0)
+			bench_fail(box, "mailbox_save_finish");
+		if (mailbox_transaction_commit(&trans) < 0)
+			bench_fail(box, "mailbox_transaction_commit");
+		i_stream_unref(&input);
+	}
+	bench_sync(box);
+	bench_op_end(&op, count);
+	str_free(&str);
+}
+
+static void
+bench_copy(struct mailbox *box, struct mailbox *dest, unsigned int count)
+{
+	struct mailbox_transaction_context *trans, *dest_trans;
+	struct mail_save_context *save_ctx;
+	struct mail *mail;
+	struct bench_op op;
+	uint32_t seq;
+
+	bench_op_begin(&op, "copy");
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	dest_trans = mailbox_transaction_begin(dest,
+		MAILBOX_TRANSACTION_FLAG_EXTERNAL, __func__);
+	mail = mail_alloc(trans, 0, NULL);
+	for (seq = 1; seq <= count; seq++) {
+		mail_set_seq(mail, seq);
+		save_ctx = mailbox_save_alloc(dest_trans);
+		if (mailbox_copy(&save_ctx, mail) < 0)
+			bench_fail(dest, "mailbox_copy");
+	}
+	mail_free(&mail);
+	if (mailbox_transaction_commit(&dest_trans) < 0)
+		bench_fail(dest, "mailbox_transaction_commit");
+	if (mailbox_transaction_commit(&trans) < 0)
+		bench_fail(box, "mailbox_transaction_commit");
+	bench_sync(dest);
+	bench_op_end(&op, count);
+}
+
+static void bench_fetch_body(struct mailbox *box, unsigned int count)
+{
+	struct mailbox_transaction_context *trans;
+	struct mail *mail;
+	struct istream *input;
+	struct bench_op op;
+	const unsigned char *data;
+	size_t size;
+	uint32_t seq;
+
+	bench_op_begin(&op, "fetch-body");
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	mail = mail_alloc(trans, MAIL_FETCH_STREAM_BODY, NULL);
+	for (seq = 1; seq <= count; seq++) {
+		mail_set_seq(mail, seq);
+		if (mail_get_stream(mail, NULL, NULL, &input) < 0)
+			bench_fail(box, "mail_get_stream");
+		while (i_stream_read_more(input, &data, &size) > 0)
+			i_stream_skip(input, size);
+		if (input->stream_errno != 0) {
+			i_fatal("read(%s) failed: %s", i_stream_get_name(input),
+				i_stream_get_error(input));
+		}
+	}
+	mail_free(&mail);
+	if (mailbox_transaction_commit(&trans) < 0)
+		bench_fail(box, "mailbox_transaction_commit");
+	bench_op_end(&op, count);
+}
+
+static void bench_flags(struct mailbox *box, unsigned int count)
+{
+	struct mailbox_transaction_context *trans;
+	struct mail *mail;
+	struct bench_op op;
+	uint32_t seq;
+
+	bench_op_begin(&op, "flags");
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	mail = mail_alloc(trans, 0, NULL);
+	for (seq = 1; seq <= count; seq++) {
+		mail_set_seq(mail, seq);
+		mail_update_flags(mail, MODIFY_ADD, MAIL_FLAGGED);
+	}
+	mail_free(&mail);
+	if (mailbox_transaction_commit(&trans) < 0)
+		bench_fail(box, "mailbox_transaction_commit");
+	bench_sync(box);
+	bench_op_end(&op, count);
+}
+
+static void bench_expunge(struct mailbox *box, unsigned int count)
+{
+	struct mailbox_transaction_context *trans;
+	struct mail *mail;
+	struct bench_op op;
+	uint32_t seq;
+
+	bench_op_begin(&op, "expunge");
+	trans = mailbox_transaction_begin(box, 0, __func__);
+	mail = mail_alloc(trans, 0, NULL);
+	for (seq = 1; seq <= count; seq++) {
+		mail_set_seq(mail, seq);
+		mail_expunge(mail);
+	}
+	mail_free(&mail);
+	if (mailbox_transaction_commit(&trans) < 0)
+		bench_fail(box, "mailbox_transaction_commit");
+	bench_sync(box);
+	bench_op_end(&op, count);
+}
+
+static void bench_driver(const char *driver, unsigned int count)
+{
+	struct test_mail_storage_settings set = {
+		.driver = driver,
+	};
+	struct test_mail_storage_ctx *ctx;
+	struct mailbox *box, *dest;
+
+	printf("%s:\n", driver);
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	box = mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	dest = mailbox_alloc(ctx->user->namespaces->list, "Copy", 0);
+	if (mailbox_open(box) < 0)
+		bench_fail(box, "mailbox_open");
+	if (mailbox_create(dest, NULL, FALSE) < 0)
+		bench_fail(dest, "mailbox_create");
+	if (mailbox_open(dest) < 0)
+		bench_fail(dest, "mailbox_open");
+
+	bench_save(box, count);
+	bench_copy(box, dest, count);
+	bench_fetch_body(box, count);
+	bench_flags(box, count);
+	bench_expunge(box, count);
+
+	mailbox_free(&dest);
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+}
+
+static int bench_parse_count(const char *str, unsigned int *count_r)
+{
+	const char *suffix;
+	unsigned int multiplier = 1;
+
+	if (str_parse_uint(str, count_r, &suffix) < 0)
+		return -1;
+	if (strcmp(suffix, "k") == 0)
+		multiplier = 1000;
+	else if (strcmp(suffix, "M") == 0)
+		multiplier = 1000000;
+	else if (*suffix != '\0')
+		return -1;
+	if (*count_r == 0 || *count_r > UINT_MAX / multiplier)
+		return -1;
+	*count_r *= multiplier;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *const *drivers = bench_drivers;
+	unsigned int i, count = BENCH_DEFAULT_MESSAGES;
+
+	master_service = master_service_init("bench-storage",
+					     MASTER_SERVICE_FLAG_STANDALONE |
+					     MASTER_SERVICE_FLAG_DONT_SEND_STATS |
+					     MASTER_SERVICE_FLAG_NO_CONFIG_SETTINGS |
+					     MASTER_SERVICE_FLAG_NO_SSL_INIT |
+					     MASTER_SERVICE_FLAG_NO_INIT_DATASTACK_FRAME,
+					     &argc, &argv, "");
+	if (argc > 1 && bench_parse_count(argv[1], &count) < 0)
+		i_fatal("Usage: %s [<messages> [<driver> ...]]", argv[0]);
+	if (argc > 2)
+		drivers = (const char *const *)argv + 2;
+	bench_event = event_create(NULL);
+
+	printf("Storage backends with %u messages:\n", count);
+	for (i = 0; drivers[i] != NULL; i++) T_BEGIN {
+		bench_driver(drivers[i], count);
+	} T_END;
+
+	event_unref(&bench_event);
+	master_service_deinit(&master_service);
+	return 0;
+}
@@ -245,6 +245,16 @@ bool mdbox_map_is_fscked(struct mdbox_map *map)
 	return (hdr->flags & MAIL_INDEX_HDR_FLAG_FSCKD) != 0;
 }
 
+bool mdbox_map_is_same(struct mdbox_map *map1, struct mdbox_map *map2)
+{
+	if (map1 == map2)
+		return TRUE;
+	return strcmp(map1->path, map2->path) == 0 &&
+		strcmp(map1->index_path, map2->index_path) == 0 &&
+		null_strcmp(map1->storage->alt_storage_dir,
+			    map2->storage->alt_storage_dir) == 0;
+}
+
 static void
 mdbox_map_get_ext_hdr(struct mdbox_map *map, struct mail_index_view *view,
 		      struct mdbox_map_mail_index_header *hdr_r)
@@ -1252,6 +1262,7 @@ mdbox_map_assign_file_ids(struct mdbox_map_append_context *ctx,
 		if (mfile->file_id == 0) {
 			if (mdbox_file_assign_file_id(mfile, file_id++) < 0)
 				return -1;
+			ctx->new_files_created = TRUE;
 		}
 	}
 
@@ -1425,6 +1436,11 @@ int mdbox_map_append_commit(struct mdbox_map_append_context *ctx)
 	return 0;
 }
 
+bool mdbox_map_append_created_files(struct mdbox_map_append_context *ctx)
+{
+	return ctx->new_files_created;
+}
+
 void mdbox_map_append_free(struct mdbox_map_append_context **_ctx)
 {
 	struct mdbox_map_append_context *ctx = *_ctx;
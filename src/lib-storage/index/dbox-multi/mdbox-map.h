@@ -43,6 +43,9 @@ int mdbox_map_open_or_create(struct mdbox_map *map);
 int mdbox_map_refresh(struct mdbox_map *map);
 /* Returns TRUE if map has been fsck'd. */
 bool mdbox_map_is_fscked(struct mdbox_map *map);
+/* Returns TRUE if both maps point to the same map index and storage files,
+   e.g. when the same user's storage is created multiple times. */
+bool mdbox_map_is_same(struct mdbox_map *map1, struct mdbox_map *map2);
 
 /* Return the current rebuild counter */
 uint32_t mdbox_map_get_rebuild_count(struct mdbox_map *map);
@@ -71,7 +74,10 @@ int mdbox_map_get_file_msgs(struct mdbox_map *map, uint32_t file_id,
 /* Begin atomic context. There can be multiple transactions/appends within the
    same atomic context. */
 struct mdbox_map_atomic_context *mdbox_map_atomic_begin(struct mdbox_map *map);
-/* Lock the map immediately. */
+/* Lock the map immediately. The lock is the map index's transaction log
+   sync lock. Saving writes and fsyncs the message data to m.* files (each
+   protected by its own file lock) before taking this lock, so it's held only
+   while map UIDs are assigned and the mailbox index is updated. */
 int mdbox_map_atomic_lock(struct mdbox_map_atomic_context *atomic,
 			  const char *reason);
 /* Returns TRUE if map is locked */
@@ -133,6 +139,9 @@ int mdbox_map_append_move(struct mdbox_map_append_context *ctx,
 int mdbox_map_append_flush(struct mdbox_map_append_context *ctx);
 /* Returns 0 if ok, -1 if error. */
 int mdbox_map_append_commit(struct mdbox_map_append_context *ctx);
+/* Returns TRUE if new m.* files were created (renamed to their final name)
+   by this append. */
+bool mdbox_map_append_created_files(struct mdbox_map_append_context *ctx);
 void mdbox_map_append_free(struct mdbox_map_append_context **ctx);
 
 /* Returns map's uidvalidity */
@@ -6,6 +6,8 @@
 #include "ostream.h"
 #include "str.h"
 #include "hash.h"
+#include "sleep.h"
+#include "time-util.h"
 #include "dbox-attachment.h"
 #include "mdbox-storage.h"
 #include "mdbox-storage-rebuild.h"
@@ -48,6 +50,11 @@ struct mdbox_purge_context {
 
 	struct mdbox_map_atomic_context *atomic;
 	struct mdbox_map_append_context *append_ctx;
+
+	/* mdbox_purge_max_bytes_per_sec throttling: number of bytes copied
+	   since throttle_start */
+	struct timeval throttle_start;
+	uoff_t throttle_bytes;
 };
 
 static int mdbox_map_file_msg_offset_cmp(const struct mdbox_map_file_msg *m1,
@@ -183,6 +190,27 @@ mdbox_purge_want_altpath(struct mdbox_purge_context *ctx,
 	return action == MDBOX_MSG_ACTION_MOVE_TO_ALT;
 }
 
+static void
+mdbox_purge_throttle(struct mdbox_purge_context *ctx, uoff_t bytes)
+{
+	uoff_t max_rate = ctx->storage->set->mdbox_purge_max_bytes_per_sec;
+	struct timeval now;
+	long long elapsed_usecs, wanted_usecs;
+
+	if (max_rate == 0)
+		return;
+
+	/* This is never called while the map is locked, so sleeping here
+	   doesn't block the other processes. */
+	ctx->throttle_bytes += bytes;
+	wanted_usecs = (ctx->throttle_bytes / max_rate) * 1000000 +
+		(ctx->throttle_bytes % max_rate) * 1000000 / max_rate;
+	i_gettimeofday(&now);
+	elapsed_usecs = timeval_diff_usecs(&now, &ctx->throttle_start);
+	if (wanted_usecs > elapsed_usecs)
+		i_sleep_usecs(wanted_usecs - elapsed_usecs);
+}
+
 static int
 mdbox_purge_save_msg(struct mdbox_purge_context *ctx, struct dbox_file *file,
 		     const struct mdbox_map_file_msg *msg)
@@ -231,6 +259,7 @@ mdbox_purge_save_msg(struct mdbox_purge_context *ctx, struct dbox_file *file,
 			return ret;
 
 		mdbox_map_append_finish(ctx->append_ctx);
+		mdbox_purge_throttle(ctx, msg_size);
 	}
 	return ret;
 }
@@ -474,6 +503,7 @@ mdbox_purge_alloc(struct mdbox_storage *storage)
 	ctx->pool = pool;
 	ctx->storage = storage;
 	ctx->lowest_primary_file_id = (uint32_t)-1;
+	i_gettimeofday(&ctx->throttle_start);
 	i_array_init(&ctx->primary_file_ids, 64);
 	i_array_init(&ctx->purge_file_ids, 64);
 	hash_table_create_direct(&ctx->altmoves, pool, 0);
@@ -231,6 +231,8 @@ int mdbox_save_finish(struct mail_save_context *ctx)
 	int ret;
 
 	ret = mdbox_save_finish_write(ctx);
+	if (ret == 0)
+		index_mail_save_binary_parts(ctx->dest_mail);
 	index_save_context_free(ctx);
 	return ret;
 }
@@ -378,6 +380,7 @@ void mdbox_transaction_save_commit_post(struct mail_save_context *_ctx,
 	struct mail_storage *_storage = box->storage;
 	struct mdbox_storage *storage =
 		container_of(_storage, struct mdbox_storage, storage.storage);
+	bool new_files;
 
 	_ctx->transaction = NULL; /* transaction is already freed */
 
@@ -395,12 +398,18 @@ void mdbox_transaction_save_commit_post(struct mail_save_context *_ctx,
 		if (mdbox_map_append_commit(ctx->append_ctx) < 0)
 			mdbox_map_atomic_set_failed(ctx->atomic);
 	}
+	new_files = mdbox_map_append_created_files(ctx->append_ctx);
 	mdbox_map_append_free(&ctx->append_ctx);
 	/* update the sync tail offset, everything else
 	   was already written at this point. */
 	(void)mdbox_map_atomic_finish(&ctx->atomic);
 
-	if (_storage->set->parsed_fsync_mode != FSYNC_MODE_NEVER) {
+	/* the directory needs to be fsynced only if new m.* files were
+	   renamed into it. appends to existing files were already
+	   fdatasynced, so with many deliveries appending to the same file
+	   this saves one fsync per delivery. */
+	if (new_files &&
+	    _storage->set->parsed_fsync_mode != FSYNC_MODE_NEVER) {
 		if (fdatasync_path(storage->storage_dir) < 0) {
 			mailbox_set_critical(box,
 				"fdatasync_path(%s) failed: %m",
@@ -432,6 +441,24 @@ void mdbox_transaction_save_rollback(struct mail_save_context *_ctx)
 	i_free(ctx);
 }
 
+static bool
+mdbox_copy_storage_is_same(struct mail_storage *src,
+			   struct mail_storage *dest)
+{
+	struct mdbox_storage *src_storage, *dest_storage;
+
+	if (src == dest)
+		return TRUE;
+	/* Different storage instances may still share the same map, e.g.
+	   when LMTP delivers to multiple recipients that are the same user.
+	   The message can then be copied by increasing its refcount. */
+	if (strcmp(src->name, MDBOX_STORAGE_NAME) != 0)
+		return FALSE;
+	src_storage = MDBOX_STORAGE(src);
+	dest_storage = MDBOX_STORAGE(dest);
+	return mdbox_map_is_same(src_storage->map, dest_storage->map);
+}
+
 int mdbox_copy(struct mail_save_context *_ctx, struct mail *mail)
 {
 	struct mdbox_save_context *ctx = MDBOX_SAVECTX(_ctx);
@@ -443,7 +470,8 @@ int mdbox_copy(struct mail_save_context *_ctx, struct mail *mail)
 
 	ctx->ctx.finished = TRUE;
 
-	if (mail->box->storage != _ctx->transaction->box->storage ||
+	if (!mdbox_copy_storage_is_same(mail->box->storage,
+					_ctx->transaction->box->storage) ||
 	    _ctx->transaction->box->disable_reflink_copy_to)
 		return mail_storage_copy(_ctx, mail);
 	src_mbox = MDBOX_MAILBOX(mail->box);
@@ -219,6 +219,8 @@ int sdbox_save_finish(struct mail_save_context *ctx)
 	int ret;
 
 	ret = dbox_save_finish_write(ctx);
+	if (ret == 0)
+		index_mail_save_binary_parts(ctx->dest_mail);
 	index_save_context_free(ctx);
 	return ret;
 }
@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "str.h"
+#include "strnum.h"
 #include "ioloop.h"
 #include "istream.h"
 #include "istream-concat.h"
@@ -139,6 +140,36 @@ headers_merge(pool_t pool, const char *const *h1, const char *const *h2)
 	return array_front(&headers);
 }
 
+static bool
+imapc_mail_try_extend_uid_range(string_t *cmd, size_t set_start,
+				size_t set_end, const char *uid_str)
+{
+	const char *set = str_c(cmd);
+	size_t pos = set_end, last_start;
+	uint32_t last_uid, uid;
+
+	/* If the new UID directly follows the last UID in the set, extend
+	   it into a range. This keeps the FETCH command short with sequential
+	   iteration, which is the common case when prefetching. */
+	if (str_to_uint32(uid_str, &uid) < 0)
+		return FALSE;
+	while (pos > set_start && set[pos-1] != ',' && set[pos-1] != ':')
+		pos--;
+	last_start = pos;
+	if (str_to_uint32(t_strndup(set + last_start, set_end - last_start),
+			  &last_uid) < 0 || last_uid + 1 != uid)
+		return FALSE;
+
+	if (last_start > set_start && set[last_start-1] == ':') {
+		/* replace the end of the existing range */
+		str_delete(cmd, last_start, set_end - last_start);
+		str_insert(cmd, last_start, uid_str);
+	} else {
+		str_insert(cmd, set_end, t_strconcat(":", uid_str, NULL));
+	}
+	return TRUE;
+}
+
 static bool
 imapc_mail_try_merge_fetch(struct imapc_mailbox *mbox, string_t *str)
 {
@@ -159,6 +190,10 @@ imapc_mail_try_merge_fetch(struct imapc_mailbox *mbox, string_t *str)
 		return FALSE;
 	/* append the new UID to the pending FETCH UID range */
 	str_truncate(str, p1-s1);
+	if (imapc_mail_try_extend_uid_range(mbox->pending_fetch_cmd,
+					    s2_args - s2, p2 - s2,
+					    str_c(str) + 10))
+		return TRUE;
 	str_insert(mbox->pending_fetch_cmd, p2-s2, ",");
 	str_insert(mbox->pending_fetch_cmd, p2-s2+1, str_c(str) + 10);
 	return TRUE;
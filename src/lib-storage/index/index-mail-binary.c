@@ -428,7 +428,7 @@ index_mail_read_binary_to_cache(struct mail *_mail,
 	if (part->parent == NULL && include_hdr &&
 	    mail->data.bin_parts == NULL) {
 		binary_parts_update(&ctx, part, &mail->data.bin_parts);
-		if (_mail->uid > 0)
+		if (_mail->uid > 0 || _mail->saving)
 			binary_parts_cache(&ctx);
 	}
 	binary_streams_free(&ctx);
@@ -544,6 +544,33 @@ index_mail_get_binary_size(struct mail *_mail,
 	return 0;
 }
 
+int index_mail_precache_binary_parts(struct index_mail *mail)
+{
+	struct message_part *parts;
+	unsigned int lines;
+	uoff_t size;
+
+	if (mail_get_parts(&mail->mail.mail, &parts) < 0)
+		return -1;
+	return index_mail_get_binary_size(&mail->mail.mail, parts, TRUE,
+					  &size, &lines);
+}
+
+void index_mail_save_binary_parts(struct mail *_mail)
+{
+	struct index_mail *mail = INDEX_MAIL(_mail);
+
+	if (!mail->data.save_binary_parts || mail->data.no_caching)
+		return;
+	mail->data.save_binary_parts = FALSE;
+
+	/* the mail was already saved successfully, so don't let a failure
+	   here change the storage's error */
+	mail_storage_last_error_push(_mail->box->storage);
+	(void)index_mail_precache_binary_parts(mail);
+	mail_storage_last_error_pop(_mail->box->storage);
+}
+
 int index_mail_get_binary_stream(struct mail *_mail,
 				 const struct message_part *part,
 				 bool include_hdr, uoff_t *size_r,
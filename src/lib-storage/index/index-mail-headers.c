@@ -403,6 +403,12 @@ index_mail_cache_parse_init(struct mail *_mail, struct istream *input)
 	   not as cheap as the others to generate. */
 	if (index_mail_want_cache(mail, MAIL_CACHE_BODY_SNIPPET))
 		mail->data.save_body_snippet = TRUE;
+	/* Clients are using BINARY.SIZE. Decode the mail after it's
+	   saved, so BINARY.SIZE won't need to decode it later. */
+	if (mail_cache_field_want_add(_mail->transaction->cache_trans,
+			_mail->seq,
+			mail->ibox->cache_fields[MAIL_CACHE_BINARY_PARTS].idx))
+		mail->data.save_binary_parts = TRUE;
 
 	mail->data.tee_stream = tee_i_stream_create(input);
 	input = tee_i_stream_create_child(mail->data.tee_stream);
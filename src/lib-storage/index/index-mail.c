@@ -2193,20 +2193,16 @@ void index_mail_set_seq(struct mail *_mail, uint32_t seq, bool saving)
 	mail->data.initialized = TRUE;
 }
 
-bool index_mail_prefetch(struct mail *_mail)
+bool index_mail_prefetch_stream(struct mail *_mail)
 {
 	struct index_mail *mail = INDEX_MAIL(_mail);
 /* HAVE_POSIX_FADVISE alone isn't enough for CentOS 4.9 */
 #if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
-	struct mail_storage *storage = _mail->box->storage;
 	struct istream *input;
-	off_t len;
+	uoff_t size;
+	off_t offset, len;
 	int fd;
 
-	if ((storage->class_flags & MAIL_STORAGE_CLASS_FLAG_FILE_PER_MSG) == 0) {
-		/* we're handling only file-per-msg storages for now. */
-		return TRUE;
-	}
 	if (mail->data.access_part == 0) {
 		/* everything we need is cached */
 		return TRUE;
@@ -2218,14 +2214,21 @@ bool index_mail_prefetch(struct mail *_mail)
 			return TRUE;
 	}
 
-	/* tell OS to start reading the file into memory */
+	/* tell OS to start reading the mail into memory. the mail may be
+	   only a part of the file, so use the stream's offset and size
+	   within it. */
 	fd = i_stream_get_fd(mail->data.stream);
 	if (fd != -1) {
+		offset = i_stream_get_absolute_offset(mail->data.stream);
+		if (i_stream_get_size(mail->data.stream, FALSE, &size) <= 0)
+			size = 0;
 		if ((mail->data.access_part & (READ_BODY | PARSE_BODY)) != 0)
-			len = 0;
+			len = size;
+		else if (size != 0 && size < MAIL_READ_HDR_BLOCK_SIZE)
+			len = size;
 		else
 			len = MAIL_READ_HDR_BLOCK_SIZE;
-		if (posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED) < 0) {
+		if (posix_fadvise(fd, offset, len, POSIX_FADV_WILLNEED) < 0) {
 			e_error(mail_event(_mail),
 				"posix_fadvise(%s) failed: %m",
 				i_stream_get_name(mail->data.stream));
@@ -2236,6 +2239,19 @@ bool index_mail_prefetch(struct mail *_mail)
 	return !mail->data.prefetch_sent;
 }
 
+bool index_mail_prefetch(struct mail *_mail)
+{
+	struct mail_storage *storage = _mail->box->storage;
+
+	if ((storage->class_flags & MAIL_STORAGE_CLASS_FLAG_FILE_PER_MSG) == 0) {
+		/* opening the stream may be expensive for other storages,
+		   they need to call index_mail_prefetch_stream() themselves
+		   if it's cheap enough. */
+		return TRUE;
+	}
+	return index_mail_prefetch_stream(_mail);
+}
+
 bool index_mail_set_uid(struct mail *_mail, uint32_t uid)
 {
 	struct index_mail *mail = INDEX_MAIL(_mail);
@@ -2492,12 +2508,25 @@ void index_mail_expunge(struct mail *mail)
 static void index_mail_parse(struct mail *mail, bool parse_body)
 {
 	struct index_mail *imail = INDEX_MAIL(mail);
+	bool want_snippet = parse_body && imail->data.body_snippet == NULL &&
+		index_mail_want_cache(imail, MAIL_CACHE_BODY_SNIPPET);
+
+	if (want_snippet) {
+		/* Generate the snippet while we're parsing the mail anyway,
+		   so it's already cached when a client asks for PREVIEW.
+		   It's written from the parsed message parts. */
+		imail->data.save_bodystructure_header = TRUE;
+		imail->data.save_bodystructure_body = TRUE;
+		imail->data.save_body_snippet = TRUE;
+	}
 
 	imail->data.access_part |= PARSE_HDR;
 	if (index_mail_parse_headers(imail, NULL, "precache") == 0) {
 		if (parse_body) {
 			imail->data.access_part |= PARSE_BODY;
-			(void)index_mail_parse_body(imail, 0);
+			if (index_mail_parse_body(imail, 0) == 0 &&
+			    want_snippet && imail->data.parsed_bodystructure)
+				index_mail_save_finish_make_snippet(imail);
 		}
 	}
 }
@@ -2520,6 +2549,13 @@ int index_mail_precache(struct mail *mail)
 	cache = imail->data.wanted_fields;
 	if ((cache & (MAIL_FETCH_STREAM_HEADER | MAIL_FETCH_STREAM_BODY)) != 0)
 		index_mail_parse(mail, (cache & MAIL_FETCH_STREAM_BODY) != 0);
+	if ((cache & MAIL_FETCH_STREAM_BODY) != 0 &&
+	    mail_cache_field_want_add(mail->transaction->cache_trans, mail->seq,
+			imail->ibox->cache_fields[MAIL_CACHE_BINARY_PARTS].idx)) {
+		/* clients are using BINARY/BINARY.SIZE. decode the mail now
+		   so they don't need to wait for it later. */
+		(void)index_mail_precache_binary_parts(imail);
+	}
 	if ((cache & MAIL_FETCH_RECEIVED_DATE) != 0)
 		(void)mail_get_received_date(mail, &date);
 	if ((cache & MAIL_FETCH_SAVE_DATE) != 0)
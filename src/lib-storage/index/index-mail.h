@@ -114,6 +114,7 @@ struct index_mail_data {
 	bool save_bodystructure_body:1;
 	bool save_message_parts:1;
 	bool save_body_snippet:1;
+	bool save_binary_parts:1;
 	bool stream_has_only_header:1;
 	bool parsed_bodystructure:1;
 	bool parsed_bodystructure_header:1;
@@ -179,6 +180,9 @@ void index_mail_set_seq(struct mail *mail, uint32_t seq, bool saving);
 bool index_mail_set_uid(struct mail *mail, uint32_t uid);
 void index_mail_set_uid_cache_updates(struct mail *mail, bool set);
 bool index_mail_prefetch(struct mail *mail);
+/* Open the mail stream and ask the OS to start reading the parts of it
+   that are going to be accessed. Returns TRUE if nothing was prefetched. */
+bool index_mail_prefetch_stream(struct mail *mail);
 void index_mail_add_temp_wanted_fields(struct mail *mail,
 				       enum mail_fetch_field fields,
 				       struct mailbox_header_lookup_ctx *headers);
@@ -239,6 +243,11 @@ int index_mail_get_binary_stream(struct mail *_mail,
 				 bool include_hdr, uoff_t *size_r,
 				 unsigned int *body_lines_r, bool *binary_r,
 				 struct istream **stream_r);
+/* Add binary.parts to cache, decoding the message if it's not cached yet. */
+int index_mail_precache_binary_parts(struct index_mail *mail);
+/* Called by backends after the mail was successfully saved and can be read.
+   Adds binary.parts to cache if the caching decisions want it. */
+void index_mail_save_binary_parts(struct mail *mail);
 int index_mail_get_special(struct mail *_mail, enum mail_fetch_field field,
 			   const char **value_r);
 int index_mail_get_backend_mail(struct mail *mail, struct mail **real_mail_r);
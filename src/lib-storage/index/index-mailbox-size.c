@@ -25,6 +25,9 @@
    do nothing else. Otherwise, for each expunged mail whose UID <=
    last-indexed-uid, decrease the message count and the vsize in memory. After
    syncing is successfully committed, write the changes to header. Unlock.
+   The expunged mails' vsizes are looked up from the vsize records while the
+   storage notifies about the expunges (index_storage_sync_notify()), so
+   the header doesn't need to be rebuilt afterwards.
 
    Note that the final expunge handling with some mailbox formats is done while
    syncing is no longer locked. Because of this we need to have the vsize
@@ -263,6 +266,30 @@ void index_mailbox_vsize_hdr_expunge(struct mailbox_vsize_update *update,
 	update->vsize_hdr.vsize -= vsize;
 }
 
+void index_mailbox_vsize_hdr_expunge_uid(struct mailbox_vsize_update *update,
+					 uint32_t uid)
+{
+	const uint32_t *vsizep;
+	const void *data;
+	uint32_t seq;
+
+	if (uid > update->vsize_hdr.highest_uid)
+		return;
+	/* update->view was opened before syncing, so it still has the
+	   expunged mail */
+	if (!mail_index_lookup_seq(update->view, uid, &seq))
+		return;
+	mail_index_lookup_ext(update->view, seq, update->box->mail_vsize_ext_id,
+			      &data, NULL);
+	vsizep = data;
+	if (vsizep == NULL || *vsizep == 0) {
+		/* vsize isn't known without opening the mail. the message
+		   count won't match afterwards, which causes a rebuild. */
+		return;
+	}
+	index_mailbox_vsize_hdr_expunge(update, uid, *vsizep - 1);
+}
+
 static void
 index_mailbox_vsize_finish_bg(struct mailbox_vsize_update *update,
 			      bool require_result)
@@ -9,6 +9,10 @@ void index_mailbox_vsize_update_deinit(struct mailbox_vsize_update **update);
 
 void index_mailbox_vsize_hdr_expunge(struct mailbox_vsize_update *update,
 				     uint32_t uid, uoff_t vsize);
+/* Like index_mailbox_vsize_hdr_expunge(), but look up the vsize from the
+   mail's vsize record. If it's not known, the header is rebuilt later. */
+void index_mailbox_vsize_hdr_expunge_uid(struct mailbox_vsize_update *update,
+					 uint32_t uid);
 
 bool index_mailbox_vsize_update_try_lock(struct mailbox_vsize_update *update);
 bool index_mailbox_vsize_update_wait_lock(struct mailbox_vsize_update *update);
@@ -0,0 +1,317 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "str.h"
+#include "strescape.h"
+#include "strnum.h"
+#include "istream.h"
+#include "ostream.h"
+#include "safe-mkstemp.h"
+#include "seq-range-array.h"
+#include "imap-seqset.h"
+#include "imap-util.h"
+#include "mail-search.h"
+#include "index-storage.h"
+#include "index-search-private.h"
+
+#include <stdio.h>
+
+/* The file contains a header line "<version> <uid_validity>" followed by
+   the most recently updated searches, one per line:
+
+   <tab-escaped search args> <last UID> <matching UIDs up to last UID>
+
+   Only searches whose result can never change for an existing mail are
+   cached, so the entries don't need to be invalidated. Expunged mails are
+   simply never looked up. */
+#define INDEX_SEARCH_CACHE_SUFFIX ".search-cache"
+#define INDEX_SEARCH_CACHE_VERSION 1
+#define INDEX_SEARCH_CACHE_MAX_ENTRIES 8
+
+static bool index_search_cache_arg_is_cacheable(struct mail_search_arg *arg,
+						bool *expensive)
+{
+	struct mail_search_arg *subarg;
+
+	switch (arg->type) {
+	case SEARCH_OR:
+	case SEARCH_SUB:
+		subarg = arg->value.subargs;
+		for (; subarg != NULL; subarg = subarg->next) {
+			if (!index_search_cache_arg_is_cacheable(subarg,
+								 expensive))
+				return FALSE;
+		}
+		return TRUE;
+	case SEARCH_ALL:
+	case SEARCH_UIDSET:
+		return TRUE;
+	case SEARCH_BEFORE:
+	case SEARCH_ON:
+	case SEARCH_SINCE:
+	case SEARCH_SMALLER:
+	case SEARCH_LARGER:
+	case SEARCH_HEADER:
+	case SEARCH_HEADER_ADDRESS:
+	case SEARCH_HEADER_COMPRESS_LWSP:
+	case SEARCH_BODY:
+	case SEARCH_TEXT:
+	case SEARCH_GUID:
+	case SEARCH_MIMEPART:
+		/* these need to look up data from the cache or the mail */
+		*expensive = TRUE;
+		return TRUE;
+	case SEARCH_SEQSET:
+	case SEARCH_FLAGS:
+	case SEARCH_KEYWORDS:
+	case SEARCH_MODSEQ:
+	case SEARCH_INTHREAD:
+	case SEARCH_SAVEDATESUPPORTED:
+	case SEARCH_MAILBOX:
+	case SEARCH_MAILBOX_GUID:
+	case SEARCH_MAILBOX_GLOB:
+	case SEARCH_REAL_UID:
+		break;
+	}
+	return FALSE;
+}
+
+static const char *
+index_search_cache_get_key(struct index_search_context *ctx)
+{
+	struct mail_search_arg *arg;
+	const char *error;
+	bool expensive = FALSE;
+	string_t *key;
+
+	for (arg = ctx->mail_ctx.args->args; arg != NULL; arg = arg->next) {
+		if (!index_search_cache_arg_is_cacheable(arg, &expensive))
+			return NULL;
+	}
+	if (!expensive) {
+		/* searching is cheap anyway */
+		return NULL;
+	}
+
+	key = t_str_new(128);
+	if (!mail_search_args_to_imap(key, ctx->mail_ctx.args->args, &error))
+		return NULL;
+	/* dates that aren't at day boundaries are written relative to the
+	   current time, so the key would mean something else tomorrow */
+	if (strstr(str_c(key), "OLDER ") != NULL ||
+	    strstr(str_c(key), "YOUNGER ") != NULL)
+		return NULL;
+	return str_c(key);
+}
+
+static const char *index_search_cache_get_path(struct mailbox *box)
+{
+	return t_strconcat(box->index->filepath, INDEX_SEARCH_CACHE_SUFFIX,
+			   NULL);
+}
+
+static void
+index_search_cache_set_corrupted(struct mailbox *box, const char *path,
+				 const char *reason)
+{
+	e_error(box->event, "Corrupted search cache file %s: %s",
+		path, reason);
+	i_unlink(path);
+}
+
+/* Read the cache file. The entry matching the key is parsed into ctx, and
+   the other valid entries are added to other_entries. */
+static void
+index_search_cache_read(struct index_search_context *ctx, const char *key,
+			ARRAY_TYPE(const_string) *other_entries)
+{
+	struct mailbox *box = ctx->box;
+	const char *path = index_search_cache_get_path(box);
+	const char *line, *const *args;
+	struct istream *input;
+	unsigned int version;
+	uint32_t uid_validity, last_uid;
+
+	input = i_stream_create_file(path, SIZE_MAX);
+	line = i_stream_read_next_line(input);
+	if (line == NULL) {
+		if (input->stream_errno != 0 && input->stream_errno != ENOENT) {
+			e_error(box->event, "read(%s) failed: %s", path,
+				i_stream_get_error(input));
+		}
+		i_stream_unref(&input);
+		return;
+	}
+	args = t_strsplit_spaces(line, " ");
+	if (str_array_length(args) != 2 ||
+	    str_to_uint(args[0], &version) < 0 ||
+	    str_to_uint32(args[1], &uid_validity) < 0) {
+		index_search_cache_set_corrupted(box, path, "Invalid header");
+		i_stream_unref(&input);
+		return;
+	}
+	if (version != INDEX_SEARCH_CACHE_VERSION ||
+	    uid_validity != mail_index_get_header(ctx->view)->uid_validity) {
+		/* it'll be recreated */
+		i_stream_unref(&input);
+		return;
+	}
+
+	while ((line = i_stream_read_next_line(input)) != NULL) {
+		args = t_strsplit_tabescaped(line);
+		if (str_array_length(args) != 3 ||
+		    str_to_uint32(args[1], &last_uid) < 0) {
+			index_search_cache_set_corrupted(box, path,
+							 "Invalid entry");
+			array_clear(other_entries);
+			ctx->search_cache_last_uid = 0;
+			break;
+		}
+		if (strcmp(args[0], key) != 0) {
+			if (array_count(other_entries) + 1 <
+			    INDEX_SEARCH_CACHE_MAX_ENTRIES) {
+				line = t_strdup(line);
+				array_push_back(other_entries, &line);
+			}
+			continue;
+		}
+		if (args[2][0] != '\0' &&
+		    imap_seq_set_nostar_parse(args[2],
+					      &ctx->search_cache_uids) < 0) {
+			index_search_cache_set_corrupted(box, path,
+							 "Invalid UIDs");
+			array_clear(other_entries);
+			array_clear(&ctx->search_cache_uids);
+			break;
+		}
+		ctx->search_cache_last_uid = last_uid;
+	}
+	if (input->stream_errno != 0) {
+		e_error(box->event, "read(%s) failed: %s", path,
+			i_stream_get_error(input));
+	}
+	i_stream_unref(&input);
+}
+
+static void
+index_search_cache_write(struct index_search_context *ctx,
+			 const ARRAY_TYPE(const_string) *other_entries)
+{
+	struct mailbox *box = ctx->box;
+	struct mail_index *index = box->index;
+	const char *path = index_search_cache_get_path(box);
+	const char *temp_path, *entry;
+	struct ostream *output;
+	string_t *str;
+	int fd, ret = 0;
+
+	str = t_str_new(256);
+	str_append(str, path);
+	fd = safe_mkstemp_hostpid_group(str, index->set.mode, index->set.gid,
+					index->set.gid_origin);
+	temp_path = str_c(str);
+	if (fd == -1) {
+		e_error(box->event, "safe_mkstemp_hostpid(%s) failed: %m",
+			temp_path);
+		return;
+	}
+
+	str = t_str_new(256);
+	str_printfa(str, "%u %u\n", INDEX_SEARCH_CACHE_VERSION,
+		    mail_index_get_header(ctx->view)->uid_validity);
+	/* the most recently updated entry first */
+	str_append_tabescaped(str, ctx->search_cache_key);
+	str_printfa(str, "\t%u\t", ctx->search_cache_next_last_uid);
+	imap_write_seq_range(str, &ctx->search_cache_new_uids);
+	str_append_c(str, '\n');
+
+	output = o_stream_create_fd(fd, 0);
+	o_stream_cork(output);
+	o_stream_nsend(output, str_data(str), str_len(str));
+	array_foreach_elem(other_entries, entry) {
+		o_stream_nsend_str(output, entry);
+		o_stream_nsend(output, "\n", 1);
+	}
+	if (o_stream_finish(output) < 0) {
+		e_error(box->event, "write(%s) failed: %s",
+			temp_path, o_stream_get_error(output));
+		ret = -1;
+	}
+	o_stream_destroy(&output);
+	if (close(fd) < 0) {
+		e_error(box->event, "close(%s) failed: %m", temp_path);
+		ret = -1;
+	} else if (ret == 0 && rename(temp_path, path) < 0) {
+		e_error(box->event, "rename(%s, %s) failed: %m",
+			temp_path, path);
+		ret = -1;
+	}
+	if (ret < 0)
+		i_unlink(temp_path);
+}
+
+void index_search_cache_init(struct index_search_context *ctx)
+{
+	struct mailbox *box = ctx->box;
+	ARRAY_TYPE(const_string) other_entries;
+	const char *key;
+	unsigned int count;
+
+	if (!box->storage->set->mail_search_result_cache ||
+	    mail_index_is_in_memory(box->index) ||
+	    box->virtual_vfuncs != NULL ||
+	    ctx->mail_ctx.args->stop_on_nonmatch)
+		return;
+
+	T_BEGIN {
+		key = index_search_cache_get_key(ctx);
+		if (key != NULL) {
+			ctx->search_cache_key = i_strdup(key);
+			i_array_init(&ctx->search_cache_uids, 32);
+			i_array_init(&ctx->search_cache_new_uids, 32);
+			t_array_init(&other_entries, 8);
+			index_search_cache_read(ctx, key, &other_entries);
+		}
+	} T_END;
+	if (ctx->search_cache_key == NULL)
+		return;
+
+	count = mail_index_view_get_messages_count(ctx->view);
+	if (count > 0) {
+		mail_index_lookup_uid(ctx->view, count,
+				      &ctx->search_cache_next_last_uid);
+	}
+}
+
+void index_search_cache_add_match(struct index_search_context *ctx,
+				  uint32_t uid)
+{
+	if (ctx->search_cache_key != NULL)
+		seq_range_array_add(&ctx->search_cache_new_uids, uid);
+}
+
+void index_search_cache_deinit(struct index_search_context *ctx)
+{
+	ARRAY_TYPE(const_string) other_entries;
+	const char *key = ctx->search_cache_key;
+
+	if (key == NULL)
+		return;
+
+	if (ctx->search_cache_finished && !ctx->failed &&
+	    ctx->mail_ctx.sort_limit == 0 &&
+	    ctx->search_cache_next_last_uid > ctx->search_cache_last_uid) T_BEGIN {
+		/* re-read the file, another process may have changed it */
+		t_array_init(&other_entries, 8);
+		ctx->search_cache_last_uid = 0;
+		array_clear(&ctx->search_cache_uids);
+		index_search_cache_read(ctx, key, &other_entries);
+		if (ctx->search_cache_last_uid < ctx->search_cache_next_last_uid)
+			index_search_cache_write(ctx, &other_entries);
+	} T_END;
+
+	array_free(&ctx->search_cache_uids);
+	array_free(&ctx->search_cache_new_uids);
+	i_free(ctx->search_cache_key);
+}
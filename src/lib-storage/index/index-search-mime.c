@@ -18,7 +18,7 @@ struct search_mimepart_context {
 	pool_t pool;
 	struct index_search_context *index_ctx;
 
-	/* message parts parsed from BODYSTRUCTURE */
+	/* message parts parsed from BODY or BODYSTRUCTURE */
 	struct message_part *mime_parts, *mime_part;
 
 	string_t *buf;
@@ -525,13 +525,63 @@ static int seach_arg_mime_parts_match(struct search_mimepart_context *mpctx,
 	return 0;
 }
 
-/* Returns >0 = matched, 0 = not matched, -1 = unknown */
-static int search_arg_match_mimepart(struct search_mimepart_context *mpctx,
-				   struct mail_search_arg *arg)
+static bool
+search_mime_args_need_extension_data(struct mail_search_mime_arg *arg)
+{
+	for (; arg != NULL; arg = arg->next) {
+		switch (arg->type) {
+		case SEARCH_MIME_OR:
+		case SEARCH_MIME_SUB:
+		case SEARCH_MIME_PARENT:
+		case SEARCH_MIME_CHILD:
+			if (search_mime_args_need_extension_data(
+				arg->value.subargs))
+				return TRUE;
+			break;
+		case SEARCH_MIME_DISPOSITION_TYPE:
+		case SEARCH_MIME_DISPOSITION_PARAM:
+		case SEARCH_MIME_LANGUAGE:
+		case SEARCH_MIME_LOCATION:
+		case SEARCH_MIME_MD5:
+		case SEARCH_MIME_FILENAME_IS:
+		case SEARCH_MIME_FILENAME_CONTAINS:
+		case SEARCH_MIME_FILENAME_BEGINS:
+		case SEARCH_MIME_FILENAME_ENDS:
+			return TRUE;
+		default:
+			break;
+		}
+	}
+	return FALSE;
+}
+
+static int search_mimepart_get_parts(struct search_mimepart_context *mpctx,
+				     struct mail_search_arg *arg)
 {
 	struct index_search_context *ctx = mpctx->index_ctx;
+	enum mail_fetch_field field;
 	const char *bodystructure, *error;
 
+	/* The extension data exists only in BODYSTRUCTURE. If it's not
+	   needed, BODY is enough. BODY can also be generated from a cached
+	   BODYSTRUCTURE, so this way the mail needs to be opened only if
+	   neither is cached. */
+	if (search_mime_args_need_extension_data(arg->value.mime_part->args))
+		field = MAIL_FETCH_IMAP_BODYSTRUCTURE;
+	else
+		field = MAIL_FETCH_IMAP_BODY;
+	if (mail_get_special(ctx->cur_mail, field, &bodystructure) < 0)
+		return -1;
+	if (imap_bodystructure_parse_full(bodystructure, mpctx->pool,
+					  &mpctx->mime_parts, &error) < 0)
+		return -1;
+	return 0;
+}
+
+/* Returns >0 = matched, 0 = not matched, -1 = unknown */
+static int search_arg_match_mimepart(struct search_mimepart_context *mpctx,
+				   struct mail_search_arg *arg)
+{
 	if (arg->type != SEARCH_MIMEPART)
 		return -1;
 
@@ -541,13 +591,7 @@ static int search_arg_match_mimepart(struct search_mimepart_context *mpctx,
 		p_array_init(&mpctx->stack, mpctx->pool, 16);
 	}
 	if (mpctx->mime_parts == NULL) {
-		/* FIXME: could the mail object already have message_part tree with
-		   data? */
-		if (mail_get_special(ctx->cur_mail,
-			MAIL_FETCH_IMAP_BODYSTRUCTURE, &bodystructure) < 0)
-			return -1;
-		if (imap_bodystructure_parse_full(bodystructure, mpctx->pool,
-			&mpctx->mime_parts, &error) < 0)
+		if (search_mimepart_get_parts(mpctx, arg) < 0)
 			return -1;
 	}
 
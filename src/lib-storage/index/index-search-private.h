@@ -28,16 +28,39 @@ struct index_search_context {
 	struct timeval interrupt_start_time;
 	unsigned long long cost, next_time_check_cost;
 
+	/* mail_search_result_cache: The cached search is matched by
+	   search_cache_uids for UIDs up to search_cache_last_uid. The returned
+	   matches are collected to search_cache_new_uids, which are saved
+	   for UIDs up to search_cache_next_last_uid once the search has
+	   finished. */
+	char *search_cache_key;
+	uint32_t search_cache_last_uid, search_cache_next_last_uid;
+	ARRAY_TYPE(seq_range) search_cache_uids;
+	ARRAY_TYPE(seq_range) search_cache_new_uids;
+
+	/* If the search has only flag, keyword and modseq args (besides
+	   seqsets), this contains the messages whose flags and modseqs
+	   match. index_match_idx points to the range containing the current
+	   sequence. */
+	ARRAY_TYPE(seq_range) index_match_seqs;
+	unsigned int index_match_idx;
+
 	bool failed:1;
 	bool sorted:1;
 	bool have_seqsets:1;
 	bool have_index_args:1;
 	bool have_mailbox_args:1;
 	bool have_nonmatch_always:1;
+	bool search_cache_finished:1;
 };
 
 struct mail *index_search_get_mail(struct index_search_context *ctx);
 
+void index_search_cache_init(struct index_search_context *ctx);
+void index_search_cache_add_match(struct index_search_context *ctx,
+				  uint32_t uid);
+void index_search_cache_deinit(struct index_search_context *ctx);
+
 int index_search_mime_arg_match(struct mail_search_arg *args,
 	struct index_search_context *ctx);
 void index_search_mime_arg_deinit(struct mail_search_arg *arg,
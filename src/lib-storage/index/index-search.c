@@ -1156,6 +1156,126 @@ static void search_get_seqset(struct index_search_context *ctx,
 	}
 }
 
+static bool
+search_flags_filter_add_arg(struct index_search_context *ctx,
+			    struct mail_search_arg *arg,
+			    struct mail_index_flags_filter *filter,
+			    enum mail_flags *unset_flags, bool *never_r)
+{
+	const struct mail_keywords *kws;
+	enum mail_flags flags;
+
+	switch (arg->type) {
+	case SEARCH_ALL:
+		return !arg->match_not;
+	case SEARCH_FLAGS:
+		flags = arg->value.flags;
+		if ((flags & MAIL_RECENT) != 0 ||
+		    (flags & mailbox_get_private_flags_mask(ctx->box)) != 0) {
+			/* these aren't in the index records */
+			return FALSE;
+		}
+		if (!arg->match_not)
+			filter->flags |= flags;
+		else if (flags != 0 && (flags & (flags - 1)) == 0)
+			*unset_flags |= flags;
+		else {
+			/* NOT with multiple flags can't be expressed
+			   as a mask */
+			return FALSE;
+		}
+		return TRUE;
+	case SEARCH_KEYWORDS:
+		kws = arg->initialized.keywords;
+		if (kws == NULL)
+			return FALSE;
+		if (!arg->match_not) {
+			/* invalid keywords never match */
+			if (kws->count == 0)
+				*never_r = TRUE;
+			array_append(&filter->keywords_set, kws->idx,
+				     kws->count);
+		} else if (kws->count <= 1) {
+			array_append(&filter->keywords_unset, kws->idx,
+				     kws->count);
+		} else {
+			return FALSE;
+		}
+		return TRUE;
+	case SEARCH_MODSEQ:
+		if (arg->match_not || arg->value.flags != 0 ||
+		    arg->initialized.keywords != NULL) {
+			/* per-flag modseqs aren't in the modseq records */
+			return FALSE;
+		}
+		filter->min_modseq = I_MAX(filter->min_modseq,
+					   arg->value.modseq->modseq);
+		return TRUE;
+	case SEARCH_SEQSET:
+	case SEARCH_UIDSET:
+		/* these have already limited seq1..seq2, and all the args
+		   are still matched for each found message */
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static void search_build_index_matches(struct index_search_context *ctx)
+{
+	struct mail_index_flags_filter filter;
+	struct mail_search_arg *arg;
+	enum mail_flags unset_flags = 0;
+	bool never = FALSE;
+
+	if (!ctx->have_index_args || ctx->seq1 > ctx->seq2)
+		return;
+
+	/* If the search consists only of flags, keywords and modseqs, find
+	   the matching messages directly from the index records. This avoids
+	   going through the search args for every non-matching message. For
+	   example FETCH CHANGEDSINCE jumps directly to the changed messages. */
+	T_BEGIN {
+		i_zero(&filter);
+		t_array_init(&filter.keywords_set, 4);
+		t_array_init(&filter.keywords_unset, 4);
+		arg = ctx->mail_ctx.args->args;
+		for (; arg != NULL; arg = arg->next) {
+			if (!search_flags_filter_add_arg(ctx, arg, &filter,
+							 &unset_flags, &never))
+				break;
+		}
+		if (arg == NULL) {
+			if ((filter.flags & unset_flags) != 0)
+				never = TRUE;
+			filter.flags_mask = filter.flags | unset_flags;
+			i_array_init(&ctx->index_match_seqs, 32);
+			if (!never) {
+				mail_index_lookup_seqs_by_flags(ctx->view,
+					ctx->seq1, ctx->seq2, &filter,
+					&ctx->index_match_seqs);
+			}
+		}
+	} T_END;
+}
+
+/* Move the current sequence to the next message whose flags match. */
+static void search_index_matches_skip(struct index_search_context *ctx)
+{
+	const struct seq_range *range;
+	unsigned int count;
+
+	range = array_get(&ctx->index_match_seqs, &count);
+	while (ctx->index_match_idx < count &&
+	       range[ctx->index_match_idx].seq2 < ctx->mail_ctx.seq)
+		ctx->index_match_idx++;
+
+	if (ctx->index_match_idx == count)
+		ctx->mail_ctx.seq = ctx->seq2 + 1;
+	else if (ctx->mail_ctx.seq < range[ctx->index_match_idx].seq1)
+		ctx->mail_ctx.seq = range[ctx->index_match_idx].seq1;
+}
+
 static int search_build_subthread(struct mail_thread_iterate_context *iter,
 				  ARRAY_TYPE(seq_range) *uids)
 {
@@ -1338,6 +1458,7 @@ index_storage_search_init(struct mailbox_transaction_context *t,
 		     sizeof(void *), 5);
 	i_array_init(&ctx->mail_ctx.mails, ctx->mail_ctx.max_mails);
 
+	mail_search_args_sort_by_cost(args);
 	mail_search_args_reset(ctx->mail_ctx.args->args, TRUE);
 	if (args->have_inthreads) {
 		if (mail_thread_init(t->box, NULL, &ctx->thread_ctx) < 0)
@@ -1358,6 +1479,8 @@ index_storage_search_init(struct mailbox_transaction_context *t,
 
 	search_get_seqset(ctx, status.messages, args->args);
 	(void)mail_search_args_foreach(args->args, search_init_arg, ctx);
+	index_search_cache_init(ctx);
+	search_build_index_matches(ctx);
 
 	/* Need to reset results for match_always cases */
 	mail_search_args_reset(ctx->mail_ctx.args->args, FALSE);
@@ -1389,6 +1512,9 @@ int index_storage_search_deinit(struct mail_search_context *_ctx)
 
 	ret = ctx->failed ? -1 : 0;
 
+	index_search_cache_deinit(ctx);
+	if (array_is_created(&ctx->index_match_seqs))
+		array_free(&ctx->index_match_seqs);
 	mail_search_args_reset(ctx->mail_ctx.args->args, FALSE);
 	(void)mail_search_args_foreach(ctx->mail_ctx.args->args,
 				       search_arg_deinit, ctx);
@@ -1860,8 +1986,11 @@ bool index_storage_search_next_nonblock(struct mail_search_context *_ctx,
 			*tryagain_r = TRUE;
 			return FALSE;
 		}
-		if (ret < 0)
+		if (ret < 0) {
+			ctx->search_cache_finished = TRUE;
 			return FALSE;
+		}
+		index_search_cache_add_match(ctx, mail->uid);
 		*mail_r = mail;
 		return TRUE;
 	}
@@ -1878,18 +2007,23 @@ bool index_storage_search_next_nonblock(struct mail_search_context *_ctx,
 		/* finished searching the messages. now sort them and start
 		   returning the messages. */
 		ctx->sorted = TRUE;
+		index_sort_program_set_limit(_ctx->sort_program,
+					     _ctx->sort_limit);
 		index_sort_list_finish(_ctx->sort_program);
 	}
 
 	/* everything searched at this point already. just returning
 	   matches from sort list. FIXME: we could do prefetching here also. */
-	if (!index_sort_list_next(_ctx->sort_program, &seq))
+	if (!index_sort_list_next(_ctx->sort_program, &seq)) {
+		ctx->search_cache_finished = TRUE;
 		return FALSE;
+	}
 
 	mailp = array_front(&ctx->mail_ctx.mails);
 	mail_set_seq(*mailp, seq);
 	index_mail_update_access_parts_pre(*mailp);
 	index_mail_update_access_parts_post(*mailp);
+	index_search_cache_add_match(ctx, (*mailp)->uid);
 	*mail_r = *mailp;
 	return TRUE;
 }
@@ -1908,13 +2042,19 @@ bool index_storage_search_next_update_seq(struct mail_search_context *_ctx)
 	}
 
 	if (!ctx->have_seqsets && !ctx->have_index_args &&
-	    !ctx->have_nonmatch_always && _ctx->update_result == NULL) {
+	    !ctx->have_nonmatch_always && _ctx->update_result == NULL &&
+	    ctx->search_cache_last_uid == 0) {
 		_ctx->progress_cur = _ctx->seq;
 		return _ctx->seq <= ctx->seq2;
 	}
 
 	ret = 0;
 	while (_ctx->seq <= ctx->seq2) {
+		if (array_is_created(&ctx->index_match_seqs)) {
+			search_index_matches_skip(ctx);
+			if (_ctx->seq > ctx->seq2)
+				break;
+		}
 		/* check if the sequence matches */
 		ret = mail_search_args_foreach(ctx->mail_ctx.args->args,
 					       search_seqset_arg, ctx);
@@ -1931,6 +2071,14 @@ bool index_storage_search_next_update_seq(struct mail_search_context *_ctx)
 					     uid))
 				ret = 0;
 		}
+		if (ret != 0 && ctx->search_cache_last_uid != 0) {
+			/* see if the cached search result says that this
+			   message doesn't match */
+			mail_index_lookup_uid(ctx->view, _ctx->seq, &uid);
+			if (uid <= ctx->search_cache_last_uid &&
+			    !seq_range_exists(&ctx->search_cache_uids, uid))
+				ret = 0;
+		}
 		if (ret != 0)
 			break;
 
@@ -1947,6 +2095,14 @@ bool index_storage_search_next_update_seq(struct mail_search_context *_ctx)
 			search_set_static_matches(_ctx->args->args);
 		}
 	}
+	if (ret != 0 && ctx->search_cache_last_uid != 0) {
+		mail_index_lookup_uid(ctx->view, _ctx->seq, &uid);
+		if (uid <= ctx->search_cache_last_uid) {
+			/* all the args are static and the cached search
+			   result says that they match */
+			search_set_static_matches(_ctx->args->args);
+		}
+	}
 	ctx->mail_ctx.progress_cur = _ctx->seq;
 	return ret != 0;
 }
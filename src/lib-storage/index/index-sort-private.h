@@ -2,6 +2,8 @@
 #define INDEX_SORT_PRIVATE_H
 
 #include "index-sort.h"
+#include "hash.h"
+#include "mail-cache.h"
 
 struct mail_search_sort_program {
 	struct mailbox_transaction_context *t;
@@ -16,8 +18,29 @@ struct mail_search_sort_program {
 
 	ARRAY_TYPE(uint32_t) seqs;
 	unsigned int iter_idx;
+	/* If non-zero, only this many first sorted mails are returned. */
+	unsigned int limit;
+
+	/* The primary sort key's cache field prefetched with
+	   mail_cache_lookup_field_multi() for prefetch_seq1..prefetch_seq2.
+	   Used only with large mailboxes. */
+	unsigned int prefetch_field_idx;
+	uint32_t prefetch_seq1, prefetch_seq2;
+	buffer_t *prefetch_buf;
+	ARRAY_TYPE(mail_cache_lookup_result) prefetch_results;
+	unsigned int prefetch_result_idx;
+
+	/* Header based sort keys looked up by index_sort_node_cmp_type(),
+	   indexed by [sort_program position][seq]. Comparisons get called
+	   many times for the same mails, so this avoids parsing the headers
+	   again each time. Identical keys (e.g. mails from the same sender)
+	   are allocated only once from header_key_pool. */
+	pool_t header_key_pool;
+	HASH_TABLE(const char *, const char *) header_key_strings;
+	ARRAY(const char *) header_keys[MAX_SORT_PROGRAM_SIZE];
 
 	bool failed;
+	bool prefetch:1;
 };
 
 /* Returns 1 on success, 0 if mail is already expunged, -1 on other errors. */
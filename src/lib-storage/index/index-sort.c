@@ -8,8 +8,15 @@
 #include "message-header-decode.h"
 #include "imap-base-subject.h"
 #include "index-storage.h"
+#include "index-mail.h"
 #include "index-sort-private.h"
 
+/* Prefetch the primary sort key from cache for mailboxes with at least this
+   many messages. */
+#define INDEX_SORT_PREFETCH_MIN_MESSAGES 1000
+/* How many sequences to prefetch at a time */
+#define INDEX_SORT_PREFETCH_COUNT 1024
+
 
 struct mail_sort_node_date {
 	uint32_t seq;
@@ -71,16 +78,109 @@ index_sort_program_set_date_failed(struct mail_search_sort_program *program,
 	}
 }
 
+static void
+index_sort_prefetch_init(struct mail_search_sort_program *program,
+			 enum index_cache_field field)
+{
+	struct mailbox *box = program->t->box;
+	struct index_mailbox_context *ibox = INDEX_STORAGE_CONTEXT(box);
+
+	if (ibox == NULL || box->view == NULL ||
+	    mail_index_view_get_messages_count(box->view) <
+	    INDEX_SORT_PREFETCH_MIN_MESSAGES)
+		return;
+
+	program->prefetch = TRUE;
+	program->prefetch_field_idx = ibox->cache_fields[field].idx;
+	program->prefetch_buf =
+		buffer_create_dynamic(default_pool,
+				      INDEX_SORT_PREFETCH_COUNT * 8);
+	i_array_init(&program->prefetch_results, INDEX_SORT_PREFETCH_COUNT);
+}
+
+static void
+index_sort_prefetch_deinit(struct mail_search_sort_program *program)
+{
+	if (!program->prefetch)
+		return;
+	buffer_free(&program->prefetch_buf);
+	array_free(&program->prefetch_results);
+	program->prefetch = FALSE;
+}
+
+static int
+index_sort_prefetch_fill(struct mail_search_sort_program *program,
+			 uint32_t seq)
+{
+	struct mailbox_transaction_context *t = program->t;
+	uint32_t messages_count = mail_index_view_get_messages_count(t->view);
+	ARRAY_TYPE(seq_range) seqs;
+
+	program->prefetch_seq1 = seq;
+	program->prefetch_seq2 = seq + INDEX_SORT_PREFETCH_COUNT - 1;
+	if (program->prefetch_seq2 > messages_count)
+		program->prefetch_seq2 = messages_count;
+	program->prefetch_result_idx = 0;
+	buffer_set_used_size(program->prefetch_buf, 0);
+	array_clear(&program->prefetch_results);
+
+	t_array_init(&seqs, 1);
+	seq_range_array_add_range(&seqs, program->prefetch_seq1,
+				  program->prefetch_seq2);
+	return mail_cache_lookup_field_multi(t->cache_view, &seqs,
+					     program->prefetch_field_idx,
+					     program->prefetch_buf,
+					     &program->prefetch_results);
+}
+
+static bool
+index_sort_prefetch_get(struct mail_search_sort_program *program,
+			struct mail *mail, void *data, size_t data_size)
+{
+	const struct mail_cache_lookup_result *results;
+	unsigned int idx, count;
+
+	if (!program->prefetch)
+		return FALSE;
+
+	if (mail->seq < program->prefetch_seq1 ||
+	    mail->seq > program->prefetch_seq2) {
+		if (index_sort_prefetch_fill(program, mail->seq) < 0) {
+			/* fall back to the normal lookups */
+			index_sort_prefetch_deinit(program);
+			return FALSE;
+		}
+	}
+
+	results = array_get(&program->prefetch_results, &count);
+	idx = program->prefetch_result_idx;
+	if (idx > 0 && results[idx-1].seq >= mail->seq)
+		idx = 0;
+	for (; idx < count && results[idx].seq < mail->seq; idx++) ;
+	program->prefetch_result_idx = idx;
+
+	if (idx == count || results[idx].seq != mail->seq ||
+	    results[idx].data_size != data_size)
+		return FALSE;
+	memcpy(data, CONST_PTR_OFFSET(program->prefetch_buf->data,
+				      results[idx].data_offset), data_size);
+	mail->transaction->stats.cache_hit_count++;
+	return TRUE;
+}
+
 static void
 index_sort_list_add_arrival(struct mail_search_sort_program *program,
 			    struct mail *mail)
 {
 	ARRAY_TYPE(mail_sort_node_date) *nodes = program->context;
 	struct mail_sort_node_date *node;
+	uint32_t t;
 
 	node = array_append_space(nodes);
 	node->seq = mail->seq;
-	if (mail_get_received_date(mail, &node->date) < 0)
+	if (index_sort_prefetch_get(program, mail, &t, sizeof(t)))
+		node->date = t;
+	else if (mail_get_received_date(mail, &node->date) < 0)
 		node->date = index_sort_program_set_date_failed(program, mail);
 }
 
@@ -90,11 +190,16 @@ index_sort_list_add_date(struct mail_search_sort_program *program,
 {
 	ARRAY_TYPE(mail_sort_node_date) *nodes = program->context;
 	struct mail_sort_node_date *node;
+	struct mail_sent_date sent_date;
 	int tz;
 
 	node = array_append_space(nodes);
 	node->seq = mail->seq;
-	if (mail_get_date(mail, &node->date, &tz) < 0)
+	if (index_sort_prefetch_get(program, mail, &sent_date,
+				    sizeof(sent_date)) &&
+	    sent_date.time != (uint32_t)-1 && sent_date.time != 0)
+		node->date = sent_date.time;
+	else if (mail_get_date(mail, &node->date, &tz) < 0)
 		node->date = index_sort_program_set_date_failed(program, mail);
 	else if (node->date == 0) {
 		if (mail_get_received_date(mail, &node->date) < 0)
@@ -111,7 +216,10 @@ index_sort_list_add_size(struct mail_search_sort_program *program,
 
 	node = array_append_space(nodes);
 	node->seq = mail->seq;
-	if (mail_get_virtual_size(mail, &node->size) < 0) {
+	if (index_sort_prefetch_get(program, mail, &node->size,
+				    sizeof(node->size)))
+		;
+	else if (mail_get_virtual_size(mail, &node->size) < 0) {
 		index_sort_program_set_mail_failed(program, mail);
 		node->size = 0;
 	}
@@ -196,6 +304,111 @@ void index_sort_list_add(struct mail_search_sort_program *program,
 	mail->lookup_abort = MAIL_LOOKUP_ABORT_NEVER;
 }
 
+static void
+index_sort_nodes_swap(unsigned char *data, size_t node_size,
+		      unsigned int idx1, unsigned int idx2)
+{
+	unsigned char tmp[32];
+
+	i_assert(node_size <= sizeof(tmp));
+	memcpy(tmp, data + idx1 * node_size, node_size);
+	memcpy(data + idx1 * node_size, data + idx2 * node_size, node_size);
+	memcpy(data + idx2 * node_size, tmp, node_size);
+}
+
+/* Mails are usually saved in the order they were received, so especially
+   ARRIVAL and DATE sorts often get the nodes already in the wanted order or
+   in exactly the reverse order. Checking this is much faster than sorting.
+   Returns TRUE if the nodes are now sorted. */
+static bool
+index_sort_nodes_presorted(void *nodes, unsigned int count, size_t node_size,
+			   int (*cmp)(const void *, const void *))
+{
+	unsigned char *data = nodes;
+	bool asc = TRUE, desc = TRUE;
+	unsigned int i;
+	int ret;
+
+	/* the comparison functions never return 0, since they finally
+	   compare the seqs */
+	for (i = 1; i < count && (asc || desc); i++) {
+		ret = cmp(data + (i-1) * node_size, data + i * node_size);
+		if (ret > 0)
+			asc = FALSE;
+		else
+			desc = FALSE;
+	}
+	if (asc)
+		return TRUE;
+	if (!desc)
+		return FALSE;
+
+	for (i = 0; i < count / 2; i++)
+		index_sort_nodes_swap(data, node_size, i, count - 1 - i);
+	return TRUE;
+}
+
+/* Partial quicksort: move the limit smallest nodes to the beginning of the
+   array in undefined order. */
+static void
+index_sort_nodes_select(void *nodes, unsigned int count, size_t node_size,
+			int (*cmp)(const void *, const void *),
+			unsigned int limit)
+{
+	unsigned char *data = nodes;
+	unsigned int left = 0, right = count - 1, i, pos;
+
+	i_assert(limit > 0 && limit < count);
+
+	while (left < right) {
+		index_sort_nodes_swap(data, node_size,
+				      left + (right - left) / 2, right);
+		pos = left;
+		for (i = left; i < right; i++) {
+			if (cmp(data + i * node_size,
+				data + right * node_size) < 0) {
+				index_sort_nodes_swap(data, node_size, i, pos);
+				pos++;
+			}
+		}
+		index_sort_nodes_swap(data, node_size, pos, right);
+
+		/* the pivot is now at its final position */
+		if (pos == limit || pos + 1 == limit)
+			break;
+		if (pos < limit)
+			left = pos + 1;
+		else
+			right = pos - 1;
+	}
+}
+
+static void
+index_sort_nodes_sort_i(struct mail_search_sort_program *program,
+			struct array *nodes,
+			int (*cmp)(const void *, const void *))
+{
+	unsigned int count;
+	void *data;
+
+	data = array_get_modifiable_i(nodes, &count);
+	if (index_sort_nodes_presorted(data, count, nodes->element_size, cmp))
+		return;
+	if (program->limit != 0 && program->limit < count) {
+		/* only the first nodes are wanted */
+		index_sort_nodes_select(data, count, nodes->element_size,
+					cmp, program->limit);
+		array_delete_i(nodes, program->limit, count - program->limit);
+	}
+	array_sort_i(nodes, cmp);
+}
+#define index_sort_nodes_sort(program, nodes, cmp) \
+	TYPE_CHECKS(void, \
+	CALLBACK_TYPECHECK(cmp, int (*)(typeof(*(nodes)->v), \
+					typeof(*(nodes)->v))), \
+	index_sort_nodes_sort_i(program, &(nodes)->arr, \
+		(int (*)(const void *, const void *))cmp))
+
 static int sort_node_date_cmp(const struct mail_sort_node_date *n1,
 			      const struct mail_sort_node_date *n2)
 {
@@ -216,7 +429,7 @@ index_sort_list_finish_date(struct mail_search_sort_program *program)
 {
 	ARRAY_TYPE(mail_sort_node_date) *nodes = program->context;
 
-	array_sort(nodes, sort_node_date_cmp);
+	index_sort_nodes_sort(program, nodes, sort_node_date_cmp);
 	memcpy(&program->seqs, nodes, sizeof(program->seqs));
 	i_free(nodes);
 	program->context = NULL;
@@ -242,7 +455,7 @@ index_sort_list_finish_size(struct mail_search_sort_program *program)
 {
 	ARRAY_TYPE(mail_sort_node_size) *nodes = program->context;
 
-	array_sort(nodes, sort_node_size_cmp);
+	index_sort_nodes_sort(program, nodes, sort_node_size_cmp);
 	memcpy(&program->seqs, nodes, sizeof(program->seqs));
 	i_free(nodes);
 	program->context = NULL;
@@ -271,7 +484,7 @@ index_sort_list_finish_float(struct mail_search_sort_program *program)
 	/* NOTE: higher relevancy is returned first, unlike with all
 	   other number based sort keys, so temporarily reverse the search */
 	static_node_cmp_context.reverse = !static_node_cmp_context.reverse;
-	array_sort(nodes, sort_node_float_cmp);
+	index_sort_nodes_sort(program, nodes, sort_node_float_cmp);
 	static_node_cmp_context.reverse = !static_node_cmp_context.reverse;
 
 	memcpy(&program->seqs, nodes, sizeof(program->seqs));
@@ -289,6 +502,17 @@ void index_sort_list_finish(struct mail_search_sort_program *program)
 	struct event_reason *reason = event_reason_begin("mailbox:sort");
 	program->sort_list_finish(program);
 	event_reason_end(&reason);
+
+	if (program->limit != 0 && array_count(&program->seqs) > program->limit) {
+		array_delete(&program->seqs, program->limit,
+			     array_count(&program->seqs) - program->limit);
+	}
+}
+
+void index_sort_program_set_limit(struct mail_search_sort_program *program,
+				  unsigned int limit)
+{
+	program->limit = limit;
 }
 
 bool index_sort_list_next(struct mail_search_sort_program *program,
@@ -412,10 +636,14 @@ index_sort_program_init(struct mailbox_transaction_context *t,
 		i_array_init(nodes, 128);
 
 		if ((program->sort_program[0] &
-		     MAIL_SORT_MASK) == MAIL_SORT_ARRIVAL)
+		     MAIL_SORT_MASK) == MAIL_SORT_ARRIVAL) {
 			program->sort_list_add = index_sort_list_add_arrival;
-		else
+			index_sort_prefetch_init(program,
+						 MAIL_CACHE_RECEIVED_DATE);
+		} else {
 			program->sort_list_add = index_sort_list_add_date;
+			index_sort_prefetch_init(program, MAIL_CACHE_SENT_DATE);
+		}
 		program->sort_list_finish = index_sort_list_finish_date;
 		program->context = nodes;
 		break;
@@ -428,6 +656,7 @@ index_sort_program_init(struct mailbox_transaction_context *t,
 		program->sort_list_add = index_sort_list_add_size;
 		program->sort_list_finish = index_sort_list_finish_size;
 		program->context = nodes;
+		index_sort_prefetch_init(program, MAIL_CACHE_VIRTUAL_FULL_SIZE);
 		break;
 	}
 	case MAIL_SORT_CC:
@@ -466,6 +695,21 @@ index_sort_program_init(struct mailbox_transaction_context *t,
 	return program;
 }
 
+static void
+index_sort_header_keys_deinit(struct mail_search_sort_program *program)
+{
+	unsigned int i;
+
+	if (program->header_key_pool == NULL)
+		return;
+	for (i = 0; i < MAX_SORT_PROGRAM_SIZE; i++) {
+		if (array_is_created(&program->header_keys[i]))
+			array_free(&program->header_keys[i]);
+	}
+	hash_table_destroy(&program->header_key_strings);
+	pool_unref(&program->header_key_pool);
+}
+
 int index_sort_program_deinit(struct mail_search_sort_program **_program)
 {
 	struct mail_search_sort_program *program = *_program;
@@ -474,6 +718,8 @@ int index_sort_program_deinit(struct mail_search_sort_program **_program)
 
 	if (program->context != NULL)
 		index_sort_list_finish(program);
+	index_sort_prefetch_deinit(program);
+	index_sort_header_keys_deinit(program);
 	mail_free(&program->temp_mail);
 	array_free(&program->seqs);
 
@@ -613,6 +859,51 @@ int index_sort_header_get(struct mail_search_sort_program *program, uint32_t seq
 	return 1;
 }
 
+static const char *
+index_sort_header_get_key(struct mail_search_sort_program *program,
+			  const enum mail_sort_type *sort_program, uint32_t seq)
+{
+	unsigned int pos = sort_program - program->sort_program;
+	const char *const *keyp;
+	const char *key;
+	string_t *str;
+	int ret;
+
+	i_assert(pos < MAX_SORT_PROGRAM_SIZE);
+
+	if (program->header_key_pool == NULL) {
+		program->header_key_pool =
+			pool_alloconly_create("sort header keys", 1024*16);
+		hash_table_create(&program->header_key_strings,
+				  program->header_key_pool, 0,
+				  str_hash, strcmp);
+	}
+	if (!array_is_created(&program->header_keys[pos]))
+		i_array_init(&program->header_keys[pos], 128);
+	else if (seq <= array_count(&program->header_keys[pos])) {
+		keyp = array_idx(&program->header_keys[pos], seq - 1);
+		if (*keyp != NULL)
+			return *keyp;
+	}
+
+	str = t_str_new(256);
+	ret = index_sort_header_get(program, seq, *sort_program, str);
+	if (ret < 0)
+		index_sort_program_set_mail_failed(program, program->temp_mail);
+	if (ret <= 0) {
+		/* don't cache failures */
+		return str_c(str);
+	}
+
+	key = hash_table_lookup(program->header_key_strings, str_c(str));
+	if (key == NULL) {
+		key = p_strdup(program->header_key_pool, str_c(str));
+		hash_table_insert(program->header_key_strings, key, key);
+	}
+	array_idx_set(&program->header_keys[pos], seq - 1, &key);
+	return key;
+}
+
 int index_sort_node_cmp_type(struct mail_search_sort_program *program,
 			     const enum mail_sort_type *sort_program,
 			     uint32_t seq1, uint32_t seq2)
@@ -633,16 +924,15 @@ int index_sort_node_cmp_type(struct mail_search_sort_program *program,
 	case MAIL_SORT_DISPLAYFROM:
 	case MAIL_SORT_DISPLAYTO:
 		T_BEGIN {
-			string_t *str1, *str2;
-
-			str1 = t_str_new(256);
-			str2 = t_str_new(256);
-			if (index_sort_header_get(program, seq1, sort_type, str1) < 0)
-				index_sort_program_set_mail_failed(program, mail);
-			if (index_sort_header_get(program, seq2, sort_type, str2) < 0)
-				index_sort_program_set_mail_failed(program, mail);
-
-			ret = strcmp(str_c(str1), str_c(str2));
+			const char *key1, *key2;
+
+			key1 = index_sort_header_get_key(program, sort_program,
+							 seq1);
+			key2 = index_sort_header_get_key(program, sort_program,
+							 seq2);
+			/* cached keys are unique, so equal pointers mean
+			   equal keys */
+			ret = key1 == key2 ? 0 : strcmp(key1, key2);
 		} T_END;
 		break;
 	case MAIL_SORT_ARRIVAL:
@@ -11,6 +11,9 @@ int index_sort_program_deinit(struct mail_search_sort_program **program);
 void index_sort_list_add(struct mail_search_sort_program *program,
 			 struct mail *mail);
 void index_sort_list_finish(struct mail_search_sort_program *program);
+/* Sort only the first limit mails and drop the rest when finishing. */
+void index_sort_program_set_limit(struct mail_search_sort_program *program,
+				  unsigned int limit);
 
 bool index_sort_list_next(struct mail_search_sort_program *program,
 			  uint32_t *seq_r);
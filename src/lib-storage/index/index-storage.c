@@ -168,6 +168,7 @@ void index_storage_lock_notify_reset(struct mailbox *box)
 static int
 index_mailbox_alloc_index(struct mailbox *box, struct mail_index **index_r)
 {
+	const struct mail_storage_settings *set = box->storage->set;
 	const char *index_dir, *mailbox_path;
 
 	if (mailbox_get_path_to(box, MAILBOX_LIST_PATH_TYPE_MAILBOX,
@@ -177,6 +178,8 @@ index_mailbox_alloc_index(struct mailbox *box, struct mail_index **index_r)
 	    mailbox_get_path_to(box, MAILBOX_LIST_PATH_TYPE_INDEX,
 				&index_dir) <= 0)
 		index_dir = NULL;
+	mail_index_alloc_cache_set_limits(set->mail_index_cache_max_count,
+					  set->mail_index_cache_timeout);
 	/* Note that this may cause box->event to live longer than box */
 	*index_r = mail_index_alloc_cache_get(box->event,
 					      mailbox_path, index_dir,
@@ -281,6 +284,7 @@ int index_storage_mailbox_alloc_index(struct mailbox *box)
 		.index = {
 			.rewrite_min_log_bytes = set->mail_index_rewrite_min_log_bytes,
 			.rewrite_max_log_bytes = set->mail_index_rewrite_max_log_bytes,
+			.rewrite_incremental_min_size = set->mail_index_rewrite_incremental_min_size,
 		},
 		.log = {
 			.min_size = set->mail_index_log_rotate_min_size,
@@ -298,6 +302,10 @@ int index_storage_mailbox_alloc_index(struct mailbox *box)
 			.purge_delete_percentage = set->mail_cache_purge_delete_percentage,
 			.purge_continued_percentage = set->mail_cache_purge_continued_percentage,
 			.purge_header_continue_count = set->mail_cache_purge_header_continue_count,
+			.columns_min_messages = set->mail_cache_columns_min_messages,
+			.dict_min_messages = set->mail_cache_dict_min_messages,
+			.fields_max_size = set->mail_cache_fields_max_size,
+			.field_bloom = set->mail_cache_field_bloom,
 		},
 	};
 	mail_index_set_optimization_settings(box->index, &optimization_set);
@@ -392,6 +400,16 @@ int index_storage_mailbox_open(struct mailbox *box, bool move_to_memory)
 	return 0;
 }
 
+static void index_storage_sync_notify(struct mailbox *box, uint32_t uid,
+				      enum mailbox_sync_type sync_type)
+{
+	struct index_mailbox_context *ibox = INDEX_STORAGE_CONTEXT(box);
+
+	if (sync_type == MAILBOX_SYNC_TYPE_EXPUNGE && uid != 0 &&
+	    ibox->vsize_update != NULL)
+		index_mailbox_vsize_hdr_expunge_uid(ibox->vsize_update, uid);
+}
+
 void index_storage_mailbox_alloc(struct mailbox *box, const char *vname,
 				 enum mailbox_flags flags,
 				 const char *index_prefix)
@@ -424,6 +442,8 @@ void index_storage_mailbox_alloc(struct mailbox *box, const char *vname,
 		ibox->index_flags |= MAIL_INDEX_OPEN_FLAG_DEBUG;
 	ibox->next_lock_notify = time(NULL) + LOCK_NOTIFY_INTERVAL;
 	MODULE_CONTEXT_SET(box, index_storage_module, ibox);
+	if (box->v.sync_notify == NULL)
+		box->v.sync_notify = index_storage_sync_notify;
 
 	box->inbox_user = strcmp(box->name, "INBOX") == 0 &&
 		(box->list->ns->flags & NAMESPACE_FLAG_INBOX_USER) != 0;
@@ -6,6 +6,9 @@
 #include "mail-index-strmap.h"
 
 #define MAIL_THREAD_INDEX_SUFFIX ".thread"
+/* The thread links built from the strmap, so that new sessions don't need
+   to rebuild them. */
+#define MAIL_THREAD_LINKS_SUFFIX ".thread.links"
 
 /* After initially building the index, assign first_invalid_msgid_idx to
    the next unused index + SKIP_COUNT. When more messages are added and
@@ -44,6 +47,34 @@ ARRAY_DEFINE_TYPE(mail_thread_node, struct mail_thread_node);
 #define MAIL_THREAD_NODE_EXISTS(node) \
 	((node)->uid != 0)
 
+struct mail_thread_links_header {
+#define MAIL_THREAD_LINKS_VERSION 1
+	uint8_t version;
+	uint8_t unused[3];
+
+	uint32_t uid_validity;
+	/* All messages up to this UID are in the links */
+	uint32_t last_uid;
+	/* Number and CRC32 of the strmap records up to last_uid. If they no
+	   longer match, messages were expunged or the string indexes were
+	   renumbered and the links can't be used anymore. */
+	uint32_t msgid_map_count;
+	uint32_t msgid_map_crc32;
+
+	uint32_t first_invalid_msgid_str_idx;
+	uint32_t next_invalid_msgid_str_idx;
+	uint32_t node_count;
+	/* struct mail_thread_links_rec[node_count] follows */
+};
+
+struct mail_thread_links_rec {
+	uint32_t uid;
+	uint32_t parent_idx;
+	/* parent_link_refcount << 2 | expunge_rebuilds << 1 |
+	   child_unref_rebuilds */
+	uint32_t refcount_flags;
+};
+
 struct mail_thread_cache {
 	uint32_t last_uid;
 	/* indexes used for invalid Message-IDs. that means no other messages
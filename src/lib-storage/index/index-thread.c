@@ -6,6 +6,10 @@
 #include "array.h"
 #include "bsearch-insert-pos.h"
 #include "hash2.h"
+#include "str.h"
+#include "ostream.h"
+#include "read-full.h"
+#include "safe-mkstemp.h"
 #include "message-id.h"
 #include "mail-search.h"
 #include "mail-search-build.h"
@@ -13,6 +17,8 @@
 #include "index-storage.h"
 #include "index-thread-private.h"
 
+#include <stdio.h>
+
 
 #define MAIL_THREAD_CONTEXT(obj) \
 	MODULE_CONTEXT(obj, mail_thread_storage_module)
@@ -46,6 +52,11 @@ struct mail_thread_mailbox {
 
 	/* set only temporarily while needed */
 	struct mail_thread_context *ctx;
+
+	/* MAIL_THREAD_LINKS_SUFFIX file was already tried to be read */
+	bool links_read:1;
+	/* the cache has changed since it was read or rebuilt */
+	bool links_dirty:1;
 };
 
 static MODULE_CONTEXT_DEFINE_INIT(mail_thread_storage_module,
@@ -360,6 +371,239 @@ static int mail_thread_index_map_build(struct mail_thread_context *ctx)
 	return ret;
 }
 
+static bool
+mail_thread_search_args_is_all(const struct mail_search_args *args)
+{
+	const struct mail_search_arg *arg = args->args;
+
+	return arg != NULL && arg->next == NULL &&
+		arg->type == SEARCH_ALL && !arg->match_not;
+}
+
+static const char *mail_thread_links_get_path(struct mailbox *box)
+{
+	return t_strconcat(box->index->filepath, MAIL_THREAD_LINKS_SUFFIX, NULL);
+}
+
+static uint32_t
+mail_thread_msgid_map_crc32(struct mail_thread_mailbox *tbox,
+			    uint32_t last_uid, uint32_t *count_r)
+{
+	const struct mail_index_strmap_rec *msgid_map;
+	unsigned int i, count;
+	uint32_t crc = 0;
+
+	msgid_map = array_get(tbox->msgid_map, &count);
+	for (i = 0; i < count && msgid_map[i].uid <= last_uid; i++)
+		crc = crc32_data_more(crc, &msgid_map[i], sizeof(msgid_map[i]));
+	*count_r = i;
+	return crc;
+}
+
+static void
+mail_thread_links_set_corrupted(struct mailbox *box, const char *path,
+				const char *reason)
+{
+	e_error(box->event, "Corrupted thread links file %s: %s",
+		path, reason);
+	i_unlink(path);
+}
+
+static bool
+mail_thread_links_verify(struct mail_thread_mailbox *tbox,
+			 const struct mail_thread_links_header *hdr)
+{
+	const struct mail_index_strmap_rec *msgid_map;
+	unsigned int i, count;
+	uint32_t crc32, map_count;
+
+	crc32 = mail_thread_msgid_map_crc32(tbox, hdr->last_uid, &map_count);
+	if (map_count != hdr->msgid_map_count ||
+	    crc32 != hdr->msgid_map_crc32) {
+		/* expunges or renumbering - links are outdated */
+		return FALSE;
+	}
+
+	/* all the strings of the included messages must have nodes */
+	msgid_map = array_get(tbox->msgid_map, &count);
+	for (i = 0; i < map_count; i++) {
+		if (msgid_map[i].str_idx >= hdr->node_count ||
+		    msgid_map[i].str_idx >= hdr->first_invalid_msgid_str_idx)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* Returns 1 if the thread links were read into the cache, 0 if they couldn't
+   be used. */
+static int
+mail_thread_links_read(struct mail_thread_mailbox *tbox, struct mailbox *box)
+{
+	struct mail_thread_cache *cache = tbox->cache;
+	struct mail_thread_links_header hdr;
+	const struct mail_thread_links_rec *recs;
+	struct mail_thread_node *node;
+	const char *path = mail_thread_links_get_path(box);
+	unsigned char *data;
+	struct stat st;
+	unsigned int i;
+	int fd, ret;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		if (errno != ENOENT)
+			e_error(box->event, "open(%s) failed: %m", path);
+		return 0;
+	}
+	if (fstat(fd, &st) < 0) {
+		e_error(box->event, "fstat(%s) failed: %m", path);
+		i_close_fd(&fd);
+		return 0;
+	}
+	if (st.st_size < (off_t)sizeof(hdr)) {
+		i_close_fd(&fd);
+		mail_thread_links_set_corrupted(box, path, "File too small");
+		return 0;
+	}
+	data = i_malloc(st.st_size);
+	ret = read_full(fd, data, st.st_size);
+	if (ret <= 0) {
+		if (ret < 0)
+			e_error(box->event, "read(%s) failed: %m", path);
+		else {
+			e_error(box->event, "read(%s) failed: "
+				"Unexpected EOF", path);
+		}
+		i_close_fd(&fd);
+		i_free(data);
+		return 0;
+	}
+	i_close_fd(&fd);
+
+	memcpy(&hdr, data, sizeof(hdr));
+	recs = (const void *)(data + sizeof(hdr));
+	if (hdr.version != MAIL_THREAD_LINKS_VERSION ||
+	    hdr.uid_validity !=
+	    mail_index_get_header(box->view)->uid_validity) {
+		/* it'll be recreated */
+		i_unlink(path);
+		ret = 0;
+	} else if ((uoff_t)st.st_size != sizeof(hdr) +
+		   (uoff_t)hdr.node_count * sizeof(recs[0])) {
+		mail_thread_links_set_corrupted(box, path, "Invalid file size");
+		ret = 0;
+	} else if (hdr.first_invalid_msgid_str_idx >
+		   hdr.next_invalid_msgid_str_idx ||
+		   (hdr.first_invalid_msgid_str_idx !=
+		    hdr.next_invalid_msgid_str_idx &&
+		    hdr.next_invalid_msgid_str_idx > hdr.node_count)) {
+		mail_thread_links_set_corrupted(box, path,
+						"Invalid invalid_msgid indexes");
+		ret = 0;
+	} else if (!mail_thread_links_verify(tbox, &hdr)) {
+		ret = 0;
+	} else {
+		for (i = 0; i < hdr.node_count; i++) {
+			if (recs[i].parent_idx >= hdr.node_count ||
+			    recs[i].uid > hdr.last_uid)
+				break;
+		}
+		if (i < hdr.node_count) {
+			mail_thread_links_set_corrupted(box, path,
+							"Invalid node");
+			ret = 0;
+		}
+	}
+	if (ret == 0) {
+		i_free(data);
+		return 0;
+	}
+
+	array_clear(&cache->thread_nodes);
+	for (i = 0; i < hdr.node_count; i++) {
+		node = array_append_space(&cache->thread_nodes);
+		node->uid = recs[i].uid;
+		node->parent_idx = recs[i].parent_idx;
+		node->parent_link_refcount = recs[i].refcount_flags >> 2;
+		node->expunge_rebuilds = (recs[i].refcount_flags & 2) != 0;
+		node->child_unref_rebuilds = (recs[i].refcount_flags & 1) != 0;
+	}
+	cache->last_uid = hdr.last_uid;
+	cache->first_invalid_msgid_str_idx = hdr.first_invalid_msgid_str_idx;
+	cache->next_invalid_msgid_str_idx = hdr.next_invalid_msgid_str_idx;
+	i_free(data);
+	return 1;
+}
+
+static void
+mail_thread_links_write(struct mail_thread_mailbox *tbox, struct mailbox *box)
+{
+	struct mail_thread_cache *cache = tbox->cache;
+	struct mail_index *index = box->index;
+	struct mail_thread_links_header hdr;
+	struct mail_thread_links_rec rec;
+	const struct mail_thread_node *nodes;
+	struct ostream *output;
+	const char *path, *temp_path;
+	string_t *str;
+	unsigned int i, count;
+	int fd, ret = 0;
+
+	path = mail_thread_links_get_path(box);
+	nodes = array_get(&cache->thread_nodes, &count);
+
+	i_zero(&hdr);
+	hdr.version = MAIL_THREAD_LINKS_VERSION;
+	hdr.uid_validity = mail_index_get_header(box->view)->uid_validity;
+	hdr.last_uid = cache->last_uid;
+	hdr.msgid_map_crc32 =
+		mail_thread_msgid_map_crc32(tbox, cache->last_uid,
+					    &hdr.msgid_map_count);
+	hdr.first_invalid_msgid_str_idx = cache->first_invalid_msgid_str_idx;
+	hdr.next_invalid_msgid_str_idx = cache->next_invalid_msgid_str_idx;
+	hdr.node_count = count;
+
+	str = t_str_new(256);
+	str_append(str, path);
+	fd = safe_mkstemp_hostpid_group(str, index->set.mode, index->set.gid,
+					index->set.gid_origin);
+	temp_path = str_c(str);
+	if (fd == -1) {
+		e_error(box->event, "safe_mkstemp_hostpid(%s) failed: %m",
+			temp_path);
+		return;
+	}
+
+	output = o_stream_create_fd(fd, 0);
+	o_stream_cork(output);
+	o_stream_nsend(output, &hdr, sizeof(hdr));
+	for (i = 0; i < count; i++) {
+		i_zero(&rec);
+		rec.uid = nodes[i].uid;
+		rec.parent_idx = nodes[i].parent_idx;
+		rec.refcount_flags = (nodes[i].parent_link_refcount << 2) |
+			(nodes[i].expunge_rebuilds ? 2 : 0) |
+			(nodes[i].child_unref_rebuilds ? 1 : 0);
+		o_stream_nsend(output, &rec, sizeof(rec));
+	}
+	if (o_stream_finish(output) < 0) {
+		e_error(box->event, "write(%s) failed: %s",
+			temp_path, o_stream_get_error(output));
+		ret = -1;
+	}
+	o_stream_destroy(&output);
+	if (close(fd) < 0) {
+		e_error(box->event, "close(%s) failed: %m", temp_path);
+		ret = -1;
+	} else if (ret == 0 && rename(temp_path, path) < 0) {
+		e_error(box->event, "rename(%s, %s) failed: %m",
+			temp_path, path);
+		ret = -1;
+	}
+	if (ret < 0)
+		i_unlink(temp_path);
+}
+
 static int msgid_map_cmp(const uint32_t *uid,
 			 const struct mail_index_strmap_rec *rec)
 {
@@ -415,6 +659,7 @@ static bool mail_thread_cache_update_removes(struct mail_thread_mailbox *tbox,
 			i_assert(msgid_map[j].uid == uid);
 			if (!mail_thread_remove(cache, msgid_map + j, &j))
 				return FALSE;
+			tbox->links_dirty = TRUE;
 		}
 	}
 	return TRUE;
@@ -434,6 +679,7 @@ static void mail_thread_cache_update_adds(struct mail_thread_mailbox *tbox,
 	uids = array_get(added_uids, &uid_count);
 	if (uid_count == 0)
 		return;
+	tbox->links_dirty = TRUE;
 
 	(void)array_bsearch_insert_pos(tbox->msgid_map, &uids[0].seq1,
 				       msgid_map_cmp, &j);
@@ -507,6 +753,15 @@ static void mail_thread_cache_sync_add(struct mail_thread_mailbox *tbox,
 	struct mail *mail;
 	const struct mail_index_strmap_rec *msgid_map;
 	unsigned int i, count;
+	bool links_read = FALSE;
+
+	if (cache->search_result == NULL && !tbox->links_read &&
+	    mail_thread_search_args_is_all(ctx->search_args)) {
+		/* try to continue from the links saved by a previous
+		   session */
+		tbox->links_read = TRUE;
+		links_read = mail_thread_links_read(tbox, ctx->box) > 0;
+	}
 
 	mail_thread_cache_fix_invalid_indexes(tbox);
 
@@ -517,11 +772,15 @@ static void mail_thread_cache_sync_add(struct mail_thread_mailbox *tbox,
 		return;
 	}
 
-	cache->last_uid = 0;
-	cache->first_invalid_msgid_str_idx = cache->next_invalid_msgid_str_idx =
-		mail_index_strmap_view_get_highest_idx(tbox->strmap_view) + 1 +
-		THREAD_INVALID_MSGID_STR_IDX_SKIP_COUNT;
-	array_clear(&cache->thread_nodes);
+	if (!links_read) {
+		tbox->links_dirty = TRUE;
+		cache->last_uid = 0;
+		cache->first_invalid_msgid_str_idx =
+			cache->next_invalid_msgid_str_idx =
+			mail_index_strmap_view_get_highest_idx(tbox->strmap_view) +
+			1 + THREAD_INVALID_MSGID_STR_IDX_SKIP_COUNT;
+		array_clear(&cache->thread_nodes);
+	}
 
 	cache->search_result =
 		mailbox_search_result_save(search_ctx,
@@ -537,7 +796,13 @@ static void mail_thread_cache_sync_add(struct mail_thread_mailbox *tbox,
 		while (msgid_map[i].uid < mail->uid)
 			i++;
 		i_assert(i < count);
+		if (mail->uid <= cache->last_uid) {
+			/* already in the links that were read */
+			i_assert(links_read);
+			continue;
+		}
 		mail_thread_add(cache, msgid_map+i, &i);
+		tbox->links_dirty = TRUE;
 	}
 }
 
@@ -623,9 +888,18 @@ mail_thread_iterate_init(struct mail_thread_context *ctx,
 static void mail_thread_mailbox_close(struct mailbox *box)
 {
 	struct mail_thread_mailbox *tbox = MAIL_THREAD_CONTEXT_REQUIRE(box);
+	struct mail_search_result *result = tbox->cache->search_result;
 
 	i_assert(tbox->ctx == NULL);
 
+	if (tbox->links_dirty && result != NULL &&
+	    mail_thread_search_args_is_all(result->search_args) &&
+	    !mail_index_is_in_memory(box->index)) T_BEGIN {
+		mail_thread_links_write(tbox, box);
+	} T_END;
+	tbox->links_read = FALSE;
+	tbox->links_dirty = FALSE;
+
 	if (tbox->strmap_view != NULL)
 		mail_index_strmap_view_close(&tbox->strmap_view);
 	if (tbox->cache->search_result != NULL)
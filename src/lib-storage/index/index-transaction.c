@@ -8,6 +8,10 @@
 #include "index-pop3-uidl.h"
 #include "index-mail.h"
 
+/* How much cache data MAILBOX_TRANSACTION_FLAG_BULK_CACHE buffers in memory
+   before writing it to dovecot.index.cache. */
+#define INDEX_TRANSACTION_BULK_CACHE_BUFFER_SIZE (1024*1024*8)
+
 static void index_transaction_free(struct mailbox_transaction_context *t)
 {
 	if (t->view_pvt != NULL)
@@ -172,6 +176,10 @@ void index_transaction_init(struct mailbox_transaction_context *t,
 
 	if ((flags & MAILBOX_TRANSACTION_FLAG_NO_CACHE_DEC) != 0)
 		mail_cache_view_update_cache_decisions(t->cache_view, FALSE);
+	if ((flags & MAILBOX_TRANSACTION_FLAG_BULK_CACHE) != 0) {
+		mail_cache_transaction_set_max_buffer_size(t->cache_trans,
+			INDEX_TRANSACTION_BULK_CACHE_BUFFER_SIZE);
+	}
 
 	/* set up after mail_cache_get_transaction(), so that we'll still
 	   have the cache_trans available in _index_commit() */
@@ -58,20 +58,20 @@ bool maildir_filename_get_size(const char *fname, char type, uoff_t *size_r)
 	return TRUE;
 }
 
-/* a char* hash function from ASU -- from glib */
+/* FNV-1a. The ASU hash used by str_hash() keeps only the last few
+   characters in the low bits, which clusters badly with maildir filenames
+   that differ only by their timestamp/uniqueness part and end in the same
+   ".hostname,S=size" suffix (e.g. mails imported by a single process).
+   With large directories the collision lists then get thousands of entries
+   long. */
 unsigned int ATTR_NO_SANITIZE_INTEGER
 maildir_filename_base_hash(const char *s)
 {
-	unsigned int g, h = 0;
+	unsigned int h = 2166136261U;
 
 	while (*s != MAILDIR_INFO_SEP && *s != '\0') {
 		i_assert(*s != '/');
-		h = (h << 4) + *s;
-		if ((g = h & 0xf0000000UL) != 0) {
-			h = h ^ (g >> 24);
-			h = h ^ g;
-		}
-
+		h = (h ^ (unsigned char)*s) * 16777619U;
 		s++;
 	}
 
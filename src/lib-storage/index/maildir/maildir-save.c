@@ -634,6 +634,8 @@ int maildir_save_finish(struct mail_save_context *ctx)
 	T_BEGIN {
 		ret = maildir_save_finish_real(ctx);
 	} T_END;
+	if (ret == 0)
+		index_mail_save_binary_parts(ctx->dest_mail);
 	index_save_context_free(ctx);
 	return ret;
 }
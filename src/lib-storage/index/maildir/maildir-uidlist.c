@@ -1655,9 +1655,12 @@ int maildir_uidlist_sync_init(struct maildir_uidlist *uidlist,
 	}
 	i_assert(uidlist->locked_refresh);
 
+	/* all the existing files are normally seen again, so size the hash
+	   table for them upfront instead of growing it while scanning */
 	ctx->record_pool = pool_alloconly_create(MEMPOOL_GROWING
 						 "maildir_uidlist_sync", 16384);
-	hash_table_create(&ctx->files, ctx->record_pool, 4096,
+	hash_table_create(&ctx->files, ctx->record_pool,
+			  I_MAX(array_count(&uidlist->records), 4096),
 			  maildir_filename_base_hash,
 			  maildir_filename_base_cmp);
 
@@ -150,8 +150,11 @@ int maildir_file_do(struct maildir_mailbox *mbox, uint32_t uid,
 	T_BEGIN {
 		ret = maildir_file_do_try(mbox, uid, callback, context);
 	} T_END;
-	if (ret == 0 && mbox->storage->set->maildir_very_dirty_syncs) T_BEGIN {
-		/* try guessing again with refreshed flags */
+	if (ret == 0) T_BEGIN {
+		/* try guessing again with refreshed flags. dovecot-uidlist
+		   doesn't contain the flags, so this is the normal case for
+		   the first lookup after the uidlist was read. It's much
+		   cheaper than rescanning a large cur/ directory. */
 		if (maildir_sync_refresh_flags_view(mbox) == 0)
 			ret = maildir_file_do_try(mbox, uid, callback, context);
 	} T_END;
@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "ioloop.h"
+#include "istream.h"
 #include "str.h"
 #include "settings-parser.h"
 #include "mail-copy.h"
@@ -197,6 +198,8 @@ static void pop3c_mailbox_close(struct mailbox *box)
 	i_free_and_null(mbox->msg_uids);
 	i_free_and_null(mbox->msg_sizes);
 	pop3c_client_deinit(&mbox->client);
+	i_stream_unref(&mbox->list_input);
+	i_free(mbox->list_error);
 	index_storage_mailbox_close(box);
 }
 
@@ -26,7 +26,12 @@ struct pop3c_mailbox {
 	   the UID may not exist for the entire session */
 	uint32_t *msg_uids;
 
+	/* LIST reply that was pipelined with UIDL, not yet parsed */
+	struct istream *list_input;
+	char *list_error;
+
 	bool logged_in:1;
+	bool list_pending:1;
 };
 
 struct pop3c_mail {
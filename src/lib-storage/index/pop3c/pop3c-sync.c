@@ -19,6 +19,36 @@ struct pop3c_sync_msg {
 };
 ARRAY_DEFINE_TYPE(pop3c_sync_msg, struct pop3c_sync_msg);
 
+static void
+pop3c_sync_list_callback(enum pop3c_command_state state, const char *reply,
+			 void *context)
+{
+	struct pop3c_mailbox *mbox = context;
+
+	i_assert(mbox->list_pending);
+
+	mbox->list_pending = FALSE;
+	if (state != POP3C_COMMAND_STATE_OK)
+		mbox->list_error = i_strdup(reply);
+}
+
+static void pop3c_sync_pipeline_list(struct pop3c_mailbox *mbox)
+{
+	if ((mbox->box.flags & MAILBOX_FLAG_POP3_SESSION) == 0 ||
+	    (pop3c_client_get_capabilities(mbox->client) &
+	     POP3C_CAPABILITY_PIPELINING) == 0 ||
+	    mbox->msg_sizes != NULL || mbox->list_input != NULL)
+		return;
+
+	/* POP3 sessions want the LIST sizes right after the UIDLs, so send
+	   the LIST already now to avoid waiting for another round trip
+	   later. */
+	i_assert(mbox->list_error == NULL);
+	mbox->list_pending = TRUE;
+	mbox->list_input = pop3c_client_cmd_stream_async(mbox->client,
+		"LIST\r\n", pop3c_sync_list_callback, mbox);
+}
+
 int pop3c_sync_get_uidls(struct pop3c_mailbox *mbox)
 {
 	ARRAY_TYPE(const_string) uidls;
@@ -37,6 +67,7 @@ int pop3c_sync_get_uidls(struct pop3c_mailbox *mbox)
 		return -1;
 	}
 
+	pop3c_sync_pipeline_list(mbox);
 	if (pop3c_client_cmd_stream(mbox->client, "UIDL\r\n",
 				    &input, &error) < 0) {
 		mailbox_set_critical(&mbox->box, "UIDL failed: %s", error);
@@ -95,8 +126,21 @@ int pop3c_sync_get_sizes(struct pop3c_mailbox *mbox)
 		return 0;
 	}
 
-	if (pop3c_client_cmd_stream(mbox->client, "LIST\r\n",
-				    &input, &error) < 0) {
+	if (mbox->list_input != NULL) {
+		/* LIST was already sent together with UIDL */
+		while (mbox->list_pending)
+			pop3c_client_wait_one(mbox->client);
+		input = mbox->list_input;
+		mbox->list_input = NULL;
+		if (mbox->list_error != NULL) {
+			mailbox_set_critical(&mbox->box, "LIST failed: %s",
+					     mbox->list_error);
+			i_free(mbox->list_error);
+			i_stream_unref(&input);
+			return -1;
+		}
+	} else if (pop3c_client_cmd_stream(mbox->client, "LIST\r\n",
+					   &input, &error) < 0) {
 		mailbox_set_critical(&mbox->box, "LIST failed: %s", error);
 		return -1;
 	}
@@ -1,6 +1,7 @@
 /* Copyright (c) 2013-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "hash.h"
 #include "hostpid.h"
 #include "str.h"
 #include "mail-index.h"
@@ -858,8 +859,13 @@ index_list_rename_mailbox(struct mailbox_list *_oldlist, const char *oldname,
 	newnode->uid = oldnode->uid;
 	newnode->flags = oldnode->flags;
 	newnode->children = oldnode->children; oldnode->children = NULL;
-	for (child = newnode->children; child != NULL; child = child->next)
+	for (child = newnode->children; child != NULL; child = child->next) {
+		/* the parent is part of the name lookup key */
+		hash_table_remove(sync_ctx->ilist->mailbox_node_names, child);
 		child->parent = newnode;
+		hash_table_insert(sync_ctx->ilist->mailbox_node_names,
+				  child, child);
+	}
 
 	/* remove the old node from existence */
 	mailbox_list_index_node_unlink(sync_ctx->ilist, oldnode);
@@ -32,6 +32,50 @@ static bool iter_use_index(struct mailbox_list *list,
 	return TRUE;
 }
 
+static struct mailbox_list_index_node *
+mailbox_list_index_iter_find_root(struct mailbox_list *list,
+				  const char *const *patterns, string_t *path)
+{
+	struct mail_namespace *ns = list->ns;
+	struct mailbox_list_index_node *node;
+	const char *pattern, *p, *sep_pos = NULL, *vname, *storage_name;
+	char ns_sep = mail_namespace_get_sep(ns);
+	char escape_char = list->set.storage_name_escape_char;
+
+	if (patterns[0] == NULL || patterns[1] != NULL)
+		return NULL;
+
+	/* Find the last hierarchy separator before the first wildcard.
+	   Everything matching the pattern is under the mailbox before it. */
+	pattern = patterns[0];
+	for (p = pattern; *p != '\0' && *p != '%' && *p != '*'; p++) {
+		if (*p == ns_sep)
+			sep_pos = p;
+	}
+	if (sep_pos == NULL)
+		return NULL;
+	vname = t_strdup_until(pattern, sep_pos);
+	if (strlen(vname) <= ns->prefix_len ||
+	    strncmp(vname, ns->prefix, ns->prefix_len) != 0)
+		return NULL;
+	p = vname + ns->prefix_len;
+	if (strncasecmp(p, "INBOX", 5) == 0 &&
+	    (p[5] == '\0' || p[5] == ns_sep)) {
+		/* INBOX is matched case-insensitively */
+		return NULL;
+	}
+
+	storage_name = mailbox_list_get_storage_name(list, vname);
+	if (escape_char != '\0' && strchr(storage_name, escape_char) != NULL) {
+		/* the node names are unescaped */
+		return NULL;
+	}
+	node = mailbox_list_index_lookup(list, storage_name);
+	if (node != NULL)
+		str_append(path, storage_name);
+	return node;
+}
+
 struct mailbox_list_iterate_context *
 mailbox_list_index_iter_init(struct mailbox_list *list,
 			     const char *const *patterns,
@@ -60,7 +104,17 @@ mailbox_list_index_iter_init(struct mailbox_list *list,
 	/* listing mailboxes from index */
 	ctx->info.ns = list->ns;
 	ctx->path = str_new(pool, 128);
-	ctx->next_node = ilist->mailbox_tree;
+	T_BEGIN {
+		ctx->iter_root = mailbox_list_index_iter_find_root(list,
+			patterns, ctx->path);
+	} T_END;
+	if (ctx->iter_root == NULL)
+		ctx->next_node = ilist->mailbox_tree;
+	else {
+		/* e.g. "Archive/2019/%" - skip the rest of the tree */
+		ctx->parent_len = str_len(ctx->path);
+		ctx->next_node = ctx->iter_root->children;
+	}
 	ctx->mailbox_pool = ilist->mailbox_pool;
 	pool_ref(ctx->mailbox_pool);
 	return &ctx->ctx;
@@ -83,7 +137,6 @@ static void
 mailbox_list_index_update_info(struct mailbox_list_index_iterate_context *ctx)
 {
 	struct mailbox_list_index_node *node = ctx->next_node;
-	struct mailbox *box;
 
 	p_clear(ctx->info_pool);
 
@@ -124,6 +177,13 @@ mailbox_list_index_update_info(struct mailbox_list_index_iterate_context *ctx)
 		ctx->info.flags |= MAILBOX_NOSELECT;
 	if ((node->flags & MAILBOX_LIST_INDEX_FLAG_NOINFERIORS) != 0)
 		ctx->info.flags |= MAILBOX_NOINFERIORS;
+}
+
+static void
+mailbox_list_index_update_info_flags(struct mailbox_list_index_iterate_context *ctx)
+{
+	struct mailbox_list_index_node *node = ctx->next_node;
+	struct mailbox *box;
 
 	if ((ctx->ctx.flags & (MAILBOX_LIST_ITER_SELECT_SUBSCRIBED |
 			       MAILBOX_LIST_ITER_RETURN_SUBSCRIBED)) != 0) {
@@ -160,6 +220,11 @@ mailbox_list_index_update_next(struct mailbox_list_index_iterate_context *ctx,
 	} else {
 		while (node->next == NULL) {
 			node = node->parent;
+			if (node == ctx->iter_root) {
+				/* the rest can't match */
+				ctx->next_node = NULL;
+				return;
+			}
 			if (node != NULL) T_BEGIN {
 				/* The storage name kept in the iteration context
 				   is escaped. To calculate the right truncation
@@ -222,6 +287,11 @@ mailbox_list_index_iter_next(struct mailbox_list_iterate_context *_ctx)
 
 		follow_children = (match & (IMAP_MATCH_YES |
 					    IMAP_MATCH_CHILDREN)) != 0;
+		if (match == IMAP_MATCH_YES) T_BEGIN {
+			/* the flags are needed only for the returned
+			   mailboxes, and looking them up may be expensive */
+			mailbox_list_index_update_info_flags(ctx);
+		} T_END;
 		if (match == IMAP_MATCH_YES && iter_subscriptions_ok(ctx)) {
 			/* If this is a) \NoSelect leaf, b) not LAYOUT=index
 			   and c) NO-NOSELECT is set, try to rmdir the leaf
@@ -19,6 +19,10 @@
 #define MAILBOX_LIST_INDEX_LOG2_MAX_AGE_SECS (10*60)
 
 static void mailbox_list_index_init_finish(struct mailbox_list *list);
+static int mailbox_list_index_node_cmp(const struct mailbox_list_index_node *n1,
+				       const struct mailbox_list_index_node *n2);
+static unsigned int
+mailbox_list_index_node_hash(const struct mailbox_list_index_node *node);
 
 struct mailbox_list_index_module mailbox_list_index_module =
 	MODULE_CONTEXT_INIT(&mailbox_list_module_register);
@@ -36,12 +40,16 @@ static void mailbox_list_index_init_pool(struct mailbox_list_index *ilist)
 	ilist->mailbox_pool = pool_alloconly_create("mailbox list index", 4096);
 	hash_table_create_direct(&ilist->mailbox_names, ilist->mailbox_pool, 0);
 	hash_table_create_direct(&ilist->mailbox_hash, ilist->mailbox_pool, 0);
+	hash_table_create(&ilist->mailbox_node_names, ilist->mailbox_pool, 0,
+			  mailbox_list_index_node_hash,
+			  mailbox_list_index_node_cmp);
 }
 
 void mailbox_list_index_reset(struct mailbox_list_index *ilist)
 {
 	hash_table_destroy(&ilist->mailbox_names);
 	hash_table_destroy(&ilist->mailbox_hash);
+	hash_table_destroy(&ilist->mailbox_node_names);
 	pool_unref(&ilist->mailbox_pool);
 
 	ilist->mailbox_tree = NULL;
@@ -114,39 +122,38 @@ int mailbox_list_index_index_open(struct mailbox_list *list)
 }
 
 struct mailbox_list_index_node *
-mailbox_list_index_node_find_sibling(const struct mailbox_list *list,
-				     struct mailbox_list_index_node *node,
-				     const char *name)
+mailbox_list_index_node_find_child(struct mailbox_list *list,
+				   struct mailbox_list_index_node *parent,
+				   const char *name)
 {
+	struct mailbox_list_index *ilist = INDEX_LIST_CONTEXT_REQUIRE(list);
+	struct mailbox_list_index_node lookup_node;
+
 	mailbox_list_name_unescape(&name, list->set.storage_name_escape_char);
 
-	while (node != NULL) {
-		if (strcmp(node->raw_name, name) == 0)
-			return node;
-		node = node->next;
-	}
-	return NULL;
+	i_zero(&lookup_node);
+	lookup_node.parent = parent;
+	lookup_node.raw_name = name;
+	return hash_table_lookup(ilist->mailbox_node_names, &lookup_node);
 }
 
 static struct mailbox_list_index_node *
 mailbox_list_index_lookup_real(struct mailbox_list *list, const char *name)
 {
-	struct mailbox_list_index *ilist = INDEX_LIST_CONTEXT_REQUIRE(list);
-	struct mailbox_list_index_node *node = ilist->mailbox_tree;
+	struct mailbox_list_index_node *node = NULL;
 	const char *const *path;
 	unsigned int i;
 	char sep[2];
 
 	if (*name == '\0')
-		return mailbox_list_index_node_find_sibling(list, node, "");
+		return mailbox_list_index_node_find_child(list, NULL, "");
 
 	sep[0] = mailbox_list_get_hierarchy_sep(list); sep[1] = '\0';
 	path = t_strsplit(name, sep);
 	for (i = 0;; i++) {
-		node = mailbox_list_index_node_find_sibling(list, node, path[i]);
+		node = mailbox_list_index_node_find_child(list, node, path[i]);
 		if (node == NULL || path[i+1] == NULL)
 			break;
-		node = node->children;
 	}
 	return node;
 }
@@ -178,11 +185,26 @@ void mailbox_list_index_node_get_path(const struct mailbox_list_index_node *node
 	str_append(str, node->raw_name);
 }
 
+void mailbox_list_index_node_link(struct mailbox_list_index *ilist,
+				  struct mailbox_list_index_node *node)
+{
+	if (node->parent != NULL) {
+		node->next = node->parent->children;
+		node->parent->children = node;
+	} else {
+		node->next = ilist->mailbox_tree;
+		ilist->mailbox_tree = node;
+	}
+	hash_table_insert(ilist->mailbox_node_names, node, node);
+}
+
 void mailbox_list_index_node_unlink(struct mailbox_list_index *ilist,
 				    struct mailbox_list_index_node *node)
 {
 	struct mailbox_list_index_node **prev;
 
+	hash_table_remove(ilist->mailbox_node_names, node);
+
 	prev = node->parent == NULL ?
 		&ilist->mailbox_tree : &node->parent->children;
 
@@ -298,8 +320,6 @@ static int mailbox_list_index_parse_records(struct mailbox_list_index *ilist,
 					    const char **error_r)
 {
 	struct mailbox_list_index_node *node, *parent;
-	HASH_TABLE(struct mailbox_list_index_node *,
-		   struct mailbox_list_index_node *) duplicate_hash;
 	const struct mail_index_record *rec;
 	const struct mailbox_list_index_record *irec;
 	const void *data;
@@ -311,9 +331,6 @@ static int mailbox_list_index_parse_records(struct mailbox_list_index *ilist,
 
 	pool_t dup_pool =
 		pool_alloconly_create(MEMPOOL_GROWING"duplicate pool", 2048);
-	hash_table_create(&duplicate_hash, dup_pool, 0,
-			  mailbox_list_index_node_hash,
-			  mailbox_list_index_node_cmp);
 	count = mail_index_view_get_messages_count(view);
 	if (!ilist->has_backing_store)
 		hash_table_create(&duplicate_guid, dup_pool, 0, guid_128_hash,
@@ -433,15 +450,11 @@ static int mailbox_list_index_parse_records(struct mailbox_list_index *ilist,
 				node->corrupted_ext = TRUE;
 			} else {
 				node->parent = parent;
-				node->next = parent->children;
-				parent->children = node;
 			}
 		} else if (strcasecmp(node->raw_name, "INBOX") == 0) {
 			ilist->rebuild_on_missing_inbox = FALSE;
 		}
-		if (hash_table_lookup(duplicate_hash, node) == NULL)
-			hash_table_insert(duplicate_hash, node, node);
-		else {
+		if (hash_table_lookup(ilist->mailbox_node_names, node) != NULL) {
 			const char *old_name = node->raw_name;
 
 			if (ilist->has_backing_store) {
@@ -461,12 +474,8 @@ static int mailbox_list_index_parse_records(struct mailbox_list_index *ilist,
 				"Duplicate mailbox '%s' in index, renaming to %s",
 				old_name, node->raw_name);
 		}
-		if (node->parent == NULL) {
-			node->next = ilist->mailbox_tree;
-			ilist->mailbox_tree = node;
-		}
+		mailbox_list_index_node_link(ilist, node);
 	}
-	hash_table_destroy(&duplicate_hash);
 	if (!ilist->has_backing_store)
 		hash_table_destroy(&duplicate_guid);
 	pool_unref(&dup_pool);
@@ -882,6 +891,7 @@ static void mailbox_list_index_deinit(struct mailbox_list *list)
 	if (ilist->index != NULL) {
 		hash_table_destroy(&ilist->mailbox_hash);
 		hash_table_destroy(&ilist->mailbox_names);
+		hash_table_destroy(&ilist->mailbox_node_names);
 		pool_unref(&ilist->mailbox_pool);
 		if (ilist->opened)
 			mail_index_close(ilist->index);
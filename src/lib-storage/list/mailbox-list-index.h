@@ -118,6 +118,9 @@ struct mailbox_list_index {
 
 	/* uint32_t uid => node */
 	HASH_TABLE(void *, struct mailbox_list_index_node *) mailbox_hash;
+	/* (parent, raw_name) => node for all the linked nodes */
+	HASH_TABLE(struct mailbox_list_index_node *,
+		   struct mailbox_list_index_node *) mailbox_node_names;
 	struct mailbox_list_index_node *mailbox_tree;
 
 	bool pending_init:1;
@@ -145,6 +148,9 @@ struct mailbox_list_index_iterate_context {
 	size_t parent_len;
 	string_t *path;
 	struct mailbox_list_index_node *next_node;
+	/* Only the children of this node can match the patterns. The
+	   iteration stops when it returns back to it. NULL = root. */
+	struct mailbox_list_index_node *iter_root;
 
 	bool failed:1;
 	bool prefix_inbox_list:1;
@@ -160,6 +166,9 @@ struct mailbox_list_index_node *
 mailbox_list_index_lookup_uid(struct mailbox_list_index *ilist, uint32_t uid);
 void mailbox_list_index_node_get_path(const struct mailbox_list_index_node *node,
 				      char sep, string_t *str);
+/* Link the node under its parent (or the root if parent=NULL). */
+void mailbox_list_index_node_link(struct mailbox_list_index *ilist,
+				  struct mailbox_list_index_node *node);
 void mailbox_list_index_node_unlink(struct mailbox_list_index *ilist,
 				    struct mailbox_list_index_node *node);
 
@@ -197,10 +206,12 @@ int mailbox_list_index_view_open(struct mailbox *box, bool require_refreshed,
 				 struct mail_index_view **view_r,
 				 uint32_t *seq_r);
 
+/* Find the child node with the given (escaped) name under parent, or from
+   the root if parent=NULL. */
 struct mailbox_list_index_node *
-mailbox_list_index_node_find_sibling(const struct mailbox_list *list,
-				     struct mailbox_list_index_node *node,
-				     const char *name);
+mailbox_list_index_node_find_child(struct mailbox_list *list,
+				   struct mailbox_list_index_node *parent,
+				   const char *name);
 void mailbox_list_index_reset(struct mailbox_list_index *ilist);
 int mailbox_list_index_parse(struct mailbox_list *list,
 			     struct mail_index_view *view, bool force);
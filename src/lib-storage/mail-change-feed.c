@@ -0,0 +1,603 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "str.h"
+#include "strnum.h"
+#include "eacces-error.h"
+#include "safe-mkstemp.h"
+#include "write-full.h"
+#include "mail-change-feed.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define MAIL_CHANGE_FEED_VERSION 1
+#define MAIL_CHANGE_FEED_ROTATE_SIZE (1024*1024)
+
+struct mail_change_feed_header {
+	uint8_t version;
+	uint8_t padding[3];
+	uint8_t file_seq[4];
+};
+
+struct mail_change_feed {
+	char *filepath, *filepath2;
+	struct event *event;
+
+	int fd;
+	ino_t ino;
+	dev_t dev;
+	/* sequence of the currently or last opened file */
+	uint32_t file_seq;
+
+	mode_t mode;
+	gid_t gid;
+	char *gid_origin;
+	enum fsync_mode fsync_mode;
+};
+
+struct mail_change_feed_iter_file {
+	const char *path;
+	uint32_t file_seq;
+	uoff_t start_offset;
+};
+
+struct mail_change_feed_iter {
+	struct mail_change_feed *feed;
+
+	/* the old and the current log file */
+	struct mail_change_feed_iter_file files[2];
+	unsigned int file_idx, file_count;
+
+	int fd;
+	struct mail_change_feed_record buf[128];
+	unsigned int idx, count;
+	struct mail_change_feed_cursor cursor;
+
+	bool lost:1;
+	bool failed:1;
+};
+
+static void mail_change_feed_close(struct mail_change_feed *feed);
+
+struct mail_change_feed *
+mail_change_feed_alloc(struct event *parent_event, const char *path)
+{
+	struct mail_change_feed *feed;
+
+	feed = i_new(struct mail_change_feed, 1);
+	feed->event = event_create(parent_event);
+	feed->filepath = i_strdup(path);
+	feed->filepath2 = i_strconcat(path, ".2", NULL);
+	feed->mode = 0600;
+	feed->gid = (gid_t)-1;
+	feed->fd = -1;
+	return feed;
+}
+
+void mail_change_feed_free(struct mail_change_feed **_feed)
+{
+	struct mail_change_feed *feed = *_feed;
+
+	if (feed == NULL)
+		return;
+	*_feed = NULL;
+
+	mail_change_feed_close(feed);
+	event_unref(&feed->event);
+	i_free(feed->gid_origin);
+	i_free(feed->filepath);
+	i_free(feed->filepath2);
+	i_free(feed);
+}
+
+static void mail_change_feed_close(struct mail_change_feed *feed)
+{
+	i_close_fd_path(&feed->fd, feed->filepath);
+}
+
+void mail_change_feed_set_permissions(struct mail_change_feed *feed,
+				      mode_t mode, gid_t gid,
+				      const char *gid_origin)
+{
+	feed->mode = mode;
+	feed->gid = gid;
+	i_free(feed->gid_origin);
+	feed->gid_origin = i_strdup(gid_origin);
+}
+
+void mail_change_feed_set_fsync_mode(struct mail_change_feed *feed,
+				     enum fsync_mode fsync_mode)
+{
+	feed->fsync_mode = fsync_mode;
+}
+
+void mail_change_feed_record_init(struct mail_change_feed_record *rec,
+				  enum mail_change_feed_record_type type,
+				  const guid_128_t mailbox_guid, uint32_t uid,
+				  time_t stamp)
+{
+	i_zero(rec);
+	rec->type = type;
+	guid_128_copy(rec->mailbox_guid, mailbox_guid);
+	cpu32_to_be_unaligned(uid, rec->uid);
+	cpu32_to_be_unaligned(time_to_uint32_trunc(stamp), rec->timestamp);
+}
+
+uint32_t
+mail_change_feed_record_get_uid(const struct mail_change_feed_record *rec)
+{
+	return be32_to_cpu_unaligned(rec->uid);
+}
+
+time_t
+mail_change_feed_record_get_timestamp(const struct mail_change_feed_record *rec)
+{
+	return (time_t)be32_to_cpu_unaligned(rec->timestamp);
+}
+
+static int
+mail_change_feed_read_header(struct mail_change_feed *feed, int fd,
+			     const char *path, uint32_t *file_seq_r)
+{
+	struct mail_change_feed_header hdr;
+	ssize_t ret;
+
+	ret = pread(fd, &hdr, sizeof(hdr), 0);
+	if (ret < 0) {
+		e_error(feed->event, "pread(%s) failed: %m", path);
+		return -1;
+	}
+	if (ret != sizeof(hdr) || hdr.version != MAIL_CHANGE_FEED_VERSION) {
+		e_error(feed->event, "Corrupted change feed %s: Invalid header",
+			path);
+		return -1;
+	}
+	*file_seq_r = be32_to_cpu_unaligned(hdr.file_seq);
+	return 0;
+}
+
+/* Open the log file and read its sequence from the header. Returns 1 if ok,
+   0 if the file doesn't exist, -1 if error. */
+static int
+mail_change_feed_open_file(struct mail_change_feed *feed, const char *path,
+			   int flags, int *fd_r, uint32_t *file_seq_r)
+{
+	*fd_r = open(path, flags);
+	if (*fd_r == -1) {
+		if (errno == ENOENT)
+			return 0;
+		if (errno == EACCES)
+			e_error(feed->event, "%s",
+				eacces_error_get("open", path));
+		else
+			e_error(feed->event, "open(%s) failed: %m", path);
+		return -1;
+	}
+	if (mail_change_feed_read_header(feed, *fd_r, path, file_seq_r) < 0) {
+		i_close_fd_path(fd_r, path);
+		return -1;
+	}
+	return 1;
+}
+
+static uint32_t
+mail_change_feed_get_next_file_seq(struct mail_change_feed *feed)
+{
+	uint32_t file_seq, next_seq = feed->file_seq + 1;
+	int fd;
+
+	if (mail_change_feed_open_file(feed, feed->filepath2, O_RDONLY,
+				       &fd, &file_seq) > 0) {
+		if (file_seq >= next_seq)
+			next_seq = file_seq + 1;
+		i_close_fd_path(&fd, feed->filepath2);
+	}
+	return next_seq;
+}
+
+static int mail_change_feed_create(struct mail_change_feed *feed)
+{
+	struct mail_change_feed_header hdr;
+	string_t *temp_path;
+	int fd, ret = 0;
+
+	i_zero(&hdr);
+	hdr.version = MAIL_CHANGE_FEED_VERSION;
+	cpu32_to_be_unaligned(mail_change_feed_get_next_file_seq(feed),
+			      hdr.file_seq);
+
+	/* Write the header to a temp file and link it into place, so the
+	   log file is never seen without a header. */
+	temp_path = t_str_new(256);
+	str_append(temp_path, feed->filepath);
+	str_append_c(temp_path, '.');
+	fd = safe_mkstemp_hostpid_group(temp_path, feed->mode, feed->gid,
+					feed->gid_origin);
+	if (fd == -1) {
+		if (errno == EACCES) {
+			e_error(feed->event, "%s",
+				eacces_error_get("creat", str_c(temp_path)));
+		} else if (errno == ENOENT) {
+			e_error(feed->event, "safe_mkstemp(%s) failed: %m",
+				str_c(temp_path));
+		}
+		return -1;
+	}
+	if (write_full(fd, &hdr, sizeof(hdr)) < 0) {
+		e_error(feed->event, "write(%s) failed: %m", str_c(temp_path));
+		ret = -1;
+	} else if (link(str_c(temp_path), feed->filepath) < 0 &&
+		   errno != EEXIST) {
+		e_error(feed->event, "link(%s, %s) failed: %m",
+			str_c(temp_path), feed->filepath);
+		ret = -1;
+	}
+	/* if the link failed with EEXIST, someone else just created the file.
+	   It's opened by the caller. */
+	i_unlink(str_c(temp_path));
+	i_close_fd_path(&fd, str_c(temp_path));
+	return ret;
+}
+
+static int mail_change_feed_open(struct mail_change_feed *feed)
+{
+	struct stat st;
+	int ret;
+
+	i_assert(feed->fd == -1);
+
+	ret = mail_change_feed_open_file(feed, feed->filepath,
+					 O_RDWR | O_APPEND, &feed->fd,
+					 &feed->file_seq);
+	if (ret == 0) {
+		if (mail_change_feed_create(feed) < 0)
+			return -1;
+		ret = mail_change_feed_open_file(feed, feed->filepath,
+						 O_RDWR | O_APPEND, &feed->fd,
+						 &feed->file_seq);
+		if (ret == 0) {
+			e_error(feed->event,
+				"open(%s) failed: File was deleted",
+				feed->filepath);
+		}
+	}
+	if (ret <= 0)
+		return -1;
+
+	if (fstat(feed->fd, &st) < 0) {
+		e_error(feed->event, "fstat(%s) failed: %m", feed->filepath);
+		mail_change_feed_close(feed);
+		return -1;
+	}
+	feed->ino = st.st_ino;
+	feed->dev = st.st_dev;
+	return 0;
+}
+
+static bool mail_change_feed_is_rotated(struct mail_change_feed *feed)
+{
+	struct stat st;
+
+	if (stat(feed->filepath, &st) < 0) {
+		if (errno != ENOENT)
+			e_error(feed->event, "stat(%s) failed: %m",
+				feed->filepath);
+		return TRUE;
+	}
+	return st.st_ino != feed->ino || !CMP_DEV_T(st.st_dev, feed->dev);
+}
+
+static void mail_change_feed_rotate_if_needed(struct mail_change_feed *feed)
+{
+	struct stat st;
+
+	if (fstat(feed->fd, &st) < 0) {
+		e_error(feed->event, "fstat(%s) failed: %m", feed->filepath);
+		return;
+	}
+	if (st.st_size < MAIL_CHANGE_FEED_ROTATE_SIZE)
+		return;
+
+	/* Don't rotate if another process already did. There's still a small
+	   race condition here, but the worst that can happen is that the
+	   readers lose their position and need to resync. */
+	if (!mail_change_feed_is_rotated(feed) &&
+	    rename(feed->filepath, feed->filepath2) < 0 && errno != ENOENT) {
+		e_error(feed->event, "rename(%s, %s) failed: %m",
+			feed->filepath, feed->filepath2);
+		return;
+	}
+	mail_change_feed_close(feed);
+}
+
+int mail_change_feed_append(struct mail_change_feed *feed,
+			    const struct mail_change_feed_record *recs,
+			    unsigned int count)
+{
+	size_t size = sizeof(*recs) * count;
+	struct stat st;
+	ssize_t ret;
+
+	if (count == 0)
+		return 0;
+
+	/* Make sure the records are written to the latest file. Otherwise
+	   readers that have already moved on from the rotated file would never
+	   see the records. */
+	if (feed->fd != -1 && mail_change_feed_is_rotated(feed))
+		mail_change_feed_close(feed);
+	if (feed->fd == -1) {
+		if (mail_change_feed_open(feed) < 0)
+			return -1;
+		i_assert(feed->fd != -1);
+	}
+
+	/* rely on atomic O_APPEND writes instead of locking */
+	ret = write(feed->fd, recs, size);
+	if (ret < 0) {
+		e_error(feed->event, "write(%s) failed: %m", feed->filepath);
+		return -1;
+	} else if ((size_t)ret != size) {
+		e_error(feed->event, "write(%s) wrote %d/%zu bytes",
+			feed->filepath, (int)ret, size);
+		if (fstat(feed->fd, &st) == 0) {
+			if (ftruncate(feed->fd, st.st_size - ret) < 0) {
+				e_error(feed->event, "ftruncate(%s) failed: %m",
+					feed->filepath);
+			}
+		}
+		return -1;
+	}
+	if (feed->fsync_mode != FSYNC_MODE_NEVER &&
+	    fdatasync(feed->fd) < 0) {
+		e_error(feed->event, "fdatasync(%s) failed: %m",
+			feed->filepath);
+		return -1;
+	}
+
+	mail_change_feed_rotate_if_needed(feed);
+	return 0;
+}
+
+static uoff_t mail_change_feed_get_end_offset(uoff_t size)
+{
+	const uoff_t hdr_size = sizeof(struct mail_change_feed_header);
+	const uoff_t rec_size = sizeof(struct mail_change_feed_record);
+
+	/* ignore a partially written record at the end */
+	if (size < hdr_size)
+		return hdr_size;
+	return hdr_size + (size - hdr_size) / rec_size * rec_size;
+}
+
+int mail_change_feed_get_head(struct mail_change_feed *feed,
+			      struct mail_change_feed_cursor *cursor_r)
+{
+	const char *path = feed->filepath;
+	struct stat st;
+	int fd, ret;
+
+	i_zero(cursor_r);
+	ret = mail_change_feed_open_file(feed, path, O_RDONLY, &fd,
+					 &cursor_r->file_seq);
+	if (ret == 0) {
+		/* the log was just rotated - the next file continues from the
+		   end of the rotated one */
+		path = feed->filepath2;
+		ret = mail_change_feed_open_file(feed, path, O_RDONLY, &fd,
+						 &cursor_r->file_seq);
+	}
+	if (ret <= 0)
+		return ret;
+
+	if (fstat(fd, &st) < 0) {
+		e_error(feed->event, "fstat(%s) failed: %m", path);
+		ret = -1;
+	} else {
+		cursor_r->offset = mail_change_feed_get_end_offset(st.st_size);
+		ret = 0;
+	}
+	i_close_fd_path(&fd, path);
+	return ret;
+}
+
+static void
+mail_change_feed_iter_add_file(struct mail_change_feed_iter *iter,
+			       const char *path, uint32_t file_seq)
+{
+	struct mail_change_feed_iter_file *file =
+		&iter->files[iter->file_count++];
+
+	file->path = path;
+	file->file_seq = file_seq;
+	file->start_offset = sizeof(struct mail_change_feed_header);
+}
+
+static bool mail_change_feed_iter_open_next(struct mail_change_feed_iter *iter)
+{
+	const struct mail_change_feed_iter_file *file, *prev_file;
+	uint32_t file_seq;
+	int ret;
+
+	if (iter->fd != -1) {
+		i_close_fd_path(&iter->fd, iter->files[iter->file_idx].path);
+		iter->file_idx++;
+	}
+	for (; iter->file_idx < iter->file_count; iter->file_idx++) {
+		file = &iter->files[iter->file_idx];
+		ret = mail_change_feed_open_file(iter->feed, file->path,
+						 O_RDONLY, &iter->fd,
+						 &file_seq);
+		if (ret < 0) {
+			iter->failed = TRUE;
+			return FALSE;
+		}
+		if (ret == 0 || file_seq != file->file_seq) {
+			/* rotated after the iteration started - the records
+			   can be read on the next iteration */
+			i_close_fd_path(&iter->fd, file->path);
+			return FALSE;
+		}
+		prev_file = iter->file_idx == 0 ? NULL :
+			&iter->files[iter->file_idx-1];
+		if (prev_file != NULL &&
+		    file->file_seq != prev_file->file_seq + 1)
+			iter->lost = TRUE;
+		iter->cursor.file_seq = file->file_seq;
+		iter->cursor.offset = file->start_offset;
+		iter->idx = iter->count = 0;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+struct mail_change_feed_iter *
+mail_change_feed_iter_init(struct mail_change_feed *feed,
+			   const struct mail_change_feed_cursor *cursor)
+{
+	struct mail_change_feed_iter *iter;
+	uint32_t seq, seq2;
+	int fd, fd2, ret, ret2;
+
+	iter = i_new(struct mail_change_feed_iter, 1);
+	iter->feed = feed;
+	iter->fd = -1;
+	if (cursor != NULL)
+		iter->cursor = *cursor;
+
+	/* open the current file first, so that if it gets rotated in the
+	   middle, the .2 file is still newer or the same */
+	ret = mail_change_feed_open_file(feed, feed->filepath, O_RDONLY,
+					 &fd, &seq);
+	ret2 = mail_change_feed_open_file(feed, feed->filepath2, O_RDONLY,
+					  &fd2, &seq2);
+	if (ret < 0 || ret2 < 0)
+		iter->failed = TRUE;
+	if (ret > 0)
+		i_close_fd_path(&fd, feed->filepath);
+	if (ret2 > 0)
+		i_close_fd_path(&fd2, feed->filepath2);
+	if (iter->failed)
+		return iter;
+
+	if (ret2 > 0 && (ret <= 0 || seq2 < seq))
+		mail_change_feed_iter_add_file(iter, feed->filepath2, seq2);
+	if (ret > 0)
+		mail_change_feed_iter_add_file(iter, feed->filepath, seq);
+
+	/* skip the files that the cursor has already processed */
+	while (iter->file_count > 0 && iter->cursor.file_seq != 0 &&
+	       iter->files[0].file_seq < iter->cursor.file_seq) {
+		iter->files[0] = iter->files[1];
+		iter->file_count--;
+	}
+	if (iter->file_count > 0) {
+		if (iter->files[0].file_seq == iter->cursor.file_seq) {
+			iter->files[0].start_offset = I_MAX(iter->cursor.offset,
+				iter->files[0].start_offset);
+		} else if (iter->cursor.file_seq != 0 ||
+			   iter->files[0].file_seq > 1) {
+			/* the cursor's log file has already been deleted */
+			iter->lost = TRUE;
+		}
+	} else if (iter->cursor.file_seq != 0) {
+		/* the cursor is newer than any of the files - they were
+		   deleted */
+		iter->lost = TRUE;
+		i_zero(&iter->cursor);
+	}
+	(void)mail_change_feed_iter_open_next(iter);
+	return iter;
+}
+
+static bool
+mail_change_feed_record_is_valid(const struct mail_change_feed_record *rec)
+{
+	return rec->type >= MAIL_CHANGE_FEED_RECORD_MAIL_APPEND &&
+		rec->type <= MAIL_CHANGE_FEED_RECORD_UNSUBSCRIBE;
+}
+
+const struct mail_change_feed_record *
+mail_change_feed_iter_next(struct mail_change_feed_iter *iter)
+{
+	const struct mail_change_feed_record *rec;
+	ssize_t ret;
+
+	if (iter->idx == iter->count) {
+		if (iter->fd == -1 || iter->failed)
+			return NULL;
+
+		ret = pread(iter->fd, iter->buf, sizeof(iter->buf),
+			    iter->cursor.offset);
+		if (ret < 0) {
+			e_error(iter->feed->event, "pread(%s) failed: %m",
+				iter->files[iter->file_idx].path);
+			iter->failed = TRUE;
+			return NULL;
+		}
+		iter->idx = 0;
+		/* a partially written record is read on the next
+		   iteration */
+		iter->count = ret / sizeof(iter->buf[0]);
+		if (iter->count == 0) {
+			if (!mail_change_feed_iter_open_next(iter))
+				return NULL;
+			return mail_change_feed_iter_next(iter);
+		}
+	}
+	rec = &iter->buf[iter->idx];
+	if (!mail_change_feed_record_is_valid(rec)) {
+		e_error(iter->feed->event,
+			"Corrupted change feed %s at offset %"PRIuUOFF_T": "
+			"type=%d", iter->files[iter->file_idx].path,
+			iter->cursor.offset, rec->type);
+		iter->failed = TRUE;
+		return NULL;
+	}
+	iter->idx++;
+	iter->cursor.offset += sizeof(*rec);
+	return rec;
+}
+
+int mail_change_feed_iter_deinit(struct mail_change_feed_iter **_iter,
+				 struct mail_change_feed_cursor *cursor_r)
+{
+	struct mail_change_feed_iter *iter = *_iter;
+	int ret = iter->failed ? -1 : (iter->lost ? 0 : 1);
+
+	*_iter = NULL;
+
+	if (iter->fd != -1)
+		i_close_fd_path(&iter->fd, iter->files[iter->file_idx].path);
+	*cursor_r = iter->cursor;
+	i_free(iter);
+	return ret;
+}
+
+const char *
+mail_change_feed_cursor_export(const struct mail_change_feed_cursor *cursor)
+{
+	return t_strdup_printf("%u:%"PRIuUOFF_T, cursor->file_seq,
+			       cursor->offset);
+}
+
+int mail_change_feed_cursor_import(const char *str,
+				   struct mail_change_feed_cursor *cursor_r)
+{
+	const char *p = strchr(str, ':');
+
+	i_zero(cursor_r);
+	if (p == NULL ||
+	    str_to_uint32(t_strdup_until(str, p), &cursor_r->file_seq) < 0 ||
+	    str_to_uoff(p + 1, &cursor_r->offset) < 0)
+		return -1;
+	/* offset 0 means that the log didn't exist yet */
+	if (cursor_r->offset != 0 &&
+	    mail_change_feed_get_end_offset(cursor_r->offset) !=
+	    cursor_r->offset)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,103 @@
+#ifndef MAIL_CHANGE_FEED_H
+#define MAIL_CHANGE_FEED_H
+
+#include "guid.h"
+#include "fsync-mode.h"
+
+/* Append-only log of a user's mailbox and message changes. Readers keep
+   a cursor to the position they have processed and read only the records
+   after it. The log is rotated to <path>.2 when it grows large, so a reader
+   that falls more than one rotation behind loses its position and must do
+   a full resync. */
+
+enum mail_change_feed_record_type {
+	/* Message was added to the mailbox. */
+	MAIL_CHANGE_FEED_RECORD_MAIL_APPEND = 1,
+	MAIL_CHANGE_FEED_RECORD_MAIL_EXPUNGE,
+	/* Message's flags or keywords were changed. */
+	MAIL_CHANGE_FEED_RECORD_MAIL_FLAGS,
+	MAIL_CHANGE_FEED_RECORD_MAILBOX_CREATE,
+	MAIL_CHANGE_FEED_RECORD_MAILBOX_DELETE,
+	/* Mailbox's name changed. The GUID stays the same. */
+	MAIL_CHANGE_FEED_RECORD_MAILBOX_RENAME,
+	/* Mailbox's metadata (e.g. UIDVALIDITY) was updated. */
+	MAIL_CHANGE_FEED_RECORD_MAILBOX_UPDATE,
+	/* Subscriptions are about names, so mailbox_guid is
+	   mailbox_name_get_sha128() of the mailbox's vname like in
+	   dovecot.mailbox.log. */
+	MAIL_CHANGE_FEED_RECORD_SUBSCRIBE,
+	MAIL_CHANGE_FEED_RECORD_UNSUBSCRIBE,
+};
+
+struct mail_change_feed_record {
+	uint8_t type;
+	uint8_t padding[3];
+	guid_128_t mailbox_guid;
+	/* 0 for mailbox changes */
+	uint8_t uid[4];
+	uint8_t timestamp[4];
+};
+ARRAY_DEFINE_TYPE(mail_change_feed_record, struct mail_change_feed_record);
+
+struct mail_change_feed_cursor {
+	/* Sequence of the log file. It's incremented whenever the log is
+	   rotated. */
+	uint32_t file_seq;
+	uoff_t offset;
+};
+
+struct mail_change_feed *
+mail_change_feed_alloc(struct event *parent_event, const char *path);
+void mail_change_feed_free(struct mail_change_feed **feed);
+
+void mail_change_feed_set_permissions(struct mail_change_feed *feed,
+				      mode_t mode, gid_t gid,
+				      const char *gid_origin);
+/* Appends are fdatasync()ed unless fsync_mode is FSYNC_MODE_NEVER. The default
+   is FSYNC_MODE_OPTIMIZED. */
+void mail_change_feed_set_fsync_mode(struct mail_change_feed *feed,
+				     enum fsync_mode fsync_mode);
+
+void mail_change_feed_record_init(struct mail_change_feed_record *rec,
+				  enum mail_change_feed_record_type type,
+				  const guid_128_t mailbox_guid, uint32_t uid,
+				  time_t stamp);
+uint32_t
+mail_change_feed_record_get_uid(const struct mail_change_feed_record *rec);
+time_t
+mail_change_feed_record_get_timestamp(const struct mail_change_feed_record *rec);
+
+/* Append the records to the log with a single write, so they're never
+   interleaved with other processes' records. Returns 0 if ok, -1 if
+   error. */
+int mail_change_feed_append(struct mail_change_feed *feed,
+			    const struct mail_change_feed_record *recs,
+			    unsigned int count);
+
+/* Get a cursor pointing to the current end of the log. Returns 0 if ok,
+   -1 if error. */
+int mail_change_feed_get_head(struct mail_change_feed *feed,
+			      struct mail_change_feed_cursor *cursor_r);
+
+/* Iterate through the records after the cursor. If cursor is NULL, iterate
+   through all the existing records. */
+struct mail_change_feed_iter *
+mail_change_feed_iter_init(struct mail_change_feed *feed,
+			   const struct mail_change_feed_cursor *cursor);
+const struct mail_change_feed_record *
+mail_change_feed_iter_next(struct mail_change_feed_iter *iter);
+/* Returns the cursor after the last returned record. Returns 1 if ok,
+   0 if the cursor pointed to an already deleted log file, so some records
+   were lost and the reader must resync everything, -1 if error. The cursor
+   is usable for continuing in all cases. */
+int mail_change_feed_iter_deinit(struct mail_change_feed_iter **iter,
+				 struct mail_change_feed_cursor *cursor_r);
+
+/* Export/import cursor as a "<file_seq>:<offset>" string. Import fails if
+   the offset doesn't point to a record boundary. */
+const char *
+mail_change_feed_cursor_export(const struct mail_change_feed_cursor *cursor);
+int mail_change_feed_cursor_import(const char *str,
+				   struct mail_change_feed_cursor *cursor_r);
+
+#endif
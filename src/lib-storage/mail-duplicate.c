@@ -12,6 +12,8 @@
 #include "file-dotlock.h"
 #include "md5.h"
 #include "hash.h"
+#include "strnum.h"
+#include "dict.h"
 #include "mail-user.h"
 #include "mail-storage-settings.h"
 #include "mail-duplicate.h"
@@ -24,6 +26,7 @@
 #define DUPLICATE_VERSION 2
 
 #define DUPLICATE_LOCK_FNAME_PREFIX "duplicate.lock."
+#define DUPLICATE_DICT_PATH DICT_PATH_PRIVATE"duplicate/"
 
 #define DUPLICATE_LOCK_TIMEOUT_SECS 65
 #define DUPLICATE_LOCK_WARN_SECS 4
@@ -54,6 +57,8 @@ struct mail_duplicate {
 
 	bool marked:1;
 	bool changed:1;
+	/* Expired record was found from mail_duplicate_dict */
+	bool expired:1;
 };
 
 struct mail_duplicate_file_header {
@@ -86,6 +91,11 @@ struct mail_duplicate_db {
 	char *lock_dir;
 	struct dotlock_settings dotlock_set;
 
+	/* mail_duplicate_dict: records are looked up and written one at a
+	   time instead of reading and rewriting the whole file. */
+	struct dict *dict;
+	char *dict_prefix;
+
 	unsigned int transaction_count;
 };
 
@@ -441,6 +451,100 @@ static void mail_duplicate_update(struct mail_duplicate_transaction *trans)
 	}
 }
 
+static const char *
+mail_duplicate_dict_key(struct mail_duplicate_db *db,
+			const struct mail_duplicate *dup)
+{
+	struct md5_context ctx;
+	unsigned char digest[MD5_RESULTLEN];
+
+	/* users are compared case-insensitively */
+	md5_init(&ctx);
+	md5_update(&ctx, dup->id, dup->id_size);
+	md5_update(&ctx, "", 1);
+	md5_update(&ctx, t_str_lcase(dup->user), strlen(dup->user));
+	md5_final(&ctx, digest);
+	return t_strconcat(db->dict_prefix,
+			   binary_to_hex(digest, sizeof(digest)), NULL);
+}
+
+static int
+mail_duplicate_dict_lookup(struct mail_duplicate_transaction *trans,
+			   struct mail_duplicate *dup)
+{
+	struct mail_duplicate_db *db = trans->db;
+	const char *key, *value, *error;
+	time_t stamp;
+	int ret;
+
+	if (dup->changed)
+		return 0;
+
+	key = mail_duplicate_dict_key(db, dup);
+	ret = dict_lookup(db->dict, mail_user_get_dict_op_settings(db->user),
+			  pool_datastack_create(), key, &value, &error);
+	if (ret < 0) {
+		e_error(trans->event, "dict_lookup(%s) failed: %s", key, error);
+		return -1;
+	}
+	if (ret > 0 && str_to_time(value, &stamp) == 0 &&
+	    stamp >= ioloop_time) {
+		dup->marked = TRUE;
+		dup->time = stamp;
+	} else {
+		dup->marked = FALSE;
+		if (ret > 0) {
+			dup->expired = TRUE;
+			trans->changed = TRUE;
+		}
+	}
+	return 0;
+}
+
+static void
+mail_duplicate_dict_commit(struct mail_duplicate_transaction *trans)
+{
+	struct mail_duplicate_db *db = trans->db;
+	struct dict_op_settings set;
+	struct dict_transaction_context *dtrans;
+	struct hash_iterate_context *iter;
+	struct mail_duplicate *d;
+	const char *error;
+	time_t max_stamp = 0;
+
+	/* The timestamps are checked by lookups, so the dict expiration only
+	   needs to make sure that the records don't stay around forever.
+	   Without it the expired records are removed only when they're
+	   looked up. */
+	iter = hash_table_iterate_init(trans->hash);
+	while (hash_table_iterate(iter, trans->hash, &d, &d)) {
+		if (d->changed && d->time > max_stamp)
+			max_stamp = d->time;
+	}
+	hash_table_iterate_deinit(&iter);
+
+	set = *mail_user_get_dict_op_settings(db->user);
+	if (max_stamp > ioloop_time && dict_supports_expire_secs(db->dict))
+		set.expire_secs = max_stamp - ioloop_time;
+
+	dtrans = dict_transaction_begin(db->dict, &set);
+	iter = hash_table_iterate_init(trans->hash);
+	while (hash_table_iterate(iter, trans->hash, &d, &d)) {
+		if (d->changed) {
+			dict_set(dtrans, mail_duplicate_dict_key(db, d),
+				 dec2str(d->time));
+		} else if (d->expired) {
+			dict_unset(dtrans, mail_duplicate_dict_key(db, d));
+		}
+	}
+	hash_table_iterate_deinit(&iter);
+
+	if (dict_transaction_commit(&dtrans, &error) < 0) {
+		e_error(trans->event, "dict_transaction_commit() failed: %s",
+			error);
+	}
+}
+
 struct mail_duplicate_transaction *
 mail_duplicate_transaction_begin(struct mail_duplicate_db *db)
 {
@@ -467,10 +571,12 @@ mail_duplicate_transaction_begin(struct mail_duplicate_db *db)
 	e_debug(trans->event, "Transaction begin; lock %s", db->path);
 
 	trans->path = p_strdup(pool, db->path);
-	hash_table_create(&trans->hash, pool, 0,
-			  mail_duplicate_hash, mail_duplicate_cmp);
+	hash_table_create_flags(&trans->hash, pool, 0,
+				mail_duplicate_hash, mail_duplicate_cmp,
+				HASH_TABLE_FLAG_OPEN_ADDRESSING);
 
-	mail_duplicate_read(trans);
+	if (db->dict == NULL)
+		mail_duplicate_read(trans);
 
 	return trans;
 }
@@ -563,7 +669,10 @@ mail_duplicate_check(struct mail_duplicate_transaction *trans,
 		return MAIL_DUPLICATE_CHECK_RESULT_DEADLOCK;
 	}
 
-	mail_duplicate_update(trans);
+	if (trans->db->dict == NULL)
+		mail_duplicate_update(trans);
+	else if (mail_duplicate_dict_lookup(trans, dup) < 0)
+		return MAIL_DUPLICATE_CHECK_RESULT_IO_ERROR;
 	if (dup->marked) {
 		e_debug(trans->event, "Check ID: found");
 		return MAIL_DUPLICATE_CHECK_RESULT_EXISTS;
@@ -628,6 +737,15 @@ void mail_duplicate_transaction_commit(
 
 	struct mail_duplicate_db *db = trans->db;
 
+	if (db->dict != NULL) {
+		e_debug(trans->event, "Commit; update dict");
+		T_BEGIN {
+			mail_duplicate_dict_commit(trans);
+		} T_END;
+		mail_duplicate_transaction_free(&trans);
+		return;
+	}
+
 	i_assert(trans->path != NULL);
 	e_debug(trans->event, "Commit; overwrite %s", trans->path);
 
@@ -747,6 +865,25 @@ mail_duplicate_db_init(struct mail_user *user, const char *name)
 	db->dotlock_set.use_excl_lock = mail_set->dotlock_use_excl;
 	db->dotlock_set.nfs_flush = mail_set->mail_nfs_storage;
 
+	if (*mail_set->mail_duplicate_dict != '\0') {
+		struct dict_settings dict_set;
+		const char *error;
+
+		i_zero(&dict_set);
+		dict_set.base_dir = user->set->base_dir;
+		dict_set.event_parent = db->event;
+		if (dict_init(mail_set->mail_duplicate_dict, &dict_set,
+			      &db->dict, &error) < 0) {
+			e_error(db->event, "mail_duplicate_dict: "
+				"dict_init(%s) failed: %s - "
+				"disabling duplicate database",
+				mail_set->mail_duplicate_dict, error);
+			i_free_and_null(db->path);
+			return db;
+		}
+		db->dict_prefix = i_strconcat(DUPLICATE_DICT_PATH, name, "/",
+					      NULL);
+	}
 	return db;
 }
 
@@ -760,7 +897,10 @@ void mail_duplicate_db_deinit(struct mail_duplicate_db **_db)
 
 	i_assert(db->transaction_count == 0);
 
+	if (db->dict != NULL)
+		dict_deinit(&db->dict);
 	event_unref(&db->event);
+	i_free(db->dict_prefix);
 	i_free(db->path);
 	i_free(db->lock_dir);
 	i_free(db);
@@ -820,3 +820,116 @@ void mail_search_args_simplify(struct mail_search_args *args)
 			removals = TRUE;
 	} while (removals);
 }
+
+/* Rough relative costs of matching search args, from the cheapest. */
+enum mail_search_arg_cost {
+	/* only the index record is needed */
+	MAIL_SEARCH_ARG_COST_INDEX = 0,
+	/* usually found from cache, otherwise stat() or similar */
+	MAIL_SEARCH_ARG_COST_CACHE,
+	/* message header may need to be parsed */
+	MAIL_SEARCH_ARG_COST_HEADER,
+	/* whole message may need to be read to get its virtual size */
+	MAIL_SEARCH_ARG_COST_SIZE,
+	/* message body needs to be searched */
+	MAIL_SEARCH_ARG_COST_BODY,
+	/* the whole message needs to be searched or parsed */
+	MAIL_SEARCH_ARG_COST_TEXT,
+};
+
+struct mail_search_arg_with_cost {
+	struct mail_search_arg *arg;
+	enum mail_search_arg_cost cost;
+};
+
+static enum mail_search_arg_cost
+mail_search_args_sort_list_by_cost(struct mail_search_arg **argsp);
+
+static enum mail_search_arg_cost
+mail_search_arg_get_cost(struct mail_search_arg *arg)
+{
+	switch (arg->type) {
+	case SEARCH_OR:
+	case SEARCH_SUB:
+		return mail_search_args_sort_list_by_cost(&arg->value.subargs);
+	case SEARCH_ALL:
+	case SEARCH_SEQSET:
+	case SEARCH_UIDSET:
+	case SEARCH_FLAGS:
+	case SEARCH_KEYWORDS:
+	case SEARCH_MODSEQ:
+	case SEARCH_MAILBOX:
+	case SEARCH_MAILBOX_GUID:
+	case SEARCH_MAILBOX_GLOB:
+		return MAIL_SEARCH_ARG_COST_INDEX;
+	case SEARCH_BEFORE:
+	case SEARCH_ON:
+	case SEARCH_SINCE:
+		if (arg->value.date_type == MAIL_SEARCH_DATE_TYPE_SENT)
+			return MAIL_SEARCH_ARG_COST_HEADER;
+		return MAIL_SEARCH_ARG_COST_CACHE;
+	case SEARCH_SAVEDATESUPPORTED:
+	case SEARCH_GUID:
+	case SEARCH_REAL_UID:
+		return MAIL_SEARCH_ARG_COST_CACHE;
+	case SEARCH_SMALLER:
+	case SEARCH_LARGER:
+		return MAIL_SEARCH_ARG_COST_SIZE;
+	case SEARCH_HEADER:
+	case SEARCH_HEADER_ADDRESS:
+	case SEARCH_HEADER_COMPRESS_LWSP:
+		return MAIL_SEARCH_ARG_COST_HEADER;
+	case SEARCH_BODY:
+		return MAIL_SEARCH_ARG_COST_BODY;
+	case SEARCH_TEXT:
+	case SEARCH_INTHREAD:
+	case SEARCH_MIMEPART:
+		return MAIL_SEARCH_ARG_COST_TEXT;
+	}
+	i_unreached();
+}
+
+static enum mail_search_arg_cost
+mail_search_args_sort_list_by_cost(struct mail_search_arg **argsp)
+{
+	struct mail_search_arg_with_cost *args, tmp;
+	struct mail_search_arg *arg, **argp;
+	enum mail_search_arg_cost max_cost = MAIL_SEARCH_ARG_COST_INDEX;
+	unsigned int i, j, count = 0;
+
+	for (arg = *argsp; arg != NULL; arg = arg->next)
+		count++;
+	if (count == 0)
+		return max_cost;
+
+	args = t_new(struct mail_search_arg_with_cost, count);
+	for (i = 0, arg = *argsp; arg != NULL; arg = arg->next, i++) {
+		args[i].arg = arg;
+		args[i].cost = mail_search_arg_get_cost(arg);
+		if (args[i].cost > max_cost)
+			max_cost = args[i].cost;
+	}
+
+	/* stable insertion sort - the lists are short */
+	for (i = 1; i < count; i++) {
+		tmp = args[i];
+		for (j = i; j > 0 && args[j-1].cost > tmp.cost; j--)
+			args[j] = args[j-1];
+		args[j] = tmp;
+	}
+
+	argp = argsp;
+	for (i = 0; i < count; i++) {
+		*argp = args[i].arg;
+		argp = &args[i].arg->next;
+	}
+	*argp = NULL;
+	return max_cost;
+}
+
+void mail_search_args_sort_by_cost(struct mail_search_args *args)
+{
+	T_BEGIN {
+		(void)mail_search_args_sort_list_by_cost(&args->args);
+	} T_END;
+}
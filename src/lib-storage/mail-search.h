@@ -251,6 +251,10 @@ bool mail_search_args_match_mailbox(struct mail_search_args *args,
 /* Simplify/optimize search arguments. Afterwards all OR/SUB args are
    guaranteed to have match_not=FALSE. */
 void mail_search_args_simplify(struct mail_search_args *args);
+/* Reorder the AND and OR lists so that the args that are expected to be
+   cheapest to match come first. Once they have decided the result, the
+   more expensive args don't need to be matched anymore. */
+void mail_search_args_sort_by_cost(struct mail_search_args *args);
 
 /* Append all args as IMAP SEARCH AND-query to the dest string and returns TRUE.
    If some search arg can't be written as IMAP SEARCH parameter, error_r is set
@@ -707,6 +707,8 @@ struct mail_search_context {
 	ARRAY(struct mail *) mails;
 	unsigned int unused_mail_idx;
 	unsigned int max_mails;
+	/* mailbox_search_set_sort_limit() */
+	unsigned int sort_limit;
 
 	ARRAY(union mail_search_module_context *) module_contexts;
 
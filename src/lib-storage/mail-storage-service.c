@@ -1601,6 +1601,31 @@ int mail_storage_service_next_with_session_suffix(struct mail_storage_service_ct
 	return ret;
 }
 
+void mail_storage_service_user_set_session_id(struct mail_user *mail_user,
+					      const char *session_id)
+{
+	struct mail_storage_service_user *user = mail_user->service_user;
+	struct mail_storage_service_privileges priv;
+	const char *error;
+
+	user->input.session_id = p_strdup(user->pool, session_id);
+	user->session_id_counter = 1;
+	mail_user->session_id = p_strdup(mail_user->pool, session_id);
+	event_add_str(user->event, "session", session_id);
+
+	if (user->log_prefix == NULL)
+		return;
+	T_BEGIN {
+		if (service_parse_privileges(user->service_ctx, user,
+					     &priv, &error) < 0) {
+			e_error(user->event, "%s", error);
+		} else {
+			mail_storage_service_init_log(user->service_ctx,
+						      user, &priv);
+		}
+	} T_END;
+}
+
 void mail_storage_service_restrict_setenv(struct mail_storage_service_ctx *ctx,
 					  struct mail_storage_service_user *user)
 {
@@ -1685,6 +1710,30 @@ void mail_storage_service_init_settings(struct mail_storage_service_ctx *ctx,
 	mail_storage_service_first_init(ctx, set_parser, user_set, ctx->flags);
 }
 
+void mail_storage_service_preload(struct mail_storage_service_ctx *ctx)
+{
+	const struct mail_user_settings *user_set;
+	struct setting_parser_context *set_parser;
+	const char *error;
+
+	if (ctx->conn != NULL)
+		return;
+
+	/* Errors are logged, but otherwise ignored here. The first user
+	   lookup will fail the same way and report it to the client. */
+	if (mail_storage_service_read_settings(ctx, NULL,
+					       &set_parser, &error) < 0) {
+		e_error(ctx->service->event, "%s", error);
+		return;
+	}
+	user_set = settings_parser_get_root_set(set_parser,
+						&mail_user_setting_parser_info);
+	mail_storage_service_first_init(ctx, set_parser, user_set, ctx->flags);
+	if (mail_storage_service_load_modules(ctx, set_parser, user_set,
+					      &error) < 0)
+		e_error(ctx->service->event, "%s", error);
+}
+
 static int
 mail_storage_service_all_iter_deinit(struct mail_storage_service_ctx *ctx)
 {
@@ -99,6 +99,12 @@ int mail_storage_service_read_settings(struct mail_storage_service_ctx *ctx,
 void mail_storage_service_init_settings(struct mail_storage_service_ctx *ctx,
 					const struct mail_storage_service_input *input)
 	ATTR_NULL(2);
+/* Do the global initialization that is otherwise done by the first user
+   lookup: read the global settings, create the auth connection and load the
+   global mail_plugins. This is intended to be called by processes that are
+   started before they have any clients (service { process_min_avail }), so
+   the first client doesn't have to wait for it. */
+void mail_storage_service_preload(struct mail_storage_service_ctx *ctx);
 /* Returns 1 if ok, 0 if user wasn't found, -1 if fatal error,
    -2 if error is user-specific (e.g. invalid settings). */
 int mail_storage_service_lookup(struct mail_storage_service_ctx *ctx,
@@ -122,6 +128,10 @@ int mail_storage_service_next_with_session_suffix(struct mail_storage_service_ct
 						   const char **error_r);
 void mail_storage_service_restrict_setenv(struct mail_storage_service_ctx *ctx,
 					  struct mail_storage_service_user *user);
+/* Change the session ID of an already initialized mail user, e.g. when the
+   user is reused for another session. The log prefix is updated as well. */
+void mail_storage_service_user_set_session_id(struct mail_user *mail_user,
+					      const char *session_id);
 /* Combine lookup() and next() into one call. */
 int mail_storage_service_lookup_next(struct mail_storage_service_ctx *ctx,
 				     const struct mail_storage_service_input *input,
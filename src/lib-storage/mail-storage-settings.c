@@ -38,6 +38,7 @@ static const struct setting_define mail_storage_setting_defines[] = {
 	DEF(SIZE, mail_attachment_min_size),
 	DEF(STR, mail_attachment_detection_options),
 	DEF(STR_VARS, mail_attribute_dict),
+	DEF(STR_VARS, mail_duplicate_dict),
 	DEF(UINT, mail_prefetch_count),
 	DEF(STR, mail_cache_fields),
 	DEF(STR, mail_always_cache_fields),
@@ -54,12 +55,20 @@ static const struct setting_define mail_storage_setting_defines[] = {
 	DEF(UINT_HIDDEN, mail_cache_purge_delete_percentage),
 	DEF(UINT_HIDDEN, mail_cache_purge_continued_percentage),
 	DEF(UINT_HIDDEN, mail_cache_purge_header_continue_count),
+	DEF(UINT_HIDDEN, mail_cache_columns_min_messages),
+	DEF(UINT_HIDDEN, mail_cache_dict_min_messages),
+	DEF(SIZE_HIDDEN, mail_cache_fields_max_size),
+	DEF(BOOL_HIDDEN, mail_cache_field_bloom),
+	DEF(BOOL_HIDDEN, mail_search_result_cache),
 	DEF(SIZE_HIDDEN, mail_index_rewrite_min_log_bytes),
 	DEF(SIZE_HIDDEN, mail_index_rewrite_max_log_bytes),
+	DEF(SIZE_HIDDEN, mail_index_rewrite_incremental_min_size),
 	DEF(SIZE_HIDDEN, mail_index_log_rotate_min_size),
 	DEF(SIZE_HIDDEN, mail_index_log_rotate_max_size),
 	DEF(TIME_HIDDEN, mail_index_log_rotate_min_age),
 	DEF(TIME_HIDDEN, mail_index_log2_max_age),
+	DEF(UINT, mail_index_cache_max_count),
+	DEF(TIME, mail_index_cache_timeout),
 	DEF(TIME, mailbox_idle_check_interval),
 	DEF(UINT, mail_max_keyword_length),
 	DEF(TIME, mail_max_lock_timeout),
@@ -96,6 +105,7 @@ const struct mail_storage_settings mail_storage_default_settings = {
 	.mail_attachment_min_size = 1024*128,
 	.mail_attachment_detection_options = "",
 	.mail_attribute_dict = "",
+	.mail_duplicate_dict = "",
 	.mail_prefetch_count = 0,
 	.mail_cache_fields = "flags",
 	.mail_always_cache_fields = "",
@@ -112,12 +122,20 @@ const struct mail_storage_settings mail_storage_default_settings = {
 	.mail_cache_purge_delete_percentage = 20,
 	.mail_cache_purge_continued_percentage = 200,
 	.mail_cache_purge_header_continue_count = 4,
+	.mail_cache_columns_min_messages = 0,
+	.mail_cache_dict_min_messages = 0,
+	.mail_cache_fields_max_size = 0,
+	.mail_cache_field_bloom = FALSE,
+	.mail_search_result_cache = FALSE,
 	.mail_index_rewrite_min_log_bytes = 8 * 1024,
 	.mail_index_rewrite_max_log_bytes = 128 * 1024,
+	.mail_index_rewrite_incremental_min_size = 0,
 	.mail_index_log_rotate_min_size = 32 * 1024,
 	.mail_index_log_rotate_max_size = 1024 * 1024,
 	.mail_index_log_rotate_min_age = 5 * 60,
 	.mail_index_log2_max_age = 3600 * 24 * 2,
+	.mail_index_cache_max_count = 3,
+	.mail_index_cache_timeout = 10,
 	.mailbox_idle_check_interval = 30,
 	.mail_max_keyword_length = 50,
 	.mail_max_lock_timeout = 0,
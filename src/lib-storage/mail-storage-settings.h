@@ -18,6 +18,7 @@ struct mail_storage_settings {
 	const char *mail_attachment_hash;
 	uoff_t mail_attachment_min_size;
 	const char *mail_attribute_dict;
+	const char *mail_duplicate_dict;
 	unsigned int mail_prefetch_count;
 	const char *mail_cache_fields;
 	const char *mail_always_cache_fields;
@@ -34,18 +35,26 @@ struct mail_storage_settings {
 	unsigned int mail_cache_purge_delete_percentage;
 	unsigned int mail_cache_purge_continued_percentage;
 	unsigned int mail_cache_purge_header_continue_count;
+	unsigned int mail_cache_columns_min_messages;
+	unsigned int mail_cache_dict_min_messages;
+	uoff_t mail_cache_fields_max_size;
 	uoff_t mail_index_rewrite_min_log_bytes;
 	uoff_t mail_index_rewrite_max_log_bytes;
+	uoff_t mail_index_rewrite_incremental_min_size;
 	uoff_t mail_index_log_rotate_min_size;
 	uoff_t mail_index_log_rotate_max_size;
 	unsigned int mail_index_log_rotate_min_age;
 	unsigned int mail_index_log2_max_age;
+	unsigned int mail_index_cache_max_count;
+	unsigned int mail_index_cache_timeout;
 	unsigned int mailbox_idle_check_interval;
 	unsigned int mail_max_keyword_length;
 	unsigned int mail_max_lock_timeout;
 	unsigned int mail_temp_scan_interval;
 	unsigned int mail_vsize_bg_after_count;
 	unsigned int mail_sort_max_read_count;
+	bool mail_cache_field_bloom;
+	bool mail_search_result_cache;
 	bool mail_save_crlf;
 	const char *mail_fsync;
 	bool mmap_disable;
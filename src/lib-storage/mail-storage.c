@@ -2543,6 +2543,23 @@ mailbox_search_set_progress_hidden(struct mail_search_context *ctx, bool hidden)
 	ctx->progress_hidden = hidden;
 }
 
+void mailbox_search_set_sort_limit(struct mail_search_context *ctx,
+				   unsigned int limit)
+{
+	i_assert(ctx->sort_program != NULL);
+
+	ctx->sort_limit = limit;
+}
+
+void mailbox_search_set_prefetch_count(struct mail_search_context *ctx,
+				       unsigned int count)
+{
+	i_assert(!array_is_created(&ctx->mails) ||
+		 array_count(&ctx->mails) == 0);
+
+	ctx->max_mails = count + 1;
+}
+
 void mailbox_search_notify(struct mailbox *box, struct mail_search_context *ctx)
 {
 	if (ctx->search_start_time.tv_sec == 0) {
@@ -211,6 +211,10 @@ enum mailbox_transaction_flags {
 	   especially means the notify plugin. This would normally be used only
 	   with _FLAG_SYNC. */
 	MAILBOX_TRANSACTION_FLAG_NO_NOTIFY	= 0x40,
+	/* The transaction adds cache fields for a large number of mails
+	   (e.g. building the initial cache). Buffer more of the cache data
+	   in memory to write it with fewer larger writes. */
+	MAILBOX_TRANSACTION_FLAG_BULK_CACHE	= 0x80,
 };
 
 enum mailbox_sync_flags {
@@ -754,6 +758,18 @@ int mailbox_search_deinit(struct mail_search_context **ctx);
 void mailbox_search_set_progress_hidden(struct mail_search_context *ctx,
 					bool hidden);
 void mailbox_search_reset_progress_start(struct mail_search_context *ctx);
+/* Return only the first limit mails of a sorted search. This allows sorting
+   only the mails that are actually needed, e.g. the first page of a large
+   mailbox. 0 means no limit (default). This must be called before the first
+   mailbox_search_next*() call. */
+void mailbox_search_set_sort_limit(struct mail_search_context *ctx,
+				   unsigned int limit);
+/* Override the mail_prefetch_count setting for this search: start reading up
+   to count next mails before the current one is returned, so the I/O
+   overlaps with processing it. This must be called before the first
+   mailbox_search_next*() call. */
+void mailbox_search_set_prefetch_count(struct mail_search_context *ctx,
+				       unsigned int count);
 /* Search the next message. Returns TRUE if found, FALSE if not. */
 bool mailbox_search_next(struct mail_search_context *ctx, struct mail **mail_r);
 /* Like mailbox_search_next(), but don't spend too much time searching.
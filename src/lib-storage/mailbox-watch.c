@@ -2,6 +2,8 @@
 
 #include "lib.h"
 #include "ioloop.h"
+#include "str.h"
+#include "strescape.h"
 #include "mail-storage-private.h"
 #include "mailbox-watch.h"
 
@@ -150,3 +152,13 @@ int mailbox_watch_extract_notify_fd(struct mailbox *box, const char **reason_r)
 	io_loop_destroy(&ioloop);
 	return ret;
 }
+
+void mailbox_watch_append_paths(struct mailbox *box, string_t *dest)
+{
+	struct mailbox_notify_file *file;
+
+	for (file = box->notify_files; file != NULL; file = file->next) {
+		str_append_tabescaped(dest, file->path);
+		str_append_c(dest, '\t');
+	}
+}
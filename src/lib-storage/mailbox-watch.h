@@ -7,5 +7,8 @@ void mailbox_watch_remove_all(struct mailbox *box);
 /* Create a new temporary ioloop, add all the watches back and call
    io_loop_extract_notify_fd() on it. Returns fd on success, -1 on error. */
 int mailbox_watch_extract_notify_fd(struct mailbox *box, const char **reason_r);
+/* Append the watched paths to the string. Mailboxes with the same paths in
+   the same filesystem namespace get identical notifications. */
+void mailbox_watch_append_paths(struct mailbox *box, string_t *dest);
 
 #endif
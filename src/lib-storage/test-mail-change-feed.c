@@ -0,0 +1,194 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "test-common.h"
+#include "mail-change-feed.h"
+
+#include <unistd.h>
+
+#define TEST_FEED_PATH ".test-change-feed"
+/* enough records to get the log rotated */
+#define TEST_ROTATE_RECORD_COUNT (1024*1024 / sizeof(struct mail_change_feed_record) + 1)
+
+static guid_128_t test_guid = {
+	0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+	0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10
+};
+
+static void test_feed_unlink(void)
+{
+	i_unlink_if_exists(TEST_FEED_PATH);
+	i_unlink_if_exists(TEST_FEED_PATH".2");
+}
+
+static void
+test_feed_append(struct mail_change_feed *feed, unsigned int first_uid,
+		 unsigned int count)
+{
+	struct mail_change_feed_record *recs;
+	unsigned int i;
+
+	recs = i_new(struct mail_change_feed_record, count);
+	for (i = 0; i < count; i++) {
+		mail_change_feed_record_init(&recs[i],
+			MAIL_CHANGE_FEED_RECORD_MAIL_APPEND, test_guid,
+			first_uid + i, 1000 + i);
+	}
+	test_assert(mail_change_feed_append(feed, recs, count) == 0);
+	i_free(recs);
+}
+
+/* Iterate the feed from the cursor and check that the records' UIDs are
+   first_uid..first_uid+count-1. Returns the iter_deinit() return value. */
+static int
+test_feed_read(struct mail_change_feed *feed,
+	       struct mail_change_feed_cursor *cursor,
+	       unsigned int first_uid, unsigned int count)
+{
+	struct mail_change_feed_iter *iter;
+	const struct mail_change_feed_record *rec;
+	unsigned int n = 0;
+	bool uids_ok = TRUE;
+
+	iter = mail_change_feed_iter_init(feed, cursor);
+	while ((rec = mail_change_feed_iter_next(iter)) != NULL) {
+		if (mail_change_feed_record_get_uid(rec) != first_uid + n)
+			uids_ok = FALSE;
+		n++;
+	}
+	test_assert(uids_ok);
+	test_assert(n == count);
+	return mail_change_feed_iter_deinit(&iter, cursor);
+}
+
+static void test_mail_change_feed_append(void)
+{
+	struct mail_change_feed *feed;
+	struct mail_change_feed_iter *iter;
+	struct mail_change_feed_cursor cursor, head;
+	const struct mail_change_feed_record *rec;
+
+	test_begin("mail change feed append");
+	test_feed_unlink();
+	feed = mail_change_feed_alloc(NULL, TEST_FEED_PATH);
+
+	test_assert(mail_change_feed_get_head(feed, &head) == 0);
+	test_assert(head.file_seq == 0 && head.offset == 0);
+	cursor = head;
+	test_assert(test_feed_read(feed, &cursor, 0, 0) == 1);
+
+	test_feed_append(feed, 1, 3);
+	iter = mail_change_feed_iter_init(feed, NULL);
+	rec = mail_change_feed_iter_next(iter);
+	test_assert(rec != NULL &&
+		    rec->type == MAIL_CHANGE_FEED_RECORD_MAIL_APPEND &&
+		    guid_128_equals(rec->mailbox_guid, test_guid) &&
+		    mail_change_feed_record_get_uid(rec) == 1 &&
+		    mail_change_feed_record_get_timestamp(rec) == 1000);
+	test_assert(mail_change_feed_iter_deinit(&iter, &cursor) == 1);
+	test_assert(cursor.file_seq == 1);
+
+	/* continue after the first record */
+	test_assert(test_feed_read(feed, &cursor, 2, 2) == 1);
+	test_assert(mail_change_feed_get_head(feed, &head) == 0);
+	test_assert(cursor.file_seq == head.file_seq &&
+		    cursor.offset == head.offset);
+
+	/* the cursor from an empty feed sees all the records */
+	i_zero(&cursor);
+	test_assert(test_feed_read(feed, &cursor, 1, 3) == 1);
+
+	test_feed_append(feed, 4, 2);
+	test_assert(test_feed_read(feed, &cursor, 4, 2) == 1);
+	test_assert(test_feed_read(feed, &cursor, 0, 0) == 1);
+
+	mail_change_feed_free(&feed);
+	test_feed_unlink();
+	test_end();
+}
+
+static void test_mail_change_feed_rotate(void)
+{
+	struct mail_change_feed *feed;
+	struct mail_change_feed_cursor cursor, old_cursor;
+	unsigned int count = TEST_ROTATE_RECORD_COUNT;
+
+	test_begin("mail change feed rotate");
+	test_feed_unlink();
+	feed = mail_change_feed_alloc(NULL, TEST_FEED_PATH);
+
+	test_feed_append(feed, 1, 1);
+	i_zero(&cursor);
+	test_assert(test_feed_read(feed, &cursor, 1, 1) == 1);
+	old_cursor = cursor;
+
+	/* the records are read from both the rotated and the new file */
+	test_feed_append(feed, 2, count);
+	test_assert(access(TEST_FEED_PATH, F_OK) < 0);
+	test_feed_append(feed, 2 + count, 1);
+	test_assert(test_feed_read(feed, &cursor, 2, count + 1) == 1);
+	test_assert(cursor.file_seq == 2);
+
+	/* rotate again - the first file is deleted and the old cursor
+	   has lost records */
+	test_feed_append(feed, 3 + count, count);
+	test_feed_append(feed, 3 + count*2, 1);
+	test_assert(test_feed_read(feed, &cursor, 3 + count, count + 1) == 1);
+	test_assert(cursor.file_seq == 3);
+	test_assert(test_feed_read(feed, &old_cursor, 2 + count,
+				   count + 2) == 0);
+	test_assert(old_cursor.file_seq == cursor.file_seq &&
+		    old_cursor.offset == cursor.offset);
+
+	/* a new process continues the file sequence after rotation */
+	test_feed_append(feed, 4 + count*2, count);
+	mail_change_feed_free(&feed);
+	feed = mail_change_feed_alloc(NULL, TEST_FEED_PATH);
+	test_feed_append(feed, 4 + count*3, 1);
+	test_assert(test_feed_read(feed, &cursor, 4 + count*2, count + 1) == 1);
+	test_assert(cursor.file_seq == 4);
+
+	mail_change_feed_free(&feed);
+	test_feed_unlink();
+	test_end();
+}
+
+static void test_mail_change_feed_cursor(void)
+{
+	static const char *const invalid[] = {
+		"", "1", "1:", ":1", "x:1", "1:x", "1:2:3",
+		/* not at a record boundary */
+		"1:1", "1:9", "1:1234567"
+	};
+	struct mail_change_feed_cursor cursor;
+	const char *str;
+	unsigned int i;
+
+	test_begin("mail change feed cursor");
+	cursor.file_seq = 5;
+	cursor.offset = sizeof(struct mail_change_feed_record) * 100 + 8;
+	str = mail_change_feed_cursor_export(&cursor);
+	test_assert_strcmp(str, "5:2808");
+	i_zero(&cursor);
+	test_assert(mail_change_feed_cursor_import(str, &cursor) == 0);
+	test_assert(cursor.file_seq == 5 && cursor.offset == 2808);
+	test_assert(mail_change_feed_cursor_import("0:0", &cursor) == 0);
+	test_assert(mail_change_feed_cursor_import("1:8", &cursor) == 0);
+
+	for (i = 0; i < N_ELEMENTS(invalid); i++) {
+		test_assert_idx(mail_change_feed_cursor_import(invalid[i],
+							       &cursor) < 0, i);
+	}
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_mail_change_feed_append,
+		test_mail_change_feed_rotate,
+		test_mail_change_feed_cursor,
+		NULL
+	};
+	return test_run(test_functions);
+}
@@ -308,6 +308,44 @@ static void test_mail_search_args_simplify(void)
 	test_end();
 }
 
+static void test_mail_search_args_sort_by_cost(void)
+{
+	static const struct {
+		const char *input;
+		const char *output;
+	} sort_tests[] = {
+		{ "BODY foo FLAGGED", "FLAGGED BODY foo" },
+		{ "OR BODY foo SEEN", "OR SEEN BODY foo" },
+		{ "TEXT foo LARGER 100 SUBJECT bar SINCE 1-Jan-2020",
+		  "SINCE \"01-Jan-2020\" SUBJECT bar LARGER 100 TEXT foo" },
+		{ "SENTBEFORE 1-Jan-2020 BEFORE 1-Jan-2020",
+		  "BEFORE \"01-Jan-2020\" SENTBEFORE \"01-Jan-2020\"" },
+		/* the order of equally expensive args is kept */
+		{ "BODY foo BODY bar SUBJECT baz FROM qux",
+		  "SUBJECT baz FROM qux BODY foo BODY bar" },
+		/* sublists are sorted and then sorted by their most expensive
+		   arg */
+		{ "OR ( BODY foo SUBJECT bar ) ( FROM baz LARGER 10 ) UID 1:5",
+		  "UID 1:5 OR (FROM baz LARGER 10) (SUBJECT bar BODY foo)" },
+	};
+	struct mail_search_args *args;
+	string_t *str = t_str_new(256);
+	const char *error;
+	unsigned int i;
+
+	test_begin("mail search args sort by cost");
+	for (i = 0; i < N_ELEMENTS(sort_tests); i++) {
+		args = test_build_search_args(sort_tests[i].input);
+		mail_search_args_sort_by_cost(args);
+
+		str_truncate(str, 0);
+		test_assert(mail_search_args_to_imap(str, args->args, &error));
+		test_assert_idx(strcmp(str_c(str), sort_tests[i].output) == 0, i);
+		mail_search_args_unref(&args);
+	}
+	test_end();
+}
+
 static void test_mail_search_args_simplify_empty_lists(void)
 {
 	struct mail_search_args *args;
@@ -327,6 +365,7 @@ int main(void)
 		mail_storage_init,
 		test_mail_search_args_simplify,
 		test_mail_search_args_simplify_empty_lists,
+		test_mail_search_args_sort_by_cost,
 		mail_storage_deinit,
 		NULL
 	};
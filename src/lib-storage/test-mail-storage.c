@@ -2,8 +2,11 @@
 
 #include "lib.h"
 #include "ioloop.h"
+#include "array.h"
+#include "str.h"
 #include "test-common.h"
 #include "master-service.h"
+#include "mailbox-list-iter.h"
 #include "test-mail-storage-common.h"
 
 static const struct test_globals {
@@ -640,6 +643,148 @@ static void test_mailbox_list_mbox(void)
 	test_end();
 }
 
+static enum mailbox_existence
+test_mailbox_list_index_exists(struct mail_namespace *ns, const char *vname)
+{
+	struct mailbox *box;
+	enum mailbox_existence exists = MAILBOX_EXISTENCE_NONE;
+
+	box = mailbox_alloc(ns->list, vname, 0);
+	test_assert(mailbox_exists(box, FALSE, &exists) == 0);
+	mailbox_free(&box);
+	return exists;
+}
+
+static void test_mailbox_list_index_tree(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct mail_namespace *ns;
+	struct mailbox *box, *dest;
+	const char *vname;
+	unsigned int i;
+
+	test_begin("mailbox list index tree");
+	ctx = test_mail_storage_init();
+
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+		.driver_opts = ":LAYOUT=INDEX",
+		.hierarchy_sep = "/",
+	};
+	test_mail_storage_init_user(ctx, &set);
+	ns = mail_namespace_find_inbox(ctx->user->namespaces);
+
+	for (i = 0; i < 50; i++) {
+		vname = t_strdup_printf("parent/child%u", i);
+		box = mailbox_alloc(ns->list, vname, 0);
+		test_assert_idx(mailbox_create(box, NULL, FALSE) == 0, i);
+		mailbox_free(&box);
+	}
+	test_assert(test_mailbox_list_index_exists(ns, "parent/child0") ==
+		    MAILBOX_EXISTENCE_SELECT);
+	test_assert(test_mailbox_list_index_exists(ns, "parent/child50") ==
+		    MAILBOX_EXISTENCE_NONE);
+	test_assert(test_mailbox_list_index_exists(ns, "child0") ==
+		    MAILBOX_EXISTENCE_NONE);
+
+	/* the children are found under the new parent after a rename */
+	box = mailbox_alloc(ns->list, "parent", 0);
+	dest = mailbox_alloc(ns->list, "renamed", 0);
+	test_assert(mailbox_rename(box, dest) == 0);
+	mailbox_free(&box);
+	mailbox_free(&dest);
+	for (i = 0; i < 50; i++) {
+		test_assert_idx(test_mailbox_list_index_exists(ns,
+			t_strdup_printf("renamed/child%u", i)) ==
+				MAILBOX_EXISTENCE_SELECT, i);
+		test_assert_idx(test_mailbox_list_index_exists(ns,
+			t_strdup_printf("parent/child%u", i)) ==
+				MAILBOX_EXISTENCE_NONE, i);
+	}
+
+	box = mailbox_alloc(ns->list, "renamed/child1", 0);
+	test_assert(mailbox_delete(box) == 0);
+	mailbox_free(&box);
+	test_assert(test_mailbox_list_index_exists(ns, "renamed/child1") ==
+		    MAILBOX_EXISTENCE_NONE);
+	test_assert(test_mailbox_list_index_exists(ns, "renamed/child2") ==
+		    MAILBOX_EXISTENCE_SELECT);
+
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static const char *
+test_mailbox_list_index_iter(struct mail_namespace *ns, const char *pattern)
+{
+	struct mailbox_list_iterate_context *iter;
+	const struct mailbox_info *info;
+	ARRAY_TYPE(const_string) names;
+	const char *name;
+
+	t_array_init(&names, 8);
+	iter = mailbox_list_iter_init(ns->list, pattern,
+				      MAILBOX_LIST_ITER_RETURN_NO_FLAGS);
+	while ((info = mailbox_list_iter_next(iter)) != NULL) {
+		name = t_strdup(info->vname);
+		array_push_back(&names, &name);
+	}
+	test_assert(mailbox_list_iter_deinit(&iter) == 0);
+	array_sort(&names, i_strcmp_p);
+	array_append_zero(&names);
+	return t_strarray_join(array_front(&names), ",");
+}
+
+static void test_mailbox_list_index_iter_prefix(void)
+{
+	static const char *const mailboxes[] = {
+		"a/b/c1", "a/b/c2", "a/b/c2/d", "a/bb/x", "other/b/c",
+	};
+	static const struct {
+		const char *pattern, *result;
+	} tests[] = {
+		{ "a/b/%", "a/b/c1,a/b/c2" },
+		{ "a/b/*", "a/b/c1,a/b/c2,a/b/c2/d" },
+		{ "a/b/c2/%", "a/b/c2/d" },
+		{ "a/%", "a/b,a/bb" },
+		{ "a/b%", "a/b,a/bb" },
+		{ "a/b/c1", "a/b/c1" },
+		{ "%/b/%", "a/b/c1,a/b/c2,other/b/c" },
+		{ "nonexistent/%", "" },
+		{ "a/b/c1/%", "" },
+	};
+	struct test_mail_storage_ctx *ctx;
+	struct mail_namespace *ns;
+	struct mailbox *box;
+	unsigned int i;
+
+	test_begin("mailbox list index iter prefix");
+	ctx = test_mail_storage_init();
+
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+		.driver_opts = ":LAYOUT=INDEX",
+		.hierarchy_sep = "/",
+	};
+	test_mail_storage_init_user(ctx, &set);
+	ns = mail_namespace_find_inbox(ctx->user->namespaces);
+
+	for (i = 0; i < N_ELEMENTS(mailboxes); i++) {
+		box = mailbox_alloc(ns->list, mailboxes[i], 0);
+		test_assert_idx(mailbox_create(box, NULL, FALSE) == 0, i);
+		mailbox_free(&box);
+	}
+	for (i = 0; i < N_ELEMENTS(tests); i++) {
+		test_assert_strcmp_idx(test_mailbox_list_index_iter(ns,
+			tests[i].pattern), tests[i].result, i);
+	}
+
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
 static void test_mail_parse_human_timestamp(void)
 {
 	int ret;
@@ -720,6 +865,8 @@ int main(int argc, char **argv)
 		test_mailbox_verify_name,
 		test_mailbox_list_maildir,
 		test_mailbox_list_mbox,
+		test_mailbox_list_index_tree,
+		test_mailbox_list_index_iter_prefix,
 		test_mail_parse_human_timestamp,
 		test_mail_parse_human_timestamp_time_interval,
 		test_mail_parse_human_timestamp_fail,
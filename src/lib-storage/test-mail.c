@@ -2,9 +2,12 @@
 
 #include "lib.h"
 #include "test-common.h"
+#include "ioloop.h"
 #include "istream.h"
 #include "master-service.h"
 #include "message-size.h"
+#include "mail-namespace.h"
+#include "mail-duplicate.h"
 #include "test-mail-storage-common.h"
 
 static struct event *test_event;
@@ -725,6 +728,129 @@ static void test_mail_get_last_internal_error(void)
 	test_mail_storage_deinit(&ctx);
 }
 
+static void test_mail_mdbox_copy_same_map(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "mdbox",
+	};
+	struct mail_user *user2;
+	const char *error, *refcount;
+	uoff_t size1, size2;
+
+	test_begin("mdbox copy between storages sharing the map");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	struct mailbox *box1 =
+		mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box1) == 0);
+	test_mail_save(box1,
+		       "From: <test1@example.com>\n"
+		       "Subject: test subject\n"
+		       "\n"
+		       "test body\n");
+
+	/* the same user created the second time has its own storage */
+	user2 = mail_user_dup(ctx->user);
+	test_assert(mail_user_init(user2, &error) == 0);
+	test_assert(mail_namespaces_init(user2, &error) == 0);
+	struct mailbox *box2 =
+		mailbox_alloc(user2->namespaces->list, "Copy", 0);
+	test_assert(mailbox_create(box2, NULL, FALSE) == 0);
+	test_assert(mailbox_get_storage(box1) != mailbox_get_storage(box2));
+
+	struct mailbox_transaction_context *trans1 =
+		mailbox_transaction_begin(box1, 0, __func__);
+	struct mail *mail1 = mail_alloc(trans1, 0, NULL);
+	mail_set_seq(mail1, 1);
+	struct mailbox_transaction_context *trans2 =
+		mailbox_transaction_begin(box2,
+			MAILBOX_TRANSACTION_FLAG_EXTERNAL, __func__);
+	struct mail_save_context *save_ctx = mailbox_save_alloc(trans2);
+	test_assert(mailbox_copy(&save_ctx, mail1) == 0);
+	test_assert(mailbox_transaction_commit(&trans2) == 0);
+	test_assert(mailbox_sync(box2, 0) == 0);
+
+	/* the message was copied by increasing the map refcount */
+	trans2 = mailbox_transaction_begin(box2, 0, __func__);
+	struct mail *mail2 = mail_alloc(trans2, 0, NULL);
+	mail_set_seq(mail2, 1);
+	test_assert(mail_get_special(mail2, MAIL_FETCH_REFCOUNT,
+				     &refcount) == 0);
+	test_assert_strcmp(refcount, "2");
+	test_assert(mail_get_physical_size(mail1, &size1) == 0);
+	test_assert(mail_get_physical_size(mail2, &size2) == 0);
+	test_assert(size1 == size2);
+
+	mail_free(&mail2);
+	mail_free(&mail1);
+	test_assert(mailbox_transaction_commit(&trans2) == 0);
+	test_assert(mailbox_transaction_commit(&trans1) == 0);
+	mailbox_free(&box2);
+	mailbox_free(&box1);
+	mail_user_deinit(&user2);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static void test_mail_duplicate_dict(void)
+{
+	static const char *const extra_input[] = {
+		"mail_duplicate_dict=file:~/duplicates.dict",
+		NULL
+	};
+	struct test_mail_storage_ctx *ctx;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+		.extra_input = extra_input,
+	};
+	struct mail_duplicate_db *db;
+	struct mail_duplicate_transaction *trans;
+	const char *home;
+	struct stat st;
+
+	test_begin("mail duplicate dict");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+	db = mail_duplicate_db_init(ctx->user, "lda-dupes");
+
+	trans = mail_duplicate_transaction_begin(db);
+	test_assert(mail_duplicate_check(trans, "id1", 3, "user1") ==
+		    MAIL_DUPLICATE_CHECK_RESULT_NOT_FOUND);
+	mail_duplicate_mark(trans, "id1", 3, "user1", ioloop_time + 60);
+	test_assert(mail_duplicate_check(trans, "id2", 3, "user1") ==
+		    MAIL_DUPLICATE_CHECK_RESULT_NOT_FOUND);
+	mail_duplicate_mark(trans, "id2", 3, "user1", ioloop_time - 1);
+	mail_duplicate_transaction_commit(&trans);
+
+	trans = mail_duplicate_transaction_begin(db);
+	test_assert(mail_duplicate_check(trans, "id1", 3, "USER1") ==
+		    MAIL_DUPLICATE_CHECK_RESULT_EXISTS);
+	/* expired */
+	test_assert(mail_duplicate_check(trans, "id2", 3, "user1") ==
+		    MAIL_DUPLICATE_CHECK_RESULT_NOT_FOUND);
+	mail_duplicate_transaction_rollback(&trans);
+
+	trans = mail_duplicate_transaction_begin(db);
+	test_assert(mail_duplicate_check(trans, "id1", 3, "user2") ==
+		    MAIL_DUPLICATE_CHECK_RESULT_NOT_FOUND);
+	mail_duplicate_transaction_rollback(&trans);
+
+	/* the file database wasn't used */
+	test_assert(mail_user_get_home(ctx->user, &home) > 0);
+	test_assert(stat(t_strconcat(home, "/.dovecot.lda-dupes", NULL),
+			 &st) < 0 && errno == ENOENT);
+	test_assert(stat(t_strconcat(home, "/duplicates.dict", NULL),
+			 &st) == 0);
+
+	mail_duplicate_db_deinit(&db);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
 int main(int argc, char **argv)
 {
 	void (*const tests[])(void) = {
@@ -735,6 +861,8 @@ int main(int argc, char **argv)
 		test_mail_set_critical,
 		test_mail_set_critical_different_mailboxes,
 		test_mail_get_last_internal_error,
+		test_mail_mdbox_copy_same_map,
+		test_mail_duplicate_dict,
 		NULL
 	};
 	int ret;
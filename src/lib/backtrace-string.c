@@ -110,6 +110,33 @@ static int backtrace_append_libc(string_t *str, const char **error_r)
 	free(strings);
 	return 0;
 }
+
+int backtrace_get_addresses(void **stack, unsigned int max_count)
+{
+	return backtrace(stack, max_count);
+}
+
+int backtrace_get_symbols(void *const *stack, unsigned int count,
+			  const char *const **symbols_r, const char **error_r)
+{
+	const char **symbols;
+	char **strings;
+	unsigned int i;
+
+	strings = backtrace_symbols(stack, count);
+	if (strings == NULL) {
+		*error_r = "backtrace_symbols() failed";
+		return -1;
+	}
+	symbols = t_new(const char *, count + 1);
+	for (i = 0; i < count; i++) {
+		const char *suffix = strrchr(strings[i], '/');
+		symbols[i] = t_strdup(suffix != NULL ? suffix + 1 : strings[i]);
+	}
+	free(strings);
+	*symbols_r = symbols;
+	return 0;
+}
 #elif defined(HAVE_WALKCONTEXT) && defined(HAVE_UCONTEXT_H)
 /* Solaris */
 #include <ucontext.h>
@@ -155,6 +182,23 @@ backtrace_append_libc(string_t *str ATTR_UNUSED, const char **error_r)
 }
 #endif
 
+#if !defined(HAVE_BACKTRACE_SYMBOLS) || !defined(HAVE_EXECINFO_H)
+int backtrace_get_addresses(void **stack ATTR_UNUSED,
+			    unsigned int max_count ATTR_UNUSED)
+{
+	return -1;
+}
+
+int backtrace_get_symbols(void *const *stack ATTR_UNUSED,
+			  unsigned int count ATTR_UNUSED,
+			  const char *const **symbols_r ATTR_UNUSED,
+			  const char **error_r)
+{
+	*error_r = "Missing implementation";
+	return -1;
+}
+#endif
+
 int backtrace_append(string_t *str, const char **error_r)
 {
 #if defined(HAVE_LIBUNWIND)
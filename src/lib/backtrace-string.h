@@ -5,4 +5,14 @@
 int backtrace_append(string_t *str, const char **error_r);
 int backtrace_get(const char **backtrace_r, const char **error_r);
 
+/* Get the return addresses of the current stack. This can be called from a
+   signal handler, except that the first call may allocate memory. Returns the
+   number of addresses or -1 if not supported. */
+int backtrace_get_addresses(void **stack, unsigned int max_count);
+/* Return the symbol names for the backtrace_get_addresses() result as a
+   NULL-terminated array without the binaries' paths. Returns 0 if ok, -1 if
+   failure. */
+int backtrace_get_symbols(void *const *stack, unsigned int count,
+			  const char *const **symbols_r, const char **error_r);
+
 #endif
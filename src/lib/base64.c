@@ -599,6 +599,41 @@ base64_skip_whitespace(struct base64_decoder *dec, const unsigned char *src_c,
 		(*src_pos)++;
 }
 
+static size_t
+base64_decode_quads(const struct base64_scheme *b64,
+		    const unsigned char *src, size_t src_size,
+		    size_t dst_avail, buffer_t *dest)
+{
+	unsigned char out[64 * 3];
+	size_t quads = I_MIN(src_size / 4, dst_avail / 3);
+	size_t n, out_pos = 0;
+
+	/* Decode whole 4-character groups without going through the
+	   per-character state machine. Stop at the first group that contains
+	   anything else than base64 alphabet (whitespace, padding or invalid
+	   characters) and let the caller handle it. */
+	for (n = 0; n < quads; n++) {
+		unsigned char d0 = b64->decmap[src[0]];
+		unsigned char d1 = b64->decmap[src[1]];
+		unsigned char d2 = b64->decmap[src[2]];
+		unsigned char d3 = b64->decmap[src[3]];
+
+		/* valid values are 0..63, 0xff marks everything else */
+		if (((d0 | d1 | d2 | d3) & 0xc0) != 0)
+			break;
+		if (out_pos == sizeof(out)) {
+			buffer_append(dest, out, out_pos);
+			out_pos = 0;
+		}
+		out[out_pos++] = (d0 << 2) | (d1 >> 4);
+		out[out_pos++] = (d1 << 4) | (d2 >> 2);
+		out[out_pos++] = (d2 << 6) | d3;
+		src += 4;
+	}
+	buffer_append(dest, out, out_pos);
+	return n;
+}
+
 int base64_decode_more(struct base64_decoder *dec,
 		       const void *src, size_t src_size, size_t *src_pos_r,
 		       buffer_t *dest)
@@ -661,8 +696,21 @@ int base64_decode_more(struct base64_decoder *dec,
 	}
 
 	for (; !dec->seen_padding && src_pos < src_size; src_pos++) {
-		unsigned char in = src_c[src_pos];
-		unsigned char dm = b64->decmap[in];
+		unsigned char in, dm;
+
+		if (dec->sub_pos == 0) {
+			size_t quads = base64_decode_quads(
+				b64, src_c + src_pos, src_size - src_pos,
+				dst_avail, dest);
+
+			src_pos += quads * 4;
+			dst_avail -= quads * 3;
+			if (src_pos == src_size)
+				break;
+		}
+
+		in = src_c[src_pos];
+		dm = b64->decmap[in];
 
 		if (dm == 0xff) {
 			if (no_whitespace) {
@@ -0,0 +1,173 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "seq-range-array.h"
+#include "time-util.h"
+#include "strnum.h"
+
+#include <stdio.h>
+
+/**
+ * Measures the seq_range_array operations with flag distributions seen in
+ * real mailboxes. Each distribution is a set over BENCH_MESSAGES messages:
+ *
+ *  - contiguous: all messages (e.g. "1:*" or a fully \Seen mailbox)
+ *  - alternate: every other message, the worst case for ranges
+ *  - seen: everything except the newest 5% and 1% of scattered older
+ *    messages, similar to \Seen in a typical INBOX
+ *  - random: each message with 10% probability, similar to \Flagged or
+ *    a keyword
+ *
+ * The set operations are run between each distribution and the "random"
+ * set. They modify the destination, so each round starts by copying the
+ * original array. The copying time is printed separately.
+ */
+
+#define BENCH_MESSAGES 100000
+
+struct bench_set {
+	const char *name;
+	ARRAY_TYPE(seq_range) seqs;
+};
+
+static uint32_t bench_rand_state = 1;
+
+static uint32_t bench_rand(void)
+{
+	/* deterministic, so that the results are comparable between runs */
+	bench_rand_state = bench_rand_state * 1103515245 + 12345;
+	return (bench_rand_state >> 16) & 0x7fff;
+}
+
+static void bench_set_init(struct bench_set *set, const char *name)
+{
+	set->name = name;
+	i_array_init(&set->seqs, 128);
+}
+
+static void bench_sets_init(struct bench_set sets[4])
+{
+	uint32_t seq;
+
+	bench_set_init(&sets[0], "contiguous");
+	seq_range_array_add_range(&sets[0].seqs, 1, BENCH_MESSAGES);
+
+	bench_set_init(&sets[1], "alternate");
+	for (seq = 1; seq <= BENCH_MESSAGES; seq += 2)
+		seq_range_array_add(&sets[1].seqs, seq);
+
+	bench_set_init(&sets[2], "seen");
+	for (seq = 1; seq <= BENCH_MESSAGES / 100 * 95; seq++) {
+		if (bench_rand() % 100 != 0)
+			seq_range_array_add(&sets[2].seqs, seq);
+	}
+
+	bench_set_init(&sets[3], "random");
+	for (seq = 1; seq <= BENCH_MESSAGES; seq++) {
+		if (bench_rand() % 10 == 0)
+			seq_range_array_add(&sets[3].seqs, seq);
+	}
+}
+
+static void
+bench_print(const char *name, const char *op, uint64_t nsecs,
+	    unsigned int count)
+{
+	printf("\t%-10s %-10s %10.02lf us/op\n", name, op,
+	       (double)nsecs / 1000 / (double)count);
+}
+
+static void
+bench_copy(ARRAY_TYPE(seq_range) *dest, const ARRAY_TYPE(seq_range) *src)
+{
+	array_clear(dest);
+	array_append_array(dest, src);
+}
+
+static void
+bench_set_ops(const struct bench_set *set, const struct bench_set *other,
+	      unsigned int rounds)
+{
+	ARRAY_TYPE(seq_range) tmp;
+	uint64_t ts_0, ts_1, copy_nsecs;
+	unsigned int i, sum = 0;
+	uint32_t seq;
+
+	i_array_init(&tmp, array_count(&set->seqs) + array_count(&other->seqs));
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < rounds; i++)
+		bench_copy(&tmp, &set->seqs);
+	ts_1 = i_nanoseconds();
+	copy_nsecs = ts_1 - ts_0;
+	bench_print(set->name, "copy", copy_nsecs, rounds);
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < rounds; i++) {
+		bench_copy(&tmp, &set->seqs);
+		seq_range_array_merge(&tmp, &other->seqs);
+	}
+	ts_1 = i_nanoseconds();
+	bench_print(set->name, "union", ts_1 - ts_0 - copy_nsecs, rounds);
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < rounds; i++) {
+		bench_copy(&tmp, &set->seqs);
+		sum += seq_range_array_intersect(&tmp, &other->seqs);
+	}
+	ts_1 = i_nanoseconds();
+	bench_print(set->name, "intersect", ts_1 - ts_0 - copy_nsecs, rounds);
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < rounds; i++) {
+		bench_copy(&tmp, &set->seqs);
+		sum += seq_range_array_remove_seq_range(&tmp, &other->seqs);
+	}
+	ts_1 = i_nanoseconds();
+	bench_print(set->name, "difference", ts_1 - ts_0 - copy_nsecs, rounds);
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < rounds; i++) {
+		for (seq = 1; seq <= BENCH_MESSAGES; seq += 97) {
+			if (seq_range_exists(&set->seqs, seq))
+				sum++;
+		}
+	}
+	ts_1 = i_nanoseconds();
+	bench_print(set->name, "exists", ts_1 - ts_0, rounds);
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < rounds; i++)
+		sum += seq_range_count(&set->seqs);
+	ts_1 = i_nanoseconds();
+	bench_print(set->name, "count", ts_1 - ts_0, rounds);
+
+	/* keep the compiler from optimizing the calls away */
+	if (sum == 0)
+		printf("\t(no results)\n");
+	array_free(&tmp);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_set sets[4];
+	unsigned int i, rounds = 100;
+
+	lib_init();
+	if (argc > 1 && str_to_uint(argv[1], &rounds) < 0)
+		i_fatal("Usage: %s [<rounds>]", argv[0]);
+
+	bench_sets_init(sets);
+	printf("seq_range_array with %u messages, %u rounds:\n",
+	       BENCH_MESSAGES, rounds);
+	for (i = 0; i < N_ELEMENTS(sets); i++) {
+		printf("%s: %u ranges\n", sets[i].name,
+		       array_count(&sets[i].seqs));
+		bench_set_ops(&sets[i], &sets[3], rounds);
+	}
+	for (i = 0; i < N_ELEMENTS(sets); i++)
+		array_free(&sets[i].seqs);
+	lib_deinit();
+	return 0;
+}
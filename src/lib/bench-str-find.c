@@ -0,0 +1,122 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "str-find.h"
+#include "time-util.h"
+#include "strnum.h"
+
+#include <stdio.h>
+
+/**
+ * Measures str_find_more() throughput for keys that don't exist in the data,
+ * which is the common case when searching message bodies. The data is sent
+ * in blocks, like message-search does. A memchr() and memcmp() based search of the
+ * whole data is used as a reference.
+ */
+
+#define BENCH_DATA_SIZE (16*1024*1024)
+#define BENCH_BLOCK_SIZE 8192
+
+static void
+bench_print(const char *name, const char *key, uint64_t nsecs, size_t size)
+{
+	printf("\t%-8s %-24s %8.02lf MB/s\n", name, key,
+	       (double)size * 1000 / (double)nsecs);
+}
+
+static void
+bench_str_find(const unsigned char *data, size_t size, const char *key,
+	       unsigned int rounds)
+{
+	struct str_find_context *ctx;
+	uint64_t ts_0, ts_1;
+	unsigned int round;
+	size_t pos, block_size;
+
+	ctx = str_find_init(default_pool, key);
+	ts_0 = i_nanoseconds();
+	for (round = 0; round < rounds; round++) {
+		str_find_reset(ctx);
+		for (pos = 0; pos < size; pos += block_size) {
+			block_size = I_MIN(size - pos, BENCH_BLOCK_SIZE);
+			if (str_find_more(ctx, data + pos, block_size))
+				i_unreached();
+		}
+	}
+	ts_1 = i_nanoseconds();
+	bench_print("str_find", key, ts_1 - ts_0, size * rounds);
+	str_find_deinit(&ctx);
+}
+
+static bool
+bench_memchr_find(const unsigned char *data, size_t size,
+		  const char *key, size_t key_len)
+{
+	const unsigned char *p, *end = data + size;
+
+	for (p = data; (size_t)(end - p) >= key_len; p++) {
+		p = memchr(p, key[0], end - p - key_len + 1);
+		if (p == NULL)
+			break;
+		if (memcmp(p + 1, key + 1, key_len - 1) == 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static void
+bench_memchr(const unsigned char *data, size_t size, const char *key,
+	     unsigned int rounds)
+{
+	size_t key_len = strlen(key);
+	uint64_t ts_0, ts_1;
+	unsigned int round;
+
+	ts_0 = i_nanoseconds();
+	for (round = 0; round < rounds; round++) {
+		if (bench_memchr_find(data, size, key, key_len))
+			i_unreached();
+	}
+	ts_1 = i_nanoseconds();
+	bench_print("memchr", key, ts_1 - ts_0, size * rounds);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [rounds]\n", prog);
+	fprintf(stderr, "Runs 10 rounds if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	static const char *keys[] = {
+		"q", "zq", "hello world", "Content-Type:", "xyzzyxyzzyxyzzyxyzzy"
+	};
+	unsigned int i, rounds = 10;
+	unsigned char *data;
+
+	lib_init();
+
+	if (argc > 2)
+		print_usage(argv[0]);
+	if (argc == 2 && (str_to_uint(argv[1], &rounds) < 0 || rounds == 0))
+		print_usage(argv[0]);
+
+	/* text with spaces and only the letters a..p, so none of the keys
+	   are found */
+	data = i_malloc(BENCH_DATA_SIZE);
+	for (i = 0; i < BENCH_DATA_SIZE; i++)
+		data[i] = i_rand_limit(8) == 0 ? ' ' : 'a' + i_rand_limit(16);
+
+	printf("%d bytes in %d byte blocks, %u rounds\n",
+	       BENCH_DATA_SIZE, BENCH_BLOCK_SIZE, rounds);
+	for (i = 0; i < N_ELEMENTS(keys); i++) {
+		bench_str_find(data, BENCH_DATA_SIZE, keys[i], rounds);
+		bench_memchr(data, BENCH_DATA_SIZE, keys[i], rounds);
+	}
+
+	i_free(data);
+	lib_deinit();
+	return 0;
+}
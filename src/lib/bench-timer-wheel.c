@@ -0,0 +1,162 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "priorityq.h"
+#include "timer-wheel.h"
+#include "time-util.h"
+#include "strnum.h"
+
+#include <stdio.h>
+
+/**
+ * Compares priorityq and timer wheel with a workload that mimics idle
+ * connections: each timer is added once, then reset many times (as when
+ * input arrives and the idle timeout is restarted), and finally all timers
+ * are removed. Timer lengths are spread between 1 second and 30 minutes.
+ */
+
+#define BENCH_TICK_MSECS 10
+
+struct bench_pq_item {
+	struct priorityq_item item;
+	uint64_t expire_msecs;
+};
+
+struct bench_wheel_item {
+	struct timer_wheel_item item;
+};
+
+static int bench_pq_cmp(const void *p1, const void *p2)
+{
+	const struct bench_pq_item *i1 = p1, *i2 = p2;
+
+	if (i1->expire_msecs < i2->expire_msecs)
+		return -1;
+	return i1->expire_msecs > i2->expire_msecs ? 1 : 0;
+}
+
+static void
+bench_print(const char *name, const char *op, uint64_t nsecs,
+	    unsigned long count)
+{
+	printf("\t%-10s %-7s %8.02lf ns/op\n", name, op,
+	       (double)nsecs / (double)count);
+}
+
+static void
+bench_priorityq(const uint64_t *expires, unsigned long timer_count,
+		unsigned long reset_count)
+{
+	struct bench_pq_item *items;
+	struct priorityq *pq;
+	uint64_t ts_0, ts_1, now = 0;
+	unsigned long i, n;
+
+	items = i_new(struct bench_pq_item, timer_count);
+	pq = priorityq_init(bench_pq_cmp, timer_count);
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < timer_count; i++) {
+		items[i].expire_msecs = expires[i];
+		priorityq_add(pq, &items[i].item);
+	}
+	ts_1 = i_nanoseconds();
+	bench_print("priorityq", "add", ts_1 - ts_0, timer_count);
+
+	ts_0 = i_nanoseconds();
+	for (n = 0; n < reset_count; n++) {
+		i = n % timer_count;
+		now += 1;
+		priorityq_remove(pq, &items[i].item);
+		items[i].expire_msecs = now + expires[i];
+		priorityq_add(pq, &items[i].item);
+	}
+	ts_1 = i_nanoseconds();
+	bench_print("priorityq", "reset", ts_1 - ts_0, reset_count);
+
+	ts_0 = i_nanoseconds();
+	while (priorityq_pop(pq) != NULL) ;
+	ts_1 = i_nanoseconds();
+	bench_print("priorityq", "expire", ts_1 - ts_0, timer_count);
+
+	priorityq_deinit(&pq);
+	i_free(items);
+}
+
+static void
+bench_timer_wheel(const uint64_t *expires, unsigned long timer_count,
+		  unsigned long reset_count)
+{
+	struct bench_wheel_item *items;
+	struct timer_wheel *wheel;
+	uint64_t ts_0, ts_1, now = 0;
+	unsigned long i, n;
+
+	items = i_new(struct bench_wheel_item, timer_count);
+	wheel = timer_wheel_init(BENCH_TICK_MSECS, now);
+
+	ts_0 = i_nanoseconds();
+	for (i = 0; i < timer_count; i++)
+		timer_wheel_add(wheel, &items[i].item, expires[i]);
+	ts_1 = i_nanoseconds();
+	bench_print("wheel", "add", ts_1 - ts_0, timer_count);
+
+	ts_0 = i_nanoseconds();
+	for (n = 0; n < reset_count; n++) {
+		i = n % timer_count;
+		now += 1;
+		timer_wheel_remove(wheel, &items[i].item);
+		timer_wheel_add(wheel, &items[i].item, now + expires[i]);
+	}
+	ts_1 = i_nanoseconds();
+	bench_print("wheel", "reset", ts_1 - ts_0, reset_count);
+
+	/* expire everything by moving through time, as ioloop would */
+	ts_0 = i_nanoseconds();
+	while (timer_wheel_get_next_msecs(wheel, &now)) {
+		while (timer_wheel_pop_expired(wheel, now) != NULL) ;
+	}
+	ts_1 = i_nanoseconds();
+	bench_print("wheel", "expire", ts_1 - ts_0, timer_count);
+
+	timer_wheel_deinit(&wheel);
+	i_free(items);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [timer_count [reset_count]]\n", prog);
+	fprintf(stderr, "Runs with 100000 timers and 1000000 resets "
+		"if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	unsigned long timer_count = 100000UL;
+	unsigned long reset_count = 1000000UL;
+	uint64_t *expires;
+	unsigned long i;
+
+	lib_init();
+
+	if (argc > 3)
+		print_usage(argv[0]);
+	if (argc >= 2 && (str_to_ulong(argv[1], &timer_count) < 0 ||
+			  timer_count == 0))
+		print_usage(argv[0]);
+	if (argc >= 3 && str_to_ulong(argv[2], &reset_count) < 0)
+		print_usage(argv[0]);
+
+	expires = i_new(uint64_t, timer_count);
+	for (i = 0; i < timer_count; i++)
+		expires[i] = 1000 + i_rand_limit(30*60*1000);
+
+	printf("%lu timers, %lu resets\n", timer_count, reset_count);
+	bench_priorityq(expires, timer_count, reset_count);
+	bench_timer_wheel(expires, timer_count, reset_count);
+
+	i_free(expires);
+	lib_deinit();
+	return 0;
+}
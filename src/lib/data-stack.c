@@ -86,6 +86,8 @@ static struct stack_block *current_block;
    freed. This can prevent rapid malloc()+free()ing when data stack is grown
    and shrunk constantly. */
 static struct stack_block *unused_block = NULL;
+/* The highest data_stack_get_alloc_size() has been so far. */
+static size_t peak_alloc_size = 0;
 
 static struct event *event_datastack = NULL;
 static bool event_datastack_deinitialized = FALSE;
@@ -395,7 +397,22 @@ static struct stack_block *mem_block_alloc(size_t min_size)
 	return block;
 }
 
-static void data_stack_send_grow_event(size_t last_alloc_size)
+static size_t data_stack_frame_get_used_size(const struct stack_frame *frame)
+{
+	struct stack_block *block = frame->block;
+	size_t size;
+
+	/* the frame starts from the middle of its first block, and it owns
+	   all the blocks after it. */
+	size = frame->block_space_left - block->left;
+	for (block = block->next; block != NULL; block = block->next)
+		size += block->size - block->left;
+	return size;
+}
+
+static void
+data_stack_send_grow_event(const struct stack_frame *frame,
+			   size_t last_alloc_size)
 {
 	if (event_datastack_deinitialized) {
 		/* already in the deinitialization code -
@@ -409,13 +426,18 @@ static void data_stack_send_grow_event(size_t last_alloc_size)
 	event_add_int(event_datastack, "used_size", data_stack_get_used_size());
 	event_add_int(event_datastack, "last_alloc_size", last_alloc_size);
 	event_add_int(event_datastack, "last_block_size", current_block->size);
+	event_add_int(event_datastack, "peak_alloc_size", peak_alloc_size);
+	event_add_int(event_datastack, "frame_used_size",
+		      data_stack_frame_get_used_size(frame));
+	/* the event is sent inside its own frame */
+	event_add_int(event_datastack, "frame_depth", data_stack_frame_id - 2);
 #ifdef DEBUG
 	event_add_int(event_datastack, "frame_alloc_bytes",
-		      current_frame->alloc_bytes);
+		      frame->alloc_bytes);
 	event_add_int(event_datastack, "frame_alloc_count",
-		      current_frame->alloc_count);
+		      frame->alloc_count);
 #endif
-	event_add_str(event_datastack, "frame_marker", current_frame->marker);
+	event_add_str(event_datastack, "frame_marker", frame->marker);
 
 	/* It's possible that the data stack gets grown and shrunk rapidly.
 	   Try to avoid doing expensive work if the event isn't even used for
@@ -440,10 +462,10 @@ static void data_stack_send_grow_event(size_t last_alloc_size)
 		    last_alloc_size);
 #ifdef DEBUG
 	str_printfa(str, ", frame_bytes=%llu, frame_alloc_count=%u",
-		    current_frame->alloc_bytes, current_frame->alloc_count);
+		    frame->alloc_bytes, frame->alloc_count);
 #endif
 	e_debug(event_datastack, "Growing data stack by %zu for '%s' (%s)",
-		current_block->size, current_frame->marker,
+		current_block->size, frame->marker,
 		str_c(str));
 }
 
@@ -451,6 +473,7 @@ static void *t_malloc_real(size_t size, bool permanent)
 {
 	void *ret;
 	size_t alloc_size;
+	struct stack_frame *frame;
 	bool warn = FALSE;
 #ifdef DEBUG
 	int old_errno = errno;
@@ -501,6 +524,10 @@ static void *t_malloc_real(size_t size, bool permanent)
 		block->prev = current_block;
 		current_block->next = block;
 		current_block = block;
+
+		size_t total_alloc_size = data_stack_get_alloc_size();
+		if (total_alloc_size > peak_alloc_size)
+			peak_alloc_size = total_alloc_size;
 	}
 
 	/* enough space in current block, use it */
@@ -513,6 +540,9 @@ static void *t_malloc_real(size_t size, bool permanent)
 	if (permanent)
 		current_block->left -= alloc_size;
 
+	/* the grow event is sent inside a new frame, so remember the frame
+	   that actually did the allocation */
+	frame = current_frame;
 	if (warn) T_BEGIN {
 		/* sending event can cause errno changes. */
 #ifdef DEBUG
@@ -522,7 +552,7 @@ static void *t_malloc_real(size_t size, bool permanent)
 #endif
 		/* warn after allocation, so if e_debug() wants to
 		   allocate more memory we don't go to infinite loop */
-		data_stack_send_grow_event(alloc_size);
+		data_stack_send_grow_event(frame, alloc_size);
 		/* reset errno back to what it was */
 		errno = old_errno;
 	} T_END;
@@ -732,6 +762,11 @@ size_t data_stack_get_used_size(void)
 	return size;
 }
 
+size_t data_stack_get_peak_alloc_size(void)
+{
+	return peak_alloc_size;
+}
+
 void data_stack_free_unused(void)
 {
 	free(unused_block);
@@ -754,6 +789,7 @@ void data_stack_init(void)
 
 	current_block = mem_block_alloc(INITIAL_STACK_SIZE);
 	current_frame = NULL;
+	peak_alloc_size = current_block->size;
 
 	last_buffer_block = NULL;
 	last_buffer_size = 0;
@@ -153,6 +153,10 @@ bool data_stack_frame_contains(data_stack_frame_t *id, const void *ptr);
 size_t data_stack_get_alloc_size(void);
 /* Returns the number of bytes currently used in data stack. */
 size_t data_stack_get_used_size(void);
+/* Returns the highest data_stack_get_alloc_size() since data_stack_init().
+   This is the data stack's contribution to the process's peak memory usage.
+   It's also sent as the peak_alloc_size field in data_stack_grow events. */
+size_t data_stack_get_peak_alloc_size(void);
 
 /* Free all the memory that is currently unused (i.e. reserved for growing
    data stack quickly). */
@@ -23,6 +23,9 @@ struct event_filter {
 	pool_t pool;
 	int refcount;
 	ARRAY(struct event_filter_query_internal) queries;
+	/* Queries indexed by the event names they require. Built when
+	   matching and freed whenever the queries change. */
+	struct event_filter_index *index;
 
 	bool fragment;
 	bool named_queries_only;
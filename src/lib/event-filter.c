@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "array.h"
+#include "hash.h"
 #include "llist.h"
 #include "str.h"
 #include "strescape.h"
@@ -36,6 +37,18 @@ struct event_filter_query_internal {
 	void *context;
 };
 
+struct event_filter_name_queries {
+	ARRAY(unsigned int) query_idxs;
+};
+
+struct event_filter_index {
+	pool_t pool;
+	/* event name -> queries that can match only events with that name */
+	HASH_TABLE(const char *, struct event_filter_name_queries *) names;
+	/* queries that can match events with any name (or without a name) */
+	ARRAY(unsigned int) unnamed_query_idxs;
+};
+
 static struct event_filter *event_filters = NULL;
 
 static struct event_filter *event_filter_create_real(pool_t pool, bool fragment)
@@ -53,6 +66,17 @@ static struct event_filter *event_filter_create_real(pool_t pool, bool fragment)
 	return filter;
 }
 
+static void event_filter_index_free(struct event_filter *filter)
+{
+	struct event_filter_index *index = filter->index;
+
+	if (index == NULL)
+		return;
+	filter->index = NULL;
+	hash_table_destroy(&index->names);
+	pool_unref(&index->pool);
+}
+
 struct event_filter *event_filter_create(void)
 {
 	return event_filter_create_real(pool_alloconly_create("event filter", 2048), FALSE);
@@ -81,6 +105,7 @@ void event_filter_unref(struct event_filter **_filter)
 	if (--filter->refcount > 0)
 		return;
 
+	event_filter_index_free(filter);
 	if (!filter->fragment) {
 		DLLIST_REMOVE(&event_filters, filter);
 
@@ -100,6 +125,11 @@ event_filter_get_or_alloc_internal_query(struct event_filter *filter,
 {
 	struct event_filter_query_internal *query;
 
+	/* the caller is going to change the queries */
+	event_filter_index_free(filter);
+	if (!filter->fragment)
+		event_filter_replace_counter++;
+
 	array_foreach_modifiable(&filter->queries, query) {
 		if (query->context == context)
 			return query;
@@ -296,6 +326,9 @@ bool event_filter_remove_queries_with_context(struct event_filter *filter,
 		if (int_query->context == context) {
 			idx = array_foreach_idx(&filter->queries, int_query);
 			array_delete(&filter->queries, idx, 1);
+			event_filter_index_free(filter);
+			if (!filter->fragment)
+				event_filter_replace_counter++;
 			return TRUE;
 		}
 	}
@@ -871,6 +904,162 @@ event_filter_query_match(const struct event_filter_query_internal *query,
 					     source_linenum, log_type);
 }
 
+/* Returns TRUE if the node can match only events that have one of the names
+   added to the names array. */
+static bool
+event_filter_node_get_names(const struct event_filter_node *node,
+			    ARRAY_TYPE(const_string) *names)
+{
+	unsigned int count;
+
+	switch (node->op) {
+	case EVENT_FILTER_OP_AND:
+		count = array_count(names);
+		if (event_filter_node_get_names(node->children[0], names))
+			return TRUE;
+		array_delete(names, count, array_count(names) - count);
+		return event_filter_node_get_names(node->children[1], names);
+	case EVENT_FILTER_OP_OR:
+		return event_filter_node_get_names(node->children[0], names) &&
+			event_filter_node_get_names(node->children[1], names);
+	case EVENT_FILTER_OP_NOT:
+		return FALSE;
+	case EVENT_FILTER_OP_CMP_EQ:
+		if (node->type != EVENT_FILTER_NODE_TYPE_EVENT_NAME_EXACT)
+			return FALSE;
+		array_push_back(names, &node->str);
+		return TRUE;
+	case EVENT_FILTER_OP_CMP_GT:
+	case EVENT_FILTER_OP_CMP_LT:
+	case EVENT_FILTER_OP_CMP_GE:
+	case EVENT_FILTER_OP_CMP_LE:
+		return FALSE;
+	}
+	i_unreached();
+}
+
+/* Returns TRUE if the node can match only events that have one of the names
+   added to the names array or one of the categories (or their child
+   categories) added to the categories array. */
+static bool
+event_filter_node_get_interest(const struct event_filter_node *node,
+			       ARRAY_TYPE(const_string) *names,
+			       ARRAY_TYPE(const_string) *categories)
+{
+	unsigned int names_count, categories_count;
+
+	switch (node->op) {
+	case EVENT_FILTER_OP_AND:
+		names_count = array_count(names);
+		categories_count = array_count(categories);
+		if (event_filter_node_get_interest(node->children[0],
+						   names, categories))
+			return TRUE;
+		array_delete(names, names_count,
+			     array_count(names) - names_count);
+		array_delete(categories, categories_count,
+			     array_count(categories) - categories_count);
+		return event_filter_node_get_interest(node->children[1],
+						      names, categories);
+	case EVENT_FILTER_OP_OR:
+		return event_filter_node_get_interest(node->children[0],
+						      names, categories) &&
+			event_filter_node_get_interest(node->children[1],
+						       names, categories);
+	case EVENT_FILTER_OP_NOT:
+		return FALSE;
+	case EVENT_FILTER_OP_CMP_EQ:
+		switch (node->type) {
+		case EVENT_FILTER_NODE_TYPE_EVENT_NAME_EXACT:
+			array_push_back(names, &node->str);
+			return TRUE;
+		case EVENT_FILTER_NODE_TYPE_EVENT_CATEGORY:
+			/* log type categories can match any event */
+			if (node->category.name == NULL)
+				return FALSE;
+			array_push_back(categories, &node->category.name);
+			return TRUE;
+		default:
+			return FALSE;
+		}
+	case EVENT_FILTER_OP_CMP_GT:
+	case EVENT_FILTER_OP_CMP_LT:
+	case EVENT_FILTER_OP_CMP_GE:
+	case EVENT_FILTER_OP_CMP_LE:
+		return FALSE;
+	}
+	i_unreached();
+}
+
+bool event_filter_get_interest(struct event_filter *filter,
+			       ARRAY_TYPE(const_string) *names,
+			       ARRAY_TYPE(const_string) *categories)
+{
+	const struct event_filter_query_internal *query;
+
+	i_assert(!filter->fragment);
+
+	array_foreach(&filter->queries, query) {
+		if (!event_filter_node_get_interest(query->expr,
+						    names, categories))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void
+event_filter_index_add_query(struct event_filter_index *index,
+			     const struct event_filter_query_internal *query,
+			     unsigned int idx)
+{
+	struct event_filter_name_queries *name_queries;
+	ARRAY_TYPE(const_string) names;
+	const char *name;
+
+	t_array_init(&names, 8);
+	if (!event_filter_node_get_names(query->expr, &names)) {
+		array_push_back(&index->unnamed_query_idxs, &idx);
+		return;
+	}
+	array_foreach_elem(&names, name) {
+		name_queries = hash_table_lookup(index->names, name);
+		if (name_queries == NULL) {
+			name_queries = p_new(index->pool,
+					     struct event_filter_name_queries, 1);
+			p_array_init(&name_queries->query_idxs, index->pool, 4);
+			hash_table_insert(index->names, name, name_queries);
+		} else if (*array_back(&name_queries->query_idxs) == idx) {
+			/* same name used multiple times in the query */
+			continue;
+		}
+		array_push_back(&name_queries->query_idxs, &idx);
+	}
+}
+
+static struct event_filter_index *
+event_filter_get_index(struct event_filter *filter)
+{
+	const struct event_filter_query_internal *query;
+	struct event_filter_index *index;
+	pool_t pool;
+
+	if (filter->index != NULL)
+		return filter->index;
+
+	pool = pool_alloconly_create("event filter index", 1024);
+	index = p_new(pool, struct event_filter_index, 1);
+	index->pool = pool;
+	hash_table_create(&index->names, default_pool, 0, str_hash, strcmp);
+	p_array_init(&index->unnamed_query_idxs, pool, 4);
+
+	array_foreach(&filter->queries, query) T_BEGIN {
+		event_filter_index_add_query(index, query,
+			array_foreach_idx(&filter->queries, query));
+	} T_END;
+	filter->index = index;
+	return index;
+}
+
 static bool
 event_filter_match_fastpath(struct event_filter *filter, struct event *event)
 {
@@ -897,16 +1086,39 @@ bool event_filter_match_source(struct event_filter *filter, struct event *event,
 			       unsigned int source_linenum,
 			       const struct failure_context *ctx)
 {
-	const struct event_filter_query_internal *query;
+	const struct event_filter_query_internal *queries;
+	struct event_filter_name_queries *name_queries;
+	struct event_filter_index *index;
+	unsigned int idx, count;
 
 	i_assert(!filter->fragment);
 
 	if (!event_filter_match_fastpath(filter, event))
 		return FALSE;
 
-	array_foreach(&filter->queries, query) {
-		if (event_filter_query_match(query, event, source_filename,
-					     source_linenum, ctx))
+	/* Check only the queries that could match the event's name. Events
+	   that no query wants are rejected with a single hash lookup. */
+	index = event_filter_get_index(filter);
+	queries = array_get(&filter->queries, &count);
+	if (event->sending_name != NULL) {
+		const char *name = event->sending_name;
+
+		name_queries = hash_table_lookup(index->names, name);
+		if (name_queries != NULL) {
+			array_foreach_elem(&name_queries->query_idxs, idx) {
+				i_assert(idx < count);
+				if (event_filter_query_match(&queries[idx],
+						event, source_filename,
+						source_linenum, ctx))
+					return TRUE;
+			}
+		}
+	}
+	array_foreach_elem(&index->unnamed_query_idxs, idx) {
+		i_assert(idx < count);
+		if (event_filter_query_match(&queries[idx], event,
+					     source_filename, source_linenum,
+					     ctx))
 			return TRUE;
 	}
 	return FALSE;
@@ -916,7 +1128,10 @@ struct event_filter_match_iter {
 	struct event_filter *filter;
 	struct event *event;
 	const struct failure_context *failure_ctx;
-	unsigned int idx;
+
+	struct event_filter_index *index;
+	const unsigned int *named_idxs, *unnamed_idxs;
+	unsigned int named_count, unnamed_count;
 };
 
 struct event_filter_match_iter *
@@ -932,21 +1147,48 @@ event_filter_match_iter_init(struct event_filter *filter, struct event *event,
 	iter->event = event;
 	iter->failure_ctx = ctx;
 	if (!event_filter_match_fastpath(filter, event))
-		iter->idx = UINT_MAX;
+		return iter;
+
+	iter->index = event_filter_get_index(filter);
+	if (event->sending_name != NULL) {
+		const char *name = event->sending_name;
+		struct event_filter_name_queries *name_queries =
+			hash_table_lookup(iter->index->names, name);
+		if (name_queries != NULL) {
+			iter->named_idxs = array_get(&name_queries->query_idxs,
+						     &iter->named_count);
+		}
+	}
+	iter->unnamed_idxs = array_get(&iter->index->unnamed_query_idxs,
+				       &iter->unnamed_count);
 	return iter;
 }
 
 void *event_filter_match_iter_next(struct event_filter_match_iter *iter)
 {
 	const struct event_filter_query_internal *queries;
-	unsigned int count;
+	unsigned int idx, count;
+
+	if (iter->named_count == 0 && iter->unnamed_count == 0)
+		return NULL;
+	/* the queries can't be changed while iterating */
+	i_assert(iter->filter->index == iter->index);
 
 	queries = array_get(&iter->filter->queries, &count);
-	while (iter->idx < count) {
-		const struct event_filter_query_internal *query =
-			&queries[iter->idx];
+	while (iter->named_count > 0 || iter->unnamed_count > 0) {
+		/* return the matches in the queries' order */
+		if (iter->unnamed_count == 0 ||
+		    (iter->named_count > 0 &&
+		     *iter->named_idxs < *iter->unnamed_idxs)) {
+			idx = *iter->named_idxs++;
+			iter->named_count--;
+		} else {
+			idx = *iter->unnamed_idxs++;
+			iter->unnamed_count--;
+		}
+		i_assert(idx < count);
 
-		iter->idx++;
+		const struct event_filter_query_internal *query = &queries[idx];
 		if (query->context != NULL &&
 		    event_filter_query_match(query, iter->event,
 					     iter->event->source_filename,
@@ -58,6 +58,14 @@ event_filter_match_iter_init(struct event_filter *filter, struct event *event,
 void *event_filter_match_iter_next(struct event_filter_match_iter *iter);
 void event_filter_match_iter_deinit(struct event_filter_match_iter **iter);
 
+/* Add to names and categories the event names and categories that the
+   filter's queries could match. Returns TRUE if the filter can match only
+   events that have one of these names or categories (or their child
+   categories), FALSE if it may match other events as well. */
+bool event_filter_get_interest(struct event_filter *filter,
+			       ARRAY_TYPE(const_string) *names,
+			       ARRAY_TYPE(const_string) *categories);
+
 void event_filter_init(void);
 void event_filter_deinit(void);
 
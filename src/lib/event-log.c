@@ -1,6 +1,8 @@
 /* Copyright (c) 2017-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "array.h"
+#include "hash.h"
 #include "str.h"
 #include "event-filter.h"
 #include "lib-event-private.h"
@@ -11,6 +13,13 @@ static struct event_filter *global_debug_log_filter = NULL;
 static struct event_filter *global_debug_send_filter = NULL;
 static struct event_filter *global_core_log_filter = NULL;
 
+/* Event names and categories that the global filters may match. This is
+   updated whenever event_filter_replace_counter changes. */
+static unsigned int global_interest_counter = 0;
+static bool global_interest_all = FALSE;
+static pool_t global_interest_pool = NULL;
+static HASH_TABLE(const char *, void *) global_interest_names;
+
 #undef e_error
 void e_error(struct event *event,
 	     const char *source_filename, unsigned int source_linenum,
@@ -267,6 +276,75 @@ void event_log(struct event *event, const struct event_log_params *params,
 	va_end(args);
 }
 
+static void event_interest_free(void)
+{
+	if (hash_table_is_created(global_interest_names))
+		hash_table_destroy(&global_interest_names);
+	pool_unref(&global_interest_pool);
+	event_categories_set_interest(NULL);
+	global_interest_all = FALSE;
+}
+
+static void event_interest_update(void)
+{
+	struct event_filter *const filters[] = {
+		global_debug_log_filter,
+		global_debug_send_filter,
+		global_core_log_filter,
+	};
+	ARRAY_TYPE(const_string) names, categories;
+	const char *name;
+	unsigned int i;
+
+	event_interest_free();
+	global_interest_counter = event_filter_replace_counter;
+
+	t_array_init(&names, 16);
+	t_array_init(&categories, 16);
+	for (i = 0; i < N_ELEMENTS(filters); i++) {
+		if (filters[i] != NULL &&
+		    !event_filter_get_interest(filters[i], &names,
+					       &categories)) {
+			global_interest_all = TRUE;
+			return;
+		}
+	}
+
+	if (array_count(&names) > 0) {
+		global_interest_pool =
+			pool_alloconly_create("event interest names", 256);
+		hash_table_create(&global_interest_names, default_pool, 0,
+				  str_hash, strcmp);
+		array_foreach_elem(&names, name) {
+			if (hash_table_lookup(global_interest_names, name) == NULL) {
+				name = p_strdup(global_interest_pool, name);
+				hash_table_insert(global_interest_names,
+						  name, POINTER_CAST(1));
+			}
+		}
+	}
+	if (array_count(&categories) > 0) {
+		array_append_zero(&categories);
+		event_categories_set_interest(array_front(&categories));
+	}
+}
+
+static bool event_want_interest(struct event *event)
+{
+	const char *name = event->sending_name;
+
+	if (global_interest_counter != event_filter_replace_counter) T_BEGIN {
+		event_interest_update();
+	} T_END;
+
+	if (global_interest_all)
+		return TRUE;
+	if (name != NULL && hash_table_is_created(global_interest_names) &&
+	    hash_table_lookup(global_interest_names, name) != NULL)
+		return TRUE;
+	return event_has_category_interest(event);
+}
+
 #undef event_want_log_level
 bool event_want_log_level(struct event *event, enum log_type level,
 			  const char *source_filename,
@@ -313,6 +391,13 @@ bool event_want_level(struct event *event, enum log_type level,
 		      const char *source_filename,
 		      unsigned int source_linenum)
 {
+	if (level < event->min_log_level && !event->forced_debug &&
+	    !event_want_interest(event)) {
+		/* None of the global filters can match this event. This is
+		   the common case for debug events, so avoid evaluating the
+		   filters. */
+		return FALSE;
+	}
 	if (event_want_log_level(event, level, source_filename, source_linenum))
 		return TRUE;
 
@@ -422,6 +507,18 @@ struct event *event_unset_forced_debug(struct event *event)
 	return event;
 }
 
+static void event_interest_unset(void)
+{
+	if (global_debug_log_filter == NULL &&
+	    global_debug_send_filter == NULL &&
+	    global_core_log_filter == NULL) {
+		/* nothing can match - free the memory already here, so it
+		   isn't leaked at deinit */
+		event_interest_free();
+		global_interest_counter = event_filter_replace_counter;
+	}
+}
+
 void event_set_global_debug_log_filter(struct event_filter *filter)
 {
 	event_unset_global_debug_log_filter();
@@ -439,6 +536,7 @@ void event_unset_global_debug_log_filter(void)
 {
 	event_filter_unref(&global_debug_log_filter);
 	event_filter_replace_counter++;
+	event_interest_unset();
 }
 
 void event_set_global_debug_send_filter(struct event_filter *filter)
@@ -458,6 +556,7 @@ void event_unset_global_debug_send_filter(void)
 {
 	event_filter_unref(&global_debug_send_filter);
 	event_filter_replace_counter++;
+	event_interest_unset();
 }
 
 void event_set_global_core_log_filter(struct event_filter *filter)
@@ -477,4 +576,5 @@ void event_unset_global_core_log_filter(void)
 {
 	event_filter_unref(&global_core_log_filter);
 	event_filter_replace_counter++;
+	event_interest_unset();
 }
@@ -3,14 +3,26 @@
 /* @UNSAFE: whole file */
 
 #include "lib.h"
+#include "bits.h"
 #include "hash.h"
 #include "primes.h"
 
 #include <ctype.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
 
 #define HASH_TABLE_MIN_SIZE 67
 
+/* Open addressing tables: the number of control bytes probed at once */
+#define HASH_OA_GROUP_SIZE 16
+#define HASH_OA_MIN_SIZE HASH_OA_GROUP_SIZE
+/* Control byte values. Full slots contain the lowest 7 bits of the hash. */
+#define HASH_OA_CTRL_EMPTY 0x80
+#define HASH_OA_CTRL_DELETED 0xfe
+
 #undef hash_table_create
+#undef hash_table_create_flags
 #undef hash_table_create_direct
 #undef hash_table_destroy
 #undef hash_table_clear
@@ -32,6 +44,11 @@ struct hash_node {
 	void *value;
 };
 
+struct hash_entry {
+	void *key;
+	void *value;
+};
+
 struct hash_table {
 	pool_t node_pool;
 
@@ -42,8 +59,23 @@ struct hash_table {
 	struct hash_node *nodes;
 	struct hash_node *free_nodes;
 
+	/* HASH_TABLE_FLAG_OPEN_ADDRESSING: size is the number of slots,
+	   which is a power of 2. Each slot has a control byte in ctrl[] and
+	   an index to entries[] in slot_entries[]. The first
+	   HASH_OA_GROUP_SIZE control bytes are mirrored after the last one,
+	   so a group can be probed at any position. removed_count is the
+	   number of removed entries that still use space in entries[]. */
+	uint8_t *ctrl;
+	uint32_t *slot_entries;
+	struct hash_entry *entries;
+	unsigned int entries_count, entries_alloc;
+	/* Number of non-empty (full or deleted) slots */
+	unsigned int used_slots;
+
 	hash_callback_t *hash_cb;
 	hash_cmp_callback_t *key_compare_cb;
+
+	bool open_addressing:1;
 };
 
 struct hash_iterate_context {
@@ -60,26 +92,64 @@ enum hash_table_operation{
 
 static bool hash_table_resize(struct hash_table *table, bool grow);
 
-void hash_table_create(struct hash_table **table_r, pool_t node_pool,
-		       unsigned int initial_size, hash_callback_t *hash_cb,
-		       hash_cmp_callback_t *key_compare_cb)
+static unsigned int hash_oa_size(unsigned int count)
+{
+	unsigned int size = HASH_OA_MIN_SIZE;
+
+	/* keep the load factor below 7/8 */
+	while (size - size/8 <= count) {
+		i_assert(size < (1U << 31));
+		size *= 2;
+	}
+	return size;
+}
+
+static void hash_oa_alloc_slots(struct hash_table *table, unsigned int size)
+{
+	table->size = size;
+	table->ctrl = i_malloc(size + HASH_OA_GROUP_SIZE);
+	memset(table->ctrl, HASH_OA_CTRL_EMPTY, size + HASH_OA_GROUP_SIZE);
+	table->slot_entries = i_new(uint32_t, size);
+	table->used_slots = 0;
+}
+
+void hash_table_create_flags(struct hash_table **table_r, pool_t node_pool,
+			     unsigned int initial_size,
+			     hash_callback_t *hash_cb,
+			     hash_cmp_callback_t *key_compare_cb,
+			     enum hash_table_flags flags)
 {
 	struct hash_table *table;
 
 	pool_ref(node_pool);
 	table = i_new(struct hash_table, 1);
 	table->node_pool = node_pool;
-	table->initial_size =
-		I_MAX(primes_closest(initial_size), HASH_TABLE_MIN_SIZE);
 
 	table->hash_cb = hash_cb;
 	table->key_compare_cb = key_compare_cb;
 
-	table->size = table->initial_size;
-	table->nodes = i_new(struct hash_node, table->size);
+	if ((flags & HASH_TABLE_FLAG_OPEN_ADDRESSING) != 0) {
+		table->open_addressing = TRUE;
+		table->initial_size = hash_oa_size(initial_size);
+		hash_oa_alloc_slots(table, table->initial_size);
+	} else {
+		table->initial_size =
+			I_MAX(primes_closest(initial_size),
+			      HASH_TABLE_MIN_SIZE);
+		table->size = table->initial_size;
+		table->nodes = i_new(struct hash_node, table->size);
+	}
 	*table_r = table;
 }
 
+void hash_table_create(struct hash_table **table_r, pool_t node_pool,
+		       unsigned int initial_size, hash_callback_t *hash_cb,
+		       hash_cmp_callback_t *key_compare_cb)
+{
+	hash_table_create_flags(table_r, node_pool, initial_size,
+				hash_cb, key_compare_cb, 0);
+}
+
 static unsigned int direct_hash(const void *p)
 {
 	/* NOTE: may truncate the value, but that doesn't matter. */
@@ -98,6 +168,266 @@ void hash_table_create_direct(struct hash_table **table_r, pool_t node_pool,
 			  direct_hash, direct_cmp);
 }
 
+static unsigned int hash_oa_mix(unsigned int hash)
+{
+	/* The hash callbacks don't necessarily have well distributed low
+	   bits (e.g. direct_hash() of aligned pointers), so mix them. This
+	   is the murmur3 finalizer. */
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bU;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35U;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+static inline uint8_t hash_oa_h2(unsigned int mixed_hash)
+{
+	return mixed_hash & 0x7f;
+}
+
+static inline unsigned int hash_oa_h1(unsigned int mixed_hash)
+{
+	return mixed_hash >> 7;
+}
+
+static inline unsigned int hash_oa_lowest_bit(unsigned int bits)
+{
+	return bits_required32(bits & -bits) - 1;
+}
+
+/* Returns a bitmask of the group's control bytes that equal c */
+static inline unsigned int
+hash_oa_group_match(const uint8_t *group, uint8_t c)
+{
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(c)));
+#else
+	unsigned int i, mask = 0;
+
+	for (i = 0; i < HASH_OA_GROUP_SIZE; i++) {
+		if (group[i] == c)
+			mask |= 1U << i;
+	}
+	return mask;
+#endif
+}
+
+/* Returns a bitmask of the group's empty or deleted control bytes */
+static inline unsigned int hash_oa_group_match_free(const uint8_t *group)
+{
+#ifdef __SSE2__
+	/* the highest bit is set only for empty and deleted */
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+	unsigned int i, mask = 0;
+
+	for (i = 0; i < HASH_OA_GROUP_SIZE; i++) {
+		if ((group[i] & 0x80) != 0)
+			mask |= 1U << i;
+	}
+	return mask;
+#endif
+}
+
+static void
+hash_oa_set_ctrl(struct hash_table *table, unsigned int slot, uint8_t c)
+{
+	table->ctrl[slot] = c;
+	if (slot < HASH_OA_GROUP_SIZE)
+		table->ctrl[table->size + slot] = c;
+}
+
+static bool
+hash_oa_find(const struct hash_table *table, const void *key,
+	     unsigned int mixed_hash, unsigned int *slot_r)
+{
+	unsigned int mask = table->size - 1;
+	unsigned int pos = hash_oa_h1(mixed_hash) & mask, stride = 0;
+	unsigned int bits, slot;
+	uint8_t h2 = hash_oa_h2(mixed_hash);
+	const struct hash_entry *entry;
+
+	for (;;) {
+		const uint8_t *group = &table->ctrl[pos];
+
+		bits = hash_oa_group_match(group, h2);
+		while (bits != 0) {
+			slot = (pos + hash_oa_lowest_bit(bits)) & mask;
+			entry = &table->entries[table->slot_entries[slot]];
+			if (table->key_compare_cb(entry->key, key) == 0) {
+				*slot_r = slot;
+				return TRUE;
+			}
+			bits &= bits - 1;
+		}
+		if (hash_oa_group_match(group, HASH_OA_CTRL_EMPTY) != 0)
+			return FALSE;
+		/* triangular probing visits all the groups */
+		stride += HASH_OA_GROUP_SIZE;
+		i_assert(stride <= table->size);
+		pos = (pos + stride) & mask;
+	}
+}
+
+static unsigned int
+hash_oa_find_free(const struct hash_table *table, unsigned int mixed_hash)
+{
+	unsigned int mask = table->size - 1;
+	unsigned int pos = hash_oa_h1(mixed_hash) & mask, stride = 0;
+	unsigned int bits;
+
+	for (;;) {
+		bits = hash_oa_group_match_free(&table->ctrl[pos]);
+		if (bits != 0)
+			return (pos + hash_oa_lowest_bit(bits)) & mask;
+		stride += HASH_OA_GROUP_SIZE;
+		i_assert(stride <= table->size);
+		pos = (pos + stride) & mask;
+	}
+}
+
+static void hash_oa_rebuild(struct hash_table *table, unsigned int min_count)
+{
+	unsigned int i, j, slot, mixed_hash, size;
+
+	i_free(table->ctrl);
+	i_free(table->slot_entries);
+
+	if (table->frozen == 0 && table->removed_count > 0) {
+		/* drop the removed entries */
+		for (i = j = 0; i < table->entries_count; i++) {
+			if (table->entries[i].key != NULL)
+				table->entries[j++] = table->entries[i];
+		}
+		table->entries_count = j;
+		table->removed_count = 0;
+	}
+
+	size = I_MAX(hash_oa_size(I_MAX(table->nodes_count, min_count)),
+		     table->initial_size);
+	hash_oa_alloc_slots(table, size);
+	for (i = 0; i < table->entries_count; i++) {
+		if (table->entries[i].key == NULL)
+			continue;
+		mixed_hash = hash_oa_mix(table->hash_cb(table->entries[i].key));
+		slot = hash_oa_find_free(table, mixed_hash);
+		hash_oa_set_ctrl(table, slot, hash_oa_h2(mixed_hash));
+		table->slot_entries[slot] = i;
+		table->used_slots++;
+	}
+}
+
+static void hash_oa_rebuild_if_sparse(struct hash_table *table)
+{
+	/* Compact the entries once most of them are removed. This also
+	   shrinks the slots if the table has become small enough. */
+	if (table->frozen == 0 &&
+	    table->removed_count > table->nodes_count &&
+	    table->removed_count >= HASH_OA_MIN_SIZE)
+		hash_oa_rebuild(table, 0);
+}
+
+static struct hash_entry *
+hash_oa_lookup(const struct hash_table *table, const void *key)
+{
+	unsigned int slot;
+
+	if (!hash_oa_find(table, key, hash_oa_mix(table->hash_cb(key)), &slot))
+		return NULL;
+	return &table->entries[table->slot_entries[slot]];
+}
+
+static void
+hash_oa_insert(struct hash_table *table, void *key, void *value,
+	       enum hash_table_operation opcode)
+{
+	struct hash_entry *entry;
+	unsigned int mixed_hash, slot;
+
+	i_assert(table->nodes_count < UINT_MAX);
+	i_assert(key != NULL);
+
+	mixed_hash = hash_oa_mix(table->hash_cb(key));
+	if (hash_oa_find(table, key, mixed_hash, &slot)) {
+		i_assert(opcode == HASH_TABLE_OP_UPDATE);
+		table->entries[table->slot_entries[slot]].value = value;
+		return;
+	}
+
+	slot = hash_oa_find_free(table, mixed_hash);
+	if (table->ctrl[slot] == HASH_OA_CTRL_EMPTY &&
+	    table->used_slots + 1 > table->size - table->size/8) {
+		/* Too full. Rehashing gets rid of the deleted slots, and
+		   grows the table if needed. The entries[] order is
+		   preserved if the table is frozen, so this is safe even
+		   while iterating. */
+		hash_oa_rebuild(table, table->nodes_count + 1);
+		slot = hash_oa_find_free(table, mixed_hash);
+	}
+
+	if (table->entries_count == table->entries_alloc) {
+		table->entries_alloc = table->entries_alloc == 0 ? 8 :
+			table->entries_alloc * 2;
+		table->entries = i_realloc_type(table->entries,
+						struct hash_entry,
+						table->entries_count,
+						table->entries_alloc);
+	}
+	entry = &table->entries[table->entries_count];
+	entry->key = key;
+	entry->value = value;
+
+	if (table->ctrl[slot] == HASH_OA_CTRL_EMPTY)
+		table->used_slots++;
+	hash_oa_set_ctrl(table, slot, hash_oa_h2(mixed_hash));
+	table->slot_entries[slot] = table->entries_count++;
+	table->nodes_count++;
+}
+
+static bool hash_oa_try_remove(struct hash_table *table, const void *key)
+{
+	struct hash_entry *entry;
+	unsigned int slot, idx;
+
+	if (!hash_oa_find(table, key, hash_oa_mix(table->hash_cb(key)), &slot))
+		return FALSE;
+
+	idx = table->slot_entries[slot];
+	entry = &table->entries[idx];
+	entry->key = NULL;
+	entry->value = NULL;
+	hash_oa_set_ctrl(table, slot, HASH_OA_CTRL_DELETED);
+	table->nodes_count--;
+
+	if (table->frozen == 0 && idx == table->entries_count - 1) {
+		/* the last entry can be dropped immediately */
+		table->entries_count--;
+	} else {
+		table->removed_count++;
+		hash_oa_rebuild_if_sparse(table);
+	}
+	return TRUE;
+}
+
+static void hash_oa_clear(struct hash_table *table)
+{
+	memset(table->ctrl, HASH_OA_CTRL_EMPTY,
+	       table->size + HASH_OA_GROUP_SIZE);
+	table->used_slots = 0;
+	table->entries_count = 0;
+	table->nodes_count = 0;
+	table->removed_count = 0;
+}
+
+static void hash_oa_destroy(struct hash_table *table)
+{
+	i_free(table->ctrl);
+	i_free(table->slot_entries);
+	i_free(table->entries);
+}
+
 static void free_node(struct hash_table *table, struct hash_node *node)
 {
 	if (!table->node_pool->alloconly_pool)
@@ -139,7 +469,9 @@ void hash_table_destroy(struct hash_table **_table)
 
 	i_assert(table->frozen == 0);
 
-	if (!table->node_pool->alloconly_pool) {
+	if (table->open_addressing)
+		hash_oa_destroy(table);
+	else if (!table->node_pool->alloconly_pool) {
 		hash_table_destroy_nodes(table);
 		destroy_node_list(table, table->free_nodes);
 	}
@@ -153,6 +485,11 @@ void hash_table_clear(struct hash_table *table, bool free_nodes)
 {
 	i_assert(table->frozen == 0);
 
+	if (table->open_addressing) {
+		hash_oa_clear(table);
+		return;
+	}
+
 	if (!table->node_pool->alloconly_pool)
 		hash_table_destroy_nodes(table);
 
@@ -191,6 +528,11 @@ void *hash_table_lookup(const struct hash_table *table, const void *key)
 {
 	struct hash_node *node;
 
+	if (table->open_addressing) {
+		struct hash_entry *entry = hash_oa_lookup(table, key);
+		return entry != NULL ? entry->value : NULL;
+	}
+
 	node = hash_table_lookup_node(table, key, table->hash_cb(key));
 	return node != NULL ? node->value : NULL;
 }
@@ -201,6 +543,15 @@ bool hash_table_lookup_full(const struct hash_table *table,
 {
 	struct hash_node *node;
 
+	if (table->open_addressing) {
+		struct hash_entry *entry = hash_oa_lookup(table, lookup_key);
+		if (entry == NULL)
+			return FALSE;
+		*orig_key = entry->key;
+		*value = entry->value;
+		return TRUE;
+	}
+
 	node = hash_table_lookup_node(table, lookup_key,
 				      table->hash_cb(lookup_key));
 	if (node == NULL)
@@ -297,12 +648,18 @@ hash_table_insert_node(struct hash_table *table, void *key, void *value,
 
 void hash_table_insert(struct hash_table *table, void *key, void *value)
 {
-	hash_table_insert_node(table, key, value, HASH_TABLE_OP_INSERT);
+	if (table->open_addressing)
+		hash_oa_insert(table, key, value, HASH_TABLE_OP_INSERT);
+	else
+		hash_table_insert_node(table, key, value, HASH_TABLE_OP_INSERT);
 }
 
 void hash_table_update(struct hash_table *table, void *key, void *value)
 {
-	hash_table_insert_node(table, key, value, HASH_TABLE_OP_UPDATE);
+	if (table->open_addressing)
+		hash_oa_insert(table, key, value, HASH_TABLE_OP_UPDATE);
+	else
+		hash_table_insert_node(table, key, value, HASH_TABLE_OP_UPDATE);
 }
 
 static void
@@ -347,6 +704,9 @@ bool hash_table_try_remove(struct hash_table *table, const void *key)
 	struct hash_node *node;
 	unsigned int hash;
 
+	if (table->open_addressing)
+		return hash_oa_try_remove(table, key);
+
 	hash = table->hash_cb(key);
 
 	node = hash_table_lookup_node(table, key, hash);
@@ -376,7 +736,8 @@ struct hash_iterate_context *hash_table_iterate_init(struct hash_table *table)
 
 	ctx = i_new(struct hash_iterate_context, 1);
 	ctx->table = table;
-	ctx->next = &table->nodes[0];
+	if (!table->open_addressing)
+		ctx->next = &table->nodes[0];
 	return ctx;
 }
 
@@ -403,6 +764,21 @@ bool hash_table_iterate(struct hash_iterate_context *ctx,
 {
 	struct hash_node *node;
 
+	if (ctx->table->open_addressing) {
+		/* entries[] isn't compacted while the table is frozen */
+		while (ctx->pos < ctx->table->entries_count) {
+			const struct hash_entry *entry =
+				&ctx->table->entries[ctx->pos++];
+			if (entry->key != NULL) {
+				*key_r = entry->key;
+				*value_r = entry->value;
+				return TRUE;
+			}
+		}
+		*key_r = *value_r = NULL;
+		return FALSE;
+	}
+
 	node = ctx->next;
 	if (node != NULL && node->key == NULL)
 		node = hash_table_iterate_next(ctx, node);
@@ -441,7 +817,9 @@ void hash_table_thaw(struct hash_table *table)
 	if (--table->frozen > 0)
 		return;
 
-	if (table->removed_count > 0) {
+	if (table->open_addressing)
+		hash_oa_rebuild_if_sparse(table);
+	else if (table->removed_count > 0) {
 		if (!hash_table_resize(table, FALSE))
 			hash_table_compress_removed(table);
 	}
@@ -2,6 +2,7 @@
 #define IOLOOP_PRIVATE_H
 
 #include "priorityq.h"
+#include "timer-wheel.h"
 #include "ioloop.h"
 #include "array-decl.h"
 
@@ -17,7 +18,12 @@ struct ioloop {
 	struct io_file *io_files;
 	struct io_file *next_io_file;
 	struct priorityq *timeouts;
+	/* Coarse timeouts are kept in a timer wheel instead of timeouts */
+	struct timer_wheel *timeouts_wheel;
 	ARRAY(struct timeout *) timeouts_new;
+	/* Slab pool for allocating struct timeouts, since they're frequently
+	   added and removed. */
+	pool_t timeout_pool;
 	struct io_wait_timer *wait_timers;
 
         struct ioloop_handler_context *handler_context;
@@ -69,6 +75,7 @@ struct io_file {
 
 struct timeout {
 	struct priorityq_item item;
+	struct timer_wheel_item wheel_item;
 	const char *source_filename;
 	unsigned int source_linenum;
 
@@ -0,0 +1,421 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "sleep.h"
+#include "ioloop-private.h"
+#include "ioloop-iolist.h"
+
+#ifdef IOLOOP_URING
+
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* Number of submission queue entries. The completion queue is twice this
+   size. Since the kernel keeps overflowed completions, this doesn't limit
+   the number of file descriptors that can be watched. */
+#define IOLOOP_URING_SQ_ENTRIES 256
+
+/* user_data for submissions whose completions are ignored */
+#define IOLOOP_URING_USER_DATA_IGNORE ((uint64_t)-1)
+
+#define IO_URING_ERROR (POLLERR | POLLHUP)
+#define IO_URING_INPUT (POLLIN | POLLPRI | IO_URING_ERROR)
+#define IO_URING_OUTPUT (POLLOUT | IO_URING_ERROR)
+
+struct io_uring_list {
+	struct io_list list;
+	int fd;
+	/* Incremented every time the poll request is removed. Completions
+	   of older requests are ignored. */
+	uint32_t gen;
+	/* Events of the currently armed poll request */
+	unsigned int armed_events;
+	bool armed:1;
+};
+
+struct ioloop_handler_context {
+	int ring_fd;
+
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	/* Number of SQEs added since the last io_uring_enter() */
+	unsigned int sq_pending;
+
+	ARRAY(struct io_uring_list *) fd_index;
+};
+
+static int
+io_uring_setup(unsigned int entries, struct io_uring_params *params)
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+io_uring_enter(int ring_fd, unsigned int to_submit, unsigned int min_complete,
+	       unsigned int flags, const void *arg, size_t arg_size)
+{
+	return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+		       flags, arg, arg_size);
+}
+
+static void *
+io_uring_mmap(struct ioloop_handler_context *ctx, size_t size, off_t offset)
+{
+	void *ptr;
+
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, ctx->ring_fd, offset);
+	if (ptr == MAP_FAILED)
+		i_fatal("mmap(io_uring) failed: %m");
+	return ptr;
+}
+
+void io_loop_handler_init(struct ioloop *ioloop, unsigned int initial_fd_count)
+{
+	struct ioloop_handler_context *ctx;
+	struct io_uring_params params;
+
+	ioloop->handler_context = ctx = i_new(struct ioloop_handler_context, 1);
+	i_array_init(&ctx->fd_index, initial_fd_count);
+
+	i_zero(&params);
+	ctx->ring_fd = io_uring_setup(IOLOOP_URING_SQ_ENTRIES, &params);
+	if (ctx->ring_fd < 0)
+		i_fatal("io_uring_setup() failed: %m");
+	fd_close_on_exec(ctx->ring_fd, TRUE);
+	if ((params.features & IORING_FEAT_EXT_ARG) == 0 ||
+	    (params.features & IORING_FEAT_NODROP) == 0) {
+		i_fatal("io_uring: Kernel is too old "
+			"(Linux v5.11+ required, use --with-ioloop=epoll)");
+	}
+
+	ctx->sq_ring_size = params.sq_off.array +
+		params.sq_entries * sizeof(unsigned int);
+	ctx->cq_ring_size = params.cq_off.cqes +
+		params.cq_entries * sizeof(struct io_uring_cqe);
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+		ctx->sq_ring_size = I_MAX(ctx->sq_ring_size, ctx->cq_ring_size);
+		ctx->sq_ring = io_uring_mmap(ctx, ctx->sq_ring_size,
+					     IORING_OFF_SQ_RING);
+		ctx->cq_ring = ctx->sq_ring;
+	} else {
+		ctx->sq_ring = io_uring_mmap(ctx, ctx->sq_ring_size,
+					     IORING_OFF_SQ_RING);
+		ctx->cq_ring = io_uring_mmap(ctx, ctx->cq_ring_size,
+					     IORING_OFF_CQ_RING);
+	}
+	ctx->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ctx->sqes = io_uring_mmap(ctx, ctx->sqes_size, IORING_OFF_SQES);
+
+	ctx->sq_head = PTR_OFFSET(ctx->sq_ring, params.sq_off.head);
+	ctx->sq_tail = PTR_OFFSET(ctx->sq_ring, params.sq_off.tail);
+	ctx->sq_mask = PTR_OFFSET(ctx->sq_ring, params.sq_off.ring_mask);
+	ctx->sq_array = PTR_OFFSET(ctx->sq_ring, params.sq_off.array);
+	ctx->cq_head = PTR_OFFSET(ctx->cq_ring, params.cq_off.head);
+	ctx->cq_tail = PTR_OFFSET(ctx->cq_ring, params.cq_off.tail);
+	ctx->cq_mask = PTR_OFFSET(ctx->cq_ring, params.cq_off.ring_mask);
+	ctx->cqes = PTR_OFFSET(ctx->cq_ring, params.cq_off.cqes);
+}
+
+void io_loop_handler_deinit(struct ioloop *ioloop)
+{
+	struct ioloop_handler_context *ctx = ioloop->handler_context;
+	struct io_uring_list **list;
+	unsigned int i, count;
+
+	list = array_get_modifiable(&ctx->fd_index, &count);
+	for (i = 0; i < count; i++)
+		i_free(list[i]);
+
+	if (munmap(ctx->sqes, ctx->sqes_size) < 0)
+		i_error("munmap(io_uring sqes) failed: %m");
+	if (ctx->cq_ring != ctx->sq_ring &&
+	    munmap(ctx->cq_ring, ctx->cq_ring_size) < 0)
+		i_error("munmap(io_uring cq) failed: %m");
+	if (munmap(ctx->sq_ring, ctx->sq_ring_size) < 0)
+		i_error("munmap(io_uring sq) failed: %m");
+	if (close(ctx->ring_fd) < 0)
+		i_error("close(io_uring) failed: %m");
+	array_free(&ioloop->handler_context->fd_index);
+	i_free(ioloop->handler_context);
+}
+
+static void io_uring_submit(struct ioloop_handler_context *ctx)
+{
+	int ret;
+
+	while (ctx->sq_pending > 0) {
+		ret = io_uring_enter(ctx->ring_fd, ctx->sq_pending, 0, 0,
+				     NULL, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EBUSY) {
+				/* completion queue is full - these will be
+				   submitted by the next wait */
+				return;
+			}
+			i_fatal("io_uring_enter() failed: %m");
+		}
+		i_assert((unsigned int)ret <= ctx->sq_pending);
+		ctx->sq_pending -= ret;
+	}
+}
+
+static struct io_uring_sqe *io_uring_get_sqe(struct ioloop_handler_context *ctx)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int head, tail, idx;
+
+	tail = *ctx->sq_tail;
+	head = __atomic_load_n(ctx->sq_head, __ATOMIC_ACQUIRE);
+	if (tail - head > *ctx->sq_mask) {
+		/* submission queue is full */
+		io_uring_submit(ctx);
+		head = __atomic_load_n(ctx->sq_head, __ATOMIC_ACQUIRE);
+		if (tail - head > *ctx->sq_mask)
+			i_panic("io_uring: Submission queue is full");
+	}
+
+	idx = tail & *ctx->sq_mask;
+	sqe = &ctx->sqes[idx];
+	i_zero(sqe);
+	ctx->sq_array[idx] = idx;
+	/* The caller fills the SQE after this. That's safe, because the
+	   kernel reads SQEs only within io_uring_enter(). */
+	__atomic_store_n(ctx->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ctx->sq_pending++;
+	return sqe;
+}
+
+static uint64_t io_uring_list_user_data(const struct io_uring_list *list)
+{
+	return ((uint64_t)(unsigned int)list->fd << 32) | list->gen;
+}
+
+static unsigned int io_uring_event_mask(struct io_uring_list *list)
+{
+	unsigned int events = 0;
+	struct io_file *io;
+	int i;
+
+	for (i = 0; i < IOLOOP_IOLIST_IOS_PER_FD; i++) {
+		io = list->list.ios[i];
+
+		if (io == NULL)
+			continue;
+
+		if ((io->io.condition & IO_READ) != 0)
+			events |= IO_URING_INPUT;
+		if ((io->io.condition & IO_WRITE) != 0)
+			events |= IO_URING_OUTPUT;
+		if ((io->io.condition & IO_ERROR) != 0)
+			events |= IO_URING_ERROR;
+	}
+	return events;
+}
+
+static void
+io_uring_list_update(struct ioloop_handler_context *ctx,
+		     struct io_uring_list *list)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int events = io_uring_event_mask(list);
+
+	if (list->armed) {
+		if (list->armed_events == events)
+			return;
+		/* The poll request keeps a reference to the file, so even
+		   if the fd was already closed the request must be removed
+		   explicitly. */
+		sqe = io_uring_get_sqe(ctx);
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = io_uring_list_user_data(list);
+		sqe->user_data = IOLOOP_URING_USER_DATA_IGNORE;
+		list->armed = FALSE;
+		list->gen++;
+	}
+	if (events == 0)
+		return;
+
+	/* Poll requests are one-shot. They're re-armed after the events
+	   have been handled, and the re-arming submissions are sent to the
+	   kernel within the next wait's io_uring_enter() call. */
+	sqe = io_uring_get_sqe(ctx);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = list->fd;
+	sqe->poll32_events = events;
+	sqe->user_data = io_uring_list_user_data(list);
+	list->armed = TRUE;
+	list->armed_events = events;
+}
+
+void io_loop_handle_add(struct io_file *io)
+{
+	struct ioloop_handler_context *ctx = io->io.ioloop->handler_context;
+	struct io_uring_list **list;
+	bool first;
+
+	list = array_idx_get_space(&ctx->fd_index, io->fd);
+	if (*list == NULL) {
+		*list = i_new(struct io_uring_list, 1);
+		(*list)->fd = io->fd;
+	}
+
+	first = ioloop_iolist_add(&(*list)->list, io);
+	io_uring_list_update(ctx, *list);
+	if (first) {
+		/* Submit polls for new fds immediately, so events get
+		   reported in the order they happen, as with epoll. */
+		io_uring_submit(ctx);
+	}
+}
+
+void io_loop_handle_remove(struct io_file *io, bool closed ATTR_UNUSED)
+{
+	struct ioloop_handler_context *ctx = io->io.ioloop->handler_context;
+	struct io_uring_list **list;
+
+	list = array_idx_modifiable(&ctx->fd_index, io->fd);
+	(void)ioloop_iolist_del(&(*list)->list, io);
+	io_uring_list_update(ctx, *list);
+	i_free(io);
+}
+
+static void
+io_uring_handle_cqe(struct ioloop *ioloop, uint64_t user_data, int res)
+{
+	struct ioloop_handler_context *ctx = ioloop->handler_context;
+	struct io_uring_list *list, *const *listp;
+	struct io_file *io;
+	unsigned int fd = user_data >> 32;
+	uint32_t gen = user_data & 0xffffffffU;
+	bool call;
+	int i;
+
+	if (user_data == IOLOOP_URING_USER_DATA_IGNORE ||
+	    fd >= array_count(&ctx->fd_index))
+		return;
+	listp = array_idx(&ctx->fd_index, fd);
+	list = *listp;
+	if (list == NULL || !list->armed || list->gen != gen) {
+		/* completion for an already removed request */
+		return;
+	}
+	list->armed = FALSE;
+
+	if (res < 0) {
+		if (res != -ECANCELED)
+			i_panic("io_uring poll(%u) failed: %s", fd,
+				strerror(-res));
+		io_uring_list_update(ctx, list);
+		return;
+	}
+
+	for (i = 0; i < IOLOOP_IOLIST_IOS_PER_FD; i++) {
+		io = list->list.ios[i];
+		if (io == NULL)
+			continue;
+
+		call = FALSE;
+		if ((res & (POLLHUP | POLLERR | POLLNVAL)) != 0)
+			call = TRUE;
+		else if ((io->io.condition & IO_READ) != 0)
+			call = (res & (POLLIN | POLLPRI)) != 0;
+		else if ((io->io.condition & IO_WRITE) != 0)
+			call = (res & POLLOUT) != 0;
+		else if ((io->io.condition & IO_ERROR) != 0)
+			call = (res & IO_URING_ERROR) != 0;
+
+		if (call) {
+			io_loop_call_io(&io->io);
+			if (!ioloop->running)
+				break;
+		}
+	}
+	/* the list may have been reallocated by the callbacks */
+	listp = array_idx(&ctx->fd_index, fd);
+	io_uring_list_update(ctx, *listp);
+}
+
+void io_loop_handler_run_internal(struct ioloop *ioloop)
+{
+	struct ioloop_handler_context *ctx = ioloop->handler_context;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	const struct io_uring_cqe *cqe;
+	struct timeval tv;
+	unsigned int head, tail;
+	uint64_t user_data;
+	int msecs, ret, res;
+
+	i_assert(ctx != NULL);
+
+	/* get the time left for next timeout task */
+	msecs = io_loop_run_get_wait_time(ioloop, &tv);
+
+	if (ioloop->io_files != NULL) {
+		/* Submit all the queued poll requests and wait for events
+		   with a single syscall. */
+		i_zero(&arg);
+		if (msecs >= 0) {
+			ts.tv_sec = msecs / 1000;
+			ts.tv_nsec = (long long)(msecs % 1000) * 1000000;
+			arg.ts = (uintptr_t)&ts;
+		}
+		ret = io_uring_enter(ctx->ring_fd, ctx->sq_pending, 1,
+				     IORING_ENTER_GETEVENTS |
+				     IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+		if (ret >= 0) {
+			i_assert((unsigned int)ret <= ctx->sq_pending);
+			ctx->sq_pending -= ret;
+		} else if (errno != EINTR && errno != ETIME &&
+			   errno != EAGAIN && errno != EBUSY) {
+			i_fatal("io_uring_enter() failed: %m");
+		}
+	} else {
+		/* no I/Os, but we should have some timeouts.
+		   just wait for them. */
+		i_assert(msecs >= 0);
+		io_uring_submit(ctx);
+		i_sleep_intr_msecs(msecs);
+	}
+
+	/* execute timeout handlers */
+	io_loop_handle_timeouts(ioloop);
+
+	if (!ioloop->running)
+		return;
+
+	/* Handle only the completions that were already available. Any
+	   new ones are handled by the next run. */
+	head = *ctx->cq_head;
+	tail = __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE);
+	while (head != tail) {
+		cqe = &ctx->cqes[head & *ctx->cq_mask];
+		user_data = cqe->user_data;
+		res = cqe->res;
+		/* release the CQE before calling the callbacks, which may
+		   want to submit new requests */
+		head++;
+		__atomic_store_n(ctx->cq_head, head, __ATOMIC_RELEASE);
+
+		io_uring_handle_cqe(ioloop, user_data, res);
+		if (!ioloop->running)
+			return;
+	}
+}
+
+#endif	/* IOLOOP_URING */
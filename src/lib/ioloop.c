@@ -19,6 +19,15 @@
    logging many warnings about this, use a rather high value. */
 #define IOLOOP_TIME_MOVED_FORWARDS_MIN_USECS (100000)
 
+/* Repeating timeouts at least this long are kept in a timer wheel instead of
+   the priority queue. This makes adding, resetting and removing them O(1),
+   which matters for processes having lots of idle connections, each with
+   their own timeouts. */
+#define IOLOOP_TIMEOUT_WHEEL_MIN_MSECS 1000
+/* Accuracy of the timer wheel. The timeouts in it may be called this much
+   later than requested. */
+#define IOLOOP_TIMEOUT_WHEEL_TICK_MSECS 10
+
 time_t ioloop_time = 0;
 struct timeval ioloop_timeval;
 struct ioloop *current_ioloop = NULL;
@@ -254,6 +263,39 @@ static void timeout_update_next(struct timeout *timeout, struct timeval *tv_now)
 	}
 }
 
+static uint64_t timeout_next_run_msecs(const struct timeval *next_run)
+{
+	return (timeval_to_usecs(next_run) + 999) / 1000;
+}
+
+static bool timeout_is_queued(const struct timeout *timeout)
+{
+	return timeout->item.idx != UINT_MAX ||
+		timer_wheel_item_is_added(&timeout->wheel_item);
+}
+
+static void timeout_queue_add(struct timeout *timeout)
+{
+	if (!timeout->one_shot &&
+	    timeout->msecs >= IOLOOP_TIMEOUT_WHEEL_MIN_MSECS) {
+		timer_wheel_add(timeout->ioloop->timeouts_wheel,
+				&timeout->wheel_item,
+				timeout_next_run_msecs(&timeout->next_run));
+	} else {
+		priorityq_add(timeout->ioloop->timeouts, &timeout->item);
+	}
+}
+
+static void timeout_queue_remove(struct timeout *timeout)
+{
+	if (timer_wheel_item_is_added(&timeout->wheel_item)) {
+		timer_wheel_remove(timeout->ioloop->timeouts_wheel,
+				   &timeout->wheel_item);
+	} else {
+		priorityq_remove(timeout->ioloop->timeouts, &timeout->item);
+	}
+}
+
 static struct timeout *
 timeout_add_common(struct ioloop *ioloop, const char *source_filename,
 		   unsigned int source_linenum,
@@ -261,7 +303,7 @@ timeout_add_common(struct ioloop *ioloop, const char *source_filename,
 {
 	struct timeout *timeout;
 
-	timeout = i_new(struct timeout, 1);
+	timeout = p_new(ioloop->timeout_pool, struct timeout, 1);
 	timeout->item.idx = UINT_MAX;
 	timeout->source_filename = source_filename;
 	timeout->source_linenum = source_linenum;
@@ -377,8 +419,8 @@ timeout_copy(const struct timeout *old_to, struct ioloop *ioloop)
 	new_to->msecs = old_to->msecs;
 	new_to->next_run = old_to->next_run;
 
-	if (old_to->item.idx != UINT_MAX)
-		priorityq_add(new_to->ioloop->timeouts, &new_to->item);
+	if (timeout_is_queued(old_to))
+		timeout_queue_add(new_to);
 	else if (!new_to->one_shot) {
 		i_assert(new_to->msecs > 0);
 		array_push_back(&new_to->ioloop->timeouts_new, &new_to);
@@ -391,7 +433,7 @@ static void timeout_free(struct timeout *timeout)
 {
 	if (timeout->ctx != NULL)
 		io_loop_context_unref(&timeout->ctx);
-	i_free(timeout);
+	p_free(timeout->ioloop->timeout_pool, timeout);
 }
 
 void timeout_remove(struct timeout **_timeout)
@@ -405,8 +447,8 @@ void timeout_remove(struct timeout **_timeout)
 	ioloop = timeout->ioloop;
 
 	*_timeout = NULL;
-	if (timeout->item.idx != UINT_MAX)
-		priorityq_remove(timeout->ioloop->timeouts, &timeout->item);
+	if (timeout_is_queued(timeout))
+		timeout_queue_remove(timeout);
 	else if (!timeout->one_shot && timeout->msecs > 0) {
 		struct timeout *const *to_idx;
 		array_foreach(&ioloop->timeouts_new, to_idx) {
@@ -423,7 +465,7 @@ void timeout_remove(struct timeout **_timeout)
 static void ATTR_NULL(2)
 timeout_reset_timeval(struct timeout *timeout, struct timeval *tv_now)
 {
-	if (timeout->item.idx == UINT_MAX)
+	if (!timeout_is_queued(timeout))
 		return;
 
 	timeout_update_next(timeout, tv_now);
@@ -440,8 +482,8 @@ timeout_reset_timeval(struct timeout *timeout, struct timeval *tv_now)
 		timeout->next_run = *tv_now;
 		timeval_add_usecs(&timeout->next_run, 1);
 	}
-	priorityq_remove(timeout->ioloop->timeouts, &timeout->item);
-	priorityq_add(timeout->ioloop->timeouts, &timeout->item);
+	timeout_queue_remove(timeout);
+	timeout_queue_add(timeout);
 }
 
 void timeout_reset(struct timeout *timeout)
@@ -450,8 +492,9 @@ void timeout_reset(struct timeout *timeout)
 	timeout_reset_timeval(timeout, NULL);
 }
 
-static int timeout_get_wait_time(struct timeout *timeout, struct timeval *tv_r,
-				 struct timeval *tv_now, bool in_timeout_loop)
+static int timeout_get_wait_time(const struct timeval *next_run,
+				 struct timeval *tv_r, struct timeval *tv_now,
+				 bool in_timeout_loop)
 {
 	int ret;
 
@@ -461,10 +504,10 @@ static int timeout_get_wait_time(struct timeout *timeout, struct timeval *tv_r,
 	tv_r->tv_usec = tv_now->tv_usec;
 
 	i_assert(tv_r->tv_sec > 0);
-	i_assert(timeout->next_run.tv_sec > 0);
+	i_assert(next_run->tv_sec > 0);
 
-	tv_r->tv_sec = timeout->next_run.tv_sec - tv_r->tv_sec;
-	tv_r->tv_usec = timeout->next_run.tv_usec - tv_r->tv_usec;
+	tv_r->tv_sec = next_run->tv_sec - tv_r->tv_sec;
+	tv_r->tv_usec = next_run->tv_usec - tv_r->tv_usec;
 	if (tv_r->tv_usec < 0) {
 		tv_r->tv_sec--;
 		tv_r->tv_usec += 1000000;
@@ -491,20 +534,54 @@ static int timeout_get_wait_time(struct timeout *timeout, struct timeval *tv_r,
 	return ret;
 }
 
-static int io_loop_get_wait_time(struct ioloop *ioloop, struct timeval *tv_r)
+static bool
+io_loop_get_next_run(struct ioloop *ioloop, struct timeout **timeout_r,
+		     struct timeval *next_run_r)
 {
-	struct timeval tv_now;
 	struct priorityq_item *item;
 	struct timeout *timeout;
-	int msecs;
+	struct timeval tv;
+	uint64_t wheel_msecs;
+	bool ret = FALSE;
 
 	item = priorityq_peek(ioloop->timeouts);
 	timeout = (struct timeout *)item;
+	if (timeout != NULL) {
+		*next_run_r = timeout->next_run;
+		ret = TRUE;
+	}
+	*timeout_r = timeout;
+
+	if (timer_wheel_get_next_msecs(ioloop->timeouts_wheel, &wheel_msecs)) {
+		if (wheel_msecs == 0) {
+			/* some timeouts have already expired */
+			tv = ioloop_timeval;
+		} else {
+			tv.tv_sec = wheel_msecs / 1000;
+			tv.tv_usec = (wheel_msecs % 1000) * 1000;
+		}
+		if (!ret || timeval_cmp(&tv, next_run_r) < 0) {
+			*next_run_r = tv;
+			*timeout_r = NULL;
+		}
+		ret = TRUE;
+	}
+	return ret;
+}
+
+static int io_loop_get_wait_time(struct ioloop *ioloop, struct timeval *tv_r)
+{
+	struct timeval tv_now, next_run;
+	struct timeout *timeout;
+	bool have_timeouts;
+	int msecs;
+
+	have_timeouts = io_loop_get_next_run(ioloop, &timeout, &next_run);
 
 	/* we need to see if there are pending IO waiting,
 	   if there is, we set msecs = 0 to ensure they are
 	   processed without delay */
-	if (timeout == NULL && ioloop->io_pending_count == 0) {
+	if (!have_timeouts && ioloop->io_pending_count == 0) {
 		/* no timeouts. use INT_MAX msecs for timeval and
 		   return -1 for poll/epoll infinity. */
 		tv_r->tv_sec = INT_MAX / 1000;
@@ -521,7 +598,7 @@ static int io_loop_get_wait_time(struct ioloop *ioloop, struct timeval *tv_r)
 		tv_r->tv_usec = 0;
 	} else {
 		tv_now.tv_sec = 0;
-		msecs = timeout_get_wait_time(timeout, tv_r, &tv_now, FALSE);
+		msecs = timeout_get_wait_time(&next_run, tv_r, &tv_now, FALSE);
 	}
 	ioloop->next_max_time = tv_now;
 	timeval_add_msecs(&ioloop->next_max_time, msecs);
@@ -531,7 +608,8 @@ static int io_loop_get_wait_time(struct ioloop *ioloop, struct timeval *tv_r)
 	   ioloop and after that we update ioloop_timeval immediately again. */
 	ioloop_timeval = tv_now;
 	ioloop_time = tv_now.tv_sec;
-	i_assert(msecs == 0 || timeout->msecs > 0 || timeout->one_shot);
+	i_assert(msecs == 0 || timeout == NULL ||
+		 timeout->msecs > 0 || timeout->one_shot);
 	return msecs;
 }
 
@@ -587,26 +665,52 @@ static void io_loop_timeouts_start_new(struct ioloop *ioloop)
 		i_assert(!timeout->one_shot);
 		i_assert(timeout->msecs > 0);
 		timeout_update_next(timeout, &ioloop_timeval);
-		priorityq_add(ioloop->timeouts, &timeout->item);
+		timeout_queue_add(timeout);
 	}
 	array_clear(&ioloop->timeouts_new);
 }
 
+static void timeout_move_next_run(struct timeout *to, long long diff_usecs)
+{
+	if (diff_usecs > 0)
+		timeval_add_usecs(&to->next_run, diff_usecs);
+	else
+		timeval_sub_usecs(&to->next_run, -diff_usecs);
+}
+
 static void io_loop_timeouts_update(struct ioloop *ioloop, long long diff_usecs)
 {
 	struct priorityq_item *const *items;
+	struct timer_wheel_item *wheel_item;
+	struct timeout *to;
+	ARRAY(struct timeout *) wheel_timeouts;
 	unsigned int i, count;
 
 	count = priorityq_count(ioloop->timeouts);
 	items = priorityq_items(ioloop->timeouts);
 	for (i = 0; i < count; i++) {
-		struct timeout *to = (struct timeout *)items[i];
+		to = (struct timeout *)items[i];
+		timeout_move_next_run(to, diff_usecs);
+	}
 
-		if (diff_usecs > 0)
-			timeval_add_usecs(&to->next_run, diff_usecs);
-		else
-			timeval_sub_usecs(&to->next_run, -diff_usecs);
+	/* The timer wheel is relative to its current time, so it needs to
+	   be rebuilt. */
+	count = timer_wheel_count(ioloop->timeouts_wheel);
+	if (count == 0) {
+		timer_wheel_set_time(ioloop->timeouts_wheel,
+			timeout_next_run_msecs(&ioloop_timeval));
+		return;
 	}
+	t_array_init(&wheel_timeouts, count);
+	while ((wheel_item = timer_wheel_pop(ioloop->timeouts_wheel)) != NULL) {
+		to = container_of(wheel_item, struct timeout, wheel_item);
+		timeout_move_next_run(to, diff_usecs);
+		array_push_back(&wheel_timeouts, &to);
+	}
+	timer_wheel_set_time(ioloop->timeouts_wheel,
+			     timeout_next_run_msecs(&ioloop_timeval));
+	array_foreach_elem(&wheel_timeouts, to)
+		timeout_queue_add(to);
 }
 
 static void io_loops_timeouts_update(long long diff_usecs)
@@ -635,12 +739,31 @@ static void ioloop_add_wait_time(struct ioloop *ioloop)
 		timer->usecs += diff;
 }
 
+static void timeout_call(struct ioloop *ioloop, struct timeout *timeout)
+{
+	data_stack_frame_t t_id;
+
+	if (timeout->ctx != NULL)
+		io_loop_context_activate(timeout->ctx);
+	t_id = t_push_named("ioloop timeout handler %p",
+			    (void *)timeout->callback);
+	timeout->callback(timeout->context);
+	if (!t_pop(&t_id)) {
+		i_panic("Leaked a t_pop() call in timeout handler %p",
+			(void *)timeout->callback);
+	}
+	if (ioloop->cur_ctx != NULL)
+		io_loop_context_deactivate(ioloop->cur_ctx);
+	i_assert(ioloop == current_ioloop);
+}
+
 static void io_loop_handle_timeouts_real(struct ioloop *ioloop)
 {
 	struct priorityq_item *item;
+	struct timer_wheel_item *wheel_item;
 	struct timeval tv_old, tv, tv_call;
 	long long diff_usecs;
-	data_stack_frame_t t_id;
+	uint64_t now_msecs;
 
 	tv_old = ioloop_timeval;
 	i_gettimeofday(&ioloop_timeval);
@@ -675,7 +798,8 @@ static void io_loop_handle_timeouts_real(struct ioloop *ioloop)
 
 		/* use tv_call to make sure we don't get to infinite loop in
 		   case callbacks update ioloop_timeval. */
-		if (timeout_get_wait_time(timeout, &tv, &tv_call, TRUE) > 0)
+		if (timeout_get_wait_time(&timeout->next_run, &tv,
+					  &tv_call, TRUE) > 0)
 			break;
 
 		if (timeout->one_shot) {
@@ -685,19 +809,21 @@ static void io_loop_handle_timeouts_real(struct ioloop *ioloop)
 			/* update timeout's next_run and reposition it in the queue */
 			timeout_reset_timeval(timeout, &tv_call);
 		}
+		timeout_call(ioloop, timeout);
+	}
 
-		if (timeout->ctx != NULL)
-			io_loop_context_activate(timeout->ctx);
-		t_id = t_push_named("ioloop timeout handler %p",
-				    (void *)timeout->callback);
-		timeout->callback(timeout->context);
-		if (!t_pop(&t_id)) {
-			i_panic("Leaked a t_pop() call in timeout handler %p",
-				(void *)timeout->callback);
-		}
-		if (ioloop->cur_ctx != NULL)
-			io_loop_context_deactivate(ioloop->cur_ctx);
-		i_assert(ioloop == current_ioloop);
+	now_msecs = timeval_to_usecs(&tv_call) / 1000;
+	while (ioloop->running &&
+	       (wheel_item = timer_wheel_pop_expired(ioloop->timeouts_wheel,
+						     now_msecs)) != NULL) {
+		struct timeout *timeout =
+			container_of(wheel_item, struct timeout, wheel_item);
+
+		/* wheel timeouts are never 0 ms, so tv_call can't cause an
+		   infinite loop */
+		timeout_update_next(timeout, &tv_call);
+		timeout_queue_add(timeout);
+		timeout_call(ioloop, timeout);
 	}
 }
 
@@ -841,7 +967,11 @@ struct ioloop *io_loop_create(void)
 
         ioloop = i_new(struct ioloop, 1);
 	ioloop->timeouts = priorityq_init(timeout_cmp, 32);
+	ioloop->timeouts_wheel =
+		timer_wheel_init(IOLOOP_TIMEOUT_WHEEL_TICK_MSECS,
+				 timeout_next_run_msecs(&ioloop_timeval));
 	i_array_init(&ioloop->timeouts_new, 8);
+	ioloop->timeout_pool = pool_slab_create("ioloop timeouts");
 
 	ioloop->time_moved_callback = current_ioloop != NULL ?
 		current_ioloop->time_moved_callback :
@@ -857,6 +987,7 @@ void io_loop_destroy(struct ioloop **_ioloop)
 	struct ioloop *ioloop = *_ioloop;
 	struct timeout *to;
 	struct priorityq_item *item;
+	struct timer_wheel_item *wheel_item;
 	bool leaks = FALSE;
 
 	*_ioloop = NULL;
@@ -924,6 +1055,24 @@ void io_loop_destroy(struct ioloop **_ioloop)
 	}
 	priorityq_deinit(&ioloop->timeouts);
 
+	while ((wheel_item = timer_wheel_pop(ioloop->timeouts_wheel)) != NULL) {
+		struct timeout *to =
+			container_of(wheel_item, struct timeout, wheel_item);
+		const char *error = t_strdup_printf(
+			"Timeout leak: %p (%s:%u)", (void *)to->callback,
+			to->source_filename,
+			to->source_linenum);
+
+		if (panic_on_leak)
+			i_panic("%s", error);
+		else
+			i_warning("%s", error);
+		timeout_free(to);
+		leaks = TRUE;
+	}
+	timer_wheel_deinit(&ioloop->timeouts_wheel);
+	pool_unref(&ioloop->timeout_pool);
+
 	while (ioloop->wait_timers != NULL) {
 		struct io_wait_timer *timer = ioloop->wait_timers;
 		const char *error = t_strdup_printf(
@@ -1303,6 +1452,7 @@ bool io_loop_is_empty(struct ioloop *ioloop)
 {
 	return ioloop->io_files == NULL &&
 		priorityq_count(ioloop->timeouts) == 0 &&
+		timer_wheel_count(ioloop->timeouts_wheel) == 0 &&
 		array_count(&ioloop->timeouts_new) == 0;
 }
 
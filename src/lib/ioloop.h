@@ -115,7 +115,8 @@ bool io_is_pending(struct io *io);
    crash to indicate that there's a bug. */
 void io_set_never_wait_alone(struct io *io, bool set);
 
-/* Timeout handlers */
+/* Timeout handlers. Timeouts of 1 second or longer may be called up to
+   10 milliseconds later than requested. */
 struct timeout *
 timeout_add(unsigned int msecs, const char *source_filename,
 	    unsigned int source_linenum,
@@ -30,9 +30,43 @@ struct temp_ostream {
 	uoff_t fd_size;
 };
 
+/* Memory used by all the temp iostream buffers in this process, including
+   the buffers of the finished istreams. */
+static size_t iostream_temp_total_mem_size = 0;
+static size_t iostream_temp_max_total_mem_size = 0;
+
 static bool o_stream_temp_dup_cancel(struct temp_ostream *tstream,
 				     enum ostream_send_istream_result *res_r);
 
+static void iostream_temp_buf_free(buffer_t **_buf)
+{
+	buffer_t *buf = *_buf;
+
+	if (buf == NULL)
+		return;
+	i_assert(iostream_temp_total_mem_size >= buf->used);
+	iostream_temp_total_mem_size -= buf->used;
+	buffer_free(_buf);
+}
+
+static void
+o_stream_temp_buf_append(struct temp_ostream *tstream,
+			 const void *data, size_t size)
+{
+	buffer_append(tstream->buf, data, size);
+	iostream_temp_total_mem_size += size;
+}
+
+static bool
+o_stream_temp_mem_exceeded(struct temp_ostream *tstream, size_t size)
+{
+	if (tstream->buf->used + size > tstream->max_mem_size)
+		return TRUE;
+	return iostream_temp_max_total_mem_size != 0 &&
+		iostream_temp_total_mem_size + size >
+		iostream_temp_max_total_mem_size;
+}
+
 static void
 o_stream_temp_close(struct iostream_private *stream,
 		    bool close_parent ATTR_UNUSED)
@@ -41,7 +75,7 @@ o_stream_temp_close(struct iostream_private *stream,
 		container_of(stream, struct temp_ostream, ostream.iostream);
 
 	i_close_fd(&tstream->fd);
-	buffer_free(&tstream->buf);
+	iostream_temp_buf_free(&tstream->buf);
 	i_free(tstream->temp_path_prefix);
 	i_free(tstream->name);
 }
@@ -56,15 +90,11 @@ static int o_stream_temp_move_to_fd(struct temp_ostream *tstream)
 
 	path = t_str_new(128);
 	str_append(path, tstream->temp_path_prefix);
-	tstream->fd = safe_mkstemp_hostpid(path, 0600, (uid_t)-1, (gid_t)-1);
+	tstream->fd = safe_mkstemp_tmpfile(path, 0600);
 	if (tstream->fd == -1) {
 		i_error("safe_mkstemp(%s) failed: %m", str_c(path));
 		return -1;
 	}
-	if (i_unlink(str_c(path)) < 0) {
-		i_close_fd(&tstream->fd);
-		return -1;
-	}
 	if (write_full(tstream->fd, tstream->buf->data, tstream->buf->used) < 0) {
 		i_error("write(%s) failed: %m", str_c(path));
 		i_close_fd(&tstream->fd);
@@ -74,7 +104,7 @@ static int o_stream_temp_move_to_fd(struct temp_ostream *tstream)
 	   e.g. for unit tests */
 	tstream->ostream.fd = tstream->fd;
 	tstream->fd_size = tstream->buf->used;
-	buffer_free(&tstream->buf);
+	iostream_temp_buf_free(&tstream->buf);
 	return 0;
 }
 
@@ -92,7 +122,7 @@ int o_stream_temp_move_to_memory(struct ostream *output)
 	       (ret = pread(tstream->fd, buf, sizeof(buf), offset)) > 0) {
 		if ((size_t)ret > tstream->ostream.ostream.offset - offset)
 			ret = tstream->ostream.ostream.offset - offset;
-		buffer_append(tstream->buf, buf, ret);
+		o_stream_temp_buf_append(tstream, buf, ret);
 		offset += ret;
 	}
 	if (ret < 0) {
@@ -123,7 +153,8 @@ o_stream_temp_fd_sendv(struct temp_ostream *tstream,
 			if (o_stream_temp_move_to_memory(&tstream->ostream.ostream) < 0)
 				return -1;
 			for (; i < iov_count; i++) {
-				buffer_append(tstream->buf, iov[i].iov_base, iov[i].iov_len);
+				o_stream_temp_buf_append(tstream, iov[i].iov_base,
+							 iov[i].iov_len);
 				bytes += iov[i].iov_len;
 				tstream->ostream.ostream.offset += iov[i].iov_len;
 			}
@@ -158,7 +189,7 @@ o_stream_temp_sendv(struct ostream_private *stream,
 		return o_stream_temp_fd_sendv(tstream, iov, iov_count);
 
 	for (i = 0; i < iov_count; i++) {
-		if (tstream->buf->used + iov[i].iov_len > tstream->max_mem_size) {
+		if (o_stream_temp_mem_exceeded(tstream, iov[i].iov_len)) {
 			if (o_stream_temp_move_to_fd(tstream) == 0) {
 				i_assert(tstream->fd != -1);
 				return o_stream_temp_fd_sendv(tstream, iov+i,
@@ -166,7 +197,8 @@ o_stream_temp_sendv(struct ostream_private *stream,
 			}
 			/* failed to move to temp fd, just keep it in memory */
 		}
-		buffer_append(tstream->buf, iov[i].iov_base, iov[i].iov_len);
+		o_stream_temp_buf_append(tstream, iov[i].iov_base,
+					 iov[i].iov_len);
 		ret += iov[i].iov_len;
 		stream->ostream.offset += iov[i].iov_len;
 	}
@@ -272,8 +304,11 @@ o_stream_temp_write_at(struct ostream_private *stream,
 		container_of(stream, struct temp_ostream, ostream);
 
 	if (tstream->fd == -1) {
+		size_t old_used = tstream->buf->used;
+
 		i_assert(stream->ostream.offset == tstream->buf->used);
 		buffer_write(tstream->buf, offset, data, size);
+		iostream_temp_total_mem_size += tstream->buf->used - old_used;
 		stream->ostream.offset = tstream->buf->used;
 	} else {
 		if (pwrite_full(tstream->fd, data, size, offset) < 0) {
@@ -342,7 +377,7 @@ struct ostream *iostream_temp_create_sized(const char *temp_path_prefix,
 
 static void iostream_temp_buf_destroyed(buffer_t *buf)
 {
-	buffer_free(&buf);
+	iostream_temp_buf_free(&buf);
 }
 
 struct istream *iostream_temp_finish(struct ostream **output,
@@ -402,3 +437,8 @@ struct istream *iostream_temp_finish(struct ostream **output,
 	o_stream_destroy(output);
 	return input;
 }
+
+void iostream_temp_set_max_total_mem_size(size_t max_size)
+{
+	iostream_temp_max_total_mem_size = max_size;
+}
@@ -25,6 +25,12 @@ struct ostream *iostream_temp_create_sized(const char *temp_path_prefix,
 struct istream *iostream_temp_finish(struct ostream **output,
 				     size_t max_buffer_size);
 
+/* Limit the total memory used by all the temp iostream buffers in this
+   process. A stream is moved to a temp file when writing to it would exceed
+   the limit, even if it's still below its own max_mem_size. 0 = unlimited
+   (default). */
+void iostream_temp_set_max_total_mem_size(size_t max_size);
+
 /* For internal testing: */
 int o_stream_temp_move_to_memory(struct ostream *output);
 
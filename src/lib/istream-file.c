@@ -12,6 +12,8 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 
+static uint64_t file_istream_total_read_bytes = 0;
+
 void i_stream_file_close(struct iostream_private *stream,
 			 bool close_parent ATTR_UNUSED)
 {
@@ -123,11 +125,18 @@ ssize_t i_stream_file_read(struct istream_private *stream)
 	}
 
 	stream->pos += ret;
+	if (fstream->file)
+		file_istream_total_read_bytes += ret;
 	i_assert(ret != 0 || !fstream->file);
 	i_assert(ret != -1);
 	return ret;
 }
 
+uint64_t i_stream_file_get_total_read_bytes(void)
+{
+	return file_istream_total_read_bytes;
+}
+
 static void i_stream_file_seek(struct istream_private *stream, uoff_t v_offset,
 			       bool mark ATTR_UNUSED)
 {
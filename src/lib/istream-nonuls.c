@@ -30,7 +30,8 @@ static ssize_t i_stream_nonuls_read(struct istream_private *stream)
 {
 	struct nonuls_istream *nstream = (struct nonuls_istream *)stream;
 	const unsigned char *data, *p;
-	size_t i, size, avail_size;
+	unsigned char *dest;
+	size_t i, size, avail_size, copy_len;
 	int ret;
 
 	if ((ret = i_stream_read_parent(stream)) <= 0)
@@ -43,17 +44,15 @@ static ssize_t i_stream_nonuls_read(struct istream_private *stream)
 		size = avail_size;
 	i_assert(size > 0);
 
-	p = memchr(data, '\0', size);
-	if (p == NULL) {
-		/* no NULs in this block */
-		memcpy(stream->w_buffer+stream->pos, data, size);
-	} else {
-		i = p-data;
-		memcpy(stream->w_buffer+stream->pos, data, i);
-		for (; i < size; i++) {
-			stream->w_buffer[stream->pos+i] = data[i] == '\0' ?
-				nstream->replace_chr : data[i];
-		}
+	dest = stream->w_buffer + stream->pos;
+	for (i = 0; i < size; ) {
+		/* copy everything until the next NUL */
+		p = memchr(data + i, '\0', size - i);
+		copy_len = p == NULL ? size - i : (size_t)(p - (data + i));
+		memcpy(dest + i, data + i, copy_len);
+		i += copy_len;
+		if (i < size)
+			dest[i++] = nstream->replace_chr;
 	}
 	stream->pos += size;
 	i_stream_skip(stream->parent, size);
@@ -44,6 +44,9 @@ struct istream *i_stream_create_fd_autoclose(int *fd, size_t max_buffer_size);
 /* Open the given path only when something is actually tried to be read from
    the stream. */
 struct istream *i_stream_create_file(const char *path, size_t max_buffer_size);
+/* Returns the number of bytes read from regular files by all file istreams
+   in this process. Pipes and sockets aren't counted. */
+uint64_t i_stream_file_get_total_read_bytes(void);
 /* Create an input stream using the provided data block. That data block must
 remain allocated during the full lifetime of the stream. */
 struct istream *i_stream_create_from_data(const void *data, size_t size);
@@ -106,6 +106,14 @@ void event_unregister_callback(event_callback_t *callback);
 void event_category_register_callback(event_category_callback_t *callback);
 void event_category_unregister_callback(event_category_callback_t *callback);
 
+/* Set the categories that the global event filters may match. Events
+   having these categories or their child categories are interesting.
+   names=NULL clears the interest. */
+void event_categories_set_interest(const char *const *names);
+/* Returns TRUE if the event, its parents or the global event have any
+   category with interest set. */
+bool event_has_category_interest(struct event *event);
+
 static inline void event_recalculate_debug_level(struct event *event)
 {
 	event->debug_level_checked_filter_counter =
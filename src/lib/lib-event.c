@@ -56,6 +56,8 @@ struct event_internal_category {
 	struct event_internal_category *parent;
 	char *name;
 	int refcount;
+	/* Global event filters may match events with this category */
+	bool interest;
 };
 
 struct event_reason {
@@ -70,6 +72,9 @@ static struct event *event_last_passthrough = NULL;
 static ARRAY(event_callback_t *) event_handlers;
 static ARRAY(event_category_callback_t *) event_category_callbacks;
 static ARRAY(struct event_internal_category *) event_registered_categories_internal;
+/* Names of the categories that have interest set, including ones that
+   haven't been registered yet. */
+static const char **event_category_interest_names = NULL;
 static ARRAY(struct event_category *) event_registered_categories_representative;
 static ARRAY(struct event *) global_event_stack;
 static uint64_t event_id_counter = 0;
@@ -805,6 +810,57 @@ event_category_find_internal(const char *name)
 	return NULL;
 }
 
+void event_categories_set_interest(const char *const *names)
+{
+	struct event_internal_category *internal;
+
+	i_free(event_category_interest_names);
+	if (names != NULL && names[0] != NULL)
+		event_category_interest_names =
+			p_strarray_dup(default_pool, names);
+
+	array_foreach_elem(&event_registered_categories_internal, internal) {
+		internal->interest = event_category_interest_names != NULL &&
+			str_array_find(event_category_interest_names,
+				       internal->name);
+	}
+}
+
+static bool event_has_category_interest_nonrecursive(struct event *event)
+{
+	struct event_internal_category *internal;
+	struct event_category *cat;
+
+	if (!array_is_created(&event->categories))
+		return FALSE;
+	array_foreach_elem(&event->categories, cat) {
+		/* filters for a category match also its child categories */
+		for (internal = cat->internal; internal != NULL;
+		     internal = internal->parent) {
+			if (internal->interest)
+				return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+bool event_has_category_interest(struct event *event)
+{
+	if (event_category_interest_names == NULL)
+		return FALSE;
+
+	for (; event != NULL; event = event->parent) {
+		if (event_has_category_interest_nonrecursive(event))
+			return TRUE;
+	}
+	/* check also the global event and its parents */
+	for (event = event_get_global(); event != NULL; event = event->parent) {
+		if (event_has_category_interest_nonrecursive(event))
+			return TRUE;
+	}
+	return FALSE;
+}
+
 struct event_category *const *
 event_get_registered_categories(unsigned int *count_r)
 {
@@ -852,6 +908,9 @@ event_category_register(struct event_category *category)
 			internal->parent = category->parent->internal;
 		internal->name = i_strdup(category->name);
 		internal->refcount = 1;
+		internal->interest = event_category_interest_names != NULL &&
+			str_array_find(event_category_interest_names,
+				       internal->name);
 		internal->representative.name = internal->name;
 		internal->representative.parent = category->parent;
 		internal->representative.internal = internal;
@@ -1826,6 +1885,7 @@ void lib_event_deinit(void)
 			  event, event->parent,
 			  event->source_filename, event->source_linenum);
 	}
+	i_free(event_category_interest_names);
 	/* categories cannot be unregistered, so just free them here */
 	array_foreach_elem(&event_registered_categories_internal, internal) {
 		i_free(internal->name);
@@ -0,0 +1,476 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+/* @UNSAFE: whole file */
+#include "lib.h"
+#include "mempool.h"
+#include "llist.h"
+
+/*
+ * Slab pools are meant for fixed-size objects that are allocated and freed
+ * constantly.
+ *
+ * Implementation
+ * ==============
+ *
+ * Allocations are divided into size classes, each 16 bytes larger than the
+ * previous. Each size class allocates its memory as slabs containing
+ * multiple chunks of the class's size. Freed chunks are placed into the
+ * class's free list, and they are reused by the following allocations in the
+ * same class. The memory is returned to the system only when the pool is
+ * cleared or destroyed.
+ *
+ * Each chunk is preceded by a small header that contains the chunk's size
+ * class, so p_free() can find the right free list.
+ *
+ *                 +------------+ next  +------------+ next
+ *     slabs ----->|    slab    |------>|    slab    |------>...---> NULL
+ *                 +------------+       +------------+
+ *                 |   header   |       |   header   |
+ *                 |   chunk    |       |   chunk    |
+ *                 |   header   |       |   header   |
+ *                 |   chunk    |       |   chunk    |
+ *                       .                    .
+ *
+ * The first slab in a size class contains POOL_SLAB_MIN_CHUNKS chunks. Each
+ * following slab is twice as large as the previous one, until the slab size
+ * reaches POOL_SLAB_MAX_SIZE.
+ *
+ * Allocations larger than the largest size class are allocated directly with
+ * calloc() and kept in a linked list, similarly to allocfree pools.
+ *
+ * Reallocation
+ * ------------
+ *
+ * If the new size still fits into the chunk's size class, the same chunk is
+ * returned. Otherwise a new chunk is allocated, the data is copied to it and
+ * the old chunk is freed.
+ */
+
+#define POOL_SLAB_CLASS_SHIFT 4
+#define POOL_SLAB_CLASS_COUNT 32
+#define POOL_SLAB_CLASS_SIZE(idx) (((size_t)(idx) + 1) << POOL_SLAB_CLASS_SHIFT)
+#define POOL_SLAB_MAX_CLASS_SIZE POOL_SLAB_CLASS_SIZE(POOL_SLAB_CLASS_COUNT - 1)
+#define POOL_SLAB_LARGE_CLASS POOL_SLAB_CLASS_COUNT
+
+#define POOL_SLAB_MIN_CHUNKS 8
+#define POOL_SLAB_MAX_SIZE (16*1024)
+
+#define POOL_SLAB_MAGIC 0x51ab51abU
+#define POOL_SLAB_MAGIC_FREED 0xdeadf5eeU
+
+struct pool_slab_chunk {
+	uint32_t class_idx;
+	uint32_t magic;
+};
+
+struct pool_slab_free_chunk {
+	struct pool_slab_free_chunk *next;
+};
+
+struct pool_slab {
+	struct pool_slab *next;
+	size_t size;
+};
+
+struct pool_slab_large {
+	struct pool_slab_large *prev, *next;
+	size_t size;
+};
+
+struct pool_slab_class {
+	struct pool_slab_free_chunk *free_list;
+	unsigned int next_slab_chunk_count;
+	struct pool_slab_class_stats stats;
+};
+
+struct slab_pool {
+	struct pool pool;
+	int refcount;
+
+	struct pool_slab *slabs;
+	struct pool_slab_large *large;
+	size_t total_slab_size;
+	size_t total_large_size;
+
+	struct pool_slab_class classes[POOL_SLAB_CLASS_COUNT];
+	struct pool_slab_class_stats large_stats;
+#ifdef DEBUG
+	char *name;
+#endif
+};
+
+#define SIZEOF_SLAB_POOL MEM_ALIGN(sizeof(struct slab_pool))
+#define SIZEOF_POOL_SLAB MEM_ALIGN(sizeof(struct pool_slab))
+#define SIZEOF_POOL_SLAB_LARGE MEM_ALIGN(sizeof(struct pool_slab_large))
+#define SIZEOF_POOL_SLAB_CHUNK MEM_ALIGN(sizeof(struct pool_slab_chunk))
+#define POOL_SLAB_CHUNK_STRIDE(idx) \
+	(SIZEOF_POOL_SLAB_CHUNK + POOL_SLAB_CLASS_SIZE(idx))
+
+static const char *pool_slab_get_name(pool_t pool);
+static void pool_slab_ref(pool_t pool);
+static void pool_slab_unref(pool_t *pool);
+static void *pool_slab_malloc(pool_t pool, size_t size);
+static void pool_slab_free(pool_t pool, void *mem);
+static void *pool_slab_realloc(pool_t pool, void *mem,
+			       size_t old_size, size_t new_size);
+static void pool_slab_clear(pool_t pool);
+static size_t pool_slab_get_max_easy_alloc_size(pool_t pool);
+
+static const struct pool_vfuncs static_slab_pool_vfuncs = {
+	pool_slab_get_name,
+
+	pool_slab_ref,
+	pool_slab_unref,
+
+	pool_slab_malloc,
+	pool_slab_free,
+
+	pool_slab_realloc,
+
+	pool_slab_clear,
+	pool_slab_get_max_easy_alloc_size
+};
+
+static const struct pool static_slab_pool = {
+	.v = &static_slab_pool_vfuncs,
+
+	.alloconly_pool = FALSE,
+	.datastack_pool = FALSE
+};
+
+static void pool_slab_classes_init(struct slab_pool *spool)
+{
+	unsigned int i;
+
+	for (i = 0; i < POOL_SLAB_CLASS_COUNT; i++) {
+		spool->classes[i].next_slab_chunk_count = POOL_SLAB_MIN_CHUNKS;
+		spool->classes[i].stats.size = POOL_SLAB_CLASS_SIZE(i);
+	}
+}
+
+pool_t pool_slab_create(const char *name ATTR_UNUSED)
+{
+	struct slab_pool *spool;
+
+	(void)COMPILE_ERROR_IF_TRUE(sizeof(struct pool_slab_free_chunk) >
+				    POOL_SLAB_CLASS_SIZE(0));
+
+	spool = calloc(1, SIZEOF_SLAB_POOL);
+	if (spool == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "calloc(1, %zu): Out of memory",
+			       SIZEOF_SLAB_POOL);
+#ifdef DEBUG
+	spool->name = strdup(name);
+#endif
+	spool->pool = static_slab_pool;
+	spool->refcount = 1;
+	pool_slab_classes_init(spool);
+	return &spool->pool;
+}
+
+static void pool_slab_destroy(struct slab_pool *spool)
+{
+	pool_slab_clear(&spool->pool);
+#ifdef DEBUG
+	free(spool->name);
+#endif
+	free(spool);
+}
+
+static const char *pool_slab_get_name(pool_t pool ATTR_UNUSED)
+{
+#ifdef DEBUG
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	return spool->name;
+#else
+	return "slab";
+#endif
+}
+
+static void pool_slab_ref(pool_t pool)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	i_assert(spool->refcount > 0);
+
+	spool->refcount++;
+}
+
+static void pool_slab_unref(pool_t *_pool)
+{
+	pool_t pool = *_pool;
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	i_assert(spool->refcount > 0);
+
+	/* erase the pointer before freeing anything, as the pointer may
+	   exist inside the pool's memory area */
+	*_pool = NULL;
+
+	if (--spool->refcount > 0)
+		return;
+
+	pool_slab_destroy(spool);
+}
+
+static void *
+pool_slab_chunk_init(struct pool_slab_chunk *chunk, unsigned int class_idx)
+{
+	chunk->class_idx = class_idx;
+	chunk->magic = POOL_SLAB_MAGIC;
+	return PTR_OFFSET(chunk, SIZEOF_POOL_SLAB_CHUNK);
+}
+
+static struct pool_slab_chunk *pool_slab_mem_get_chunk(void *mem)
+{
+	struct pool_slab_chunk *chunk;
+
+	/* cannot use PTR_OFFSET because of negative value */
+	i_assert((uintptr_t)mem >= SIZEOF_POOL_SLAB_CHUNK);
+	chunk = (struct pool_slab_chunk *)
+		((unsigned char *)mem - SIZEOF_POOL_SLAB_CHUNK);
+	i_assert(chunk->magic == POOL_SLAB_MAGIC);
+	i_assert(chunk->class_idx <= POOL_SLAB_LARGE_CLASS);
+	return chunk;
+}
+
+static void
+pool_slab_class_grow(struct slab_pool *spool, unsigned int class_idx)
+{
+	struct pool_slab_class *class = &spool->classes[class_idx];
+	struct pool_slab_free_chunk *free_chunk;
+	struct pool_slab *slab;
+	unsigned char *p;
+	size_t size, stride = POOL_SLAB_CHUNK_STRIDE(class_idx);
+	unsigned int i, count = class->next_slab_chunk_count;
+
+	size = SIZEOF_POOL_SLAB + stride * count;
+	slab = calloc(1, size);
+	if (slab == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "calloc(1, %zu): Out of memory",
+			       size);
+	slab->size = size;
+	slab->next = spool->slabs;
+	spool->slabs = slab;
+	spool->total_slab_size += size;
+
+	/* add the chunks to the free list in memory order */
+	p = PTR_OFFSET(slab, SIZEOF_POOL_SLAB + stride * count);
+	for (i = 0; i < count; i++) {
+		p -= stride;
+		free_chunk = PTR_OFFSET(p, SIZEOF_POOL_SLAB_CHUNK);
+		free_chunk->next = class->free_list;
+		class->free_list = free_chunk;
+	}
+	class->stats.free_count += count;
+
+	if (SIZEOF_POOL_SLAB + stride * count * 2 <= POOL_SLAB_MAX_SIZE)
+		class->next_slab_chunk_count = count * 2;
+}
+
+static void *pool_slab_malloc_large(struct slab_pool *spool, size_t size)
+{
+	struct pool_slab_large *large;
+	size_t alloc_size;
+
+	alloc_size = MALLOC_ADD(SIZEOF_POOL_SLAB_LARGE + SIZEOF_POOL_SLAB_CHUNK,
+				size);
+	large = calloc(1, alloc_size);
+	if (large == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "calloc(1, %zu): Out of memory",
+			       alloc_size);
+	large->size = size;
+	DLLIST_PREPEND(&spool->large, large);
+	spool->total_large_size += size;
+
+	spool->large_stats.used_count++;
+	spool->large_stats.alloc_count++;
+	return pool_slab_chunk_init(PTR_OFFSET(large, SIZEOF_POOL_SLAB_LARGE),
+				    POOL_SLAB_LARGE_CLASS);
+}
+
+static struct pool_slab_large *
+pool_slab_chunk_get_large(struct pool_slab_chunk *chunk)
+{
+	i_assert(chunk->class_idx == POOL_SLAB_LARGE_CLASS);
+	/* cannot use PTR_OFFSET because of negative value */
+	return (struct pool_slab_large *)
+		((unsigned char *)chunk - SIZEOF_POOL_SLAB_LARGE);
+}
+
+static void *pool_slab_malloc(pool_t pool, size_t size)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct pool_slab_class *class;
+	struct pool_slab_free_chunk *free_chunk;
+	unsigned int class_idx;
+
+	if (size > POOL_SLAB_MAX_CLASS_SIZE)
+		return pool_slab_malloc_large(spool, size);
+
+	class_idx = (size - 1) >> POOL_SLAB_CLASS_SHIFT;
+	class = &spool->classes[class_idx];
+	if (class->free_list == NULL)
+		pool_slab_class_grow(spool, class_idx);
+
+	free_chunk = class->free_list;
+	class->free_list = free_chunk->next;
+	/* reused chunks contain the old data */
+	memset(free_chunk, 0, POOL_SLAB_CLASS_SIZE(class_idx));
+
+	i_assert(class->stats.free_count > 0);
+	class->stats.free_count--;
+	class->stats.used_count++;
+	class->stats.alloc_count++;
+	/* cannot use PTR_OFFSET because of negative value */
+	return pool_slab_chunk_init((struct pool_slab_chunk *)
+		((unsigned char *)free_chunk - SIZEOF_POOL_SLAB_CHUNK),
+		class_idx);
+}
+
+static void
+pool_slab_free_large(struct slab_pool *spool, struct pool_slab_chunk *chunk)
+{
+	struct pool_slab_large *large = pool_slab_chunk_get_large(chunk);
+
+	i_assert(spool->large_stats.used_count > 0);
+	DLLIST_REMOVE(&spool->large, large);
+	spool->large_stats.used_count--;
+	spool->total_large_size -= large->size;
+	free(large);
+}
+
+static void pool_slab_free(pool_t pool, void *mem)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct pool_slab_chunk *chunk = pool_slab_mem_get_chunk(mem);
+	struct pool_slab_class *class;
+	struct pool_slab_free_chunk *free_chunk = mem;
+
+	if (chunk->class_idx == POOL_SLAB_LARGE_CLASS) {
+		pool_slab_free_large(spool, chunk);
+		return;
+	}
+
+	/* catch double-frees */
+	chunk->magic = POOL_SLAB_MAGIC_FREED;
+
+	class = &spool->classes[chunk->class_idx];
+	i_assert(class->stats.used_count > 0);
+	class->stats.used_count--;
+	class->stats.free_count++;
+
+	free_chunk->next = class->free_list;
+	class->free_list = free_chunk;
+}
+
+static void *pool_slab_realloc(pool_t pool, void *mem,
+			       size_t old_size, size_t new_size)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct pool_slab_chunk *chunk = pool_slab_mem_get_chunk(mem);
+	struct pool_slab_large *large;
+	size_t alloc_size;
+	void *new_mem;
+
+	if (chunk->class_idx != POOL_SLAB_LARGE_CLASS) {
+		i_assert(old_size <= POOL_SLAB_CLASS_SIZE(chunk->class_idx));
+		if (new_size <= POOL_SLAB_CLASS_SIZE(chunk->class_idx)) {
+			/* fits into the same chunk */
+			if (new_size > old_size) {
+				memset(PTR_OFFSET(mem, old_size), 0,
+				       new_size - old_size);
+			}
+			return mem;
+		}
+		new_mem = pool_slab_malloc(pool, new_size);
+		memcpy(new_mem, mem, old_size);
+		pool_slab_free(pool, mem);
+		return new_mem;
+	}
+
+	large = pool_slab_chunk_get_large(chunk);
+	DLLIST_REMOVE(&spool->large, large);
+	alloc_size = MALLOC_ADD(SIZEOF_POOL_SLAB_LARGE + SIZEOF_POOL_SLAB_CHUNK,
+				new_size);
+	if ((large = realloc(large, alloc_size)) == NULL)
+		i_fatal_status(FATAL_OUTOFMEM, "realloc(block, %zu)",
+			       alloc_size);
+	DLLIST_PREPEND(&spool->large, large);
+	spool->total_large_size += new_size - large->size;
+	large->size = new_size;
+
+	new_mem = PTR_OFFSET(large, SIZEOF_POOL_SLAB_LARGE +
+			     SIZEOF_POOL_SLAB_CHUNK);
+	/* zero out new memory */
+	if (new_size > old_size)
+		memset(PTR_OFFSET(new_mem, old_size), 0, new_size - old_size);
+	return new_mem;
+}
+
+static void pool_slab_clear(pool_t pool)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	struct pool_slab *slab, *next_slab;
+	struct pool_slab_large *large, *next_large;
+
+	for (slab = spool->slabs; slab != NULL; slab = next_slab) {
+		next_slab = slab->next;
+		free(slab);
+	}
+	for (large = spool->large; large != NULL; large = next_large) {
+		next_large = large->next;
+		free(large);
+	}
+	spool->slabs = NULL;
+	spool->large = NULL;
+	spool->total_slab_size = 0;
+	spool->total_large_size = 0;
+
+	i_zero(&spool->classes);
+	i_zero(&spool->large_stats);
+	pool_slab_classes_init(spool);
+}
+
+static size_t pool_slab_get_max_easy_alloc_size(pool_t pool ATTR_UNUSED)
+{
+	return 0;
+}
+
+unsigned int pool_slab_get_class_count(void)
+{
+	return POOL_SLAB_CLASS_COUNT + 1;
+}
+
+void pool_slab_get_class_stats(pool_t pool, unsigned int class_idx,
+			       struct pool_slab_class_stats *stats_r)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+
+	i_assert(class_idx <= POOL_SLAB_LARGE_CLASS);
+	if (class_idx == POOL_SLAB_LARGE_CLASS)
+		*stats_r = spool->large_stats;
+	else
+		*stats_r = spool->classes[class_idx].stats;
+}
+
+size_t pool_slab_get_total_used_size(pool_t pool)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+	size_t size = spool->total_large_size;
+	unsigned int i;
+
+	for (i = 0; i < POOL_SLAB_CLASS_COUNT; i++) {
+		size += spool->classes[i].stats.used_count *
+			POOL_SLAB_CLASS_SIZE(i);
+	}
+	return size;
+}
+
+size_t pool_slab_get_total_alloc_size(pool_t pool)
+{
+	struct slab_pool *spool = container_of(pool, struct slab_pool, pool);
+
+	return SIZEOF_SLAB_POOL + spool->total_slab_size +
+		spool->total_large_size +
+		(SIZEOF_POOL_SLAB_LARGE + SIZEOF_POOL_SLAB_CHUNK) *
+		spool->large_stats.used_count;
+}
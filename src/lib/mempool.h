@@ -81,6 +81,13 @@ pool_t pool_allocfree_create(const char *name);
    See pool_alloconly_create_clean. */
 pool_t pool_allocfree_create_clean(const char *name);
 
+/* Create a new slab pool. It's meant for fixed-size objects that are
+   frequently allocated and freed. Allocations are rounded up to size classes
+   and freed memory is kept in per-class free lists for reuse. The memory is
+   returned to the system only when the pool is cleared or destroyed, so this
+   shouldn't be used for allocations whose sizes vary a lot. */
+pool_t pool_slab_create(const char *name);
+
 /* Similar to nearest_power(), but try not to exceed buffer's easy
    allocation size. If you don't have any explicit minimum size, use
    old_size + 1. */
@@ -173,6 +180,31 @@ size_t pool_allocfree_get_total_used_size(pool_t pool);
 /* Returns how much system memory has been allocated for this pool. */
 size_t pool_allocfree_get_total_alloc_size(pool_t pool);
 
+/* These functions are only for pools created with pool_slab_create(): */
+
+struct pool_slab_class_stats {
+	/* Maximum allocation size in this class. 0 for the last class, which
+	   contains all the allocations larger than the other classes. */
+	size_t size;
+	/* Number of currently allocated chunks */
+	unsigned int used_count;
+	/* Number of freed chunks that are waiting to be reused */
+	unsigned int free_count;
+	/* Total number of allocations done in this class */
+	uint64_t alloc_count;
+};
+
+/* Returns the number of size classes in slab pools. */
+unsigned int pool_slab_get_class_count(void);
+/* Returns statistics for the size class, which must be smaller than
+   pool_slab_get_class_count(). */
+void pool_slab_get_class_stats(pool_t pool, unsigned int class_idx,
+			       struct pool_slab_class_stats *stats_r);
+/* Returns how much memory has been allocated from this pool. */
+size_t pool_slab_get_total_used_size(pool_t pool);
+/* Returns how much system memory has been allocated for this pool. */
+size_t pool_slab_get_total_alloc_size(pool_t pool);
+
 /* private: */
 void pool_system_free(pool_t pool, void *mem);
 
@@ -65,6 +65,10 @@ static void o_stream_file_destroy(struct iostream_private *stream)
 	struct file_ostream *fstream =
 		container_of(stream, struct file_ostream, ostream.iostream);
 
+	if (fstream->splice_pipe[0] != -1) {
+		i_close_fd(&fstream->splice_pipe[0]);
+		i_close_fd(&fstream->splice_pipe[1]);
+	}
 	i_free(fstream->buffer);
 }
 
@@ -332,12 +336,44 @@ static int o_stream_fill_iovec(struct file_ostream *fstream,
 	}
 }
 
+static int splice_pipe_flush(struct file_ostream *fstream)
+{
+	ssize_t ret;
+
+	while (fstream->splice_pipe_used > 0) {
+		ret = safe_splice(fstream->splice_pipe[0], fstream->fd,
+				  fstream->splice_pipe_used);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				return 0;
+			io_stream_set_error(&fstream->ostream.iostream,
+					    "splice() failed: %m");
+			fstream->ostream.ostream.stream_errno = errno;
+			stream_closed(fstream);
+			return -1;
+		}
+		i_assert(ret > 0);
+		fstream->splice_pipe_used -= ret;
+		fstream->real_offset += ret;
+		fstream->buffer_offset += ret;
+	}
+	return 1;
+}
+
 static int buffer_flush(struct file_ostream *fstream)
 {
 	struct const_iovec iov[2];
 	int iov_len;
 	ssize_t ret;
 
+	/* data in the splice pipe was sent before anything in the buffer */
+	if (fstream->splice_pipe_used > 0) {
+		if ((ret = splice_pipe_flush(fstream)) <= 0)
+			return ret;
+	}
+
 	iov_len = o_stream_fill_iovec(fstream, iov);
 	if (iov_len > 0) {
 		ret = o_stream_file_writev_full(fstream, iov, iov_len);
@@ -461,7 +497,8 @@ o_stream_file_get_buffer_used_size(const struct ostream_private *stream)
 	const struct file_ostream *fstream =
 		container_of(stream, const struct file_ostream, ostream);
 
-	return fstream->buffer_size - get_unused_space(fstream);
+	return fstream->buffer_size - get_unused_space(fstream) +
+		fstream->splice_pipe_used;
 }
 
 static int o_stream_file_seek(struct ostream_private *stream, uoff_t offset)
@@ -546,7 +583,8 @@ static void stream_send_io(struct file_ostream *fstream)
 	if (ret == 0)
 		fstream->flush_pending = TRUE;
 
-	if (!fstream->flush_pending && IS_STREAM_EMPTY(fstream)) {
+	if (!fstream->flush_pending && IS_STREAM_EMPTY(fstream) &&
+	    fstream->splice_pipe_used == 0) {
 		io_remove(&fstream->io);
 	} else if (!fstream->ostream.ostream.closed) {
 		/* Add the IO handler if it's not there already. Callback
@@ -625,7 +663,7 @@ ssize_t o_stream_file_sendv(struct ostream_private *stream,
 
 	optimal_size = I_MIN(fstream->optimal_block_size,
 			     fstream->ostream.max_buffer_size);
-	if (IS_STREAM_EMPTY(fstream) &&
+	if (IS_STREAM_EMPTY(fstream) && fstream->splice_pipe_used == 0 &&
 	    (!stream->corked || size >= optimal_size)) {
 		/* send immediately */
 		ret = o_stream_file_writev_full(fstream, iov, iov_count);
@@ -856,6 +894,91 @@ io_stream_sendfile(struct ostream_private *outstream,
 	return TRUE;
 }
 
+static bool splice_pipe_create(struct file_ostream *fstream)
+{
+	if (fstream->splice_pipe[0] != -1)
+		return TRUE;
+	if (pipe(fstream->splice_pipe) < 0) {
+		i_error("pipe() failed: %m");
+		fstream->splice_pipe[0] = fstream->splice_pipe[1] = -1;
+		return FALSE;
+	}
+	fd_set_nonblock(fstream->splice_pipe[0], TRUE);
+	fd_set_nonblock(fstream->splice_pipe[1], TRUE);
+	fd_close_on_exec(fstream->splice_pipe[0], TRUE);
+	fd_close_on_exec(fstream->splice_pipe[1], TRUE);
+	return TRUE;
+}
+
+static bool
+io_stream_splice(struct ostream_private *outstream,
+		 struct istream *instream, int in_fd,
+		 enum ostream_send_istream_result *res_r)
+{
+	struct file_ostream *foutstream =
+		container_of(outstream, struct file_ostream, ostream);
+	struct istream_private *rinstream = instream->real_stream;
+	ssize_t ret;
+	int ret2;
+
+	/* flush out any data in buffer */
+	if ((ret2 = buffer_flush(foutstream)) < 0) {
+		*res_r = OSTREAM_SEND_ISTREAM_RESULT_ERROR_OUTPUT;
+		return TRUE;
+	} else if (ret2 == 0) {
+		*res_r = OSTREAM_SEND_ISTREAM_RESULT_WAIT_OUTPUT;
+		return TRUE;
+	}
+	if (!splice_pipe_create(foutstream))
+		return FALSE;
+
+	for (;;) {
+		/* The pipe is always empty here, so the splice() can block
+		   only because of the input. */
+		i_assert(foutstream->splice_pipe_used == 0);
+		ret = safe_splice(in_fd, foutstream->splice_pipe[1],
+				  IO_BLOCK_SIZE * 16);
+		if (ret == 0) {
+			instream->eof = TRUE;
+			*res_r = OSTREAM_SEND_ISTREAM_RESULT_FINISHED;
+			return TRUE;
+		}
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN) {
+				*res_r = OSTREAM_SEND_ISTREAM_RESULT_WAIT_INPUT;
+				return TRUE;
+			}
+			if (errno == EINVAL) {
+				/* splice() isn't supported with this fd */
+				return FALSE;
+			}
+			io_stream_set_error(&rinstream->iostream,
+					    "splice() failed: %m");
+			instream->stream_errno = errno;
+			instream->eof = TRUE;
+			*res_r = OSTREAM_SEND_ISTREAM_RESULT_ERROR_INPUT;
+			return TRUE;
+		}
+
+		/* The data was already read from the istream's fd. It now
+		   belongs to the ostream, similarly to buffered data. */
+		instream->v_offset += ret;
+		rinstream->last_read_timeval = ioloop_timeval;
+		outstream->ostream.offset += ret;
+		foutstream->splice_pipe_used = ret;
+
+		if ((ret2 = splice_pipe_flush(foutstream)) < 0) {
+			*res_r = OSTREAM_SEND_ISTREAM_RESULT_ERROR_OUTPUT;
+			return TRUE;
+		} else if (ret2 == 0) {
+			*res_r = OSTREAM_SEND_ISTREAM_RESULT_WAIT_OUTPUT;
+			return TRUE;
+		}
+	}
+}
+
 static enum ostream_send_istream_result
 io_stream_copy_backwards(struct ostream_private *outstream,
 			 struct istream *instream, uoff_t in_size)
@@ -997,6 +1120,17 @@ o_stream_file_send_istream(struct ostream_private *outstream,
 		   regular sending. */
 		foutstream->no_sendfile = TRUE;
 	}
+	if (outstream->splice && !foutstream->no_splice && in_fd != -1 &&
+	    !foutstream->file && !instream->seekable &&
+	    instream->real_stream->parent == NULL &&
+	    i_stream_get_data_size(instream) == 0) {
+		if (io_stream_splice(outstream, instream, in_fd, &res))
+			return res;
+
+		/* splice() not supported (with this fd), fallback to
+		   regular sending. */
+		foutstream->no_splice = TRUE;
+	}
 
 	same_stream = i_stream_get_fd(instream) == foutstream->fd &&
 		foutstream->fd != -1;
@@ -1023,6 +1157,7 @@ o_stream_create_file_common(struct file_ostream *fstream,
 
 	fstream->fd = fd;
 	fstream->autoclose_fd = autoclose_fd;
+	fstream->splice_pipe[0] = fstream->splice_pipe[1] = -1;
 	fstream->optimal_block_size = DEFAULT_OPTIMAL_BLOCK_SIZE;
 
 	fstream->ostream.iostream.close = o_stream_file_close;
@@ -230,6 +230,11 @@ void o_stream_abort(struct ostream *stream);
    When creating wrapper streams, they copy this behavior from the parent
    stream. */
 void o_stream_set_no_error_handling(struct ostream *stream, bool set);
+/* Allow o_stream_send_istream() to move data from a socket istream using
+   splice(), so it's not copied to userspace. This is used only when the
+   istream is a plain fd istream with nothing buffered. Only fd ostreams
+   support this, and only on Linux. Other ostreams ignore the setting. */
+void o_stream_set_splice(struct ostream *stream, bool set);
 /* Send all of the instream to outstream.
 
    On non-failure instream is skips over all data written to outstream.
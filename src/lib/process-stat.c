@@ -209,6 +209,41 @@ static int parse_stat_file(struct process_stat *stat_r, struct event *event)
 	return 0;
 }
 
+static int parse_stat_file_rss(uint64_t *rss_r, struct event *event)
+{
+	string_t *buf = t_str_new(PROC_BUFFER_INITIAL_SIZE);
+	const char *const *tmp;
+
+	if (read_file_buffer(PROC_STAT_PATH, buf, PROC_STAT_MAX_SIZE, event) < 0)
+		return -1;
+	tmp = t_strsplit(str_c(buf), " ");
+	if (str_array_length(tmp) <= 23 || str_to_uint64(tmp[23], rss_r) < 0)
+		return -1;
+	/* rss is provided in pages, convert to bytes */
+	*rss_r *= sysconf(_SC_PAGESIZE);
+	return 0;
+}
+
+int process_stat_read_rss(uint64_t *rss_r, struct event *event)
+{
+	int ret;
+
+	T_BEGIN {
+		ret = parse_stat_file_rss(rss_r, event);
+	} T_END;
+	return ret;
+}
+
+void process_stat_read_cpu(uint64_t *utime_r, uint64_t *stime_r)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) < 0)
+		i_fatal("getrusage() failed: %m");
+	*utime_r = timeval_to_usecs(&usage.ru_utime);
+	*stime_r = timeval_to_usecs(&usage.ru_stime);
+}
+
 static int parse_all_stats(struct process_stat *stat_r, struct event *event)
 {
 	bool has_fields = FALSE;
@@ -22,5 +22,13 @@ struct process_stat {
 
 void process_stat_read_start(struct process_stat *stat_r, struct event *event);
 void process_stat_read_finish(struct process_stat *stat, struct event *event);
+/* Read only the current RSS of the process in bytes. This is cheap enough to
+   be called after every client disconnection. Returns 0 on success, -1 if
+   the RSS isn't available. */
+int process_stat_read_rss(uint64_t *rss_r, struct event *event);
+/* Read the process's user and system CPU time in microseconds. This is a
+   single getrusage() call, so it's cheap enough to be called whenever an
+   IMAP command is run. */
+void process_stat_read_cpu(uint64_t *utime_r, uint64_t *stime_r);
 
 #endif
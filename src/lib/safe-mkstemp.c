@@ -19,7 +19,6 @@ safe_mkstemp_full(string_t *prefix, mode_t mode, uid_t uid, gid_t gid,
 	size_t prefix_len;
 	struct stat st;
 	unsigned char randbuf[8];
-	mode_t old_umask;
 	int fd;
 
 	prefix_len = str_len(prefix);
@@ -37,9 +36,7 @@ safe_mkstemp_full(string_t *prefix, mode_t mode, uid_t uid, gid_t gid,
 			return -1;
 		}
 
-		old_umask = umask(0666 ^ mode);
-		fd = open(str_c(prefix), O_RDWR | O_EXCL | O_CREAT, 0666);
-		umask(old_umask);
+		fd = open(str_c(prefix), O_RDWR | O_EXCL | O_CREAT, 0600);
 		if (fd != -1)
 			break;
 
@@ -50,6 +47,15 @@ safe_mkstemp_full(string_t *prefix, mode_t mode, uid_t uid, gid_t gid,
 			return -1;
 		}
 	}
+	/* set the mode without the umask. changing the umask could race
+	   with other threads creating files. */
+	if (fchmod(fd, mode & 0666) < 0) {
+		i_error("fchmod(%s) failed: %m", str_c(prefix));
+		i_close_fd(&fd);
+		i_unlink(str_c(prefix));
+		str_truncate(prefix, prefix_len);
+		return -1;
+	}
 	if (uid == (uid_t)-1 && gid == (gid_t)-1)
 		return fd;
 
@@ -104,3 +110,39 @@ int safe_mkstemp_hostpid_group(string_t *prefix, mode_t mode,
 		str_truncate(prefix, orig_prefix_len);
 	return fd;
 }
+
+int safe_mkstemp_tmpfile(string_t *prefix, mode_t mode)
+{
+	int fd;
+
+#ifdef O_TMPFILE
+	const char *p, *dir;
+
+	p = strrchr(str_c(prefix), '/');
+	dir = p == NULL ? "." :
+		p == str_c(prefix) ? "/" : t_strdup_until(str_c(prefix), p);
+	fd = open(dir, O_TMPFILE | O_RDWR, 0600);
+	if (fd != -1) {
+		if (fchmod(fd, mode & 0666) < 0) {
+			i_error("fchmod(%s, O_TMPFILE) failed: %m", dir);
+			i_close_fd(&fd);
+			return -1;
+		}
+		return fd;
+	}
+	/* EISDIR = kernel doesn't support O_TMPFILE,
+	   EOPNOTSUPP = filesystem doesn't support it */
+	if (errno != EISDIR && errno != EOPNOTSUPP && errno != EINVAL) {
+		if (errno != ENOENT && errno != EACCES)
+			i_error("open(%s, O_TMPFILE) failed: %m", dir);
+		return -1;
+	}
+#endif
+	if ((fd = safe_mkstemp_hostpid(prefix, mode, (uid_t)-1, (gid_t)-1)) == -1)
+		return -1;
+	if (i_unlink(str_c(prefix)) < 0) {
+		i_close_fd(&fd);
+		return -1;
+	}
+	return fd;
+}
@@ -11,5 +11,10 @@ int safe_mkstemp_group(string_t *prefix, mode_t mode,
 int safe_mkstemp_hostpid(string_t *prefix, mode_t mode, uid_t uid, gid_t gid);
 int safe_mkstemp_hostpid_group(string_t *prefix, mode_t mode,
 			       gid_t gid, const char *gid_origin);
+/* Create an unnamed temporary file in the prefix's directory. O_TMPFILE is
+   used where the kernel and filesystem support it, so no directory entry is
+   created at all. Otherwise falls back to safe_mkstemp_hostpid() followed by
+   unlink(). The string is updated to contain the path that was used. */
+int safe_mkstemp_tmpfile(string_t *prefix, mode_t mode);
 
 #endif
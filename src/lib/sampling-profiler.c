@@ -0,0 +1,337 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "hash.h"
+#include "str.h"
+#include "lib-signals.h"
+#include "backtrace-string.h"
+#include "sampling-profiler.h"
+
+#include <sys/time.h>
+
+/* The immediate signal handler, lib-signals' handler and the signal
+   trampoline are at the top of the sampled stacks. */
+#define SAMPLING_PROFILER_SKIP_FRAMES 3
+#define SAMPLING_PROFILER_MAX_FRAMES 32
+/* Number of samples that can be taken before they're aggregated */
+#define SAMPLING_PROFILER_MAX_SAMPLES 256
+
+struct sampling_profiler_sample {
+	const char *label;
+	unsigned int frames_count;
+	void *frames[SAMPLING_PROFILER_MAX_FRAMES];
+};
+
+struct sampling_profiler_stack {
+	char *key;
+	struct sampling_profiler_sample sample;
+	unsigned int count;
+};
+
+struct sampling_profiler_report_stack {
+	const char *label, *function, *stack;
+	unsigned int count;
+};
+HASH_TABLE_DEFINE_TYPE(sampling_profiler_report, const char *,
+		       struct sampling_profiler_report_stack *);
+
+struct sampling_profiler {
+	unsigned int interval_msecs;
+	struct event *event;
+	struct timeout *to_report;
+
+	/* Written by the signal handler. Other code may read them only while
+	   SIGPROF is blocked. */
+	struct sampling_profiler_sample samples[SAMPLING_PROFILER_MAX_SAMPLES];
+	volatile unsigned int samples_count;
+	volatile unsigned int samples_dropped;
+
+	HASH_TABLE(char *, struct sampling_profiler_stack *) stacks;
+	unsigned int dropped_count;
+
+	/* Copies of the labels. The samples point to these, so the caller's
+	   strings may be freed (or their plugin unloaded) before the samples
+	   are reported. */
+	pool_t labels_pool;
+	HASH_TABLE(char *, char *) labels;
+};
+
+static struct sampling_profiler *profiler = NULL;
+static const char *volatile profiler_label = NULL;
+
+static void
+sampling_profiler_sigprof(const siginfo_t *si, void *context ATTR_UNUSED)
+{
+	void *frames[SAMPLING_PROFILER_MAX_FRAMES + SAMPLING_PROFILER_SKIP_FRAMES];
+	struct sampling_profiler_sample *sample;
+	int count;
+
+	if (profiler == NULL)
+		return;
+	if (profiler->samples_count == SAMPLING_PROFILER_MAX_SAMPLES) {
+		profiler->samples_dropped++;
+		return;
+	}
+
+	count = backtrace_get_addresses(frames, N_ELEMENTS(frames));
+	if (count <= SAMPLING_PROFILER_SKIP_FRAMES)
+		return;
+	count -= SAMPLING_PROFILER_SKIP_FRAMES;
+
+	sample = &profiler->samples[profiler->samples_count];
+	sample->label = profiler_label;
+	sample->frames_count = count;
+	memcpy(sample->frames, frames + SAMPLING_PROFILER_SKIP_FRAMES,
+	       sizeof(frames[0]) * count);
+	if (++profiler->samples_count == SAMPLING_PROFILER_MAX_SAMPLES / 2) {
+		/* aggregate them before the buffer becomes full */
+		lib_signal_delayed(si);
+	}
+}
+
+static void sampling_profiler_add(const struct sampling_profiler_sample *sample)
+{
+	struct sampling_profiler_stack *stack;
+	string_t *key = t_str_new(256);
+	unsigned int i;
+
+	str_printfa(key, "%p", sample->label);
+	for (i = 0; i < sample->frames_count; i++)
+		str_printfa(key, " %p", sample->frames[i]);
+
+	stack = hash_table_lookup(profiler->stacks, str_c(key));
+	if (stack == NULL) {
+		stack = i_new(struct sampling_profiler_stack, 1);
+		stack->key = i_strdup(str_c(key));
+		stack->sample = *sample;
+		hash_table_insert(profiler->stacks, stack->key, stack);
+	}
+	stack->count++;
+}
+
+static void sampling_profiler_aggregate(void)
+{
+	sigset_t set, oldset;
+	unsigned int i;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGPROF);
+	if (sigprocmask(SIG_BLOCK, &set, &oldset) < 0)
+		i_fatal("sigprocmask(SIG_BLOCK, SIGPROF) failed: %m");
+
+	T_BEGIN {
+		for (i = 0; i < profiler->samples_count; i++)
+			sampling_profiler_add(&profiler->samples[i]);
+	} T_END;
+	profiler->samples_count = 0;
+	profiler->dropped_count += profiler->samples_dropped;
+	profiler->samples_dropped = 0;
+
+	if (sigprocmask(SIG_SETMASK, &oldset, NULL) < 0)
+		i_fatal("sigprocmask(SIG_SETMASK) failed: %m");
+}
+
+static void
+sampling_profiler_sigprof_delayed(const siginfo_t *si ATTR_UNUSED,
+				  void *context ATTR_UNUSED)
+{
+	if (profiler != NULL)
+		sampling_profiler_aggregate();
+}
+
+static const char *sampling_profiler_frame_name(const char *frame)
+{
+	const char *p, *start, *end;
+
+	/* "binary(function+0x1a) [0x55f0d8535284]" -> "function". Without
+	   the function name use just the binary, because the offsets are
+	   different for each sampled instruction. */
+	p = strchr(frame, '(');
+	if (p == NULL) {
+		end = strstr(frame, " [");
+		return end == NULL ? frame : t_strdup_until(frame, end);
+	}
+	start = p + 1;
+	end = start + strcspn(start, "+)");
+	if (end == start)
+		return t_strdup_until(frame, p);
+	return t_strdup_until(start, end);
+}
+
+static void
+sampling_profiler_add_report(HASH_TABLE_TYPE(sampling_profiler_report) report,
+			     const struct sampling_profiler_stack *stack)
+{
+	const struct sampling_profiler_sample *sample = &stack->sample;
+	struct sampling_profiler_report_stack *rstack;
+	const char *error, *const *frames;
+	string_t *str = t_str_new(512);
+	unsigned int i;
+
+	if (backtrace_get_symbols(sample->frames, sample->frames_count,
+				  &frames, &error) < 0) {
+		e_debug(profiler->event, "Failed to get backtrace: %s", error);
+		return;
+	}
+	for (i = 0; frames[i] != NULL; i++) {
+		if (i > 0)
+			str_append(str, " -> ");
+		str_append(str, sampling_profiler_frame_name(frames[i]));
+	}
+
+	/* the same function and stack may have been sampled at different
+	   instructions */
+	const char *key = t_strdup_printf("%p %s", sample->label, str_c(str));
+	rstack = hash_table_lookup(report, key);
+	if (rstack == NULL) {
+		rstack = t_new(struct sampling_profiler_report_stack, 1);
+		rstack->label = sample->label == NULL ? "" : sample->label;
+		rstack->function = sampling_profiler_frame_name(frames[0]);
+		rstack->stack = t_strdup(str_c(str));
+		hash_table_insert(report, t_strdup(key), rstack);
+	}
+	rstack->count += stack->count;
+}
+
+static void
+sampling_profiler_send_report(const struct sampling_profiler_report_stack *rstack)
+{
+	struct event_passthrough *e =
+		event_create_passthrough(profiler->event)->
+		set_name("profiler_samples")->
+		add_str("label", rstack->label)->
+		add_str("function", rstack->function)->
+		add_str("stack", rstack->stack)->
+		add_int("samples", rstack->count)->
+		add_int("cpu_usecs",
+			(intmax_t)rstack->count * profiler->interval_msecs * 1000);
+	e_debug(e->event(), "%u samples in %s", rstack->count,
+		rstack->function);
+}
+
+static void sampling_profiler_report(void)
+{
+	HASH_TABLE_TYPE(sampling_profiler_report) report;
+	struct hash_iterate_context *iter;
+	struct sampling_profiler_stack *stack;
+	struct sampling_profiler_report_stack *rstack;
+	char *key;
+	const char *rkey;
+
+	sampling_profiler_aggregate();
+
+	T_BEGIN {
+		hash_table_create(&report, pool_datastack_create(), 0,
+				  str_hash, strcmp);
+		iter = hash_table_iterate_init(profiler->stacks);
+		while (hash_table_iterate(iter, profiler->stacks,
+					  &key, &stack)) {
+			sampling_profiler_add_report(report, stack);
+			i_free(stack->key);
+			i_free(stack);
+		}
+		hash_table_iterate_deinit(&iter);
+		hash_table_clear(profiler->stacks, TRUE);
+
+		iter = hash_table_iterate_init(report);
+		while (hash_table_iterate(iter, report, &rkey, &rstack))
+			sampling_profiler_send_report(rstack);
+		hash_table_iterate_deinit(&iter);
+		hash_table_destroy(&report);
+	} T_END;
+
+	if (profiler->dropped_count > 0) {
+		e_debug(profiler->event, "Dropped %u samples",
+			profiler->dropped_count);
+		profiler->dropped_count = 0;
+	}
+}
+
+static void sampling_profiler_report_timeout(void *context ATTR_UNUSED)
+{
+	sampling_profiler_report();
+}
+
+static void sampling_profiler_set_timer(unsigned int interval_msecs)
+{
+	struct itimerval itv;
+
+	i_zero(&itv);
+	itv.it_interval.tv_sec = interval_msecs / 1000;
+	itv.it_interval.tv_usec = (interval_msecs % 1000) * 1000;
+	itv.it_value = itv.it_interval;
+	if (setitimer(ITIMER_PROF, &itv, NULL) < 0)
+		i_fatal("setitimer(ITIMER_PROF) failed: %m");
+}
+
+void sampling_profiler_init(unsigned int interval_msecs,
+			    unsigned int report_interval_msecs)
+{
+	void *frames[1];
+
+	i_assert(profiler == NULL);
+	i_assert(interval_msecs > 0);
+
+	/* the first call may load libraries and allocate memory, so it can't
+	   be done in the signal handler */
+	if (backtrace_get_addresses(frames, N_ELEMENTS(frames)) < 0) {
+		i_error("Sampling profiler isn't supported on this system");
+		return;
+	}
+
+	profiler = i_new(struct sampling_profiler, 1);
+	profiler->interval_msecs = interval_msecs;
+	profiler->event = event_create(NULL);
+	event_set_append_log_prefix(profiler->event, "sampling-profiler: ");
+	hash_table_create(&profiler->stacks, default_pool, 0, str_hash, strcmp);
+	profiler->labels_pool =
+		pool_alloconly_create("sampling profiler labels", 256);
+	hash_table_create(&profiler->labels, default_pool, 0, str_hash, strcmp);
+	profiler_label = NULL;
+	profiler->to_report = timeout_add_to(io_loop_get_root(),
+					     report_interval_msecs,
+					     sampling_profiler_report_timeout,
+					     NULL);
+
+	lib_signals_set_handler2(SIGPROF,
+		LIBSIG_FLAG_RESTART | LIBSIG_FLAG_IOLOOP_AUTOMOVE,
+		sampling_profiler_sigprof, sampling_profiler_sigprof_delayed,
+		NULL);
+	sampling_profiler_set_timer(interval_msecs);
+}
+
+void sampling_profiler_deinit(void)
+{
+	if (profiler == NULL)
+		return;
+
+	sampling_profiler_set_timer(0);
+	lib_signals_unset_handler(SIGPROF, sampling_profiler_sigprof, NULL);
+
+	sampling_profiler_report();
+	timeout_remove(&profiler->to_report);
+	hash_table_destroy(&profiler->stacks);
+	hash_table_destroy(&profiler->labels);
+	pool_unref(&profiler->labels_pool);
+	event_unref(&profiler->event);
+	i_free_and_null(profiler);
+	profiler_label = NULL;
+}
+
+const char *sampling_profiler_set_label(const char *label)
+{
+	const char *old_label = profiler_label;
+	char *copy;
+
+	if (label != NULL && profiler != NULL) {
+		copy = hash_table_lookup(profiler->labels, label);
+		if (copy == NULL) {
+			copy = p_strdup(profiler->labels_pool, label);
+			hash_table_insert(profiler->labels, copy, copy);
+		}
+		label = copy;
+	}
+	profiler_label = label;
+	return old_label;
+}
@@ -0,0 +1,24 @@
+#ifndef SAMPLING_PROFILER_H
+#define SAMPLING_PROFILER_H
+
+/* Sample the process's stack every interval_msecs of used CPU time. The
+   samples are aggregated by the label and the stack, and sent every
+   report_interval_msecs as "profiler_samples" events with fields:
+
+   label - sampling_profiler_set_label() at the time of the sample
+   function - the function that was running
+   stack - the whole stack
+   samples - number of samples
+   cpu_usecs - the approximate used CPU time in microseconds
+*/
+void sampling_profiler_init(unsigned int interval_msecs,
+			    unsigned int report_interval_msecs);
+void sampling_profiler_deinit(void);
+
+/* Set the label for the following samples, e.g. the name of the command that
+   is being run. The profiler keeps its own copy of the string. This is cheap
+   enough to call even if the profiler isn't running. Returns the previous
+   label so it can be restored. */
+const char *sampling_profiler_set_label(const char *label);
+
+#endif
@@ -1,5 +1,7 @@
 /* Copyright (c) 2002-2018 Dovecot authors, see the included COPYING file */
 
+#define _GNU_SOURCE /* for splice() */
+
 /* kludge a bit to remove _FILE_OFFSET_BITS definition from config.h.
    It's required to be able to include sys/sendfile.h with Linux. */
 #include "config.h"
@@ -135,3 +137,22 @@ ssize_t safe_sendfile(int out_fd ATTR_UNUSED, int in_fd ATTR_UNUSED,
 }
 
 #endif
+
+#ifdef HAVE_SPLICE
+#include <fcntl.h>
+
+ssize_t safe_splice(int in_fd, int out_fd, size_t count)
+{
+	i_assert(count > 0);
+
+	return splice(in_fd, NULL, out_fd, NULL, I_MIN(count, SSIZE_T_MAX),
+		      SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+}
+#else
+ssize_t safe_splice(int in_fd ATTR_UNUSED, int out_fd ATTR_UNUSED,
+		    size_t count ATTR_UNUSED)
+{
+	errno = EINVAL;
+	return -1;
+}
+#endif
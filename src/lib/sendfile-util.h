@@ -13,4 +13,16 @@
    -1, errno=EAGAIN if non-blocking write couldn't send anything */
 ssize_t safe_sendfile(int out_fd, int in_fd, uoff_t *offset, size_t count);
 
+/* Wrapper for Linux splice(). Move a maximum of count bytes from in_fd to
+   out_fd without copying them to userspace. One of the fds must be a pipe.
+   The call doesn't block, even if the fds are blocking.
+
+   Returns:
+   >0 number of bytes moved (maybe less than count)
+   0 if in_fd is at EOF
+   -1, errno=EINVAL if it isn't supported for the fds or there is no
+       splice().
+   -1, errno=EAGAIN if nothing could be moved without blocking */
+ssize_t safe_splice(int in_fd, int out_fd, size_t count);
+
 #endif
@@ -221,18 +221,68 @@ unsigned int seq_range_array_add_range_count(ARRAY_TYPE(seq_range) *array,
 	return count;
 }
 
+static struct seq_range *
+seq_range_array_move_to_end(ARRAY_TYPE(seq_range) *array, unsigned int extra)
+{
+	struct seq_range *data;
+	unsigned int count;
+
+	/* Grow the array by extra ranges and move the existing ranges after
+	   them. The result can then be written from the beginning of the
+	   array while reading the old ranges, without a temporary copy. */
+	count = array_count(array);
+	if (extra > 0)
+		(void)array_idx_get_space(array, count + extra - 1);
+	data = array_get_modifiable(array, &count);
+	memmove(data + extra, data, (count - extra) * sizeof(*data));
+	return data;
+}
+
 void seq_range_array_merge(ARRAY_TYPE(seq_range) *dest,
 			   const ARRAY_TYPE(seq_range) *src)
 {
-	const struct seq_range *range;
+	const struct seq_range *range, *src_range;
+	struct seq_range *data;
+	unsigned int i, src_i, count, src_count, out;
 
 	if (array_count(dest) == 0) {
 		array_append_array(dest, src);
 		return;
 	}
+	if (dest == src)
+		return;
+
+	if (array_count(src) <= 1) {
+		array_foreach(src, range)
+			seq_range_array_add_range(dest, range->seq1, range->seq2);
+		return;
+	}
 
-	array_foreach(src, range)
-		seq_range_array_add_range(dest, range->seq1, range->seq2);
+	/* merge the sorted arrays in linear time */
+	src_range = array_get(src, &src_count);
+	data = seq_range_array_move_to_end(dest, src_count);
+	count = array_count(dest);
+	i = src_count; src_i = 0; out = 0;
+	while (i < count || src_i < src_count) {
+		if (src_i == src_count ||
+		    (i < count && data[i].seq1 <= src_range[src_i].seq1))
+			range = &data[i++];
+		else
+			range = &src_range[src_i++];
+
+		if (out > 0 && data[out-1].seq2 != (uint32_t)-1 &&
+		    data[out-1].seq2 + 1 >= range->seq1) {
+			/* overlapping or adjacent with the previous range */
+			if (data[out-1].seq2 < range->seq2)
+				data[out-1].seq2 = range->seq2;
+		} else if (out > 0 && data[out-1].seq2 == (uint32_t)-1) {
+			/* the previous range already covers everything */
+		} else {
+			data[out++] = *range;
+		}
+	}
+	array_delete(dest, out, count - out);
+	i_assert(!seq_range_is_overflowed(dest));
 }
 
 void seq_range_array_merge_n(ARRAY_TYPE(seq_range) *dest,
@@ -372,12 +422,98 @@ unsigned int seq_range_array_remove_range(ARRAY_TYPE(seq_range) *array,
 	return remove_count;
 }
 
+static void
+seq_range_count_add(unsigned int *count, uint32_t seq1, uint32_t seq2)
+{
+	unsigned int len = seq2 - seq1 + 1;
+
+	i_assert(UINT_MAX - *count >= len);
+	*count += len;
+}
+
+static unsigned int
+seq_range_array_filter(ARRAY_TYPE(seq_range) *dest,
+		       const ARRAY_TYPE(seq_range) *src, bool keep_common)
+{
+	const struct seq_range *src_range, *dest_range;
+	struct seq_range *data, range, piece;
+	unsigned int i, src_i, k, count, src_count, out;
+	unsigned int remove_count = 0;
+	uint32_t seq;
+	bool done;
+
+	/* Walk through both sorted arrays in linear time. Each dest range
+	   is split into pieces that either exist in src or not. Depending on
+	   keep_common either the common or the other pieces are kept. */
+	src_range = array_get(src, &src_count);
+	if (array_count(dest) == 0 || src_count == 0) {
+		if (!keep_common)
+			return 0;
+		array_foreach(dest, dest_range)
+			seq_range_count_add(&remove_count, dest_range->seq1,
+					    dest_range->seq2);
+		array_clear(dest);
+		return remove_count;
+	}
+
+	data = seq_range_array_move_to_end(dest, src_count);
+	count = array_count(dest);
+	src_i = 0; out = 0;
+	for (i = src_count; i < count; i++) {
+		range = data[i];
+		while (src_i < src_count && src_range[src_i].seq2 < range.seq1)
+			src_i++;
+
+		seq = range.seq1; done = FALSE;
+		for (k = src_i; k < src_count && !done; k++) {
+			if (src_range[k].seq1 > range.seq2)
+				break;
+			piece.seq1 = I_MAX(seq, src_range[k].seq1);
+			piece.seq2 = I_MIN(range.seq2, src_range[k].seq2);
+			if (seq < piece.seq1) {
+				/* the part before the common piece */
+				if (!keep_common) {
+					data[out].seq1 = seq;
+					data[out++].seq2 = piece.seq1 - 1;
+				} else {
+					seq_range_count_add(&remove_count,
+							    seq, piece.seq1 - 1);
+				}
+			}
+			if (keep_common)
+				data[out++] = piece;
+			else
+				seq_range_count_add(&remove_count,
+						    piece.seq1, piece.seq2);
+			if (piece.seq2 == range.seq2)
+				done = TRUE;
+			else
+				seq = piece.seq2 + 1;
+		}
+		if (!done) {
+			/* the rest of the range doesn't exist in src */
+			if (!keep_common) {
+				data[out].seq1 = seq;
+				data[out++].seq2 = range.seq2;
+			} else {
+				seq_range_count_add(&remove_count,
+						    seq, range.seq2);
+			}
+		}
+	}
+	array_delete(dest, out, count - out);
+	return remove_count;
+}
+
 unsigned int seq_range_array_remove_seq_range(ARRAY_TYPE(seq_range) *dest,
 					      const ARRAY_TYPE(seq_range) *src)
 {
 	unsigned int count, full_count = 0;
 	const struct seq_range *src_range;
 
+	if (dest != src && array_count(src) > 1)
+		return seq_range_array_filter(dest, src, FALSE);
+
 	array_foreach(src, src_range) {
 		count = seq_range_array_remove_range(dest, src_range->seq1,
 						     src_range->seq2);
@@ -412,27 +548,9 @@ void seq_range_array_remove_nth(ARRAY_TYPE(seq_range) *array,
 unsigned int seq_range_array_intersect(ARRAY_TYPE(seq_range) *dest,
 				       const ARRAY_TYPE(seq_range) *src)
 {
-	const struct seq_range *src_range;
-	unsigned int i, count, remove_count, full_count = 0;
-	uint32_t last_seq = 0;
-
-	src_range = array_get(src, &count);
-	for (i = 0; i < count; i++) {
-		if (last_seq + 1 < src_range[i].seq1) {
-			remove_count = seq_range_array_remove_range(dest,
-				last_seq + 1, src_range[i].seq1 - 1);
-			i_assert(UINT_MAX - full_count >= remove_count);
-			full_count += remove_count;
-		}
-		last_seq = src_range[i].seq2;
-	}
-	if (last_seq != (uint32_t)-1) {
-		remove_count = seq_range_array_remove_range(dest, last_seq + 1,
-							    (uint32_t)-1);
-		i_assert(UINT_MAX - full_count >= remove_count);
-		full_count += remove_count;
-	}
-	return full_count;
+	if (dest == src)
+		return 0;
+	return seq_range_array_filter(dest, src, TRUE);
 }
 
 bool seq_range_exists(const ARRAY_TYPE(seq_range) *array, uint32_t seq)
@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "stats-dist.h"
+#include "stats-sketch.h"
 #include "sort.h"
 
 /* In order to have a vaguely accurate 95th percentile, you need way
@@ -15,6 +16,8 @@ struct stats_dist {
 	uint64_t min;
 	uint64_t max;
 	uint64_t sum;
+	/* If non-NULL, used instead of samples[] */
+	struct stats_sketch *sketch;
 	uint64_t samples[];
 };
 
@@ -34,25 +37,43 @@ struct stats_dist *stats_dist_init_with_size(unsigned int sample_count)
 	return stats;
 }
 
+struct stats_dist *stats_dist_init_sketch(void)
+{
+	struct stats_dist *stats = i_new(struct stats_dist, 1);
+
+	stats->sketch = stats_sketch_init();
+	return stats;
+}
+
 void stats_dist_deinit(struct stats_dist **_stats)
 {
+	if (*_stats != NULL)
+		stats_sketch_deinit(&(*_stats)->sketch);
 	i_free_and_null(*_stats);
 }
 
 void stats_dist_reset(struct stats_dist *stats)
 {
 	unsigned int sample_count = stats->sample_count;
+	struct stats_sketch *sketch = stats->sketch;
+
 	i_zero(stats);
 	stats->sample_count = sample_count;
+	stats->sketch = sketch;
+	if (sketch != NULL)
+		stats_sketch_reset(sketch);
 }
 
 void stats_dist_add(struct stats_dist *stats, uint64_t value)
 {
-	if (stats->count < stats->sample_count) {
+	if (stats->count == 0)
+		stats->min = stats->max = value;
+
+	if (stats->sketch != NULL)
+		stats_sketch_add(stats->sketch, value);
+	else if (stats->count < stats->sample_count)
 		stats->samples[stats->count] = value;
-		if (stats->count == 0)
-			stats->min = stats->max = value;
-	} else {
+	else {
 		unsigned int idx = i_rand_limit(stats->count);
 		if (idx < stats->sample_count)
 			stats->samples[idx] = value;
@@ -67,6 +88,39 @@ void stats_dist_add(struct stats_dist *stats, uint64_t value)
 	stats->sorted = FALSE;
 }
 
+void stats_dist_merge(struct stats_dist *dest, const struct stats_dist *src)
+{
+	i_assert(src->sketch != NULL);
+
+	stats_dist_merge_sketch(dest, src->sketch);
+}
+
+void stats_dist_merge_sketch(struct stats_dist *dest,
+			     const struct stats_sketch *src)
+{
+	unsigned int count = stats_sketch_get_count(src);
+	uint64_t min = stats_sketch_get_min(src);
+	uint64_t max = stats_sketch_get_max(src);
+
+	i_assert(dest->sketch != NULL);
+
+	if (count == 0)
+		return;
+	stats_sketch_merge(dest->sketch, src);
+
+	if (dest->count == 0) {
+		dest->min = min;
+		dest->max = max;
+	} else {
+		if (dest->min > min)
+			dest->min = min;
+		if (dest->max < max)
+			dest->max = max;
+	}
+	dest->count += count;
+	dest->sum += stats_sketch_get_sum(src);
+}
+
 unsigned int stats_dist_get_count(const struct stats_dist *stats)
 {
 	return stats->count;
@@ -112,6 +166,8 @@ uint64_t stats_dist_get_median(struct stats_dist *stats)
 {
 	if (stats->count == 0)
 		return 0;
+	if (stats->sketch != NULL)
+		return stats_sketch_get_percentile(stats->sketch, 0.5);
 	/* cast-away const - reading requires sorting */
 	stats_dist_ensure_sorted(stats);
 	unsigned int count = (stats->count < stats->sample_count)
@@ -126,6 +182,8 @@ double stats_dist_get_variance(const struct stats_dist *stats)
 	double sum = 0;
 	if (stats->count == 0)
 		return 0;
+	if (stats->sketch != NULL)
+		return stats_sketch_get_variance(stats->sketch);
 
 	double avg = stats_dist_get_avg(stats);
 	double count = (stats->count < stats->sample_count)
@@ -165,6 +223,8 @@ uint64_t stats_dist_get_percentile(struct stats_dist *stats, double fraction)
 {
 	if (stats->count == 0)
 		return 0;
+	if (stats->sketch != NULL)
+		return stats_sketch_get_percentile(stats->sketch, fraction);
 	stats_dist_ensure_sorted(stats);
 	unsigned int count = (stats->count < stats->sample_count)
 		? stats->count
@@ -181,3 +241,9 @@ const uint64_t *stats_dist_get_samples(const struct stats_dist *stats,
 		: stats->sample_count;
 	return stats->samples;
 }
+
+const struct stats_sketch *
+stats_dist_get_sketch(const struct stats_dist *stats)
+{
+	return stats->sketch;
+}
@@ -1,8 +1,14 @@
 #ifndef STATS_DIST_H
 #define STATS_DIST_H
 
+struct stats_sketch;
+
 struct stats_dist *stats_dist_init(void);
 struct stats_dist *stats_dist_init_with_size(unsigned int sample_count);
+/* Use a stats_sketch instead of random subsampling for the median,
+   percentiles and variance. They are then accurate within the sketch's
+   relative error, and the stats_dists can be merged. */
+struct stats_dist *stats_dist_init_sketch(void);
 void stats_dist_deinit(struct stats_dist **stats);
 
 /* Reset all events. */
@@ -10,6 +16,13 @@ void stats_dist_reset(struct stats_dist *stats);
 
 /* Add a new event. */
 void stats_dist_add(struct stats_dist *stats, uint64_t value);
+/* Add all events in src to dest. Both must have been created with
+   stats_dist_init_sketch(). */
+void stats_dist_merge(struct stats_dist *dest, const struct stats_dist *src);
+/* Add all events in the sketch to dest, which must have been created with
+   stats_dist_init_sketch(). */
+void stats_dist_merge_sketch(struct stats_dist *dest,
+			     const struct stats_sketch *src);
 
 /* Returns number of events added. */
 unsigned int stats_dist_get_count(const struct stats_dist *stats);
@@ -34,7 +47,10 @@ static inline uint64_t stats_dist_get_95th(struct stats_dist *stats)
 {
 	return stats_dist_get_percentile(stats, 0.95);
 }
-/* Returns the sample array */
+/* Returns the sample array. It's always empty with stats_dist_init_sketch(). */
 const uint64_t *stats_dist_get_samples(const struct stats_dist *stats,
 				       unsigned int *count_r);
+/* Returns the sketch or NULL if stats_dist_init_sketch() wasn't used. */
+const struct stats_sketch *
+stats_dist_get_sketch(const struct stats_dist *stats);
 #endif
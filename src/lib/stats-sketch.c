@@ -0,0 +1,308 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "bits.h"
+#include "str.h"
+#include "strnum.h"
+#include "stats-sketch.h"
+
+#define SKETCH_SUB_BUCKETS (1U << STATS_SKETCH_PRECISION_BITS)
+
+struct stats_sketch {
+	unsigned int count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+	/* Bucket number of counts[0]. Only the buckets between min and max
+	   are allocated. */
+	unsigned int first_bucket;
+	ARRAY_TYPE(uint) counts;
+};
+
+static unsigned int stats_sketch_bucket(uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < SKETCH_SUB_BUCKETS)
+		return value;
+	/* the highest bit selects the group of buckets and the following
+	   STATS_SKETCH_PRECISION_BITS select the bucket within the group */
+	shift = bits_required64(value) - 1 - STATS_SKETCH_PRECISION_BITS;
+	return (shift + 1) * SKETCH_SUB_BUCKETS +
+		(unsigned int)((value >> shift) - SKETCH_SUB_BUCKETS);
+}
+
+static uint64_t stats_sketch_bucket_value(unsigned int bucket)
+{
+	unsigned int shift;
+	uint64_t low;
+
+	if (bucket < SKETCH_SUB_BUCKETS)
+		return bucket;
+	shift = bucket / SKETCH_SUB_BUCKETS - 1;
+	low = (uint64_t)(SKETCH_SUB_BUCKETS + bucket % SKETCH_SUB_BUCKETS) <<
+		shift;
+	/* return the middle of the bucket's range */
+	return low + ((1ULL << shift) - 1) / 2;
+}
+
+struct stats_sketch *stats_sketch_init(void)
+{
+	struct stats_sketch *sketch;
+
+	sketch = i_new(struct stats_sketch, 1);
+	i_array_init(&sketch->counts, 64);
+	return sketch;
+}
+
+void stats_sketch_deinit(struct stats_sketch **_sketch)
+{
+	struct stats_sketch *sketch = *_sketch;
+
+	if (sketch == NULL)
+		return;
+	*_sketch = NULL;
+
+	array_free(&sketch->counts);
+	i_free(sketch);
+}
+
+void stats_sketch_reset(struct stats_sketch *sketch)
+{
+	array_clear(&sketch->counts);
+	sketch->count = 0;
+	sketch->min = sketch->max = sketch->sum = 0;
+	sketch->first_bucket = 0;
+}
+
+static void
+stats_sketch_add_count(struct stats_sketch *sketch, unsigned int bucket,
+		       unsigned int count)
+{
+	ARRAY_TYPE(uint) counts;
+	unsigned int *countp;
+
+	if (array_count(&sketch->counts) == 0)
+		sketch->first_bucket = bucket;
+	else if (bucket < sketch->first_bucket) {
+		/* new minimum - move the existing buckets forward */
+		i_array_init(&counts, array_count(&sketch->counts) +
+			     sketch->first_bucket - bucket);
+		array_idx_clear(&counts, sketch->first_bucket - bucket - 1);
+		array_append_array(&counts, &sketch->counts);
+		array_free(&sketch->counts);
+		sketch->counts = counts;
+		sketch->first_bucket = bucket;
+	}
+	countp = array_idx_get_space(&sketch->counts,
+				     bucket - sketch->first_bucket);
+	*countp += count;
+}
+
+void stats_sketch_add(struct stats_sketch *sketch, uint64_t value)
+{
+	stats_sketch_add_count(sketch, stats_sketch_bucket(value), 1);
+
+	if (sketch->count == 0)
+		sketch->min = sketch->max = value;
+	else if (sketch->min > value)
+		sketch->min = value;
+	else if (sketch->max < value)
+		sketch->max = value;
+	sketch->count++;
+	sketch->sum += value;
+}
+
+void stats_sketch_merge(struct stats_sketch *dest,
+			const struct stats_sketch *src)
+{
+	const unsigned int *counts;
+	unsigned int i, count;
+
+	if (src->count == 0)
+		return;
+
+	counts = array_get(&src->counts, &count);
+	for (i = 0; i < count; i++) {
+		if (counts[i] != 0) {
+			stats_sketch_add_count(dest, src->first_bucket + i,
+					       counts[i]);
+		}
+	}
+
+	if (dest->count == 0) {
+		dest->min = src->min;
+		dest->max = src->max;
+	} else {
+		if (dest->min > src->min)
+			dest->min = src->min;
+		if (dest->max < src->max)
+			dest->max = src->max;
+	}
+	dest->count += src->count;
+	dest->sum += src->sum;
+}
+
+unsigned int stats_sketch_get_count(const struct stats_sketch *sketch)
+{
+	return sketch->count;
+}
+
+uint64_t stats_sketch_get_sum(const struct stats_sketch *sketch)
+{
+	return sketch->sum;
+}
+
+uint64_t stats_sketch_get_min(const struct stats_sketch *sketch)
+{
+	return sketch->min;
+}
+
+uint64_t stats_sketch_get_max(const struct stats_sketch *sketch)
+{
+	return sketch->max;
+}
+
+static uint64_t
+stats_sketch_get_value(const struct stats_sketch *sketch, unsigned int bucket)
+{
+	uint64_t value = stats_sketch_bucket_value(bucket);
+
+	/* the first and the last buckets may be only partially used */
+	if (value < sketch->min)
+		return sketch->min;
+	if (value > sketch->max)
+		return sketch->max;
+	return value;
+}
+
+double stats_sketch_get_variance(const struct stats_sketch *sketch)
+{
+	const unsigned int *counts;
+	unsigned int i, count;
+	double avg, diff, sum = 0;
+
+	if (sketch->count == 0)
+		return 0;
+
+	avg = (double)sketch->sum / sketch->count;
+	counts = array_get(&sketch->counts, &count);
+	for (i = 0; i < count; i++) {
+		if (counts[i] == 0)
+			continue;
+		diff = stats_sketch_get_value(sketch,
+					      sketch->first_bucket + i) - avg;
+		sum += counts[i] * diff * diff;
+	}
+	return sum / sketch->count;
+}
+
+uint64_t stats_sketch_get_percentile(const struct stats_sketch *sketch,
+				     double fraction)
+{
+	const unsigned int *counts;
+	unsigned int i, count, rank, seen = 0;
+	double rank_float;
+
+	if (sketch->count == 0)
+		return 0;
+	if (fraction >= 1.)
+		return sketch->max;
+	if (fraction <= 0.)
+		return sketch->min;
+
+	/* Find the event at the same position as stats_dist_get_percentile()
+	   would. Exact boundaries belong to the range below them. */
+	rank_float = sketch->count * fraction;
+	rank = rank_float;
+	if (rank_float - rank > 1e-8*sketch->count)
+		rank++;
+	if (rank == 0)
+		rank = 1;
+
+	counts = array_get(&sketch->counts, &count);
+	for (i = 0; i < count; i++) {
+		seen += counts[i];
+		if (seen >= rank)
+			break;
+	}
+	i_assert(i < count);
+	return stats_sketch_get_value(sketch, sketch->first_bucket + i);
+}
+
+void stats_sketch_export(const struct stats_sketch *sketch, string_t *dest)
+{
+	const unsigned int *counts;
+	unsigned int i, count;
+
+	str_printfa(dest, "%u %"PRIu64" %"PRIu64" %"PRIu64" %u",
+		    STATS_SKETCH_PRECISION_BITS, sketch->min, sketch->max,
+		    sketch->sum, sketch->first_bucket);
+	counts = array_get(&sketch->counts, &count);
+	for (i = 0; i < count; i++)
+		str_printfa(dest, " %u", counts[i]);
+}
+
+static int
+stats_sketch_import_real(struct stats_sketch *sketch, const char *str,
+			 const char **error_r)
+{
+	const char *const *args = t_strsplit(str, " ");
+	unsigned int i, bits, count, bucket;
+
+	if (str_array_length(args) < 5) {
+		*error_r = "Too few fields";
+		return -1;
+	}
+	if (str_to_uint(args[0], &bits) < 0 ||
+	    bits != STATS_SKETCH_PRECISION_BITS) {
+		*error_r = t_strdup_printf("Unsupported precision: %s",
+					   args[0]);
+		return -1;
+	}
+	if (str_to_uint64(args[1], &sketch->min) < 0 ||
+	    str_to_uint64(args[2], &sketch->max) < 0 ||
+	    str_to_uint64(args[3], &sketch->sum) < 0 ||
+	    str_to_uint(args[4], &bucket) < 0) {
+		*error_r = "Invalid number";
+		return -1;
+	}
+	if (sketch->min > sketch->max) {
+		*error_r = "min is larger than max";
+		return -1;
+	}
+
+	for (i = 5; args[i] != NULL; i++, bucket++) {
+		if (str_to_uint(args[i], &count) < 0) {
+			*error_r = t_strdup_printf("Invalid count: %s",
+						   args[i]);
+			return -1;
+		}
+		if (count == 0)
+			continue;
+		if (bucket < stats_sketch_bucket(sketch->min) ||
+		    bucket > stats_sketch_bucket(sketch->max)) {
+			*error_r = "Bucket is outside min..max range";
+			return -1;
+		}
+		stats_sketch_add_count(sketch, bucket, count);
+		sketch->count += count;
+	}
+	return 0;
+}
+
+int stats_sketch_import(struct stats_sketch *sketch, const char *str,
+			const char **error_r)
+{
+	struct stats_sketch *imported = stats_sketch_init();
+	int ret;
+
+	T_BEGIN {
+		ret = stats_sketch_import_real(imported, str, error_r);
+	} T_END_PASS_STR_IF(ret < 0, error_r);
+	if (ret == 0)
+		stats_sketch_merge(sketch, imported);
+	stats_sketch_deinit(&imported);
+	return ret;
+}
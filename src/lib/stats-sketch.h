@@ -0,0 +1,48 @@
+#ifndef STATS_SKETCH_H
+#define STATS_SKETCH_H
+
+/* Quantile sketch with bounded relative error. Values are counted in
+   log-linear buckets: values below 2^STATS_SKETCH_PRECISION_BITS are exact,
+   larger values are split into 2^STATS_SKETCH_PRECISION_BITS buckets per
+   power of two. Percentiles are accurate to within 1/2^(bits+1) (0.8%) of
+   the actual value. Adding is O(1) and two sketches can be merged without
+   losing accuracy, so sketches from different processes or servers can be
+   aggregated. */
+#define STATS_SKETCH_PRECISION_BITS 6
+
+struct stats_sketch *stats_sketch_init(void);
+void stats_sketch_deinit(struct stats_sketch **sketch);
+
+/* Reset all events. */
+void stats_sketch_reset(struct stats_sketch *sketch);
+
+/* Add a new event. */
+void stats_sketch_add(struct stats_sketch *sketch, uint64_t value);
+/* Add all events in src to dest. */
+void stats_sketch_merge(struct stats_sketch *dest,
+			const struct stats_sketch *src);
+
+/* Returns number of events added. */
+unsigned int stats_sketch_get_count(const struct stats_sketch *sketch);
+/* Returns the sum of all events. */
+uint64_t stats_sketch_get_sum(const struct stats_sketch *sketch);
+/* Returns events' minimum. */
+uint64_t stats_sketch_get_min(const struct stats_sketch *sketch);
+/* Returns events' maximum. */
+uint64_t stats_sketch_get_max(const struct stats_sketch *sketch);
+/* Returns events' approximate variance. */
+double stats_sketch_get_variance(const struct stats_sketch *sketch);
+/* Returns events' approximate percentile. fraction parameter is in the range
+   (0., 1.], so 95th %-ile is 0.95. */
+uint64_t stats_sketch_get_percentile(const struct stats_sketch *sketch,
+				     double fraction);
+
+/* Append the sketch to dest as a string that contains only digits and
+   spaces. */
+void stats_sketch_export(const struct stats_sketch *sketch, string_t *dest);
+/* Add all events from a string created by stats_sketch_export() to the
+   sketch. Returns 0 on success, -1 if the string is invalid. */
+int stats_sketch_import(struct stats_sketch *sketch, const char *str,
+			const char **error_r);
+
+#endif
@@ -5,6 +5,11 @@
 #include "lib.h"
 #include "str-find.h"
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#  define STR_FIND_BLOCK_SIZE 16
+#endif
+
 struct str_find_context {
 	pool_t pool;
 	unsigned char *key;
@@ -106,6 +111,46 @@ void str_find_deinit(struct str_find_context **_ctx)
 	p_free(ctx->pool, ctx);
 }
 
+#ifdef STR_FIND_BLOCK_SIZE
+/* Scan data for the key by comparing 16 positions at a time against the key's
+   first and last bytes, and fully comparing only the positions where both
+   matched. Returns TRUE and the match's start position in *pos_r if the key
+   was found. Otherwise returns FALSE and the position where the scanning
+   stopped, because the remaining data is too short for a full block. */
+static bool
+str_find_block_scan(const struct str_find_context *ctx,
+		    const unsigned char *data, size_t size, size_t *pos_r)
+{
+	unsigned int key_len_1 = ctx->key_len - 1;
+	const __m128i first = _mm_set1_epi8((char)ctx->key[0]);
+	const __m128i last = _mm_set1_epi8((char)ctx->key[key_len_1]);
+	__m128i block_first, block_last;
+	unsigned int mask, bit;
+	size_t j;
+
+	for (j = 0; j + key_len_1 + STR_FIND_BLOCK_SIZE <= size;
+	     j += STR_FIND_BLOCK_SIZE) {
+		block_first = _mm_loadu_si128((const __m128i *)(data + j));
+		block_last = _mm_loadu_si128((const __m128i *)
+					     (data + j + key_len_1));
+		mask = _mm_movemask_epi8(
+			_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+				      _mm_cmpeq_epi8(last, block_last)));
+		while (mask != 0) {
+			bit = bits_required32(mask & -mask) - 1;
+			if (memcmp(data + j + bit + 1, ctx->key + 1,
+				   key_len_1) == 0) {
+				*pos_r = j + bit;
+				return TRUE;
+			}
+			mask &= mask - 1;
+		}
+	}
+	*pos_r = j;
+	return FALSE;
+}
+#endif
+
 bool str_find_more(struct str_find_context *ctx,
 		    const unsigned char *data, size_t size)
 {
@@ -141,8 +186,18 @@ bool str_find_more(struct str_find_context *ctx,
 		ctx->match_count = j;
 		j = 0;
 	} else {
-		/* Boyer-Moore searching */
+#ifdef STR_FIND_BLOCK_SIZE
+		size_t pos;
+
+		if (str_find_block_scan(ctx, data, size, &pos)) {
+			ctx->match_end_pos = pos + key_len;
+			return TRUE;
+		}
+		j = pos;
+#else
 		j = 0;
+#endif
+		/* Boyer-Moore searching for the rest */
 		while (j + key_len <= size) {
 			i = key_len - 1;
 			while (ctx->key[i] == data[i + j]) {
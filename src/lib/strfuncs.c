@@ -12,6 +12,12 @@
 #include <limits.h>
 #include <ctype.h>
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+/* Maximum number of reject bytes for the i_memcspn() SSE2 fast path */
+#  define MEMCSPN_SSE2_MAX_REJECT 4
+#endif
+
 /* Disable our memcpy() safety wrapper. This file is very performance sensitive
    and it's been checked to work correctly with memcpy(). */
 #undef memcpy
@@ -686,6 +692,38 @@ size_t i_memspn(const void *data, size_t data_len,
 	return pos;
 }
 
+#ifdef MEMCSPN_SSE2_MAX_REJECT
+static size_t
+i_memcspn_sse2(const unsigned char *data, size_t data_len,
+	       const unsigned char *reject, size_t reject_len)
+{
+	__m128i reject_bytes[MEMCSPN_SSE2_MAX_REJECT], block, match;
+	unsigned int mask;
+	size_t i, pos;
+
+	i_assert(reject_len <= MEMCSPN_SSE2_MAX_REJECT);
+
+	for (i = 0; i < reject_len; i++)
+		reject_bytes[i] = _mm_set1_epi8((char)reject[i]);
+	for (pos = 0; pos + 16 <= data_len; pos += 16) {
+		block = _mm_loadu_si128((const __m128i *)(data + pos));
+		match = _mm_cmpeq_epi8(block, reject_bytes[0]);
+		for (i = 1; i < reject_len; i++) {
+			match = _mm_or_si128(match,
+				_mm_cmpeq_epi8(block, reject_bytes[i]));
+		}
+		mask = _mm_movemask_epi8(match);
+		if (mask != 0)
+			return pos + bits_required32(mask & -mask) - 1;
+	}
+	for (; pos < data_len; pos++) {
+		if (memchr(reject, data[pos], reject_len) != NULL)
+			break;
+	}
+	return pos;
+}
+#endif
+
 size_t i_memcspn(const void *data, size_t data_len,
 		 const void *reject, size_t reject_len)
 {
@@ -697,6 +735,13 @@ size_t i_memcspn(const void *data, size_t data_len,
 	/* nothing to reject */
 	if (reject_len == 0 || data_len == 0)
 		return data_len;
+#ifdef MEMCSPN_SSE2_MAX_REJECT
+	/* Scanning the data once is faster than repeated memchr()s, which
+	   go through the whole data even when the other reject bytes are
+	   found early. */
+	if (reject_len > 1 && reject_len <= MEMCSPN_SSE2_MAX_REJECT)
+		return i_memcspn_sse2(start, data_len, r, reject_len);
+#endif
 	/* Doing repeated memchr's over the data is faster than
 	   going over it once byte by byte, as long as reject
 	   is reasonably short. */
@@ -34,6 +34,20 @@ test_ds_grow_event_callback(struct event *event,
 	test_assert(field != NULL &&
 		    field->value_type == EVENT_FIELD_VALUE_TYPE_INTMAX &&
 		    field->value.intmax >= 1024 * 100);
+	field = event_find_field_nonrecursive(event, "peak_alloc_size");
+	test_assert(field != NULL &&
+		    field->value_type == EVENT_FIELD_VALUE_TYPE_INTMAX &&
+		    (size_t)field->value.intmax == data_stack_get_peak_alloc_size() &&
+		    (size_t)field->value.intmax >= data_stack_get_alloc_size());
+	field = event_find_field_nonrecursive(event, "frame_used_size");
+	test_assert(field != NULL &&
+		    field->value_type == EVENT_FIELD_VALUE_TYPE_INTMAX &&
+		    field->value.intmax >= 1024 * (5 + 100) &&
+		    field->value.intmax < 1024 * (5 + 100 + 1));
+	field = event_find_field_nonrecursive(event, "frame_depth");
+	test_assert(field != NULL &&
+		    field->value_type == EVENT_FIELD_VALUE_TYPE_INTMAX &&
+		    field->value.intmax >= 2);
 	field = event_find_field_nonrecursive(event, "frame_marker");
 	test_assert(field != NULL &&
 		    field->value_type == EVENT_FIELD_VALUE_TYPE_STR &&
@@ -63,6 +77,10 @@ static void test_ds_grow_event(void)
 		(void)t_malloc0(1024*100);
 		test_assert(ds_grow_event_count == 1);
 	} T_END;
+	/* the peak is remembered after the memory is freed */
+	test_assert(data_stack_get_peak_alloc_size() >= 1024 * (5 + 100));
+	data_stack_free_unused();
+	test_assert(data_stack_get_peak_alloc_size() >= 1024 * (5 + 100));
 	event_unset_global_debug_log_filter();
 	event_unregister_callback(test_ds_grow_event_callback);
 	test_end();
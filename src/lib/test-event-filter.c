@@ -631,6 +631,164 @@ static void test_event_filter_named_separate_from_str(void)
 	test_end();
 }
 
+static void
+test_event_filter_name_index_check(struct event_filter *filter,
+				   struct event *event,
+				   void *const *expected)
+{
+	const struct failure_context failure_ctx = {
+		.type = LOG_TYPE_DEBUG
+	};
+	struct event_filter_match_iter *iter;
+	unsigned int i = 0;
+	void *context;
+
+	iter = event_filter_match_iter_init(filter, event, &failure_ctx);
+	while ((context = event_filter_match_iter_next(iter)) != NULL) {
+		test_assert_idx(context == expected[i], i);
+		if (expected[i] != NULL)
+			i++;
+	}
+	test_assert_idx(expected[i] == NULL, i);
+	event_filter_match_iter_deinit(&iter);
+}
+
+static void test_event_filter_name_index(void)
+{
+	static const char *const queries[] = {
+		"event=foo",
+		"event=bar OR event=foo",
+		"str=x",
+		"event=foo AND str=x",
+		"NOT event=foo",
+		"event=foo OR event=foo",
+	};
+	const struct failure_context failure_ctx = {
+		.type = LOG_TYPE_DEBUG
+	};
+	int contexts[N_ELEMENTS(queries)];
+	struct event_filter *filter, *src;
+	const char *error;
+	unsigned int i;
+
+	test_begin("event filter: name index");
+
+	filter = event_filter_create();
+	for (i = 0; i < N_ELEMENTS(queries); i++) {
+		src = event_filter_create();
+		test_assert_idx(event_filter_parse(queries[i], src, &error) == 0, i);
+		event_filter_merge_with_context(filter, src, &contexts[i]);
+		event_filter_unref(&src);
+	}
+
+	struct event *e_foo = event_create(NULL);
+	event_set_name(e_foo, "foo");
+	event_add_str(e_foo, "str", "x");
+	struct event *e_bar = event_create(NULL);
+	event_set_name(e_bar, "bar");
+	event_add_str(e_bar, "str", "y");
+
+	void *const foo_matches[] = {
+		&contexts[0], &contexts[1], &contexts[2], &contexts[3],
+		&contexts[5], NULL
+	};
+	void *const bar_matches[] = { &contexts[1], &contexts[4], NULL };
+	test_event_filter_name_index_check(filter, e_foo, foo_matches);
+	test_event_filter_name_index_check(filter, e_bar, bar_matches);
+	test_assert(event_filter_match(filter, e_foo, &failure_ctx));
+	test_assert(event_filter_match(filter, e_bar, &failure_ctx));
+
+	/* removing queries updates the index */
+	test_assert(event_filter_remove_queries_with_context(filter, &contexts[1]));
+	test_assert(event_filter_remove_queries_with_context(filter, &contexts[4]));
+	void *const foo_matches2[] = {
+		&contexts[0], &contexts[2], &contexts[3], &contexts[5], NULL
+	};
+	void *const no_matches[] = { NULL };
+	test_event_filter_name_index_check(filter, e_foo, foo_matches2);
+	test_event_filter_name_index_check(filter, e_bar, no_matches);
+	test_assert(!event_filter_match(filter, e_bar, &failure_ctx));
+
+	/* so does adding them */
+	test_assert(event_filter_parse("event=bar", filter, &error) == 0);
+	test_event_filter_name_index_check(filter, e_bar, no_matches);
+	test_assert(event_filter_match(filter, e_bar, &failure_ctx));
+
+	event_filter_unref(&filter);
+	event_unref(&e_foo);
+	event_unref(&e_bar);
+	test_end();
+}
+
+static void test_event_filter_global_interest(void)
+{
+	static struct event_category parent_category = {
+		.name = "interest-parent",
+	};
+	static struct event_category child_category = {
+		.parent = &parent_category,
+		.name = "interest-child",
+	};
+	static struct event_category other_category = {
+		.name = "interest-other",
+	};
+	struct event_filter *filter;
+	const char *error;
+
+	test_begin("event filter: global interest");
+
+	struct event *e_child = event_create(NULL);
+	event_add_category(e_child, &child_category);
+	struct event *e_other = event_create(NULL);
+	event_add_category(e_other, &other_category);
+	struct event *e_other_child = event_create(e_child);
+	event_add_category(e_other_child, &other_category);
+	struct event *e_named = event_create(NULL);
+	event_set_name(e_named, "foo");
+
+	/* no filters - nothing is wanted */
+	test_assert(!event_want_debug(e_child));
+	test_assert(!event_want_debug(e_named));
+
+	filter = event_filter_create();
+	test_assert(event_filter_parse("category=interest-parent OR "
+				       "(event=foo AND str=x)",
+				       filter, &error) == 0);
+	test_assert(event_filter_parse("category=interest-unregistered",
+				       filter, &error) == 0);
+	event_set_global_debug_send_filter(filter);
+	test_assert(event_want_debug(e_child));
+	test_assert(event_want_debug(e_other_child));
+	test_assert(!event_want_debug(e_other));
+	test_assert(!event_want_debug(e_named));
+	event_add_str(e_named, "str", "x");
+	test_assert(event_want_debug(e_named));
+
+	/* changing the queries updates the interest */
+	test_assert(event_filter_parse("category=interest-other",
+				       filter, &error) == 0);
+	test_assert(event_want_debug(e_other));
+
+	/* a query that isn't restricted to names or categories can match
+	   anything */
+	test_assert(event_filter_parse("str=y", filter, &error) == 0);
+	struct event *e_plain = event_create(NULL);
+	event_add_str(e_plain, "str", "y");
+	test_assert(event_want_debug(e_plain));
+	event_unref(&e_plain);
+
+	event_unset_global_debug_send_filter();
+	test_assert(!event_want_debug(e_child));
+	test_assert(!event_want_debug(e_named));
+
+	event_filter_unref(&filter);
+	event_unref(&e_child);
+	event_unref(&e_other);
+	event_unref(&e_other_child);
+	event_unref(&e_named);
+	test_end();
+}
+
 static void test_event_filter_duration(void)
 {
 	struct event_filter *filter;
@@ -1129,6 +1287,8 @@ void test_event_filter(void)
 	test_event_filter_named_and_str();
 	test_event_filter_named_or_str();
 	test_event_filter_named_separate_from_str();
+	test_event_filter_name_index();
+	test_event_filter_global_interest();
 	test_event_filter_duration();
 	test_event_filter_numbers();
 	test_event_filter_ips();
@@ -35,6 +35,137 @@ static void test_hash_random_pool(pool_t pool)
 	i_free(keys);
 }
 
+static unsigned int test_hash_direct(const void *p)
+{
+	return POINTER_CAST_TO(p, unsigned int);
+}
+
+static unsigned int test_hash_constant(const void *p ATTR_UNUSED)
+{
+	return 1234;
+}
+
+static int test_hash_cmp(const void *p1, const void *p2)
+{
+	return p1 == p2 ? 0 : 1;
+}
+
+static void
+test_hash_open_addressing_random(bool constant_hash, unsigned int max)
+{
+	HASH_TABLE(void *, void *) hash;
+	unsigned int *values, i, key, count = 0;
+	void *k, *v;
+
+	values = i_new(unsigned int, max + 1);
+	if (constant_hash) {
+		hash_table_create_flags(&hash, default_pool, 0,
+					test_hash_constant, test_hash_cmp,
+					HASH_TABLE_FLAG_OPEN_ADDRESSING);
+	} else {
+		hash_table_create_flags(&hash, default_pool, 0,
+					test_hash_direct, test_hash_cmp,
+					HASH_TABLE_FLAG_OPEN_ADDRESSING);
+	}
+	for (i = 0; i < max * 10; i++) {
+		key = i_rand_minmax(1, max);
+		switch (i_rand_limit(4)) {
+		case 0:
+		case 1:
+			if (values[key] == 0) {
+				hash_table_insert(hash, POINTER_CAST(key),
+						  POINTER_CAST(i + 1));
+				count++;
+			} else {
+				hash_table_update(hash, POINTER_CAST(key),
+						  POINTER_CAST(i + 1));
+			}
+			values[key] = i + 1;
+			break;
+		case 2:
+			test_assert_idx(hash_table_try_remove(hash,
+				POINTER_CAST(key)) == (values[key] != 0), i);
+			if (values[key] != 0)
+				count--;
+			values[key] = 0;
+			break;
+		case 3:
+			test_assert_idx(POINTER_CAST_TO(
+				hash_table_lookup(hash, POINTER_CAST(key)),
+				unsigned int) == values[key], i);
+			break;
+		}
+		test_assert_idx(hash_table_count(hash) == count, i);
+	}
+	for (key = 1; key <= max; key++) {
+		if (values[key] == 0)
+			test_assert(!hash_table_lookup_full(hash,
+				POINTER_CAST(key), &k, &v));
+		else {
+			test_assert(hash_table_lookup_full(hash,
+				POINTER_CAST(key), &k, &v));
+			test_assert(POINTER_CAST_TO(k, unsigned int) == key);
+			test_assert(POINTER_CAST_TO(v, unsigned int) == values[key]);
+		}
+	}
+	hash_table_clear(hash, TRUE);
+	test_assert(hash_table_count(hash) == 0);
+	test_assert(hash_table_lookup(hash, POINTER_CAST(1)) == NULL);
+	hash_table_destroy(&hash);
+	i_free(values);
+}
+
+static void test_hash_open_addressing_iterate(void)
+{
+#define ITER_KEYS 1000
+	HASH_TABLE(void *, void *) hash;
+	struct hash_iterate_context *iter;
+	unsigned int seen[ITER_KEYS + 1], i, key;
+	void *k, *v;
+
+	hash_table_create_flags(&hash, default_pool, 0, test_hash_direct,
+				test_hash_cmp, HASH_TABLE_FLAG_OPEN_ADDRESSING);
+	for (i = 1; i <= ITER_KEYS/2; i++)
+		hash_table_insert(hash, POINTER_CAST(i), POINTER_CAST(i));
+
+	/* remove and add keys while iterating. The table grows during the
+	   iteration, but all the original keys must still be seen once. */
+	memset(seen, 0, sizeof(seen));
+	iter = hash_table_iterate_init(hash);
+	while (hash_table_iterate(iter, hash, &k, &v)) {
+		key = POINTER_CAST_TO(k, unsigned int);
+		test_assert(k == v);
+		seen[key]++;
+		if (key <= ITER_KEYS/2)
+			hash_table_insert(hash, POINTER_CAST(key + ITER_KEYS/2),
+					  POINTER_CAST(key + ITER_KEYS/2));
+		if (key % 2 == 0)
+			hash_table_remove(hash, k);
+	}
+	hash_table_iterate_deinit(&iter);
+	for (i = 1; i <= ITER_KEYS/2; i++)
+		test_assert_idx(seen[i] == 1, i);
+	for (i = ITER_KEYS/2 + 1; i <= ITER_KEYS; i++)
+		test_assert_idx(seen[i] <= 1, i);
+	for (i = 1; i <= ITER_KEYS; i++) {
+		if (i % 2 == 0 && (i <= ITER_KEYS/2 || seen[i] > 0))
+			test_assert_idx(hash_table_lookup(hash, POINTER_CAST(i)) == NULL, i);
+		else
+			test_assert_idx(hash_table_lookup(hash, POINTER_CAST(i)) == POINTER_CAST(i), i);
+	}
+	hash_table_destroy(&hash);
+}
+
+static void test_hash_open_addressing(void)
+{
+	test_begin("hash open addressing");
+	test_hash_open_addressing_random(FALSE, 10000);
+	/* all keys have the same hash */
+	test_hash_open_addressing_random(TRUE, 100);
+	test_hash_open_addressing_iterate();
+	test_end();
+}
+
 void test_hash(void)
 {
 	pool_t pool;
@@ -44,4 +175,6 @@ void test_hash(void)
 	pool = pool_alloconly_create("test hash", 1024);
 	test_hash_random_pool(pool);
 	pool_unref(&pool);
+
+	test_hash_open_addressing();
 }
@@ -48,6 +48,38 @@ static void test_iostream_temp_create_sized_disk(void)
 	test_end();
 }
 
+static void test_iostream_temp_max_total_mem_size(void)
+{
+	struct ostream *output1, *output2;
+	struct istream *input;
+
+	test_begin("iostream_temp_set_max_total_mem_size()");
+	iostream_temp_set_max_total_mem_size(6);
+	output1 = iostream_temp_create_sized(".", 0, "test", 100);
+	output2 = iostream_temp_create_sized(".", 0, "test", 100);
+	test_assert(o_stream_send(output1, "1234", 4) == 4);
+	test_assert(o_stream_get_fd(output1) == -1);
+	/* the total memory usage would become too large */
+	test_assert(o_stream_send(output2, "1234", 4) == 4);
+	test_assert(o_stream_get_fd(output2) != -1);
+	o_stream_destroy(&output2);
+
+	/* the finished istream's buffer is still counted */
+	input = iostream_temp_finish(&output1, 128);
+	output2 = iostream_temp_create_sized(".", 0, "test", 100);
+	test_assert(o_stream_send(output2, "1234", 4) == 4);
+	test_assert(o_stream_get_fd(output2) != -1);
+	o_stream_destroy(&output2);
+	i_stream_unref(&input);
+
+	output2 = iostream_temp_create_sized(".", 0, "test", 100);
+	test_assert(o_stream_send(output2, "1234", 4) == 4);
+	test_assert(o_stream_get_fd(output2) == -1);
+	o_stream_destroy(&output2);
+	iostream_temp_set_max_total_mem_size(0);
+	test_end();
+}
+
 static void test_iostream_temp_create_write_error(void)
 {
 	struct ostream *output;
@@ -145,6 +177,7 @@ void test_iostream_temp(void)
 {
 	test_iostream_temp_create_sized_memory();
 	test_iostream_temp_create_sized_disk();
+	test_iostream_temp_max_total_mem_size();
 	test_iostream_temp_create_write_error();
 	test_iostream_temp_istream();
 }
@@ -0,0 +1,151 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "test-lib.h"
+
+#define SENSE 0xAB
+
+static bool mem_has_bytes(const void *mem, size_t size, uint8_t b)
+{
+	const uint8_t *bytes = mem;
+	unsigned int i;
+
+	for (i = 0; i < size; i++) {
+		if (bytes[i] != b)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void test_mempool_slab_reuse(void)
+{
+	struct pool_slab_class_stats stats;
+	pool_t pool;
+	void *mem[100], *mem2;
+	unsigned int i;
+
+	test_begin("mempool_slab reuse");
+	pool = pool_slab_create("test");
+
+	for (i = 0; i < N_ELEMENTS(mem); i++) {
+		mem[i] = p_malloc(pool, 40);
+		test_assert_idx(mem_has_bytes(mem[i], 40, 0), i);
+		test_assert_idx(((uintptr_t)mem[i] % MEM_ALIGN_SIZE) == 0, i);
+		memset(mem[i], SENSE, 40);
+	}
+	/* 40 bytes goes to the 48 byte class */
+	pool_slab_get_class_stats(pool, 2, &stats);
+	test_assert(stats.size == 48);
+	test_assert(stats.used_count == N_ELEMENTS(mem));
+	test_assert(stats.alloc_count == N_ELEMENTS(mem));
+	test_assert(pool_slab_get_total_used_size(pool) == 48 * N_ELEMENTS(mem));
+
+	/* freed memory is reused and zeroed */
+	mem2 = mem[10];
+	p_free(pool, mem[10]);
+	pool_slab_get_class_stats(pool, 2, &stats);
+	test_assert(stats.used_count == N_ELEMENTS(mem) - 1);
+	test_assert(stats.free_count > 0);
+	mem[10] = p_malloc(pool, 33);
+	test_assert(mem[10] == mem2);
+	test_assert(mem_has_bytes(mem[10], 48, 0));
+
+	/* the other allocations weren't touched */
+	for (i = 0; i < N_ELEMENTS(mem); i++) {
+		if (i != 10)
+			test_assert_idx(mem_has_bytes(mem[i], 40, SENSE), i);
+		p_free(pool, mem[i]);
+	}
+	pool_slab_get_class_stats(pool, 2, &stats);
+	test_assert(stats.used_count == 0);
+	test_assert(stats.alloc_count == N_ELEMENTS(mem) + 1);
+	test_assert(pool_slab_get_total_used_size(pool) == 0);
+	pool_unref(&pool);
+	test_end();
+}
+
+static void test_mempool_slab_classes(void)
+{
+	struct pool_slab_class_stats stats;
+	unsigned int class_count = pool_slab_get_class_count();
+	pool_t pool;
+	void *mem[2000];
+	size_t sizes[N_ELEMENTS(mem)], used = 0;
+	unsigned int i;
+
+	test_begin("mempool_slab classes");
+	pool = pool_slab_create("test");
+	for (i = 0; i < N_ELEMENTS(mem); i++) {
+		sizes[i] = i_rand_minmax(1, 1024);
+		mem[i] = p_malloc(pool, sizes[i]);
+		memset(mem[i], i & 0xff, sizes[i]);
+	}
+	for (i = 0; i < N_ELEMENTS(mem); i += 2)
+		p_free(pool, mem[i]);
+	for (i = 1; i < N_ELEMENTS(mem); i += 2) {
+		test_assert_idx(mem_has_bytes(mem[i], sizes[i], i & 0xff), i);
+		used += sizes[i];
+	}
+	test_assert(pool_slab_get_total_used_size(pool) >= used);
+	test_assert(pool_slab_get_total_alloc_size(pool) >
+		    pool_slab_get_total_used_size(pool));
+
+	/* the last class has the large allocations */
+	pool_slab_get_class_stats(pool, class_count - 1, &stats);
+	test_assert(stats.size == 0);
+	test_assert(stats.used_count > 0 && stats.free_count == 0);
+
+	/* clearing frees everything */
+	p_clear(pool);
+	test_assert(pool_slab_get_total_used_size(pool) == 0);
+	for (i = 0; i < class_count; i++) {
+		pool_slab_get_class_stats(pool, i, &stats);
+		test_assert_idx(stats.used_count == 0 && stats.free_count == 0,
+				i);
+	}
+	mem[0] = p_malloc(pool, 10);
+	test_assert(mem_has_bytes(mem[0], 10, 0));
+	pool_unref(&pool);
+	test_end();
+}
+
+static void test_mempool_slab_realloc(void)
+{
+	pool_t pool;
+	unsigned char *mem, *mem2;
+	unsigned int i;
+
+	test_begin("mempool_slab realloc");
+	pool = pool_slab_create("test");
+
+	mem = NULL;
+	for (i = 1; i < 2000; i++) {
+		mem = p_realloc(pool, mem, i-1, i);
+		test_assert_idx(mem_has_bytes(mem, i-1, SENSE), i);
+		test_assert_idx(mem[i-1] == 0, i);
+		mem[i-1] = SENSE;
+	}
+	/* shrinking keeps the data */
+	mem = p_realloc(pool, mem, i-1, 100);
+	test_assert(mem_has_bytes(mem, 100, SENSE));
+	p_free(pool, mem);
+
+	/* growing within the size class returns the same memory */
+	mem = p_malloc(pool, 17);
+	memset(mem, SENSE, 17);
+	mem2 = p_realloc(pool, mem, 17, 32);
+	test_assert(mem2 == mem);
+	test_assert(mem_has_bytes(mem2, 17, SENSE));
+	test_assert(mem_has_bytes(mem2 + 17, 32 - 17, 0));
+	p_free(pool, mem2);
+
+	test_assert(pool_slab_get_total_used_size(pool) == 0);
+	pool_unref(&pool);
+	test_end();
+}
+
+void test_mempool_slab(void)
+{
+	test_mempool_slab_reuse();
+	test_mempool_slab_classes();
+	test_mempool_slab_realloc();
+}
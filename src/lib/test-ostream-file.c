@@ -181,9 +181,63 @@ static void test_ostream_file_send_istream_sendfile(void)
 	test_end();
 }
 
+static void test_ostream_file_send_istream_splice(void)
+{
+	struct istream *input;
+	struct ostream *output;
+	char buf[32];
+	int in_fd[2], out_fd[2];
+
+	test_begin("ostream file send istream splice()");
+
+	i_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, in_fd) == 0);
+	i_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, out_fd) == 0);
+	fd_set_nonblock(in_fd[0], TRUE);
+	fd_set_nonblock(out_fd[0], TRUE);
+	input = i_stream_create_fd_autoclose(&in_fd[0], 1024);
+	output = o_stream_create_fd_autoclose(&out_fd[0], 1024);
+	o_stream_set_splice(output, TRUE);
+
+	/* nothing buffered in the istream */
+	test_assert(write(in_fd[1], "hello world", 11) == 11);
+	test_assert(o_stream_send_istream(output, input) ==
+		    OSTREAM_SEND_ISTREAM_RESULT_WAIT_INPUT);
+	test_assert(input->v_offset == 11);
+	test_assert(output->offset == 11);
+	test_assert(read(out_fd[1], buf, sizeof(buf)) == 11 &&
+		    memcmp(buf, "hello world", 11) == 0);
+
+	/* buffered data is sent first */
+	test_assert(write(in_fd[1], "abc", 3) == 3);
+	test_assert(i_stream_read(input) == 3);
+	test_assert(write(in_fd[1], "def", 3) == 3);
+	test_assert(o_stream_send_istream(output, input) ==
+		    OSTREAM_SEND_ISTREAM_RESULT_WAIT_INPUT);
+	test_assert(o_stream_flush(output) == 1);
+	test_assert(read(out_fd[1], buf, sizeof(buf)) == 6 &&
+		    memcmp(buf, "abcdef", 6) == 0);
+
+	/* EOF */
+	test_assert(write(in_fd[1], "ghi", 3) == 3);
+	i_close_fd(&in_fd[1]);
+	test_assert(o_stream_send_istream(output, input) ==
+		    OSTREAM_SEND_ISTREAM_RESULT_FINISHED);
+	test_assert(input->eof);
+	test_assert(input->v_offset == 20);
+	test_assert(output->offset == 20);
+	test_assert(read(out_fd[1], buf, sizeof(buf)) == 3 &&
+		    memcmp(buf, "ghi", 3) == 0);
+
+	i_stream_unref(&input);
+	o_stream_destroy(&output);
+	i_close_fd(&out_fd[1]);
+	test_end();
+}
+
 void test_ostream_file(void)
 {
 	test_ostream_file_random();
 	test_ostream_file_send_istream_file();
 	test_ostream_file_send_istream_sendfile();
+	test_ostream_file_send_istream_splice();
 }
@@ -0,0 +1,98 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "test-lib.h"
+#include "ioloop.h"
+#include "time-util.h"
+#include "lib-signals.h"
+#include "lib-event-private.h"
+#include "event-filter.h"
+#include "sampling-profiler.h"
+
+#include <sys/resource.h>
+
+static unsigned int test_profiler_samples;
+static unsigned int test_profiler_unlabeled;
+
+static bool
+test_sampling_profiler_callback(struct event *event,
+				enum event_callback_type type,
+				struct failure_context *ctx ATTR_UNUSED,
+				const char *fmt ATTR_UNUSED,
+				va_list args ATTR_UNUSED)
+{
+	const struct event_field *field;
+
+	if (type != EVENT_CALLBACK_TYPE_SEND ||
+	    strcmp(event->sending_name, "profiler_samples") != 0)
+		return TRUE;
+
+	field = event_find_field_nonrecursive(event, "label");
+	test_assert(field != NULL);
+	if (field == NULL || strcmp(field->value.str, "test label") != 0)
+		test_profiler_unlabeled++;
+	field = event_find_field_nonrecursive(event, "function");
+	test_assert(field != NULL && field->value.str[0] != '\0');
+	field = event_find_field_nonrecursive(event, "samples");
+	test_assert(field != NULL && field->value.intmax > 0);
+	if (field != NULL)
+		test_profiler_samples += field->value.intmax;
+	field = event_find_field_nonrecursive(event, "cpu_usecs");
+	test_assert(field != NULL && field->value.intmax > 0);
+	return TRUE;
+}
+
+static uint64_t test_cpu_usecs(void)
+{
+	struct rusage rusage;
+
+	if (getrusage(RUSAGE_SELF, &rusage) < 0)
+		i_fatal("getrusage() failed: %m");
+	return rusage.ru_utime.tv_sec * 1000000ULL + rusage.ru_utime.tv_usec +
+		rusage.ru_stime.tv_sec * 1000000ULL + rusage.ru_stime.tv_usec;
+}
+
+static void test_sampling_profiler_cpu(void)
+{
+	struct ioloop *ioloop;
+	struct event_filter *filter;
+	const char *error;
+	char *label;
+	volatile unsigned int counter = 0;
+	uint64_t start;
+
+	test_begin("sampling profiler");
+	lib_signals_init();
+	ioloop = io_loop_create();
+	event_register_callback(test_sampling_profiler_callback);
+	filter = event_filter_create();
+	test_assert(event_filter_parse("event=profiler_samples", filter,
+				       &error) == 0);
+	event_set_global_debug_send_filter(filter);
+	event_filter_unref(&filter);
+
+	sampling_profiler_init(10, 60*1000);
+	/* the label is copied, so it can be freed before it's reported */
+	label = i_strdup("test label");
+	test_assert(sampling_profiler_set_label(label) == NULL);
+	i_free(label);
+	start = test_cpu_usecs();
+	while (test_cpu_usecs() - start < 200*1000)
+		counter++;
+	test_assert_strcmp(sampling_profiler_set_label(NULL), "test label");
+	sampling_profiler_deinit();
+
+	/* the deinit sends the remaining samples */
+	test_assert(test_profiler_samples > 0);
+	test_assert(test_profiler_unlabeled == 0);
+
+	event_unset_global_debug_send_filter();
+	event_unregister_callback(test_sampling_profiler_callback);
+	io_loop_destroy(&ioloop);
+	lib_signals_deinit();
+	test_end();
+}
+
+void test_sampling_profiler(void)
+{
+	test_sampling_profiler_cpu();
+}
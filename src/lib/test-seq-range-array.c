@@ -231,6 +231,119 @@ fail:
 	array_free(&range);
 }
 
+static void
+test_seq_range_array_random_fill(ARRAY_TYPE(seq_range) *range,
+				 unsigned char *shadowbuf)
+{
+	uint32_t seq1, seq2;
+	unsigned int i, count = i_rand_limit(10);
+
+	array_clear(range);
+	memset(shadowbuf, 0, SEQ_RANGE_TEST_BUFSIZE);
+	for (i = 0; i < count; i++) {
+		seq1 = i_rand_limit(SEQ_RANGE_TEST_BUFSIZE);
+		seq2 = seq1 + i_rand_limit(I_MIN(SEQ_RANGE_TEST_BUFSIZE - seq1, 10));
+		seq_range_array_add_range(range, seq1, seq2);
+		memset(shadowbuf + seq1, 1, seq2 - seq1 + 1);
+	}
+}
+
+static bool
+test_seq_range_array_equals(const ARRAY_TYPE(seq_range) *range,
+			    const unsigned char *shadowbuf)
+{
+	const struct seq_range *seqs;
+	unsigned int i, count;
+	uint32_t seq = 0;
+
+	seqs = array_get(range, &count);
+	for (i = 0; i < count; i++) {
+		if (i > 0 && seqs[i-1].seq2+1 >= seqs[i].seq1)
+			return FALSE;
+		if (seqs[i].seq1 > seqs[i].seq2 ||
+		    seqs[i].seq2 >= SEQ_RANGE_TEST_BUFSIZE)
+			return FALSE;
+		for (; seq < seqs[i].seq1; seq++) {
+			if (shadowbuf[seq] != 0)
+				return FALSE;
+		}
+		for (; seq <= seqs[i].seq2; seq++) {
+			if (shadowbuf[seq] == 0)
+				return FALSE;
+		}
+	}
+	for (; seq < SEQ_RANGE_TEST_BUFSIZE; seq++) {
+		if (shadowbuf[seq] != 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void test_seq_range_array_random_sets(void)
+{
+	unsigned char dest_buf[SEQ_RANGE_TEST_BUFSIZE];
+	unsigned char src_buf[SEQ_RANGE_TEST_BUFSIZE];
+	ARRAY_TYPE(seq_range) dest, src;
+	const struct seq_range *seqs;
+	unsigned int i, j, ret, ret2, count;
+	int test;
+
+	test_begin("seq_range_array merge/intersect/remove random");
+	t_array_init(&dest, 8);
+	t_array_init(&src, 8);
+	for (i = 0; i < 10000; i++) {
+		test_seq_range_array_random_fill(&dest, dest_buf);
+		test_seq_range_array_random_fill(&src, src_buf);
+		test = i_rand_limit(3);
+		ret = ret2 = 0;
+		switch (test) {
+		case 0:
+			seq_range_array_merge(&dest, &src);
+			for (j = 0; j < SEQ_RANGE_TEST_BUFSIZE; j++)
+				dest_buf[j] |= src_buf[j];
+			break;
+		case 1:
+			ret = seq_range_array_intersect(&dest, &src);
+			for (j = 0; j < SEQ_RANGE_TEST_BUFSIZE; j++) {
+				if (dest_buf[j] != 0 && src_buf[j] == 0) {
+					dest_buf[j] = 0;
+					ret2++;
+				}
+			}
+			break;
+		case 2:
+			ret = seq_range_array_remove_seq_range(&dest, &src);
+			for (j = 0; j < SEQ_RANGE_TEST_BUFSIZE; j++) {
+				if (dest_buf[j] != 0 && src_buf[j] != 0) {
+					dest_buf[j] = 0;
+					ret2++;
+				}
+			}
+			break;
+		}
+		test_assert_idx(ret == ret2, i);
+		test_assert_idx(test_seq_range_array_equals(&dest, dest_buf), i);
+	}
+
+	/* ranges ending at the last possible sequence */
+	array_clear(&dest);
+	array_clear(&src);
+	seq_range_array_add_range(&dest, 1, 5);
+	seq_range_array_add_range(&dest, 100, (uint32_t)-1);
+	seq_range_array_add_range(&src, 3, 10);
+	seq_range_array_add_range(&src, 200, 300);
+	seq_range_array_add_range(&src, 1000, (uint32_t)-2);
+	seq_range_array_merge(&dest, &src);
+	seqs = array_get(&dest, &count);
+	test_assert(count == 2 &&
+		    seqs[0].seq1 == 1 && seqs[0].seq2 == 10 &&
+		    seqs[1].seq1 == 100 && seqs[1].seq2 == (uint32_t)-1);
+	test_assert(seq_range_array_intersect(&dest, &src) == 2 + 100 + 699 + 1);
+	seqs = array_get(&dest, &count);
+	test_assert(count == 3 && seqs[2].seq2 == (uint32_t)-2);
+	test_end();
+}
+
 static void test_seq_range_array_invert_minmax(uint32_t min, uint32_t max)
 {
 	ARRAY_TYPE(seq_range) range = ARRAY_INIT;
@@ -372,6 +485,7 @@ void test_seq_range_array(void)
 	test_seq_range_array_invert_edges();
 	test_seq_range_array_have_common();
 	test_seq_range_array_random();
+	test_seq_range_array_random_sets();
 }
 
 enum fatal_test_state fatal_seq_range_array(unsigned int stage)
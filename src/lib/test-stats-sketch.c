@@ -0,0 +1,228 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "test-lib.h"
+#include "str.h"
+#include "stats-dist.h"
+#include "stats-sketch.h"
+
+#include <math.h>
+
+#define DBL_EQ(a, b) (fabs((a)-(b)) < 0.001)
+/* maximum relative error of the returned percentiles */
+#define SKETCH_ERROR (1.0 / (1 << (STATS_SKETCH_PRECISION_BITS+1)))
+
+static bool test_sketch_value_ok(uint64_t value, uint64_t expected)
+{
+	return fabs((double)value - expected) <= expected * SKETCH_ERROR;
+}
+
+static void test_stats_sketch_small(void)
+{
+	struct stats_sketch *sketch;
+	uint64_t i;
+
+	test_begin("stats_sketch small values");
+	sketch = stats_sketch_init();
+	test_assert(stats_sketch_get_percentile(sketch, 0.5) == 0);
+	test_assert(stats_sketch_get_variance(sketch) == 0);
+
+	/* small values are exact */
+	for (i = 20; i > 0; i--)
+		stats_sketch_add(sketch, i);
+	test_assert(stats_sketch_get_count(sketch) == 20);
+	test_assert(stats_sketch_get_sum(sketch) == 210);
+	test_assert(stats_sketch_get_min(sketch) == 1);
+	test_assert(stats_sketch_get_max(sketch) == 20);
+	test_assert(stats_sketch_get_percentile(sketch, 0.5) == 10);
+	test_assert(stats_sketch_get_percentile(sketch, 0.95) == 19);
+	test_assert(stats_sketch_get_percentile(sketch, 0.951) == 20);
+	test_assert(stats_sketch_get_percentile(sketch, 0.01) == 1);
+	test_assert(stats_sketch_get_percentile(sketch, 1) == 20);
+	test_assert(DBL_EQ(stats_sketch_get_variance(sketch), 33.25));
+
+	stats_sketch_reset(sketch);
+	test_assert(stats_sketch_get_count(sketch) == 0);
+	test_assert(stats_sketch_get_max(sketch) == 0);
+	stats_sketch_add(sketch, 0);
+	test_assert(stats_sketch_get_percentile(sketch, 0.5) == 0);
+	stats_sketch_deinit(&sketch);
+	test_end();
+}
+
+static void test_stats_sketch_large(void)
+{
+	static const double fractions[] = {
+		0.01, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99, 0.999
+	};
+	struct stats_sketch *sketch;
+	unsigned int i;
+
+	test_begin("stats_sketch large values");
+	sketch = stats_sketch_init();
+	/* add in descending order to test growing the buckets downwards */
+	for (i = 10000; i > 0; i--)
+		stats_sketch_add(sketch, (uint64_t)i * 1000);
+	for (i = 0; i < N_ELEMENTS(fractions); i++) {
+		uint64_t expected = fractions[i] * 10000000;
+		test_assert_idx(test_sketch_value_ok(
+			stats_sketch_get_percentile(sketch, fractions[i]),
+			expected), i);
+	}
+	test_assert(stats_sketch_get_percentile(sketch, 1) == 10000000);
+
+	stats_sketch_reset(sketch);
+	stats_sketch_add(sketch, UINT64_MAX);
+	stats_sketch_add(sketch, 1);
+	test_assert(stats_sketch_get_percentile(sketch, 0.5) == 1);
+	test_assert(test_sketch_value_ok(
+		stats_sketch_get_percentile(sketch, 0.9), UINT64_MAX));
+	stats_sketch_deinit(&sketch);
+	test_end();
+}
+
+static void test_stats_sketch_merge(void)
+{
+	struct stats_sketch *sketch1, *sketch2, *all;
+	unsigned int i;
+
+	test_begin("stats_sketch merge");
+	sketch1 = stats_sketch_init();
+	sketch2 = stats_sketch_init();
+	all = stats_sketch_init();
+	for (i = 0; i < 1000; i++) {
+		uint64_t value = i_rand_limit(1000000);
+
+		stats_sketch_add(i % 3 == 0 ? sketch1 : sketch2, value);
+		stats_sketch_add(all, value);
+	}
+	stats_sketch_merge(sketch1, sketch2);
+	test_assert(stats_sketch_get_count(sketch1) ==
+		    stats_sketch_get_count(all));
+	test_assert(stats_sketch_get_sum(sketch1) == stats_sketch_get_sum(all));
+	test_assert(stats_sketch_get_min(sketch1) == stats_sketch_get_min(all));
+	test_assert(stats_sketch_get_max(sketch1) == stats_sketch_get_max(all));
+	for (i = 1; i <= 100; i++) {
+		test_assert_idx(stats_sketch_get_percentile(sketch1, i/100.0) ==
+				stats_sketch_get_percentile(all, i/100.0), i);
+	}
+
+	/* merging to an empty sketch */
+	stats_sketch_reset(sketch2);
+	stats_sketch_merge(sketch2, all);
+	test_assert(stats_sketch_get_min(sketch2) == stats_sketch_get_min(all));
+	test_assert(stats_sketch_get_percentile(sketch2, 0.5) ==
+		    stats_sketch_get_percentile(all, 0.5));
+
+	stats_sketch_deinit(&sketch1);
+	stats_sketch_deinit(&sketch2);
+	stats_sketch_deinit(&all);
+	test_end();
+}
+
+static void test_stats_sketch_export_import(void)
+{
+	static const char *const invalid[] = {
+		"",
+		"6 1 2 3",
+		"5 1 2 3 1 1",
+		"6 2 1 3 1 1",
+		"6 1 2 x 1 1",
+		"6 1 2 3 1 1 x",
+		"6 1 2 3 0 1",
+		"6 1 2 3 1 1 1 1",
+	};
+	struct stats_sketch *sketch, *imported;
+	const char *error;
+	string_t *str = t_str_new(128);
+	unsigned int i;
+
+	test_begin("stats_sketch export/import");
+	sketch = stats_sketch_init();
+	imported = stats_sketch_init();
+
+	stats_sketch_export(sketch, str);
+	test_assert_strcmp(str_c(str), "6 0 0 0 0");
+	test_assert(stats_sketch_import(imported, str_c(str), &error) == 0);
+	test_assert(stats_sketch_get_count(imported) == 0);
+
+	stats_sketch_add(sketch, 3);
+	stats_sketch_add(sketch, 5);
+	stats_sketch_add(sketch, 3);
+	str_truncate(str, 0);
+	stats_sketch_export(sketch, str);
+	test_assert_strcmp(str_c(str), "6 3 5 11 3 2 0 1");
+
+	for (i = 0; i < 1000; i++)
+		stats_sketch_add(sketch, i_rand_limit(100000));
+	str_truncate(str, 0);
+	stats_sketch_export(sketch, str);
+	test_assert(stats_sketch_import(imported, str_c(str), &error) == 0);
+	test_assert(stats_sketch_get_count(imported) ==
+		    stats_sketch_get_count(sketch));
+	test_assert(stats_sketch_get_sum(imported) ==
+		    stats_sketch_get_sum(sketch));
+	test_assert(stats_sketch_get_min(imported) ==
+		    stats_sketch_get_min(sketch));
+	test_assert(stats_sketch_get_max(imported) ==
+		    stats_sketch_get_max(sketch));
+	test_assert(stats_sketch_get_percentile(imported, 0.99) ==
+		    stats_sketch_get_percentile(sketch, 0.99));
+
+	/* importing again adds the events */
+	test_assert(stats_sketch_import(imported, str_c(str), &error) == 0);
+	test_assert(stats_sketch_get_count(imported) ==
+		    2 * stats_sketch_get_count(sketch));
+
+	for (i = 0; i < N_ELEMENTS(invalid); i++) {
+		error = NULL;
+		test_assert_idx(stats_sketch_import(imported, invalid[i],
+						    &error) < 0, i);
+		test_assert_idx(error != NULL, i);
+	}
+	test_assert(stats_sketch_get_count(imported) ==
+		    2 * stats_sketch_get_count(sketch));
+
+	stats_sketch_deinit(&sketch);
+	stats_sketch_deinit(&imported);
+	test_end();
+}
+
+static void test_stats_dist_sketch(void)
+{
+	struct stats_dist *dist1, *dist2;
+	const uint64_t *samples;
+	unsigned int i, count;
+
+	test_begin("stats_dist with sketch");
+	dist1 = stats_dist_init_sketch();
+	dist2 = stats_dist_init_sketch();
+	for (i = 1; i <= 8; i++)
+		stats_dist_add(i <= 4 ? dist1 : dist2, i);
+	stats_dist_merge(dist1, dist2);
+	test_assert(stats_dist_get_count(dist1) == 8);
+	test_assert(stats_dist_get_sum(dist1) == 36);
+	test_assert(stats_dist_get_min(dist1) == 1);
+	test_assert(stats_dist_get_max(dist1) == 8);
+	test_assert(stats_dist_get_median(dist1) == 4);
+	test_assert(stats_dist_get_95th(dist1) == 8);
+	test_assert(DBL_EQ(stats_dist_get_variance(dist1), 5.25));
+	test_assert(stats_sketch_get_count(stats_dist_get_sketch(dist1)) == 8);
+	samples = stats_dist_get_samples(dist1, &count);
+	test_assert(samples != NULL && count == 0);
+
+	stats_dist_reset(dist1);
+	test_assert(stats_dist_get_count(dist1) == 0);
+	test_assert(stats_sketch_get_count(stats_dist_get_sketch(dist1)) == 0);
+	stats_dist_deinit(&dist1);
+	stats_dist_deinit(&dist2);
+	test_end();
+}
+
+void test_stats_sketch(void)
+{
+	test_stats_sketch_small();
+	test_stats_sketch_large();
+	test_stats_sketch_merge();
+	test_stats_sketch_export_import();
+	test_stats_dist_sketch();
+}
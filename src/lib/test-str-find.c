@@ -56,6 +56,63 @@ struct str_find_input {
 	int pos;
 };
 
+static int
+test_str_find_naive(const unsigned char *data, size_t size,
+		    const unsigned char *key, size_t key_len)
+{
+	size_t i;
+
+	for (i = 0; i + key_len <= size; i++) {
+		if (memcmp(data + i, key, key_len) == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+static void test_str_find_long(void)
+{
+	unsigned char data[1024], key[40];
+	struct str_find_context *ctx;
+	unsigned int i, n, key_len, size, pos, block_size;
+	int expected_pos, found_pos;
+
+	test_begin("str_find() long");
+	for (n = 0; n < 2000; n++) T_BEGIN {
+		/* use a small alphabet to get plenty of partial matches */
+		size = i_rand_minmax(1, sizeof(data));
+		for (i = 0; i < size; i++)
+			data[i] = 'a' + i_rand_limit(n % 2 == 0 ? 3 : 26);
+		key_len = i_rand_minmax(1, sizeof(key) - 1);
+		if (key_len > size || i_rand_limit(2) == 0) {
+			for (i = 0; i < key_len; i++)
+				key[i] = 'a' + i_rand_limit(3);
+		} else {
+			/* get the key from the data */
+			memcpy(key, data + i_rand_limit(size - key_len + 1),
+			       key_len);
+		}
+		key[key_len] = '\0';
+		expected_pos = test_str_find_naive(data, size, key, key_len);
+
+		ctx = str_find_init(pool_datastack_create(), (const char *)key);
+		found_pos = -1;
+		for (pos = 0; pos < size; pos += block_size) {
+			block_size = n % 3 == 0 ? size :
+				i_rand_minmax(1, key_len * 3);
+			if (block_size > size - pos)
+				block_size = size - pos;
+			if (str_find_more(ctx, data + pos, block_size)) {
+				found_pos = pos + str_find_get_match_end_pos(ctx) -
+					key_len;
+				break;
+			}
+		}
+		test_assert_idx(found_pos == expected_pos, n);
+		str_find_deinit(&ctx);
+	} T_END;
+	test_end();
+}
+
 void test_str_find(void)
 {
 	static const char *fail_input[] = {
@@ -83,4 +140,6 @@ void test_str_find(void)
 	for (i = 0; i < N_ELEMENTS(fail_input) && success; i++)
 		success = test_str_find_substring(fail_input[i], -1);
 	test_out("str_find()", success);
+
+	test_str_find_long();
 }
@@ -718,6 +718,21 @@ static void test_memcspn(void)
 		test_assert_ucmp_idx(a, ==, b, i);
 	}
 
+	/* longer inputs with a few reject bytes */
+	unsigned char data[100];
+	for (unsigned int n = 0; n < 1000; n++) {
+		size_t data_len = i_rand_limit(sizeof(data) + 1);
+		size_t reject_len = i_rand_minmax(1, 5), expected;
+		for (size_t j = 0; j < data_len; j++)
+			data[j] = 'a' + i_rand_limit(n % 2 == 0 ? 26 : 200);
+		for (expected = 0; expected < data_len; expected++) {
+			if (memchr("xyz\n\r", data[expected], reject_len) != NULL)
+				break;
+		}
+		test_assert_idx(i_memcspn(data, data_len,
+					  "xyz\n\r", reject_len) == expected, n);
+	}
+
 	test_end();
 }
 
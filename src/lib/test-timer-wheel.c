@@ -0,0 +1,150 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "test-lib.h"
+#include "timer-wheel.h"
+
+#define TEST_ITEMS_COUNT 1000
+
+struct test_item {
+	struct timer_wheel_item item;
+	uint64_t expire_msecs;
+	bool expired;
+};
+
+static void test_timer_wheel_basic(void)
+{
+	struct timer_wheel *wheel;
+	struct timer_wheel_item *item;
+	struct test_item items[3];
+	uint64_t next;
+
+	test_begin("timer wheel basic");
+	wheel = timer_wheel_init(10, 1000);
+	i_zero(&items);
+	test_assert(!timer_wheel_get_next_msecs(wheel, &next));
+	test_assert(timer_wheel_pop_expired(wheel, 1000000) == NULL);
+
+	/* the wheel time jumped to 1000000 */
+	timer_wheel_add(wheel, &items[0].item, 1000000 + 5);
+	timer_wheel_add(wheel, &items[1].item, 1000000 + 25);
+	timer_wheel_add(wheel, &items[2].item, 1000000 + 60000);
+	test_assert(timer_wheel_count(wheel) == 3);
+	test_assert(timer_wheel_item_is_added(&items[1].item));
+	test_assert(timer_wheel_get_next_msecs(wheel, &next));
+	test_assert(next <= 1000000 + 10);
+
+	/* expiring is rounded up to the next tick */
+	test_assert(timer_wheel_pop_expired(wheel, 1000000 + 9) == NULL);
+	test_assert(timer_wheel_pop_expired(wheel, 1000000 + 10) == &items[0].item);
+	test_assert(timer_wheel_pop_expired(wheel, 1000000 + 10) == NULL);
+	test_assert(!timer_wheel_item_is_added(&items[0].item));
+
+	timer_wheel_remove(wheel, &items[1].item);
+	test_assert(!timer_wheel_item_is_added(&items[1].item));
+	test_assert(timer_wheel_pop_expired(wheel, 1000000 + 59999) == NULL);
+	test_assert(timer_wheel_pop_expired(wheel, 1000000 + 60000) == &items[2].item);
+	test_assert(timer_wheel_count(wheel) == 0);
+
+	/* adding an already expired item */
+	timer_wheel_add(wheel, &items[0].item, 500);
+	test_assert(timer_wheel_get_next_msecs(wheel, &next) && next == 0);
+	test_assert(timer_wheel_pop_expired(wheel, 1000000 + 60000) == &items[0].item);
+
+	/* moving time backwards */
+	timer_wheel_set_time(wheel, 2000);
+	timer_wheel_add(wheel, &items[0].item, 3000);
+	test_assert(timer_wheel_pop_expired(wheel, 2999) == NULL);
+	test_assert(timer_wheel_pop_expired(wheel, 3000) == &items[0].item);
+
+	timer_wheel_add(wheel, &items[0].item, 5000);
+	timer_wheel_add(wheel, &items[1].item, 1ULL << 50);
+	item = timer_wheel_pop(wheel);
+	test_assert(item == &items[0].item || item == &items[1].item);
+	test_assert(timer_wheel_pop(wheel) != NULL);
+	test_assert(timer_wheel_pop(wheel) == NULL);
+	timer_wheel_deinit(&wheel);
+	test_end();
+}
+
+static void
+test_timer_wheel_check(struct test_item *items, uint64_t now, uint64_t next)
+{
+	unsigned int i;
+
+	for (i = 0; i < TEST_ITEMS_COUNT; i++) {
+		if (items[i].expired)
+			continue;
+		/* everything that has expired was popped */
+		test_assert_idx(items[i].expire_msecs > now, i);
+		test_assert_idx(timer_wheel_item_is_added(&items[i].item), i);
+		/* the wheel wants to be processed before the item expires */
+		test_assert_idx(next <= items[i].expire_msecs, i);
+	}
+}
+
+static void test_timer_wheel_random(void)
+{
+	struct timer_wheel *wheel;
+	struct timer_wheel_item *item;
+	struct test_item *items, *titem;
+	uint64_t now = 0, next, max_expire = 0;
+	unsigned int i, count = TEST_ITEMS_COUNT;
+
+	test_begin("timer wheel random");
+	wheel = timer_wheel_init(1, now);
+	items = i_new(struct test_item, TEST_ITEMS_COUNT);
+	for (i = 0; i < TEST_ITEMS_COUNT; i++) {
+		if (i % 100 == 0) {
+			/* further than the wheel covers */
+			items[i].expire_msecs = (1ULL << 37) + i_rand_limit(1000);
+		} else if (i % 10 == 0) {
+			items[i].expire_msecs = i_rand_limit(1 << 30);
+		} else {
+			items[i].expire_msecs = i_rand_limit(1 << 20);
+		}
+		max_expire = I_MAX(max_expire, items[i].expire_msecs);
+		timer_wheel_add(wheel, &items[i].item, items[i].expire_msecs);
+	}
+	test_assert(timer_wheel_count(wheel) == TEST_ITEMS_COUNT);
+
+	while (count > 0) {
+		if (!timer_wheel_get_next_msecs(wheel, &next))
+			i_unreached();
+		test_timer_wheel_check(items, now, next);
+
+		/* jump either to the next wakeup or randomly */
+		if (i_rand_limit(2) == 0 && next > now)
+			now = next;
+		else if (now < (1 << 20))
+			now += i_rand_limit(5000);
+		else
+			now += i_rand_limit(1 << 28);
+		while ((item = timer_wheel_pop_expired(wheel, now)) != NULL) {
+			titem = container_of(item, struct test_item, item);
+			test_assert(titem->expire_msecs <= now);
+			test_assert(!titem->expired);
+			titem->expired = TRUE;
+			count--;
+		}
+		if (count > 0 && i_rand_limit(10) == 0) {
+			/* remove a random item */
+			i = i_rand_limit(TEST_ITEMS_COUNT);
+			if (!items[i].expired) {
+				timer_wheel_remove(wheel, &items[i].item);
+				items[i].expired = TRUE;
+				count--;
+			}
+		}
+	}
+	test_assert(now >= max_expire || timer_wheel_count(wheel) == 0);
+	test_assert(timer_wheel_count(wheel) == 0);
+	timer_wheel_deinit(&wheel);
+	i_free(items);
+	test_end();
+}
+
+void test_timer_wheel(void)
+{
+	test_timer_wheel_basic();
+	test_timer_wheel_random();
+}
@@ -475,6 +475,55 @@ static void test_var_expand_merge_tables(void)
 	test_end();
 }
 
+static void test_var_expand_program(void)
+{
+	static const struct var_expand_test tests[] = {
+		{ "", "", 1 },
+		{ "plain text", "plain text", 1 },
+		{ "%v", "value1234", 1 },
+		{ "a%vb%%c", "avalue1234b%c", 1 },
+		{ "%3.2v%-4.-1v", "ue123", 1 },
+		{ "%Uv@%{long}", "VALUE1234@longvalue", 1 },
+		{ "(uid=%Lu)(cn=%{long})", "(uid=user)(cn=longvalue)", 1 },
+		{ "%{nonexistent}", "UNSUPPORTED_VARIABLE_nonexistent", 0 },
+		{ "%x%v", "UNSUPPORTED_VARIABLE_xvalue1234", 0 },
+		{ "%{long", "UNSUPPORTED_VARIABLE_{long", 0 },
+		{ "foo%", "foo", 1 },
+		{ "foo%5", "foo", 1 },
+	};
+	static const struct var_expand_table table[] = {
+		{ 'v', "value1234", NULL },
+		{ 'u', "USER", NULL },
+		{ '\0', "longvalue", "long" },
+		{ '\0', NULL, NULL }
+	};
+	struct var_expand_program *program;
+	string_t *str = t_str_new(128), *str2 = t_str_new(128);
+	const char *error;
+	unsigned int i, j;
+	pool_t pool;
+
+	test_begin("var_expand_program");
+	pool = pool_alloconly_create("var expand program", 1024);
+	for (i = 0; i < N_ELEMENTS(tests); i++) {
+		program = var_expand_program_create(pool, tests[i].in);
+		/* programs can be executed multiple times */
+		for (j = 0; j < 2; j++) {
+			str_truncate(str, 0);
+			test_assert_idx(var_expand_program_execute(str, program,
+					table, NULL, NULL, &error) == tests[i].ret, i);
+			test_assert_strcmp_idx(str_c(str), tests[i].out, i);
+		}
+		/* same result as parsing each time */
+		str_truncate(str2, 0);
+		test_assert_idx(var_expand(str2, tests[i].in, table, &error) ==
+				tests[i].ret, i);
+		test_assert_strcmp_idx(str_c(str2), str_c(str), i);
+	}
+	pool_unref(&pool);
+	test_end();
+}
+
 void test_var_expand(void)
 {
 	test_var_expand_ranges();
@@ -486,4 +535,5 @@ void test_var_expand(void)
 	test_var_expand_extensions();
 	test_var_expand_if();
 	test_var_expand_merge_tables();
+	test_var_expand_program();
 }
@@ -0,0 +1,304 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "bits.h"
+#include "llist.h"
+#include "timer-wheel.h"
+
+/* Each level has 64 slots, so that a single uint64_t bitmap can tell which
+   of them are non-empty. Level N slot covers 64^N ticks. With 6 levels the
+   wheel covers 2^36 ticks. Items further away than that are placed to the
+   last level's furthest slot and moved again once it's reached. */
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1U << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 6
+#define TIMER_WHEEL_MAX_DELTA \
+	((1ULL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+#define TIMER_WHEEL_LEVEL_SHIFT(level) ((level) * TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_LEVEL_IDX(tick, level) \
+	(((tick) >> TIMER_WHEEL_LEVEL_SHIFT(level)) & TIMER_WHEEL_SLOT_MASK)
+
+struct timer_wheel {
+	unsigned int tick_msecs;
+	/* The next tick that hasn't been processed yet. */
+	uint64_t cur_tick;
+	unsigned int count;
+
+	/* Items that have already expired, but haven't been popped yet. */
+	struct timer_wheel_item *expired;
+
+	uint64_t slot_bitmap[TIMER_WHEEL_LEVELS];
+	struct timer_wheel_item *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+static inline unsigned int timer_wheel_lowest_bit(uint64_t bits)
+{
+	i_assert(bits != 0);
+	return bits_required64(bits & -bits) - 1;
+}
+
+struct timer_wheel *
+timer_wheel_init(unsigned int tick_msecs, uint64_t now_msecs)
+{
+	struct timer_wheel *wheel;
+
+	i_assert(tick_msecs > 0);
+
+	wheel = i_new(struct timer_wheel, 1);
+	wheel->tick_msecs = tick_msecs;
+	wheel->cur_tick = now_msecs / tick_msecs;
+	return wheel;
+}
+
+void timer_wheel_deinit(struct timer_wheel **_wheel)
+{
+	struct timer_wheel *wheel = *_wheel;
+
+	*_wheel = NULL;
+	i_assert(wheel->count == 0);
+	i_free(wheel);
+}
+
+unsigned int timer_wheel_count(const struct timer_wheel *wheel)
+{
+	return wheel->count;
+}
+
+static void
+timer_wheel_link(struct timer_wheel *wheel, struct timer_wheel_item *item)
+{
+	uint64_t tick = item->expire_tick, delta;
+	unsigned int level = 0, idx;
+
+	if (tick < wheel->cur_tick) {
+		item->slot = &wheel->expired;
+		DLLIST_PREPEND(item->slot, item);
+		return;
+	}
+
+	delta = tick - wheel->cur_tick;
+	if (delta > TIMER_WHEEL_MAX_DELTA) {
+		/* too far away - reconsider when the furthest slot is
+		   reached */
+		tick = wheel->cur_tick + TIMER_WHEEL_MAX_DELTA;
+		delta = TIMER_WHEEL_MAX_DELTA;
+	}
+	while ((delta >> TIMER_WHEEL_LEVEL_SHIFT(level + 1)) != 0)
+		level++;
+	i_assert(level < TIMER_WHEEL_LEVELS);
+
+	idx = TIMER_WHEEL_LEVEL_IDX(tick, level);
+	item->slot = &wheel->slots[level][idx];
+	DLLIST_PREPEND(item->slot, item);
+	wheel->slot_bitmap[level] |= 1ULL << idx;
+}
+
+static void
+timer_wheel_unlink(struct timer_wheel *wheel, struct timer_wheel_item *item)
+{
+	struct timer_wheel_item **slot = item->slot;
+	size_t slot_idx;
+
+	DLLIST_REMOVE(slot, item);
+	item->slot = NULL;
+
+	if (*slot == NULL && slot != &wheel->expired) {
+		slot_idx = slot - &wheel->slots[0][0];
+		wheel->slot_bitmap[slot_idx / TIMER_WHEEL_SLOTS] &=
+			~(1ULL << (slot_idx % TIMER_WHEEL_SLOTS));
+	}
+}
+
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_wheel_item *item,
+		     uint64_t expire_msecs)
+{
+	i_assert(!timer_wheel_item_is_added(item));
+
+	/* round up, so the item never expires too early */
+	item->expire_tick = expire_msecs / wheel->tick_msecs +
+		(expire_msecs % wheel->tick_msecs != 0 ? 1 : 0);
+	timer_wheel_link(wheel, item);
+	wheel->count++;
+}
+
+void timer_wheel_remove(struct timer_wheel *wheel,
+			struct timer_wheel_item *item)
+{
+	i_assert(timer_wheel_item_is_added(item));
+	i_assert(wheel->count > 0);
+
+	timer_wheel_unlink(wheel, item);
+	wheel->count--;
+}
+
+static void
+timer_wheel_slot_move(struct timer_wheel *wheel, unsigned int level,
+		      unsigned int idx)
+{
+	struct timer_wheel_item *item, *next;
+
+	item = wheel->slots[level][idx];
+	wheel->slots[level][idx] = NULL;
+	wheel->slot_bitmap[level] &= ~(1ULL << idx);
+
+	for (; item != NULL; item = next) {
+		next = item->next;
+		item->prev = item->next = NULL;
+		timer_wheel_link(wheel, item);
+	}
+}
+
+static void timer_wheel_slot_expire(struct timer_wheel *wheel, unsigned int idx)
+{
+	struct timer_wheel_item *item, *next;
+
+	/* all the items in the level 0 slot expire at cur_tick */
+	item = wheel->slots[0][idx];
+	wheel->slots[0][idx] = NULL;
+	wheel->slot_bitmap[0] &= ~(1ULL << idx);
+
+	for (; item != NULL; item = next) {
+		next = item->next;
+		i_assert(item->expire_tick == wheel->cur_tick);
+		item->slot = &wheel->expired;
+		DLLIST_PREPEND(item->slot, item);
+	}
+}
+
+static void timer_wheel_cascade(struct timer_wheel *wheel)
+{
+	unsigned int level, idx;
+
+	/* cur_tick reached the beginning of a level 1 slot's range. Move its
+	   items to lower levels. If it was also the beginning of the level 2
+	   slot's range, do the same for it, and so on. */
+	for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+		idx = TIMER_WHEEL_LEVEL_IDX(wheel->cur_tick, level);
+		if ((wheel->slot_bitmap[level] & (1ULL << idx)) != 0)
+			timer_wheel_slot_move(wheel, level, idx);
+		if (idx != 0)
+			break;
+	}
+}
+
+static uint64_t timer_wheel_next_tick(const struct timer_wheel *wheel)
+{
+	uint64_t bits, next_tick = UINT64_MAX, tick;
+	unsigned int level, pos, idx, shift;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		bits = wheel->slot_bitmap[level];
+		if (bits == 0)
+			continue;
+		shift = TIMER_WHEEL_LEVEL_SHIFT(level);
+		pos = TIMER_WHEEL_LEVEL_IDX(wheel->cur_tick, level);
+		if (level == 0) {
+			/* pos hasn't been processed yet */
+			bits = (bits >> pos) | (pos == 0 ? 0 :
+				(bits << (TIMER_WHEEL_SLOTS - pos)));
+			idx = timer_wheel_lowest_bit(bits);
+			tick = wheel->cur_tick + idx;
+		} else {
+			/* pos was already cascaded, so the next one is needed
+			   the earliest at the next round */
+			pos = (pos + 1) & TIMER_WHEEL_SLOT_MASK;
+			bits = (bits >> pos) | (pos == 0 ? 0 :
+				(bits << (TIMER_WHEEL_SLOTS - pos)));
+			idx = timer_wheel_lowest_bit(bits);
+			tick = ((wheel->cur_tick >> shift) + idx + 1) << shift;
+		}
+		if (tick < next_tick)
+			next_tick = tick;
+	}
+	return next_tick;
+}
+
+static void timer_wheel_advance(struct timer_wheel *wheel, uint64_t now_tick)
+{
+	uint64_t next_tick;
+	unsigned int idx;
+
+	while (wheel->cur_tick <= now_tick) {
+		idx = TIMER_WHEEL_LEVEL_IDX(wheel->cur_tick, 0);
+		if (idx == 0)
+			timer_wheel_cascade(wheel);
+		if ((wheel->slot_bitmap[0] & (1ULL << idx)) != 0)
+			timer_wheel_slot_expire(wheel, idx);
+		wheel->cur_tick++;
+
+		if (TIMER_WHEEL_LEVEL_IDX(wheel->cur_tick, 0) == 0) {
+			/* level 1 slot needs to be cascaded first */
+			continue;
+		}
+		/* skip directly to the next tick that has something to do */
+		next_tick = timer_wheel_next_tick(wheel);
+		if (next_tick > now_tick + 1)
+			next_tick = now_tick + 1;
+		if (next_tick > wheel->cur_tick)
+			wheel->cur_tick = next_tick;
+	}
+}
+
+bool timer_wheel_get_next_msecs(struct timer_wheel *wheel,
+				uint64_t *next_msecs_r)
+{
+	uint64_t next_tick;
+
+	if (wheel->count == 0)
+		return FALSE;
+	if (wheel->expired != NULL) {
+		*next_msecs_r = 0;
+		return TRUE;
+	}
+
+	if (TIMER_WHEEL_LEVEL_IDX(wheel->cur_tick, 0) == 0) {
+		/* level 1 slot hasn't been cascaded yet */
+		next_tick = wheel->cur_tick;
+	} else {
+		next_tick = timer_wheel_next_tick(wheel);
+	}
+	i_assert(next_tick != UINT64_MAX);
+	*next_msecs_r = next_tick * wheel->tick_msecs;
+	return TRUE;
+}
+
+struct timer_wheel_item *
+timer_wheel_pop_expired(struct timer_wheel *wheel, uint64_t now_msecs)
+{
+	struct timer_wheel_item *item;
+
+	timer_wheel_advance(wheel, now_msecs / wheel->tick_msecs);
+	item = wheel->expired;
+	if (item != NULL)
+		timer_wheel_remove(wheel, item);
+	return item;
+}
+
+struct timer_wheel_item *timer_wheel_pop(struct timer_wheel *wheel)
+{
+	struct timer_wheel_item *item;
+	unsigned int level, idx;
+
+	if (wheel->count == 0)
+		return NULL;
+
+	item = wheel->expired;
+	for (level = 0; item == NULL; level++) {
+		i_assert(level < TIMER_WHEEL_LEVELS);
+		if (wheel->slot_bitmap[level] != 0) {
+			idx = timer_wheel_lowest_bit(wheel->slot_bitmap[level]);
+			item = wheel->slots[level][idx];
+		}
+	}
+	timer_wheel_remove(wheel, item);
+	return item;
+}
+
+void timer_wheel_set_time(struct timer_wheel *wheel, uint64_t now_msecs)
+{
+	i_assert(wheel->count == 0);
+
+	wheel->cur_tick = now_msecs / wheel->tick_msecs;
+}
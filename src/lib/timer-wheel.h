@@ -0,0 +1,57 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+/* Hierarchical timer wheel. Adding, removing and expiring items are O(1)
+   operations, but items expire only with the accuracy of one tick. Items
+   never expire before their expire time, but they can expire up to one
+   tick later.
+
+   The items you add to the wheel should contain a struct timer_wheel_item.
+   Use container_of() to get back to your own struct. */
+
+struct timer_wheel_item {
+	/* Private fields, updated automatically: */
+	struct timer_wheel_item *prev, *next;
+	struct timer_wheel_item **slot;
+	uint64_t expire_tick;
+};
+
+/* Create a new timer wheel. now_msecs is the current time. All the times are
+   given in milliseconds, but they don't need to be related to wall time. */
+struct timer_wheel *
+timer_wheel_init(unsigned int tick_msecs, uint64_t now_msecs);
+void timer_wheel_deinit(struct timer_wheel **wheel);
+
+/* Return number of items in the wheel. */
+unsigned int timer_wheel_count(const struct timer_wheel *wheel) ATTR_PURE;
+/* Returns TRUE if the item has been added to a wheel. The item must have
+   been zero-initialized before it was added the first time. */
+static inline bool timer_wheel_item_is_added(const struct timer_wheel_item *item)
+{
+	return item->slot != NULL;
+}
+
+/* Add a new item to the wheel, to expire at expire_msecs. */
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_wheel_item *item,
+		     uint64_t expire_msecs);
+/* Remove the specified item from the wheel. */
+void timer_wheel_remove(struct timer_wheel *wheel,
+			struct timer_wheel_item *item);
+
+/* Returns TRUE and the time when the wheel needs to be processed next with
+   timer_wheel_pop_expired(), or FALSE if the wheel is empty. The returned
+   time may be earlier than the earliest expire time, but never later than
+   the time when the earliest item can be expired. */
+bool timer_wheel_get_next_msecs(struct timer_wheel *wheel,
+				uint64_t *next_msecs_r);
+/* Remove and return an item that has expired by now_msecs, or NULL if there
+   are no such items. */
+struct timer_wheel_item *
+timer_wheel_pop_expired(struct timer_wheel *wheel, uint64_t now_msecs);
+/* Remove and return any item, or NULL if the wheel is empty. */
+struct timer_wheel_item *timer_wheel_pop(struct timer_wheel *wheel);
+/* Change the wheel's current time. This can be used to handle time moving
+   backwards or forwards. The wheel must be empty. */
+void timer_wheel_set_time(struct timer_wheel *wheel, uint64_t now_msecs);
+
+#endif
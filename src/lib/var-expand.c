@@ -487,19 +487,207 @@ var_expand_long(struct var_expand_context *ctx,
 	return ret;
 }
 
+struct var_expand_var {
+	int offset, width;
+	bool zero_padding;
+
+	const char *(*modifier[MAX_MODIFIER_COUNT])
+		(const char *, struct var_expand_context *);
+	unsigned int modifier_count;
+
+	/* %x key, or long_key for %{long_key} */
+	char key;
+	const char *long_key;
+	size_t long_key_len;
+};
+
+enum var_expand_program_part_type {
+	VAR_EXPAND_PROGRAM_PART_LITERAL,
+	VAR_EXPAND_PROGRAM_PART_VAR,
+};
+
+struct var_expand_program_part {
+	enum var_expand_program_part_type type;
+	/* VAR_EXPAND_PROGRAM_PART_LITERAL */
+	const char *literal;
+	size_t literal_len;
+	/* VAR_EXPAND_PROGRAM_PART_VAR */
+	struct var_expand_var var;
+};
+
+struct var_expand_program {
+	ARRAY(struct var_expand_program_part) parts;
+};
+
+/* Parse [<offset>.]<width>[<modifiers>]<variable> from str, which points
+   after the '%' character. Returns pointer to the last character of the
+   variable, or NULL if the string ended before the variable. */
+static const char *
+var_expand_parse_var(const char *str, struct var_expand_var *var_r)
+{
+	const struct var_expand_modifier *m;
+	const char *end;
+	int sign = 1;
+
+	i_zero(var_r);
+	if (*str == '-') {
+		sign = -1;
+		str++;
+	}
+	if (*str == '0') {
+		var_r->zero_padding = TRUE;
+		str++;
+	}
+	while (*str >= '0' && *str <= '9') {
+		var_r->width = var_r->width*10 + (*str - '0');
+		str++;
+	}
+
+	if (*str == '.') {
+		var_r->offset = sign * var_r->width;
+		sign = 1;
+		var_r->width = 0;
+		str++;
+
+		/* if offset was prefixed with zero (or it was
+		   plain zero), just ignore that. zero padding
+		   is done with the width. */
+		var_r->zero_padding = FALSE;
+		if (*str == '0') {
+			var_r->zero_padding = TRUE;
+			str++;
+		}
+		if (*str == '-') {
+			sign = -1;
+			str++;
+		}
+
+		while (*str >= '0' && *str <= '9') {
+			var_r->width = var_r->width*10 + (*str - '0');
+			str++;
+		}
+		var_r->width = sign * var_r->width;
+	}
+
+	while (var_r->modifier_count < MAX_MODIFIER_COUNT) {
+		var_r->modifier[var_r->modifier_count] = NULL;
+		for (m = modifiers; m->key != '\0'; m++) {
+			if (m->key == *str) {
+				/* @UNSAFE */
+				var_r->modifier[var_r->modifier_count] =
+					m->func;
+				str++;
+				break;
+			}
+		}
+		if (var_r->modifier[var_r->modifier_count] == NULL)
+			break;
+		var_r->modifier_count++;
+	}
+
+	if (*str == '\0')
+		return NULL;
+
+	if (*str == '{' && strchr(str, '}') != NULL) {
+		/* %{long_key} */
+		unsigned int ctr = 1;
+		bool escape = FALSE;
+		end = str;
+		while(*++end != '\0' && ctr > 0) {
+			if (!escape && *end == '\\') {
+				escape = TRUE;
+				continue;
+			}
+			if (escape) {
+				escape = FALSE;
+				continue;
+			}
+			if (*end == '{') ctr++;
+			if (*end == '}') ctr--;
+		}
+		if (ctr == 0)
+			/* it needs to come back a bit */
+			end--;
+		/* if there is no } it will consume rest of the
+		   string */
+		var_r->long_key = str + 1;
+		var_r->long_key_len = end - (str + 1);
+		str = end;
+	} else {
+		var_r->key = *str;
+	}
+	return str;
+}
+
+static int
+var_expand_var(string_t *dest, struct var_expand_context *ctx,
+	       const struct var_expand_var *v, const char **error_r)
+{
+	const char *var = NULL;
+	unsigned int i;
+	int ret;
+
+	/* reset per-field modifiers */
+	ctx->offset = v->offset;
+	ctx->width = v->width;
+	ctx->zero_padding = v->zero_padding;
+
+	if (v->long_key != NULL) {
+		ret = var_expand_long(ctx, v->long_key, v->long_key_len,
+				      &var, error_r);
+	} else {
+		ret = var_expand_short(ctx, v->key, &var, error_r);
+	}
+	i_assert(var != NULL);
+
+	if (ret <= 0) {
+		str_append(dest, var);
+		return ret;
+	}
+
+	for (i = 0; i < v->modifier_count; i++)
+		var = v->modifier[i](var, ctx);
+
+	if (ctx->offset < 0) {
+		/* if offset is < 0 then we want to
+		   start at the end */
+		size_t len = strlen(var);
+		size_t offset_from_end = -ctx->offset;
+
+		if (len > offset_from_end)
+			var += len - offset_from_end;
+	} else {
+		while (*var != '\0' && ctx->offset > 0) {
+			ctx->offset--;
+			var++;
+		}
+	}
+	if (ctx->width == 0)
+		str_append(dest, var);
+	else if (!ctx->zero_padding) {
+		if (ctx->width < 0)
+			ctx->width = strlen(var) - (-ctx->width);
+		str_append_max(dest, var, ctx->width);
+	} else {
+		/* %05d -like padding. no truncation. */
+		ssize_t len = strlen(var);
+		while (len < ctx->width) {
+			str_append_c(dest, '0');
+			ctx->width--;
+		}
+		str_append(dest, var);
+	}
+	return ret;
+}
+
 int var_expand_with_funcs(string_t *dest, const char *str,
 			  const struct var_expand_table *table,
 			  const struct var_expand_func_table *func_table,
 			  void *context, const char **error_r)
 {
-	const struct var_expand_modifier *m;
-	const char *var;
 	struct var_expand_context ctx;
-	const char *(*modifier[MAX_MODIFIER_COUNT])
-		(const char *, struct var_expand_context *);
-	const char *end;
-	unsigned int i, modifier_count;
-	size_t len;
+	struct var_expand_var var;
+	const char *p;
 	int ret, final_ret = 1;
 
 	*error_r = NULL;
@@ -510,150 +698,89 @@ int var_expand_with_funcs(string_t *dest, const char *str,
 	ctx.context = context;
 
 	for (; *str != '\0'; str++) {
-		if (*str != '%')
-			str_append_c(dest, *str);
-		else {
-			int sign = 1;
-
-			str++;
-
-			/* reset per-field modifiers */
-			ctx.offset = 0;
-			ctx.width = 0;
-			ctx.zero_padding = FALSE;
-
-			/* [<offset>.]<width>[<modifiers>]<variable> */
-			if (*str == '-') {
-				sign = -1;
-				str++;
-			}
-			if (*str == '0') {
-				ctx.zero_padding = TRUE;
-				str++;
-			}
-			while (*str >= '0' && *str <= '9') {
-				ctx.width = ctx.width*10 + (*str - '0');
-				str++;
+		if (*str != '%') {
+			p = strchr(str, '%');
+			if (p == NULL) {
+				str_append(dest, str);
+				break;
 			}
+			str_append_data(dest, str, p - str);
+			str = p;
+		}
+		str = var_expand_parse_var(str + 1, &var);
+		if (str == NULL)
+			break;
+		ret = var_expand_var(dest, &ctx, &var, error_r);
+		if (final_ret > ret)
+			final_ret = ret;
+	}
+	return final_ret;
+}
 
-			if (*str == '.') {
-				ctx.offset = sign * ctx.width;
-				sign = 1;
-				ctx.width = 0;
-				str++;
-
-				/* if offset was prefixed with zero (or it was
-				   plain zero), just ignore that. zero padding
-				   is done with the width. */
-				ctx.zero_padding = FALSE;
-				if (*str == '0') {
-					ctx.zero_padding = TRUE;
-					str++;
-				}
-				if (*str == '-') {
-					sign = -1;
-					str++;
-				}
-
-				while (*str >= '0' && *str <= '9') {
-					ctx.width = ctx.width*10 + (*str - '0');
-					str++;
-				}
-				ctx.width = sign * ctx.width;
-			}
+struct var_expand_program *
+var_expand_program_create(pool_t pool, const char *str)
+{
+	struct var_expand_program *program;
+	struct var_expand_program_part *part;
+	const char *p;
 
-			modifier_count = 0;
-			while (modifier_count < MAX_MODIFIER_COUNT) {
-				modifier[modifier_count] = NULL;
-				for (m = modifiers; m->key != '\0'; m++) {
-					if (m->key == *str) {
-						/* @UNSAFE */
-						modifier[modifier_count] =
-							m->func;
-						str++;
-						break;
-					}
-				}
-				if (modifier[modifier_count] == NULL)
-					break;
-				modifier_count++;
-			}
+	program = p_new(pool, struct var_expand_program, 1);
+	p_array_init(&program->parts, pool, 8);
+	/* the parsed variables point to the string */
+	str = p_strdup(pool, str);
 
-			if (*str == '\0')
+	for (; *str != '\0'; str++) {
+		if (*str != '%') {
+			p = strchr(str, '%');
+			if (p == NULL)
+				p = str + strlen(str);
+			part = array_append_space(&program->parts);
+			part->type = VAR_EXPAND_PROGRAM_PART_LITERAL;
+			part->literal = str;
+			part->literal_len = p - str;
+			if (*p == '\0')
 				break;
+			str = p;
+		}
+		part = array_append_space(&program->parts);
+		str = var_expand_parse_var(str + 1, &part->var);
+		if (str == NULL) {
+			array_pop_back(&program->parts);
+			break;
+		}
+		part->type = VAR_EXPAND_PROGRAM_PART_VAR;
+	}
+	return program;
+}
 
-			var = NULL;
-			if (*str == '{' && strchr(str, '}') != NULL) {
-				/* %{long_key} */
-				unsigned int ctr = 1;
-				bool escape = FALSE;
-				end = str;
-				while(*++end != '\0' && ctr > 0) {
-					if (!escape && *end == '\\') {
-						escape = TRUE;
-						continue;
-					}
-					if (escape) {
-						escape = FALSE;
-						continue;
-					}
-					if (*end == '{') ctr++;
-					if (*end == '}') ctr--;
-				}
-				if (ctr == 0)
-					/* it needs to come back a bit */
-					end--;
-				/* if there is no } it will consume rest of the
-				   string */
-				len = end - (str + 1);
-				ret = var_expand_long(&ctx, str+1, len,
-						      &var, error_r);
-				str = end;
-			} else {
-				ret = var_expand_short(&ctx, *str,
-						       &var, error_r);
-			}
-			i_assert(var != NULL);
+int var_expand_program_execute(string_t *dest,
+			       const struct var_expand_program *program,
+			       const struct var_expand_table *table,
+			       const struct var_expand_func_table *func_table,
+			       void *context, const char **error_r)
+{
+	const struct var_expand_program_part *part;
+	struct var_expand_context ctx;
+	int ret, final_ret = 1;
+
+	*error_r = NULL;
+
+	i_zero(&ctx);
+	ctx.table = table;
+	ctx.func_table = func_table;
+	ctx.context = context;
 
+	array_foreach(&program->parts, part) {
+		switch (part->type) {
+		case VAR_EXPAND_PROGRAM_PART_LITERAL:
+			str_append_data(dest, part->literal,
+					part->literal_len);
+			break;
+		case VAR_EXPAND_PROGRAM_PART_VAR:
+			ret = var_expand_var(dest, &ctx, &part->var, error_r);
 			if (final_ret > ret)
 				final_ret = ret;
-
-			if (ret <= 0)
-				str_append(dest, var);
-			else {
-				for (i = 0; i < modifier_count; i++)
-					var = modifier[i](var, &ctx);
-
-				if (ctx.offset < 0) {
-					/* if offset is < 0 then we want to
-					   start at the end */
-					size_t len = strlen(var);
-					size_t offset_from_end = -ctx.offset;
-
-					if (len > offset_from_end)
-						var += len - offset_from_end;
-				} else {
-					while (*var != '\0' && ctx.offset > 0) {
-						ctx.offset--;
-						var++;
-					}
-				}
-				if (ctx.width == 0)
-					str_append(dest, var);
-				else if (!ctx.zero_padding) {
-					if (ctx.width < 0)
-						ctx.width = strlen(var) - (-ctx.width);
-					str_append_max(dest, var, ctx.width);
-				} else {
-					/* %05d -like padding. no truncation. */
-					ssize_t len = strlen(var);
-					while (len < ctx.width) {
-						str_append_c(dest, '0');
-						ctx.width--;
-					}
-					str_append(dest, var);
-				}
-			}
+			break;
 		}
 	}
 	return final_ret;
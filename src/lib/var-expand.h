@@ -1,6 +1,8 @@
 #ifndef VAR_EXPAND_H
 #define VAR_EXPAND_H
 
+struct var_expand_program;
+
 struct var_expand_table {
 	char key;
 	const char *value;
@@ -30,6 +32,18 @@ int var_expand_with_funcs(string_t *dest, const char *str,
 			  const struct var_expand_func_table *func_table,
 			  void *func_context, const char **error_r) ATTR_NULL(3, 4, 5);
 
+/* Parse str into a program that can be expanded multiple times without
+   parsing it again. The program is allocated from pool. */
+struct var_expand_program *
+var_expand_program_create(pool_t pool, const char *str);
+/* Same as var_expand_with_funcs(), but expand a parsed program. */
+int var_expand_program_execute(string_t *dest,
+			       const struct var_expand_program *program,
+			       const struct var_expand_table *table,
+			       const struct var_expand_func_table *func_table,
+			       void *func_context, const char **error_r)
+	ATTR_NULL(3, 4, 5);
+
 /* Returns the actual key character for given string, ie. skip any modifiers
    that are before it. The string should be the data after the '%' character.
    For %{long_variable}, '{' is returned. */
@@ -266,6 +266,7 @@ client_default_destroy(struct client *client)
 		mail_user_deinit(&client->raw_mail_user);
 
 	client_state_reset(client);
+	lmtp_proxy_pool_deinit(&client->proxy_pool);
 	event_unref(&client->event);
 	pool_unref(&client->state_pool);
 	pool_unref(&client->pool);
@@ -339,6 +340,9 @@ client_connection_proxy_data_updated(void *context,
 
 	client->remote_ip = data->source_ip;
 	client->remote_port = data->source_port;
+	/* the existing backend connections have the old proxy data */
+	if (client->proxy == NULL)
+		lmtp_proxy_pool_deinit(&client->proxy_pool);
 	if (data->client_transport != NULL) {
 		client->end_client_tls_secured = TRUE;
 		client->end_client_tls_secured =
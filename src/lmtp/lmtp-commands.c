@@ -9,6 +9,7 @@
 #include "iostream-temp.h"
 #include "master-service.h"
 #include "settings-parser.h"
+#include "sampling-profiler.h"
 #include "mail-user.h"
 #include "smtp-address.h"
 #include "mail-deliver.h"
@@ -27,8 +28,13 @@ int cmd_mail(void *conn_ctx,
 	     struct smtp_server_cmd_mail *data)
 {
 	struct client *client = (struct client *)conn_ctx;
+	const char *old_label;
+	int ret;
 
-	return client->v.cmd_mail(client, cmd, data);
+	old_label = sampling_profiler_set_label("MAIL");
+	ret = client->v.cmd_mail(client, cmd, data);
+	sampling_profiler_set_label(old_label);
+	return ret;
 }
 
 int client_default_cmd_mail(struct client *client,
@@ -93,6 +99,8 @@ int cmd_rcpt(void *conn_ctx, struct smtp_server_cmd_ctx *cmd,
 	struct client *client = (struct client *)conn_ctx;
 	struct smtp_server_transaction *trans;
 	struct lmtp_recipient *lrcpt;
+	const char *old_label;
+	int ret;
 
 	i_assert(!smtp_address_isnull(rcpt->path));
 	if (*rcpt->path->localpart == '\0' && rcpt->path->domain == NULL) {
@@ -110,7 +118,10 @@ int cmd_rcpt(void *conn_ctx, struct smtp_server_cmd_ctx *cmd,
 	if (cmd_rcpt_handle_forward_fields(cmd, lrcpt) < 0)
 		return -1;
 
-	return client->v.cmd_rcpt(client, cmd, lrcpt);
+	old_label = sampling_profiler_set_label("RCPT");
+	ret = client->v.cmd_rcpt(client, cmd, lrcpt);
+	sampling_profiler_set_label(old_label);
+	return ret;
 }
 
 int client_default_cmd_rcpt(struct client *client,
@@ -187,6 +198,7 @@ cmd_data_finish(struct client *client,
 {
 	struct client_state *state = &client->state;
 	struct istream *input_msg;
+	const char *old_label;
 	int ret;
 
 	i_assert(HAS_ALL_BITS(trans->flags,
@@ -198,8 +210,10 @@ cmd_data_finish(struct client *client,
 	input_msg = iostream_temp_finish(&state->mail_data_output,
 					 IO_BLOCK_SIZE);
 
+	old_label = sampling_profiler_set_label("DATA");
 	ret = client->v.cmd_data(client, cmd, trans,
 				 input_msg, client->state.data_size);
+	sampling_profiler_set_label(old_label);
 	i_stream_unref(&input_msg);
 
 	return ret;
@@ -261,8 +275,13 @@ int cmd_data_begin(void *conn_ctx,
 
 	path = t_str_new(256);
 	mail_user_set_get_temp_prefix(path, client->raw_mail_user->set);
+	/* Messages up to lmtp_data_max_memory_size are kept in memory, so
+	   they're written to disk only once when they are saved. */
+	iostream_temp_set_max_total_mem_size(
+		(size_t)client->lmtp_set->lmtp_data_max_total_memory_size);
 	client->state.mail_data_output =
-		iostream_temp_create_named(str_c(path), 0, "(lmtp data)");
+		iostream_temp_create_sized(str_c(path), 0, "(lmtp data)",
+			(size_t)client->lmtp_set->lmtp_data_max_memory_size);
 
 	client->state.data_input = data_input;
 	return 0;
@@ -25,16 +25,29 @@
 #include "lmtp-settings.h"
 #include "lmtp-recipient.h"
 #include "lmtp-local.h"
+#include "lmtp-user-cache.h"
+
+/* Maximum number of mail users kept initialized between the RCPT quota
+   check and the delivery in a single transaction. */
+#define LMTP_LOCAL_MAX_KEPT_USERS 100
 
 struct lmtp_local_recipient {
 	struct lmtp_recipient *rcpt;
 
 	struct mail_storage_service_user *service_user;
+	/* mail user initialized by the RCPT quota check, used for the
+	   delivery */
+	struct mail_user *rcpt_user;
 	struct anvil_query *anvil_query;
 	guid_128_t anvil_conn_guid;
 
 	struct lmtp_local_recipient *duplicate;
 
+	/* Time spent in the delivery phases before mail_deliver() */
+	uint64_t userdb_lookup_usecs;
+	uint64_t quota_check_usecs;
+	uint64_t user_init_usecs;
+
 	bool anvil_connect_sent:1;
 };
 
@@ -45,6 +58,7 @@ struct lmtp_local {
 
 	struct mail *raw_mail, *first_saved_mail;
 	struct mail_user *rcpt_user;
+	unsigned int kept_users_count;
 
 	struct smtp_server_stats stats;
 };
@@ -118,6 +132,12 @@ lmtp_local_rcpt_destroy(struct smtp_server_recipient *rcpt ATTR_UNUSED,
 	if (llrcpt->anvil_query != NULL)
 		anvil_client_query_abort(anvil, &llrcpt->anvil_query);
 	lmtp_local_rcpt_anvil_disconnect(llrcpt);
+	if (llrcpt->rcpt_user != NULL) {
+		/* no delivery was done */
+		mail_storage_service_io_activate_user(llrcpt->service_user);
+		mail_user_deinit(&llrcpt->rcpt_user);
+		mail_storage_service_io_deactivate_user(llrcpt->service_user);
+	}
 	mail_storage_service_user_unref(&llrcpt->service_user);
 }
 
@@ -162,6 +182,25 @@ lmtp_local_rcpt_fail_all(struct lmtp_local *local,
  * RCPT command
  */
 
+static bool
+lmtp_local_rcpt_can_keep_user(struct lmtp_local_recipient *llrcpt)
+{
+	struct client *client = llrcpt->rcpt->client;
+	struct smtp_proxy_data proxy_data;
+
+	if (client->local->kept_users_count >= LMTP_LOCAL_MAX_KEPT_USERS)
+		return FALSE;
+	/* The delivery changes the user's settings when the proxy has
+	   a timeout, so the user must be initialized only after that. */
+	smtp_server_connection_get_proxy_data(client->conn, &proxy_data);
+	if (proxy_data.timeout_secs > 0)
+		return FALSE;
+	/* When running as root, privileges are switched between the users
+	   only while initializing them. Keep the users only when lmtp
+	   runs as the (shared) user itself. */
+	return getuid() != 0;
+}
+
 static int
 lmtp_local_rcpt_check_quota(struct lmtp_local_recipient *llrcpt)
 {
@@ -174,10 +213,13 @@ lmtp_local_rcpt_check_quota(struct lmtp_local_recipient *llrcpt)
 	struct mailbox_status status;
 	enum mail_error mail_error;
 	const char *error;
+	uint64_t start_usecs;
+	bool keep_user;
 	int ret;
 
 	if (!client->lmtp_set->lmtp_rcpt_check_quota)
 		return 0;
+	start_usecs = i_microseconds();
 
 	/* mail user will be created second time when mail is saved,
 	   so it's session_id needs to be different,
@@ -185,11 +227,18 @@ lmtp_local_rcpt_check_quota(struct lmtp_local_recipient *llrcpt)
 	   mail user session id for the first rcpt should not overlap with session id
 	   of the second recipient, so add custom ":quota" suffix to the session_id without
 	   session_id counter increment, so next time mail user will get
-	   the same session id as rcpt */
-	ret = mail_storage_service_next_with_session_suffix(storage_service,
-							    llrcpt->service_user,
-							    "quota",
-							    &user, &error);
+	   the same session id as rcpt. If the mail user can be kept for
+	   the delivery, it's created only once with the rcpt session_id. */
+	keep_user = lmtp_local_rcpt_can_keep_user(llrcpt);
+	if (keep_user) {
+		ret = mail_storage_service_next(storage_service,
+						llrcpt->service_user,
+						&user, &error);
+	} else {
+		ret = mail_storage_service_next_with_session_suffix(
+			storage_service, llrcpt->service_user, "quota",
+			&user, &error);
+	}
 
 	if (ret < 0) {
 		e_error(rcpt->event, "Failed to initialize user %s: %s",
@@ -218,9 +267,15 @@ lmtp_local_rcpt_check_quota(struct lmtp_local_recipient *llrcpt)
 			ret = -1;
 		}
 		mailbox_free(&box);
-		mail_user_deinit(&user);
+		if (ret == 0 && keep_user) {
+			llrcpt->rcpt_user = user;
+			client->local->kept_users_count++;
+		} else {
+			mail_user_deinit(&user);
+		}
 		mail_storage_service_io_deactivate_user(llrcpt->service_user);
 	}
+	llrcpt->quota_check_usecs = i_microseconds() - start_usecs;
 
 	if (ret < 0 && !smtp_server_recipient_is_replied(rcpt)) {
 		smtp_server_recipient_reply(rcpt, 451, "4.3.0",
@@ -301,6 +356,7 @@ int lmtp_local_rcpt(struct client *client,
 	struct mail_storage_service_input input;
 	struct mail_storage_service_user *service_user;
 	const char *error = NULL, *username = lrcpt->username;
+	uint64_t start_usecs;
 	int ret = 0;
 
 	i_zero(&input);
@@ -318,6 +374,7 @@ int lmtp_local_rcpt(struct client *client,
 	input.forward_fields = lrcpt->forward_fields;
 	input.event_parent = rcpt->event;
 
+	start_usecs = i_microseconds();
 	ret = mail_storage_service_lookup(storage_service, &input,
 					  &service_user, &error);
 	if (ret < 0) {
@@ -340,6 +397,7 @@ int lmtp_local_rcpt(struct client *client,
 	llrcpt = p_new(rcpt->pool, struct lmtp_local_recipient, 1);
 	llrcpt->rcpt = lrcpt;
 	llrcpt->service_user = service_user;
+	llrcpt->userdb_lookup_usecs = i_microseconds() - start_usecs;
 
 	lrcpt->type = LMTP_RECIPIENT_TYPE_LOCAL;
 	lrcpt->backend_context = llrcpt;
@@ -462,19 +520,33 @@ lmtp_local_deliver(struct lmtp_local *local,
 	lldctx.delivery_time_started = ioloop_timeval;
 
 	client_update_data_state(client, username);
-	if (mail_storage_service_next(storage_service, service_user,
-				      &rcpt_user, &error) < 0) {
+	if (llrcpt->rcpt_user != NULL) {
+		/* already initialized by the RCPT quota check */
+		rcpt_user = llrcpt->rcpt_user;
+		llrcpt->rcpt_user = NULL;
+		mail_storage_service_io_activate_user(service_user);
+	} else if (proxy_data.timeout_secs == 0 &&
+		   (rcpt_user = lmtp_user_cache_get(client->lmtp_set,
+						    service_user,
+						    lrcpt->session_id)) != NULL) {
+		/* initialized by an earlier delivery */
+	} else if (mail_storage_service_next(storage_service, service_user,
+					     &rcpt_user, &error) < 0) {
 		e_error(rcpt->event, "Failed to initialize user: %s", error);
 		smtp_server_recipient_reply(rcpt, 451, "4.3.0",
 					    "Temporary internal error");
 		return -1;
 	}
 	local->rcpt_user = rcpt_user;
+	io_loop_time_refresh();
+	llrcpt->user_init_usecs =
+		timeval_diff_usecs(&ioloop_timeval,
+				   &lldctx.delivery_time_started);
 
 	/* Set the log prefix for the user. The default log prefix is
 	   automatically restored later when user context gets deactivated. */
 	i_set_failure_prefix("%s",
-		mail_storage_service_user_get_log_prefix(service_user));
+		mail_storage_service_user_get_log_prefix(rcpt_user->service_user));
 
 	lldctx.rcpt_user = rcpt_user;
 	lldctx.smtp_set = settings_parser_get_root_set(rcpt_user->set_parser,
@@ -555,6 +627,11 @@ int lmtp_local_default_deliver(struct client *client,
 
 	event = event_create(rcpt->event);
 	event_drop_parent_log_prefixes(event, 3);
+	/* inherited by the mail_delivery_finished event */
+	event_add_int(event, "userdb_lookup_usecs",
+		      llrcpt->userdb_lookup_usecs);
+	event_add_int(event, "quota_check_usecs", llrcpt->quota_check_usecs);
+	event_add_int(event, "user_init_usecs", llrcpt->user_init_usecs);
 
 	i_zero(&dinput);
 	dinput.session = lldctx->session;
@@ -613,6 +690,20 @@ int lmtp_local_default_deliver(struct client *client,
 	return ret;
 }
 
+static void
+lmtp_local_user_deinit(struct lmtp_local *local, struct mail_user **user)
+{
+	struct smtp_proxy_data proxy_data;
+
+	/* Users whose settings were changed for the proxy timeout can't be
+	   reused. */
+	smtp_server_connection_get_proxy_data(local->client->conn, &proxy_data);
+	if (proxy_data.timeout_secs == 0)
+		lmtp_user_cache_put(local->client->lmtp_set, user);
+	else
+		mail_user_deinit(user);
+}
+
 static uid_t
 lmtp_local_deliver_to_rcpts(struct lmtp_local *local,
 			    struct smtp_server_cmd_ctx *cmd,
@@ -656,7 +747,10 @@ lmtp_local_deliver_to_rcpts(struct lmtp_local *local,
 			if (i == (count - 1))
 				mail_user_autoexpunge(local->rcpt_user);
 			mail_storage_service_io_deactivate_user(local->rcpt_user->service_user);
-			mail_user_deinit(&local->rcpt_user);
+			if (ret == 0)
+				lmtp_local_user_deinit(local, &local->rcpt_user);
+			else
+				mail_user_deinit(&local->rcpt_user);
 		} else if (ret == 0) {
 			/* use the first saved message to save it elsewhere too.
 			   this might allow hard linking the files.
@@ -747,7 +841,7 @@ void lmtp_local_data(struct client *client,
 		mailbox_free(&box);
 		mail_user_autoexpunge(user);
 		mail_storage_service_io_deactivate_user(user->service_user);
-		mail_user_deinit(&user);
+		lmtp_local_user_deinit(local, &user);
 	}
 
 	if (old_uid == 0) {
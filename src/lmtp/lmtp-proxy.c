@@ -28,6 +28,11 @@
 #define LMTP_MAX_REPLY_SIZE 4096
 #define LMTP_PROXY_DEFAULT_TIMEOUT_MSECS (1000*125)
 
+/* Maximum number of idle backend connections kept for a client connection */
+#define LMTP_PROXY_POOL_MAX_IDLE_CONNECTIONS 8
+/* How long to keep an idle backend connection for the next transaction */
+#define LMTP_PROXY_POOL_IDLE_TIMEOUT_MSECS (60*1000)
+
 struct lmtp_proxy_redirect {
 	struct ip_addr ip;
 	in_port_t port;
@@ -71,6 +76,23 @@ struct lmtp_proxy_connection {
 	bool failed:1;
 };
 
+struct lmtp_proxy_idle_connection {
+	struct lmtp_proxy_pool *pool;
+	struct lmtp_proxy_rcpt_settings set;
+	char *host;
+
+	struct smtp_client_connection *lmtp_conn;
+	struct timeout *to_idle;
+};
+
+/* Backend connections of a client connection, which are reused by its later
+   transactions. The pool is per client connection, because the proxy data
+   (XCLIENT) is sent only once for each backend connection. */
+struct lmtp_proxy_pool {
+	struct smtp_client *lmtp_client;
+	ARRAY(struct lmtp_proxy_idle_connection *) idle_conns;
+};
+
 struct lmtp_proxy {
 	struct client *client;
 
@@ -95,6 +117,129 @@ static void
 lmtp_proxy_data_cb(const struct smtp_reply *reply,
 		   struct lmtp_proxy_recipient *lprcpt);
 
+static bool
+lmtp_proxy_rcpt_settings_equal(const struct lmtp_proxy_rcpt_settings *set1,
+			       const struct lmtp_proxy_rcpt_settings *set2)
+{
+	return set1->protocol == set2->protocol &&
+		set1->set.port == set2->set.port &&
+		strcmp(set1->set.host, set2->set.host) == 0 &&
+		(set2->set.host_ip.family == 0 ||
+		 net_ip_compare(&set1->set.host_ip, &set2->set.host_ip)) &&
+		net_ip_compare(&set1->set.source_ip, &set2->set.source_ip) &&
+		set1->set.ssl_flags == set2->set.ssl_flags;
+}
+
+/*
+ * Connection pool
+ */
+
+static struct lmtp_proxy_pool *
+lmtp_proxy_pool_init(const struct smtp_client_settings *lmtp_set)
+{
+	struct lmtp_proxy_pool *pool;
+
+	pool = i_new(struct lmtp_proxy_pool, 1);
+	pool->lmtp_client = smtp_client_init(lmtp_set);
+	i_array_init(&pool->idle_conns, 4);
+	return pool;
+}
+
+static void
+lmtp_proxy_pool_idle_connection_free(struct lmtp_proxy_idle_connection *iconn)
+{
+	timeout_remove(&iconn->to_idle);
+	i_free(iconn->host);
+	i_free(iconn);
+}
+
+static void
+lmtp_proxy_pool_idle_timeout(struct lmtp_proxy_idle_connection *iconn)
+{
+	struct lmtp_proxy_idle_connection *const *iconns;
+	unsigned int i, count;
+
+	iconns = array_get(&iconn->pool->idle_conns, &count);
+	for (i = 0; i < count; i++) {
+		if (iconns[i] == iconn) {
+			array_delete(&iconn->pool->idle_conns, i, 1);
+			break;
+		}
+	}
+	smtp_client_connection_close(&iconn->lmtp_conn);
+	lmtp_proxy_pool_idle_connection_free(iconn);
+}
+
+static void
+lmtp_proxy_pool_put(struct lmtp_proxy_pool *pool,
+		    const struct lmtp_proxy_rcpt_settings *set,
+		    struct smtp_client_connection **_lmtp_conn)
+{
+	struct smtp_client_connection *lmtp_conn = *_lmtp_conn;
+	struct lmtp_proxy_idle_connection *iconn;
+
+	*_lmtp_conn = NULL;
+
+	if (smtp_client_connection_get_state(lmtp_conn) ==
+		SMTP_CLIENT_CONNECTION_STATE_DISCONNECTED ||
+	    array_count(&pool->idle_conns) >=
+		LMTP_PROXY_POOL_MAX_IDLE_CONNECTIONS) {
+		smtp_client_connection_close(&lmtp_conn);
+		return;
+	}
+
+	iconn = i_new(struct lmtp_proxy_idle_connection, 1);
+	iconn->pool = pool;
+	iconn->set = *set;
+	iconn->host = i_strdup(set->set.host);
+	iconn->set.set.host = iconn->host;
+	iconn->lmtp_conn = lmtp_conn;
+	iconn->to_idle = timeout_add(LMTP_PROXY_POOL_IDLE_TIMEOUT_MSECS,
+				     lmtp_proxy_pool_idle_timeout, iconn);
+	array_push_back(&pool->idle_conns, &iconn);
+}
+
+static struct smtp_client_connection *
+lmtp_proxy_pool_take(struct lmtp_proxy_pool *pool,
+		     const struct lmtp_proxy_rcpt_settings *set)
+{
+	struct lmtp_proxy_idle_connection *const *iconns, *iconn;
+	struct smtp_client_connection *lmtp_conn;
+	unsigned int i, count;
+
+	iconns = array_get(&pool->idle_conns, &count);
+	for (i = 0; i < count; i++) {
+		if (lmtp_proxy_rcpt_settings_equal(&iconns[i]->set, set))
+			break;
+	}
+	if (i == count)
+		return NULL;
+
+	iconn = iconns[i];
+	array_delete(&pool->idle_conns, i, 1);
+	lmtp_conn = iconn->lmtp_conn;
+	lmtp_proxy_pool_idle_connection_free(iconn);
+	return lmtp_conn;
+}
+
+void lmtp_proxy_pool_deinit(struct lmtp_proxy_pool **_pool)
+{
+	struct lmtp_proxy_pool *pool = *_pool;
+	struct lmtp_proxy_idle_connection *iconn;
+
+	if (pool == NULL)
+		return;
+	*_pool = NULL;
+
+	array_foreach_elem(&pool->idle_conns, iconn) {
+		smtp_client_connection_close(&iconn->lmtp_conn);
+		lmtp_proxy_pool_idle_connection_free(iconn);
+	}
+	array_free(&pool->idle_conns);
+	smtp_client_deinit(&pool->lmtp_client);
+	i_free(pool);
+}
+
 /*
  * LMTP proxy
  */
@@ -146,17 +291,26 @@ lmtp_proxy_init(struct client *client,
 	else
 		proxy->initial_ttl = lmtp_set.proxy_data.ttl_plus_1 - 1;
 
-	proxy->lmtp_client = smtp_client_init(&lmtp_set);
+	if (client->proxy_pool == NULL)
+		client->proxy_pool = lmtp_proxy_pool_init(&lmtp_set);
+	proxy->lmtp_client = client->proxy_pool->lmtp_client;
 
 	return proxy;
 }
 
 static void lmtp_proxy_connection_deinit(struct lmtp_proxy_connection *conn)
 {
+	struct lmtp_proxy_pool *pool = conn->proxy->client->proxy_pool;
+
 	if (conn->lmtp_trans != NULL)
 		smtp_client_transaction_destroy(&conn->lmtp_trans);
-	if (conn->lmtp_conn != NULL)
-		smtp_client_connection_close(&conn->lmtp_conn);
+	if (conn->lmtp_conn != NULL) {
+		/* keep the connection for the client's next transaction */
+		if (!conn->failed && pool != NULL)
+			lmtp_proxy_pool_put(pool, &conn->set, &conn->lmtp_conn);
+		else
+			smtp_client_connection_close(&conn->lmtp_conn);
+	}
 	timeout_remove(&conn->to);
 	i_stream_unref(&conn->data_input);
 	i_free(conn->host);
@@ -173,7 +327,6 @@ void lmtp_proxy_deinit(struct lmtp_proxy **_proxy)
 	array_foreach_elem(&proxy->connections, conn)
 		lmtp_proxy_connection_deinit(conn);
 
-	smtp_client_deinit(&proxy->lmtp_client);
 	i_stream_unref(&proxy->data_input);
 	array_free(&proxy->rcpt_to);
 	array_free(&proxy->connections);
@@ -220,6 +373,22 @@ lmtp_proxy_connection_init_ssl(struct lmtp_proxy_connection *conn,
 		*ssl_mode_r = SMTP_CLIENT_SSL_MODE_STARTTLS;
 }
 
+static void lmtp_proxy_connection_start(struct lmtp_proxy_connection *conn)
+{
+	struct lmtp_proxy *proxy = conn->proxy;
+	struct smtp_server_transaction *trans = proxy->trans;
+
+	conn->lmtp_trans = smtp_client_transaction_create(
+		conn->lmtp_conn, trans->mail_from, &trans->params, 0,
+		lmtp_proxy_connection_finish, conn);
+
+	smtp_client_transaction_start(conn->lmtp_trans,
+				      lmtp_proxy_mail_cb, conn);
+
+	if (proxy->max_timeout_msecs < conn->set.set.timeout_msecs)
+		proxy->max_timeout_msecs = conn->set.set.timeout_msecs;
+}
+
 static bool
 lmtp_proxy_connection_has_rcpt_forward(struct lmtp_proxy_connection *conn)
 {
@@ -241,7 +410,6 @@ lmtp_proxy_get_connection(struct lmtp_proxy *proxy,
 		.rcpt_param_extensions = rcpt_param_extensions,
 	};
 	struct smtp_client_settings lmtp_set;
-	struct smtp_server_transaction *trans = proxy->trans;
 	struct client *client = proxy->client;
 	struct lmtp_proxy_connection *conn;
 	enum smtp_client_connection_ssl_mode ssl_mode;
@@ -250,13 +418,7 @@ lmtp_proxy_get_connection(struct lmtp_proxy *proxy,
 	i_assert(set->set.timeout_msecs > 0);
 
 	array_foreach_elem(&proxy->connections, conn) {
-		if (conn->set.protocol == set->protocol &&
-		    conn->set.set.port == set->set.port &&
-		    strcmp(conn->set.set.host, set->set.host) == 0 &&
-		    (set->set.host_ip.family == 0 ||
-		     net_ip_compare(&conn->set.set.host_ip, &set->set.host_ip)) &&
-		    net_ip_compare(&conn->set.set.source_ip, &set->set.source_ip) &&
-		    conn->set.set.ssl_flags == set->set.ssl_flags)
+		if (lmtp_proxy_rcpt_settings_equal(&conn->set, set))
 			return conn;
 	}
 
@@ -272,6 +434,21 @@ lmtp_proxy_get_connection(struct lmtp_proxy *proxy,
 	conn->set.set.timeout_msecs = set->set.timeout_msecs;
 	array_push_back(&proxy->connections, &conn);
 
+	struct smtp_proxy_data proxy_data = {
+		.session = t_strdup_printf("%s:P%u", proxy->trans->id,
+					   ++proxy->proxy_session_seq),
+	};
+	conn->lmtp_conn = lmtp_proxy_pool_take(client->proxy_pool, &conn->set);
+	if (conn->lmtp_conn != NULL) {
+		/* The proxy data is updated only if the connection needs
+		   to be reconnected. */
+		smtp_client_connection_update_proxy_data(conn->lmtp_conn,
+							 &proxy_data);
+		smtp_client_connection_connect(conn->lmtp_conn, NULL, NULL);
+		lmtp_proxy_connection_start(conn);
+		return conn;
+	}
+
 	lmtp_proxy_connection_init_ssl(conn, &ssl_set, &ssl_mode);
 
 	i_zero(&lmtp_set);
@@ -293,24 +470,11 @@ lmtp_proxy_get_connection(struct lmtp_proxy *proxy,
 			conn->set.set.host, conn->set.set.port,
 			ssl_mode, &lmtp_set);
 	}
-	struct smtp_proxy_data proxy_data = {
-		.session = t_strdup_printf("%s:P%u", proxy->trans->id,
-					   ++proxy->proxy_session_seq),
-	};
 	smtp_client_connection_update_proxy_data(conn->lmtp_conn, &proxy_data);
 	smtp_client_connection_accept_extra_capability(conn->lmtp_conn,
 						       &cap_rcpt_forward);
 	smtp_client_connection_connect(conn->lmtp_conn, NULL, NULL);
-
-	conn->lmtp_trans = smtp_client_transaction_create(
-		conn->lmtp_conn, trans->mail_from, &trans->params, 0,
-		lmtp_proxy_connection_finish, conn);
-
-	smtp_client_transaction_start(conn->lmtp_trans,
-				      lmtp_proxy_mail_cb, conn);
-
-	if (proxy->max_timeout_msecs < set->set.timeout_msecs)
-		proxy->max_timeout_msecs = set->set.timeout_msecs;
+	lmtp_proxy_connection_start(conn);
 	return conn;
 }
 
@@ -323,6 +487,10 @@ lmtp_proxy_handle_connection_error(struct lmtp_proxy_recipient *lprcpt,
 	struct smtp_server_recipient *rcpt = lrcpt->rcpt;
 	const char *detail = "";
 
+	/* don't reuse the backend connection */
+	if (lprcpt->conn != NULL)
+		lprcpt->conn->failed = TRUE;
+
 	if (client->lmtp_set->lmtp_verbose_replies) {
 		smtp_server_command_fail(rcpt->cmd->cmd, 451, "4.4.0",
 					 "Proxy failed: %s (session=%s)",
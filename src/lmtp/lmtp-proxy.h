@@ -16,9 +16,12 @@
 struct smtp_server_cmd_ctx;
 struct smtp_server_cmd_rcpt;
 struct lmtp_proxy;
+struct lmtp_proxy_pool;
 struct client;
 
 void lmtp_proxy_deinit(struct lmtp_proxy **proxy);
+/* Close the client's idle backend connections. */
+void lmtp_proxy_pool_deinit(struct lmtp_proxy_pool **pool);
 
 int lmtp_proxy_rcpt(struct client *client,
 		    struct smtp_server_cmd_ctx *cmd,
@@ -43,6 +43,7 @@ struct service_settings lmtp_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "$default_internal_group",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -52,6 +53,7 @@ struct service_settings lmtp_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &lmtp_unix_listeners_buf,
 			      sizeof(lmtp_unix_listeners[0]) } },
@@ -70,6 +72,10 @@ static const struct setting_define lmtp_setting_defines[] = {
 	DEF(BOOL, lmtp_add_received_header),
 	DEF(BOOL, lmtp_verbose_replies),
 	DEF(UINT, lmtp_user_concurrency_limit),
+	DEF(UINT, lmtp_user_cache_size),
+	DEF(TIME, lmtp_user_cache_ttl),
+	DEF(SIZE, lmtp_data_max_memory_size),
+	DEF(SIZE, lmtp_data_max_total_memory_size),
 	DEF(ENUM, lmtp_hdr_delivery_address),
 	DEF(STR_VARS, lmtp_rawlog_dir),
 	DEF(STR_VARS, lmtp_proxy_rawlog_dir),
@@ -92,6 +98,10 @@ static const struct lmtp_settings lmtp_default_settings = {
 	.lmtp_add_received_header = TRUE,
 	.lmtp_verbose_replies = FALSE,
 	.lmtp_user_concurrency_limit = 0,
+	.lmtp_user_cache_size = 0,
+	.lmtp_user_cache_ttl = 60,
+	.lmtp_data_max_memory_size = 128*1024,
+	.lmtp_data_max_total_memory_size = 0,
 	.lmtp_hdr_delivery_address = "final:none:original",
 	.lmtp_rawlog_dir = "",
 	.lmtp_proxy_rawlog_dir = "",
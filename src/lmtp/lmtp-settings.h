@@ -25,6 +25,10 @@ struct lmtp_settings {
 	bool lmtp_add_received_header;
 	bool lmtp_verbose_replies;
 	unsigned int lmtp_user_concurrency_limit;
+	unsigned int lmtp_user_cache_size;
+	unsigned int lmtp_user_cache_ttl;
+	uoff_t lmtp_data_max_memory_size;
+	uoff_t lmtp_data_max_total_memory_size;
 	const char *lmtp_hdr_delivery_address;
 	const char *lmtp_rawlog_dir;
 	const char *lmtp_proxy_rawlog_dir;
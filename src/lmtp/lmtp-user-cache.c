@@ -0,0 +1,170 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lmtp-common.h"
+#include "ioloop.h"
+#include "mail-user.h"
+#include "mail-storage-service.h"
+#include "lmtp-user-cache.h"
+
+#include <unistd.h>
+
+struct lmtp_user_cache_entry {
+	struct mail_user *user;
+	time_t expire_time;
+};
+
+static ARRAY(struct lmtp_user_cache_entry) lmtp_user_cache;
+static struct timeout *to_lmtp_user_cache;
+
+static void lmtp_user_cache_timeout(void *context ATTR_UNUSED);
+
+bool lmtp_user_cache_is_enabled(const struct lmtp_settings *set)
+{
+	return set->lmtp_user_cache_size > 0 && set->lmtp_user_cache_ttl > 0 &&
+		getuid() != 0;
+}
+
+static bool
+lmtp_user_cache_fields_equal(const char *const *fields1,
+			     const char *const *fields2)
+{
+	unsigned int i;
+
+	if (fields1 == NULL)
+		fields1 = empty_str_array;
+	if (fields2 == NULL)
+		fields2 = empty_str_array;
+	for (i = 0; fields1[i] != NULL && fields2[i] != NULL; i++) {
+		if (strcmp(fields1[i], fields2[i]) != 0)
+			return FALSE;
+	}
+	return fields1[i] == NULL && fields2[i] == NULL;
+}
+
+static void lmtp_user_cache_remove_idx(unsigned int idx)
+{
+	struct lmtp_user_cache_entry *entry =
+		array_idx_modifiable(&lmtp_user_cache, idx);
+	struct mail_user *user = entry->user;
+
+	array_delete(&lmtp_user_cache, idx, 1);
+	mail_user_deinit(&user);
+}
+
+static void lmtp_user_cache_update_timeout(void)
+{
+	const struct lmtp_user_cache_entry *entry;
+	time_t expire_time = 0;
+
+	timeout_remove(&to_lmtp_user_cache);
+	array_foreach(&lmtp_user_cache, entry) {
+		if (expire_time == 0 || entry->expire_time < expire_time)
+			expire_time = entry->expire_time;
+	}
+	if (expire_time == 0)
+		return;
+
+	unsigned int secs = expire_time <= ioloop_time ? 0 :
+		(unsigned int)(expire_time - ioloop_time);
+	to_lmtp_user_cache = timeout_add(secs * 1000 + 1,
+					 lmtp_user_cache_timeout, NULL);
+}
+
+static void lmtp_user_cache_timeout(void *context ATTR_UNUSED)
+{
+	const struct lmtp_user_cache_entry *entries;
+	unsigned int i, count;
+
+	entries = array_get(&lmtp_user_cache, &count);
+	for (i = count; i > 0; i--) {
+		if (entries[i-1].expire_time <= ioloop_time) {
+			lmtp_user_cache_remove_idx(i-1);
+			entries = array_get(&lmtp_user_cache, &count);
+		}
+	}
+	lmtp_user_cache_update_timeout();
+}
+
+struct mail_user *
+lmtp_user_cache_get(const struct lmtp_settings *set,
+		    struct mail_storage_service_user *service_user,
+		    const char *session_id)
+{
+	const struct mail_storage_service_input *input, *cached_input;
+	const struct lmtp_user_cache_entry *entries;
+	struct mail_user *user;
+	unsigned int i, count;
+
+	if (!lmtp_user_cache_is_enabled(set) ||
+	    !array_is_created(&lmtp_user_cache))
+		return NULL;
+
+	input = mail_storage_service_user_get_input(service_user);
+	entries = array_get(&lmtp_user_cache, &count);
+	for (i = 0; i < count; i++) {
+		if (strcmp(entries[i].user->username, input->username) == 0)
+			break;
+	}
+	if (i == count)
+		return NULL;
+
+	cached_input = mail_storage_service_user_get_input(
+		entries[i].user->service_user);
+	if (entries[i].expire_time <= ioloop_time ||
+	    !lmtp_user_cache_fields_equal(cached_input->userdb_fields,
+					  input->userdb_fields)) {
+		/* expired or userdb fields have changed */
+		lmtp_user_cache_remove_idx(i);
+		lmtp_user_cache_update_timeout();
+		return NULL;
+	}
+
+	user = entries[i].user;
+	array_delete(&lmtp_user_cache, i, 1);
+	lmtp_user_cache_update_timeout();
+
+	mail_storage_service_io_activate_user(user->service_user);
+	mail_storage_service_user_set_session_id(user, session_id);
+	return user;
+}
+
+void lmtp_user_cache_put(const struct lmtp_settings *set,
+			 struct mail_user **_user)
+{
+	struct mail_user *user = *_user;
+	struct lmtp_user_cache_entry *entry;
+	time_t expire_time;
+
+	*_user = NULL;
+
+	/* The user stays cached for at most lmtp_user_cache_ttl after it was
+	   created, regardless of how often it's used. */
+	expire_time = user->session_create_time + set->lmtp_user_cache_ttl;
+	if (!lmtp_user_cache_is_enabled(set) || expire_time <= ioloop_time ||
+	    user->refcount > 1) {
+		mail_user_deinit(&user);
+		return;
+	}
+
+	if (!array_is_created(&lmtp_user_cache))
+		i_array_init(&lmtp_user_cache, set->lmtp_user_cache_size);
+	while (array_count(&lmtp_user_cache) >= set->lmtp_user_cache_size) {
+		/* drop the least recently used user */
+		lmtp_user_cache_remove_idx(0);
+	}
+	entry = array_append_space(&lmtp_user_cache);
+	entry->user = user;
+	entry->expire_time = expire_time;
+	lmtp_user_cache_update_timeout();
+}
+
+void lmtp_user_cache_deinit(void)
+{
+	if (!array_is_created(&lmtp_user_cache))
+		return;
+
+	while (array_count(&lmtp_user_cache) > 0)
+		lmtp_user_cache_remove_idx(array_count(&lmtp_user_cache) - 1);
+	timeout_remove(&to_lmtp_user_cache);
+	array_free(&lmtp_user_cache);
+}
@@ -0,0 +1,26 @@
+#ifndef LMTP_USER_CACHE_H
+#define LMTP_USER_CACHE_H
+
+struct mail_user;
+struct mail_storage_service_user;
+struct lmtp_settings;
+
+/* Returns TRUE if initialized mail users can be cached between deliveries.
+   This requires that lmtp isn't switching privileges between users. */
+bool lmtp_user_cache_is_enabled(const struct lmtp_settings *set);
+
+/* Return a cached mail user for the looked up service_user, or NULL if
+   there is none. The user's session ID is changed to session_id and the
+   user is activated, similar to mail_storage_service_next(). */
+struct mail_user *
+lmtp_user_cache_get(const struct lmtp_settings *set,
+		    struct mail_storage_service_user *service_user,
+		    const char *session_id);
+/* Add the (deactivated) user to the cache, or deinitialize it if it can't
+   be cached. */
+void lmtp_user_cache_put(const struct lmtp_settings *set,
+			 struct mail_user **user);
+
+void lmtp_user_cache_deinit(void);
+
+#endif
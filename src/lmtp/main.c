@@ -12,6 +12,7 @@
 #include "mail-storage-service.h"
 #include "smtp-submit-settings.h"
 #include "lda-settings.h"
+#include "lmtp-user-cache.h"
 
 #include <unistd.h>
 
@@ -105,6 +106,7 @@ static void main_init(void)
 static void main_deinit(void)
 {
 	clients_destroy();
+	lmtp_user_cache_deinit();
 	if (anvil != NULL)
 		anvil_client_deinit(&anvil);
 	i_free(dns_client_socket_path);
@@ -161,6 +163,11 @@ int main(int argc, char *argv[])
 
 	main_init();
 	master_service_init_finish(master_service);
+	if (!IS_STANDALONE() &&
+	    master_service_get_process_min_avail(master_service) > 0) {
+		/* we're likely started to wait for clients */
+		mail_storage_service_preload(storage_service);
+	}
 	master_service_run(master_service, client_connected);
 
 	main_deinit();
@@ -35,6 +35,7 @@ struct service_settings log_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -44,6 +45,7 @@ struct service_settings log_service_settings = {
 	.service_count = 0,
 	.idle_kill = UINT_MAX,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &log_unix_listeners_buf,
 			      sizeof(log_unix_listeners[0]) } },
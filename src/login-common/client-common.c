@@ -267,8 +267,21 @@ client_alloc(int fd, pool_t pool,
 		/* Start by assuming this is the end client connection.
 		   Later on this can be overwritten. */
 		client->end_client_tls_secured = conn->haproxy.ssl;
-		client->local_name = conn->haproxy.hostname;
-		client->client_cert_common_name = conn->haproxy.cert_common_name;
+		/* the haproxy strings are freed after the connection callback
+		   returns */
+		client->local_name = p_strdup(client->pool,
+					      conn->haproxy.hostname);
+		client->client_cert_common_name =
+			p_strdup(client->pool, conn->haproxy.cert_common_name);
+		if (conn->haproxy.ssl_version != NULL) {
+			client->haproxy_ssl_security = p_strdup_printf(
+				client->pool, "%s with cipher %s (proxied)",
+				conn->haproxy.ssl_version,
+				conn->haproxy.ssl_cipher == NULL ? "unknown" :
+				conn->haproxy.ssl_cipher);
+		}
+		client->haproxy_unique_id =
+			p_strdup(client->pool, conn->haproxy.unique_id);
 	} else if (net_ip_compare(&conn->real_remote_ip, &conn->real_local_ip)) {
 		/* localhost connections are always secured */
 		client->connection_secured = TRUE;
@@ -885,7 +898,7 @@ const char *client_get_session_id(struct client *client)
 
 /* increment index if new proper login variables are added
  * make sure the aliases stay in the current order */
-#define VAR_EXPAND_ALIAS_INDEX_START 28
+#define VAR_EXPAND_ALIAS_INDEX_START 29
 
 static struct var_expand_table login_var_expand_empty_tab[] = {
 	{ 'u', NULL, "user" },
@@ -917,6 +930,7 @@ static struct var_expand_table login_var_expand_empty_tab[] = {
 	{ '\0', NULL, "listener" },
 	{ '\0', NULL, "local_name" },
 	{ '\0', NULL, "ssl_ja3" },
+	{ '\0', NULL, "haproxy_unique_id" },
 
 	/* aliases: */
 	{ '\0', NULL, "local_ip" },
@@ -975,7 +989,9 @@ get_var_expand_table(struct client *client)
 		dec2str(client->remote_port);
 	if (client->haproxy_terminated_tls) {
 		tab[11].value = "TLS";
-		tab[12].value = "(proxied)";
+		tab[12].value = client->haproxy_ssl_security != NULL ?
+			str_sanitize(client->haproxy_ssl_security, 256) :
+			"(proxied)";
 	} else if (!client->connection_tls_secured) {
 		tab[11].value = client->connection_secured ? "secured" : NULL;
 		tab[12].value = "";
@@ -1023,6 +1039,7 @@ get_var_expand_table(struct client *client)
 	}
 	tab[25].value = client->listener_name;
 	tab[26].value = str_sanitize(client->local_name, 256);
+	tab[28].value = str_sanitize(client->haproxy_unique_id, 256);
 	return tab;
 }
 
@@ -176,6 +176,9 @@ struct client {
 	const char *session_id, *listener_name, *postlogin_socket_path;
 	const char *local_name;
 	const char *client_cert_common_name;
+	/* TLS information and unique ID sent by haproxy, or NULL */
+	const char *haproxy_ssl_security;
+	const char *haproxy_unique_id;
 
 	string_t *client_id;
 	ARRAY_TYPE(const_string) forward_fields;
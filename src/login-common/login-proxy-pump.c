@@ -0,0 +1,146 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "login-common.h"
+#include "fdpass.h"
+#include "net.h"
+#include "str.h"
+#include "strescape.h"
+#include "write-full.h"
+#include "master-service.h"
+#include "client-common.h"
+#include "login-proxy-pump.h"
+
+#include <unistd.h>
+
+#define LOGIN_PROXY_PUMP_SEND_TIMEOUT_SECS 5
+#define LOGIN_PROXY_PUMP_HANDSHAKE "VERSION\tproxy-pump\t1\t0\n"
+
+static int
+login_proxy_pump_read_reply(int fd, const char *path, bool handshake,
+			    const char **error_r)
+{
+	char buf[1024];
+	ssize_t ret;
+
+	if ((ret = read(fd, buf, sizeof(buf)-1)) < 0) {
+		*error_r = t_strdup_printf("read(%s) failed: %m", path);
+		return -1;
+	} else if (ret == 0) {
+		*error_r = t_strdup_printf("%s disconnected", path);
+		return -1;
+	}
+	buf[ret] = '\0';
+	if (ret > 0 && buf[ret-1] == '\n')
+		buf[ret-1] = '\0';
+	if (handshake) {
+		if (version_string_verify(buf, "proxy-pump", 1))
+			return 0;
+		*error_r = t_strdup_printf(
+			"%s sent invalid VERSION handshake: %s", path, buf);
+		return -1;
+	}
+	if (buf[0] != '+') {
+		*error_r = t_strdup_printf("%s returned failure: %s", path,
+					   buf[0] == '-' ? buf+1 : buf);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+login_proxy_pump_send_fd(int fd, const char *path, int send_fd,
+			 const string_t *cmd, const char **error_r)
+{
+	ssize_t ret;
+
+	i_assert(str_len(cmd) > 0);
+
+	if ((ret = fd_send(fd, send_fd, str_data(cmd), 1)) < 0) {
+		*error_r = t_strdup_printf("fd_send(%s) failed: %m", path);
+		return -1;
+	}
+	i_assert(ret == 1);
+	if (write_full(fd, str_data(cmd)+1, str_len(cmd)-1) < 0) {
+		*error_r = t_strdup_printf("write(%s) failed: %m", path);
+		return -1;
+	}
+	return 0;
+}
+
+static void
+login_proxy_pump_write_cmd(string_t *cmd, struct client *client,
+			   const struct ip_addr *dest_ip, in_port_t dest_port,
+			   const char *const *alt_usernames)
+{
+	str_append_tabescaped(cmd, login_binary->protocol);
+	str_append_c(cmd, '\t');
+	str_append_tabescaped(cmd, client->virtual_user);
+	if (client->session_id != NULL) {
+		str_append(cmd, "\tsession=");
+		str_append_tabescaped(cmd, client->session_id);
+	}
+	if (client->local_ip.family != 0)
+		str_printfa(cmd, "\tlip=%s", net_ip2addr(&client->local_ip));
+	if (client->local_port != 0)
+		str_printfa(cmd, "\tlport=%u", client->local_port);
+	if (client->ip.family != 0)
+		str_printfa(cmd, "\trip=%s", net_ip2addr(&client->ip));
+	if (client->remote_port != 0)
+		str_printfa(cmd, "\trport=%u", client->remote_port);
+	if (dest_ip->family != 0)
+		str_printfa(cmd, "\tdip=%s", net_ip2addr(dest_ip));
+	if (dest_port != 0)
+		str_printfa(cmd, "\tdport=%u", dest_port);
+	for (; alt_usernames != NULL && alt_usernames[0] != NULL;
+	     alt_usernames += 2) {
+		str_append(cmd, "\talt_username=");
+		str_append_tabescaped(cmd, t_strdup_printf("%s=%s",
+			alt_usernames[0], alt_usernames[1]));
+	}
+	str_append_c(cmd, '\n');
+}
+
+int login_proxy_pump_handoff(const char *path, struct client *client,
+			     int server_fd, const struct ip_addr *dest_ip,
+			     in_port_t dest_port,
+			     const char *const *alt_usernames,
+			     const char **error_r)
+{
+	string_t *cmd = t_str_new(256);
+	int fd, ret = 1;
+
+	fd = net_connect_unix(path);
+	if (fd == -1) {
+		*error_r = t_strdup_printf(
+			"net_connect_unix(%s) failed: %m", path);
+		return -1;
+	}
+	net_set_nonblock(fd, FALSE);
+
+	login_proxy_pump_write_cmd(cmd, client, dest_ip, dest_port,
+				   alt_usernames);
+
+	/* The proxy-pump process is local and answers immediately, but don't
+	   let it hang the whole login process. */
+	alarm(LOGIN_PROXY_PUMP_SEND_TIMEOUT_SECS);
+	if (write_full(fd, LOGIN_PROXY_PUMP_HANDSHAKE,
+		       strlen(LOGIN_PROXY_PUMP_HANDSHAKE)) < 0) {
+		*error_r = t_strdup_printf("write(%s) failed: %m", path);
+		ret = -1;
+	} else if (login_proxy_pump_read_reply(fd, path, TRUE, error_r) < 0 ||
+		   login_proxy_pump_send_fd(fd, path, client->fd,
+					    cmd, error_r) < 0 ||
+		   login_proxy_pump_read_reply(fd, path, FALSE, error_r) < 0 ||
+		   login_proxy_pump_send_fd(fd, path, server_fd,
+					    t_str_new_const("\n", 1),
+					    error_r) < 0)
+		ret = -1;
+	else if (login_proxy_pump_read_reply(fd, path, FALSE, error_r) < 0) {
+		/* proxy-pump may already be forwarding the session, so it
+		   can't be proxied here anymore. */
+		ret = 0;
+	}
+	alarm(0);
+	net_disconnect(fd);
+	return ret;
+}
@@ -0,0 +1,22 @@
+#ifndef LOGIN_PROXY_PUMP_H
+#define LOGIN_PROXY_PUMP_H
+
+struct client;
+
+/* Hand over a proxied session to the proxy-pump service listening in the
+   given UNIX socket path. The service forwards the data between the client
+   and server fds from now on, so on success the caller only needs to close
+   its own copies of them. alt_usernames contains field, value pairs or is
+   NULL.
+
+   Returns 1 if the session was handed over, 0 if the server fd was already
+   sent but proxy-pump didn't acknowledge it (error_r is set, but the session
+   can't be proxied locally anymore either) and -1 if the session wasn't
+   handed over. */
+int login_proxy_pump_handoff(const char *path, struct client *client,
+			     int server_fd, const struct ip_addr *dest_ip,
+			     in_port_t dest_port,
+			     const char *const *alt_usernames,
+			     const char **error_r);
+
+#endif
@@ -17,6 +17,7 @@
 #include "master-service.h"
 #include "master-service-ssl-settings.h"
 #include "client-common.h"
+#include "login-proxy-pump.h"
 #include "login-proxy-state.h"
 #include "login-proxy.h"
 
@@ -966,6 +967,55 @@ client_get_alt_usernames(struct client *client,
 	return TRUE;
 }
 
+static bool login_proxy_pump_try_handoff(struct login_proxy *proxy)
+{
+	struct client *client = proxy->client;
+	const char *path = client->set->login_proxy_pump_path;
+	const char *error;
+	int ret;
+
+	if (path[0] == '\0')
+		return FALSE;
+	/* TLS state, rawlogs and already buffered data can't be moved to
+	   another process. Such sessions are proxied here as usual. */
+	if (client->ssl_iostream != NULL ||
+	    proxy->server_ssl_iostream != NULL ||
+	    proxy->rawlog_dir != NULL || proxy->notify_refresh_secs != 0 ||
+	    i_stream_get_data_size(client->input) > 0 ||
+	    i_stream_get_data_size(proxy->server_input) > 0 ||
+	    o_stream_get_buffer_used_size(client->output) > 0 ||
+	    o_stream_get_buffer_used_size(proxy->server_output) > 0)
+		return FALSE;
+
+	ARRAY_TYPE(const_string) alt_usernames;
+	const char *const *alt_usernames_list = NULL;
+	if (client_get_alt_usernames(client, &alt_usernames)) {
+		array_append_zero(&alt_usernames);
+		alt_usernames_list = array_front(&alt_usernames);
+	}
+	ret = login_proxy_pump_handoff(path, client, proxy->server_fd,
+				       &proxy->ip, proxy->port,
+				       alt_usernames_list, &error);
+	if (ret < 0) {
+		e_error(proxy->event, "Failed to hand off proxy session, "
+			"proxying it locally: %s", error);
+		return FALSE;
+	}
+	if (ret == 0) {
+		e_error(proxy->event,
+			"Lost proxy session during handoff: %s", error);
+	} else {
+		e_debug(proxy->event, "Handed off proxy session to %s", path);
+	}
+
+	/* proxy-pump has its own copies of the fds now */
+	login_proxy_disconnect(proxy);
+	DLLIST_REMOVE(&login_proxies_pending, proxy);
+	client->login_proxy = NULL;
+	login_proxy_free_final(proxy);
+	return TRUE;
+}
+
 void login_proxy_detach(struct login_proxy *proxy)
 {
 	struct client *client = proxy->client;
@@ -976,6 +1026,9 @@ void login_proxy_detach(struct login_proxy *proxy)
 	i_assert(proxy->server_input != NULL);
 	i_assert(proxy->server_output != NULL);
 
+	if (login_proxy_pump_try_handoff(proxy))
+		return;
+
 	timeout_remove(&proxy->to);
 	io_remove(&proxy->server_io);
 
@@ -987,6 +1040,12 @@ void login_proxy_detach(struct login_proxy *proxy)
 	client->input = NULL;
 	client->output = NULL;
 
+	/* When neither side uses TLS, the data can be moved between the
+	   sockets without copying it through userspace. The streams ignore
+	   this if they can't do it. */
+	o_stream_set_splice(proxy->client_output, TRUE);
+	o_stream_set_splice(proxy->server_output, TRUE);
+
 	/* from now on, just do dummy proxying */
 	proxy->iostream_proxy =
 		iostream_proxy_create(proxy->client_input, proxy->client_output,
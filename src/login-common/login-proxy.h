@@ -98,7 +98,9 @@ bool login_proxy_is_ourself(const struct client *client, const char *host,
 			    in_port_t port, const char *destuser);
 
 /* Detach proxy from client. This is done after the authentication is
-   successful and all that is left is the dummy proxying. */
+   successful and all that is left is the dummy proxying. If
+   login_proxy_pump_path is set, plaintext sessions are handed over to the
+   proxy-pump service instead of proxying them in this process. */
 void login_proxy_detach(struct login_proxy *proxy);
 
 /* STARTTLS command was issued. */
@@ -31,6 +31,7 @@ static const struct setting_define login_setting_defines[] = {
 	DEF(UINT, login_proxy_max_reconnects),
 	DEF(TIME, login_proxy_max_disconnect_delay),
 	DEF(STR, login_proxy_rawlog_dir),
+	DEF(STR, login_proxy_pump_path),
 	DEF(STR, login_socket_path),
 
 	DEF(BOOL, auth_ssl_require_client_cert),
@@ -61,6 +62,7 @@ static const struct login_settings login_default_settings = {
 	.login_proxy_max_reconnects = 3,
 	.login_proxy_max_disconnect_delay = 0,
 	.login_proxy_rawlog_dir = "",
+	.login_proxy_pump_path = "",
 	.login_socket_path = "",
 
 	.auth_ssl_require_client_cert = FALSE,
@@ -17,6 +17,7 @@ struct login_settings {
 	unsigned int login_proxy_max_reconnects;
 	unsigned int login_proxy_max_disconnect_delay;
 	const char *login_proxy_rawlog_dir;
+	const char *login_proxy_pump_path;
 	const char *login_socket_path;
 	const char *ssl; /* for settings check */
 
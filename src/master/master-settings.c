@@ -111,6 +111,7 @@ static const struct setting_define service_setting_defines[] = {
 	DEF(STR, privileged_group),
 	DEF(STR, extra_groups),
 	DEF(STR, chroot),
+	DEF(STR, cpu_affinity),
 
 	DEF(BOOL, drop_priv_before_exec),
 
@@ -120,6 +121,7 @@ static const struct setting_define service_setting_defines[] = {
 	DEF(UINT, service_count),
 	DEF(TIME, idle_kill),
 	DEF(SIZE, vsz_limit),
+	DEF(SIZE, restart_rss_limit),
 
 	DEFLIST_UNIQUE(unix_listeners, "unix_listener",
 		       &file_listener_setting_parser_info),
@@ -141,6 +143,7 @@ static const struct service_settings service_default_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -150,6 +153,7 @@ static const struct service_settings service_default_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = ARRAY_INIT,
 	.fifo_listeners = ARRAY_INIT,
@@ -17,7 +17,7 @@
 
 #define MIN_BACKLOG 4
 
-static unsigned int service_get_backlog(struct service *service)
+unsigned int service_get_backlog(struct service *service)
 {
 	unsigned int backlog;
 
@@ -13,6 +13,9 @@ int services_listen(struct service_list *service_list);
 int services_listen_using(struct service_list *new_service_list,
 			  struct service_list *old_service_list);
 
+/* Returns the listen() backlog used for the service's listeners. */
+unsigned int service_get_backlog(struct service *service);
+
 int service_listener_listen(struct service_listener *l);
 
 int service_unix_listener_listen(struct service_listener *l, const char *path,
@@ -1,5 +1,6 @@
 /* Copyright (c) 2005-2018 Dovecot authors, see the included COPYING file */
 
+#define _GNU_SOURCE /* for sched_setaffinity() */
 #include "common.h"
 #include "array.h"
 #include "aqueue.h"
@@ -31,6 +32,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <syslog.h>
+#ifdef HAVE_SCHED_SETAFFINITY
+#  include <sched.h>
+#endif
 #include <signal.h>
 #include <sys/wait.h>
 
@@ -73,6 +77,7 @@ service_dup_fds(struct service *service)
 	string_t *listener_settings;
 	int fd = MASTER_LISTEN_FD_FIRST;
 	unsigned int i, count, socket_listener_count;
+	bool pass_config_fd = FALSE;
 
 	/* stdin/stdout is already redirected to /dev/null. Other master fds
 	   should have been opened with fd_close_on_exec() so we don't have to
@@ -117,6 +122,11 @@ service_dup_fds(struct service *service)
 					str_append(listener_settings, "\tssl");
 				if (listeners[i]->set.inetset.set->haproxy)
 					str_append(listener_settings, "\thaproxy");
+				if (listeners[i]->reuse_port) {
+					str_printfa(listener_settings,
+						    "\treuse_port=%u",
+						    service_get_backlog(service));
+				}
 				if (listeners[i]->set.inetset.set->type != NULL &&
 				    *listeners[i]->set.inetset.set->type != '\0') {
 					str_append(listener_settings, "\ttype=");
@@ -220,9 +230,25 @@ service_dup_fds(struct service *service)
 
 	if (service->type == SERVICE_TYPE_LOG) {
 		/* Pass our config fd to the log process, so it won't depend
-		   on config process. Note that we don't want to do this for
-		   other processes, since it prevents config reload. */
+		   on config process. The log process is kept over config
+		   reloads, so it must not try to use the config socket. */
 		i_assert(global_config_fd != -1);
+		pass_config_fd = TRUE;
+	} else if (service->type != SERVICE_TYPE_CONFIG &&
+		   !service->set->drop_priv_before_exec &&
+		   global_config_fd != -1) {
+		/* Pass the same config to other processes as well. This is
+		   what they would get from the config socket, except that
+		   they don't need the round trip to the config process. The
+		   fd is only used for the first settings read, unless the
+		   process is using another config file with -c. Config
+		   reload gives master a new fd for the new processes.
+		   With drop_priv_before_exec=yes the process couldn't read
+		   the private settings from the config socket, so it must
+		   not get them this way either. */
+		pass_config_fd = TRUE;
+	}
+	if (pass_config_fd) {
 		if (lseek(global_config_fd, 0, SEEK_SET) < 0)
 			i_fatal("lseek(config fd, 0) failed: %m");
 		dup2_append(&dups, global_config_fd, MASTER_CONFIG_FD);
@@ -246,6 +272,28 @@ service_dup_fds(struct service *service)
 	env_put("SOCKET_COUNT", dec2str(socket_listener_count));
 }
 
+static void service_set_cpu_affinity(struct service *service)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+	const unsigned int *cpu;
+	cpu_set_t cpus;
+
+	if (!array_is_created(&service->cpu_affinity))
+		return;
+
+	CPU_ZERO(&cpus);
+	array_foreach(&service->cpu_affinity, cpu)
+		CPU_SET(*cpu, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+		i_error("service(%s): sched_setaffinity() failed: %m "
+			"(See service %s { cpu_affinity } setting)",
+			service->set->name, service->set->name);
+	}
+#else
+	i_assert(!array_is_created(&service->cpu_affinity));
+#endif
+}
+
 static void
 drop_privileges(struct service *service)
 {
@@ -255,6 +303,7 @@ drop_privileges(struct service *service)
 
 	if (service->vsz_limit != 0)
 		restrict_process_size(service->vsz_limit);
+	service_set_cpu_affinity(service);
 
 	restrict_access_init(&rset);
 	rset.uid = service->uid;
@@ -312,6 +361,10 @@ service_process_setup_environment(struct service *service, unsigned int uid,
 		env_put(MASTER_SERVICE_COUNT_ENV,
 			dec2str(service->set->service_count));
 	}
+	if (service->set->restart_rss_limit != 0) {
+		env_put(MASTER_SERVICE_RESTART_RSS_LIMIT_ENV,
+			dec2str(service->set->restart_rss_limit));
+	}
 	env_put(MASTER_UID_ENV, dec2str(uid));
 	env_put(MY_HOSTNAME_ENV, my_hostname);
 	env_put(MY_HOSTDOMAIN_ENV, hostdomain);
@@ -1,5 +1,6 @@
 /* Copyright (c) 2005-2018 Dovecot authors, see the included COPYING file */
 
+#define _GNU_SOURCE /* for CPU_SETSIZE */
 #include "common.h"
 #include "ioloop.h"
 #include "array.h"
@@ -7,6 +8,7 @@
 #include "hash.h"
 #include "str.h"
 #include "net.h"
+#include "strnum.h"
 #include "master-service.h"
 #include "master-service-settings.h"
 #include "service.h"
@@ -16,6 +18,9 @@
 
 #include <unistd.h>
 #include <signal.h>
+#ifdef HAVE_SCHED_SETAFFINITY
+#  include <sched.h>
+#endif
 
 #define SERVICE_DIE_TIMEOUT_MSECS (1000*6)
 #define SERVICE_LOGIN_NOTIFY_MIN_INTERVAL_SECS 2
@@ -186,6 +191,53 @@ static int service_get_groups(const char *groups, pool_t pool,
 	return 0;
 }
 
+static int service_get_cpus(const char *cpus, pool_t pool,
+			    ARRAY_TYPE(uint) *cpus_r, const char **error_r)
+{
+	const char *const *tmp, *p;
+	unsigned int cpu, first_cpu, last_cpu;
+
+	p_array_init(cpus_r, pool, 8);
+	for (tmp = t_strsplit_spaces(cpus, ", "); *tmp != NULL; tmp++) {
+		p = strchr(*tmp, '-');
+		if (p == NULL) {
+			if (str_to_uint(*tmp, &first_cpu) < 0) {
+				*error_r = t_strdup_printf(
+					"Invalid CPU number: %s", *tmp);
+				return -1;
+			}
+			last_cpu = first_cpu;
+		} else if (str_to_uint(t_strdup_until(*tmp, p),
+				       &first_cpu) < 0 ||
+			   str_to_uint(p + 1, &last_cpu) < 0 ||
+			   first_cpu > last_cpu) {
+			*error_r = t_strdup_printf(
+				"Invalid CPU range: %s", *tmp);
+			return -1;
+		}
+#ifdef HAVE_SCHED_SETAFFINITY
+		if (last_cpu >= CPU_SETSIZE) {
+			*error_r = t_strdup_printf(
+				"CPU number too large (max %u): %s",
+				(unsigned int)CPU_SETSIZE - 1, *tmp);
+			return -1;
+		}
+#endif
+		for (cpu = first_cpu; cpu <= last_cpu; cpu++)
+			array_push_back(cpus_r, &cpu);
+	}
+	if (array_count(cpus_r) == 0) {
+		*error_r = "No CPUs listed";
+		return -1;
+	}
+#ifndef HAVE_SCHED_SETAFFINITY
+	*error_r = "CPU affinity isn't supported by this OS";
+	return -1;
+#else
+	return 0;
+#endif
+}
+
 static struct service *
 service_create_real(pool_t pool, struct event *event,
 		    const struct service_settings *set,
@@ -268,6 +320,15 @@ service_create_real(pool_t pool, struct event *event,
 			return NULL;
 		}
 	}
+	if (*set->cpu_affinity != '\0') {
+		if (service_get_cpus(set->cpu_affinity, pool,
+				     &service->cpu_affinity, error_r) < 0) {
+			*error_r = t_strdup_printf(
+				"%s (See service %s { cpu_affinity } setting)",
+				*error_r, set->name);
+			return NULL;
+		}
+	}
 
 	/* set these later, so if something fails we don't have to worry about
 	   closing them */
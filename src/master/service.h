@@ -56,6 +56,8 @@ struct service {
 	gid_t gid;
 	gid_t privileged_gid;
 	const char *extra_gids; /* comma-separated list */
+	/* CPUs that the processes are bound to, unassigned if not set */
+	ARRAY_TYPE(uint) cpu_affinity;
 
 	/* all listeners, even those that aren't currently listening */
 	ARRAY(struct service_listener *) listeners;
@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "array.h"
+#include "llist.h"
 #include "ioloop.h"
 #include "istream.h"
 #include "strescape.h"
@@ -22,6 +23,9 @@ struct acl_global_parse_rights {
 };
 
 struct acl_global_file {
+	struct acl_global_file *prev, *next;
+	int refcount;
+
 	char *path;
 	struct stat prev_st;
 	struct event *event;
@@ -33,18 +37,32 @@ struct acl_global_file {
 	unsigned int refresh_interval_secs;
 };
 
+/* All the ACL backends in the process share the same global files. With
+   shared namespaces there is a separate backend for each other user. */
+static struct acl_global_file *acl_global_files = NULL;
+
 struct acl_global_file *
 acl_global_file_init(const char *path, unsigned int refresh_interval_secs,
 		     struct event *event)
 {
 	struct acl_global_file *file;
 
+	for (file = acl_global_files; file != NULL; file = file->next) {
+		if (strcmp(file->path, path) == 0 &&
+		    file->refresh_interval_secs == refresh_interval_secs) {
+			file->refcount++;
+			return file;
+		}
+	}
+
 	file = i_new(struct acl_global_file, 1);
+	file->refcount = 1;
 	file->path = i_strdup(path);
 	file->refresh_interval_secs = refresh_interval_secs;
 	file->event = event_create(event);
 	i_array_init(&file->rights, 32);
 	file->rights_pool = pool_alloconly_create("acl global file rights", 1024);
+	DLLIST_PREPEND(&acl_global_files, file);
 	return file;
 }
 
@@ -54,6 +72,11 @@ void acl_global_file_deinit(struct acl_global_file **_file)
 
 	*_file = NULL;
 
+	i_assert(file->refcount > 0);
+	if (--file->refcount > 0)
+		return;
+	DLLIST_REMOVE(&acl_global_files, file);
+
 	array_free(&file->rights);
 	event_unref(&file->event);
 	pool_unref(&file->rights_pool);
@@ -3,6 +3,8 @@
 
 #include "acl-api.h"
 
+/* Returns the global ACL file for the path. If the same file is already used
+   elsewhere in the process, it's shared along with its parsed rights. */
 struct acl_global_file *
 acl_global_file_init(const char *path, unsigned int refresh_interval_secs,
 		     struct event *event);
@@ -2,8 +2,13 @@
 
 #include "lib.h"
 #include "array.h"
+#include "ioloop.h"
 #include "test-common.h"
 #include "acl-api-private.h"
+#include "acl-global-file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
 
 static void test_acl_rights_sort(void)
 {
@@ -56,10 +61,48 @@ static void test_acl_rights_sort(void)
 	test_end();
 }
 
+static void test_acl_global_file_shared(void)
+{
+	static const char *const path = ".test-acl-global";
+	static const char data[] = "shared/* user=foo lr\n";
+	struct acl_global_file *file1, *file2, *file3;
+	struct event *event = event_create(NULL);
+	int fd;
+
+	test_begin("acl global file shared");
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		i_fatal("creat(%s) failed: %m", path);
+	if (write(fd, data, sizeof(data)-1) != sizeof(data)-1)
+		i_fatal("write(%s) failed: %m", path);
+	i_close_fd(&fd);
+	ioloop_time = time(NULL);
+
+	file1 = acl_global_file_init(path, 30, event);
+	file2 = acl_global_file_init(path, 30, event);
+	file3 = acl_global_file_init(path, 10, event);
+	test_assert(file1 == file2);
+	test_assert(file1 != file3);
+
+	test_assert(acl_global_file_refresh(file1) == 0);
+	test_assert(acl_global_file_have_any(file2, "shared/foo"));
+	test_assert(!acl_global_file_have_any(file2, "INBOX"));
+
+	acl_global_file_deinit(&file1);
+	test_assert(acl_global_file_have_any(file2, "shared/foo"));
+	acl_global_file_deinit(&file2);
+	acl_global_file_deinit(&file3);
+
+	i_unlink(path);
+	event_unref(&event);
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_acl_rights_sort,
+		test_acl_global_file_shared,
 		NULL
 	};
 	return test_run(test_functions);
@@ -0,0 +1,378 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "ioloop.h"
+#include "seq-range-array.h"
+#include "mail-user.h"
+#include "mail-namespace.h"
+#include "mail-storage-private.h"
+#include "mailbox-list-private.h"
+#include "mail-change-feed.h"
+#include "notify-plugin.h"
+#include "change-feed-plugin.h"
+
+#define CHANGE_FEED_USER_CONTEXT(obj) \
+	MODULE_CONTEXT(obj, change_feed_user_module)
+
+struct change_feed_user {
+	union mail_user_module_context module_ctx;
+	struct mail_change_feed *feed;
+};
+
+struct change_feed_mail_txn {
+	struct mailbox *box;
+	unsigned int save_count;
+	ARRAY_TYPE(seq_range) expunged_uids;
+	ARRAY_TYPE(seq_range) changed_uids;
+};
+
+struct change_feed_mailbox_delete_txn {
+	guid_128_t mailbox_guid;
+};
+
+const char *change_feed_plugin_version = DOVECOT_ABI_VERSION;
+
+static MODULE_CONTEXT_DEFINE_INIT(change_feed_user_module,
+				  &mail_user_module_register);
+
+static struct mail_change_feed *change_feed_get(struct mailbox *box)
+{
+	struct change_feed_user *fuser =
+		CHANGE_FEED_USER_CONTEXT(box->storage->user);
+
+	return fuser == NULL ? NULL : fuser->feed;
+}
+
+static int change_feed_get_guid(struct mailbox *box, guid_128_t guid_r)
+{
+	struct mailbox_metadata metadata;
+
+	if (mailbox_get_metadata(box, MAILBOX_METADATA_GUID, &metadata) < 0) {
+		e_error(box->event, "change-feed: "
+			"Failed to get mailbox GUID: %s",
+			mailbox_get_last_internal_error(box, NULL));
+		return -1;
+	}
+	guid_128_copy(guid_r, metadata.guid);
+	return 0;
+}
+
+static void
+change_feed_append_uids(ARRAY_TYPE(mail_change_feed_record) *recs,
+			enum mail_change_feed_record_type type,
+			const guid_128_t mailbox_guid,
+			const ARRAY_TYPE(seq_range) *uids)
+{
+	struct mail_change_feed_record *rec;
+	struct seq_range_iter iter;
+	unsigned int n = 0;
+	uint32_t uid;
+
+	seq_range_array_iter_init(&iter, uids);
+	while (seq_range_array_iter_nth(&iter, n++, &uid)) {
+		rec = array_append_space(recs);
+		mail_change_feed_record_init(rec, type, mailbox_guid, uid,
+					     ioloop_time);
+	}
+}
+
+static void
+change_feed_append_mailbox(struct mailbox *box,
+			   enum mail_change_feed_record_type type,
+			   const guid_128_t mailbox_guid)
+{
+	struct mail_change_feed *feed = change_feed_get(box);
+	struct mail_change_feed_record rec;
+
+	if (feed == NULL)
+		return;
+	mail_change_feed_record_init(&rec, type, mailbox_guid, 0, ioloop_time);
+	(void)mail_change_feed_append(feed, &rec, 1);
+}
+
+static void *
+change_feed_mail_transaction_begin(struct mailbox_transaction_context *t)
+{
+	struct change_feed_mail_txn *txn;
+
+	txn = i_new(struct change_feed_mail_txn, 1);
+	txn->box = mailbox_transaction_get_mailbox(t);
+	return txn;
+}
+
+static void change_feed_mail_save(void *_txn, struct mail *mail ATTR_UNUSED)
+{
+	struct change_feed_mail_txn *txn = _txn;
+
+	/* the UIDs are known only after commit */
+	txn->save_count++;
+}
+
+static void
+change_feed_mail_copy(void *_txn, struct mail *src ATTR_UNUSED,
+		      struct mail *dst ATTR_UNUSED)
+{
+	struct change_feed_mail_txn *txn = _txn;
+
+	txn->save_count++;
+}
+
+static void change_feed_mail_expunge(void *_txn, struct mail *mail)
+{
+	struct change_feed_mail_txn *txn = _txn;
+
+	if (mail->uid != 0)
+		seq_range_array_add_with_init(&txn->expunged_uids, 32,
+					      mail->uid);
+}
+
+static void
+change_feed_mail_update_flags(void *_txn, struct mail *mail,
+			      enum mail_flags old_flags ATTR_UNUSED)
+{
+	struct change_feed_mail_txn *txn = _txn;
+
+	/* mails saved in this transaction don't have UIDs yet, but they're
+	   added as new mails anyway */
+	if (mail->uid != 0)
+		seq_range_array_add_with_init(&txn->changed_uids, 32,
+					      mail->uid);
+}
+
+static void
+change_feed_mail_update_keywords(void *_txn, struct mail *mail,
+				 const char *const *old_keywords ATTR_UNUSED)
+{
+	struct change_feed_mail_txn *txn = _txn;
+
+	if (mail->uid != 0)
+		seq_range_array_add_with_init(&txn->changed_uids, 32,
+					      mail->uid);
+}
+
+static void change_feed_mail_txn_free(struct change_feed_mail_txn *txn)
+{
+	if (array_is_created(&txn->expunged_uids))
+		array_free(&txn->expunged_uids);
+	if (array_is_created(&txn->changed_uids))
+		array_free(&txn->changed_uids);
+	i_free(txn);
+}
+
+static void
+change_feed_mail_transaction_commit(
+	void *_txn, struct mail_transaction_commit_changes *changes)
+{
+	struct change_feed_mail_txn *txn = _txn;
+	struct mail_change_feed *feed = change_feed_get(txn->box);
+	ARRAY_TYPE(mail_change_feed_record) recs;
+	guid_128_t mailbox_guid;
+
+	if (feed == NULL ||
+	    (txn->save_count == 0 && !array_is_created(&txn->expunged_uids) &&
+	     !array_is_created(&txn->changed_uids))) {
+		change_feed_mail_txn_free(txn);
+		return;
+	}
+
+	if (change_feed_get_guid(txn->box, mailbox_guid) == 0) T_BEGIN {
+		t_array_init(&recs, 32);
+		if (txn->save_count > 0) {
+			change_feed_append_uids(&recs,
+				MAIL_CHANGE_FEED_RECORD_MAIL_APPEND,
+				mailbox_guid, &changes->saved_uids);
+		}
+		if (array_is_created(&txn->expunged_uids)) {
+			change_feed_append_uids(&recs,
+				MAIL_CHANGE_FEED_RECORD_MAIL_EXPUNGE,
+				mailbox_guid, &txn->expunged_uids);
+			/* flag changes to expunged mails don't matter */
+			if (array_is_created(&txn->changed_uids)) {
+				seq_range_array_remove_seq_range(
+					&txn->changed_uids,
+					&txn->expunged_uids);
+			}
+		}
+		if (array_is_created(&txn->changed_uids)) {
+			change_feed_append_uids(&recs,
+				MAIL_CHANGE_FEED_RECORD_MAIL_FLAGS,
+				mailbox_guid, &txn->changed_uids);
+		}
+		/* write all of the transaction's changes at once */
+		(void)mail_change_feed_append(feed, array_front(&recs),
+					      array_count(&recs));
+	} T_END;
+	change_feed_mail_txn_free(txn);
+}
+
+static void change_feed_mail_transaction_rollback(void *_txn)
+{
+	change_feed_mail_txn_free(_txn);
+}
+
+static void change_feed_mailbox_create(struct mailbox *box)
+{
+	guid_128_t mailbox_guid;
+
+	if (change_feed_get(box) != NULL &&
+	    change_feed_get_guid(box, mailbox_guid) == 0) {
+		change_feed_append_mailbox(box,
+			MAIL_CHANGE_FEED_RECORD_MAILBOX_CREATE, mailbox_guid);
+	}
+}
+
+static void change_feed_mailbox_update(struct mailbox *box)
+{
+	guid_128_t mailbox_guid;
+
+	if (change_feed_get(box) != NULL &&
+	    change_feed_get_guid(box, mailbox_guid) == 0) {
+		change_feed_append_mailbox(box,
+			MAIL_CHANGE_FEED_RECORD_MAILBOX_UPDATE, mailbox_guid);
+	}
+}
+
+static void *change_feed_mailbox_delete_begin(struct mailbox *box)
+{
+	struct change_feed_mailbox_delete_txn *txn;
+
+	/* the GUID can't be looked up anymore after the mailbox is
+	   deleted */
+	txn = i_new(struct change_feed_mailbox_delete_txn, 1);
+	if (change_feed_get(box) != NULL)
+		(void)change_feed_get_guid(box, txn->mailbox_guid);
+	return txn;
+}
+
+static void
+change_feed_mailbox_delete_commit(void *_txn, struct mailbox *box)
+{
+	struct change_feed_mailbox_delete_txn *txn = _txn;
+
+	if (!guid_128_is_empty(txn->mailbox_guid)) {
+		change_feed_append_mailbox(box,
+			MAIL_CHANGE_FEED_RECORD_MAILBOX_DELETE,
+			txn->mailbox_guid);
+	}
+	i_free(txn);
+}
+
+static void change_feed_mailbox_delete_rollback(void *txn)
+{
+	i_free(txn);
+}
+
+static void
+change_feed_mailbox_rename(struct mailbox *src ATTR_UNUSED,
+			   struct mailbox *dest)
+{
+	guid_128_t mailbox_guid;
+
+	if (change_feed_get(dest) != NULL &&
+	    change_feed_get_guid(dest, mailbox_guid) == 0) {
+		change_feed_append_mailbox(dest,
+			MAIL_CHANGE_FEED_RECORD_MAILBOX_RENAME, mailbox_guid);
+	}
+}
+
+static void
+change_feed_mailbox_set_subscribed(struct mailbox *box, bool subscribed)
+{
+	guid_128_t name_guid;
+
+	mailbox_name_get_sha128(mailbox_get_vname(box), name_guid);
+	change_feed_append_mailbox(box, subscribed ?
+				   MAIL_CHANGE_FEED_RECORD_SUBSCRIBE :
+				   MAIL_CHANGE_FEED_RECORD_UNSUBSCRIBE,
+				   name_guid);
+}
+
+static const struct notify_vfuncs change_feed_vfuncs = {
+	.mail_transaction_begin = change_feed_mail_transaction_begin,
+	.mail_save = change_feed_mail_save,
+	.mail_copy = change_feed_mail_copy,
+	.mail_expunge = change_feed_mail_expunge,
+	.mail_update_flags = change_feed_mail_update_flags,
+	.mail_update_keywords = change_feed_mail_update_keywords,
+	.mail_transaction_commit = change_feed_mail_transaction_commit,
+	.mail_transaction_rollback = change_feed_mail_transaction_rollback,
+	.mailbox_create = change_feed_mailbox_create,
+	.mailbox_update = change_feed_mailbox_update,
+	.mailbox_delete_begin = change_feed_mailbox_delete_begin,
+	.mailbox_delete_commit = change_feed_mailbox_delete_commit,
+	.mailbox_delete_rollback = change_feed_mailbox_delete_rollback,
+	.mailbox_rename = change_feed_mailbox_rename,
+	.mailbox_set_subscribed = change_feed_mailbox_set_subscribed,
+};
+
+static struct notify_context *change_feed_ctx;
+
+static void change_feed_mail_user_deinit(struct mail_user *user)
+{
+	struct change_feed_user *fuser = CHANGE_FEED_USER_CONTEXT(user);
+
+	i_assert(fuser != NULL);
+	mail_change_feed_free(&fuser->feed);
+	fuser->module_ctx.super.deinit(user);
+}
+
+static void change_feed_mail_user_created(struct mail_user *user)
+{
+	struct mail_user_vfuncs *v = user->vlast;
+	struct change_feed_user *fuser;
+	const char *path;
+
+	path = mail_user_plugin_getenv(user, "change_feed_path");
+	if (path == NULL || *path == '\0' || user->autocreated)
+		return;
+
+	fuser = p_new(user->pool, struct change_feed_user, 1);
+	fuser->module_ctx.super = *v;
+	user->vlast = &fuser->module_ctx.super;
+	v->deinit = change_feed_mail_user_deinit;
+
+	fuser->feed = mail_change_feed_alloc(user->event,
+					     mail_user_home_expand(user, path));
+	MODULE_CONTEXT_SET(user, change_feed_user_module, fuser);
+}
+
+static void
+change_feed_mail_namespaces_created(struct mail_namespace *namespaces)
+{
+	struct change_feed_user *fuser =
+		CHANGE_FEED_USER_CONTEXT(namespaces->user);
+	struct mail_namespace *ns;
+	struct mailbox_permissions perm;
+
+	if (fuser == NULL)
+		return;
+
+	/* create the feed with the same permissions as the mail files */
+	ns = mail_namespace_find_inbox(namespaces);
+	mailbox_list_get_root_permissions(ns->list, &perm);
+	mail_change_feed_set_permissions(fuser->feed, perm.file_create_mode,
+					 perm.file_create_gid,
+					 perm.file_create_gid_origin);
+	mail_change_feed_set_fsync_mode(fuser->feed,
+					ns->mail_set->parsed_fsync_mode);
+}
+
+static struct mail_storage_hooks change_feed_mail_storage_hooks = {
+	.mail_user_created = change_feed_mail_user_created,
+	.mail_namespaces_created = change_feed_mail_namespaces_created
+};
+
+void change_feed_plugin_init(struct module *module)
+{
+	change_feed_ctx = notify_register(&change_feed_vfuncs);
+	mail_storage_hooks_add(module, &change_feed_mail_storage_hooks);
+}
+
+void change_feed_plugin_deinit(void)
+{
+	mail_storage_hooks_remove(&change_feed_mail_storage_hooks);
+	notify_unregister(&change_feed_ctx);
+}
+
+const char *change_feed_plugin_dependencies[] = { "notify", NULL };
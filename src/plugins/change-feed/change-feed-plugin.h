@@ -0,0 +1,9 @@
+#ifndef CHANGE_FEED_PLUGIN_H
+#define CHANGE_FEED_PLUGIN_H
+
+extern const char *change_feed_plugin_dependencies[];
+
+void change_feed_plugin_init(struct module *module);
+void change_feed_plugin_deinit(void);
+
+#endif
@@ -15,6 +15,7 @@ extern "C" {
 #include "time-util.h"
 #include "fts-backend-flatcurve.h"
 #include "fts-backend-flatcurve-xapian.h"
+#include "fts-flatcurve-tiers.h"
 #include <dirent.h>
 #include <stdio.h>
 };
@@ -36,6 +37,7 @@ extern "C" {
 #include <algorithm>
 #include <sstream>
 #include <string>
+#include <vector>
 
 /* How Xapian DBs work in fts-flatcurve: all data lives in under one
  * per-mailbox directory (FTS_FLATCURVE_LABEL) stored at the root of the
@@ -159,6 +161,11 @@ struct flatcurve_xapian {
 	bool deinit:1;
 };
 
+struct flatcurve_xapian_shard_size {
+	struct flatcurve_xapian_db *xdb;
+	Xapian::doccount messages;
+};
+
 struct flatcurve_fts_query_xapian {
 	Xapian::Query *query;
 };
@@ -1799,6 +1806,46 @@ fts_flatcurve_xapian_optimize_rebuild(struct flatcurve_fts_backend *backend,
 			backend, xdb, FLATCURVE_XAPIAN_DB_CLOSE_WDB, error_r);
 }
 
+/* Compact db into dbpath. Returns: 0 on success, -1 on error */
+static int
+fts_flatcurve_xapian_compact(struct flatcurve_fts_backend *backend,
+			     Xapian::Database *db,
+			     struct flatcurve_xapian_db_path *dbpath,
+			     const char **error_r)
+{
+	bool failed = FALSE;
+	try {
+		(void)db->reopen();
+		db->compact(dbpath->path, Xapian::DBCOMPACT_NO_RENUMBER |
+					  Xapian::DBCOMPACT_MULTIPASS |
+					  Xapian::Compactor::FULLER);
+	} catch (Xapian::InvalidOperationError &e) {
+		/* This exception is not as specific as it could be...
+		 * but the likely reason it happens is due to
+		 * Xapian::DBCOMPACT_NO_RENUMBER and shards having disjoint
+		 * ranges of UIDs (e.g. shard 1 = 1..2, shard 2 = 2..3).
+		 * Xapian, as of 1.4.18, cannot handle this situation.
+		 * Since we will never be able to compact this data unless
+		 * we do something about it, the options are either:
+		 *   1) delete the index totally and start fresh (not great
+		 *      for large mailboxes), or
+		 *   2) to incrementally build the optimized DB by walking
+		 *      through all DBs and copying, ignoring duplicate
+		 *      documents.
+		 * Let's try to be awesome and do the latter. */
+		failed = fts_flatcurve_xapian_optimize_rebuild(
+				backend, db, dbpath, error_r) < 0;
+		if (!failed)
+			e_debug(backend->event, "Native optimize failed, "
+				"falling back to manual optimization; %s",
+				e.get_description().c_str());
+	} catch (Xapian::Error &e) {
+		*error_r = t_strdup(e.get_description().c_str());
+		failed = TRUE;
+	}
+	return failed ? -1 : 0;
+}
+
 /* Returns: 0 on success, -1 on error */
 static int
 fts_flatcurve_xapian_optimize_box_do(struct flatcurve_fts_backend *backend,
@@ -1834,37 +1881,7 @@ fts_flatcurve_xapian_optimize_box_do(struct flatcurve_fts_backend *backend,
 	struct timeval start;
 	i_gettimeofday(&start);
 
-	bool failed = FALSE;
-	try {
-		(void)db->reopen();
-		db->compact(dbpath->path, Xapian::DBCOMPACT_NO_RENUMBER |
-					  Xapian::DBCOMPACT_MULTIPASS |
-					  Xapian::Compactor::FULLER);
-	} catch (Xapian::InvalidOperationError &e) {
-		/* This exception is not as specific as it could be...
-		 * but the likely reason it happens is due to
-		 * Xapian::DBCOMPACT_NO_RENUMBER and shards having disjoint
-		 * ranges of UIDs (e.g. shard 1 = 1..2, shard 2 = 2..3).
-		 * Xapian, as of 1.4.18, cannot handle this situation.
-		 * Since we will never be able to compact this data unless
-		 * we do something about it, the options are either:
-		 *   1) delete the index totally and start fresh (not great
-		 *      for large mailboxes), or
-		 *   2) to incrementally build the optimized DB by walking
-		 *      through all DBs and copying, ignoring duplicate
-		 *      documents.
-		 * Let's try to be awesome and do the latter. */
-		failed = fts_flatcurve_xapian_optimize_rebuild(
-				backend, db, dbpath, error_r) < 0;
-		if (!failed)
-			e_debug(backend->event, "Native optimize failed, "
-				"falling back to manual optimization; %s",
-				e.get_description().c_str());
-	} catch (Xapian::Error &e) {
-		*error_r = t_strdup(e.get_description().c_str());
-		failed = TRUE;
-	}
-	if (failed) {
+	if (fts_flatcurve_xapian_compact(backend, db, dbpath, error_r) < 0) {
 		e_error(backend->event, "Optimize failed: %s", *error_r);
 		return 0;
 	}
@@ -1909,6 +1926,117 @@ fts_flatcurve_xapian_optimize_box_do(struct flatcurve_fts_backend *backend,
 	return 0;
 }
 
+static bool
+fts_flatcurve_xapian_shard_size_cmp(const struct flatcurve_xapian_shard_size &s1,
+				    const struct flatcurve_xapian_shard_size &s2)
+{
+	return s1.messages < s2.messages;
+}
+
+/* Returns: 0 on success, -1 on error */
+static int
+fts_flatcurve_xapian_merge_tier(struct flatcurve_fts_backend *backend,
+				const std::vector<struct flatcurve_xapian_shard_size> &shards,
+				size_t start, size_t end, const char **error_r)
+{
+	static const enum flatcurve_xapian_wdb wopts =
+		ENUM_EMPTY(flatcurve_xapian_wdb);
+
+	/* Lock the merged shards so nothing changes while we are merging. */
+	Xapian::Database tier_db;
+	Xapian::doccount messages = 0;
+	for (size_t i = start; i < end; i++) {
+		if (fts_flatcurve_xapian_write_db_get(
+			backend, shards[i].xdb, wopts, error_r) < 0)
+			return -1;
+		tier_db.add_database(*(shards[i].xdb->db));
+		messages += shards[i].messages;
+	}
+
+	struct flatcurve_xapian_db_path *dbpath =
+		fts_flatcurve_xapian_create_db_path(
+			backend, FLATCURVE_XAPIAN_DB_OPTIMIZE);
+	if (fts_flatcurve_xapian_delete(backend, dbpath, error_r) < 0 ||
+	    fts_flatcurve_xapian_compact(backend, &tier_db, dbpath,
+					 error_r) < 0)
+		return -1;
+
+	/* Replace the merged shards with the new one. */
+	for (size_t i = start; i < end; i++) {
+		if (fts_flatcurve_xapian_delete(
+			backend, shards[i].xdb->dbpath, error_r) < 0)
+			return -1;
+	}
+	if (fts_flatcurve_xapian_rename_db(backend, dbpath, NULL, error_r) < 0 ||
+	    fts_flatcurve_xapian_delete(backend, dbpath, error_r) < 0)
+		return -1;
+
+	e_debug(backend->event, "Merged %u shards with %u messages",
+		(unsigned int)(end - start), (unsigned int)messages);
+	return 0;
+}
+
+/* Merge the tiers that have enough shards in them.
+ * Returns: 1 if merged, 0 if the shard count wouldn't drop below
+ * optimize_limit and the full optimization is needed, -1 on error */
+static int
+fts_flatcurve_xapian_merge_box_do(struct flatcurve_fts_backend *backend,
+				  const char **error_r)
+{
+	struct flatcurve_xapian *x = backend->xapian;
+	std::vector<struct flatcurve_xapian_shard_size> shards;
+
+	/* The current shard is still being written to, so only the index
+	 * shards are merged. */
+	void *key, *val;
+	struct hash_iterate_context *hiter = hash_table_iterate_init(x->dbs);
+	while (hash_table_iterate(hiter, x->dbs, &key, &val)) {
+		struct flatcurve_xapian_db *xdb =
+			(struct flatcurve_xapian_db *)val;
+		if (xdb->type != FLATCURVE_XAPIAN_DB_TYPE_INDEX ||
+		    xdb->db == NULL)
+			continue;
+
+		struct flatcurve_xapian_shard_size shard;
+		shard.xdb = xdb;
+		try {
+			shard.messages = xdb->db->get_doccount();
+		} catch (Xapian::Error &e) {
+			hash_table_iterate_deinit(&hiter);
+			*error_r = t_strdup_printf(
+				"Cannot get message count (%s): %s",
+				xdb->dbpath->fname,
+				e.get_description().c_str());
+			return -1;
+		}
+		shards.push_back(shard);
+	}
+	hash_table_iterate_deinit(&hiter);
+	std::sort(shards.begin(), shards.end(),
+		  fts_flatcurve_xapian_shard_size_cmp);
+
+	std::vector<unsigned int> counts;
+	for (size_t i = 0; i < shards.size(); i++)
+		counts.push_back(shards[i].messages);
+
+	ARRAY_TYPE(fts_flatcurve_tier) tiers;
+	t_array_init(&tiers, 4);
+	unsigned int removed = fts_flatcurve_tiers_select(
+		counts.empty() ? NULL : &counts[0], counts.size(),
+		FTS_FLATCURVE_TIER_FACTOR, &tiers);
+	if (array_is_empty(&tiers) || removed >= x->shards ||
+	    x->shards - removed >= backend->fuser->set.optimize_limit)
+		return 0;
+
+	const struct fts_flatcurve_tier *tier;
+	array_foreach(&tiers, tier) {
+		if (fts_flatcurve_xapian_merge_tier(backend, shards,
+				tier->start, tier->end, error_r) < 0)
+			return -1;
+	}
+	return 1;
+}
+
 /* Returns: 0 on success, -1 on error */
 int fts_flatcurve_xapian_optimize_box(struct flatcurve_fts_backend *backend,
 				      const char **error_r)
@@ -1935,9 +2063,18 @@ int fts_flatcurve_xapian_optimize_box(struct flatcurve_fts_backend *backend,
 		"Optimizing");
 
 	ret = 0;
-	if (fts_flatcurve_xapian_lock(backend, error_r) < 0 ||
+	if (fts_flatcurve_xapian_lock(backend, error_r) < 0)
+		ret = -1;
+	else if (backend->xapian->deinit) {
+		/* Automatic optimization: try merging only the small shards
+		   before falling back to rewriting the whole index. */
+		ret = fts_flatcurve_xapian_merge_box_do(backend, error_r);
+	}
+	if (ret == 0 &&
 	    fts_flatcurve_xapian_optimize_box_do(backend, db, error_r) < 0)
 		ret = -1;
+	else if (ret > 0)
+		ret = 0;
 
 	const char *error;
 	if (fts_flatcurve_xapian_close(backend, &error) < 0) {
@@ -2137,8 +2274,14 @@ bool
 fts_flatcurve_xapian_query_iter_next(struct fts_flatcurve_xapian_query_iter *iter,
 				     struct fts_flatcurve_xapian_query_result **result_r)
 {
+	/* Searching must not create (and lock) an empty index for each
+	 * mailbox it touches; mailboxes without an index simply have no
+	 * matches. This matters for multi-mailbox (e.g. virtual) searches
+	 * where most of the mailboxes may not be indexed. */
 	static const enum flatcurve_xapian_db_opts opts =
-		ENUM_EMPTY(flatcurve_xapian_db_opts);
+		(enum flatcurve_xapian_db_opts)
+			(FLATCURVE_XAPIAN_DB_NOCREATE_CURRENT |
+			 FLATCURVE_XAPIAN_DB_IGNORE_EMPTY);
 
 	if (iter->error != NULL)
 		return FALSE;
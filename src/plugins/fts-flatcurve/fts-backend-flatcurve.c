@@ -422,14 +422,16 @@ fts_backend_flatcurve_rescan_box(struct flatcurve_fts_backend *backend,
 				     add_str("mailbox", box->name);
 
 	if (!array_is_empty(&missing)) {
-		/* There does not seem to be an easy way via FTS API (as of
-		 * 2.3.15) to indicate what specific uids need to be indexed.
-		 * Instead, delete all messages above the lowest, non-indexed
-		 * UID and recreate the index the next time the mailbox
-		 * is accessed. */
+		/* Record the non-indexed UIDs, so they get indexed the next
+		 * time the mailbox is accessed without having to reindex
+		 * everything after the lowest of them. */
 		seq_range_array_iter_init(&iter2, &missing);
 		bool ret1 = seq_range_array_iter_nth(&iter2, 0, &low_uid);
 		i_assert(ret1);
+		if (fts_index_add_missing_uids(box, &missing) < 0) {
+			*error_r = mailbox_get_last_internal_error(box, NULL);
+			return -1;
+		}
 	}
 
 	query = fts_backend_flatcurve_create_query(backend, pool);
@@ -439,8 +441,7 @@ fts_backend_flatcurve_rescan_box(struct flatcurve_fts_backend *backend,
 
 	iter = fts_flatcurve_xapian_query_iter_init(query);
 	while (fts_flatcurve_xapian_query_iter_next(iter, &result)) {
-		if ((low_uid > 0  && result->uid >= low_uid) ||
-		    (low_uid == 0 && !seq_range_exists(&uids, result->uid))) {
+		if (!seq_range_exists(&uids, result->uid)) {
 			if (fts_flatcurve_xapian_expunge(
 				backend, result->uid, error_r) < 0)
 				e_error(backend->event, "%s", *error_r);
@@ -454,7 +455,7 @@ fts_backend_flatcurve_rescan_box(struct flatcurve_fts_backend *backend,
 	if (ret < 0)
 		return -1;
 
-	if (array_is_empty(&expunged)) {
+	if (array_is_empty(&expunged) && low_uid == 0) {
 		e_debug(e->add_str("status", "ok")->event(),
 			"Rescan: no issues found");
 	} else T_BEGIN {
@@ -0,0 +1,35 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "fts-flatcurve-tiers.h"
+
+unsigned int
+fts_flatcurve_tiers_select(const unsigned int *message_counts,
+			   unsigned int count, unsigned int factor,
+			   ARRAY_TYPE(fts_flatcurve_tier) *tiers_r)
+{
+	struct fts_flatcurve_tier *tier;
+	unsigned int i, start = 0, removed = 0;
+	uint64_t tier_max;
+
+	i_assert(factor > 1);
+
+	for (i = 1; i <= count; i++) {
+		i_assert(i == count || message_counts[i-1] <= message_counts[i]);
+
+		/* empty shards belong to the tier of 1-message shards */
+		tier_max = (uint64_t)I_MAX(message_counts[start], 1) * factor;
+		if (i < count && message_counts[i] <= tier_max)
+			continue;
+
+		if (i - start >= factor) {
+			tier = array_append_space(tiers_r);
+			tier->start = start;
+			tier->end = i;
+			removed += i - start - 1;
+		}
+		start = i;
+	}
+	return removed;
+}
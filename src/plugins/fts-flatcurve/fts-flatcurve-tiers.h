@@ -0,0 +1,25 @@
+#ifndef FTS_FLATCURVE_TIERS_H
+#define FTS_FLATCURVE_TIERS_H
+
+/* Automatic optimization merges shards in tiers: shards whose message counts
+ * are within this factor of each other belong to the same tier, and a tier
+ * is merged into a single shard once it has at least this many shards. Each
+ * message is then rewritten only a logarithmic number of times, instead of
+ * the whole index being rewritten every time optimize_limit is reached. */
+#define FTS_FLATCURVE_TIER_FACTOR 4
+
+/* [start, end) range of shards in the sorted message count array */
+struct fts_flatcurve_tier {
+	unsigned int start, end;
+};
+ARRAY_DEFINE_TYPE(fts_flatcurve_tier, struct fts_flatcurve_tier);
+
+/* Find the tiers to merge. The message_counts must be sorted in ascending
+ * order. The tiers are appended to tiers_r. Returns how many shards fewer
+ * there are after the tiers have been merged. */
+unsigned int
+fts_flatcurve_tiers_select(const unsigned int *message_counts,
+			   unsigned int count, unsigned int factor,
+			   ARRAY_TYPE(fts_flatcurve_tier) *tiers_r);
+
+#endif
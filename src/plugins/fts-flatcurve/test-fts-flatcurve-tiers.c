@@ -0,0 +1,78 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "test-common.h"
+#include "fts-flatcurve-tiers.h"
+
+static void
+test_tiers(const unsigned int *counts, unsigned int count,
+	   const struct fts_flatcurve_tier *expected,
+	   unsigned int expected_count, unsigned int expected_removed)
+{
+	ARRAY_TYPE(fts_flatcurve_tier) tiers;
+	const struct fts_flatcurve_tier *tier;
+	unsigned int i, removed;
+
+	t_array_init(&tiers, 4);
+	removed = fts_flatcurve_tiers_select(counts, count,
+					     FTS_FLATCURVE_TIER_FACTOR, &tiers);
+	test_assert(removed == expected_removed);
+	test_assert(array_count(&tiers) == expected_count);
+	for (i = 0; i < expected_count && i < array_count(&tiers); i++) {
+		tier = array_idx(&tiers, i);
+		test_assert_idx(tier->start == expected[i].start &&
+				tier->end == expected[i].end, i);
+	}
+}
+
+static void test_fts_flatcurve_tiers_select(void)
+{
+	test_begin("fts_flatcurve_tiers_select()");
+
+	/* nothing to merge */
+	test_tiers(NULL, 0, NULL, 0, 0);
+	static const unsigned int few[] = { 10, 20, 30 };
+	test_tiers(few, N_ELEMENTS(few), NULL, 0, 0);
+
+	/* one tier of similar sized shards */
+	static const unsigned int one[] = { 10, 12, 20, 40 };
+	static const struct fts_flatcurve_tier one_tiers[] = { { 0, 4 } };
+	test_tiers(one, N_ELEMENTS(one), one_tiers, 1, 3);
+
+	/* a big shard is never merged with the small ones */
+	static const unsigned int big[] = { 5, 5, 6, 7, 8, 10000 };
+	static const struct fts_flatcurve_tier big_tiers[] = { { 0, 5 } };
+	test_tiers(big, N_ELEMENTS(big), big_tiers, 1, 4);
+
+	/* two tiers, with a too small tier between them */
+	static const unsigned int two[] = {
+		0, 1, 1, 3,  100, 150,  1000, 1000, 2000, 3000, 4000
+	};
+	static const struct fts_flatcurve_tier two_tiers[] = {
+		{ 0, 4 }, { 6, 11 }
+	};
+	test_tiers(two, N_ELEMENTS(two), two_tiers, 2, 3 + 4);
+
+	/* 4000 is too large for the tier starting with 999 */
+	static const unsigned int edge[] = { 999, 999, 999, 4000 };
+	test_tiers(edge, N_ELEMENTS(edge), NULL, 0, 0);
+
+	/* no overflow with huge shards */
+	static const unsigned int huge[] = {
+		UINT_MAX/2, UINT_MAX/2, UINT_MAX, UINT_MAX
+	};
+	static const struct fts_flatcurve_tier huge_tiers[] = { { 0, 4 } };
+	test_tiers(huge, N_ELEMENTS(huge), huge_tiers, 1, 3);
+
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_fts_flatcurve_tiers_select,
+		NULL
+	};
+	return test_run(test_functions);
+}
@@ -28,6 +28,9 @@
 #define SOLR_HEADER_LINE_MAX_TRUNC_SIZE 1024
 
 #define SOLR_QUERY_MAX_MAILBOX_COUNT 10
+/* Asynchronous updates keep the whole batch in memory. Limit its size if
+   batch_bytes isn't set. */
+#define SOLR_ASYNC_DEFAULT_BATCH_BYTES (1024*1024*8)
 
 struct solr_fts_backend {
 	struct fts_backend backend;
@@ -53,8 +56,11 @@ struct solr_fts_backend_update_context {
 
 	uint32_t last_indexed_uid;
 	unsigned int mails_since_flush;
+	uoff_t bytes_since_flush;
 
 	bool tokenized_input:1;
+	bool async:1;
+	bool batch_open:1;
 	bool last_indexed_uid_set:1;
 	bool body_open:1;
 	bool documents_added:1;
@@ -276,12 +282,15 @@ fts_backend_solr_get_last_uid(struct fts_backend *_backend,
 static struct fts_backend_update_context *
 fts_backend_solr_update_init(struct fts_backend *_backend)
 {
+	struct fts_solr_user *fuser =
+		FTS_SOLR_USER_CONTEXT_REQUIRE(_backend->ns->user);
 	struct solr_fts_backend_update_context *ctx;
 
 	ctx = i_new(struct solr_fts_backend_update_context, 1);
 	ctx->ctx.backend = _backend;
 	ctx->tokenized_input =
 		(_backend->flags & FTS_BACKEND_FLAG_TOKENIZED_INPUT) != 0;
+	ctx->async = fuser->set.max_parallel_updates > 1;
 	i_array_init(&ctx->fields, 16);
 	return &ctx->ctx;
 }
@@ -354,22 +363,80 @@ fts_backend_solr_doc_close(struct solr_fts_backend_update_context *ctx)
 	str_append(ctx->cmd, "</doc>");
 }
 
+static void
+fts_backend_solr_cmd_send(struct solr_fts_backend_update_context *ctx)
+{
+	if (ctx->post == NULL) {
+		/* asynchronous update: the whole batch is sent at once */
+		return;
+	}
+	solr_connection_post_more(ctx->post, str_data(ctx->cmd),
+				  str_len(ctx->cmd));
+	ctx->bytes_since_flush += str_len(ctx->cmd);
+	str_truncate(ctx->cmd, 0);
+}
+
 static int
 fts_backed_solr_build_flush(struct solr_fts_backend_update_context *ctx)
 {
-	if (ctx->post == NULL)
+	struct solr_fts_backend *backend =
+		(struct solr_fts_backend *)ctx->ctx.backend;
+	int ret;
+
+	if (!ctx->batch_open)
 		return 0;
 
 	fts_backend_solr_doc_close(ctx);
 	str_append(ctx->cmd, "</add>");
 	ctx->mails_since_flush = 0;
+	ctx->bytes_since_flush = 0;
+	ctx->batch_open = FALSE;
 
+	if (ctx->post == NULL) {
+		ret = solr_connection_post_async(backend->solr_conn,
+						 str_data(ctx->cmd),
+						 str_len(ctx->cmd));
+		str_truncate(ctx->cmd, 0);
+		return ret;
+	}
 	solr_connection_post_more(ctx->post, str_data(ctx->cmd),
 				  str_len(ctx->cmd));
 	str_truncate(ctx->cmd, 0);
 	return solr_connection_post_end(&ctx->post);
 }
 
+static bool
+fts_backend_solr_batch_full(struct solr_fts_backend_update_context *ctx)
+{
+	struct fts_solr_user *fuser =
+		FTS_SOLR_USER_CONTEXT_REQUIRE(ctx->ctx.backend->ns->user);
+	uoff_t max_bytes = fuser->set.batch_bytes;
+
+	if (!ctx->batch_open)
+		return FALSE;
+	if (ctx->mails_since_flush >= fuser->set.batch_size)
+		return TRUE;
+	if (max_bytes == 0 && ctx->async)
+		max_bytes = SOLR_ASYNC_DEFAULT_BATCH_BYTES;
+	return max_bytes != 0 &&
+		ctx->bytes_since_flush + str_len(ctx->cmd) >= max_bytes;
+}
+
+static void
+fts_backend_solr_cmd_open(struct solr_fts_backend_update_context *ctx,
+			  string_t *str, const char *cmd)
+{
+	struct fts_solr_user *fuser =
+		FTS_SOLR_USER_CONTEXT_REQUIRE(ctx->ctx.backend->ns->user);
+
+	if (fuser->set.commit_within_msecs == 0)
+		str_printfa(str, "<%s>", cmd);
+	else {
+		str_printfa(str, "<%s commitWithin=\"%u\">", cmd,
+			    fuser->set.commit_within_msecs);
+	}
+}
+
 static void
 fts_backend_solr_expunge_flush(struct solr_fts_backend_update_context *ctx)
 {
@@ -379,7 +446,7 @@ fts_backend_solr_expunge_flush(struct solr_fts_backend_update_context *ctx)
 	str_append(ctx->cmd_expunge, "</delete>");
 	(void)solr_connection_post(backend->solr_conn, str_c(ctx->cmd_expunge));
 	str_truncate(ctx->cmd_expunge, 0);
-	str_append(ctx->cmd_expunge, "<delete>");
+	fts_backend_solr_cmd_open(ctx, ctx->cmd_expunge, "delete");
 }
 
 static int fts_backend_solr_commit(struct solr_fts_backend_update_context *ctx)
@@ -389,8 +456,10 @@ static int fts_backend_solr_commit(struct solr_fts_backend_update_context *ctx)
 	struct fts_solr_user *fuser =
 		FTS_SOLR_USER_CONTEXT_REQUIRE(ctx->ctx.backend->ns->user);
 
-	if (!fuser->set.soft_commit)
+	if (!fuser->set.soft_commit || fuser->set.commit_within_msecs != 0) {
+		/* Solr commits the changes by itself */
 		return 0;
+	}
 
 	const char *str = t_strdup_printf(
 		"<commit softCommit=\"true\" waitSearcher=\"%s\"/>",
@@ -404,10 +473,15 @@ fts_backend_solr_update_deinit(struct fts_backend_update_context *_ctx)
 	struct solr_fts_backend_update_context *ctx =
 		(struct solr_fts_backend_update_context *)_ctx;
 	struct solr_fts_field *field;
+	struct solr_fts_backend *backend =
+		(struct solr_fts_backend *)_ctx->backend;
 	int ret = _ctx->failed ? -1 : 0;
 
 	if (fts_backed_solr_build_flush(ctx) < 0)
 		ret = -1;
+	if (ctx->async &&
+	    solr_connection_post_async_finish(backend->solr_conn) < 0)
+		ret = -1;
 
 	if (ctx->expunges) {
 		fts_backend_solr_expunge_flush(ctx);
@@ -432,6 +506,9 @@ fts_backend_solr_update_set_mailbox(struct fts_backend_update_context *_ctx,
 {
 	struct solr_fts_backend_update_context *ctx =
 		(struct solr_fts_backend_update_context *)_ctx;
+	struct solr_fts_backend *backend =
+		(struct solr_fts_backend *)_ctx->backend;
+	struct fts_index_header hdr;
 	const char *box_guid;
 
 	if (ctx->prev_uid != 0) {
@@ -441,11 +518,17 @@ fts_backend_solr_update_set_mailbox(struct fts_backend_update_context *_ctx,
 		   last_uid before we know it has succeeded */
 		if (fts_backed_solr_build_flush(ctx) < 0)
 			_ctx->failed = TRUE;
-		else if (!_ctx->failed) {
+		if (ctx->async &&
+		    solr_connection_post_async_finish(backend->solr_conn) < 0)
+			_ctx->failed = TRUE;
+		if (!_ctx->failed) {
 			if (fts_backend_solr_commit(ctx) < 0)
 				_ctx->failed = TRUE;
-			else
+			else if (!fts_index_get_header(ctx->cur_box, &hdr) ||
+				 ctx->prev_uid > hdr.last_indexed_uid) {
+				/* don't lower it when filling missing UIDs */
 				fts_index_set_last_uid(ctx->cur_box, ctx->prev_uid);
+			}
 		}
 		ctx->prev_uid = 0;
 	}
@@ -486,7 +569,7 @@ fts_backend_solr_update_expunge(struct fts_backend_update_context *_ctx,
 	if (!ctx->expunges) {
 		ctx->expunges = TRUE;
 		ctx->cmd_expunge = str_new(default_pool, 1024);
-		str_append(ctx->cmd_expunge, "<delete>");
+		fts_backend_solr_cmd_open(ctx, ctx->cmd_expunge, "delete");
 	}
 
 	if (str_len(ctx->cmd_expunge) >= SOLR_CMDBUF_FLUSH_SIZE)
@@ -503,19 +586,19 @@ fts_backend_solr_uid_changed(struct solr_fts_backend_update_context *ctx,
 {
 	struct solr_fts_backend *backend =
 		(struct solr_fts_backend *)ctx->ctx.backend;
-	struct fts_solr_user *fuser =
-		FTS_SOLR_USER_CONTEXT_REQUIRE(ctx->ctx.backend->ns->user);
 
-	if (ctx->mails_since_flush >= fuser->set.batch_size) {
+	if (fts_backend_solr_batch_full(ctx)) {
 		if (fts_backed_solr_build_flush(ctx) < 0)
 			ctx->ctx.failed = TRUE;
 	}
 	ctx->mails_since_flush++;
-	if (ctx->post == NULL) {
+	if (!ctx->batch_open) {
 		if (ctx->cmd == NULL)
 			ctx->cmd = str_new(default_pool, SOLR_CMDBUF_SIZE);
-		ctx->post = solr_connection_post_begin(backend->solr_conn);
-		str_append(ctx->cmd, "<add>");
+		if (!ctx->async)
+			ctx->post = solr_connection_post_begin(backend->solr_conn);
+		ctx->batch_open = TRUE;
+		fts_backend_solr_cmd_open(ctx, ctx->cmd, "add");
 	} else {
 		fts_backend_solr_doc_close(ctx);
 	}
@@ -590,13 +673,9 @@ fts_backend_solr_update_build_more(struct fts_backend_update_context *_ctx,
 	if (ctx->cur_value2 == NULL && ctx->cur_value == ctx->cmd) {
 		/* we're writing to message body. if size is huge,
 		   flush it once in a while */
-		while (size >= SOLR_CMDBUF_FLUSH_SIZE) {
-			if (str_len(ctx->cmd) >= SOLR_CMDBUF_FLUSH_SIZE) {
-				solr_connection_post_more(ctx->post,
-							  str_data(ctx->cmd),
-							  str_len(ctx->cmd));
-				str_truncate(ctx->cmd, 0);
-			}
+		while (ctx->post != NULL && size >= SOLR_CMDBUF_FLUSH_SIZE) {
+			if (str_len(ctx->cmd) >= SOLR_CMDBUF_FLUSH_SIZE)
+				fts_backend_solr_cmd_send(ctx);
 			len = xml_encode_data_max(ctx->cmd, data, size,
 						  SOLR_CMDBUF_FLUSH_SIZE -
 						  str_len(ctx->cmd));
@@ -623,11 +702,8 @@ fts_backend_solr_update_build_more(struct fts_backend_update_context *_ctx,
 		}
 	}
 
-	if (str_len(ctx->cmd) >= SOLR_CMDBUF_FLUSH_SIZE) {
-		solr_connection_post_more(ctx->post, str_data(ctx->cmd),
-					  str_len(ctx->cmd));
-		str_truncate(ctx->cmd, 0);
-	}
+	if (str_len(ctx->cmd) >= SOLR_CMDBUF_FLUSH_SIZE)
+		fts_backend_solr_cmd_send(ctx);
 	if (!ctx->truncate_header &&
 	    str_len(ctx->cur_value) >= SOLR_HEADER_MAX_SIZE) {
 		/* a large header */
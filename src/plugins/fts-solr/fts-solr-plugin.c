@@ -2,6 +2,7 @@
 
 #include "lib.h"
 #include "array.h"
+#include "str-parse.h"
 #include "http-client.h"
 #include "mail-user.h"
 #include "mail-storage-hooks.h"
@@ -21,12 +22,13 @@ static int
 fts_solr_plugin_init_settings(struct mail_user *user,
 			      struct fts_solr_settings *set, const char *str)
 {
-	const char *value, *const *tmp;
+	const char *value, *error, *const *tmp;
 
 	if (str == NULL)
 		str = "";
 
 	set->batch_size = DEFAULT_SOLR_BATCH_SIZE;
+	set->max_parallel_updates = 1;
 	set->soft_commit = TRUE;
 
 	for (tmp = t_strsplit_spaces(str, " "); *tmp != NULL; tmp++) {
@@ -47,6 +49,29 @@ fts_solr_plugin_init_settings(struct mail_user *user,
 					"fts-solr: batch_size must be a positive integer");
 					return -1;
 			}
+		} else if (str_begins(*tmp, "batch_bytes=", &value)) {
+			if (str_parse_get_size(value, &set->batch_bytes,
+					       &error) < 0) {
+				e_error(user->event,
+					"fts-solr: Invalid batch_bytes: %s",
+					error);
+				return -1;
+			}
+		} else if (str_begins(*tmp, "max_parallel_updates=", &value)) {
+			if (str_to_uint(value, &set->max_parallel_updates) < 0 ||
+			    set->max_parallel_updates == 0) {
+				e_error(user->event,
+					"fts-solr: max_parallel_updates must be a positive integer");
+				return -1;
+			}
+		} else if (str_begins(*tmp, "commit_within=", &value)) {
+			if (str_parse_get_interval_msecs(value,
+					&set->commit_within_msecs, &error) < 0) {
+				e_error(user->event,
+					"fts-solr: Invalid commit_within: %s",
+					error);
+				return -1;
+			}
 		} else if (str_begins(*tmp, "soft_commit=", &value)) {
 			if (strcmp(value, "yes") == 0) {
 				set->soft_commit = TRUE;
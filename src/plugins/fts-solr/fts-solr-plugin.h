@@ -13,6 +13,14 @@
 struct fts_solr_settings {
 	const char *url, *default_ns_prefix, *rawlog_dir;
 	unsigned int batch_size;
+	/* Flush the batch when it reaches this many bytes (0 = unlimited) */
+	uoff_t batch_bytes;
+	/* Maximum number of update requests in flight. With more than 1 the
+	   batches are posted asynchronously. */
+	unsigned int max_parallel_updates;
+	/* Let Solr commit within this many msecs instead of committing
+	   explicitly (0 = explicit commits) */
+	unsigned int commit_within_msecs;
 	bool use_libfts;
 	bool debug;
 	bool soft_commit;
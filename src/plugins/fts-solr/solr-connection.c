@@ -33,6 +33,7 @@ struct solr_connection_post {
 	int request_status;
 
 	bool failed:1;
+	bool async:1;
 };
 
 struct solr_connection {
@@ -44,9 +45,16 @@ struct solr_connection {
 	char *http_user;
 	char *http_password;
 
+	/* Asynchronous update requests */
+	unsigned int async_posts_max;
+	unsigned int async_posts_pending;
+	unsigned int async_posts_wait_max;
+
 	bool debug:1;
 	bool posting:1;
 	bool http_ssl:1;
+	bool async_posts_failed:1;
+	bool async_posts_waiting:1;
 };
 
 /* Regardless of the specified URL, make sure path ends in '/' */
@@ -94,12 +102,14 @@ int solr_connection_init(const struct fts_solr_settings *solr_set,
 	}
 
 	conn->debug = solr_set->debug;
+	conn->async_posts_max = solr_set->max_parallel_updates;
 
 	if (solr_http_client == NULL) {
 		i_zero(&http_set);
 		http_set.max_idle_time_msecs = 5*1000;
 		http_set.max_parallel_connections = 1;
-		http_set.max_pipelined_requests = 1;
+		http_set.max_pipelined_requests =
+			I_MAX(solr_set->max_parallel_updates, 1);
 		http_set.max_redirects = 1;
 		http_set.max_attempts = 3;
 		http_set.connect_timeout_msecs = 5*1000;
@@ -126,6 +136,8 @@ void solr_connection_deinit(struct solr_connection **_conn)
 {
 	struct solr_connection *conn = *_conn;
 
+	i_assert(conn->async_posts_pending == 0);
+
 	*_conn = NULL;
 	event_unref(&conn->event);
 	i_free(conn->http_host);
@@ -219,6 +231,21 @@ int solr_connection_select(struct solr_connection *conn, const char *query,
 	return 0;
 }
 
+static void
+solr_connection_async_post_finished(struct solr_connection_post *post)
+{
+	struct solr_connection *conn = post->conn;
+
+	if (post->request_status < 0)
+		conn->async_posts_failed = TRUE;
+	i_assert(conn->async_posts_pending > 0);
+	conn->async_posts_pending--;
+	if (conn->async_posts_waiting &&
+	    conn->async_posts_pending <= conn->async_posts_wait_max)
+		io_loop_stop(current_ioloop);
+	i_free(post);
+}
+
 static void
 solr_connection_update_response(const struct http_response *response,
 				struct solr_connection_post *post)
@@ -229,6 +256,8 @@ solr_connection_update_response(const struct http_response *response,
 			http_response_get_message(response));
 		post->request_status = -1;
 	}
+	if (post->async)
+		solr_connection_async_post_finished(post);
 }
 
 static struct http_client_request *
@@ -328,3 +357,63 @@ int solr_connection_post(struct solr_connection *conn, const char *cmd)
 
 	return post.request_status;
 }
+
+static void
+solr_connection_async_wait(struct solr_connection *conn,
+			   unsigned int max_pending)
+{
+	struct ioloop *prev_ioloop, *prev_client_ioloop, *ioloop;
+
+	if (conn->async_posts_pending <= max_pending)
+		return;
+
+	/* Like http_client_wait(), but return as soon as enough of the
+	   requests have finished rather than waiting for all of them. */
+	prev_ioloop = current_ioloop;
+	ioloop = io_loop_create();
+	prev_client_ioloop = http_client_switch_ioloop(solr_http_client);
+
+	conn->async_posts_waiting = TRUE;
+	conn->async_posts_wait_max = max_pending;
+	while (conn->async_posts_pending > max_pending)
+		io_loop_run(ioloop);
+	conn->async_posts_waiting = FALSE;
+
+	if (prev_client_ioloop != NULL)
+		io_loop_set_current(prev_client_ioloop);
+	else
+		io_loop_set_current(prev_ioloop);
+	(void)http_client_switch_ioloop(solr_http_client);
+	io_loop_set_current(ioloop);
+	io_loop_destroy(&ioloop);
+}
+
+int solr_connection_post_async(struct solr_connection *conn,
+			       const unsigned char *data, size_t size)
+{
+	struct solr_connection_post *post;
+
+	i_assert(!conn->posting);
+
+	/* Keep at most async_posts_max requests in flight. */
+	solr_connection_async_wait(conn, conn->async_posts_max - 1);
+
+	post = i_new(struct solr_connection_post, 1);
+	post->conn = conn;
+	post->async = TRUE;
+	post->http_req = solr_connection_post_request(post);
+	http_client_request_set_payload_data(post->http_req, data, size);
+	conn->async_posts_pending++;
+	http_client_request_submit(post->http_req);
+	return conn->async_posts_failed ? -1 : 0;
+}
+
+int solr_connection_post_async_finish(struct solr_connection *conn)
+{
+	solr_connection_async_wait(conn, 0);
+	if (conn->async_posts_failed) {
+		conn->async_posts_failed = FALSE;
+		return -1;
+	}
+	return 0;
+}
@@ -23,4 +23,13 @@ void solr_connection_post_more(struct solr_connection_post *post,
 			       const unsigned char *data, size_t size);
 int solr_connection_post_end(struct solr_connection_post **post);
 
+/* Submit an update request without waiting for it to finish, unless the
+   max_parallel_updates limit has been reached. The data is copied.
+   Returns -1 if some earlier asynchronous update has already failed. */
+int solr_connection_post_async(struct solr_connection *conn,
+			       const unsigned char *data, size_t size);
+/* Wait for all the asynchronous updates to finish. Returns -1 if any of
+   them failed since the last call. */
+int solr_connection_post_async_finish(struct solr_connection *conn);
+
 #endif
@@ -129,6 +129,21 @@ int fts_index_set_header(struct mailbox *box,
 int ATTR_NOWARN_UNUSED_RESULT
 fts_index_set_last_uid(struct mailbox *box, uint32_t last_uid);
 int fts_backend_reset_last_uids(struct fts_backend *backend);
+
+/* The missing UIDs are UIDs below the last indexed UID that aren't indexed,
+   e.g. because a rescan found them missing from the backend. They are
+   indexed the next time the mailbox is indexed, and searching doesn't
+   trust the FTS results for them meanwhile. */
+void fts_index_get_missing_uids(struct mailbox *box,
+				ARRAY_TYPE(seq_range) *uids);
+/* Like fts_index_get_missing_uids(), but return the sequences of the missing
+   mails that still exist. */
+void fts_index_get_missing_seqs(struct mailbox *box,
+				ARRAY_TYPE(seq_range) *seqs);
+int fts_index_add_missing_uids(struct mailbox *box,
+			       const ARRAY_TYPE(seq_range) *uids);
+int fts_index_remove_missing_uids(struct mailbox *box,
+				  const ARRAY_TYPE(seq_range) *uids);
 int fts_index_have_compatible_settings(struct mailbox_list *list,
 				       uint32_t checksum);
 
@@ -257,6 +257,9 @@ int fts_backend_refresh(struct fts_backend *backend)
 	return backend->v.refresh(backend);
 }
 
+static int fts_index_set_missing_uids(struct mailbox *box,
+				      const ARRAY_TYPE(seq_range) *uids);
+
 int fts_backend_reset_last_uids(struct fts_backend *backend)
 {
 	struct mailbox_list_iterate_context *iter;
@@ -273,10 +276,16 @@ int fts_backend_reset_last_uids(struct fts_backend *backend)
 			continue;
 
 		box = mailbox_alloc(info->ns->list, info->vname, 0);
-		if (mailbox_open(box) == 0) {
+		if (mailbox_open(box) == 0) T_BEGIN {
+			ARRAY_TYPE(seq_range) missing;
+
 			if (fts_index_set_last_uid(box, 0) < 0)
 				ret = -1;
-		}
+			/* everything is reindexed anyway */
+			t_array_init(&missing, 1);
+			if (fts_index_set_missing_uids(box, &missing) < 0)
+				ret = -1;
+		} T_END;
 		mailbox_free(&box);
 	}
 	if (mailbox_list_iter_deinit(&iter) < 0)
@@ -314,11 +323,8 @@ fts_merge_maybies(ARRAY_TYPE(seq_range) *dest_maybe,
 		  const ARRAY_TYPE(seq_range) *src_maybe,
 		  const ARRAY_TYPE(seq_range) *src_definite)
 {
-	ARRAY_TYPE(seq_range) src_unwanted;
-	const struct seq_range *range;
+	ARRAY_TYPE(seq_range) src_unwanted, definite_maybe;
 	struct seq_range new_range;
-	unsigned int i, count;
-	uint32_t seq;
 
 	/* add/leave to dest_maybe if at least one list has maybe,
 	   and no lists have none */
@@ -334,13 +340,10 @@ fts_merge_maybies(ARRAY_TYPE(seq_range) *dest_maybe,
 	seq_range_array_remove_seq_range(dest_maybe, &src_unwanted);
 
 	/* add uids that are in dest_definite and src_maybe lists */
-	range = array_get(dest_definite, &count);
-	for (i = 0; i < count; i++) {
-		for (seq = range[i].seq1; seq <= range[i].seq2; seq++) {
-			if (seq_range_exists(src_maybe, seq))
-				seq_range_array_add(dest_maybe, seq);
-		}
-	}
+	t_array_init(&definite_maybe, array_count(dest_definite));
+	array_append_array(&definite_maybe, dest_definite);
+	(void)seq_range_array_intersect(&definite_maybe, src_maybe);
+	seq_range_array_merge(dest_maybe, &definite_maybe);
 }
 
 void fts_filter_uids(ARRAY_TYPE(seq_range) *definite_dest,
@@ -511,6 +514,122 @@ int fts_index_set_last_uid(struct mailbox *box, uint32_t last_uid)
 	return fts_index_set_header(box, &hdr);
 }
 
+static uint32_t fts_index_get_missing_ext_id(struct mailbox *box)
+{
+	return mail_index_ext_register(box->index, "fts-missing", 0, 0, 0);
+}
+
+void fts_index_get_missing_uids(struct mailbox *box,
+				ARRAY_TYPE(seq_range) *uids)
+{
+	struct mail_index_view *view;
+	const struct seq_range *range;
+	const void *data;
+	size_t i, count, data_size;
+
+	mail_index_refresh(box->index);
+	view = mail_index_view_open(box->index);
+	mail_index_get_header_ext(view, fts_index_get_missing_ext_id(box),
+				  &data, &data_size);
+	/* the header may not shrink, so it could have zeros at the end */
+	range = data;
+	count = data_size / sizeof(*range);
+	for (i = 0; i < count && range[i].seq1 != 0; i++) {
+		if (range[i].seq1 <= range[i].seq2)
+			seq_range_array_add_range(uids, range[i].seq1,
+						  range[i].seq2);
+	}
+	mail_index_view_close(&view);
+}
+
+void fts_index_get_missing_seqs(struct mailbox *box,
+				ARRAY_TYPE(seq_range) *seqs)
+{
+	ARRAY_TYPE(seq_range) uids;
+	const struct seq_range *range;
+	uint32_t seq1, seq2;
+
+	if (box->virtual_vfuncs != NULL)
+		return;
+
+	t_array_init(&uids, 8);
+	fts_index_get_missing_uids(box, &uids);
+	array_foreach(&uids, range) {
+		mailbox_get_seq_range(box, range->seq1, range->seq2,
+				      &seq1, &seq2);
+		if (seq1 != 0)
+			seq_range_array_add_range(seqs, seq1, seq2);
+	}
+}
+
+static int fts_index_set_missing_uids(struct mailbox *box,
+				      const ARRAY_TYPE(seq_range) *uids)
+{
+	struct mail_index_transaction *trans;
+	uint32_t ext_id = fts_index_get_missing_ext_id(box);
+	const struct seq_range *range;
+	struct mail_index_view *view;
+	const void *data;
+	size_t old_size, size;
+	unsigned int count;
+
+	view = mail_index_view_open(box->index);
+	mail_index_get_header_ext(view, ext_id, &data, &old_size);
+	mail_index_view_close(&view);
+
+	range = array_get(uids, &count);
+	size = count * sizeof(*range);
+	if (size == 0 && old_size == 0)
+		return 0;
+
+	trans = mail_index_transaction_begin(box->view, 0);
+	if (size > old_size)
+		mail_index_ext_resize_hdr(trans, ext_id, size);
+	if (size > 0)
+		mail_index_update_header_ext(trans, ext_id, 0, range, size);
+	if (old_size > size) {
+		/* the header isn't shrunk - just zero out the old ranges */
+		void *zeros = t_malloc0(old_size - size);
+		mail_index_update_header_ext(trans, ext_id, size, zeros,
+					     old_size - size);
+	}
+	return mail_index_transaction_commit(&trans);
+}
+
+int fts_index_add_missing_uids(struct mailbox *box,
+			       const ARRAY_TYPE(seq_range) *uids)
+{
+	ARRAY_TYPE(seq_range) missing;
+	int ret;
+
+	if (array_count(uids) == 0)
+		return 0;
+	T_BEGIN {
+		t_array_init(&missing, 8);
+		fts_index_get_missing_uids(box, &missing);
+		seq_range_array_merge(&missing, uids);
+		ret = fts_index_set_missing_uids(box, &missing);
+	} T_END;
+	return ret;
+}
+
+int fts_index_remove_missing_uids(struct mailbox *box,
+				  const ARRAY_TYPE(seq_range) *uids)
+{
+	ARRAY_TYPE(seq_range) missing;
+	int ret = 0;
+
+	if (array_count(uids) == 0)
+		return 0;
+	T_BEGIN {
+		t_array_init(&missing, 8);
+		fts_index_get_missing_uids(box, &missing);
+		if (seq_range_array_remove_seq_range(&missing, uids) > 0)
+			ret = fts_index_set_missing_uids(box, &missing);
+	} T_END;
+	return ret;
+}
+
 int fts_index_have_compatible_settings(struct mailbox_list *list,
 				       uint32_t checksum)
 {
@@ -34,6 +34,12 @@ struct fts_mail_build_context {
 
 	buffer_t *word_buf, *pending_input;
 	struct fts_user_language *cur_user_lang;
+
+	/* fts_language_reuse: the language to use for the rest of the mail,
+	   and the mail's lowercased From address */
+	const struct fts_language *reuse_lang;
+	char *sender;
+	bool in_body:1;
 };
 
 static int fts_build_data(struct fts_mail_build_context *ctx,
@@ -134,6 +140,28 @@ fts_build_tokenized_hdr_update_lang(struct fts_mail_build_context *ctx,
 	}
 }
 
+static void
+fts_build_mail_set_sender(struct fts_mail_build_context *ctx,
+			  const struct message_address *addr)
+{
+	struct mail_user *user = ctx->update_ctx->backend->ns->user;
+
+	if ((ctx->update_ctx->backend->flags &
+	     FTS_BACKEND_FLAG_TOKENIZED_INPUT) == 0 ||
+	    fts_user_get_language_reuse(user) != FTS_USER_LANGUAGE_REUSE_SENDER)
+		return;
+	if (ctx->sender != NULL || addr == NULL || addr->mailbox == NULL ||
+	    addr->domain == NULL || addr->domain[0] == '\0')
+		return;
+
+	ctx->sender = str_lcase(i_strconcat(addr->mailbox, "@",
+					    addr->domain, NULL));
+	if (ctx->reuse_lang == NULL) {
+		ctx->reuse_lang =
+			fts_user_sender_language_lookup(user, ctx->sender);
+	}
+}
+
 static int fts_build_mail_header(struct fts_mail_build_context *ctx,
 				 const struct message_block *block)
 {
@@ -153,6 +181,7 @@ static int fts_build_mail_header(struct fts_mail_build_context *ctx,
 	key.part = block->part;
 	key.hdr_name = hdr->name;
 
+	ctx->in_body = FALSE;
 	if ((ctx->update_ctx->backend->flags &
 	     FTS_BACKEND_FLAG_TOKENIZED_INPUT) != 0)
 		fts_build_tokenized_hdr_update_lang(ctx, hdr);
@@ -173,6 +202,9 @@ static int fts_build_mail_header(struct fts_mail_build_context *ctx,
 					     hdr->full_value,
 					     hdr->full_value_len,
 					     UINT_MAX, 0);
+		if (block->part->physical_pos == 0 &&
+		    strcasecmp(hdr->name, "From") == 0)
+			fts_build_mail_set_sender(ctx, addr);
 		str = t_str_new(hdr->full_value_len);
 		message_address_write(str, addr);
 
@@ -252,6 +284,7 @@ fts_build_body_begin(struct fts_mail_build_context *ctx,
 	key.body_content_type = parser_context.content_type;
 	key.body_content_disposition = ctx->content_disposition;
 	ctx->cur_user_lang = NULL;
+	ctx->in_body = TRUE;
 	if (!fts_backend_update_set_build_key(ctx->update_ctx, &key)) {
 		if (ctx->body_parser != NULL)
 			(void)fts_parser_deinit(&ctx->body_parser, NULL);
@@ -303,10 +336,14 @@ fts_detect_language(struct fts_mail_build_context *ctx,
 	const struct fts_language *lang;
 	const char *error;
 
+	if (ctx->reuse_lang != NULL) {
+		*lang_r = ctx->reuse_lang;
+		return 1;
+	}
+
 	switch (fts_language_detect(lang_list, data, size, &lang, &error)) {
 	case FTS_LANGUAGE_RESULT_SHORT:
-		/* save the input so far and try again later */
-		buffer_append(ctx->pending_input, data, size);
+		/* try again later with more input */
 		if (last) {
 			/* we've run out of data. use the default language. */
 			*lang_r = fts_language_list_get_first(lang_list);
@@ -318,6 +355,17 @@ fts_detect_language(struct fts_mail_build_context *ctx,
 		*lang_r = fts_language_list_get_first(lang_list);
 		return 1;
 	case FTS_LANGUAGE_RESULT_OK:
+		if (ctx->in_body &&
+		    fts_user_get_language_reuse(user) !=
+		    FTS_USER_LANGUAGE_REUSE_NONE) {
+			/* body text is long enough to be trusted for
+			   the rest of the mail */
+			ctx->reuse_lang = lang;
+			if (ctx->sender != NULL) {
+				fts_user_sender_language_set(user, ctx->sender,
+							     lang);
+			}
+		}
 		*lang_r = lang;
 		return 1;
 	case FTS_LANGUAGE_RESULT_ERROR:
@@ -342,23 +390,26 @@ fts_build_tokenized(struct fts_mail_build_context *ctx,
 
 	if (ctx->cur_user_lang != NULL) {
 		/* we already have a language */
-	} else if ((ret = fts_detect_language(ctx, data, size, last, &lang)) < 0) {
-		return -1;
-	} else if (ret == 0) {
-		/* wait for more data */
-		return 0;
 	} else {
-		fts_mail_build_ctx_set_lang(ctx, fts_user_language_find(user, lang));
-
 		if (ctx->pending_input->used > 0) {
-			if (fts_build_add_tokens_with_filter(ctx,
-					ctx->pending_input->data,
-					ctx->pending_input->used) < 0)
-				return -1;
-			buffer_set_used_size(ctx->pending_input, 0);
+			/* detect using all the input so far */
+			buffer_append(ctx->pending_input, data, size);
+			data = ctx->pending_input->data;
+			size = ctx->pending_input->used;
+		}
+		if ((ret = fts_detect_language(ctx, data, size, last, &lang)) < 0)
+			return -1;
+		if (ret == 0) {
+			/* save the input and wait for more data */
+			if (ctx->pending_input->used == 0)
+				buffer_append(ctx->pending_input, data, size);
+			return 0;
 		}
+		fts_mail_build_ctx_set_lang(ctx, fts_user_language_find(user, lang));
 	}
-	if (fts_build_add_tokens_with_filter(ctx, data, size) < 0)
+	ret = fts_build_add_tokens_with_filter(ctx, data, size);
+	buffer_set_used_size(ctx->pending_input, 0);
+	if (ret < 0)
 		return -1;
 	if (last) {
 		if (fts_build_add_tokens_with_filter(ctx, NULL, 0) < 0)
@@ -580,7 +631,8 @@ fts_build_mail_real(struct fts_backend_update_context *update_ctx,
 	struct message_parser_ctx *parser;
 	struct message_decoder_context *decoder;
 	struct message_block raw_block, block;
-	struct message_part *prev_part, *parts;
+	struct message_part *prev_part, *parts, *cached_parts;
+	enum mail_lookup_abort orig_lookup_abort;
 	bool skip_body = FALSE, body_part = FALSE, body_added = FALSE;
 	bool binary_body;
 	const char *error;
@@ -601,9 +653,23 @@ fts_build_mail_real(struct fts_backend_update_context *update_ctx,
 	if ((update_ctx->backend->flags & FTS_BACKEND_FLAG_TOKENIZED_INPUT) != 0)
 		ctx.pending_input = buffer_create_dynamic(default_pool, 128);
 
+	/* Use the MIME structure if it already exists in cache. Parsing
+	   with it is faster, since MIME boundaries don't need to be searched
+	   from the whole message. */
+	orig_lookup_abort = mail->lookup_abort;
+	mail->lookup_abort = MAIL_LOOKUP_ABORT_NOT_IN_CACHE;
+	if (mail_get_parts(mail, &cached_parts) < 0)
+		cached_parts = NULL;
+	mail->lookup_abort = orig_lookup_abort;
+
 	prev_part = NULL;
 	pool_t parts_pool = pool_alloconly_create("fts message parts", 512);
-	parser = message_parser_init(parts_pool, input, &parser_set);
+	if (cached_parts != NULL) {
+		parser = message_parser_init_from_parts(cached_parts, input,
+							&parser_set);
+	} else {
+		parser = message_parser_init(parts_pool, input, &parser_set);
+	}
 
 	decoder = message_decoder_init(update_ctx->normalizer, 0);
 	for (;;) {
@@ -693,11 +759,22 @@ fts_build_mail_real(struct fts_backend_update_context *update_ctx,
 		block.data = NULL; block.size = 0;
 		ret = fts_build_body_block(&ctx, &block, TRUE);
 	}
-	if (message_parser_deinit_from_parts(&parser, &parts, &error) < 0)
+	if (message_parser_deinit_from_parts(&parser, &parts, &error) < 0) {
 		index_mail_set_message_parts_corrupted(mail, error);
+		if (cached_parts != NULL && ret == 0) {
+			/* the indexed data may be broken - try again
+			   without the cached parts */
+			*retriable_err_msg_r = t_strdup_printf(
+				"Cached MIME parts don't match message: %s",
+				error);
+			*may_need_retry_r = TRUE;
+			ret = -1;
+		}
+	}
 	message_decoder_deinit(&decoder);
 	i_free(ctx.content_type);
 	i_free(ctx.content_disposition);
+	i_free(ctx.sender);
 	buffer_free(&ctx.word_buf);
 	buffer_free(&ctx.pending_input);
 	pool_unref(&parts_pool);
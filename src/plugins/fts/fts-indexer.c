@@ -11,7 +11,7 @@
 #include "str-parse.h"
 #include "mail-user.h"
 #include "mail-storage-private.h"
-#include "fts-api.h"
+#include "fts-api-private.h"
 #include "fts-storage.h"
 #include "fts-indexer.h"
 #include "fts-indexer-status.h"
@@ -268,14 +268,26 @@ int fts_indexer_init(struct fts_backend *backend, struct mailbox *box,
 	if (ret < 0)
 		return -1;
 	if (ret > 0) {
-		/* everything is already indexed */
-		return 0;
+		/* everything up to the last mail is indexed */
+		seq1 = 0;
+	} else {
+		mailbox_get_seq_range(box, last_uid+1, (uint32_t)-1,
+				      &seq1, &seq2);
 	}
-
-	mailbox_get_seq_range(box, last_uid+1, (uint32_t)-1, &seq1, &seq2);
 	if (seq1 == 0) {
-		/* no new messages (last messages in mailbox were expunged) */
-		return 0;
+		/* no new messages (or the last messages in mailbox were
+		   expunged), but there may still be holes in the index */
+		bool have_missing;
+
+		T_BEGIN {
+			ARRAY_TYPE(seq_range) missing;
+
+			t_array_init(&missing, 8);
+			fts_index_get_missing_seqs(box, &missing);
+			have_missing = array_count(&missing) > 0;
+		} T_END;
+		if (!have_missing)
+			return 0;
 	}
 
 	path = t_strconcat(box->storage->user->set->base_dir,
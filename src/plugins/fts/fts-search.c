@@ -152,6 +152,16 @@ multi_add_lookup_result(struct fts_search_context *fctx,
 	return 0;
 }
 
+static int fts_score_map_uid_cmp(const struct fts_score_map *m1,
+				 const struct fts_score_map *m2)
+{
+	if (m1->uid < m2->uid)
+		return -1;
+	if (m1->uid > m2->uid)
+		return 1;
+	return 0;
+}
+
 static int fts_search_lookup_level_multi(struct fts_search_context *fctx,
 					 struct mail_search_arg *args,
 					 bool and_args)
@@ -201,6 +211,9 @@ static int fts_search_lookup_level_multi(struct fts_search_context *fctx,
 		if (multi_add_lookup_result(fctx, level, args, &result) < 0)
 			return -1;
 	}
+	/* the scores were added per backend mailbox, but merging them and
+	   looking them up requires them to be sorted by virtual UID */
+	array_sort(&level->score_map, fts_score_map_uid_cmp);
 	fctx->search_state = result.search_state;
 	return 0;
 }
@@ -393,6 +406,12 @@ static void fts_search_try_lookup(struct fts_search_context *fctx)
 				      &seq1, &seq2);
 	}
 	fctx->first_unindexed_seq = seq1 != 0 ? seq1 : (uint32_t)-1;
+	if (!fctx->virtual_mailbox) {
+		if (!array_is_created(&fctx->missing_seqs))
+			p_array_init(&fctx->missing_seqs, fctx->result_pool, 8);
+		array_clear(&fctx->missing_seqs);
+		fts_index_get_missing_seqs(fctx->box, &fctx->missing_seqs);
+	}
 
 	if (fctx->virtual_mailbox) {
 		hash_table_clear(fctx->last_indexed_virtual_uids, TRUE);
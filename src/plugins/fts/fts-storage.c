@@ -57,6 +57,10 @@ struct fts_transaction_context {
 	uint32_t next_index_seq;
 	uint32_t highest_virtual_uid;
 	unsigned int precache_extra_count;
+	/* Missing mails below next_index_seq that still need to be indexed,
+	   and the UIDs that can be removed from the missing UIDs after the
+	   backend has committed the changes. */
+	ARRAY_TYPE(seq_range) missing_seqs, unmissing_uids;
 
 	bool indexing:1;
 	bool precached:1;
@@ -121,6 +125,20 @@ fts_mailbox_get_status(struct mailbox *box, enum mailbox_status_items items,
 		   don't want to reindex all mails to FTS if .cache file is
 		   deleted. */
 		status_r->last_cached_seq = seq;
+		T_BEGIN {
+			/* make the indexer go through the missing mails */
+			ARRAY_TYPE(seq_range) missing;
+			const struct seq_range *range;
+
+			t_array_init(&missing, 8);
+			fts_index_get_missing_seqs(box, &missing);
+			if (array_count(&missing) > 0) {
+				range = array_front(&missing);
+				if (range->seq1 <= seq)
+					status_r->last_cached_seq =
+						range->seq1 - 1;
+			}
+		} T_END;
 	}
 	return 0;
 }
@@ -376,6 +394,11 @@ static bool fts_mailbox_search_next_update_seq(struct mail_search_context *ctx)
 		/* we've not indexed this far */
 		return TRUE;
 	}
+	if (array_is_created(&fctx->missing_seqs) &&
+	    seq_range_exists(&fctx->missing_seqs, ctx->seq)) {
+		/* this mail is missing from the index */
+		return TRUE;
+	}
 
 	/* apply [non]matches based on the FTS lookup results */
 	idx = 0;
@@ -483,6 +506,43 @@ fts_mail_precache_range(struct mailbox_transaction_context *trans,
 	return ret;
 }
 
+static void
+fts_mail_precache_init_missing(struct mailbox *box,
+			       struct fts_transaction_context *ft)
+{
+	ARRAY_TYPE(seq_range) missing_uids;
+	const struct seq_range *range;
+	uint32_t seq1, seq2, uid;
+
+	i_array_init(&ft->missing_seqs, 8);
+	i_array_init(&ft->unmissing_uids, 8);
+	T_BEGIN {
+		t_array_init(&missing_uids, 8);
+		fts_index_get_missing_uids(box, &missing_uids);
+		array_foreach(&missing_uids, range) {
+			mailbox_get_seq_range(box, range->seq1, range->seq2,
+					      &seq1, &seq2);
+			if (seq1 == 0) {
+				/* expunged already */
+				seq_range_array_add_range(&ft->unmissing_uids,
+							  range->seq1,
+							  range->seq2);
+			} else if (seq1 < ft->next_index_seq) {
+				seq_range_array_add_range(&ft->missing_seqs,
+					seq1, I_MIN(seq2, ft->next_index_seq - 1));
+			}
+			if (seq1 != 0 && seq2 >= ft->next_index_seq) {
+				/* these are indexed the normal way, and until
+				   then they're after the last indexed UID */
+				mail_index_lookup_uid(box->view,
+					I_MAX(seq1, ft->next_index_seq), &uid);
+				seq_range_array_add_range(&ft->unmissing_uids,
+							  uid, range->seq2);
+			}
+		}
+	} T_END;
+}
+
 static int fts_mail_precache_init(struct mail *_mail)
 {
 	struct fts_transaction_context *ft = FTS_CONTEXT_REQUIRE(_mail->transaction);
@@ -496,6 +556,8 @@ static int fts_mail_precache_init(struct mail *_mail)
 
 	ft->precached = TRUE;
 	ft->next_index_seq = last_seq + 1;
+	if (_mail->box->virtual_vfuncs == NULL)
+		fts_mail_precache_init_missing(_mail->box, ft);
 	if (flist->update_ctx == NULL)
 		flist->update_ctx = fts_backend_update_init(flist->backend);
 	flist->update_ctx_refcount++;
@@ -537,6 +599,17 @@ static int fts_mail_index(struct mail *_mail)
 		}
 	}
 
+	if (_mail->seq < ft->next_index_seq &&
+	    array_is_created(&ft->missing_seqs) &&
+	    seq_range_array_remove(&ft->missing_seqs, _mail->seq)) {
+		/* fill a hole in the index */
+		fts_backend_update_set_mailbox(flist->update_ctx, _mail->box);
+		if (fts_build_mail(flist->update_ctx, _mail) < 0)
+			return -1;
+		seq_range_array_add(&ft->unmissing_uids, _mail->uid);
+		return 0;
+	}
+
 	if (ft->next_index_seq < _mail->seq) {
 		/* we'll first need to index all the missing mails up to the
 		   current one. */
@@ -638,6 +711,11 @@ static int fts_transaction_end(struct mailbox_transaction_context *t, const char
 			if (fts_backend_update_deinit(&flist->update_ctx) < 0) {
 				ret = -1;
 				*error_r = "backend deinit";
+			} else if (array_is_created(&ft->unmissing_uids) &&
+				   fts_index_remove_missing_uids(t->box,
+						&ft->unmissing_uids) < 0) {
+				ret = -1;
+				*error_r = "index missing uids update";
 			}
 		}
 	} else if (ft->highest_virtual_uid > 0) {
@@ -660,6 +738,10 @@ static int fts_transaction_end(struct mailbox_transaction_context *t, const char
 		}
 	}
 	event_reason_end(&reason);
+	if (array_is_created(&ft->missing_seqs)) {
+		array_free(&ft->missing_seqs);
+		array_free(&ft->unmissing_uids);
+	}
 	i_free(ft);
 	return ret;
 }
@@ -39,6 +39,8 @@ struct fts_search_context {
 
 	uint32_t first_unindexed_seq;
 	uint32_t next_unindexed_seq;
+	/* Mails before first_unindexed_seq that are missing from the index */
+	ARRAY_TYPE(seq_range) missing_seqs;
 	HASH_TABLE_TYPE(virtual_last_indexed) last_indexed_virtual_uids;
 
 	/* final scores, combined from all levels */
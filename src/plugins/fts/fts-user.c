@@ -1,6 +1,7 @@
 /* Copyright (c) 2015-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "hash.h"
 #include "module-context.h"
 #include "mail-user.h"
 #include "mail-storage-private.h"
@@ -15,6 +16,14 @@
 #define FTS_USER_CONTEXT_REQUIRE(obj) \
 	MODULE_CONTEXT_REQUIRE(obj, fts_user_module)
 
+/* How many of the most recently filtered tokens to remember for each
+   language. Common words repeat often enough that this avoids most of the
+   (especially ICU) filtering work. */
+#define FTS_USER_FILTER_CACHE_COUNT 4096
+/* Maximum number of senders whose language is remembered. The whole cache is
+   cleared when this is reached. */
+#define FTS_USER_SENDER_LANGUAGES_MAX_COUNT 1000
+
 struct fts_user {
 	union mail_user_module_context module_ctx;
 	int refcount;
@@ -24,6 +33,10 @@ struct fts_user {
 	ARRAY_TYPE(fts_user_language) languages, data_languages;
 
 	struct mailbox_match_plugin *autoindex_exclude;
+
+	enum fts_user_language_reuse language_reuse;
+	pool_t sender_langs_pool;
+	HASH_TABLE(char *, const struct fts_language *) sender_langs;
 };
 
 static MODULE_CONTEXT_DEFINE_INIT(fts_user_module,
@@ -59,7 +72,7 @@ static int
 fts_user_init_languages(struct mail_user *user, struct fts_user *fuser,
 			const char **error_r)
 {
-	const char *languages, *unknown;
+	const char *languages, *unknown, *reuse;
 	const char *lang_config[3] = {NULL, NULL, NULL};
 
 	languages = mail_user_plugin_getenv(user, "fts_languages");
@@ -83,6 +96,19 @@ fts_user_init_languages(struct mail_user *user, struct fts_user *fuser,
 		*error_r = "fts_languages setting is empty";
 		return -1;
 	}
+
+	reuse = mail_user_plugin_getenv(user, "fts_language_reuse");
+	if (reuse == NULL || reuse[0] == '\0' || strcmp(reuse, "no") == 0)
+		fuser->language_reuse = FTS_USER_LANGUAGE_REUSE_NONE;
+	else if (strcmp(reuse, "mail") == 0)
+		fuser->language_reuse = FTS_USER_LANGUAGE_REUSE_MAIL;
+	else if (strcmp(reuse, "sender") == 0)
+		fuser->language_reuse = FTS_USER_LANGUAGE_REUSE_SENDER;
+	else {
+		*error_r = t_strdup_printf(
+			"fts_language_reuse: Unknown value '%s'", reuse);
+		return -1;
+	}
 	return 0;
 }
 
@@ -147,6 +173,8 @@ fts_user_create_filters(struct mail_user *user, const struct fts_language *lang,
 			fts_filter_unref(&parent);
 		return -1;
 	}
+	if (filter != NULL)
+		fts_filter_cache_init(filter, FTS_USER_FILTER_CACHE_COUNT);
 	*filter_r = filter;
 	return 0;
 }
@@ -342,6 +370,51 @@ struct fts_user_language *fts_user_get_data_lang(struct mail_user *user)
 	return fuser->data_lang;
 }
 
+enum fts_user_language_reuse
+fts_user_get_language_reuse(struct mail_user *user)
+{
+	struct fts_user *fuser = FTS_USER_CONTEXT_REQUIRE(user);
+
+	return fuser->language_reuse;
+}
+
+const struct fts_language *
+fts_user_sender_language_lookup(struct mail_user *user, const char *sender)
+{
+	struct fts_user *fuser = FTS_USER_CONTEXT_REQUIRE(user);
+
+	if (!hash_table_is_created(fuser->sender_langs))
+		return NULL;
+	return hash_table_lookup(fuser->sender_langs, sender);
+}
+
+void fts_user_sender_language_set(struct mail_user *user, const char *sender,
+				  const struct fts_language *lang)
+{
+	struct fts_user *fuser = FTS_USER_CONTEXT_REQUIRE(user);
+	char *orig_sender;
+	const struct fts_language *orig_lang;
+
+	if (!hash_table_is_created(fuser->sender_langs)) {
+		fuser->sender_langs_pool = pool_alloconly_create(
+			MEMPOOL_GROWING"fts sender languages", 4096);
+		hash_table_create(&fuser->sender_langs, fuser->sender_langs_pool,
+				  0, str_hash, strcmp);
+	}
+	if (hash_table_lookup_full(fuser->sender_langs, sender,
+				   &orig_sender, &orig_lang)) {
+		hash_table_update(fuser->sender_langs, orig_sender, lang);
+		return;
+	}
+	if (hash_table_count(fuser->sender_langs) >=
+	    FTS_USER_SENDER_LANGUAGES_MAX_COUNT) {
+		hash_table_clear(fuser->sender_langs, TRUE);
+		p_clear(fuser->sender_langs_pool);
+	}
+	hash_table_insert(fuser->sender_langs,
+			  p_strdup(fuser->sender_langs_pool, sender), lang);
+}
+
 bool fts_user_autoindex_exclude(struct mailbox *box)
 {
 	struct fts_user *fuser = FTS_USER_CONTEXT_REQUIRE(box->storage->user);
@@ -371,6 +444,8 @@ static void fts_user_free(struct fts_user *fuser)
 			fts_user_language_free(user_lang);
 	}
 	mailbox_match_plugin_deinit(&fuser->autoindex_exclude);
+	hash_table_destroy(&fuser->sender_langs);
+	pool_unref(&fuser->sender_langs_pool);
 }
 
 static int
@@ -8,6 +8,17 @@ struct fts_user_language {
 };
 ARRAY_DEFINE_TYPE(fts_user_language, struct fts_user_language *);
 
+enum fts_user_language_reuse {
+	/* Detect the language separately for each field */
+	FTS_USER_LANGUAGE_REUSE_NONE = 0,
+	/* Use the language detected from the first body part for the rest
+	   of the mail */
+	FTS_USER_LANGUAGE_REUSE_MAIL,
+	/* Like _MAIL, but also remember the language for the mail's From
+	   address and use it for the sender's other mails */
+	FTS_USER_LANGUAGE_REUSE_SENDER,
+};
+
 struct fts_user_language *
 fts_user_language_find(struct mail_user *user,
                        const struct fts_language *lang);
@@ -18,6 +29,14 @@ struct fts_user_language *fts_user_get_data_lang(struct mail_user *user);
 const ARRAY_TYPE(fts_user_language) *
 fts_user_get_data_languages(struct mail_user *user);
 
+enum fts_user_language_reuse
+fts_user_get_language_reuse(struct mail_user *user);
+/* Returns the language remembered for the sender address, or NULL if none. */
+const struct fts_language *
+fts_user_sender_language_lookup(struct mail_user *user, const char *sender);
+void fts_user_sender_language_set(struct mail_user *user, const char *sender,
+				  const struct fts_language *lang);
+
 bool fts_user_autoindex_exclude(struct mailbox *box);
 
 int fts_mail_user_init(struct mail_user *user, bool initialize_libfts,
@@ -2,6 +2,8 @@
 
 #include "lib.h"
 #include "ioloop.h"
+#include "strnum.h"
+#include "str-parse.h"
 #include "dict.h"
 #include "mail-user.h"
 #include "mail-namespace.h"
@@ -18,6 +20,12 @@ struct last_login_user {
 	union mail_user_module_context module_ctx;
 	struct dict *dict;
 	struct timeout *to;
+
+	struct dict_op_settings dset;
+	const char *key_name, *value;
+	/* stored value is in these units per second */
+	uint64_t value_units;
+	unsigned int interval_secs;
 };
 
 const char *last_login_plugin_version = DOVECOT_ABI_VERSION;
@@ -72,14 +80,49 @@ last_login_dict_commit(const struct dict_commit_result *result,
 	luser->to = timeout_add(0, last_login_dict_deinit, user);
 }
 
+static void last_login_dict_write(struct mail_user *user)
+{
+	struct last_login_user *luser = LAST_LOGIN_USER_CONTEXT(user);
+	struct dict_transaction_context *trans;
+
+	trans = dict_transaction_begin(luser->dict, &luser->dset);
+	if (luser->value != NULL)
+		dict_set(trans, luser->key_name, luser->value);
+	dict_transaction_commit_async(&trans, last_login_dict_commit, user);
+}
+
+static void
+last_login_dict_lookup(const struct dict_lookup_result *result,
+		       struct mail_user *user)
+{
+	struct last_login_user *luser = LAST_LOGIN_USER_CONTEXT(user);
+	uint64_t value;
+
+	if (result->ret < 0) {
+		e_error(user->event,
+			"last_login_dict: Failed to lookup value: %s",
+			result->error);
+	} else if (result->ret > 0 &&
+		   str_to_uint64(result->value, &value) == 0 &&
+		   value / luser->value_units + luser->interval_secs >
+		   (uint64_t)ioloop_time) {
+		/* updated recently enough - skip the write */
+		luser->to = timeout_add(0, last_login_dict_deinit, user);
+		return;
+	}
+	last_login_dict_write(user);
+}
+
 static void last_login_mail_user_created(struct mail_user *user)
 {
 	struct mail_user_vfuncs *v = user->vlast;
 	struct last_login_user *luser;
 	struct dict *dict;
 	struct dict_settings set;
-	struct dict_transaction_context *trans;
-	const char *dict_value, *key_name, *precision, *error;
+	const char *dict_value, *key_name, *precision, *interval, *error;
+	const char *value = NULL;
+	uint64_t value_units = 1;
+	unsigned int interval_secs = 0;
 
 	if (user->autocreated) {
 		/* we want to handle only logged in users,
@@ -95,6 +138,15 @@ static void last_login_mail_user_created(struct mail_user *user)
 	if (dict_value == NULL || dict_value[0] == '\0')
 		return;
 
+	interval = mail_user_plugin_getenv(user, "last_login_interval");
+	if (interval != NULL &&
+	    str_parse_get_interval(interval, &interval_secs, &error) < 0) {
+		e_error(user->event,
+			"last_login_dict: Invalid last_login_interval '%s': %s",
+			interval, error);
+		interval_secs = 0;
+	}
+
 	i_zero(&set);
 	set.base_dir = user->set->base_dir;
 	set.event_parent = user->event;
@@ -121,30 +173,45 @@ static void last_login_mail_user_created(struct mail_user *user)
 	key_name = t_strconcat(DICT_PATH_SHARED, key_name, NULL);
 
 	precision = mail_user_plugin_getenv(user, "last_login_precision");
-
-	struct dict_op_settings dset = *mail_user_get_dict_op_settings(user);
-	dset.no_slowness_warning = TRUE;
-	trans = dict_transaction_begin(dict, &dset);
 	if (precision == NULL || strcmp(precision, "s") == 0)
-		dict_set(trans, key_name, dec2str(ioloop_time));
+		value = dec2str(ioloop_time);
 	else if (strcmp(precision, "ms") == 0) {
-		dict_set(trans, key_name, t_strdup_printf(
+		value = t_strdup_printf(
 			"%ld%03u", (long)ioloop_timeval.tv_sec,
-			(unsigned int)(ioloop_timeval.tv_usec/1000)));
+			(unsigned int)(ioloop_timeval.tv_usec/1000));
+		value_units = 1000;
 	} else if (strcmp(precision, "us") == 0) {
-		dict_set(trans, key_name, t_strdup_printf(
+		value = t_strdup_printf(
 			"%ld%06u", (long)ioloop_timeval.tv_sec,
-			(unsigned int)ioloop_timeval.tv_usec));
+			(unsigned int)ioloop_timeval.tv_usec);
+		value_units = 1000000;
 	} else if (strcmp(precision, "ns") == 0) {
-		dict_set(trans, key_name, t_strdup_printf(
+		value = t_strdup_printf(
 			"%ld%06u000", (long)ioloop_timeval.tv_sec,
-			(unsigned int)ioloop_timeval.tv_usec));
+			(unsigned int)ioloop_timeval.tv_usec);
+		value_units = 1000000000;
 	} else {
 		e_error(user->event,
 			"last_login_dict: Invalid last_login_precision '%s'",
 			precision);
 	}
-	dict_transaction_commit_async(&trans, last_login_dict_commit, user);
+
+	luser->dset = *mail_user_get_dict_op_settings(user);
+	luser->dset.no_slowness_warning = TRUE;
+	luser->key_name = p_strdup(user->pool, key_name);
+	luser->value = p_strdup(user->pool, value);
+	luser->value_units = value_units;
+	luser->interval_secs = interval_secs;
+
+	if (interval_secs == 0 || value == NULL)
+		last_login_dict_write(user);
+	else {
+		/* Skip the write if the stored value is recent enough. This
+		   avoids a dict write for every login of users that log in
+		   frequently. */
+		dict_lookup_async(dict, &luser->dset, luser->key_name,
+				  last_login_dict_lookup, user);
+	}
 }
 
 static struct mail_storage_hooks last_login_mail_storage_hooks = {
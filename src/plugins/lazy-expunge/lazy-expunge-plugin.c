@@ -317,7 +317,11 @@ static void lazy_expunge_mail_expunge_move(struct mail *_mail)
 			lazy_expunge_set_error(lt, _mail->box->storage);
 			return;
 		}
-		if (mailbox_sync(lt->dest_box, 0) < 0) {
+		/* The mailbox is opened SAVEONLY, so a fast sync avoids
+		   a full (e.g. Maildir/new/) scan of a large expunge mailbox
+		   on every expunging transaction. The moves below don't need
+		   more than the index to be refreshed. */
+		if (mailbox_sync(lt->dest_box, MAILBOX_SYNC_FLAG_FAST) < 0) {
 			mail_set_critical(_mail,
 				"lazy_expunge: Couldn't sync expunge mailbox");
 			lazy_expunge_set_error(lt, lt->dest_box->storage);
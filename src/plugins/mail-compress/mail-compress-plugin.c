@@ -10,6 +10,7 @@
 #include "index-storage.h"
 #include "index-mail.h"
 #include "compression.h"
+#include "iostream-zstd-dict.h"
 #include "mail-compress-plugin.h"
 
 #include <fcntl.h>
@@ -44,6 +45,8 @@ struct mail_compress_user {
 
 	const struct compression_handler *save_handler;
 	int save_level;
+	/* zstd dictionary used for saving, 0 if none */
+	unsigned int save_zstd_dict_id;
 };
 
 const char *mail_compress_plugin_version = DOVECOT_ABI_VERSION;
@@ -233,8 +236,14 @@ mail_compress_mail_save_compress_begin(struct mail_save_context *ctx,
 	if (zbox->super.save_begin(ctx, input) < 0)
 		return -1;
 
-	output = zuser->save_handler->create_ostream(ctx->data.output,
-						     zuser->save_level);
+	if (zuser->save_zstd_dict_id != 0) {
+		output = o_stream_create_zstd_dict(ctx->data.output,
+						   zuser->save_level,
+						   zuser->save_zstd_dict_id);
+	} else {
+		output = zuser->save_handler->create_ostream(ctx->data.output,
+							     zuser->save_level);
+	}
 	o_stream_unref(&ctx->data.output);
 	ctx->data.output = output;
 	o_stream_cork(ctx->data.output);
@@ -333,6 +342,32 @@ static void mail_compress_mail_user_deinit(struct mail_user *user)
 	zuser->module_ctx.super.deinit(user);
 }
 
+static void
+mail_compress_zstd_dicts_load(struct mail_user *user,
+			      struct mail_compress_user *zuser)
+{
+	const char *set_name, *path, *error;
+	unsigned int i, dict_id;
+
+	/* mail_compress_zstd_dictionary is used for saving new mails.
+	   mail_compress_zstd_dictionary2 etc. are older dictionaries that are
+	   only needed for reading the mails saved with them. */
+	for (i = 1;; i++) {
+		set_name = i == 1 ? "mail_compress_zstd_dictionary" :
+			t_strdup_printf("mail_compress_zstd_dictionary%u", i);
+		path = mail_user_plugin_getenv(user, set_name);
+		if (path == NULL || path[0] == '\0')
+			break;
+		if (zstd_dict_load(path, &dict_id, &error) < 0) {
+			e_error(user->event, "%s: %s", set_name, error);
+			continue;
+		}
+		if (i == 1 && zuser->save_handler != NULL &&
+		    strcmp(zuser->save_handler->name, "zstd") == 0)
+			zuser->save_zstd_dict_id = dict_id;
+	}
+}
+
 static void mail_compress_mail_user_created(struct mail_user *user)
 {
 	struct mail_user_vfuncs *v = user->vlast;
@@ -372,6 +407,7 @@ static void mail_compress_mail_user_created(struct mail_user *user)
 	} else if (zuser->save_handler != NULL) {
 		zuser->save_level = zuser->save_handler->get_default_level();
 	}
+	mail_compress_zstd_dicts_load(user, zuser);
 	MODULE_CONTEXT_SET(user, mail_compress_user_module, zuser);
 }
 
@@ -3,6 +3,9 @@
 
 #include "notify-plugin.h"
 
+/* Returns TRUE if any registered context wants the event. */
+bool notify_contexts_want(enum notify_event event);
+
 void notify_contexts_mail_transaction_begin(struct mailbox_transaction_context *t);
 void notify_contexts_mail_save(struct mail *mail);
 void notify_contexts_mail_copy(struct mail *src, struct mail *dst);
@@ -16,12 +16,15 @@ struct notify_mail_txn {
 struct notify_context {
 	struct notify_context *prev, *next;
 	struct notify_vfuncs v;
+	enum notify_event events;
 	struct notify_mail_txn *mail_txn_list;
 	void *mailbox_delete_txn;
 };
 
 const char *notify_plugin_version = DOVECOT_ABI_VERSION;
 static struct notify_context *ctx_list = NULL;
+/* union of all the contexts' events */
+static enum notify_event ctx_list_events = 0;
 
 static struct notify_mail_txn *
 notify_context_find_mail_txn(struct notify_context *ctx,
@@ -36,6 +39,20 @@ notify_context_find_mail_txn(struct notify_context *ctx,
 	i_panic("no notify_mail_txn found");
 }
 
+static void notify_contexts_update_events(void)
+{
+	struct notify_context *ctx;
+
+	ctx_list_events = 0;
+	for (ctx = ctx_list; ctx != NULL; ctx = ctx->next)
+		ctx_list_events |= ctx->events;
+}
+
+bool notify_contexts_want(enum notify_event event)
+{
+	return (ctx_list_events & event) != 0;
+}
+
 void notify_contexts_mail_transaction_begin(struct mailbox_transaction_context *t)
 {
 	struct notify_context *ctx;
@@ -56,7 +73,7 @@ void notify_contexts_mail_save(struct mail *mail)
 	struct notify_mail_txn *mail_txn;
 
 	for (ctx = ctx_list; ctx != NULL; ctx = ctx->next) {
-		if (ctx->v.mail_save == NULL)
+		if ((ctx->events & NOTIFY_EVENT_MAIL_SAVE) == 0)
 			continue;
 		mail_txn = notify_context_find_mail_txn(ctx, mail->transaction);
 		ctx->v.mail_save(mail_txn->txn, mail);
@@ -69,7 +86,7 @@ void notify_contexts_mail_copy(struct mail *src, struct mail *dst)
 	struct notify_mail_txn *mail_txn;
 
 	for (ctx = ctx_list; ctx != NULL; ctx = ctx->next) {
-		if (ctx->v.mail_copy == NULL)
+		if ((ctx->events & NOTIFY_EVENT_MAIL_COPY) == 0)
 			continue;
 		mail_txn = notify_context_find_mail_txn(ctx, dst->transaction);
 		ctx->v.mail_copy(mail_txn->txn, src, dst);
@@ -82,7 +99,7 @@ void notify_contexts_mail_expunge(struct mail *mail)
 	struct notify_mail_txn *mail_txn;
 
 	for (ctx = ctx_list; ctx != NULL; ctx = ctx->next) {
-		if (ctx->v.mail_expunge == NULL)
+		if ((ctx->events & NOTIFY_EVENT_MAIL_EXPUNGE) == 0)
 			continue;
 		mail_txn = notify_context_find_mail_txn(ctx, mail->transaction);
 		ctx->v.mail_expunge(mail_txn->txn, mail);
@@ -99,7 +116,7 @@ void notify_contexts_mail_update_flags(struct mail *mail,
 		return;
 
 	for (ctx = ctx_list; ctx != NULL; ctx = ctx->next) {
-		if (ctx->v.mail_update_flags == NULL)
+		if ((ctx->events & NOTIFY_EVENT_MAIL_UPDATE_FLAGS) == 0)
 			continue;
 		mail_txn = notify_context_find_mail_txn(ctx, mail->transaction);
 		ctx->v.mail_update_flags(mail_txn->txn, mail, old_flags);
@@ -116,7 +133,7 @@ void notify_contexts_mail_update_keywords(struct mail *mail,
 		return;
 
 	for (ctx = ctx_list; ctx != NULL; ctx = ctx->next) {
-		if (ctx->v.mail_update_keywords == NULL)
+		if ((ctx->events & NOTIFY_EVENT_MAIL_UPDATE_KEYWORDS) == 0)
 			continue;
 		mail_txn = notify_context_find_mail_txn(ctx, mail->transaction);
 		ctx->v.mail_update_keywords(mail_txn->txn, mail, old_keywords);
@@ -230,12 +247,32 @@ void notify_contexts_mailbox_set_subscribed(struct mailbox *box,
 
 struct notify_context *
 notify_register(const struct notify_vfuncs *v)
+{
+	return notify_register_events(v, NOTIFY_EVENTS_MAIL_ALL);
+}
+
+struct notify_context *
+notify_register_events(const struct notify_vfuncs *v,
+		       enum notify_event events)
 {
 	struct notify_context *ctx;
 
+	if (v->mail_save == NULL)
+		events &= ENUM_NEGATE(NOTIFY_EVENT_MAIL_SAVE);
+	if (v->mail_copy == NULL)
+		events &= ENUM_NEGATE(NOTIFY_EVENT_MAIL_COPY);
+	if (v->mail_expunge == NULL)
+		events &= ENUM_NEGATE(NOTIFY_EVENT_MAIL_EXPUNGE);
+	if (v->mail_update_flags == NULL)
+		events &= ENUM_NEGATE(NOTIFY_EVENT_MAIL_UPDATE_FLAGS);
+	if (v->mail_update_keywords == NULL)
+		events &= ENUM_NEGATE(NOTIFY_EVENT_MAIL_UPDATE_KEYWORDS);
+
 	ctx = i_new(struct notify_context, 1);
 	ctx->v = *v;
+	ctx->events = events;
 	DLLIST_PREPEND(&ctx_list, ctx);
+	notify_contexts_update_events();
 	return ctx;
 }
 
@@ -258,6 +295,7 @@ void notify_unregister(struct notify_context **_ctx)
 		ctx->v.mailbox_delete_rollback(ctx->mailbox_delete_txn);
 	DLLIST_REMOVE(&ctx_list, ctx);
 	i_free(ctx);
+	notify_contexts_update_events();
 }
 
 void notify_plugin_init(struct module *module)
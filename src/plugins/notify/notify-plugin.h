@@ -12,6 +12,18 @@ struct mailbox;
 struct notify_context;
 struct module;
 
+enum notify_event {
+	NOTIFY_EVENT_MAIL_SAVE			= 0x01,
+	NOTIFY_EVENT_MAIL_COPY			= 0x02,
+	NOTIFY_EVENT_MAIL_EXPUNGE		= 0x04,
+	NOTIFY_EVENT_MAIL_UPDATE_FLAGS		= 0x08,
+	NOTIFY_EVENT_MAIL_UPDATE_KEYWORDS	= 0x10,
+};
+#define NOTIFY_EVENTS_MAIL_ALL \
+	(NOTIFY_EVENT_MAIL_SAVE | NOTIFY_EVENT_MAIL_COPY | \
+	 NOTIFY_EVENT_MAIL_EXPUNGE | NOTIFY_EVENT_MAIL_UPDATE_FLAGS | \
+	 NOTIFY_EVENT_MAIL_UPDATE_KEYWORDS)
+
 struct notify_vfuncs {
 	void *(*mail_transaction_begin)(struct mailbox_transaction_context *t);
 	void (*mail_save)(void *txn, struct mail *mail);
@@ -35,6 +47,13 @@ struct notify_vfuncs {
 
 struct notify_context *
 notify_register(const struct notify_vfuncs *vfuncs);
+/* Like notify_register(), but call the per-mail vfuncs only for the given
+   events. If no registered context wants an event, the storage hooks skip
+   the mail lookups needed to generate it. NULL vfuncs are never called,
+   regardless of the events. */
+struct notify_context *
+notify_register_events(const struct notify_vfuncs *vfuncs,
+		       enum notify_event events);
 void notify_unregister(struct notify_context **ctx);
 
 void notify_plugin_init(struct module *module);
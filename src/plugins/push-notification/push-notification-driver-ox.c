@@ -46,6 +46,9 @@ struct push_notification_driver_ox_config {
 	bool use_unsafe_username;
 	unsigned int http_max_retries;
 	unsigned int http_timeout_msecs;
+	unsigned int http_max_parallel;
+	/* Don't wait for the notifications to be sent at user deinit */
+	bool async;
 
 	char *cached_ox_metadata;
 	time_t cached_ox_metadata_timestamp;
@@ -72,6 +75,7 @@ push_notification_driver_ox_init_global(
 		http_set.debug = user->mail_debug;
 		http_set.max_attempts = config->http_max_retries+1;
 		http_set.request_timeout_msecs = config->http_timeout_msecs;
+		http_set.max_parallel_connections = config->http_max_parallel;
 		http_set.event_parent = user->event;
 		mail_user_init_ssl_client_settings(user, &ssl_set);
 		http_set.ssl = &ssl_set;
@@ -135,6 +139,16 @@ push_notification_driver_ox_init(struct push_notification_driver_config *config,
 	    (str_to_uint(tmp, &dconfig->http_timeout_msecs) < 0)) {
 		dconfig->http_timeout_msecs = DEFAULT_TIMEOUT_MSECS;
 	}
+	tmp = hash_table_lookup(config->config, (const char *)"max_parallel");
+	if (tmp != NULL &&
+	    str_to_uint(tmp, &dconfig->http_max_parallel) < 0) {
+		event_unref(&dconfig->event);
+		*error_r = t_strdup_printf(
+			"Failed to parse OX max_parallel %s", tmp);
+		return -1;
+	}
+	dconfig->async = hash_table_lookup(config->config,
+					   (const char *)"async") != NULL;
 
 	e_debug(dconfig->event, "Using cache lifetime: %u",
 		dconfig->cached_ox_metadata_lifetime_secs);
@@ -291,26 +305,32 @@ push_notification_driver_ox_begin_txn(struct push_notification_driver_txn *dtxn)
 	return TRUE;
 }
 
+/* The request may finish after the user is already deinitialized, so
+   the callback only uses its own reference to the driver's event. */
 static void
 push_notification_driver_ox_http_callback(
-	const struct http_response *response,
-	struct push_notification_driver_ox_config *dconfig)
+	const struct http_response *response, struct event *event)
 {
 	switch (response->status / 100) {
 	case 2:
 		// Success.
-		e_debug(dconfig->event, "Notification sent successfully: %s",
+		e_debug(event, "Notification sent successfully: %s",
 			http_response_get_message(response));
 		break;
 
 	default:
 		// Error.
-		e_error(dconfig->event, "Error when sending notification: %s",
+		e_error(event, "Error when sending notification: %s",
 			http_response_get_message(response));
 		break;
 	}
 }
 
+static void push_notification_driver_ox_http_destroy(struct event *event)
+{
+	event_unref(&event);
+}
+
 /* Callback needed for i_stream_add_destroy_callback() in
    push_notification_driver_ox_process_msg. */
 static void str_free_i(string_t *str)
@@ -385,7 +405,10 @@ push_notification_driver_ox_process_msg(
 
 	http_req = http_client_request_url(
 		ox_global->http_client, "PUT", dconfig->http_url,
-		push_notification_driver_ox_http_callback, dconfig);
+		push_notification_driver_ox_http_callback, dconfig->event);
+	event_ref(dconfig->event);
+	http_client_request_set_destroy_callback(http_req,
+		push_notification_driver_ox_http_destroy, dconfig->event);
 	http_client_request_set_event(http_req, dtxn->ptxn->event);
 	http_client_request_add_header(http_req, "Content-Type",
 				       "application/json; charset=utf-8");
@@ -436,7 +459,7 @@ push_notification_driver_ox_deinit(
 
 	i_free(dconfig->cached_ox_metadata);
 	if (ox_global != NULL) {
-		if (ox_global->http_client != NULL)
+		if (ox_global->http_client != NULL && !dconfig->async)
 			http_client_wait(ox_global->http_client);
 		i_assert(ox_global->refcount > 0);
 		--ox_global->refcount;
@@ -448,12 +471,32 @@ static void push_notification_driver_ox_cleanup(void)
 {
 	if ((ox_global != NULL) && (ox_global->refcount <= 0)) {
 		if (ox_global->http_client != NULL) {
+			if (http_client_get_pending_request_count(
+				ox_global->http_client) > 0) {
+				/* async notifications are still being sent
+				   in the background. they're waited for when
+				   the plugin is unloaded. */
+				return;
+			}
 			http_client_deinit(&ox_global->http_client);
 		}
 		i_free_and_null(ox_global);
 	}
 }
 
+static void push_notification_driver_ox_unload(void)
+{
+	if (ox_global == NULL)
+		return;
+	i_assert(ox_global->refcount <= 0);
+
+	if (ox_global->http_client != NULL) {
+		http_client_wait(ox_global->http_client);
+		http_client_deinit(&ox_global->http_client);
+	}
+	i_free_and_null(ox_global);
+}
+
 /* Driver definition */
 
 extern struct push_notification_driver push_notification_driver_ox;
@@ -466,5 +509,6 @@ struct push_notification_driver push_notification_driver_ox = {
 		.process_msg = push_notification_driver_ox_process_msg,
 		.deinit = push_notification_driver_ox_deinit,
 		.cleanup = push_notification_driver_ox_cleanup,
+		.unload = push_notification_driver_ox_unload,
 	},
 };
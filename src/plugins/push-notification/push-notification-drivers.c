@@ -173,6 +173,8 @@ void push_notification_driver_unregister(
 		i_panic("push_notification_driver_register(%s): "
 			"unknown driver", driver->name);
 	}
+	if (driver->v.unload != NULL)
+		driver->v.unload();
 
 	if (array_is_created(&push_notification_drivers)) {
 		array_delete(&push_notification_drivers, idx, 1);
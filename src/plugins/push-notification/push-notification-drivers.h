@@ -41,6 +41,10 @@ struct push_notification_driver_vfuncs {
 	void (*deinit)(struct push_notification_driver_user *duser);
 	/* Called to cleanup any global resources used in plugin. */
 	void (*cleanup)(void);
+	/* Called when the driver is unregistered. Finish any work still
+	   running in the background and free the remaining global
+	   resources. */
+	void (*unload)(void);
 };
 
 struct push_notification_driver {
@@ -2,9 +2,12 @@
 
 #include "lib.h"
 #include "ioloop.h"
+#include "mail-index-modseq.h"
 #include "mailbox-list-iter.h"
 #include "quota-private.h"
 
+#define QUOTA_RECALC_HDR_EXT_NAME "quota-recalc"
+
 struct count_quota_root {
 	struct quota_root root;
 
@@ -21,6 +24,16 @@ struct quota_mailbox_iter {
 	const char *error;
 };
 
+/* The state of the mailbox after it was last recalculated. If none of it has
+   changed, the vsize header is known to be correct and the next forced
+   recalculation can skip the mailbox. */
+struct quota_recalc_index_header {
+	uint32_t uid_validity;
+	uint32_t next_uid;
+	uint64_t highest_modseq;
+	struct mailbox_index_vsize vsize;
+};
+
 extern struct quota_backend quota_backend_count;
 
 static int
@@ -281,14 +294,54 @@ count_quota_get_resource(struct quota_root *_root,
 	return QUOTA_GET_RESULT_LIMITED;
 }
 
+static void
+quota_count_recalc_hdr_get(struct mailbox *box,
+			   struct quota_recalc_index_header *hdr_r)
+{
+	const struct mail_index_header *hdr;
+	const void *data;
+	size_t size;
+
+	i_zero(hdr_r);
+	hdr = mail_index_get_header(box->view);
+	hdr_r->uid_validity = hdr->uid_validity;
+	hdr_r->next_uid = hdr->next_uid;
+	hdr_r->highest_modseq = mail_index_modseq_get_highest(box->view);
+	mail_index_get_header_ext(box->view, box->vsize_hdr_ext_id,
+				  &data, &size);
+	if (size == sizeof(hdr_r->vsize))
+		memcpy(&hdr_r->vsize, data, size);
+}
+
+static bool
+quota_count_recalc_is_needed(struct mailbox *box, uint32_t ext_id,
+			     const struct quota_recalc_index_header *cur)
+{
+	const void *data;
+	size_t size;
+
+	if (cur->highest_modseq == 0 || cur->vsize.highest_uid == 0 ||
+	    mail_index_is_in_memory(box->index))
+		return TRUE;
+
+	/* Appends and expunges always increase the modseq, while the vsize
+	   header updates don't. So if neither the modseq nor the vsize
+	   header has changed, the previously calculated vsize is still
+	   correct. */
+	mail_index_get_header_ext(box->view, ext_id, &data, &size);
+	return size != sizeof(*cur) || memcmp(data, cur, size) != 0;
+}
+
 static int quota_count_recalculate_box(struct mailbox *box,
 				       const char **error_r)
 {
 	struct mail_index_transaction *trans;
 	struct mailbox_metadata metadata;
 	struct mailbox_index_vsize vsize_hdr;
+	struct quota_recalc_index_header recalc_hdr;
 	const char *errstr;
 	enum mail_error error;
+	uint32_t recalc_ext_id;
 
 	if (mailbox_open(box) < 0) {
 		errstr = mailbox_get_last_internal_error(box, &error);
@@ -301,6 +354,16 @@ static int quota_count_recalculate_box(struct mailbox *box,
 		return -1;
 	}
 
+	recalc_ext_id = mail_index_ext_register(box->index,
+		QUOTA_RECALC_HDR_EXT_NAME,
+		sizeof(struct quota_recalc_index_header), 0, 0);
+	quota_count_recalc_hdr_get(box, &recalc_hdr);
+	if (!quota_count_recalc_is_needed(box, recalc_ext_id, &recalc_hdr)) {
+		e_debug(box->event,
+			"quota: Mailbox unchanged since the last recalculation");
+		return 0;
+	}
+
 	/* reset the vsize header first */
 	trans = mail_index_transaction_begin(box->view,
 				MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
@@ -329,6 +392,24 @@ static int quota_count_recalculate_box(struct mailbox *box,
 			mailbox_get_last_internal_error(box, NULL));
 		return -1;
 	}
+
+	/* remember the state the vsize was calculated for */
+	quota_count_recalc_hdr_get(box, &recalc_hdr);
+	if (recalc_hdr.vsize.highest_uid == 0) {
+		/* vsize header couldn't be written (e.g. it was locked) */
+		return 0;
+	}
+	trans = mail_index_transaction_begin(box->view,
+				MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
+	mail_index_update_header_ext(trans, recalc_ext_id, 0,
+				     &recalc_hdr, sizeof(recalc_hdr));
+	if (mail_index_transaction_commit(&trans) < 0) {
+		*error_r = t_strdup_printf(
+			"Couldn't commit mail index transaction for %s: %s",
+			box->vname,
+			mail_index_get_error_message(box->view->index));
+		return -1;
+	}
 	return 0;
 }
 
@@ -1,7 +1,10 @@
 /* Copyright (c) 2013-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "ioloop.h"
+#include "hash.h"
 #include "str.h"
+#include "str-parse.h"
 #include "str-sanitize.h"
 #include "ostream.h"
 #include "connection.h"
@@ -35,6 +38,22 @@ struct quota_client {
 	bool warned_bad_state:1;
 };
 
+/* Maximum number of users in the quota_status_cache_ttl cache */
+#define QUOTA_STATUS_CACHE_MAX_USERS 10000
+
+/* Cached replies for a user. A mail that is at most as large as an already
+   accepted mail is accepted, and a mail that is at least as large as an
+   already rejected mail is rejected. */
+struct quota_status_cache_entry {
+	char *username;
+	time_t expire_time;
+
+	uoff_t ok_size;
+	char *ok_value;
+	uoff_t reject_size;
+	char *reject_value;
+};
+
 static struct event_category event_category_quota_status = {
 	.name = "quota-status"
 };
@@ -45,6 +64,8 @@ static enum quota_protocol protocol;
 static struct mail_storage_service_ctx *storage_service;
 static struct connection_list *clients;
 static char *nouser_reply;
+static unsigned int cache_ttl_secs;
+static HASH_TABLE(char *, struct quota_status_cache_entry *) cache;
 
 static void client_connected(struct master_service_connection *conn)
 {
@@ -68,6 +89,90 @@ static void client_reset(struct quota_client *client)
 	i_free(client->recipient);
 }
 
+static void quota_status_cache_entry_free(struct quota_status_cache_entry *entry)
+{
+	i_free(entry->username);
+	i_free(entry->ok_value);
+	i_free(entry->reject_value);
+	i_free(entry);
+}
+
+static void quota_status_cache_clean(bool all)
+{
+	struct hash_iterate_context *iter;
+	struct quota_status_cache_entry *entry;
+	char *username;
+
+	iter = hash_table_iterate_init(cache);
+	while (hash_table_iterate(iter, cache, &username, &entry)) {
+		if (all || entry->expire_time <= ioloop_time) {
+			hash_table_remove(cache, username);
+			quota_status_cache_entry_free(entry);
+		}
+	}
+	hash_table_iterate_deinit(&iter);
+}
+
+static const char *
+quota_status_cache_lookup(const char *username, uoff_t mail_size)
+{
+	struct quota_status_cache_entry *entry;
+
+	if (!hash_table_is_created(cache))
+		return NULL;
+	entry = hash_table_lookup(cache, username);
+	if (entry == NULL)
+		return NULL;
+	if (entry->expire_time <= ioloop_time) {
+		hash_table_remove(cache, username);
+		quota_status_cache_entry_free(entry);
+		return NULL;
+	}
+	if (entry->ok_value != NULL && mail_size <= entry->ok_size)
+		return entry->ok_value;
+	if (entry->reject_value != NULL && mail_size >= entry->reject_size)
+		return entry->reject_value;
+	return NULL;
+}
+
+static void
+quota_status_cache_update(const char *username, uoff_t mail_size, bool ok,
+			  const char *value)
+{
+	struct quota_status_cache_entry *entry;
+
+	if (!hash_table_is_created(cache))
+		return;
+	entry = hash_table_lookup(cache, username);
+	if (entry == NULL) {
+		if (hash_table_count(cache) >= QUOTA_STATUS_CACHE_MAX_USERS) {
+			quota_status_cache_clean(FALSE);
+			if (hash_table_count(cache) >=
+			    QUOTA_STATUS_CACHE_MAX_USERS)
+				quota_status_cache_clean(TRUE);
+		}
+		entry = i_new(struct quota_status_cache_entry, 1);
+		entry->username = i_strdup(username);
+		entry->expire_time = ioloop_time + cache_ttl_secs;
+		hash_table_insert(cache, entry->username, entry);
+	}
+
+	if (ok) {
+		if (entry->ok_value == NULL || mail_size > entry->ok_size) {
+			i_free(entry->ok_value);
+			entry->ok_value = i_strdup(value);
+			entry->ok_size = mail_size;
+		}
+	} else {
+		if (entry->reject_value == NULL ||
+		    mail_size < entry->reject_size) {
+			i_free(entry->reject_value);
+			entry->reject_value = i_strdup(value);
+			entry->reject_size = mail_size;
+		}
+	}
+}
+
 static enum quota_alloc_result
 quota_check(struct mail_user *user, uoff_t mail_size, const char **error_r)
 {
@@ -122,6 +227,7 @@ static void client_handle_request(struct quota_client *client)
 	const char *detail ATTR_UNUSED;
 	char delim ATTR_UNUSED;
 	string_t *resp;
+	uoff_t mail_size;
 	int ret;
 
 	if (client_check_mta_state(client) < 0 || client->recipient == NULL) {
@@ -148,12 +254,24 @@ static void client_handle_request(struct quota_client *client)
 	smtp_address_detail_parse_temp(quota_status_settings->recipient_delimiter,
 				       rcpt, &input.username, &delim,
 				       &detail);
+	/* the nonexistent users are cached with the mail size 0, which
+	   matches all mails */
+	mail_size = I_MAX(1, client->size);
+	value = quota_status_cache_lookup(input.username, mail_size);
+	if (value != NULL) {
+		e_debug(client->event, "Using cached reply for user `%s'",
+			input.username);
+		ret = 1;
+		goto reply;
+	}
+
 	ret = mail_storage_service_lookup_next(storage_service, &input,
 					       &user, &error);
 	restrict_access_allow_coredumps(TRUE);
 	if (ret == 0) {
 		e_debug(client->event, "User `%s' not found", input.username);
 		value = nouser_reply;
+		quota_status_cache_update(input.username, 0, FALSE, value);
 	} else if (ret > 0) {
 		enum quota_alloc_result qret = quota_check(user, client->size,
 							   &error);
@@ -192,12 +310,17 @@ static void client_handle_request(struct quota_client *client)
 		}
 		value = t_strdup(value); /* user's pool is being freed */
 		mail_user_deinit(&user);
+		if (ret > 0) {
+			quota_status_cache_update(input.username, mail_size,
+				qret == QUOTA_ALLOC_RESULT_OK, value);
+		}
 	} else {
 		e_error(client->event,
 			"Failed to lookup user %s: %s", input.username, error);
 		error = "Temporary internal error";
 	}
 
+reply:
 	resp = t_str_new(256);
 	if (ret < 0) {
 		/* temporary failure */
@@ -308,10 +431,24 @@ static void main_init(void)
 	value = mail_user_set_plugin_getenv(user_set, "quota_status_nouser");
 	nouser_reply = p_strdup(quota_status_pool,
 				value != NULL ? value : "REJECT Unknown user");
+
+	/* Cache the replies for this long to avoid initializing the user for
+	   each recipient query. Quota changes (and new users) are noticed
+	   only after the cached reply expires. */
+	value = mail_user_set_plugin_getenv(user_set, "quota_status_cache_ttl");
+	if (value != NULL &&
+	    str_parse_get_interval(value, &cache_ttl_secs, &error) < 0)
+		i_fatal("quota_status_cache_ttl: %s", error);
+	if (cache_ttl_secs > 0)
+		hash_table_create(&cache, default_pool, 0, str_hash, strcmp);
 }
 
 static void main_deinit(void)
 {
+	if (hash_table_is_created(cache)) {
+		quota_status_cache_clean(TRUE);
+		hash_table_destroy(&cache);
+	}
 	pool_unref(&quota_status_pool);
 	connection_list_deinit(&clients);
 	mail_storage_service_deinit(&storage_service);
@@ -24,6 +24,9 @@
 struct trash_mailbox {
 	const char *name;
 	int priority; /* lower number = higher priority */
+	/* other trash mailboxes have the same priority, so the mails'
+	   received dates are needed to find the oldest one */
+	bool compare_dates;
 
 	struct mail_namespace *ns;
 
@@ -50,9 +53,11 @@ static enum quota_alloc_result (*trash_next_quota_test_alloc)(
 		struct quota_transaction_context *, uoff_t,
 		const char **error_r);
 
-static int trash_clean_mailbox_open(struct trash_mailbox *trash)
+static int trash_clean_mailbox_open(struct trash_mailbox *trash,
+				    bool vsizes)
 {
 	struct mail_search_args *search_args;
+	enum mail_fetch_field wanted_fields;
 
 	trash->box = mailbox_alloc(trash->ns->list, trash->name, 0);
 	if (mailbox_open(trash->box) < 0) {
@@ -65,25 +70,31 @@ static int trash_clean_mailbox_open(struct trash_mailbox *trash)
 
 	trash->trans = mailbox_transaction_begin(trash->box, 0, __func__);
 
+	/* prefetch only what is used, so the candidates can be picked from
+	   the cached index data */
+	wanted_fields = vsizes ? MAIL_FETCH_VIRTUAL_SIZE :
+		MAIL_FETCH_PHYSICAL_SIZE;
+	if (trash->compare_dates)
+		wanted_fields |= MAIL_FETCH_RECEIVED_DATE;
+
 	search_args = mail_search_build_init();
 	mail_search_build_add_all(search_args);
 	trash->search_ctx = mailbox_search_init(trash->trans,
 						search_args, NULL,
-						MAIL_FETCH_PHYSICAL_SIZE |
-						MAIL_FETCH_RECEIVED_DATE, NULL);
+						wanted_fields, NULL);
 	mail_search_args_unref(&search_args);
 
 	return mailbox_search_next(trash->search_ctx, &trash->mail) ? 1 : 0;
 }
 
 static int trash_clean_mailbox_get_next(struct trash_mailbox *trash,
-					time_t *received_time_r)
+					bool vsizes, time_t *received_time_r)
 {
 	int ret;
 
 	if (trash->mail == NULL) {
 		if (trash->box == NULL)
-			ret = trash_clean_mailbox_open(trash);
+			ret = trash_clean_mailbox_open(trash, vsizes);
 		else {
 			ret = mailbox_search_next(trash->search_ctx,
 						  &trash->mail) ? 1 : 0;
@@ -94,11 +105,25 @@ static int trash_clean_mailbox_get_next(struct trash_mailbox *trash,
 		}
 	}
 
+	if (!trash->compare_dates) {
+		/* the mailbox is alone in its priority group */
+		*received_time_r = 0;
+		return 1;
+	}
 	if (mail_get_received_date(trash->mail, received_time_r) < 0)
 		return -1;
 	return 1;
 }
 
+static int trash_mail_get_size(struct trash_mailbox *trash, bool vsizes,
+			       uoff_t *size_r)
+{
+	/* use the same sizes as quota counts */
+	if (vsizes)
+		return mail_get_virtual_size(trash->mail, size_r);
+	return mail_get_physical_size(trash->mail, size_r);
+}
+
 static int trash_try_clean_mails(struct quota_transaction_context *ctx,
 				 uint64_t size_needed,
 				 unsigned int count_needed)
@@ -108,8 +133,10 @@ static int trash_try_clean_mails(struct quota_transaction_context *ctx,
 	struct event_reason *reason;
 	unsigned int i, j, count, oldest_idx;
 	time_t oldest, received = 0;
-	uint64_t size, size_expunged = 0;
+	uoff_t size;
+	uint64_t size_expunged = 0;
 	unsigned int expunged_count = 0;
+	bool vsizes = ctx->quota->set->vsizes;
 	int ret = 0;
 
 	reason = event_reason_begin("trash:clean");
@@ -124,7 +151,7 @@ static int trash_try_clean_mails(struct quota_transaction_context *ctx,
 			if (trashes[j].priority != trashes[i].priority)
 				break;
 
-			ret = trash_clean_mailbox_get_next(&trashes[j],
+			ret = trash_clean_mailbox_get_next(&trashes[j], vsizes,
 							   &received);
 			if (ret < 0)
 				goto err;
@@ -137,8 +164,8 @@ static int trash_try_clean_mails(struct quota_transaction_context *ctx,
 		}
 
 		if (oldest_idx < count) {
-			if (mail_get_physical_size(trashes[oldest_idx].mail,
-						   &size) < 0) {
+			if (trash_mail_get_size(&trashes[oldest_idx], vsizes,
+						&size) < 0) {
 				/* maybe expunged already? */
 				trashes[oldest_idx].mail = NULL;
 				continue;
@@ -341,6 +368,17 @@ static int read_configuration(struct mail_user *user, const char *path)
 	i_close_fd(&fd);
 
 	array_sort(&tuser->trash_boxes, trash_mailbox_priority_cmp);
+
+	struct trash_mailbox *trashes;
+	unsigned int i, count;
+
+	trashes = array_get_modifiable(&tuser->trash_boxes, &count);
+	for (i = 1; i < count; i++) {
+		if (trashes[i-1].priority == trashes[i].priority) {
+			trashes[i-1].compare_dates = TRUE;
+			trashes[i].compare_dates = TRUE;
+		}
+	}
 	return ret;
 }
 
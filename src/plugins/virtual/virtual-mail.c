@@ -233,11 +233,25 @@ static void virtual_mail_set_uid_cache_updates(struct mail *mail, bool set)
 static bool virtual_mail_prefetch(struct mail *mail)
 {
 	struct virtual_mail *vmail = virtual_mail_container_of(mail);
+	enum index_mail_access_part access_part = vmail->imail.data.access_part;
+	enum mail_fetch_field fields = 0;
 	struct mail *backend_mail;
 	struct mail_private *p;
 
 	if (backend_mail_get(vmail, &backend_mail) < 0)
 		return TRUE;
+
+	/* Searching updates the access_part only for the virtual mail. Tell
+	   the backend mail what is going to be read, or it assumes that
+	   everything is cached and won't prefetch anything. This allows the
+	   backend mailboxes' mails to be read in parallel while searching. */
+	if ((access_part & (READ_BODY | PARSE_BODY)) != 0)
+		fields |= MAIL_FETCH_STREAM_HEADER | MAIL_FETCH_STREAM_BODY;
+	else if ((access_part & (READ_HDR | PARSE_HDR)) != 0)
+		fields |= MAIL_FETCH_STREAM_HEADER;
+	if (fields != 0)
+		mail_add_temp_wanted_fields(backend_mail, fields, NULL);
+
 	p = (struct mail_private *)backend_mail;
 	return p->v.prefetch(backend_mail);
 }
@@ -1252,6 +1252,36 @@ virtual_bbox_mailbox_equals(struct virtual_backend_box *bbox,
 	return TRUE;
 }
 
+static uint64_t
+virtual_sync_backend_box_pending_modseq(struct virtual_backend_box *bbox,
+					uint64_t highest_modseq)
+{
+	struct mail_index_view *view = bbox->box->view;
+	const struct seq_range *range;
+	uint32_t seq, seq1, seq2;
+	uint64_t modseq, min_modseq = highest_modseq + 1;
+
+	/* The messages in sync_pending_removes no longer match the search
+	   rule, but they haven't been removed from the virtual index yet.
+	   The next sync needs to look at them again, so save a modseq that
+	   is lower than theirs. Using 0 here would make the next sync
+	   re-evaluate all the messages in the backend mailbox. */
+	array_foreach(&bbox->sync_pending_removes, range) {
+		if (!mail_index_lookup_seq_range(view, range->seq1, range->seq2,
+						 &seq1, &seq2)) {
+			/* expunged - these are handled at the next sync
+			   anyway */
+			continue;
+		}
+		for (seq = seq1; seq <= seq2; seq++) {
+			modseq = mail_index_modseq_lookup(view, seq);
+			if (modseq < min_modseq)
+				min_modseq = modseq;
+		}
+	}
+	return min_modseq == 0 ? 0 : min_modseq - 1;
+}
+
 static void virtual_sync_backend_ext_header(struct virtual_sync_context *ctx,
 					    struct virtual_backend_box *bbox)
 {
@@ -1269,8 +1299,10 @@ static void virtual_sync_backend_ext_header(struct virtual_sync_context *ctx,
 	mailbox_get_open_status(bbox->box, STATUS_UIDVALIDITY |
 				STATUS_HIGHESTMODSEQ, &status);
 	wanted_ondisk_highest_modseq =
-		array_count(&bbox->sync_pending_removes) > 0 ? 0 :
-		status.highest_modseq;
+		array_count(&bbox->sync_pending_removes) == 0 ?
+		status.highest_modseq :
+		virtual_sync_backend_box_pending_modseq(bbox,
+							status.highest_modseq);
 
 	if (mailbox_get_metadata(bbox->box, MAILBOX_METADATA_GUID,
 				 &metadata) < 0) {
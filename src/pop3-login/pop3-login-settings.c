@@ -59,6 +59,7 @@ struct service_settings pop3_login_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "login",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -68,6 +69,7 @@ struct service_settings pop3_login_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &pop3_login_unix_listeners_buf,
 			      sizeof(pop3_login_unix_listeners[0]) } },
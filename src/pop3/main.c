@@ -439,6 +439,11 @@ int main(int argc, char *argv[])
 	master_service_init_finish(master_service);
 	/* NOTE: login_set.*_socket_path are now invalid due to data stack
 	   having been freed */
+	if (!IS_STANDALONE() &&
+	    master_service_get_process_min_avail(master_service) > 0) {
+		/* we're likely started to wait for clients */
+		mail_storage_service_preload(storage_service);
+	}
 
 	/* fake that we're running, so we know if client was destroyed
 	   while handling its initial input */
@@ -48,6 +48,7 @@ struct service_settings pop3_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "$default_internal_group",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -57,6 +58,7 @@ struct service_settings pop3_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &pop3_unix_listeners_buf,
 			      sizeof(pop3_unix_listeners[0]) } },
@@ -0,0 +1,47 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "restrict-access.h"
+#include "master-service.h"
+#include "master-admin-client.h"
+#include "master-service-settings.h"
+#include "proxy-pump-client.h"
+#include "proxy-pump-session.h"
+
+static const struct master_admin_client_callback admin_callbacks = {
+	.cmd_kick_user = proxy_pump_sessions_kick,
+};
+
+static void client_connected(struct master_service_connection *conn)
+{
+	master_service_client_connection_accept(conn);
+	proxy_pump_client_create(conn->fd);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *error;
+
+	master_service = master_service_init("proxy-pump", 0,
+					     &argc, &argv, "");
+	if (master_getopt(master_service) > 0)
+		return FATAL_DEFAULT;
+
+	if (master_service_settings_read_simple(master_service, NULL, &error) < 0)
+		i_fatal("Error reading configuration: %s", error);
+
+	master_service_init_log(master_service);
+	restrict_access_by_env(RESTRICT_ACCESS_FLAG_ALLOW_ROOT, NULL);
+	restrict_access_allow_coredumps(TRUE);
+
+	master_admin_clients_init(&admin_callbacks);
+	proxy_pump_clients_init();
+	master_service_init_finish(master_service);
+
+	master_service_run(master_service, client_connected);
+
+	proxy_pump_clients_deinit();
+	proxy_pump_sessions_deinit();
+	master_service_deinit(&master_service);
+	return 0;
+}
@@ -0,0 +1,233 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "connection.h"
+#include "istream.h"
+#include "istream-unix.h"
+#include "ostream.h"
+#include "strescape.h"
+#include "master-service.h"
+#include "proxy-pump-session.h"
+#include "proxy-pump-client.h"
+
+/* Connection from a login process that hands over a proxied session:
+
+   VERSION	proxy-pump	1	0
+   <protocol> <username> [<key>=<value> ...] - with the client fd
+   (empty line) - with the server fd
+
+   Both lines are answered with "+" on success or "-<error>" on failure. The
+   login process closes its own copies of the fds after the second reply. */
+struct proxy_pump_client {
+	struct connection conn;
+
+	pool_t pool;
+	struct proxy_pump_session_state state;
+	int client_fd;
+
+	bool session_created;
+};
+
+static struct connection_list *proxy_pump_clients = NULL;
+
+static void proxy_pump_client_destroy(struct connection *conn)
+{
+	struct proxy_pump_client *client = (struct proxy_pump_client *)conn;
+
+	/* after the session is created, it owns the client connection slot */
+	if (!client->session_created)
+		master_service_client_connection_destroyed(master_service);
+	i_close_fd(&client->client_fd);
+	connection_deinit(conn);
+	pool_unref(&client->pool);
+	i_free(client);
+}
+
+static int
+proxy_pump_client_parse_input(const char *const *args, pool_t pool,
+			      struct proxy_pump_session_state *state_r,
+			      const char **error_r)
+{
+	ARRAY_TYPE(const_string) alt_usernames;
+	const char *key, *value, *field;
+
+	i_zero(state_r);
+	if (args[0] == NULL || args[1] == NULL) {
+		*error_r = "Missing protocol or username in input";
+		return -1;
+	}
+	state_r->protocol = args[0];
+	state_r->username = args[1];
+	args += 2;
+
+	p_array_init(&alt_usernames, pool, 4);
+	for (; *args != NULL; args++) {
+		value = strchr(*args, '=');
+		if (value != NULL)
+			key = t_strdup_until(*args, value++);
+		else {
+			key = *args;
+			value = "";
+		}
+		if (strcmp(key, "session") == 0)
+			state_r->session_id = value;
+		else if (strcmp(key, "lip") == 0) {
+			if (net_addr2ip(value, &state_r->local_ip) < 0) {
+				*error_r = t_strdup_printf(
+					"Invalid lip value: %s", value);
+				return -1;
+			}
+		} else if (strcmp(key, "lport") == 0) {
+			if (net_str2port(value, &state_r->local_port) < 0) {
+				*error_r = t_strdup_printf(
+					"Invalid lport value: %s", value);
+				return -1;
+			}
+		} else if (strcmp(key, "rip") == 0) {
+			if (net_addr2ip(value, &state_r->remote_ip) < 0) {
+				*error_r = t_strdup_printf(
+					"Invalid rip value: %s", value);
+				return -1;
+			}
+		} else if (strcmp(key, "rport") == 0) {
+			if (net_str2port(value, &state_r->remote_port) < 0) {
+				*error_r = t_strdup_printf(
+					"Invalid rport value: %s", value);
+				return -1;
+			}
+		} else if (strcmp(key, "dip") == 0) {
+			if (net_addr2ip(value, &state_r->dest_ip) < 0) {
+				*error_r = t_strdup_printf(
+					"Invalid dip value: %s", value);
+				return -1;
+			}
+		} else if (strcmp(key, "dport") == 0) {
+			if (net_str2port(value, &state_r->dest_port) < 0) {
+				*error_r = t_strdup_printf(
+					"Invalid dport value: %s", value);
+				return -1;
+			}
+		} else if (strcmp(key, "alt_username") == 0) {
+			/* <field>=<value> */
+			const char *p = strchr(value, '=');
+			if (p == NULL) {
+				*error_r = t_strdup_printf(
+					"Invalid alt_username value: %s", value);
+				return -1;
+			}
+			field = p_strdup_until(pool, value, p);
+			value = p + 1;
+			array_push_back(&alt_usernames, &field);
+			array_push_back(&alt_usernames, &value);
+		}
+	}
+	if (array_count(&alt_usernames) > 0) {
+		array_append_zero(&alt_usernames);
+		state_r->alt_usernames = array_front(&alt_usernames);
+	}
+	return 0;
+}
+
+static void
+proxy_pump_client_fail(struct proxy_pump_client *client, const char *error)
+{
+	e_error(client->conn.event, "%s", error);
+	o_stream_nsend_str(client->conn.output,
+			   t_strdup_printf("-%s\n", error));
+}
+
+static int
+proxy_pump_client_input_line(struct connection *conn, const char *line)
+{
+	struct proxy_pump_client *client = (struct proxy_pump_client *)conn;
+	const char *error;
+	int fd;
+
+	if (!conn->version_received) {
+		if (connection_handshake_args_default(
+			conn, t_strsplit_tabescaped(line)) < 0)
+			return -1;
+		conn->version_received = TRUE;
+		return 1;
+	}
+	if (client->session_created) {
+		e_error(conn->event, "Received unexpected line: %s", line);
+		return -1;
+	}
+
+	fd = i_stream_unix_get_read_fd(conn->input);
+	if (client->client_fd == -1) {
+		if (fd == -1) {
+			proxy_pump_client_fail(client, "Client fd not received");
+			return -1;
+		}
+		client->client_fd = fd;
+		if (proxy_pump_client_parse_input(
+			(const void *)p_strsplit_tabescaped(client->pool, line),
+			client->pool, &client->state, &error) < 0) {
+			proxy_pump_client_fail(client, t_strdup_printf(
+				"Failed to parse client input: %s", error));
+			return -1;
+		}
+		/* the server fd comes next */
+		i_stream_unix_set_read_fd(conn->input);
+	} else {
+		if (fd == -1) {
+			proxy_pump_client_fail(client, "Server fd not received");
+			return -1;
+		}
+		if (line[0] != '\0') {
+			i_close_fd(&fd);
+			proxy_pump_client_fail(client, t_strdup_printf(
+				"Expected empty server fd line, but got: %s",
+				line));
+			return -1;
+		}
+		(void)proxy_pump_session_create(client->client_fd, fd,
+						&client->state);
+		client->client_fd = -1;
+		client->session_created = TRUE;
+	}
+	o_stream_nsend_str(conn->output, "+\n");
+	return 1;
+}
+
+void proxy_pump_client_create(int fd)
+{
+	struct proxy_pump_client *client;
+
+	client = i_new(struct proxy_pump_client, 1);
+	client->pool = pool_alloconly_create("proxy pump client", 1024);
+	client->client_fd = -1;
+	client->conn.unix_socket = TRUE;
+	connection_init_server(proxy_pump_clients, &client->conn,
+			       "proxy-pump", fd, fd);
+	i_stream_unix_set_read_fd(client->conn.input);
+}
+
+static struct connection_settings client_set = {
+	.service_name_in = "proxy-pump",
+	.service_name_out = "proxy-pump",
+	.major_version = 1,
+	.minor_version = 0,
+
+	.input_max_size = 8192,
+	.output_max_size = SIZE_MAX,
+	.client = FALSE
+};
+
+static const struct connection_vfuncs client_vfuncs = {
+	.destroy = proxy_pump_client_destroy,
+	.input_line = proxy_pump_client_input_line
+};
+
+void proxy_pump_clients_init(void)
+{
+	proxy_pump_clients = connection_list_init(&client_set, &client_vfuncs);
+}
+
+void proxy_pump_clients_deinit(void)
+{
+	connection_list_deinit(&proxy_pump_clients);
+}
@@ -0,0 +1,9 @@
+#ifndef PROXY_PUMP_CLIENT_H
+#define PROXY_PUMP_CLIENT_H
+
+void proxy_pump_client_create(int fd);
+
+void proxy_pump_clients_init(void);
+void proxy_pump_clients_deinit(void);
+
+#endif
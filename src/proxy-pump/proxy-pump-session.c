@@ -0,0 +1,264 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "array.h"
+#include "llist.h"
+#include "str.h"
+#include "time-util.h"
+#include "istream.h"
+#include "ostream.h"
+#include "iostream-proxy.h"
+#include "master-service.h"
+#include "proxy-pump-session.h"
+
+#define PROXY_PUMP_MAX_INPUT_SIZE 4096
+#define PROXY_PUMP_MAX_OUTBUF_SIZE 1024
+
+#define PROXY_PUMP_SIDE_CLIENT IOSTREAM_PROXY_SIDE_LEFT
+#define PROXY_PUMP_SIDE_SERVER IOSTREAM_PROXY_SIDE_RIGHT
+#define PROXY_PUMP_SIDE_SELF "proxy"
+
+#define PROXY_PUMP_KILL_PREFIX "Disconnected by proxy: "
+#define KILLED_BY_ADMIN_REASON "Kicked by admin"
+#define KILLED_BY_SHUTDOWN_REASON "Process shutting down"
+
+struct proxy_pump_session {
+	struct proxy_pump_session *prev, *next;
+
+	pool_t pool;
+	struct event *event;
+	char *username, *anvil_service_name;
+	struct ip_addr remote_ip, dest_ip;
+	const char *const *alt_usernames;
+
+	struct istream *client_input, *server_input;
+	struct ostream *client_output, *server_output;
+	struct iostream_proxy *iostream_proxy;
+	guid_128_t anvil_conn_guid;
+
+	bool anvil_connect_sent:1;
+};
+
+static struct proxy_pump_session *proxy_pump_sessions = NULL;
+
+static struct timeval
+proxy_pump_session_last_io(struct proxy_pump_session *session)
+{
+	struct timeval max_tv, tv1, tv2, tv3, tv4;
+
+	i_stream_get_last_read_time(session->client_input, &tv1);
+	i_stream_get_last_read_time(session->server_input, &tv2);
+	o_stream_get_last_write_time(session->client_output, &tv3);
+	o_stream_get_last_write_time(session->server_output, &tv4);
+
+	max_tv = timeval_cmp(&tv3, &tv4) > 0 ? tv3 : tv4;
+	max_tv = timeval_cmp(&max_tv, &tv2) > 0 ? max_tv : tv2;
+	max_tv = timeval_cmp(&max_tv, &tv1) > 0 ? max_tv : tv1;
+	return max_tv;
+}
+
+static void
+proxy_pump_session_anvil(struct proxy_pump_session *session, bool connect)
+{
+	struct master_service_anvil_session anvil_session = {
+		.username = session->username,
+		.service_name = session->anvil_service_name,
+		.ip = session->remote_ip,
+		.dest_ip = session->dest_ip,
+		.alt_usernames = session->alt_usernames,
+	};
+
+	if (connect) {
+		if (master_service_anvil_connect(master_service,
+						 &anvil_session, TRUE,
+						 session->anvil_conn_guid))
+			session->anvil_connect_sent = TRUE;
+	} else if (session->anvil_connect_sent) {
+		master_service_anvil_disconnect(master_service, &anvil_session,
+						session->anvil_conn_guid);
+	}
+}
+
+static void
+proxy_pump_session_finished(enum iostream_proxy_side side,
+			    enum iostream_proxy_status status,
+			    struct proxy_pump_session *session)
+{
+	string_t *log_msg = t_str_new(128);
+	const char *errstr, *disconnect_side;
+	struct timeval last_io;
+	bool server_side;
+
+	server_side = side == PROXY_PUMP_SIDE_SERVER;
+	switch (status) {
+	case IOSTREAM_PROXY_STATUS_INPUT_EOF:
+		errstr = "";
+		break;
+	case IOSTREAM_PROXY_STATUS_INPUT_ERROR:
+		errstr = side == PROXY_PUMP_SIDE_CLIENT ?
+			i_stream_get_error(session->client_input) :
+			i_stream_get_error(session->server_input);
+		break;
+	case IOSTREAM_PROXY_STATUS_OTHER_SIDE_OUTPUT_ERROR:
+		server_side = !server_side;
+		errstr = side == PROXY_PUMP_SIDE_CLIENT ?
+			o_stream_get_error(session->server_output) :
+			o_stream_get_error(session->client_output);
+		break;
+	default:
+		i_unreached();
+	}
+	disconnect_side = server_side ? "server" : "client";
+
+	last_io = proxy_pump_session_last_io(session);
+	str_printfa(log_msg, "Disconnected by %s", disconnect_side);
+	if (errstr[0] != '\0')
+		str_printfa(log_msg, ": %s", errstr);
+	str_printfa(log_msg, " (%ds idle, in=%"PRIuUOFF_T", out=%"PRIuUOFF_T")",
+		    (int)(ioloop_time - last_io.tv_sec),
+		    session->server_output->offset,
+		    session->client_output->offset);
+	proxy_pump_session_destroy(&session, str_c(log_msg), errstr,
+				   disconnect_side);
+}
+
+struct proxy_pump_session *
+proxy_pump_session_create(int client_fd, int server_fd,
+			  const struct proxy_pump_session_state *state)
+{
+	struct proxy_pump_session *session;
+	pool_t pool;
+
+	pool = pool_alloconly_create("proxy pump session", 512);
+	session = p_new(pool, struct proxy_pump_session, 1);
+	session->pool = pool;
+	session->username = p_strdup(pool, state->username);
+	session->anvil_service_name =
+		p_strconcat(pool, state->protocol, "-proxy-pump", NULL);
+	session->remote_ip = state->remote_ip;
+	session->dest_ip = state->dest_ip;
+	if (state->alt_usernames != NULL)
+		session->alt_usernames = p_strarray_dup(pool, state->alt_usernames);
+
+	session->event = event_create(NULL);
+	event_add_str(session->event, "protocol", state->protocol);
+	event_add_str(session->event, "user", state->username);
+	event_add_str(session->event, "session", state->session_id);
+	event_add_ip(session->event, "local_ip", &state->local_ip);
+	event_add_int(session->event, "local_port", state->local_port);
+	event_add_ip(session->event, "remote_ip", &state->remote_ip);
+	event_add_int(session->event, "remote_port", state->remote_port);
+	event_add_ip(session->event, "dest_ip", &state->dest_ip);
+	event_add_int(session->event, "dest_port", state->dest_port);
+	event_set_append_log_prefix(session->event, t_strdup_printf(
+		"%s(%s,%s)<%s>: ", state->protocol, state->username,
+		net_ip2addr(&state->remote_ip),
+		state->session_id == NULL ? "" : state->session_id));
+
+	net_set_nonblock(client_fd, TRUE);
+	net_set_nonblock(server_fd, TRUE);
+	session->client_input = i_stream_create_fd_autoclose(&client_fd,
+		PROXY_PUMP_MAX_INPUT_SIZE);
+	session->client_output = o_stream_create_fd(
+		i_stream_get_fd(session->client_input),
+		PROXY_PUMP_MAX_OUTBUF_SIZE);
+	session->server_input = i_stream_create_fd_autoclose(&server_fd,
+		PROXY_PUMP_MAX_INPUT_SIZE);
+	session->server_output = o_stream_create_fd(
+		i_stream_get_fd(session->server_input),
+		PROXY_PUMP_MAX_OUTBUF_SIZE);
+	o_stream_set_no_error_handling(session->client_output, TRUE);
+	o_stream_set_no_error_handling(session->server_output, TRUE);
+	/* the fds were checked by the login process to be plaintext */
+	o_stream_set_splice(session->client_output, TRUE);
+	o_stream_set_splice(session->server_output, TRUE);
+
+	session->iostream_proxy =
+		iostream_proxy_create(session->client_input,
+				      session->client_output,
+				      session->server_input,
+				      session->server_output);
+	iostream_proxy_set_completion_callback(session->iostream_proxy,
+					       proxy_pump_session_finished,
+					       session);
+	iostream_proxy_start(session->iostream_proxy);
+
+	proxy_pump_session_anvil(session, TRUE);
+	DLLIST_PREPEND(&proxy_pump_sessions, session);
+
+	struct event_passthrough *e = event_create_passthrough(session->event)->
+		set_name("proxy_pump_session_started");
+	e_debug(e->event(), "Proxy session handed over from login process");
+	return session;
+}
+
+void proxy_pump_session_destroy(struct proxy_pump_session **_session,
+				const char *log_msg,
+				const char *disconnect_reason,
+				const char *disconnect_side)
+{
+	struct proxy_pump_session *session = *_session;
+	struct timeval last_io;
+
+	*_session = NULL;
+
+	last_io = proxy_pump_session_last_io(session);
+	struct event_passthrough *e = event_create_passthrough(session->event)->
+		add_str("disconnect_reason", disconnect_reason)->
+		add_str("disconnect_side", disconnect_side)->
+		add_int("idle_usecs",
+			timeval_diff_usecs(&ioloop_timeval, &last_io))->
+		add_int("net_in_bytes", session->server_output->offset)->
+		add_int("net_out_bytes", session->client_output->offset)->
+		set_name("proxy_session_finished");
+	e_info(e->event(), "%s", log_msg);
+
+	DLLIST_REMOVE(&proxy_pump_sessions, session);
+	proxy_pump_session_anvil(session, FALSE);
+
+	iostream_proxy_unref(&session->iostream_proxy);
+	/* the istreams close the fds, so destroy the ostreams first */
+	o_stream_destroy(&session->client_output);
+	o_stream_destroy(&session->server_output);
+	i_stream_destroy(&session->client_input);
+	i_stream_destroy(&session->server_input);
+	event_unref(&session->event);
+	pool_unref(&session->pool);
+
+	master_service_client_connection_destroyed(master_service);
+}
+
+unsigned int
+proxy_pump_sessions_kick(const char *user, const guid_128_t conn_guid)
+{
+	struct proxy_pump_session *session, *next;
+	unsigned int count = 0;
+	bool match_conn_guid = conn_guid != NULL &&
+		!guid_128_is_empty(conn_guid);
+
+	for (session = proxy_pump_sessions; session != NULL; session = next) {
+		next = session->next;
+		if (strcmp(session->username, user) == 0 &&
+		    (!match_conn_guid ||
+		     guid_128_cmp(session->anvil_conn_guid, conn_guid) == 0)) {
+			proxy_pump_session_destroy(&session,
+				PROXY_PUMP_KILL_PREFIX KILLED_BY_ADMIN_REASON,
+				KILLED_BY_ADMIN_REASON, PROXY_PUMP_SIDE_SELF);
+			count++;
+		}
+	}
+	return count;
+}
+
+void proxy_pump_sessions_deinit(void)
+{
+	struct proxy_pump_session *session;
+
+	while (proxy_pump_sessions != NULL) {
+		session = proxy_pump_sessions;
+		proxy_pump_session_destroy(&session,
+			PROXY_PUMP_KILL_PREFIX KILLED_BY_SHUTDOWN_REASON,
+			KILLED_BY_SHUTDOWN_REASON, PROXY_PUMP_SIDE_SELF);
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef PROXY_PUMP_SESSION_H
+#define PROXY_PUMP_SESSION_H
+
+#include "net.h"
+#include "guid.h"
+
+struct proxy_pump_session_state {
+	/* required: */
+	const char *protocol, *username;
+	/* optional: */
+	const char *session_id;
+	struct ip_addr local_ip, remote_ip, dest_ip;
+	in_port_t local_port, remote_port, dest_port;
+	/* alt username field, value pairs for anvil */
+	const char *const *alt_usernames;
+};
+
+/* Start forwarding between the client and server fds. The session takes over
+   the master service client connection slot. */
+struct proxy_pump_session *
+proxy_pump_session_create(int client_fd, int server_fd,
+			  const struct proxy_pump_session_state *state);
+void proxy_pump_session_destroy(struct proxy_pump_session **_session,
+				const char *log_msg,
+				const char *disconnect_reason,
+				const char *disconnect_side);
+
+unsigned int
+proxy_pump_sessions_kick(const char *user, const guid_128_t conn_guid);
+
+void proxy_pump_sessions_deinit(void);
+
+#endif
@@ -0,0 +1,88 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "buffer.h"
+#include "settings-parser.h"
+#include "service-settings.h"
+
+#include <stddef.h>
+#include <unistd.h>
+
+/* <settings checks> */
+static struct file_listener_settings proxy_pump_unix_listeners_array[] = {
+	{
+		.path = "login/proxy-pump",
+		.mode = 0666,
+		.user = "",
+		.group = "",
+	},
+	/* The sessions are registered to anvil with <protocol>-proxy-pump
+	   service names, so kicks for each protocol arrive to these. */
+	{
+		.path = "srv.imap-proxy-pump/%{pid}",
+		.type = "admin",
+		.mode = 0600,
+		.user = "",
+		.group = "",
+	},
+	{
+		.path = "srv.pop3-proxy-pump/%{pid}",
+		.type = "admin",
+		.mode = 0600,
+		.user = "",
+		.group = "",
+	},
+	{
+		.path = "srv.submission-proxy-pump/%{pid}",
+		.type = "admin",
+		.mode = 0600,
+		.user = "",
+		.group = "",
+	},
+	{
+		.path = "srv.managesieve-proxy-pump/%{pid}",
+		.type = "admin",
+		.mode = 0600,
+		.user = "",
+		.group = "",
+	},
+};
+static struct file_listener_settings *proxy_pump_unix_listeners[] = {
+	&proxy_pump_unix_listeners_array[0],
+	&proxy_pump_unix_listeners_array[1],
+	&proxy_pump_unix_listeners_array[2],
+	&proxy_pump_unix_listeners_array[3],
+	&proxy_pump_unix_listeners_array[4],
+};
+static buffer_t proxy_pump_unix_listeners_buf = {
+	{ { proxy_pump_unix_listeners, sizeof(proxy_pump_unix_listeners) } }
+};
+/* </settings checks> */
+
+struct service_settings proxy_pump_service_settings = {
+	.name = "proxy-pump",
+	.protocol = "",
+	.type = "",
+	.executable = "proxy-pump",
+	.user = "$default_internal_user",
+	.group = "",
+	.privileged_group = "",
+	.extra_groups = "",
+	.chroot = "",
+	.cpu_affinity = "",
+
+	.drop_priv_before_exec = FALSE,
+
+	.process_min_avail = 0,
+	.process_limit = 0,
+	.client_limit = 0,
+	.service_count = 0,
+	.idle_kill = 0,
+	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
+
+	.unix_listeners = { { &proxy_pump_unix_listeners_buf,
+			      sizeof(proxy_pump_unix_listeners[0]) } },
+	.fifo_listeners = ARRAY_INIT,
+	.inet_listeners = ARRAY_INIT
+};
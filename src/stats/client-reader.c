@@ -4,6 +4,7 @@
 #include "array.h"
 #include "str.h"
 #include "stats-dist.h"
+#include "stats-sketch.h"
 #include "strescape.h"
 #include "connection.h"
 #include "ostream.h"
@@ -57,6 +58,10 @@ static void reader_client_dump_stats(string_t *str, struct stats_dist *stats,
 			str_printfa(str, "%"PRIu64, stats_dist_get_median(stats));
 		else if (strcmp(field, "variance") == 0)
 			str_printfa(str, "%.02f", stats_dist_get_variance(stats));
+		else if (strcmp(field, "sketch") == 0) {
+			/* for merging the distribution with other servers' */
+			stats_sketch_export(stats_dist_get_sketch(stats), str);
+		}
 		else if (field[0] == '%') {
 			str_printfa(str, "%"PRIu64,
 				    stats_dist_get_percentile(stats, strtod(field+1, NULL)/100.0));
@@ -17,6 +17,8 @@
 #include "client-writer.h"
 
 #define STATS_UPDATE_CLIENTS_DELAY_MSECS 1000
+/* Clients with this minor version support AGGREGATE */
+#define STATS_CLIENT_AGGREGATE_MIN_VERSION 1
 
 struct stats_event {
 	struct stats_event *prev, *next;
@@ -30,17 +32,60 @@ struct writer_client {
 
 	struct stats_event *events;
 	HASH_TABLE(struct stats_event *, struct stats_event *) events_hash;
+
+	/* Client counts the client_aggregate metrics itself */
+	bool client_aggregate:1;
 };
 
 static struct timeout *to_update_clients;
 static struct connection_list *writer_clients = NULL;
 
+static void
+client_writer_append_aggregates(string_t *str)
+{
+	struct stats_metrics_iter *iter;
+	const struct metric *metric;
+	string_t *filter = t_str_new(128);
+	unsigned int i;
+
+	iter = stats_metrics_iterate_init(stats_metrics);
+	while ((metric = stats_metrics_iterate(iter)) != NULL) {
+		if (!metric->set->client_aggregate)
+			continue;
+
+		str_truncate(filter, 0);
+		event_filter_export(metric->set->parsed_filter, filter);
+		str_printfa(str, "AGGREGATE\t%u\t",
+			    stats_metrics_get_client_aggregate_interval(
+				stats_metrics));
+		str_append_tabescaped(str, metric->name);
+		str_append_c(str, '\t');
+		str_append_tabescaped(str, str_c(filter));
+		for (i = 0; i < metric->fields_count; i++) {
+			str_append_c(str, '\t');
+			str_append_tabescaped(str, metric->fields[i].field_key);
+		}
+		str_append_c(str, '\n');
+	}
+	stats_metrics_iterate_deinit(&iter);
+}
+
 static void client_writer_send_handshake(struct writer_client *client)
 {
 	string_t *filter = t_str_new(128);
 	string_t *str = t_str_new(128);
 
-	event_filter_export(stats_metrics_get_event_filter(stats_metrics), filter);
+	if (client->conn.minor_version >= STATS_CLIENT_AGGREGATE_MIN_VERSION) {
+		/* client counts the client_aggregate metrics and doesn't
+		   need to send the events for them */
+		client->client_aggregate = TRUE;
+		client_writer_append_aggregates(str);
+		event_filter_export(stats_metrics_get_unaggregated_event_filter(
+			stats_metrics), filter);
+	} else {
+		event_filter_export(stats_metrics_get_event_filter(stats_metrics),
+				    filter);
+	}
 
 	str_append(str, "FILTER\t");
 	str_append_tabescaped(str, str_c(filter));
@@ -67,8 +112,15 @@ void client_writer_create(int fd)
 	hash_table_create(&client->events_hash, default_pool, 0,
 			  stats_event_hash, stats_event_cmp);
 
+	/* the handshake is sent after the client's VERSION is received */
 	connection_init_server(writer_clients, &client->conn,
 			       "stats", fd, fd);
+}
+
+static void writer_client_handshake_ready(struct connection *conn)
+{
+	struct writer_client *client = (struct writer_client *)conn;
+
 	client_writer_send_handshake(client);
 }
 
@@ -131,7 +183,10 @@ writer_client_run_event(struct writer_client *client,
 		event_unref(&event);
 		return FALSE;
 	}
-	stats_metrics_event(stats_metrics, event, &ctx);
+	if (client->client_aggregate)
+		stats_metrics_event_unaggregated(stats_metrics, event, &ctx);
+	else
+		stats_metrics_event(stats_metrics, event, &ctx);
 	*event_r = event;
 	return TRUE;
 }
@@ -312,6 +367,12 @@ writer_client_input_args(struct connection *conn, const char *const *args)
 		ret = writer_client_input_event_end(client, args+1, &error);
 	else if (strcmp(cmd, "CATEGORY") == 0)
 		ret = writer_client_input_category(client, args+1, &error);
+	else if (strcmp(cmd, "METRIC") == 0) {
+		ret = stats_metrics_merge_client_aggregate(stats_metrics,
+							   args+1, &error);
+	}
+	else if (strcmp(cmd, "SHARD") == 0)
+		ret = stats_metrics_merge_shard(stats_metrics, args+1, &error);
 	else {
 		error = "Unknown command";
 		ret = FALSE;
@@ -329,7 +390,7 @@ static struct connection_settings client_set = {
 	.service_name_in = "stats-client",
 	.service_name_out = "stats-server",
 	.major_version = 4,
-	.minor_version = 0,
+	.minor_version = 1,
 
 	.input_max_size = 1024*128, /* "big enough" */
 	.output_max_size = SIZE_MAX,
@@ -339,6 +400,7 @@ static struct connection_settings client_set = {
 static const struct connection_vfuncs client_vfuncs = {
 	.destroy = writer_client_destroy,
 	.input_args = writer_client_input_args,
+	.handshake_ready = writer_client_handshake_ready,
 };
 
 static void
@@ -348,7 +410,8 @@ client_writer_update_connections_internal(void *context ATTR_UNUSED)
 	for (conn = writer_clients->connections; conn != NULL; conn = conn->next) {
 		struct writer_client *client =
 			container_of(conn, struct writer_client, conn);
-		client_writer_send_handshake(client);
+		if (conn->handshake_received)
+			client_writer_send_handshake(client);
 	}
 	timeout_remove(&to_update_clients);
 }
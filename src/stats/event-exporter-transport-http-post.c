@@ -1,8 +1,11 @@
 /* Copyright (c) 2019 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "array.h"
 #include "ioloop.h"
 #include "str.h"
+#include "ostream.h"
+#include "compression.h"
 #include "event-exporter.h"
 #include "http-client.h"
 #include "iostream-ssl.h"
@@ -10,21 +13,65 @@
 #include "master-service-settings.h"
 #include "master-service-ssl-settings.h"
 
+struct http_post_exporter {
+	const struct exporter *exporter;
+
+	/* events waiting to be sent in the next request */
+	buffer_t *batch;
+	unsigned int batch_count;
+	struct timeout *to_batch;
+
+	/* size of the requests that haven't finished yet */
+	uoff_t queued_size;
+	/* events dropped since the last time it was logged */
+	unsigned int dropped_count;
+	time_t dropped_last_log;
+};
+
+struct http_post_request {
+	struct http_post_exporter *hexporter;
+	size_t size;
+};
+
 /* the http client used to export all events with exporter=http-post */
 static struct http_client *exporter_http_client;
+static ARRAY(struct http_post_exporter *) http_post_exporters;
+
+static void http_post_exporter_flush(struct http_post_exporter *hexporter);
 
 void event_export_transport_http_post_deinit(void)
 {
-	if (exporter_http_client != NULL)
+	struct http_post_exporter *hexporter;
+
+	if (array_is_created(&http_post_exporters)) {
+		array_foreach_elem(&http_post_exporters, hexporter)
+			http_post_exporter_flush(hexporter);
+	}
+	if (exporter_http_client != NULL) {
+		/* wait for the last batches to be sent */
+		http_client_wait(exporter_http_client);
 		http_client_deinit(&exporter_http_client);
+	}
+	if (!array_is_created(&http_post_exporters))
+		return;
+	array_foreach_elem(&http_post_exporters, hexporter) {
+		timeout_remove(&hexporter->to_batch);
+		buffer_free(&hexporter->batch);
+		i_free(hexporter);
+	}
+	array_free(&http_post_exporters);
 }
 
 static void response_fxn(const struct http_response *response,
-			 void *context ATTR_UNUSED)
+			 struct http_post_request *hreq)
 {
 	static time_t last_log;
 	static unsigned int suppressed;
 
+	i_assert(hreq->hexporter->queued_size >= hreq->size);
+	hreq->hexporter->queued_size -= hreq->size;
+	i_free(hreq);
+
 	if (http_response_is_success(response))
 		return;
 
@@ -44,10 +91,62 @@ static void response_fxn(const struct http_response *response,
 	suppressed = 0;
 }
 
-void event_export_transport_http_post(const struct exporter *exporter,
-				      const buffer_t *buf)
+static void
+http_post_exporter_dropped(struct http_post_exporter *hexporter,
+			   unsigned int count)
 {
+	hexporter->dropped_count += count;
+	if (hexporter->dropped_last_log == ioloop_time)
+		return; /* don't spam the log */
+
+	i_error("Exporter %s: Dropped %u events: "
+		"HTTP POST queue is full (transport_queue_max_size=%"PRIuUOFF_T")",
+		hexporter->exporter->name, hexporter->dropped_count,
+		hexporter->exporter->transport_queue_max_size);
+	hexporter->dropped_last_log = ioloop_time;
+	hexporter->dropped_count = 0;
+}
+
+static void
+http_post_compress(const struct exporter *exporter, const buffer_t *buf,
+		   buffer_t *dest)
+{
+	const struct compression_handler *handler =
+		exporter->transport_compression;
+	struct ostream *output, *compress_output;
+
+	output = o_stream_create_buffer(dest);
+	compress_output = handler->create_ostream(output,
+		handler->get_default_level());
+	o_stream_unref(&output);
+	o_stream_nsend(compress_output, buf->data, buf->used);
+	if (o_stream_finish(compress_output) < 0) {
+		/* writing to a buffer can't fail */
+		i_panic("Exporter %s: Compression failed: %s", exporter->name,
+			o_stream_get_error(compress_output));
+	}
+	o_stream_unref(&compress_output);
+}
+
+static void http_post_send(struct http_post_exporter *hexporter,
+			   const buffer_t *buf, unsigned int events_count)
+{
+	const struct exporter *exporter = hexporter->exporter;
 	struct http_client_request *req;
+	struct http_post_request *hreq;
+
+	if (exporter->transport_compression != NULL) {
+		buffer_t *compressed = t_buffer_create(buf->used / 2 + 64);
+
+		http_post_compress(exporter, buf, compressed);
+		buf = compressed;
+	}
+	if (hexporter->queued_size + buf->used >
+	    exporter->transport_queue_max_size) {
+		/* the collector isn't keeping up */
+		http_post_exporter_dropped(hexporter, events_count);
+		return;
+	}
 
 	if (exporter_http_client == NULL) {
 		const struct master_service_ssl_settings *master_ssl_set =
@@ -67,12 +166,78 @@ void event_export_transport_http_post(const struct exporter *exporter,
 		exporter_http_client = http_client_init(&set);
 	}
 
+	hreq = i_new(struct http_post_request, 1);
+	hreq->hexporter = hexporter;
+	hreq->size = buf->used;
+	hexporter->queued_size += buf->used;
+
 	req = http_client_request_url_str(exporter_http_client, "POST",
 					  exporter->transport_args,
-					  response_fxn, NULL);
+					  response_fxn, hreq);
 	http_client_request_add_header(req, "Content-Type", exporter->format_mime_type);
+	if (exporter->transport_content_encoding != NULL) {
+		http_client_request_add_header(req, "Content-Encoding",
+			exporter->transport_content_encoding);
+	}
 	http_client_request_set_payload_data(req, buf->data, buf->used);
 
 	http_client_request_set_timeout_msecs(req, exporter->transport_timeout);
 	http_client_request_submit(req);
 }
+
+static void http_post_exporter_flush(struct http_post_exporter *hexporter)
+{
+	timeout_remove(&hexporter->to_batch);
+	if (hexporter->batch_count == 0)
+		return;
+
+	T_BEGIN {
+		http_post_send(hexporter, hexporter->batch,
+			       hexporter->batch_count);
+	} T_END;
+	buffer_set_used_size(hexporter->batch, 0);
+	hexporter->batch_count = 0;
+}
+
+static struct http_post_exporter *
+http_post_exporter_get(const struct exporter *exporter)
+{
+	struct http_post_exporter *hexporter;
+
+	if (!array_is_created(&http_post_exporters))
+		i_array_init(&http_post_exporters, 4);
+	array_foreach_elem(&http_post_exporters, hexporter) {
+		if (hexporter->exporter == exporter)
+			return hexporter;
+	}
+
+	hexporter = i_new(struct http_post_exporter, 1);
+	hexporter->exporter = exporter;
+	array_push_back(&http_post_exporters, &hexporter);
+	return hexporter;
+}
+
+void event_export_transport_http_post(const struct exporter *exporter,
+				      const buffer_t *buf)
+{
+	struct http_post_exporter *hexporter =
+		http_post_exporter_get(exporter);
+
+	if (exporter->transport_batch_size == 0) {
+		http_post_send(hexporter, buf, 1);
+		return;
+	}
+
+	/* newline-delimited batch of events */
+	if (hexporter->batch == NULL)
+		hexporter->batch = buffer_create_dynamic(default_pool, 1024);
+	buffer_append_buf(hexporter->batch, buf, 0, SIZE_MAX);
+	buffer_append_c(hexporter->batch, '\n');
+	if (++hexporter->batch_count >= exporter->transport_batch_size)
+		http_post_exporter_flush(hexporter);
+	else if (hexporter->to_batch == NULL) {
+		hexporter->to_batch =
+			timeout_add(exporter->transport_batch_interval,
+				    http_post_exporter_flush, hexporter);
+	}
+}
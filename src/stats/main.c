@@ -12,11 +12,13 @@
 #include "client-writer.h"
 #include "client-reader.h"
 #include "client-http.h"
+#include "stats-shard.h"
 
 struct stats_metrics *stats_metrics;
 time_t stats_startup_time;
 
 static const struct stats_settings *stats_settings;
+static bool shard = FALSE;
 
 static void client_connected(struct master_service_connection *conn)
 {
@@ -54,10 +56,18 @@ static void main_init(void)
 	client_writers_init();
 	client_http_init(stats_settings);
 	stats_services_init();
+	if (shard) {
+		const struct master_service_settings *master_set =
+			master_service_settings_get(master_service);
+
+		stats_shard_init(master_set->base_dir,
+				 stats_settings->stats_client_aggregate_interval);
+	}
 }
 
 static void main_deinit(void)
 {
+	stats_shard_deinit();
 	stats_services_deinit();
 	client_readers_deinit();
 	client_writers_deinit();
@@ -78,15 +88,26 @@ int main(int argc, char *argv[])
 		MASTER_SERVICE_FLAG_NO_IDLE_DIE |
 		MASTER_SERVICE_FLAG_UPDATE_PROCTITLE;
 	const char *error;
+	int c;
 
 	master_service = master_service_init("stats", service_flags,
-					     &argc, &argv, "");
-	if (master_getopt(master_service) > 0)
-		return FATAL_DEFAULT;
+					     &argc, &argv, "s");
+	while ((c = master_getopt(master_service)) > 0) {
+		switch (c) {
+		case 's':
+			shard = TRUE;
+			break;
+		default:
+			return FATAL_DEFAULT;
+		}
+	}
 	if (master_service_settings_read_simple(master_service, set_roots,
 						&error) < 0)
 		i_fatal("Error reading configuration: %s", error);
-	master_service_init_log(master_service);
+	if (shard)
+		master_service_init_log_with_pid(master_service);
+	else
+		master_service_init_log(master_service);
 	master_service_set_die_callback(master_service, stats_die);
 
 	main_preinit();
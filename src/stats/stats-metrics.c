@@ -3,11 +3,17 @@
 #include "stats-common.h"
 #include "array.h"
 #include "str.h"
+#include "strnum.h"
+#include "strescape.h"
 #include "str-sanitize.h"
+#include "hex-binary.h"
+#include "json-parser.h"
 #include "stats-dist.h"
+#include "stats-sketch.h"
 #include "time-util.h"
 #include "event-filter.h"
 #include "event-exporter.h"
+#include "compression.h"
 #include "stats-settings.h"
 #include "stats-metrics.h"
 #include "settings-parser.h"
@@ -16,10 +22,14 @@
 
 #define LOG_EXPORTER_LONG_FIELD_TRUNCATE_LEN 1000
 #define STATS_SUB_METRIC_MAX_LENGTH 256
+#define STATS_SUB_METRIC_TOP_OTHER_NAME "other"
 
 struct stats_metrics {
 	pool_t pool;
 	struct event_filter *filter; /* stats & export */
+	/* filter without the client_aggregate metrics */
+	struct event_filter *filter_unaggregated;
+	unsigned int client_aggregate_interval_msecs;
 	ARRAY(struct exporter *) exporters;
 	ARRAY(struct metric *) metrics;
 };
@@ -39,6 +49,9 @@ static void stats_exporters_add_set(struct stats_metrics *metrics,
 	exporter->name = p_strdup(metrics->pool, set->name);
 	exporter->transport_args = p_strdup(metrics->pool, set->transport_args);
 	exporter->transport_timeout = set->transport_timeout;
+	exporter->transport_batch_size = set->transport_batch_size;
+	exporter->transport_batch_interval = set->transport_batch_interval;
+	exporter->transport_queue_max_size = set->transport_queue_max_size;
 	exporter->time_format = set->parsed_time_format;
 
 	/* TODO: The following should be plugable.
@@ -51,7 +64,9 @@ static void stats_exporters_add_set(struct stats_metrics *metrics,
 		exporter->format_mime_type = "application/octet-stream";
 	} else if (strcmp(set->format, "json") == 0) {
 		exporter->format = event_export_fmt_json;
-		exporter->format_mime_type = "application/json";
+		/* batches have one JSON object per line */
+		exporter->format_mime_type = set->transport_batch_size > 0 ?
+			"application/x-ndjson" : "application/json";
 	} else if (strcmp(set->format, "tab-text") == 0) {
 		exporter->format = event_export_fmt_tabescaped_text;
 		exporter->format_mime_type = "text/plain";
@@ -78,6 +93,19 @@ static void stats_exporters_add_set(struct stats_metrics *metrics,
 
 	exporter->transport_args = set->transport_args;
 
+	if (set->transport_compression[0] != '\0') {
+		if (compression_lookup_handler(set->transport_compression,
+				&exporter->transport_compression) <= 0) {
+			i_fatal("event_exporter %s: transport_compression=%s "
+				"isn't supported: Not compiled in",
+				set->name, set->transport_compression);
+		}
+		/* the HTTP name for gz is gzip */
+		exporter->transport_content_encoding =
+			strcmp(set->transport_compression, "gz") == 0 ? "gzip" :
+			set->transport_compression;
+	}
+
 	array_push_back(&metrics->exporters, &exporter);
 }
 
@@ -89,14 +117,14 @@ stats_metric_alloc(pool_t pool, const char *name,
 	struct metric *metric = p_new(pool, struct metric, 1);
 	metric->name = p_strdup(pool, name);
 	metric->set = set;
-	metric->duration_stats = stats_dist_init();
+	metric->duration_stats = stats_dist_init_sketch();
 	metric->fields_count = str_array_length(fields);
 	if (metric->fields_count > 0) {
 		metric->fields = p_new(pool, struct metric_field,
 				       metric->fields_count);
 		for (unsigned int i = 0; i < metric->fields_count; i++) {
 			metric->fields[i].field_key = p_strdup(pool, fields[i]);
-			metric->fields[i].stats = stats_dist_init();
+			metric->fields[i].stats = stats_dist_init_sketch();
 		}
 	}
 	return metric;
@@ -120,6 +148,10 @@ static void stats_metrics_add_set(struct stats_metrics *metrics,
 	array_push_back(&metrics->metrics, &metric);
 
 	event_filter_merge_with_context(metrics->filter, set->parsed_filter, metric);
+	if (!set->client_aggregate) {
+		event_filter_merge_with_context(metrics->filter_unaggregated,
+						set->parsed_filter, metric);
+	}
 
 	/*
 	 * Metrics may also be exported - make sure exporter info is set
@@ -246,6 +278,8 @@ bool stats_metrics_remove_dynamic(struct stats_metrics *metrics,
 	if (m != NULL) {
 		array_delete(&metrics->metrics, m_idx, 1);
 		ret = event_filter_remove_queries_with_context(metrics->filter, m);
+		(void)event_filter_remove_queries_with_context(
+			metrics->filter_unaggregated, m);
 		stats_metric_free(m);
 	}
 	return ret;
@@ -289,6 +323,9 @@ struct stats_metrics *stats_metrics_init(const struct stats_settings *set)
 	metrics = p_new(pool, struct stats_metrics, 1);
 	metrics->pool = pool;
 	metrics->filter = event_filter_create();
+	metrics->filter_unaggregated = event_filter_create();
+	metrics->client_aggregate_interval_msecs =
+		set->stats_client_aggregate_interval;
 	stats_metrics_add_from_settings(metrics, set);
 	return metrics;
 }
@@ -296,6 +333,7 @@ struct stats_metrics *stats_metrics_init(const struct stats_settings *set)
 static void stats_metric_free(struct metric *metric)
 {
 	struct metric *sub_metric;
+	str_free(&metric->sub_name_label);
 	stats_dist_deinit(&metric->duration_stats);
 	for (unsigned int i = 0; i < metric->fields_count; i++)
 		stats_dist_deinit(&metric->fields[i].stats);
@@ -324,12 +362,14 @@ void stats_metrics_deinit(struct stats_metrics **_metrics)
 	array_foreach_elem(&metrics->metrics, metric)
 		stats_metric_free(metric);
 	event_filter_unref(&metrics->filter);
+	event_filter_unref(&metrics->filter_unaggregated);
 	pool_unref(&metrics->pool);
 }
 
 static void stats_metric_reset(struct metric *metric)
 {
 	struct metric *sub_metric;
+	metric->top_error = 0;
 	stats_dist_reset(metric->duration_stats);
 	for (unsigned int i = 0; i < metric->fields_count; i++)
 		stats_dist_reset(metric->fields[i].stats);
@@ -353,6 +393,61 @@ stats_metrics_get_event_filter(struct stats_metrics *metrics)
 	return metrics->filter;
 }
 
+struct event_filter *
+stats_metrics_get_unaggregated_event_filter(struct stats_metrics *metrics)
+{
+	return metrics->filter_unaggregated;
+}
+
+unsigned int
+stats_metrics_get_client_aggregate_interval(struct stats_metrics *metrics)
+{
+	return metrics->client_aggregate_interval_msecs;
+}
+
+bool stats_metrics_merge_client_aggregate(struct stats_metrics *metrics,
+					  const char *const *args,
+					  const char **error_r)
+{
+	struct metric *metric;
+	struct stats_sketch **sketches;
+	unsigned int i, idx, count;
+	bool ret = TRUE;
+
+	if (args[0] == NULL) {
+		*error_r = "Missing metric name";
+		return FALSE;
+	}
+	metric = stats_metrics_find(metrics, args[0], &idx);
+	if (metric == NULL || !metric->set->client_aggregate) {
+		/* metric was removed */
+		return TRUE;
+	}
+	/* duration followed by the fields */
+	count = str_array_length(args + 1);
+	if (count != 1 + metric->fields_count) {
+		*error_r = "Wrong number of fields";
+		return FALSE;
+	}
+
+	sketches = t_new(struct stats_sketch *, count);
+	for (i = 0; i < count && ret; i++) {
+		sketches[i] = stats_sketch_init();
+		if (stats_sketch_import(sketches[i], args[1 + i], error_r) < 0)
+			ret = FALSE;
+	}
+	if (ret) {
+		stats_dist_merge_sketch(metric->duration_stats, sketches[0]);
+		for (i = 0; i < metric->fields_count; i++) {
+			stats_dist_merge_sketch(metric->fields[i].stats,
+						sketches[1 + i]);
+		}
+	}
+	for (i = 0; i < count; i++)
+		stats_sketch_deinit(&sketches[i]);
+	return ret;
+}
+
 static struct metric *
 stats_metric_find_sub_metric(struct metric *metric,
 			     const struct metric_value *value)
@@ -361,6 +456,8 @@ stats_metric_find_sub_metric(struct metric *metric,
 
 	/* lookup sub-metric */
 	array_foreach_elem(&metric->sub_metrics, sub_metrics) {
+		if (sub_metrics->group_value.type != value->type)
+			continue;
 		switch (sub_metrics->group_value.type) {
 		case METRIC_VALUE_TYPE_STR:
 			if (memcmp(sub_metrics->group_value.hash, value->hash,
@@ -380,11 +477,43 @@ stats_metric_find_sub_metric(struct metric *metric,
 			if (sub_metrics->group_value.intmax == value->intmax)
 				return sub_metrics;
 			break;
+		case METRIC_VALUE_TYPE_OTHER:
+			return sub_metrics;
 		}
 	}
 	return NULL;
 }
 
+static void
+stats_metric_sub_metric_set_name(struct metric *metric,
+				 struct metric *sub_metric,
+				 const char *name, pool_t pool)
+{
+	size_t max_len = STATS_SUB_METRIC_MAX_LENGTH - metric->sub_name_used_size;
+
+	name = str_sanitize_utf8(name, max_len);
+	if (metric->group_by[0].func != STATS_METRIC_GROUPBY_TOP)
+		sub_metric->sub_name = p_strdup(pool, name);
+	else {
+		if (sub_metric->top_sub_name_buf == NULL) {
+			sub_metric->top_sub_name_buf =
+				p_malloc(pool, max_len + 1);
+		}
+		i_strocpy(sub_metric->top_sub_name_buf, name, max_len + 1);
+		sub_metric->sub_name = sub_metric->top_sub_name_buf;
+	}
+	sub_metric->sub_name_used_size =
+		metric->sub_name_used_size + strlen(sub_metric->sub_name);
+
+	if (sub_metric->sub_name_label == NULL)
+		sub_metric->sub_name_label = str_new(default_pool, 32);
+	else
+		str_truncate(sub_metric->sub_name_label, 0);
+	str_append_c(sub_metric->sub_name_label, '"');
+	json_append_escaped(sub_metric->sub_name_label, sub_metric->sub_name);
+	str_append_c(sub_metric->sub_name_label, '"');
+}
+
 static struct metric *
 stats_metric_sub_metric_alloc(struct metric *metric, const char *name, pool_t pool)
 {
@@ -396,10 +525,7 @@ stats_metric_sub_metric_alloc(struct metric *metric, const char *name, pool_t po
 	array_append_zero(&fields);
 	sub_metric = stats_metric_alloc(pool, metric->name, metric->set,
 					array_idx(&fields, 0));
-	size_t max_len = STATS_SUB_METRIC_MAX_LENGTH - metric->sub_name_used_size;
-	sub_metric->sub_name = p_strdup(pool, str_sanitize_utf8(name, max_len));
-	sub_metric->sub_name_used_size =
-		metric->sub_name_used_size + strlen(sub_metric->sub_name);
+	stats_metric_sub_metric_set_name(metric, sub_metric, name, pool);
 	array_append(&metric->sub_metrics, &sub_metric, 1);
 	return sub_metric;
 }
@@ -502,6 +628,7 @@ stats_metric_group_by_get_value(const struct event_field *field,
 {
 	switch (group_by->func) {
 	case STATS_METRIC_GROUPBY_DISCRETE:
+	case STATS_METRIC_GROUPBY_TOP:
 		if (!stats_metric_group_by_discrete(field, value_r))
 			return FALSE;
 		return TRUE;
@@ -521,6 +648,7 @@ stats_metric_group_by_get_label(const struct event_field *field,
 {
 	switch (group_by->func) {
 	case STATS_METRIC_GROUPBY_DISCRETE:
+	case STATS_METRIC_GROUPBY_TOP:
 		i_unreached();
 	case STATS_METRIC_GROUPBY_QUANTIZED:
 		return stats_metric_group_by_quantized_label(field, group_by,
@@ -563,10 +691,108 @@ stats_metric_group_by_value_label(const struct event_field *field,
 		return net_ip2addr(&field->value.ip);
 	case METRIC_VALUE_TYPE_BUCKET_INDEX:
 		return stats_metric_group_by_get_label(field, group_by, value);
+	case METRIC_VALUE_TYPE_OTHER:
+		break;
 	}
 	i_unreached();
 }
 
+static void
+stats_metric_sub_metric_set_value(struct metric *metric,
+				  struct metric *sub_metric,
+				  const struct metric_value *value)
+{
+	if (metric->group_by_count > 1) {
+		sub_metric->group_by_count = metric->group_by_count - 1;
+		sub_metric->group_by = &metric->group_by[1];
+	}
+	sub_metric->group_value.type = value->type;
+	sub_metric->group_value.intmax = value->intmax;
+	sub_metric->group_value.ip = value->ip;
+	memcpy(sub_metric->group_value.hash, value->hash, SHA1_RESULTLEN);
+}
+
+static uint64_t
+stats_metric_top_weight(const struct metric *metric,
+			const struct metric *sub_metric)
+{
+	unsigned int idx = metric->group_by[0].top_weight_field_idx;
+	uint64_t weight;
+
+	if (idx == UINT_MAX)
+		weight = stats_dist_get_count(sub_metric->duration_stats);
+	else
+		weight = stats_dist_get_sum(sub_metric->fields[idx].stats);
+	return sub_metric->top_error + weight;
+}
+
+static struct metric *
+stats_metric_top_get_other(struct metric *metric, pool_t pool)
+{
+	const struct metric_value value = { .type = METRIC_VALUE_TYPE_OTHER };
+	struct metric *other;
+
+	other = stats_metric_find_sub_metric(metric, &value);
+	if (other == NULL) {
+		other = stats_metric_sub_metric_alloc(metric,
+			STATS_SUB_METRIC_TOP_OTHER_NAME, pool);
+		stats_metric_sub_metric_set_value(metric, other, &value);
+	}
+	return other;
+}
+
+/* Returns NULL if the group_by top doesn't have top_count values yet.
+   Otherwise the value with the lowest weight is merged into the "other"
+   sub-metric and its sub-metric is returned for reuse. */
+static struct metric *
+stats_metric_top_evict(struct metric *metric, pool_t pool)
+{
+	struct metric *sub_metric, *min_metric = NULL, *other;
+	uint64_t weight, min_weight = 0;
+	unsigned int i, count = 0;
+
+	array_foreach_elem(&metric->sub_metrics, sub_metric) {
+		if (sub_metric->group_value.type == METRIC_VALUE_TYPE_OTHER)
+			continue;
+		count++;
+		weight = stats_metric_top_weight(metric, sub_metric);
+		if (min_metric == NULL || weight < min_weight) {
+			min_metric = sub_metric;
+			min_weight = weight;
+		}
+	}
+	if (count < metric->group_by[0].top_count)
+		return NULL;
+
+	other = stats_metric_top_get_other(metric, pool);
+	stats_dist_merge(other->duration_stats, min_metric->duration_stats);
+	for (i = 0; i < metric->fields_count; i++) {
+		stats_dist_merge(other->fields[i].stats,
+				 min_metric->fields[i].stats);
+	}
+	stats_metric_reset(min_metric);
+	min_metric->top_error = min_weight;
+	return min_metric;
+}
+
+static struct metric *
+stats_metric_add_sub_metric(struct metric *metric,
+			    const struct metric_value *value,
+			    const char *name, pool_t pool)
+{
+	struct metric *sub_metric = NULL;
+
+	if (metric->group_by[0].func == STATS_METRIC_GROUPBY_TOP &&
+	    value->type != METRIC_VALUE_TYPE_OTHER)
+		sub_metric = stats_metric_top_evict(metric, pool);
+	if (sub_metric == NULL)
+		sub_metric = stats_metric_sub_metric_alloc(metric, name, pool);
+	else
+		stats_metric_sub_metric_set_name(metric, sub_metric, name, pool);
+	stats_metric_sub_metric_set_value(metric, sub_metric, value);
+	return sub_metric;
+}
+
 static struct metric *
 stats_metric_get_sub_metric(struct metric *metric,
 			    const struct event_field *field,
@@ -583,20 +809,196 @@ stats_metric_get_sub_metric(struct metric *metric,
 		const char *value_label =
 			stats_metric_group_by_value_label(field,
 				&metric->group_by[0], value);
-		sub_metric = stats_metric_sub_metric_alloc(metric, value_label,
-							   pool);
+		sub_metric = stats_metric_add_sub_metric(metric, value,
+							 value_label, pool);
 	} T_END;
-	if (metric->group_by_count > 1) {
-		sub_metric->group_by_count = metric->group_by_count - 1;
-		sub_metric->group_by = &metric->group_by[1];
-	}
-	sub_metric->group_value.type = value->type;
-	sub_metric->group_value.intmax = value->intmax;
-	sub_metric->group_value.ip = value->ip;
-	memcpy(sub_metric->group_value.hash, value->hash, SHA1_RESULTLEN);
 	return sub_metric;
 }
 
+static void
+stats_metric_export_shard(const struct metric *metric, const char *path,
+			  unsigned int levels, string_t *dest)
+{
+	const struct stats_sketch *sketch;
+	struct metric *sub_metric;
+	unsigned int i;
+
+	if (stats_dist_get_count(metric->duration_stats) > 0) {
+		str_append(dest, "SHARD\t");
+		str_append_tabescaped(dest, metric->name);
+		str_printfa(dest, "\t%u%s\t", levels, path);
+		sketch = stats_dist_get_sketch(metric->duration_stats);
+		stats_sketch_export(sketch, dest);
+		for (i = 0; i < metric->fields_count; i++) {
+			str_append_c(dest, '\t');
+			sketch = stats_dist_get_sketch(metric->fields[i].stats);
+			stats_sketch_export(sketch, dest);
+		}
+		str_append_c(dest, '\n');
+	}
+	if (!array_is_created(&metric->sub_metrics))
+		return;
+
+	string_t *sub_path = t_str_new(128);
+	array_foreach_elem(&metric->sub_metrics, sub_metric) {
+		const struct metric_value *value = &sub_metric->group_value;
+
+		str_truncate(sub_path, 0);
+		str_append(sub_path, path);
+		str_append_c(sub_path, '\t');
+		switch (value->type) {
+		case METRIC_VALUE_TYPE_STR:
+			str_append_c(sub_path, 's');
+			binary_to_hex_append(sub_path, value->hash,
+					     sizeof(value->hash));
+			break;
+		case METRIC_VALUE_TYPE_INT:
+			str_printfa(sub_path, "i%jd", value->intmax);
+			break;
+		case METRIC_VALUE_TYPE_IP:
+			str_printfa(sub_path, "a%s", net_ip2addr(&value->ip));
+			break;
+		case METRIC_VALUE_TYPE_BUCKET_INDEX:
+			str_printfa(sub_path, "b%jd", value->intmax);
+			break;
+		case METRIC_VALUE_TYPE_OTHER:
+			str_append_c(sub_path, 'o');
+			break;
+		}
+		str_append_c(sub_path, '\t');
+		str_append_tabescaped(sub_path, sub_metric->sub_name);
+		stats_metric_export_shard(sub_metric, str_c(sub_path),
+					  levels + 1, dest);
+	}
+}
+
+void stats_metrics_export_shard(struct stats_metrics *metrics, string_t *dest)
+{
+	struct metric *metric;
+
+	array_foreach_elem(&metrics->metrics, metric)
+		stats_metric_export_shard(metric, "", 0, dest);
+}
+
+static bool
+stats_metric_value_import(const char *str, struct metric_value *value_r)
+{
+	buffer_t buf;
+
+	i_zero(value_r);
+	switch (str[0]) {
+	case 's':
+		value_r->type = METRIC_VALUE_TYPE_STR;
+		buffer_create_from_data(&buf, value_r->hash,
+					sizeof(value_r->hash));
+		if (strlen(str + 1) != sizeof(value_r->hash) * 2 ||
+		    hex_to_binary(str + 1, &buf) < 0)
+			return FALSE;
+		return TRUE;
+	case 'i':
+		value_r->type = METRIC_VALUE_TYPE_INT;
+		return str_to_intmax(str + 1, &value_r->intmax) == 0;
+	case 'a':
+		value_r->type = METRIC_VALUE_TYPE_IP;
+		return net_addr2ip(str + 1, &value_r->ip) == 0;
+	case 'b':
+		value_r->type = METRIC_VALUE_TYPE_BUCKET_INDEX;
+		return str_to_intmax(str + 1, &value_r->intmax) == 0;
+	case 'o':
+		value_r->type = METRIC_VALUE_TYPE_OTHER;
+		return str[1] == '\0';
+	}
+	return FALSE;
+}
+
+static struct metric *
+stats_metrics_shard_find_metric(struct stats_metrics *metrics,
+				const char *const **_args,
+				const char **error_r)
+{
+	const char *const *args = *_args;
+	struct metric_value value;
+	struct metric *metric, *sub_metric;
+	unsigned int i, idx, levels;
+
+	if (str_array_length(args) < 2 || str_to_uint(args[1], &levels) < 0) {
+		*error_r = "Invalid metric path";
+		return NULL;
+	}
+	metric = stats_metrics_find(metrics, args[0], &idx);
+	args += 2;
+	if (str_array_length(args) < levels * 2) {
+		*error_r = "Invalid metric path";
+		return NULL;
+	}
+	*_args = args + levels * 2;
+	if (metric == NULL) {
+		/* metric was removed */
+		*error_r = NULL;
+		return NULL;
+	}
+
+	for (i = 0; i < levels; i++, args += 2) {
+		if (!stats_metric_value_import(args[0], &value)) {
+			*error_r = t_strdup_printf(
+				"Invalid metric group value: %s", args[0]);
+			return NULL;
+		}
+		if (metric->group_by_count == 0 ||
+		    metric->sub_name_used_size >= STATS_SUB_METRIC_MAX_LENGTH) {
+			/* group_by was changed */
+			*error_r = NULL;
+			return NULL;
+		}
+		if (!array_is_created(&metric->sub_metrics))
+			p_array_init(&metric->sub_metrics, metrics->pool, 8);
+		sub_metric = stats_metric_find_sub_metric(metric, &value);
+		if (sub_metric == NULL) {
+			sub_metric = stats_metric_add_sub_metric(metric,
+				&value, args[1], metrics->pool);
+		}
+		metric = sub_metric;
+	}
+	return metric;
+}
+
+bool stats_metrics_merge_shard(struct stats_metrics *metrics,
+			       const char *const *args, const char **error_r)
+{
+	struct metric *metric;
+	struct stats_sketch **sketches;
+	unsigned int i, count;
+	bool ret = TRUE;
+
+	/* <metric name> <levels> [<group value> <label> ...] <duration sketch>
+	   [<field sketch> ...] */
+	metric = stats_metrics_shard_find_metric(metrics, &args, error_r);
+	if (metric == NULL)
+		return *error_r == NULL;
+	count = str_array_length(args);
+	if (count != 1 + metric->fields_count) {
+		/* metric's fields were changed */
+		return TRUE;
+	}
+
+	sketches = t_new(struct stats_sketch *, count);
+	for (i = 0; i < count && ret; i++) {
+		sketches[i] = stats_sketch_init();
+		if (stats_sketch_import(sketches[i], args[i], error_r) < 0)
+			ret = FALSE;
+	}
+	if (ret) {
+		stats_dist_merge_sketch(metric->duration_stats, sketches[0]);
+		for (i = 0; i < metric->fields_count; i++) {
+			stats_dist_merge_sketch(metric->fields[i].stats,
+						sketches[1 + i]);
+		}
+	}
+	for (i = 0; i < count; i++)
+		stats_sketch_deinit(&sketches[i]);
+	return ret;
+}
+
 static void
 stats_metric_group_by_field(struct metric *metric, struct event *event,
 			    const struct event_field *field, pool_t pool)
@@ -751,8 +1153,10 @@ stats_export_event(struct metric *metric, struct event *oldevent)
 	event_unref(&event);
 }
 
-void stats_metrics_event(struct stats_metrics *metrics, struct event *event,
-			 const struct failure_context *ctx)
+static void
+stats_metrics_event_real(struct stats_metrics *metrics, struct event *event,
+			 const struct failure_context *ctx,
+			 bool skip_client_aggregated)
 {
 	struct event_filter_match_iter *iter;
 	struct metric *metric;
@@ -767,16 +1171,31 @@ void stats_metrics_event(struct stats_metrics *metrics, struct event *event,
 	/* process stats & exports */
 	iter = event_filter_match_iter_init(metrics->filter, event, ctx);
 	while ((metric = event_filter_match_iter_next(iter)) != NULL) T_BEGIN {
-		/* every metric is fed into stats */
-		stats_metric_event(metric, event, metrics->pool);
+		if (!skip_client_aggregated || !metric->set->client_aggregate) {
+			/* every metric is fed into stats */
+			stats_metric_event(metric, event, metrics->pool);
 
-		/* some metrics are exported */
-		if (metric->export_info.exporter != NULL)
-			stats_export_event(metric, event);
+			/* some metrics are exported */
+			if (metric->export_info.exporter != NULL)
+				stats_export_event(metric, event);
+		}
 	} T_END;
 	event_filter_match_iter_deinit(&iter);
 }
 
+void stats_metrics_event(struct stats_metrics *metrics, struct event *event,
+			 const struct failure_context *ctx)
+{
+	stats_metrics_event_real(metrics, event, ctx, FALSE);
+}
+
+void stats_metrics_event_unaggregated(struct stats_metrics *metrics,
+				      struct event *event,
+				      const struct failure_context *ctx)
+{
+	stats_metrics_event_real(metrics, event, ctx, TRUE);
+}
+
 struct stats_metrics_iter {
 	struct stats_metrics *metrics;
 	unsigned int idx;
@@ -8,6 +8,7 @@
 
 struct metric;
 struct stats_metrics;
+struct compression_handler;
 
 struct exporter {
 	const char *name;
@@ -35,6 +36,12 @@ struct exporter {
 	 */
 	const char *transport_args;
 	unsigned int transport_timeout;
+	unsigned int transport_batch_size;
+	unsigned int transport_batch_interval;
+	uoff_t transport_queue_max_size;
+	/* NULL if not compressed */
+	const struct compression_handler *transport_compression;
+	const char *transport_content_encoding;
 
 	/* function to send the event */
 	void (*transport)(const struct exporter *, const buffer_t *);
@@ -63,6 +70,8 @@ enum metric_value_type {
 	METRIC_VALUE_TYPE_INT,
 	METRIC_VALUE_TYPE_IP,
 	METRIC_VALUE_TYPE_BUCKET_INDEX,
+	/* group_by top's sub-metric for all the values not in the top */
+	METRIC_VALUE_TYPE_OTHER,
 };
 
 struct metric_value {
@@ -92,6 +101,17 @@ struct metric {
 	*/
 	const char *sub_name;
 	size_t sub_name_used_size;
+	/* sub_name quoted and escaped as an OpenMetrics label value. This is
+	   rendered once when the name is set, so that scrapes don't need to
+	   escape the names again. */
+	string_t *sub_name_label;
+	/* With group_by top the sub-metrics are reused for new values, so
+	   the sub_name is copied to this fixed size buffer. */
+	char *top_sub_name_buf;
+	/* With group_by top this is the weight of the evicted value that this
+	   sub-metric replaced. The value may have had at most this much
+	   weight before it started to be counted (Space-Saving algorithm). */
+	uint64_t top_error;
 
 	/* Timing for how long the event existed */
 	struct stats_dist *duration_stats;
@@ -123,10 +143,37 @@ void stats_metrics_reset(struct stats_metrics *metrics);
 /* Returns event filter created from the stats_settings. */
 struct event_filter *
 stats_metrics_get_event_filter(struct stats_metrics *metrics);
+/* Returns event filter for the metrics that don't have client_aggregate
+   enabled. */
+struct event_filter *
+stats_metrics_get_unaggregated_event_filter(struct stats_metrics *metrics);
+
+/* Returns how often processes send the client_aggregate metrics. */
+unsigned int
+stats_metrics_get_client_aggregate_interval(struct stats_metrics *metrics);
 
 /* Update metrics with given event. */
 void stats_metrics_event(struct stats_metrics *metrics, struct event *event,
 			 const struct failure_context *ctx);
+/* Same as stats_metrics_event(), but skip the client_aggregate metrics. This
+   is used for events from processes that count those metrics themselves. */
+void stats_metrics_event_unaggregated(struct stats_metrics *metrics,
+				      struct event *event,
+				      const struct failure_context *ctx);
+/* Merge the totals that a process sent for a client_aggregate metric:
+   metric name, duration sketch and a sketch for each field. Unknown metrics
+   are ignored. Returns FALSE if the input is invalid. */
+bool stats_metrics_merge_client_aggregate(struct stats_metrics *metrics,
+					  const char *const *args,
+					  const char **error_r);
+/* Append all metrics with their sub-metrics to dest as SHARD lines that
+   stats_metrics_merge_shard() can merge. Used by stats-shard processes to
+   send their metrics to the main stats process. */
+void stats_metrics_export_shard(struct stats_metrics *metrics, string_t *dest);
+/* Merge a SHARD line's arguments. Unknown metrics are ignored. Returns FALSE
+   if the input is invalid. */
+bool stats_metrics_merge_shard(struct stats_metrics *metrics,
+			       const char *const *args, const char **error_r);
 
 /* Iterate through all the tracked metrics. */
 struct stats_metrics_iter *
@@ -4,9 +4,9 @@
 #include "dovecot-version.h"
 #include "str.h"
 #include "array.h"
-#include "json-parser.h"
 #include "ioloop.h"
 #include "ostream.h"
+#include "compression.h"
 #include "stats-dist.h"
 #include "http-server.h"
 #include "client-http.h"
@@ -48,7 +48,11 @@ struct openmetrics_request_sub_metric {
 };
 
 struct openmetrics_request {
+	/* payload output, compressed if the client accepts gzip */
 	struct ostream *output;
+	/* metrics are rendered into this buffer and sent when it has grown
+	   to IO_BLOCK_SIZE */
+	string_t *out;
 
 	enum openmetrics_request_state state;
 	struct stats_metrics_iter *stats_iter;
@@ -174,26 +178,6 @@ openmetrics_export_metric_value(struct openmetrics_request *req, string_t *out,
 	}
 }
 
-static const struct metric *
-openmetrics_find_histogram_bucket(const struct metric *metric,
-				 unsigned int index)
-{
-	struct metric *sub_metric;
-
-	if (!array_is_created(&metric->sub_metrics))
-		return NULL;
-
-	array_foreach_elem(&metric->sub_metrics, sub_metric) {
-		if (sub_metric->group_value.type !=
-		    METRIC_VALUE_TYPE_BUCKET_INDEX)
-			continue;
-		if (sub_metric->group_value.intmax == index)
-			return sub_metric;
-	}
-
-	return NULL;
-}
-
 static void
 openmetrics_export_histogram_bucket(struct openmetrics_request *req,
 				    string_t *out, const struct metric *metric,
@@ -227,19 +211,30 @@ openmetrics_export_histogram(struct openmetrics_request *req, string_t *out,
 {
 	const struct stats_metric_settings_group_by *group_by =
 		metric->group_by;
+	struct metric *sub_metric;
 	float sum = 0;
-	uint64_t count = 0;
-
-	/* Buckets */
-	for (unsigned int i = 0; i < group_by->num_ranges; i++) {
-		const struct metric *sub_metric =
-			openmetrics_find_histogram_bucket(metric, i);
-
-		if (sub_metric != NULL) {
+	uint64_t count = 0, *bucket_counts;
+
+	/* Count the buckets with a single pass over the sub-metrics */
+	bucket_counts = t_new(uint64_t, group_by->num_ranges);
+	if (array_is_created(&metric->sub_metrics)) {
+		array_foreach_elem(&metric->sub_metrics, sub_metric) {
+			const struct metric_value *value =
+				&sub_metric->group_value;
+
+			if (value->type != METRIC_VALUE_TYPE_BUCKET_INDEX ||
+			    value->intmax < 0 ||
+			    (uintmax_t)value->intmax >= group_by->num_ranges)
+				continue;
 			sum += stats_dist_get_sum(sub_metric->duration_stats);
-			count += stats_dist_get_count(sub_metric->duration_stats);
+			bucket_counts[value->intmax] +=
+				stats_dist_get_count(sub_metric->duration_stats);
 		}
+	}
 
+	/* Buckets */
+	for (unsigned int i = 0; i < group_by->num_ranges; i++) {
+		count += bucket_counts[i];
 		openmetrics_export_histogram_bucket(req, out, metric,
 						    group_by->ranges[i].max,
 						    count);
@@ -336,11 +331,8 @@ openmetrics_export_submetric(struct openmetrics_request *req, string_t *out,
 {
 	/* This metric may be a submetric and therefore have a label
 	   associated with it. */
-	if (metric->sub_name != NULL) {
-		str_append_c(req->labels, '"');
-		json_append_escaped(req->labels, metric->sub_name);
-		str_append_c(req->labels, '"');
-	}
+	if (metric->sub_name != NULL)
+		str_append_str(req->labels, metric->sub_name_label);
 
 	if (req->metric_type == OPENMETRICS_METRIC_TYPE_HISTOGRAM) {
 		if (metric->group_by == NULL ||
@@ -680,6 +672,7 @@ static void openmetrics_request_deinit(struct openmetrics_request *req)
 {
 	stats_metrics_iterate_deinit(&req->stats_iter);
 	str_free(&req->labels);
+	str_free(&req->out);
 	array_free(&req->sub_metric_stack);
 }
 
@@ -705,16 +698,21 @@ static int openmetrics_export(struct openmetrics_request *req)
 		return 1;
 	}
 
-	/* Export metrics into a string buffer and write that buffer to the
-	   output stream after each (sub-)metric, so that the string buffer
-	   stays small. The output stream buffer can grow bigger, but writing is
-	   stopped for later resumption when the output stream buffer has grown
+	/* Export metrics into a reusable string buffer and write it to the
+	   output stream whenever it has grown to IO_BLOCK_SIZE, so that the
+	   buffer stays small without sending each (sub-)metric separately.
+	   The output stream buffer can grow bigger, but writing is stopped
+	   for later resumption when the output stream buffer has grown
 	   beyond an optimal size. */
-	out = t_str_new(1024);
+	if (req->out == NULL)
+		req->out = str_new(default_pool, IO_BLOCK_SIZE * 2);
+	out = req->out;
 	for (;;) {
 		str_truncate(out, 0);
 
-		openmetrics_export_continue(req, out);
+		while (str_len(out) < IO_BLOCK_SIZE &&
+		       req->state != OPENMETRICS_REQUEST_STATE_FINISHED)
+			openmetrics_export_continue(req, out);
 
 		ret = openmetrics_send_buffer(req, out);
 		if (ret < 0) {
@@ -760,6 +758,32 @@ static void openmetrics_request_destroy(struct openmetrics_request *req)
 	openmetrics_request_deinit(req);
 }
 
+static bool openmetrics_request_accepts_gzip(const struct http_request *hreq)
+{
+	const char *value, *const *codings, *coding, *params;
+
+	value = http_request_header_get(hreq, "Accept-Encoding");
+	if (value == NULL)
+		return FALSE;
+	codings = t_strsplit(value, ",");
+	for (; *codings != NULL; codings++) {
+		/* <coding>[;q=<weight>] */
+		coding = t_str_trim(*codings, " \t");
+		params = strchr(coding, ';');
+		if (params != NULL) {
+			coding = t_str_trim(t_strdup_until(coding, params),
+					    " \t");
+			params = t_str_trim(params + 1, " \t");
+			if (str_begins_icase_with(params, "q=0") &&
+			    strspn(params + 3, ".0") == strlen(params + 3))
+				continue;
+		}
+		if (strcasecmp(coding, "gzip") == 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
 static void
 stats_service_openmetrics_request(void *context ATTR_UNUSED,
 				  struct http_server_request *hsreq,
@@ -768,6 +792,7 @@ stats_service_openmetrics_request(void *context ATTR_UNUSED,
 	const struct http_request *hreq = http_server_request_get(hsreq);
 	struct http_server_response *hsresp;
 	struct openmetrics_request *req;
+	const struct compression_handler *gz_handler = NULL;
 	pool_t pool;
 
 	if (strcmp(hreq->method, "OPTIONS") == 0) {
@@ -791,14 +816,30 @@ stats_service_openmetrics_request(void *context ATTR_UNUSED,
 	http_server_request_set_destroy_callback(
 		hsreq, openmetrics_request_destroy, req);
 
+	if (openmetrics_request_accepts_gzip(hreq) &&
+	    compression_lookup_handler("gz", &gz_handler) <= 0)
+		gz_handler = NULL;
+
 	hsresp = http_server_response_create(hsreq, 200, "OK");
 	http_server_response_add_header(
 		hsresp, "Content-Type",
 		"application/openmetrics-text; version="OPENMETRICS_CONTENT_VERSION"; "
 		"charset=utf-8");
+	http_server_response_add_header(hsresp, "Vary", "Accept-Encoding");
+	if (gz_handler != NULL) {
+		http_server_response_add_header(hsresp, "Content-Encoding",
+						"gzip");
+	}
 
 	req->output = http_server_response_get_payload_output(
 		hsresp, SIZE_MAX, FALSE);
+	if (gz_handler != NULL) {
+		struct ostream *payload_output = req->output;
+
+		/* the scrapes are frequent, so prefer speed over size */
+		req->output = gz_handler->create_ostream(payload_output, 1);
+		o_stream_unref(&payload_output);
+	}
 
 	o_stream_set_flush_callback(req->output, openmetrics_export, req);
 	o_stream_set_flush_pending(req->output, TRUE);
@@ -60,6 +60,7 @@ struct service_settings stats_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -69,12 +70,66 @@ struct service_settings stats_service_settings = {
 	.service_count = 0,
 	.idle_kill = UINT_MAX,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &stats_unix_listeners_buf,
 			      sizeof(stats_unix_listeners[0]) } },
 	.inet_listeners = ARRAY_INIT,
 };
 
+/* <settings checks> */
+static struct file_listener_settings stats_shard_unix_listeners_array[] = {
+	{
+		.path = "stats-shard-writer",
+		.type = "writer",
+		.mode = 0660,
+		.user = "",
+		.group = "$default_internal_group",
+	},
+	{
+		.path = "login/stats-shard-writer",
+		.type = "writer",
+		.mode = 0600,
+		.user = "$default_login_user",
+		.group = "",
+	},
+};
+static struct file_listener_settings *stats_shard_unix_listeners[] = {
+	&stats_shard_unix_listeners_array[0],
+	&stats_shard_unix_listeners_array[1],
+};
+static buffer_t stats_shard_unix_listeners_buf = {
+	{ { stats_shard_unix_listeners, sizeof(stats_shard_unix_listeners) } }
+};
+/* </settings checks> */
+
+struct service_settings stats_shard_service_settings = {
+	.name = "stats-shard",
+	.protocol = "",
+	.type = "",
+	.executable = "stats -s",
+	.user = "$default_internal_user",
+	.group = "",
+	.privileged_group = "",
+	.extra_groups = "",
+	.chroot = "",
+	.cpu_affinity = "",
+
+	.drop_priv_before_exec = FALSE,
+
+	.process_min_avail = 0,
+	.process_limit = 0,
+	.client_limit = 0,
+	.service_count = 0,
+	.idle_kill = UINT_MAX,
+	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
+
+	.unix_listeners = { { &stats_shard_unix_listeners_buf,
+			      sizeof(stats_shard_unix_listeners[0]) } },
+	.inet_listeners = ARRAY_INIT,
+};
+
 /*
  * event_exporter { } block settings
  */
@@ -88,6 +143,10 @@ static const struct setting_define stats_exporter_setting_defines[] = {
 	DEF(STR, transport),
 	DEF(STR, transport_args),
 	DEF(TIME_MSECS, transport_timeout),
+	DEF(UINT, transport_batch_size),
+	DEF(TIME_MSECS, transport_batch_interval),
+	DEF(SIZE, transport_queue_max_size),
+	DEF(STR, transport_compression),
 	DEF(STR, format),
 	DEF(STR, format_args),
 	SETTING_DEFINE_LIST_END
@@ -98,6 +157,10 @@ static const struct stats_exporter_settings stats_exporter_default_settings = {
 	.transport = "",
 	.transport_args = "",
 	.transport_timeout = 250, /* ms */
+	.transport_batch_size = 0,
+	.transport_batch_interval = 1000, /* ms */
+	.transport_queue_max_size = 8*1024*1024,
+	.transport_compression = "",
 	.format = "",
 	.format_args = "",
 };
@@ -129,6 +192,7 @@ static const struct setting_define stats_metric_setting_defines[] = {
 	DEF(STR, exporter),
 	DEF(STR, exporter_include),
 	DEF(STR, description),
+	DEF(BOOL, client_aggregate),
 	SETTING_DEFINE_LIST_END
 };
 
@@ -140,6 +204,7 @@ static const struct stats_metric_settings stats_metric_default_settings = {
 	.group_by = "",
 	.exporter_include = STATS_METRIC_SETTINGS_DEFAULT_EXPORTER_INCLUDE,
 	.description = "",
+	.client_aggregate = FALSE,
 };
 
 const struct setting_parser_info stats_metric_setting_parser_info = {
@@ -168,6 +233,7 @@ const struct setting_parser_info stats_metric_setting_parser_info = {
 
 static const struct setting_define stats_setting_defines[] = {
 	DEF(STR, stats_http_rawlog_dir),
+	DEF(TIME_MSECS, stats_client_aggregate_interval),
 
 	DEFLIST_UNIQUE(metrics, "metric", &stats_metric_setting_parser_info),
 	DEFLIST_UNIQUE(exporters, "event_exporter", &stats_exporter_setting_parser_info),
@@ -176,6 +242,7 @@ static const struct setting_define stats_setting_defines[] = {
 
 const struct stats_settings stats_default_settings = {
 	.stats_http_rawlog_dir = "",
+	.stats_client_aggregate_interval = 1000,
 
 	.metrics = ARRAY_INIT,
 	.exporters = ARRAY_INIT,
@@ -296,6 +363,23 @@ static bool stats_exporter_settings_check(void *_set, pool_t pool ATTR_UNUSED,
 		return FALSE;
 	}
 
+	if (strcmp(set->transport, "http-post") != 0 &&
+	    (set->transport_batch_size > 0 ||
+	     set->transport_compression[0] != '\0')) {
+		*error_r = "transport_batch_size and transport_compression "
+			"can be used only with http-post transport";
+		return FALSE;
+	}
+	/* only the ones that have a HTTP Content-Encoding */
+	if (set->transport_compression[0] != '\0' &&
+	    strcmp(set->transport_compression, "gz") != 0 &&
+	    strcmp(set->transport_compression, "deflate") != 0 &&
+	    strcmp(set->transport_compression, "zstd") != 0) {
+		*error_r = t_strdup_printf("Unsupported transport_compression "
+					   "'%s'", set->transport_compression);
+		return FALSE;
+	}
+
 	if (!parse_format_args(set, error_r))
 		return FALSE;
 
@@ -461,6 +545,47 @@ parse_metric_group_by_mod(pool_t pool ATTR_UNUSED,
 	return TRUE;
 }
 
+static bool
+parse_metric_group_by_top(struct stats_metric_settings *set,
+			  struct stats_metric_settings_group_by *group_by,
+			  const char *const *params, const char **error_r)
+{
+	const char *const *fields;
+	unsigned int i;
+
+	/* <count>[:<weight field>] */
+	if (params[0] == NULL || str_to_uint(params[0], &group_by->top_count) < 0 ||
+	    group_by->top_count == 0) {
+		*error_r = t_strdup_printf("group_by '%s' top function requires "
+					   "a positive count", group_by->field);
+		return FALSE;
+	}
+	group_by->func = STATS_METRIC_GROUPBY_TOP;
+	group_by->top_weight_field_idx = UINT_MAX;
+	if (params[1] == NULL)
+		return TRUE;
+	if (params[2] != NULL) {
+		*error_r = t_strdup_printf("group_by '%s' top function takes "
+					   "at most 2 parameters",
+					   group_by->field);
+		return FALSE;
+	}
+
+	/* the weight is taken from the metric's field stats, so it's
+	   available also when merging metrics from stats-shard processes */
+	fields = t_strsplit_spaces(set->fields, " ");
+	for (i = 0; fields[i] != NULL; i++) {
+		if (strcmp(fields[i], params[1]) == 0) {
+			group_by->top_weight_field_idx = i;
+			return TRUE;
+		}
+	}
+	*error_r = t_strdup_printf("group_by '%s' top function weight field "
+				   "'%s' isn't listed in fields",
+				   group_by->field, params[1]);
+	return FALSE;
+}
+
 static bool parse_metric_group_by(struct stats_metric_settings *set,
 				  pool_t pool, const char **error_r)
 {
@@ -498,6 +623,18 @@ static bool parse_metric_group_by(struct stats_metric_settings *set,
 			/* <field>:linear:<min val>:<max val>:<step> */
 			if (!parse_metric_group_by_lin(pool, &group_by, &params[2], error_r))
 				return FALSE;
+		} else if (strcmp(params[1], "top") == 0) {
+			/* <field>:top:<count>[:<weight field>] */
+			if (!parse_metric_group_by_top(set, &group_by, &params[2], error_r))
+				return FALSE;
+			/* the other values' sub-metrics are merged into one,
+			   so they can't be grouped further */
+			if (tmp[1] != NULL) {
+				*error_r = t_strdup_printf("group_by '%s' top "
+					"function must be the last group_by",
+					group_by.field);
+				return FALSE;
+			}
 		} else {
 			*error_r = t_strdup_printf("unknown aggregation function "
 						   "'%s' on field '%s'", params[1], params[0]);
@@ -532,6 +669,19 @@ static bool stats_metric_settings_check(void *_set, pool_t pool, const char **er
 	if (!parse_metric_group_by(set, pool, error_r))
 		return FALSE;
 
+	if (set->client_aggregate) {
+		/* the processes send only the totals */
+		if (set->group_by[0] != '\0') {
+			*error_r = t_strdup_printf("metric %s { client_aggregate } "
+				"can't be used with group_by", set->metric_name);
+			return FALSE;
+		}
+		if (set->exporter[0] != '\0') {
+			*error_r = t_strdup_printf("metric %s { client_aggregate } "
+				"can't be used with exporter", set->metric_name);
+			return FALSE;
+		}
+	}
 	return TRUE;
 }
 
@@ -65,6 +65,13 @@ struct stats_exporter_settings {
 	const char *transport;
 	const char *transport_args;
 	unsigned int transport_timeout;
+	/* http-post: send up to this many events in one request */
+	unsigned int transport_batch_size;
+	unsigned int transport_batch_interval;
+	/* http-post: drop events when this many bytes are waiting to be
+	   sent */
+	uoff_t transport_queue_max_size;
+	const char *transport_compression;
 	const char *format;
 	const char *format_args;
 
@@ -76,6 +83,9 @@ struct stats_exporter_settings {
 enum stats_metric_group_by_func {
 	STATS_METRIC_GROUPBY_DISCRETE = 0,
 	STATS_METRIC_GROUPBY_QUANTIZED,
+	/* discrete, but only the top_count values with the highest weight are
+	   kept and the rest are counted in a single "other" sub-metric */
+	STATS_METRIC_GROUPBY_TOP,
 };
 
 /* A modifier for discrete group by.
@@ -105,6 +115,11 @@ struct stats_metric_settings_group_by {
 	enum stats_metric_group_by_modifier mod;
 	unsigned int num_ranges;
 	struct stats_metric_settings_bucket_range *ranges;
+
+	unsigned int top_count;
+	/* Index of the metric field whose sum is used as the weight, or
+	   UINT_MAX if the values are weighted by the number of events. */
+	unsigned int top_weight_field_idx;
 };
 /* </settings checks> */
 
@@ -121,10 +136,15 @@ struct stats_metric_settings {
 	/* exporter related fields */
 	const char *exporter;
 	const char *exporter_include;
+
+	/* Processes count the metric themselves and send only the totals
+	   every stats_client_aggregate_interval. */
+	bool client_aggregate;
 };
 
 struct stats_settings {
 	const char *stats_http_rawlog_dir;
+	unsigned int stats_client_aggregate_interval;
 
 	ARRAY(struct stats_exporter_settings *) exporters;
 	ARRAY(struct stats_metric_settings *) metrics;
@@ -0,0 +1,116 @@
+/* Copyright (c) 2026 Dovecot authors, see the included COPYING file */
+
+#include "stats-common.h"
+#include "ioloop.h"
+#include "str.h"
+#include "ostream.h"
+#include "connection.h"
+#include "stats-metrics.h"
+#include "stats-shard.h"
+
+struct stats_shard {
+	struct connection conn;
+	struct timeout *to_flush;
+	bool connected;
+};
+
+static struct connection_list *shard_connections = NULL;
+static struct stats_shard *shard = NULL;
+
+static int
+stats_shard_input_args(struct connection *conn ATTR_UNUSED,
+		       const char *const *args ATTR_UNUSED)
+{
+	/* The main stats process sends the same handshake as to all other
+	   stats clients. This process already has the same settings, so just
+	   ignore it. */
+	return 1;
+}
+
+static void stats_shard_destroy(struct connection *conn)
+{
+	struct stats_shard *shard = (struct stats_shard *)conn;
+
+	shard->connected = FALSE;
+	connection_disconnect(conn);
+}
+
+static bool stats_shard_connect(struct stats_shard *shard)
+{
+	if (shard->connected)
+		return TRUE;
+	if (connection_client_connect(&shard->conn) < 0) {
+		e_error(shard->conn.event, "net_connect_unix(%s) failed: %m",
+			shard->conn.name);
+		return FALSE;
+	}
+	shard->connected = TRUE;
+	return TRUE;
+}
+
+static void stats_shard_flush(struct stats_shard *shard)
+{
+	string_t *str;
+
+	if (!stats_shard_connect(shard)) {
+		/* keep the metrics and try again later */
+		return;
+	}
+
+	str = t_str_new(1024);
+	stats_metrics_export_shard(stats_metrics, str);
+	o_stream_nsend(shard->conn.output, str_data(str), str_len(str));
+	stats_metrics_reset(stats_metrics);
+}
+
+static void stats_shard_flush_timeout(struct stats_shard *shard)
+{
+	T_BEGIN {
+		stats_shard_flush(shard);
+	} T_END;
+}
+
+static const struct connection_vfuncs shard_client_vfuncs = {
+	.input_args = stats_shard_input_args,
+	.destroy = stats_shard_destroy,
+};
+
+static const struct connection_settings shard_client_set = {
+	.service_name_in = "stats-server",
+	.service_name_out = "stats-client",
+	.major_version = 4,
+	.minor_version = 1,
+
+	.input_max_size = SIZE_MAX,
+	.output_max_size = SIZE_MAX,
+	.client = TRUE,
+};
+
+void stats_shard_init(const char *base_dir, unsigned int interval_msecs)
+{
+	const char *path = t_strconcat(base_dir, "/",
+		STATS_SHARD_AGGREGATOR_SOCKET_NAME, NULL);
+
+	shard_connections = connection_list_init(&shard_client_set,
+						 &shard_client_vfuncs);
+	shard = i_new(struct stats_shard, 1);
+	connection_init_client_unix(shard_connections, &shard->conn, path);
+	shard->to_flush = timeout_add(interval_msecs,
+				      stats_shard_flush_timeout, shard);
+}
+
+void stats_shard_deinit(void)
+{
+	if (shard == NULL)
+		return;
+
+	/* send the metrics counted since the last flush */
+	stats_shard_flush_timeout(shard);
+	if (shard->connected)
+		(void)o_stream_flush(shard->conn.output);
+
+	timeout_remove(&shard->to_flush);
+	connection_deinit(&shard->conn);
+	i_free(shard);
+	connection_list_deinit(&shard_connections);
+}
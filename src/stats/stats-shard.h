@@ -0,0 +1,11 @@
+#ifndef STATS_SHARD_H
+#define STATS_SHARD_H
+
+/* stats-shard processes count the events from the processes connected to
+   them and send the metrics to the main stats process every interval. */
+#define STATS_SHARD_AGGREGATOR_SOCKET_NAME "stats-writer"
+
+void stats_shard_init(const char *base_dir, unsigned int interval_msecs);
+void stats_shard_deinit(void);
+
+#endif
@@ -5,6 +5,7 @@
 #include "client-reader.h"
 #include "connection.h"
 #include "ostream.h"
+#include "stats-sketch.h"
 
 static struct connection_list *conn_list;
 
@@ -54,12 +55,21 @@ static const char *const settings_blob_1[] = {
 static int test_reader_server_input_args(struct connection *conn ATTR_UNUSED,
 					 const char *const *args)
 {
+	struct stats_sketch *sketch;
+	const char *error;
+
 	if (args[0] == NULL)
 		return -1;
 
 	test_assert_strcmp(args[0], "test");
 	test_assert_strcmp(args[1], "1");
 
+	/* the exported sketch can be merged elsewhere */
+	sketch = stats_sketch_init();
+	test_assert(args[2] != NULL &&
+		    stats_sketch_import(sketch, args[2], &error) == 0);
+	test_assert(stats_sketch_get_count(sketch) == 1);
+	stats_sketch_deinit(&sketch);
 	return 1;
 }
 
@@ -75,7 +85,7 @@ static void test_dump_metrics(void)
 
 	client_reader_create(fds[1]);
 	connection_init_client_fd(conn_list, conn, "stats", fds[0], fds[0]);
-	o_stream_nsend_str(conn->output, "DUMP\tcount\n");
+	o_stream_nsend_str(conn->output, "DUMP\tcount\tsketch\n");
 
 	io_loop_run(loop);
 	connection_deinit(conn);
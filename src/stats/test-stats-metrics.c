@@ -2,6 +2,7 @@
 
 #include "test-stats-common.h"
 #include "array.h"
+#include "strescape.h"
 
 bool test_stats_callback(struct event *event,
 			 enum event_callback_type type ATTR_UNUSED,
@@ -92,6 +93,151 @@ static void test_stats_metrics_filter(void)
 	test_end();
 }
 
+static const char *const settings_blob_3[] = {
+	"metric=test",
+	"metric/test/metric_name=test",
+	"metric/test/filter=event=test",
+	"metric/test/fields=num",
+	"metric/test/client_aggregate=yes",
+	NULL
+};
+
+static void test_stats_metrics_client_aggregate(void)
+{
+	const char *error;
+
+	test_begin("stats metrics (client aggregate)");
+
+	test_init(settings_blob_3);
+
+	/* the filter sent to clients doesn't include the metric */
+	struct event_filter *filter =
+		stats_metrics_get_unaggregated_event_filter(stats_metrics);
+	string_t *str_filter = t_str_new(64);
+	event_filter_export(filter, str_filter);
+	test_assert_strcmp("", str_c(str_filter));
+
+	/* 3 events with durations 3, 5, 3 and num=10 in all of them */
+	const char *const args[] = {
+		"test", "6 3 5 11 3 2 0 1", "6 10 10 30 10 3", NULL
+	};
+	test_assert(stats_metrics_merge_client_aggregate(stats_metrics,
+							 args, &error));
+	test_assert(get_stats_dist_field("test", STATS_DIST_COUNT) == 3);
+	test_assert(get_stats_dist_field("test", STATS_DIST_SUM) == 11);
+
+	/* unknown metrics are ignored */
+	const char *const args_unknown[] = {
+		"unknown", "6 3 5 11 3 2 0 1", NULL
+	};
+	test_assert(stats_metrics_merge_client_aggregate(stats_metrics,
+							 args_unknown, &error));
+
+	/* field is missing */
+	const char *const args_invalid[] = {
+		"test", "6 3 5 11 3 2 0 1", NULL
+	};
+	error = NULL;
+	test_assert(!stats_metrics_merge_client_aggregate(stats_metrics,
+							  args_invalid, &error));
+	test_assert(error != NULL);
+	test_assert(get_stats_dist_field("test", STATS_DIST_COUNT) == 3);
+
+	test_deinit();
+	test_end();
+}
+
+static const char *const settings_blob_4[] = {
+	"metric=test",
+	"metric/test/metric_name=test",
+	"metric/test/filter=event=test",
+	"metric/test/fields=num",
+	"metric/test/group_by=test_name num:linear:10:30:10",
+	NULL
+};
+
+static void test_stats_metrics_shard(void)
+{
+	static const char *const names[] = { "alpha", "beta", "alpha" };
+	struct stats_metrics_iter *iter;
+	const struct metric *metric, *sub_metric;
+	const char *const *lines, *const *args, *error;
+	string_t *str = t_str_new(256);
+	unsigned int i;
+
+	test_begin("stats metrics (shard)");
+	test_init(settings_blob_4);
+
+	for (i = 0; i < N_ELEMENTS(names); i++) {
+		struct event *event = event_create(NULL);
+		event_add_category(event, &test_category);
+		event_set_name(event, "test");
+		event_add_str(event, "test_name", names[i]);
+		event_add_int(event, "num", 15 + i*10);
+		test_event_send(event);
+		event_unref(&event);
+	}
+
+	/* move the metrics through the export */
+	stats_metrics_export_shard(stats_metrics, str);
+	stats_metrics_reset(stats_metrics);
+	test_assert(get_stats_dist_field("test", STATS_DIST_COUNT) == 0);
+	str_truncate(str, str_len(str) - 1);
+	lines = t_strsplit(str_c(str), "\n");
+	/* test, alpha, alpha/num_11_20, alpha/num_31_40, beta and
+	   beta/num_21_30 */
+	test_assert(str_array_length(lines) == 6);
+	for (i = 0; lines[i] != NULL; i++) {
+		args = t_strsplit_tabescaped(lines[i]);
+		test_assert_strcmp_idx(args[0], "SHARD", i);
+		test_assert_idx(stats_metrics_merge_shard(stats_metrics,
+							  args + 1, &error), i);
+	}
+
+	iter = stats_metrics_iterate_init(stats_metrics);
+	metric = stats_metrics_iterate(iter);
+	stats_metrics_iterate_deinit(&iter);
+	test_assert(stats_dist_get_count(metric->duration_stats) == 3);
+	test_assert(stats_dist_get_sum(metric->fields[0].stats) == 75);
+	test_assert(array_count(&metric->sub_metrics) == 2);
+	sub_metric = array_idx_elem(&metric->sub_metrics, 0);
+	test_assert_strcmp(sub_metric->sub_name, "alpha");
+	test_assert(stats_dist_get_count(sub_metric->duration_stats) == 2);
+	test_assert(array_count(&sub_metric->sub_metrics) == 2);
+
+	/* merging creates missing sub-metrics */
+	test_deinit();
+	test_init(settings_blob_4);
+	for (i = 0; lines[i] != NULL; i++) {
+		args = t_strsplit_tabescaped(lines[i]);
+		test_assert_idx(stats_metrics_merge_shard(stats_metrics,
+							  args + 1, &error), i);
+	}
+	iter = stats_metrics_iterate_init(stats_metrics);
+	metric = stats_metrics_iterate(iter);
+	stats_metrics_iterate_deinit(&iter);
+	test_assert(stats_dist_get_count(metric->duration_stats) == 3);
+	test_assert(array_count(&metric->sub_metrics) == 2);
+	sub_metric = array_idx_elem(&metric->sub_metrics, 1);
+	test_assert_strcmp(sub_metric->sub_name, "beta");
+	test_assert(array_count(&sub_metric->sub_metrics) == 1);
+	sub_metric = array_idx_elem(&sub_metric->sub_metrics, 0);
+	test_assert_strcmp(sub_metric->sub_name, "num_21_30");
+	test_assert(sub_metric->group_value.type ==
+		    METRIC_VALUE_TYPE_BUCKET_INDEX);
+	test_assert(stats_dist_get_count(sub_metric->duration_stats) == 1);
+
+	/* invalid input */
+	const char *const args_invalid[] = { "test", "1", "x", NULL };
+	error = NULL;
+	test_assert(!stats_metrics_merge_shard(stats_metrics, args_invalid,
+					       &error));
+	test_assert(error != NULL);
+
+	test_deinit();
+	test_end();
+}
+
 static void test_stats_metrics_group_by_check_one(const struct metric *metric,
 						  const char *sub_name,
 						  unsigned int total_count,
@@ -443,12 +589,99 @@ static void test_stats_metrics_group_by_quantized(void)
 		test_stats_metrics_group_by_quantized_real(&quantized_tests[i]);
 }
 
+static const char *const settings_blob_top[] = {
+	"metric=test",
+	"metric/test/metric_name=test",
+	"metric/test/filter=event=test",
+	"metric/test/fields=bytes",
+	"metric/test/group_by=user:top:2:bytes",
+	NULL
+};
+
+static void test_stats_metrics_group_by_top(void)
+{
+	static const struct {
+		const char *user;
+		unsigned int bytes;
+	} events[] = {
+		{ "alice", 100 },
+		{ "bob", 10 },
+		/* bob has the lowest weight and is moved to other */
+		{ "carol", 1 },
+		{ "alice", 50 },
+		/* carol has weight 10+1 and is moved to other */
+		{ "dave", 5 },
+	};
+	struct stats_metrics_iter *iter;
+	const struct metric *metric, *sub_metric;
+	unsigned int i;
+
+	test_begin("stats metrics (group by top)");
+	test_init(settings_blob_top);
+
+	for (i = 0; i < N_ELEMENTS(events); i++) {
+		struct event *event = event_create(NULL);
+		event_add_category(event, &test_category);
+		event_set_name(event, "test");
+		event_add_str(event, "user", events[i].user);
+		event_add_int(event, "bytes", events[i].bytes);
+		test_event_send(event);
+		event_unref(&event);
+	}
+
+	iter = stats_metrics_iterate_init(stats_metrics);
+	metric = stats_metrics_iterate(iter);
+	stats_metrics_iterate_deinit(&iter);
+	test_assert(stats_dist_get_sum(metric->fields[0].stats) == 166);
+	test_assert(array_count(&metric->sub_metrics) == 3);
+
+	sub_metric = array_idx_elem(&metric->sub_metrics, 0);
+	test_assert_strcmp(sub_metric->sub_name, "alice");
+	test_assert(stats_dist_get_sum(sub_metric->fields[0].stats) == 150);
+	test_assert(sub_metric->top_error == 0);
+
+	/* the sub-metric was reused for carol and then dave */
+	sub_metric = array_idx_elem(&metric->sub_metrics, 1);
+	test_assert_strcmp(sub_metric->sub_name, "dave");
+	test_assert(stats_dist_get_count(sub_metric->duration_stats) == 1);
+	test_assert(stats_dist_get_sum(sub_metric->fields[0].stats) == 5);
+	test_assert(sub_metric->top_error == 11);
+
+	sub_metric = array_idx_elem(&metric->sub_metrics, 2);
+	test_assert_strcmp(sub_metric->sub_name, "other");
+	test_assert(sub_metric->group_value.type == METRIC_VALUE_TYPE_OTHER);
+	test_assert(stats_dist_get_count(sub_metric->duration_stats) == 2);
+	test_assert(stats_dist_get_sum(sub_metric->fields[0].stats) == 11);
+
+	/* the other sub-metric survives the shard export */
+	string_t *str = t_str_new(256);
+	const char *const *lines, *const *args, *error;
+	stats_metrics_export_shard(stats_metrics, str);
+	stats_metrics_reset(stats_metrics);
+	str_truncate(str, str_len(str) - 1);
+	lines = t_strsplit(str_c(str), "\n");
+	test_assert(str_array_length(lines) == 4);
+	for (i = 0; lines[i] != NULL; i++) {
+		args = t_strsplit_tabescaped(lines[i]);
+		test_assert_idx(stats_metrics_merge_shard(stats_metrics,
+							  args + 1, &error), i);
+	}
+	sub_metric = array_idx_elem(&metric->sub_metrics, 2);
+	test_assert(stats_dist_get_count(sub_metric->duration_stats) == 2);
+
+	test_deinit();
+	test_end();
+}
+
 int main(void) {
 	void (*const test_functions[])(void) = {
 		test_stats_metrics,
 		test_stats_metrics_filter,
+		test_stats_metrics_client_aggregate,
+		test_stats_metrics_shard,
 		test_stats_metrics_group_by_discrete,
 		test_stats_metrics_group_by_quantized,
+		test_stats_metrics_group_by_top,
 		NULL
 	};
 
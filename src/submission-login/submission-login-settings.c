@@ -63,6 +63,7 @@ struct service_settings submission_login_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "",
 	.chroot = "login",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -72,6 +73,7 @@ struct service_settings submission_login_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &submission_login_unix_listeners_buf,
 			      sizeof(submission_login_unix_listeners[0]) } },
@@ -26,6 +26,7 @@
 #include "smtp-client.h"
 
 #include "submission-commands.h"
+#include "submission-backend-relay.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -443,6 +444,11 @@ int main(int argc, char *argv[])
 	master_service_init_finish(master_service);
 	/* NOTE: login_set.*_socket_path are now invalid due to data stack
 	   having been freed */
+	if (!IS_STANDALONE() &&
+	    master_service_get_process_min_avail(master_service) > 0) {
+		/* we're likely started to wait for clients */
+		mail_storage_service_preload(storage_service);
+	}
 
 	/* fake that we're running, so we know if client was destroyed
 	   while handling its initial input */
@@ -460,6 +466,7 @@ int main(int argc, char *argv[])
 		master_service_run(master_service, client_connected);
 	clients_destroy_all();
 
+	submission_backend_relay_idle_deinit();
 	smtp_client_deinit(&smtp_client);
 	smtp_server_deinit(&smtp_server);
 
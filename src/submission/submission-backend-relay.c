@@ -2,9 +2,11 @@
 
 #include "submission-common.h"
 #include "str.h"
+#include "strescape.h"
 #include "str-sanitize.h"
 #include "mail-user.h"
 #include "iostream-ssl.h"
+#include "dsasl-client.h"
 #include "smtp-client.h"
 #include "smtp-client-connection.h"
 #include "smtp-client-transaction.h"
@@ -13,19 +15,36 @@
 #include "submission-recipient.h"
 #include "submission-backend-relay.h"
 
+/* Maximum number of idle relay connections kept for reuse */
+#define SUBMISSION_RELAY_MAX_IDLE_CONNECTIONS 8
+
 struct submission_backend_relay {
 	struct submission_backend backend;
 
 	struct smtp_client_connection *conn;
 	struct smtp_client_transaction *trans;
 
+	/* Identifies the relay settings of a connection that can be reused
+	   by other clients, NULL if it can't be. */
+	const char *reuse_key;
+	unsigned int reuse_timeout;
+
 	bool trans_started:1;
 	bool trusted:1;
 	bool quit_confirmed:1;
+	bool reuse:1;
+};
+
+struct submission_relay_idle_connection {
+	struct smtp_client_connection *conn;
+	char *key;
+	struct timeout *to_idle;
 };
 
 static struct submission_backend_vfuncs backend_relay_vfuncs;
 
+static ARRAY(struct submission_relay_idle_connection *) relay_idle_conns;
+
 /*
  * Common
  */
@@ -1018,6 +1037,17 @@ static void relay_cmd_quit_relay(struct relay_cmd_quit_context *quit_cmd)
 		smtp_server_reply_quit(cmd);
 		return;
 	}
+	if (rbackend->reuse_key != NULL && rbackend->trans == NULL &&
+	    smtp_client_connection_get_state(rbackend->conn) ==
+		SMTP_CLIENT_CONNECTION_STATE_READY) {
+		/* All the previous commands have been replied to and there's
+		   no transaction. Keep the relay connection open for the next
+		   client instead of relaying QUIT. */
+		rbackend->reuse = TRUE;
+		quit_cmd->backend->quit_confirmed = TRUE;
+		smtp_server_reply_quit(cmd);
+		return;
+	}
 
 	/* RFC 5321, Section 4.1.1.10:
 
@@ -1068,6 +1098,131 @@ backend_relay_cmd_quit(struct submission_backend *backend,
 	return 0;
 }
 
+/*
+ * Idle connections
+ */
+
+static const char *
+backend_relay_get_reuse_key(const struct submision_backend_relay_settings *set)
+{
+	string_t *key = t_str_new(128);
+
+	str_printfa(key, "%d\t%u\t%d\t%u\t", set->protocol, set->port,
+		    set->ssl_mode, set->ssl_verify ? 1 : 0);
+	if (set->ip.family != 0)
+		str_append(key, net_ip2addr(&set->ip));
+	str_append_c(key, '\t');
+	str_append_tabescaped(key, set->path != NULL ? set->path : "");
+	str_append_c(key, '\t');
+	str_append_tabescaped(key, set->host != NULL ? set->host : "");
+	str_append_c(key, '\t');
+	str_append_tabescaped(key, set->user != NULL ? set->user : "");
+	str_append_c(key, '\t');
+	str_append_tabescaped(key, set->master_user != NULL ?
+			      set->master_user : "");
+	str_append_c(key, '\t');
+	str_append_tabescaped(key, set->password != NULL ?
+			      set->password : "");
+	str_append_c(key, '\t');
+	if (set->sasl_mech != NULL) {
+		str_append_tabescaped(key,
+			dsasl_client_mech_get_name(set->sasl_mech));
+	}
+	return str_c(key);
+}
+
+static void
+backend_relay_idle_connection_free(struct submission_relay_idle_connection *iconn)
+{
+	timeout_remove(&iconn->to_idle);
+	if (iconn->conn != NULL)
+		smtp_client_connection_close(&iconn->conn);
+	i_free(iconn->key);
+	i_free(iconn);
+}
+
+static void
+backend_relay_idle_timeout(struct submission_relay_idle_connection *iconn)
+{
+	struct submission_relay_idle_connection *const *iconns;
+	unsigned int i, count;
+
+	iconns = array_get(&relay_idle_conns, &count);
+	for (i = 0; i < count; i++) {
+		if (iconns[i] == iconn) {
+			array_delete(&relay_idle_conns, i, 1);
+			break;
+		}
+	}
+	backend_relay_idle_connection_free(iconn);
+}
+
+static void
+backend_relay_idle_put(struct submission_backend_relay *rbackend)
+{
+	struct submission_relay_idle_connection *iconn;
+
+	if (!array_is_created(&relay_idle_conns))
+		i_array_init(&relay_idle_conns, 4);
+	if (array_count(&relay_idle_conns) >=
+	    SUBMISSION_RELAY_MAX_IDLE_CONNECTIONS) {
+		/* drop the oldest one */
+		iconn = array_idx_elem(&relay_idle_conns, 0);
+		array_pop_front(&relay_idle_conns);
+		backend_relay_idle_connection_free(iconn);
+	}
+
+	iconn = i_new(struct submission_relay_idle_connection, 1);
+	iconn->conn = rbackend->conn;
+	iconn->key = i_strdup(rbackend->reuse_key);
+	iconn->to_idle = timeout_add(rbackend->reuse_timeout * 1000,
+				     backend_relay_idle_timeout, iconn);
+	array_push_back(&relay_idle_conns, &iconn);
+	rbackend->conn = NULL;
+}
+
+static struct smtp_client_connection *backend_relay_idle_take(const char *key)
+{
+	struct submission_relay_idle_connection *const *iconns, *iconn;
+	struct smtp_client_connection *conn = NULL;
+	unsigned int i, count;
+
+	if (!array_is_created(&relay_idle_conns))
+		return NULL;
+
+	/* prefer the most recently used connection */
+	iconns = array_get(&relay_idle_conns, &count);
+	for (i = count; i > 0; i--) {
+		iconn = iconns[i-1];
+		if (strcmp(iconn->key, key) != 0)
+			continue;
+
+		array_delete(&relay_idle_conns, i-1, 1);
+		if (smtp_client_connection_get_state(iconn->conn) ==
+		    SMTP_CLIENT_CONNECTION_STATE_READY) {
+			conn = iconn->conn;
+			iconn->conn = NULL;
+		}
+		backend_relay_idle_connection_free(iconn);
+		if (conn != NULL)
+			break;
+		/* it was disconnected in the meantime */
+		iconns = array_get(&relay_idle_conns, &count);
+	}
+	return conn;
+}
+
+void submission_backend_relay_idle_deinit(void)
+{
+	struct submission_relay_idle_connection *iconn;
+
+	if (!array_is_created(&relay_idle_conns))
+		return;
+	array_foreach_elem(&relay_idle_conns, iconn)
+		backend_relay_idle_connection_free(iconn);
+	array_free(&relay_idle_conns);
+}
+
 /*
  * Relay backend
  */
@@ -1124,6 +1279,17 @@ submission_backend_relay_create(
 		}
 		smtp_set.proxy_data.login = user->username;
 		smtp_set.xclient_defer = TRUE;
+	} else if (set->reuse_timeout > 0 && set->rawlog_dir == NULL) {
+		/* the connection doesn't have any client-specific state */
+		rbackend->reuse_key =
+			p_strdup(pool, backend_relay_get_reuse_key(set));
+		rbackend->reuse_timeout = set->reuse_timeout;
+		rbackend->conn = backend_relay_idle_take(rbackend->reuse_key);
+		if (rbackend->conn != NULL) {
+			e_debug(rbackend->backend.event,
+				"Reusing idle relay connection");
+			return rbackend;
+		}
 	}
 
 	smtp_set.username = set->user;
@@ -1176,7 +1342,13 @@ static void backend_relay_destroy(struct submission_backend *backend)
 
 	if (rbackend->trans != NULL)
 		smtp_client_transaction_destroy(&rbackend->trans);
-	if (rbackend->conn != NULL)
+	if (rbackend->conn == NULL)
+		return;
+	if (rbackend->reuse && rbackend->trans == NULL &&
+	    smtp_client_connection_get_state(rbackend->conn) ==
+		SMTP_CLIENT_CONNECTION_STATE_READY)
+		backend_relay_idle_put(rbackend);
+	else
 		smtp_client_connection_close(&rbackend->conn);
 }
 
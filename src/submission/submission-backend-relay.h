@@ -27,6 +27,9 @@ struct submision_backend_relay_settings {
 
 	const char *rawlog_dir;
 	unsigned int max_idle_time;
+	/* Keep the connection open for this long after the client QUITs, so
+	   that the next client in this process can reuse it (0 = disabled) */
+	unsigned int reuse_timeout;
 
 	unsigned int connect_timeout_msecs;
 	unsigned int command_timeout_msecs;
@@ -61,4 +64,7 @@ submission_backend_relay_init_transaction(
 	struct submission_backend_relay *backend,
 	enum smtp_client_transaction_flags flags);
 
+/* Close all the connections kept for reuse */
+void submission_backend_relay_idle_deinit(void);
+
 #endif
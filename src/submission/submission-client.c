@@ -138,6 +138,7 @@ client_create_backend_default(struct client *client,
 	relay_set.password = set->submission_relay_password;
 	relay_set.rawlog_dir = set->submission_relay_rawlog_dir;
 	relay_set.max_idle_time = set->submission_relay_max_idle_time;
+	relay_set.reuse_timeout = set->submission_relay_reuse_timeout;
 	relay_set.connect_timeout_msecs = set->submission_relay_connect_timeout;
 	relay_set.command_timeout_msecs = set->submission_relay_command_timeout;
 	relay_set.trusted = set->submission_relay_trusted;
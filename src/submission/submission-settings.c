@@ -49,6 +49,7 @@ struct service_settings submission_service_settings = {
 	.privileged_group = "",
 	.extra_groups = "$default_internal_group",
 	.chroot = "",
+	.cpu_affinity = "",
 
 	.drop_priv_before_exec = FALSE,
 
@@ -58,6 +59,7 @@ struct service_settings submission_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.restart_rss_limit = 0,
 
 	.unix_listeners = { { &submission_unix_listeners_buf,
 			      sizeof(submission_unix_listeners[0]) } },
@@ -101,6 +103,7 @@ static const struct setting_define submission_setting_defines[] = {
 
 	DEF(STR_VARS, submission_relay_rawlog_dir),
 	DEF(TIME, submission_relay_max_idle_time),
+	DEF(TIME, submission_relay_reuse_timeout),
 
 	DEF(TIME_MSECS, submission_relay_connect_timeout),
 	DEF(TIME_MSECS, submission_relay_command_timeout),
@@ -143,6 +146,7 @@ static const struct submission_settings submission_default_settings = {
 
 	.submission_relay_rawlog_dir = "",
 	.submission_relay_max_idle_time = 60*29,
+	.submission_relay_reuse_timeout = 0,
 
 	.submission_relay_connect_timeout = 30*1000,
 	.submission_relay_command_timeout = 60*5*1000,